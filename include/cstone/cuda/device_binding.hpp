@@ -0,0 +1,73 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Assignment of GPUs to the MPI ranks of a node
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <stdexcept>
+
+#include <mpi.h>
+
+namespace cstone
+{
+
+//! @brief rank of the calling process among the ranks of @p comm that share its node
+inline int nodeLocalRank(MPI_Comm comm = MPI_COMM_WORLD)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    MPI_Comm nodeComm;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nodeComm);
+
+    int localRank;
+    MPI_Comm_rank(nodeComm, &localRank);
+    MPI_Comm_free(&nodeComm);
+
+    return localRank;
+}
+
+/*! @brief the device ID that the calling rank should bind to, if there are @p numDevices GPUs per node
+ *
+ * @param numDevices  number of GPUs visible on each node, e.g. from cudaGetDeviceCount
+ * @param comm        communicator of all ranks that use GPUs
+ * @return            device ID in [0:numDevices]
+ *
+ * The ranks of a node are distributed round-robin over its devices. If there are more ranks than devices
+ * on a node, several ranks share the same device. Collective over @p comm.
+ */
+inline int deviceOfRank(int numDevices, MPI_Comm comm = MPI_COMM_WORLD)
+{
+    if (numDevices < 1) { throw std::runtime_error("cannot bind a rank to a GPU without visible devices\n"); }
+
+    return nodeLocalRank(comm) % numDevices;
+}
+
+} // namespace cstone
@@ -0,0 +1,395 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Halo exchange of device-resident arrays with CUDA packing kernels
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <array>
+#include <vector>
+
+#include <thrust/device_vector.h>
+
+#include "cstone/primitives/mpi_wrappers.hpp"
+
+#if __has_include(<mpi-ext.h>)
+#include <mpi-ext.h>
+#endif
+
+#include "device_scope.cuh"
+#include "errorcheck.cuh"
+#include "device_halo_exchange.cuh"
+
+namespace cstone
+{
+
+//! @brief array of device pointers and their transfer sizes, passed by value to the packing kernels
+template<class T>
+struct DeviceArrayPointers
+{
+    T* ptr[DeviceHaloExchanger<T>::maxArrays];
+    int transferBytes[DeviceHaloExchanger<T>::maxArrays];
+};
+
+/*! @brief byte offset of the first @p numArrays array segments in a message with @p count elements per array
+ *
+ * Each segment is padded to a multiple of 8 bytes, such that all transferred elements are naturally aligned.
+ * With numArrays = total number of arrays, this is the size of the message.
+ */
+CUDA_HOST_DEVICE_FUN inline std::size_t haloSegmentOffset(const int* transferBytes, int numArrays, std::size_t count)
+{
+    std::size_t offset = 0;
+    for (int i = 0; i < numArrays; ++i)
+    {
+        offset += (count * transferBytes[i] + 7) / 8 * 8;
+    }
+    return offset;
+}
+
+//! @brief byte offsets of the messages of all peers, given their offsets in elements per array
+inline std::vector<std::size_t> messageByteOffsets(const std::vector<std::size_t>& offsets, const int* transferBytes,
+                                                   int numArrays)
+{
+    std::vector<std::size_t> byteOffsets(offsets.size(), 0);
+    for (std::size_t i = 1; i < offsets.size(); ++i)
+    {
+        byteOffsets[i] =
+            byteOffsets[i - 1] + haloSegmentOffset(transferBytes, numArrays, offsets[i] - offsets[i - 1]);
+    }
+    return byteOffsets;
+}
+
+//! @brief page-locked host memory for staging buffers if MPI cannot access device memory
+template<class T>
+class PinnedHostBuffer
+{
+public:
+    PinnedHostBuffer() = default;
+
+    PinnedHostBuffer(const PinnedHostBuffer&) = delete;
+    PinnedHostBuffer& operator=(const PinnedHostBuffer&) = delete;
+
+    ~PinnedHostBuffer()
+    {
+        if (data_) { checkCudaErrors(cudaFreeHost(data_)); }
+    }
+
+    void reserve(std::size_t newSize)
+    {
+        if (newSize > size_)
+        {
+            if (data_) { checkCudaErrors(cudaFreeHost(data_)); }
+            checkCudaErrors(cudaMallocHost((void**)&data_, newSize * sizeof(T)));
+            size_ = newSize;
+        }
+    }
+
+    T* data() { return data_; }
+
+private:
+    T* data_{nullptr};
+    std::size_t size_{0};
+};
+
+template<class T>
+class DeviceHaloBuffers
+{
+public:
+    using IndexType = SendManifest::IndexType;
+
+    DeviceHaloBuffers() { checkCudaErrors(cudaStreamCreate(&stream)); }
+
+    DeviceHaloBuffers(const DeviceHaloBuffers&) = delete;
+    DeviceHaloBuffers& operator=(const DeviceHaloBuffers&) = delete;
+
+    ~DeviceHaloBuffers() { checkCudaErrors(cudaStreamDestroy(stream)); }
+
+    //! @brief peer ranks with non-zero message sizes, the offsets of their messages and flattened index lists
+    struct Peers
+    {
+        std::vector<int> ranks;
+        std::vector<std::size_t> offsets;
+        thrust::device_vector<IndexType> d_indices;
+    };
+
+    static void setupPeers(const SendList& halos, Peers& peers)
+    {
+        peers.ranks.clear();
+        peers.offsets.assign(1, 0);
+
+        std::vector<IndexType> indices;
+        for (std::size_t rank = 0; rank < halos.size(); ++rank)
+        {
+            if (halos[rank].totalCount() == 0) { continue; }
+
+            peers.ranks.push_back(rank);
+            peers.offsets.push_back(peers.offsets.back() + halos[rank].totalCount());
+            for (std::size_t rangeIdx = 0; rangeIdx < halos[rank].nRanges(); ++rangeIdx)
+            {
+                for (IndexType i = halos[rank].rangeStart(rangeIdx); i < halos[rank].rangeEnd(rangeIdx); ++i)
+                {
+                    indices.push_back(i);
+                }
+            }
+        }
+        peers.d_indices = indices;
+    }
+
+    //! @brief make room for @p sendBytes and @p receiveBytes in the staging buffers
+    void reserve(std::size_t sendBytes, std::size_t receiveBytes, bool gpuAware)
+    {
+        if (d_sendBuffer.size() < sendBytes) { d_sendBuffer.resize(sendBytes); }
+        if (d_receiveBuffer.size() < receiveBytes) { d_receiveBuffer.resize(receiveBytes); }
+        if (!gpuAware)
+        {
+            h_sendBuffer.reserve(sendBytes);
+            h_receiveBuffer.reserve(receiveBytes);
+        }
+    }
+
+    Peers send;
+    Peers receive;
+
+    //! @brief messages of all peers, each message holds one padded segment per array, see haloSegmentOffset
+    thrust::device_vector<char> d_sendBuffer;
+    thrust::device_vector<char> d_receiveBuffer;
+
+    PinnedHostBuffer<char> h_sendBuffer;
+    PinnedHostBuffer<char> h_receiveBuffer;
+
+    //! @brief stream for packing, unpacking and staging copies
+    cudaStream_t stream;
+};
+
+//! @brief store @p value converted to the transfer type with @p transferBytes bytes
+template<class T>
+__device__ void storeTransfer(T value, int transferBytes, char* dst)
+{
+    if (transferBytes == sizeof(T)) { *reinterpret_cast<T*>(dst) = value; }
+    else if (transferBytes == sizeof(float)) { *reinterpret_cast<float*>(dst) = float(value); }
+    else { *reinterpret_cast<BFloat16*>(dst) = BFloat16(float(value)); }
+}
+
+//! @brief inverse of storeTransfer
+template<class T>
+__device__ T loadTransfer(int transferBytes, const char* src)
+{
+    if (transferBytes == sizeof(T)) { return *reinterpret_cast<const T*>(src); }
+    else if (transferBytes == sizeof(float)) { return T(*reinterpret_cast<const float*>(src)); }
+    else { return T(float(*reinterpret_cast<const BFloat16*>(src))); }
+}
+
+/*! @brief copy the elements at @p indices of all arrays into contiguous array-major order
+ *
+ * Element i of array a is converted to the transfer type of a and stored at element i of the segment of a,
+ * see haloSegmentOffset.
+ */
+template<class T, class IndexType>
+__global__ void packHalosKernel(DeviceArrayPointers<T> arrays, int numArrays, const IndexType* indices,
+                                std::size_t count, char* buffer)
+{
+    std::size_t tid = blockIdx.x * blockDim.x + threadIdx.x;
+
+    if (tid < count * numArrays)
+    {
+        int arrayIndex    = tid / count;
+        std::size_t i     = tid - arrayIndex * count;
+        int transferBytes = arrays.transferBytes[arrayIndex];
+        char* segment     = buffer + haloSegmentOffset(arrays.transferBytes, arrayIndex, count);
+
+        storeTransfer(arrays.ptr[arrayIndex][indices[i]], transferBytes, segment + i * transferBytes);
+    }
+}
+
+//! @brief inverse of packHalosKernel, scatter the buffer into the elements at @p indices of all arrays
+template<class T, class IndexType>
+__global__ void unpackHalosKernel(DeviceArrayPointers<T> arrays, int numArrays, const IndexType* indices,
+                                  std::size_t count, const char* buffer)
+{
+    std::size_t tid = blockIdx.x * blockDim.x + threadIdx.x;
+
+    if (tid < count * numArrays)
+    {
+        int arrayIndex      = tid / count;
+        std::size_t i       = tid - arrayIndex * count;
+        int transferBytes   = arrays.transferBytes[arrayIndex];
+        const char* segment = buffer + haloSegmentOffset(arrays.transferBytes, arrayIndex, count);
+
+        arrays.ptr[arrayIndex][indices[i]] = loadTransfer<T>(transferBytes, segment + i * transferBytes);
+    }
+}
+
+template<class T>
+DeviceHaloExchanger<T>::DeviceHaloExchanger(int deviceId)
+    : deviceId_(deviceId)
+{
+    DeviceScope scope(deviceId_);
+    buffers_ = std::make_unique<DeviceHaloBuffers<T>>();
+}
+
+template<class T>
+DeviceHaloExchanger<T>::DeviceHaloExchanger(DeviceHaloExchanger&&) noexcept = default;
+
+template<class T>
+DeviceHaloExchanger<T>& DeviceHaloExchanger<T>::operator=(DeviceHaloExchanger&&) noexcept = default;
+
+template<class T>
+DeviceHaloExchanger<T>::~DeviceHaloExchanger()
+{
+    DeviceScope scope(deviceId_);
+    buffers_.reset();
+}
+
+template<class T>
+void DeviceHaloExchanger<T>::setup(const SendList& incomingHalos, const SendList& outgoingHalos, MPI_Comm comm)
+{
+    DeviceScope scope(deviceId_);
+    comm_ = comm;
+    DeviceHaloBuffers<T>::setupPeers(outgoingHalos, buffers_->send);
+    DeviceHaloBuffers<T>::setupPeers(incomingHalos, buffers_->receive);
+}
+
+template<class T>
+bool DeviceHaloExchanger<T>::gpuAwareMpi()
+{
+#if defined(CSTONE_HAVE_GPU_AWARE_MPI)
+    return true;
+#elif defined(MPIX_CUDA_AWARE_SUPPORT) && MPIX_CUDA_AWARE_SUPPORT
+    static bool gpuAware = MPIX_Query_cuda_support() == 1;
+    return gpuAware;
+#else
+    return false;
+#endif
+}
+
+template<class T>
+void DeviceHaloExchanger<T>::exchange(T* const* arrays, int numArrays)
+{
+    std::array<int, maxArrays> transferBytes;
+    transferBytes.fill(sizeof(T));
+    exchange(arrays, transferBytes.data(), numArrays);
+}
+
+template<class T>
+void DeviceHaloExchanger<T>::exchange(T* const* arrays, const int* transferBytes, int numArrays)
+{
+    if (numArrays > maxArrays) { throw std::runtime_error("too many arrays for a single device halo exchange\n"); }
+    for (int i = 0; i < numArrays; ++i)
+    {
+        if (transferBytes[i] != sizeof(T) && transferBytes[i] != sizeof(float) && transferBytes[i] != sizeof(BFloat16))
+        {
+            throw std::runtime_error("unsupported transfer precision in device halo exchange\n");
+        }
+    }
+
+    DeviceScope scope(deviceId_);
+    cudaStream_t stream = buffers_->stream;
+
+    DeviceArrayPointers<T> pointers;
+    std::copy(arrays, arrays + numArrays, pointers.ptr);
+    std::copy(transferBytes, transferBytes + numArrays, pointers.transferBytes);
+
+    auto& send    = buffers_->send;
+    auto& receive = buffers_->receive;
+
+    std::vector<std::size_t> sendBytes    = messageByteOffsets(send.offsets, transferBytes, numArrays);
+    std::vector<std::size_t> receiveBytes = messageByteOffsets(receive.offsets, transferBytes, numArrays);
+
+    bool gpuAware = gpuAwareMpi();
+    buffers_->reserve(sendBytes.back(), receiveBytes.back(), gpuAware);
+
+    char* d_sendBuffer     = thrust::raw_pointer_cast(buffers_->d_sendBuffer.data());
+    char* d_receiveBuffer  = thrust::raw_pointer_cast(buffers_->d_receiveBuffer.data());
+    char* mpiSendBuffer    = gpuAware ? d_sendBuffer : buffers_->h_sendBuffer.data();
+    char* mpiReceiveBuffer = gpuAware ? d_receiveBuffer : buffers_->h_receiveBuffer.data();
+
+    int haloTag = nextTagEpoch(comm_, ExchangeKind::halos);
+
+    std::vector<MPI_Request> receiveRequests(receive.ranks.size());
+    for (std::size_t i = 0; i < receive.ranks.size(); ++i)
+    {
+        MPI_Irecv(mpiReceiveBuffer + receiveBytes[i], int(receiveBytes[i + 1] - receiveBytes[i]), MPI_BYTE,
+                  receive.ranks[i], haloTag, comm_, &receiveRequests[i]);
+    }
+
+    constexpr int numThreads = 256;
+    for (std::size_t i = 0; i < send.ranks.size(); ++i)
+    {
+        std::size_t count = send.offsets[i + 1] - send.offsets[i];
+        int numBlocks     = (count * numArrays + numThreads - 1) / numThreads;
+        packHalosKernel<<<numBlocks, numThreads, 0, stream>>>(
+            pointers, numArrays, thrust::raw_pointer_cast(send.d_indices.data()) + send.offsets[i], count,
+            d_sendBuffer + sendBytes[i]);
+    }
+    checkCudaErrors(cudaGetLastError());
+
+    if (!gpuAware)
+    {
+        checkCudaErrors(
+            cudaMemcpyAsync(mpiSendBuffer, d_sendBuffer, sendBytes.back(), cudaMemcpyDeviceToHost, stream));
+    }
+    checkCudaErrors(cudaStreamSynchronize(stream));
+
+    std::vector<MPI_Request> sendRequests(send.ranks.size());
+    for (std::size_t i = 0; i < send.ranks.size(); ++i)
+    {
+        MPI_Isend(mpiSendBuffer + sendBytes[i], int(sendBytes[i + 1] - sendBytes[i]), MPI_BYTE, send.ranks[i],
+                  haloTag, comm_, &sendRequests[i]);
+    }
+
+    // unpack in the order of arrival
+    for (std::size_t numMessages = 0; numMessages < receive.ranks.size(); ++numMessages)
+    {
+        int i;
+        MPI_Waitany(int(receiveRequests.size()), receiveRequests.data(), &i, MPI_STATUS_IGNORE);
+
+        std::size_t count = receive.offsets[i + 1] - receive.offsets[i];
+        char* d_segment   = d_receiveBuffer + receiveBytes[i];
+        if (!gpuAware)
+        {
+            checkCudaErrors(cudaMemcpyAsync(d_segment, mpiReceiveBuffer + receiveBytes[i],
+                                            receiveBytes[i + 1] - receiveBytes[i], cudaMemcpyHostToDevice, stream));
+        }
+
+        int numBlocks = (count * numArrays + numThreads - 1) / numThreads;
+        unpackHalosKernel<<<numBlocks, numThreads, 0, stream>>>(
+            pointers, numArrays, thrust::raw_pointer_cast(receive.d_indices.data()) + receive.offsets[i], count,
+            d_segment);
+    }
+    checkCudaErrors(cudaGetLastError());
+    checkCudaErrors(cudaStreamSynchronize(stream));
+
+    if (!sendRequests.empty())
+    {
+        MPI_Waitall(int(sendRequests.size()), sendRequests.data(), MPI_STATUSES_IGNORE);
+    }
+}
+
+template class DeviceHaloExchanger<float>;
+template class DeviceHaloExchanger<double>;
+
+} // namespace cstone
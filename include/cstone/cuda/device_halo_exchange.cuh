@@ -0,0 +1,142 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Halo exchange of device-resident arrays
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <type_traits>
+
+#include <mpi.h>
+
+#include "cstone/primitives/reduced_precision.hpp"
+#include "cstone/util/index_ranges.hpp"
+
+namespace cstone
+{
+
+template<class T> class DeviceHaloBuffers;
+
+/*! @brief halo exchange of arrays in GPU memory
+ *
+ * @tparam T  float or double
+ *
+ * Performs the same exchange as HaloExchanger, but for device pointers. The send and receive index ranges
+ * are uploaded once per exchange pattern. The outgoing halos are packed into a device staging buffer
+ * with CUDA kernels and the received halos are scattered into the arrays on the device, such that only
+ * the halo elements leave the GPU.
+ *
+ * If the MPI library is CUDA-aware, the device staging buffers are passed to MPI directly. Otherwise,
+ * the staging buffers are copied through page-locked host memory.
+ *
+ * Arrays wrapped as reducedPrecision<float> or reducedPrecision<BFloat16> are converted by the packing and
+ * unpacking kernels, such that only the reduced precision halos are staged and sent.
+ */
+template<class T>
+class DeviceHaloExchanger
+{
+public:
+    //! @brief maximum number of arrays that can be exchanged in a single call
+    static constexpr int maxArrays = 16;
+
+    /*! @brief construct a halo exchanger bound to a device
+     *
+     * @param deviceId  device that holds the arrays to exchange, a negative value selects the device
+     *                  that is current at the time of each call
+     *
+     * Packing and unpacking kernels run on a stream owned by the exchanger, such that an exchange only
+     * synchronizes with its own work and not with other streams on the same device.
+     */
+    explicit DeviceHaloExchanger(int deviceId = -1);
+
+    DeviceHaloExchanger(DeviceHaloExchanger&&) noexcept;
+
+    DeviceHaloExchanger& operator=(DeviceHaloExchanger&&) noexcept;
+
+    ~DeviceHaloExchanger();
+
+    /*! @brief upload a new exchange pattern to the device
+     *
+     * @param incomingHalos   per source rank, the array index ranges to receive
+     * @param outgoingHalos   per destination rank, the array index ranges to send
+     * @param comm            communicator in which the ranks of the halo lists are numbered
+     */
+    void setup(const SendList& incomingHalos, const SendList& outgoingHalos, MPI_Comm comm = MPI_COMM_WORLD);
+
+    /*! @brief exchange halos of the specified device arrays
+     *
+     * @param arrays   device pointers to arrays of type T, all of them need the size of the local particles plus
+     *                 halos, optionally wrapped with reducedPrecision<float> or reducedPrecision<BFloat16>
+     *
+     * Returns after the incoming halos have been written to the arrays.
+     */
+    template<class... Arrays>
+    void exchange(Arrays... arrays)
+    {
+        constexpr int nArrays = sizeof...(Arrays);
+        static_assert(nArrays <= maxArrays, "too many arrays for a single device halo exchange\n");
+        static_assert(((std::is_same_v<TransferElement_t<Arrays>, T> ||
+                        std::is_same_v<TransferElement_t<Arrays>, float> ||
+                        std::is_same_v<TransferElement_t<Arrays>, BFloat16>) && ...),
+                      "device halos can only be transferred as T, float or BFloat16\n");
+
+        std::array<T*, nArrays> data{arrayData(arrays)...};
+        std::array<int, nArrays> transferBytes{int(sizeof(TransferElement_t<Arrays>))...};
+        exchange(data.data(), transferBytes.data(), nArrays);
+    }
+
+    //! @brief exchange halos of @p numArrays device arrays
+    void exchange(T* const* arrays, int numArrays);
+
+    /*! @brief exchange halos of @p numArrays device arrays with per-array transfer precision
+     *
+     * @param arrays          device pointers to arrays of type T
+     * @param transferBytes   per array, sizeof(T) for full precision, 4 for float or 2 for BFloat16 transfers
+     * @param numArrays       number of arrays, at most maxArrays
+     */
+    void exchange(T* const* arrays, const int* transferBytes, int numArrays);
+
+    //! @brief whether the staging buffers are passed to MPI as device pointers
+    static bool gpuAwareMpi();
+
+    //! @brief the device on which the exchanged arrays reside, negative if not bound to a device
+    [[nodiscard]] int deviceId() const { return deviceId_; }
+
+private:
+    int deviceId_;
+    MPI_Comm comm_{MPI_COMM_WORLD};
+    std::unique_ptr<DeviceHaloBuffers<T>> buffers_;
+};
+
+extern template class DeviceHaloExchanger<float>;
+extern template class DeviceHaloExchanger<double>;
+
+} // namespace cstone
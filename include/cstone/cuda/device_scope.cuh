@@ -0,0 +1,68 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  RAII selection of the current CUDA device
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include "errorcheck.cuh"
+
+namespace cstone
+{
+
+/*! @brief makes @p deviceId the current device of the calling host thread for the lifetime of the object
+ *
+ * The previously current device is restored on destruction. A negative device ID leaves the current
+ * device unchanged, which is the setting of objects that are not bound to a particular device.
+ */
+class DeviceScope
+{
+public:
+    explicit DeviceScope(int deviceId)
+    {
+        if (deviceId < 0) { return; }
+
+        checkCudaErrors(cudaGetDevice(&previousDevice_));
+        if (previousDevice_ != deviceId) { checkCudaErrors(cudaSetDevice(deviceId)); }
+        else { previousDevice_ = -1; }
+    }
+
+    DeviceScope(const DeviceScope&) = delete;
+    DeviceScope& operator=(const DeviceScope&) = delete;
+
+    ~DeviceScope()
+    {
+        if (previousDevice_ >= 0) { checkCudaErrors(cudaSetDevice(previousDevice_)); }
+    }
+
+private:
+    int previousDevice_{-1};
+};
+
+} // namespace cstone
@@ -29,18 +29,223 @@
  * @author Sebastian Keller <sebastian.f.keller@gmail.com>
  */
 
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <thrust/device_ptr.h>
+#include <thrust/device_vector.h>
+#include <thrust/scan.h>
+#include <thrust/system/cuda/execution_policy.h>
+
+#include "errorcheck.cuh"
 #include "findneighbors.cuh"
 
-template<class T, class I>
-__global__ void findNeighborsCudaKernel(const T* x, const T* y, const T* z, const T* h, int firstId, int lastId, int n,
-                                        cstone::Box<T> box, const I* codes, int* neighbors, int* neighborsCount, int ngmax)
+//! @brief number of particles handled together by one warp
+constexpr int groupSize = 32;
+//! @brief maximum number of cells whose particle ranges are searched per group
+constexpr int maxGroupCells = 64;
+//! @brief number of warps per thread block
+constexpr int warpsPerBlock = 4;
+
+//! @brief reduce @p value over all lanes of a warp with @p op
+template<class T, class F>
+__device__ T warpReduce(T value, F&& op)
 {
-    unsigned tid = blockDim.x * blockIdx.x + threadIdx.x;
-    unsigned id = firstId + tid;
-    if (id < lastId)
+    for (int offset = groupSize / 2; offset > 0; offset /= 2)
     {
-        cstone::findNeighbors(id, x, y, z, h, box, codes, neighbors + tid*ngmax, neighborsCount + tid, n, ngmax);
+        value = op(value, __shfl_xor_sync(0xffffffff, value, offset));
     }
+    return value;
+}
+
+/*! @brief integer cell coordinate range at @p level of a coordinate interval in one dimension
+ *
+ * @param[in]  lo, hi      interval in normalized coordinates, may exceed [0,1]
+ * @param[in]  level       cell subdivision level
+ * @param[in]  pbc         whether the dimension is periodic
+ * @param[out] first       first cell coordinate, may be negative if @p pbc is true
+ * @param[out] numCells    number of cells, at most 2^level
+ * @return                 true if the interval crosses a periodic boundary
+ */
+template<class T>
+__device__ bool cellRange(T lo, T hi, unsigned level, bool pbc, int* first, int* numCells)
+{
+    int cellsPerDim = 1 << level;
+    int iLo         = int(floor(lo * T(cellsPerDim)));
+    int iHi         = int(floor(hi * T(cellsPerDim)));
+
+    if (!pbc)
+    {
+        iLo = stl::max(iLo, 0);
+        iHi = stl::min(iHi, cellsPerDim - 1);
+    }
+
+    bool crossesBoundary = pbc && (iLo < 0 || iHi >= cellsPerDim);
+    if (iHi - iLo + 1 >= cellsPerDim)
+    {
+        iLo = 0;
+        iHi = cellsPerDim - 1;
+    }
+
+    *first    = iLo;
+    *numCells = iHi - iLo + 1;
+    return crossesBoundary;
+}
+
+/*! @brief find neighbors of groups of consecutive particles with one warp per group
+ *
+ * The particles of a group are consecutive along the SFC and therefore spatially compact. The warp determines
+ * the cells at the level of the largest search radius in the group that overlap with the bounding box of the group
+ * enlarged by that radius. The particle ranges of these cells are located with one binary search pair per cell,
+ * distributed over the lanes. The candidates of each range are then loaded into shared memory in tiles of
+ * groupSize particles and tested against all particles of the group.
+ *
+ * Neighbors are stored at a stride of @p ngmax if @p csrOffsets is nullptr and at the CSR offset of each particle
+ * otherwise. If @p neighbors is nullptr, only the counts are stored, and if @p neighborsCount is nullptr, only the
+ * neighbors. With @p halfList, neighbors in [firstId:id] of particle id are skipped, see forEachHalfNeighbor.
+ */
+template<class T, class I, class CountType>
+__global__ void findNeighborsGroupKernel(const T* x, const T* y, const T* z, const T* h, int firstId, int lastId,
+                                         int n, cstone::Box<T> box, const I* codes, int* neighbors,
+                                         CountType* neighborsCount, int ngmax, const std::size_t* csrOffsets,
+                                         bool halfList)
+{
+    __shared__ int cellRanges[warpsPerBlock][maxGroupCells][2];
+    __shared__ T xTile[warpsPerBlock][groupSize];
+    __shared__ T yTile[warpsPerBlock][groupSize];
+    __shared__ T zTile[warpsPerBlock][groupSize];
+
+    int lane  = threadIdx.x % groupSize;
+    int warp  = threadIdx.x / groupSize;
+    int group = blockIdx.x * warpsPerBlock + warp;
+
+    int groupStart = firstId + group * groupSize;
+    if (groupStart >= lastId) { return; }
+
+    int  id    = groupStart + lane;
+    bool valid = id < lastId;
+
+    // lanes without a particle take the coordinates of the first particle in the group
+    int loadId = valid ? id : groupStart;
+    T   xi = x[loadId], yi = y[loadId], zi = z[loadId];
+    T   radius   = valid ? 2 * h[id] : T(0);
+    T   radiusSq = radius * radius;
+
+    T maxRadius = warpReduce(radius, [](T a, T b) { return stl::max(a, b); });
+    T xLo = warpReduce(xi, [](T a, T b) { return stl::min(a, b); }) - maxRadius;
+    T xHi = warpReduce(xi, [](T a, T b) { return stl::max(a, b); }) + maxRadius;
+    T yLo = warpReduce(yi, [](T a, T b) { return stl::min(a, b); }) - maxRadius;
+    T yHi = warpReduce(yi, [](T a, T b) { return stl::max(a, b); }) + maxRadius;
+    T zLo = warpReduce(zi, [](T a, T b) { return stl::min(a, b); }) - maxRadius;
+    T zHi = warpReduce(zi, [](T a, T b) { return stl::max(a, b); }) + maxRadius;
+
+    xLo = (xLo - box.xmin()) * box.ilx();
+    xHi = (xHi - box.xmin()) * box.ilx();
+    yLo = (yLo - box.ymin()) * box.ily();
+    yHi = (yHi - box.ymin()) * box.ily();
+    zLo = (zLo - box.zmin()) * box.ilz();
+    zHi = (zHi - box.zmin()) * box.ilz();
+
+    // coarsen the cells until the enlarged group box is covered by at most maxGroupCells of them
+    unsigned level = stl::min(cstone::radiusToTreeLevel(maxRadius, box.minExtent()),
+                                      unsigned(cstone::maxTreeLevel<I>{}));
+    int  ix, iy, iz, nx, ny, nz;
+    bool usePbc;
+    while (true)
+    {
+        usePbc = cellRange(xLo, xHi, level, box.pbcX(), &ix, &nx);
+        usePbc = cellRange(yLo, yHi, level, box.pbcY(), &iy, &ny) || usePbc;
+        usePbc = cellRange(zLo, zHi, level, box.pbcZ(), &iz, &nz) || usePbc;
+        if (nx * ny * nz <= maxGroupCells || level == 0) { break; }
+        --level;
+    }
+
+    int numCells    = nx * ny * nz;
+    int cellsPerDim = 1 << level;
+    int shift       = cstone::maxTreeLevel<I>{} - level;
+    for (int cell = lane; cell < numCells; cell += groupSize)
+    {
+        int cx = (ix + cell / (ny * nz) + cellsPerDim) % cellsPerDim;
+        int cy = (iy + (cell / nz) % ny + cellsPerDim) % cellsPerDim;
+        int cz = (iz + cell % nz + cellsPerDim) % cellsPerDim;
+
+        I cellStart = cstone::imorton3D<I>(unsigned(cx) << shift, unsigned(cy) << shift, unsigned(cz) << shift);
+        I cellEnd   = cellStart + cstone::nodeRange<I>(level);
+
+        cellRanges[warp][cell][0] = stl::lower_bound(codes, codes + n, cellStart) - codes;
+        cellRanges[warp][cell][1] = stl::lower_bound(codes, codes + n, cellEnd) - codes;
+    }
+    __syncwarp();
+
+    int* iNeighbors = nullptr;
+    if (neighbors && valid)
+    {
+        iNeighbors = csrOffsets ? neighbors + csrOffsets[id - firstId]
+                                : neighbors + std::size_t(id - firstId) * ngmax;
+    }
+
+    int excludeFirst = halfList ? firstId : id;
+
+    int ngcount = 0;
+    for (int cell = 0; cell < numCells; ++cell)
+    {
+        int rangeStart = cellRanges[warp][cell][0];
+        int rangeEnd   = cellRanges[warp][cell][1];
+
+        // for half lists, candidates in [firstId:groupStart] are skipped by all lanes
+        if (halfList && firstId <= rangeStart && rangeStart <= groupStart) { rangeStart = groupStart + 1; }
+
+        for (int tileStart = rangeStart; tileStart < rangeEnd; tileStart += groupSize)
+        {
+            int j = tileStart + lane;
+            if (j < rangeEnd)
+            {
+                xTile[warp][lane] = x[j];
+                yTile[warp][lane] = y[j];
+                zTile[warp][lane] = z[j];
+            }
+            __syncwarp();
+
+            int tileSize = stl::min(groupSize, rangeEnd - tileStart);
+            if (valid)
+            {
+                for (int k = 0; k < tileSize && ngcount < ngmax; ++k)
+                {
+                    T xj = xTile[warp][k], yj = yTile[warp][k], zj = zTile[warp][k];
+                    T d2 = usePbc ? cstone::distanceSqPbc(xi, yi, zi, xj, yj, zj, box)
+                                  : cstone::distancesq(xi, yi, zi, xj, yj, zj);
+                    int  candidate = tileStart + k;
+                    bool included  = candidate < excludeFirst || candidate > id;
+                    if (d2 < radiusSq && included)
+                    {
+                        if (iNeighbors) { iNeighbors[ngcount] = candidate; }
+                        ++ngcount;
+                    }
+                }
+            }
+            __syncwarp();
+        }
+    }
+
+    if (valid && neighborsCount) { neighborsCount[id - firstId] = ngcount; }
+}
+
+//! @brief launch findNeighborsGroupKernel for particles [firstId:lastId]
+template<class T, class I, class CountType>
+void launchGroupKernel(const T* x, const T* y, const T* z, const T* h, int firstId, int lastId, int n,
+                       cstone::Box<T> box, const I* codes, int* neighbors, CountType* neighborsCount, int ngmax,
+                       const std::size_t* csrOffsets, bool halfList, cudaStream_t stream)
+{
+    constexpr int threadsPerBlock = warpsPerBlock * groupSize;
+
+    int numGroups = (lastId - firstId + groupSize - 1) / groupSize;
+    if (numGroups <= 0) { return; }
+
+    int blocksPerGrid = (numGroups + warpsPerBlock - 1) / warpsPerBlock;
+    findNeighborsGroupKernel<<<blocksPerGrid, threadsPerBlock, 0, stream>>>
+        (x, y, z, h, firstId, lastId, n, box, codes, neighbors, neighborsCount, ngmax, csrOffsets, halfList);
 }
 
 template<class T, class I>
@@ -48,13 +253,134 @@ void findNeighborsCuda(const T* x, const T* y, const T* z, const T* h, int first
                        cstone::Box<T> box, const I* codes, int* neighbors, int* neighborsCount, int ngmax,
                        cudaStream_t stream)
 {
-    constexpr int threadsPerBlock = 256;
-    int blocksPerGrid = (n + threadsPerBlock - 1) / threadsPerBlock;
-    findNeighborsCudaKernel<<<blocksPerGrid, threadsPerBlock, 0, stream>>>
-        (x, y, z, h, firstId, lastId, n, box, codes, neighbors, neighborsCount, ngmax);
+    launchGroupKernel(x, y, z, h, firstId, lastId, n, box, codes, neighbors, neighborsCount, ngmax, nullptr, false,
+                      stream);
+}
+
+template<class T, class I>
+std::size_t findNeighborsCsrOffsetsCuda(const T* x, const T* y, const T* z, const T* h, int firstId, int lastId,
+                                        int n, cstone::Box<T> box, const I* codes, std::size_t* offsets,
+                                        bool halfList, cudaStream_t stream)
+{
+    std::size_t numOffsets = lastId - firstId + 1;
+    checkCudaErrors(cudaMemsetAsync(offsets, 0, numOffsets * sizeof(std::size_t), stream));
+
+    launchGroupKernel(x, y, z, h, firstId, lastId, n, box, codes, (int*)nullptr, offsets,
+                      std::numeric_limits<int>::max(), (const std::size_t*)nullptr, halfList, stream);
+
+    thrust::exclusive_scan(thrust::cuda::par.on(stream), thrust::device_pointer_cast(offsets),
+                           thrust::device_pointer_cast(offsets + numOffsets), thrust::device_pointer_cast(offsets));
+
+    std::size_t numNeighbors;
+    checkCudaErrors(cudaMemcpyAsync(&numNeighbors, offsets + numOffsets - 1, sizeof(std::size_t),
+                                    cudaMemcpyDeviceToHost, stream));
+    checkCudaErrors(cudaStreamSynchronize(stream));
+
+    return numNeighbors;
+}
+
+template<class T, class I>
+void findNeighborsCsrCuda(const T* x, const T* y, const T* z, const T* h, int firstId, int lastId, int n,
+                          cstone::Box<T> box, const I* codes, const std::size_t* offsets, int* neighbors,
+                          bool halfList, cudaStream_t stream)
+{
+    launchGroupKernel(x, y, z, h, firstId, lastId, n, box, codes, neighbors, (int*)nullptr,
+                      std::numeric_limits<int>::max(), offsets, halfList, stream);
+}
+
+//! @brief out[i] = in[i] - in[0] for i in [0:count]
+__global__ void rebaseOffsetsKernel(const std::size_t* in, std::size_t count, std::size_t* out)
+{
+    std::size_t i = std::size_t(blockDim.x) * blockIdx.x + threadIdx.x;
+    if (i < count) { out[i] = in[i] - in[0]; }
+}
+
+template<class T, class I>
+void findNeighborsBatchedCuda(const T* x, const T* y, const T* z, const T* h, int firstId, int lastId, int n,
+                              cstone::Box<T> box, const I* codes, std::size_t batchCapacity,
+                              const NeighborBatchConsumer& consume, cudaStream_t stream)
+{
+    if (lastId <= firstId) { return; }
+
+    std::size_t numOffsets = lastId - firstId + 1;
+    thrust::device_vector<std::size_t> d_offsets(numOffsets);
+    std::size_t* offsets = thrust::raw_pointer_cast(d_offsets.data());
+    findNeighborsCsrOffsetsCuda(x, y, z, h, firstId, lastId, n, box, codes, offsets, false, stream);
+
+    std::vector<std::size_t> h_offsets(numOffsets);
+    checkCudaErrors(cudaMemcpy(h_offsets.data(), offsets, numOffsets * sizeof(std::size_t), cudaMemcpyDeviceToHost));
+
+    // split into the largest consecutive batches with at most batchCapacity neighbors each
+    batchCapacity = std::min(batchCapacity, h_offsets.back());
+    std::vector<int> batchBounds{firstId};
+    std::size_t maxBatchOffsets = 0;
+    while (batchBounds.back() < lastId)
+    {
+        int batchStart = batchBounds.back();
+        auto it = std::upper_bound(h_offsets.begin() + (batchStart - firstId), h_offsets.end(),
+                                   h_offsets[batchStart - firstId] + batchCapacity);
+        int batchEnd = firstId + int(it - h_offsets.begin()) - 1;
+        if (batchEnd == batchStart)
+        {
+            throw std::runtime_error("a particle has more neighbors than the batch capacity\n");
+        }
+        batchBounds.push_back(batchEnd);
+        maxBatchOffsets = std::max(maxBatchOffsets, std::size_t(batchEnd - batchStart + 1));
+    }
+
+    constexpr int numStreams = 2;
+    cudaStream_t streams[numStreams];
+    thrust::device_vector<int> d_neighbors[numStreams];
+    thrust::device_vector<std::size_t> d_batchOffsets[numStreams];
+    for (int s = 0; s < numStreams; ++s)
+    {
+        checkCudaErrors(cudaStreamCreateWithFlags(&streams[s], cudaStreamNonBlocking));
+        d_neighbors[s].resize(batchCapacity);
+        d_batchOffsets[s].resize(maxBatchOffsets);
+    }
+
+    for (std::size_t batch = 0; batch + 1 < batchBounds.size(); ++batch)
+    {
+        int batchStart = batchBounds[batch];
+        int batchEnd   = batchBounds[batch + 1];
+        int s          = batch % numStreams;
+
+        std::size_t numBatchOffsets = batchEnd - batchStart + 1;
+        std::size_t* batchOffsets   = thrust::raw_pointer_cast(d_batchOffsets[s].data());
+        int* batchNeighbors         = thrust::raw_pointer_cast(d_neighbors[s].data());
+
+        constexpr unsigned numThreads = 256;
+        rebaseOffsetsKernel<<<(numBatchOffsets + numThreads - 1) / numThreads, numThreads, 0, streams[s]>>>(
+            offsets + (batchStart - firstId), numBatchOffsets, batchOffsets);
+        launchGroupKernel(x, y, z, h, batchStart, batchEnd, n, box, codes, batchNeighbors, (int*)nullptr,
+                          std::numeric_limits<int>::max(), (const std::size_t*)batchOffsets, false, streams[s]);
+
+        consume(batchStart, batchEnd, batchOffsets, batchNeighbors, streams[s]);
+    }
+
+    for (int s = 0; s < numStreams; ++s)
+    {
+        checkCudaErrors(cudaStreamSynchronize(streams[s]));
+        checkCudaErrors(cudaStreamDestroy(streams[s]));
+    }
 }
 
 template FIND_NEIGHBORS_CUDA(float,  uint32_t)
 template FIND_NEIGHBORS_CUDA(float,  uint64_t)
 template FIND_NEIGHBORS_CUDA(double, uint32_t)
 template FIND_NEIGHBORS_CUDA(double, uint64_t)
+
+template FIND_NEIGHBORS_CSR_OFFSETS_CUDA(float,  uint32_t)
+template FIND_NEIGHBORS_CSR_OFFSETS_CUDA(float,  uint64_t)
+template FIND_NEIGHBORS_CSR_OFFSETS_CUDA(double, uint32_t)
+template FIND_NEIGHBORS_CSR_OFFSETS_CUDA(double, uint64_t)
+
+template FIND_NEIGHBORS_CSR_CUDA(float,  uint32_t)
+template FIND_NEIGHBORS_CSR_CUDA(float,  uint64_t)
+template FIND_NEIGHBORS_CSR_CUDA(double, uint32_t)
+template FIND_NEIGHBORS_CSR_CUDA(double, uint64_t)
+
+template FIND_NEIGHBORS_BATCHED_CUDA(float,  uint32_t)
+template FIND_NEIGHBORS_BATCHED_CUDA(float,  uint64_t)
+template FIND_NEIGHBORS_BATCHED_CUDA(double, uint32_t)
+template FIND_NEIGHBORS_BATCHED_CUDA(double, uint64_t)
@@ -31,6 +31,8 @@
 
 #pragma once
 
+#include <functional>
+
 #include <cuda_runtime.h>
 
 #include "cstone/findneighbors.hpp"
@@ -61,6 +63,10 @@
  *      - If id is the index of the particle (x[id], y[id], z[id), and if id is in [firstId:lastId], then
  *        the neighbors of id are stored in
  *        neighbors[(id-firstId)*ngmax, (id-firstId)*ngmax + neighborsCount[id-firstId]]
+ *
+ * Each warp processes a group of 32 consecutive particles. The particle ranges of the cells around the group are
+ * located once per group and their candidates are tested against all particles of the group via shared memory.
+ * The neighbors found are the same as with findNeighbors, but their order may differ.
  */
 template<class T, class I>
 void findNeighborsCuda(const T* x, const T* y, const T* z, const T* h, int firstId, int lastId, int n,
@@ -78,3 +84,92 @@ extern template FIND_NEIGHBORS_CUDA(float, uint64_t )
 extern template FIND_NEIGHBORS_CUDA(double, uint32_t)
 extern template FIND_NEIGHBORS_CUDA(double, uint64_t)
 
+/*! @brief count the neighbors of particles [firstId:lastId] on the GPU and compute their CSR offsets
+ *
+ * @param[out] offsets   device array of length lastId - firstId + 1, the exclusive scan of the neighbor counts
+ * @param[in]  halfList  if true, count symmetric half lists, in which neighbors j in [firstId:lastId] of particle id
+ *                       are only kept if j > id, see forEachHalfNeighbor
+ * @return               total number of neighbors, i.e. the required length of the neighbor array
+ *                       for findNeighborsCsrCuda
+ *
+ * See findNeighborsCuda for a description of the remaining arguments. The call synchronizes @p stream.
+ */
+template<class T, class I>
+std::size_t findNeighborsCsrOffsetsCuda(const T* x, const T* y, const T* z, const T* h, int firstId, int lastId,
+                                        int n, cstone::Box<T> box, const I* codes, std::size_t* offsets,
+                                        bool halfList = false, cudaStream_t stream = cudaStreamDefault);
+
+/*! @brief find the neighbors of particles [firstId:lastId] on the GPU and store them in CSR format
+ *
+ * @param[in]  offsets    device CSR offsets, output of findNeighborsCsrOffsetsCuda
+ * @param[in]  halfList   needs to match the value passed to findNeighborsCsrOffsetsCuda
+ * @param[out] neighbors  device neighbor indices, the neighbors of particle id are stored in
+ *                        neighbors[offsets[id-firstId]:offsets[id-firstId+1]]
+ *
+ * In contrast to findNeighborsCuda, memory is only needed for the neighbors actually present and no
+ * particle has its neighbor list truncated.
+ */
+template<class T, class I>
+void findNeighborsCsrCuda(const T* x, const T* y, const T* z, const T* h, int firstId, int lastId, int n,
+                          cstone::Box<T> box, const I* codes, const std::size_t* offsets, int* neighbors,
+                          bool halfList = false, cudaStream_t stream = cudaStreamDefault);
+
+#define FIND_NEIGHBORS_CSR_OFFSETS_CUDA(T, I) \
+std::size_t findNeighborsCsrOffsetsCuda(const T* x, const T* y, const T* z, const T* h, int firstId, int lastId, \
+                                        int n, cstone::Box<T> box, const I* codes, std::size_t* offsets, \
+                                        bool halfList, cudaStream_t stream);
+
+#define FIND_NEIGHBORS_CSR_CUDA(T, I) \
+void findNeighborsCsrCuda(const T* x, const T* y, const T* z, const T* h, int firstId, int lastId, int n, \
+                          cstone::Box<T> box, const I* codes, const std::size_t* offsets, int* neighbors, \
+                          bool halfList, cudaStream_t stream);
+
+extern template FIND_NEIGHBORS_CSR_OFFSETS_CUDA(float, uint32_t )
+extern template FIND_NEIGHBORS_CSR_OFFSETS_CUDA(float, uint64_t )
+extern template FIND_NEIGHBORS_CSR_OFFSETS_CUDA(double, uint32_t)
+extern template FIND_NEIGHBORS_CSR_OFFSETS_CUDA(double, uint64_t)
+extern template FIND_NEIGHBORS_CSR_CUDA(float, uint32_t )
+extern template FIND_NEIGHBORS_CSR_CUDA(float, uint64_t )
+extern template FIND_NEIGHBORS_CSR_CUDA(double, uint32_t)
+extern template FIND_NEIGHBORS_CSR_CUDA(double, uint64_t)
+
+
+/*! @brief consumer of the neighbor lists of one batch of particles
+ *
+ * Called as consume(firstId, lastId, offsets, neighbors, stream). The neighbors of particle id in [firstId:lastId]
+ * are stored in the device array neighbors[offsets[id-firstId]:offsets[id-firstId+1]], with offsets[0] = 0.
+ * Both arrays are reused for later batches once all work enqueued on @p stream has completed. The consumer therefore
+ * has to enqueue any processing of the batch on @p stream or synchronize it before returning.
+ */
+using NeighborBatchConsumer =
+    std::function<void(int firstId, int lastId, const std::size_t* offsets, const int* neighbors, cudaStream_t)>;
+
+/*! @brief find the neighbors of particles [firstId:lastId] on the GPU with bounded memory and stream them in batches
+ *
+ * @param[in] batchCapacity  maximum number of neighbors per batch
+ * @param[in] consume        called once per batch in ascending particle order, see NeighborBatchConsumer
+ * @param[in] stream         stream for the count pass, batches alternate between two internal streams
+ *
+ * A count pass and a device-side exclusive scan determine the CSR offsets of all particles in [firstId:lastId].
+ * The range is then split into consecutive batches of at most @p batchCapacity neighbors, which are filled and
+ * passed to @p consume on alternating streams, such that the fill of one batch overlaps with the
+ * consumption of the previous one. Device memory is needed for the lastId - firstId + 1 offsets and two
+ * buffers of @p batchCapacity neighbors, independent of the total number of neighbors.
+ * Throws if a single particle has more than @p batchCapacity neighbors. The call returns after all batches
+ * have been consumed and the internal streams have been synchronized.
+ * See findNeighborsCuda for a description of the remaining arguments.
+ */
+template<class T, class I>
+void findNeighborsBatchedCuda(const T* x, const T* y, const T* z, const T* h, int firstId, int lastId, int n,
+                              cstone::Box<T> box, const I* codes, std::size_t batchCapacity,
+                              const NeighborBatchConsumer& consume, cudaStream_t stream = cudaStreamDefault);
+
+#define FIND_NEIGHBORS_BATCHED_CUDA(T, I) \
+void findNeighborsBatchedCuda(const T* x, const T* y, const T* z, const T* h, int firstId, int lastId, int n, \
+                              cstone::Box<T> box, const I* codes, std::size_t batchCapacity, \
+                              const NeighborBatchConsumer& consume, cudaStream_t stream);
+
+extern template FIND_NEIGHBORS_BATCHED_CUDA(float, uint32_t )
+extern template FIND_NEIGHBORS_BATCHED_CUDA(float, uint64_t )
+extern template FIND_NEIGHBORS_BATCHED_CUDA(double, uint32_t)
+extern template FIND_NEIGHBORS_BATCHED_CUDA(double, uint64_t)
@@ -0,0 +1,85 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  k-nearest-neighbor queries on device octrees, see findneighbors_knn.hpp
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include "cstone/findneighbors_knn.hpp"
+#include "cstone/tree/octree_internal.cuh"
+
+namespace cstone
+{
+
+//! @brief one thread per query point
+template<class T, class KeyType, class SfcKind, class LocalIndex>
+__global__ void findKNearestNeighborsKernel(OctreeGpuDataView<KeyType> octree, const LocalIndex* layout, const T* x,
+                                            const T* y, const T* z, Box<T> box, const T* qx, const T* qy,
+                                            const T* qz, std::size_t numQueries, int k, int* neighbors,
+                                            T* distancesSq)
+{
+    std::size_t i = std::size_t(blockDim.x) * blockIdx.x + threadIdx.x;
+    if (i < numQueries)
+    {
+        knnQuery<T, KeyType, SfcKind>(octree, layout, x, y, z, box, qx[i], qy[i], qz[i], k, neighbors + i * k,
+                                      distancesSq + i * k);
+    }
+}
+
+/*! @brief find the @p k nearest particles of each point in a batch of query points on the GPU
+ *
+ * @param[in]  octree       the device octree
+ * @param[in]  layout       device array of leaf particle offsets, length = octree.numLeafNodes() + 1
+ * @param[in]  x,y,z        device arrays with particle coordinates in SFC order
+ * @param[in]  box          coordinate bounding box that was used to construct @p octree
+ * @param[in]  qx,qy,qz     device arrays with query point coordinates, length @p numQueries
+ * @param[in]  numQueries   number of query points
+ * @param[in]  k            number of neighbors per query
+ * @param[out] neighbors    device neighbor indices, length @p numQueries * @p k
+ * @param[out] distancesSq  device squared neighbor distances, length @p numQueries * @p k
+ * @param[in]  stream       execute on cuda stream @p stream
+ *
+ * See findKNearestNeighbors for the output layout. Each thread traverses the tree for one query and keeps its
+ * heap in the output arrays. Consecutive queries should be close to each other, e.g. in SFC order,
+ * to avoid divergence of the traversals within a warp.
+ */
+template<class T, class KeyType, class SfcKind = KeyType, class LocalIndex>
+void findKNearestNeighborsGpu(const OctreeGpu<KeyType>& octree, const LocalIndex* layout, const T* x, const T* y,
+                              const T* z, const Box<T>& box, const T* qx, const T* qy, const T* qz,
+                              std::size_t numQueries, int k, int* neighbors, T* distancesSq,
+                              cudaStream_t stream = cudaStreamDefault)
+{
+    if (numQueries == 0) { return; }
+
+    constexpr unsigned nThreads = 128;
+    findKNearestNeighborsKernel<T, KeyType, SfcKind><<<iceil(numQueries, nThreads), nThreads, 0, stream>>>(
+        octree.data(), layout, x, y, z, box, qx, qy, qz, numQueries, k, neighbors, distancesSq);
+}
+
+} // namespace cstone
@@ -29,11 +29,15 @@
  * \author Sebastian Keller <sebastian.f.keller@gmail.com>
  */
 
+#include <algorithm>
+#include <cstring>
 #include <vector>
 
 #include <thrust/device_vector.h>
 #include <thrust/sort.h>
+#include <thrust/system/cuda/execution_policy.h>
 
+#include "device_scope.cuh"
 #include "errorcheck.cuh"
 #include "gather.cuh"
 
@@ -45,6 +49,8 @@ class DeviceMemory
 {
     static constexpr int alignment = 4096/sizeof(T);
 public:
+    //! @brief an input and an output buffer for each of the two pipeline slots
+    static constexpr int numBuffers = 4;
 
     DeviceMemory() = default;
 
@@ -54,6 +60,11 @@ public:
         {
             checkCudaErrors(cudaFree(d_ordering_));
             checkCudaErrors(cudaFree(d_buffer_));
+            checkCudaErrors(cudaFreeHost(h_staging_));
+            for (cudaStream_t stream : streams_)
+            {
+                checkCudaErrors(cudaStreamDestroy(stream));
+            }
         }
     }
 
@@ -71,10 +82,19 @@ public:
                 checkCudaErrors(cudaFree(d_ordering_));
 
                 checkCudaErrors(cudaFree(d_buffer_));
+                checkCudaErrors(cudaFreeHost(h_staging_));
+            }
+            else
+            {
+                for (cudaStream_t& stream : streams_)
+                {
+                    checkCudaErrors(cudaStreamCreate(&stream));
+                }
             }
 
             checkCudaErrors(cudaMalloc((void**)&d_ordering_,  newSize * sizeof(LocalIndex)));
-            checkCudaErrors(cudaMalloc((void**)&(d_buffer_), 2 * newSize * sizeof(T)));
+            checkCudaErrors(cudaMalloc((void**)&(d_buffer_), numBuffers * newSize * sizeof(T)));
+            checkCudaErrors(cudaMallocHost((void**)&h_staging_, 2 * newSize * sizeof(T)));
 
             allocatedSize_ = newSize;
         }
@@ -84,10 +104,15 @@ public:
 
     T* deviceBuffer(int i)
     {
-        if (i > 1) throw std::runtime_error("buffer index out of bounds\n");
+        if (i >= numBuffers) throw std::runtime_error("buffer index out of bounds\n");
         return d_buffer_ + i * allocatedSize_;
     }
 
+    //! @brief page-locked host buffer of pipeline @p slot
+    T* stagingBuffer(int slot) { return h_staging_ + slot * allocatedSize_; }
+
+    cudaStream_t stream(int slot) { return streams_[slot]; }
+
 private:
     std::size_t allocatedSize_{0} ;
 
@@ -96,18 +121,25 @@ private:
 
     //! @brief device buffers
     T* d_buffer_;
+
+    //! @brief page-locked host buffers and streams of the two pipeline slots
+    T* h_staging_;
+    cudaStream_t streams_[2];
 };
 
 
 template<class ValueType, class CodeType, class IndexType>
-DeviceGather<ValueType, CodeType, IndexType>::DeviceGather()
-    : deviceMemory_(std::make_unique<DeviceMemory<ValueType, IndexType>>())
+DeviceGather<ValueType, CodeType, IndexType>::DeviceGather(int deviceId)
+    : deviceId_(deviceId)
+    , deviceMemory_(std::make_unique<DeviceMemory<ValueType, IndexType>>())
 {}
 
 template<class ValueType, class CodeType, class IndexType>
 void DeviceGather<ValueType, CodeType, IndexType>::setReorderMap(const IndexType* map_first,
                                                                  const IndexType* map_last)
 {
+    DeviceScope scope(deviceId_);
+
     mapSize_      = map_last - map_first;
     deviceMemory_->reallocate(mapSize_);
     // upload new ordering to the device
@@ -118,6 +150,7 @@ void DeviceGather<ValueType, CodeType, IndexType>::setReorderMap(const IndexType
 template<class ValueType, class CodeType, class IndexType>
 void DeviceGather<ValueType, CodeType, IndexType>::getReorderMap(IndexType* map_first)
 {
+    DeviceScope scope(deviceId_);
     cudaMemcpy(map_first, deviceMemory_->ordering(), mapSize_ * sizeof(IndexType), cudaMemcpyDeviceToHost);
 }
 
@@ -135,10 +168,12 @@ __global__ void iotaKernel(I* buffer, size_t n, size_t offset)
 template<class ValueType, class CodeType, class IndexType>
 void DeviceGather<ValueType, CodeType, IndexType>::setMapFromCodes(CodeType* codes_first, CodeType* codes_last)
 {
+    DeviceScope scope(deviceId_);
+
     mapSize_      = codes_last - codes_first;
     deviceMemory_->reallocate(mapSize_);
 
-    // the deviceBuffer is allocated as a single chunk of size 2 * mapSize_ * sizeof(T)
+    // the deviceBuffer is allocated as a single chunk of size numBuffers * mapSize_ * sizeof(T)
     // so we can reuse it for mapSize_ elements of KeyType, as long as the static assert holds
     static_assert(sizeof(CodeType) <= 2 * sizeof(ValueType), "buffer size not big enough for codes device array\n");
     CodeType* d_codes = reinterpret_cast<CodeType*>(deviceMemory_->deviceBuffer(0));
@@ -165,7 +200,12 @@ void DeviceGather<ValueType, CodeType, IndexType>::setMapFromCodes(CodeType* cod
 }
 
 template<class ValueType, class CodeType, class IndexType>
-DeviceGather<ValueType, CodeType, IndexType>::~DeviceGather() = default;
+DeviceGather<ValueType, CodeType, IndexType>::~DeviceGather()
+{
+    // device memory and streams are released on the device they were allocated on
+    DeviceScope scope(deviceId_);
+    deviceMemory_.reset();
+}
 
 
 template<class T, class I>
@@ -182,23 +222,87 @@ __global__ void reorder(I* map, T* source, T* destination, size_t n)
 template<class ValueType, class CodeType, class IndexType>
 void DeviceGather<ValueType, CodeType, IndexType>::operator()(ValueType* values)
 {
+    (*this)(&values, 1);
+}
+
+template<class ValueType, class CodeType, class IndexType>
+void DeviceGather<ValueType, CodeType, IndexType>::operator()(ValueType* const* values, int numArrays)
+{
+    DeviceScope scope(deviceId_);
+    if (mapSize_ == 0) { return; }
+
     constexpr int nThreads = 256;
     int nBlocks = (mapSize_ + nThreads - 1) / nThreads;
+    std::size_t numBytes = mapSize_ * sizeof(ValueType);
+
+    // array i is processed in slot i % 2, such that the upload of array i overlaps
+    // the gather and download of array i - 1
+    for (int i = 0; i < numArrays; ++i)
+    {
+        int slot              = i % 2;
+        cudaStream_t stream   = deviceMemory_->stream(slot);
+        ValueType* staging    = deviceMemory_->stagingBuffer(slot);
+        ValueType* d_input    = deviceMemory_->deviceBuffer(2 * slot);
+        ValueType* d_output   = deviceMemory_->deviceBuffer(2 * slot + 1);
+
+        if (i >= 2)
+        {
+            // the staging buffer of this slot holds the reordered array i - 2
+            checkCudaErrors(cudaStreamSynchronize(stream));
+            std::memcpy(values[i - 2], staging, numBytes);
+        }
 
-    // upload to device
-    cudaMemcpy(deviceMemory_->deviceBuffer(0), values, mapSize_ * sizeof(ValueType), cudaMemcpyHostToDevice);
+        std::memcpy(staging, values[i], numBytes);
+        checkCudaErrors(cudaMemcpyAsync(d_input, staging, numBytes, cudaMemcpyHostToDevice, stream));
+        reorder<<<nBlocks, nThreads, 0, stream>>>(deviceMemory_->ordering(), d_input, d_output, mapSize_);
+        checkCudaErrors(cudaGetLastError());
+        checkCudaErrors(cudaMemcpyAsync(staging, d_output, numBytes, cudaMemcpyDeviceToHost, stream));
+    }
+
+    for (int i = std::max(0, numArrays - 2); i < numArrays; ++i)
+    {
+        int slot = i % 2;
+        checkCudaErrors(cudaStreamSynchronize(deviceMemory_->stream(slot)));
+        std::memcpy(values[i], deviceMemory_->stagingBuffer(slot), numBytes);
+    }
+}
+
+template<class ValueType, class CodeType, class IndexType>
+void DeviceGather<ValueType, CodeType, IndexType>::setMapFromCodesDevice(CodeType* d_codesFirst,
+                                                                         CodeType* d_codesLast,
+                                                                         StreamType stream)
+{
+    DeviceScope scope(deviceId_);
+    mapSize_ = d_codesLast - d_codesFirst;
+    deviceMemory_->reallocate(mapSize_);
+    if (mapSize_ == 0) { return; }
+
+    constexpr int nThreads = 256;
+    int nBlocks = (mapSize_ + nThreads - 1) / nThreads;
+    iotaKernel<<<nBlocks, nThreads, 0, stream>>>(deviceMemory_->ordering(), mapSize_, 0);
     checkCudaErrors(cudaGetLastError());
 
-    // reorder on device
-    reorder<<<nBlocks, nThreads>>>(deviceMemory_->ordering(),
-                                   deviceMemory_->deviceBuffer(0),
-                                   deviceMemory_->deviceBuffer(1),
-                                   mapSize_);
+    thrust::sort_by_key(thrust::cuda::par.on(stream),
+                        thrust::device_pointer_cast(d_codesFirst),
+                        thrust::device_pointer_cast(d_codesLast),
+                        thrust::device_pointer_cast(deviceMemory_->ordering()));
     checkCudaErrors(cudaGetLastError());
+}
+
+template<class ValueType, class CodeType, class IndexType>
+void DeviceGather<ValueType, CodeType, IndexType>::reorderDevice(ValueType* d_values, StreamType stream)
+{
+    DeviceScope scope(deviceId_);
+    if (mapSize_ == 0) { return; }
+
+    constexpr int nThreads = 256;
+    int nBlocks = (mapSize_ + nThreads - 1) / nThreads;
 
-    // download to host
-    cudaMemcpy(values, deviceMemory_->deviceBuffer(1), mapSize_ * sizeof(ValueType), cudaMemcpyDeviceToHost);
+    reorder<<<nBlocks, nThreads, 0, stream>>>(deviceMemory_->ordering(), d_values,
+                                              deviceMemory_->deviceBuffer(0), mapSize_);
     checkCudaErrors(cudaGetLastError());
+    checkCudaErrors(cudaMemcpyAsync(d_values, deviceMemory_->deviceBuffer(0), mapSize_ * sizeof(ValueType),
+                                    cudaMemcpyDeviceToDevice, stream));
 }
 
 template class DeviceGather<float,  unsigned, unsigned>;
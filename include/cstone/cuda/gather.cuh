@@ -31,6 +31,9 @@
 
 #include <cstdint>
 #include <memory>
+#include <vector>
+
+struct CUstream_st;
 
 namespace cstone
 {
@@ -47,11 +50,21 @@ template<class ValueType, class CodeType, class IndexType>
 class DeviceGather
 {
 public:
+    //! @brief identical to cudaStream_t, declared without the CUDA headers for host translation units
+    using StreamType = CUstream_st*;
 
-    DeviceGather();
+    /*! @brief construct a gather functor bound to a device
+     *
+     * @param deviceId  device on which buffers and streams are allocated and kernels are launched,
+     *                  a negative value selects the device that is current at the time of each call
+     */
+    explicit DeviceGather(int deviceId = -1);
 
     ~DeviceGather();
 
+    //! @brief the device on which this functor operates, negative if not bound to a device
+    [[nodiscard]] int deviceId() const { return deviceId_; }
+
     /*! @brief upload the new reorder map to the device and reallocates buffers if necessary
      *
      * If the sequence [map_first:map_last] does not contain each element [0:map_last-map_first]
@@ -89,7 +102,48 @@ public:
      */
     void operator()(ValueType* values);
 
+    /*! @brief reorder multiple host arrays according to the reorder map, overlapping transfers with kernels
+     *
+     * @param[inout] values     @p numArrays pointers to host arrays
+     * @param[in]    numArrays  number of arrays to reorder
+     *
+     * The arrays are staged through two page-locked host buffers and reordered on two streams, such that
+     * the upload of one array overlaps the gather and download of the previous one.
+     */
+    void operator()(ValueType* const* values, int numArrays);
+
+    //! @brief reorder the elements [offset:offset + mapSize] of @p numArrays host vectors, see CpuGather
+    void operator()(std::vector<ValueType>* const* arrays, int numArrays, std::size_t offset)
+    {
+        std::vector<ValueType*> values(numArrays);
+        for (int a = 0; a < numArrays; ++a)
+        {
+            values[a] = arrays[a]->data() + offset;
+        }
+        (*this)(values.data(), numArrays);
+    }
+
+    /*! @brief sort SFC keys in device memory and determine the reorder map on the device
+     *
+     * @param[inout] d_codesFirst  device pointer to first SFC key
+     * @param[inout] d_codesLast   device pointer to last SFC key
+     * @param[in]    stream        CUDA stream for the sort, the default stream if omitted
+     *
+     * Same as setMapFromCodes, but the keys are not transferred to or from the host and the call
+     * is asynchronous with respect to the host. Work on other streams that uses the reorder map,
+     * e.g. the reordering of host arrays, needs to be synchronized with @p stream by the caller.
+     */
+    void setMapFromCodesDevice(CodeType* d_codesFirst, CodeType* d_codesLast, StreamType stream = nullptr);
+
+    /*! @brief reorder a device array in place according to the reorder map, asynchronous w.r.t. the host
+     *
+     * @param[inout] d_values  device array with at least as many elements as the reorder map
+     * @param[in]    stream    CUDA stream for the gather, the default stream if omitted
+     */
+    void reorderDevice(ValueType* d_values, StreamType stream = nullptr);
+
 private:
+    int deviceId_;
     std::size_t mapSize_{0};
 
     std::unique_ptr<DeviceMemory<ValueType, IndexType>> deviceMemory_;
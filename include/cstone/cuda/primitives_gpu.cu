@@ -0,0 +1,155 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  GPU implementations of the accelerator primitives with thrust
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <thrust/copy.h>
+#include <thrust/device_ptr.h>
+#include <thrust/extrema.h>
+#include <thrust/gather.h>
+#include <thrust/scan.h>
+#include <thrust/scatter.h>
+#include <thrust/sort.h>
+#include <thrust/system/cuda/execution_policy.h>
+
+#include "errorcheck.cuh"
+#include "primitives_gpu.cuh"
+
+namespace cstone
+{
+
+template<class KeyType, class ValueType>
+void sortByKeyGpu(KeyType* keys, ValueType* values, std::size_t numElements)
+{
+    thrust::sort_by_key(thrust::device, thrust::device_pointer_cast(keys),
+                        thrust::device_pointer_cast(keys + numElements), thrust::device_pointer_cast(values));
+}
+
+template<class T>
+void exclusiveScanGpu(const T* in, T* out, std::size_t numElements)
+{
+    thrust::exclusive_scan(thrust::device, thrust::device_pointer_cast(in),
+                           thrust::device_pointer_cast(in + numElements), thrust::device_pointer_cast(out), T(0));
+}
+
+template<class T>
+void inclusiveScanGpu(const T* in, T* out, std::size_t numElements)
+{
+    thrust::inclusive_scan(thrust::device, thrust::device_pointer_cast(in),
+                           thrust::device_pointer_cast(in + numElements), thrust::device_pointer_cast(out));
+}
+
+template<class T>
+std::tuple<T, T> minMaxGpu(const T* in, std::size_t numElements)
+{
+    auto minMax = thrust::minmax_element(thrust::device, thrust::device_pointer_cast(in),
+                                         thrust::device_pointer_cast(in + numElements));
+
+    T minimum, maximum;
+    checkCudaErrors(cudaMemcpy(&minimum, thrust::raw_pointer_cast(minMax.first), sizeof(T), cudaMemcpyDeviceToHost));
+    checkCudaErrors(cudaMemcpy(&maximum, thrust::raw_pointer_cast(minMax.second), sizeof(T), cudaMemcpyDeviceToHost));
+
+    return {minimum, maximum};
+}
+
+template<class IndexType, class ValueType>
+void gatherGpu(const IndexType* map, std::size_t numElements, const ValueType* in, ValueType* out)
+{
+    thrust::gather(thrust::device, thrust::device_pointer_cast(map), thrust::device_pointer_cast(map + numElements),
+                   thrust::device_pointer_cast(in), thrust::device_pointer_cast(out));
+}
+
+template<class IndexType, class ValueType>
+void scatterGpu(const IndexType* map, std::size_t numElements, const ValueType* in, ValueType* out)
+{
+    thrust::scatter(thrust::device, thrust::device_pointer_cast(in), thrust::device_pointer_cast(in + numElements),
+                    thrust::device_pointer_cast(map), thrust::device_pointer_cast(out));
+}
+
+//! @brief one thread per segment, intended for many short segments such as the particles of octree leaves
+template<class ValueType, class IndexType>
+__global__ void segmentedReduceKernel(const ValueType* values, const IndexType* offsets, std::size_t numSegments,
+                                      ValueType* out)
+{
+    std::size_t s = std::size_t(blockDim.x) * blockIdx.x + threadIdx.x;
+    if (s >= numSegments) { return; }
+
+    ValueType sum = 0;
+    for (IndexType i = offsets[s]; i < offsets[s + 1]; ++i)
+    {
+        sum += values[i];
+    }
+    out[s] = sum;
+}
+
+template<class ValueType, class IndexType>
+void segmentedReduceGpu(const ValueType* values, const IndexType* offsets, std::size_t numSegments, ValueType* out)
+{
+    if (numSegments == 0) { return; }
+
+    constexpr unsigned numThreads = 256;
+    unsigned numBlocks = (numSegments + numThreads - 1) / numThreads;
+    segmentedReduceKernel<<<numBlocks, numThreads>>>(values, offsets, numSegments, out);
+    checkCudaErrors(cudaGetLastError());
+}
+
+template SORT_BY_KEY_GPU(unsigned, unsigned)
+template SORT_BY_KEY_GPU(unsigned, int)
+template SORT_BY_KEY_GPU(uint64_t, unsigned)
+template SORT_BY_KEY_GPU(uint64_t, int)
+
+template EXCLUSIVE_SCAN_GPU(int)
+template EXCLUSIVE_SCAN_GPU(unsigned)
+template EXCLUSIVE_SCAN_GPU(uint64_t)
+
+template INCLUSIVE_SCAN_GPU(int)
+template INCLUSIVE_SCAN_GPU(unsigned)
+template INCLUSIVE_SCAN_GPU(uint64_t)
+
+template MIN_MAX_GPU(float)
+template MIN_MAX_GPU(double)
+template MIN_MAX_GPU(unsigned)
+template MIN_MAX_GPU(uint64_t)
+
+template GATHER_GPU(unsigned, float)
+template GATHER_GPU(unsigned, double)
+template GATHER_GPU(unsigned, unsigned)
+template GATHER_GPU(unsigned, uint64_t)
+
+template SCATTER_GPU(unsigned, float)
+template SCATTER_GPU(unsigned, double)
+template SCATTER_GPU(unsigned, unsigned)
+template SCATTER_GPU(unsigned, uint64_t)
+
+template SEGMENTED_REDUCE_GPU(float, unsigned)
+template SEGMENTED_REDUCE_GPU(double, unsigned)
+template SEGMENTED_REDUCE_GPU(unsigned, unsigned)
+template SEGMENTED_REDUCE_GPU(uint64_t, unsigned)
+
+} // namespace cstone
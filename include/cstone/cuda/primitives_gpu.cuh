@@ -0,0 +1,115 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  GPU implementations of the accelerator primitives, see primitives/accelerator.hpp
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * This header does not depend on CUDA and can be included by host translation units.
+ * The implementations are compiled in primitives_gpu.cu, all pointers refer to device memory.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+
+namespace cstone
+{
+
+//! @brief sort @p keys on the device and permute @p values in the same way
+template<class KeyType, class ValueType>
+void sortByKeyGpu(KeyType* keys, ValueType* values, std::size_t numElements);
+
+//! @brief exclusive prefix sum of @p in to @p out, in-place if in == out
+template<class T>
+void exclusiveScanGpu(const T* in, T* out, std::size_t numElements);
+
+//! @brief inclusive prefix sum of @p in to @p out, in-place if in == out
+template<class T>
+void inclusiveScanGpu(const T* in, T* out, std::size_t numElements);
+
+//! @brief the smallest and largest element of a non-empty device array
+template<class T>
+std::tuple<T, T> minMaxGpu(const T* in, std::size_t numElements);
+
+//! @brief out[i] = in[map[i]] for i in [0:numElements]
+template<class IndexType, class ValueType>
+void gatherGpu(const IndexType* map, std::size_t numElements, const ValueType* in, ValueType* out);
+
+//! @brief out[map[i]] = in[i] for i in [0:numElements]
+template<class IndexType, class ValueType>
+void scatterGpu(const IndexType* map, std::size_t numElements, const ValueType* in, ValueType* out);
+
+//! @brief out[s] = sum of values[offsets[s]:offsets[s+1]] for s in [0:numSegments]
+template<class ValueType, class IndexType>
+void segmentedReduceGpu(const ValueType* values, const IndexType* offsets, std::size_t numSegments,
+                        ValueType* out);
+
+#define SORT_BY_KEY_GPU(K, V) void sortByKeyGpu(K* keys, V* values, std::size_t numElements);
+#define EXCLUSIVE_SCAN_GPU(T) void exclusiveScanGpu(const T* in, T* out, std::size_t numElements);
+#define INCLUSIVE_SCAN_GPU(T) void inclusiveScanGpu(const T* in, T* out, std::size_t numElements);
+#define MIN_MAX_GPU(T) std::tuple<T, T> minMaxGpu(const T* in, std::size_t numElements);
+#define GATHER_GPU(I, V) void gatherGpu(const I* map, std::size_t numElements, const V* in, V* out);
+#define SCATTER_GPU(I, V) void scatterGpu(const I* map, std::size_t numElements, const V* in, V* out);
+#define SEGMENTED_REDUCE_GPU(V, I) \
+void segmentedReduceGpu(const V* values, const I* offsets, std::size_t numSegments, V* out);
+
+extern template SORT_BY_KEY_GPU(unsigned, unsigned)
+extern template SORT_BY_KEY_GPU(unsigned, int)
+extern template SORT_BY_KEY_GPU(uint64_t, unsigned)
+extern template SORT_BY_KEY_GPU(uint64_t, int)
+
+extern template EXCLUSIVE_SCAN_GPU(int)
+extern template EXCLUSIVE_SCAN_GPU(unsigned)
+extern template EXCLUSIVE_SCAN_GPU(uint64_t)
+
+extern template INCLUSIVE_SCAN_GPU(int)
+extern template INCLUSIVE_SCAN_GPU(unsigned)
+extern template INCLUSIVE_SCAN_GPU(uint64_t)
+
+extern template MIN_MAX_GPU(float)
+extern template MIN_MAX_GPU(double)
+extern template MIN_MAX_GPU(unsigned)
+extern template MIN_MAX_GPU(uint64_t)
+
+extern template GATHER_GPU(unsigned, float)
+extern template GATHER_GPU(unsigned, double)
+extern template GATHER_GPU(unsigned, unsigned)
+extern template GATHER_GPU(unsigned, uint64_t)
+
+extern template SCATTER_GPU(unsigned, float)
+extern template SCATTER_GPU(unsigned, double)
+extern template SCATTER_GPU(unsigned, unsigned)
+extern template SCATTER_GPU(unsigned, uint64_t)
+
+extern template SEGMENTED_REDUCE_GPU(float, unsigned)
+extern template SEGMENTED_REDUCE_GPU(double, unsigned)
+extern template SEGMENTED_REDUCE_GPU(unsigned, unsigned)
+extern template SEGMENTED_REDUCE_GPU(uint64_t, unsigned)
+
+} // namespace cstone
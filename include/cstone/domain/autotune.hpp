@@ -0,0 +1,315 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Runtime tuning of the bucket sizes and the MAC opening parameter of a domain
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * The Autotuner performs a coordinate search over the parameters during the first time steps of a simulation.
+ * Each candidate setting is applied to the domain, a few syncs are skipped to let the trees adapt, and the cost
+ * of the following syncs is measured with a SyncTimer, optionally complemented by the time the application spent
+ * in work that depends on the tree, e.g. the neighbor search. A parameter is moved in one direction for as long as
+ * the cost decreases, then the next parameter is tuned. Afterwards, the best setting found is locked in.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+#include <mpi.h>
+
+#include "cstone/domain/domain.hpp"
+#include "cstone/domain/domain_focus.hpp"
+#include "cstone/util/instrumentation.hpp"
+
+namespace cstone
+{
+
+//! @brief the parameters tuned by the Autotuner
+struct DomainParameters
+{
+    unsigned bucketSize;
+    //! @brief only used by FocusedDomain
+    unsigned bucketSizeFocus;
+    //! @brief only used by FocusedDomain
+    float theta;
+
+    bool operator==(const DomainParameters& rhs) const
+    {
+        return bucketSize == rhs.bucketSize && bucketSizeFocus == rhs.bucketSizeFocus && theta == rhs.theta;
+    }
+};
+
+/*! @brief bounds and schedule of the tuning
+ *
+ * Parameters with identical lower and upper bounds are not tuned. In particular, theta also controls the accuracy
+ * of tree-based algorithms such as the multipole gravity and should only be given a range if the accuracy
+ * is acceptable for all values in it.
+ */
+struct TuningSettings
+{
+    DomainParameters lower;
+    DomainParameters upper;
+    //! @brief syncs after each parameter change that are not measured, to let the trees adapt
+    int settleSteps{2};
+    //! @brief syncs measured per candidate setting
+    int measureSteps{3};
+    //! @brief minimum relative cost reduction for a candidate to replace the best setting
+    double minImprovement{0.02};
+    //! @brief additive step size for theta, bucket sizes are doubled or halved
+    float thetaStep{0.1f};
+};
+
+template<class DomainType>
+struct IsFocusedDomain : public std::false_type
+{
+};
+
+template<class SfcKind, class T, class Accelerator>
+struct IsFocusedDomain<FocusedDomain<SfcKind, T, Accelerator>> : public std::true_type
+{
+};
+
+template<class SfcKind, class T, class Accelerator>
+DomainParameters getParameters(const Domain<SfcKind, T, Accelerator>& domain)
+{
+    return {domain.bucketSize(), domain.bucketSize(), 0.0f};
+}
+
+template<class SfcKind, class T, class Accelerator>
+void setParameters(Domain<SfcKind, T, Accelerator>& domain, const DomainParameters& p)
+{
+    domain.setBucketSize(p.bucketSize);
+}
+
+template<class SfcKind, class T, class Accelerator>
+DomainParameters getParameters(const FocusedDomain<SfcKind, T, Accelerator>& domain)
+{
+    return {domain.bucketSize(), domain.bucketSizeFocus(), domain.theta()};
+}
+
+template<class SfcKind, class T, class Accelerator>
+void setParameters(FocusedDomain<SfcKind, T, Accelerator>& domain, const DomainParameters& p)
+{
+    domain.setBucketSizes(p.bucketSize, p.bucketSizeFocus);
+    domain.setTheta(p.theta);
+}
+
+/*! @brief tunes the parameters of a Domain or FocusedDomain during the first time steps
+ *
+ * Usage:
+ *
+ *   Autotuner tuner(domain, settings);
+ *   for each time step:
+ *       domain.sync(...);
+ *       ... application work, timed as appSeconds ...
+ *       tuner.step(appSeconds);
+ *
+ * The tuner registers itself as the observer of the domain until the parameters are locked, see
+ * Domain::setObserver. All ranks take identical decisions, since the cost of each candidate is the maximum
+ * over all ranks of the domain, obtained with one allreduce per candidate. step() is therefore collective.
+ */
+template<class DomainType>
+class Autotuner
+{
+public:
+    //! @brief a candidate setting and its measured cost in seconds per step
+    struct Trial
+    {
+        DomainParameters parameters;
+        double           cost;
+    };
+
+    Autotuner(DomainType& domain, const TuningSettings& settings)
+        : domain_(domain)
+        , settings_(settings)
+        , best_(getParameters(domain))
+        , candidate_(best_)
+    {
+        if (settings_.measureSteps < 1) { throw std::runtime_error("Autotuner: measureSteps must be positive\n"); }
+        if (!withinBounds(best_)) { throw std::runtime_error("Autotuner: initial parameters are out of bounds\n"); }
+        domain_.setObserver(&timer_);
+    }
+
+    Autotuner(const Autotuner&)            = delete;
+    Autotuner& operator=(const Autotuner&) = delete;
+
+    ~Autotuner()
+    {
+        if (!locked_) { domain_.setObserver(nullptr); }
+    }
+
+    /*! @brief account for the sync of the current time step, call once after each sync
+     *
+     * @param applicationSeconds  time spent by the executing rank in this step outside of the sync,
+     *                            in work whose cost depends on the tuned parameters
+     */
+    void step(double applicationSeconds = 0)
+    {
+        if (locked_) { return; }
+
+        double syncSeconds = 0;
+        for (int p = 0; p < numSyncPhases; ++p)
+        {
+            syncSeconds += timer_.counters(SyncPhase(p)).seconds;
+        }
+        timer_.reset();
+
+        if (stepInTrial_++ >= settings_.settleSteps) { trialSeconds_ += syncSeconds + applicationSeconds; }
+        if (stepInTrial_ < settings_.settleSteps + settings_.measureSteps) { return; }
+
+        double cost = trialSeconds_ / settings_.measureSteps;
+        MPI_Allreduce(MPI_IN_PLACE, &cost, 1, MPI_DOUBLE, MPI_MAX, domain_.comm());
+        trials_.push_back({candidate_, cost});
+        stepInTrial_  = 0;
+        trialSeconds_ = 0;
+
+        evaluate(cost);
+    }
+
+    //! @brief true once the tuning finished and the best parameters are applied permanently
+    [[nodiscard]] bool locked() const { return locked_; }
+
+    //! @brief the best parameters found so far, the final ones once locked
+    [[nodiscard]] const DomainParameters& parameters() const { return best_; }
+
+    //! @brief all evaluated settings in the order of evaluation, the first one is the initial setting
+    [[nodiscard]] const std::vector<Trial>& trials() const { return trials_; }
+
+private:
+    static constexpr int numParameters = 3;
+
+    bool isTunable(int param) const
+    {
+        // the global domain only has a bucket size
+        if (!IsFocusedDomain<DomainType>{} && param > 0) { return false; }
+        switch (param)
+        {
+            case 0: return settings_.lower.bucketSize != settings_.upper.bucketSize;
+            case 1: return settings_.lower.bucketSizeFocus != settings_.upper.bucketSizeFocus;
+            default: return settings_.lower.theta != settings_.upper.theta;
+        }
+    }
+
+    bool withinBounds(const DomainParameters& p) const
+    {
+        bool bucketOk = settings_.lower.bucketSize <= p.bucketSize && p.bucketSize <= settings_.upper.bucketSize;
+        if constexpr (!IsFocusedDomain<DomainType>{}) { return bucketOk; }
+        else
+        {
+            bool focusOk = settings_.lower.bucketSizeFocus <= p.bucketSizeFocus &&
+                           p.bucketSizeFocus <= settings_.upper.bucketSizeFocus && p.bucketSizeFocus <= p.bucketSize;
+            bool thetaOk = settings_.lower.theta <= p.theta && p.theta <= settings_.upper.theta;
+            return bucketOk && focusOk && thetaOk;
+        }
+    }
+
+    //! @brief move parameter @p param of @p p one step in @p direction
+    DomainParameters move(DomainParameters p, int param, int direction) const
+    {
+        switch (param)
+        {
+            case 0: p.bucketSize = direction > 0 ? 2 * p.bucketSize : p.bucketSize / 2; break;
+            case 1: p.bucketSizeFocus = direction > 0 ? 2 * p.bucketSizeFocus : p.bucketSizeFocus / 2; break;
+            default: p.theta = p.theta + direction * settings_.thetaStep; break;
+        }
+        return p;
+    }
+
+    void evaluate(double cost)
+    {
+        if (trials_.size() == 1) { bestCost_ = cost; }
+        else if (cost < bestCost_ * (1.0 - settings_.minImprovement))
+        {
+            best_     = candidate_;
+            bestCost_ = cost;
+            improved_ = true;
+        }
+        else
+        {
+            // the last step in this direction was not beneficial, try the opposite direction if the current
+            // direction did not lead to any improvement, otherwise continue with the next parameter
+            if (direction_ > 0 && !improved_) { direction_ = -1; }
+            else { nextParameter(); }
+        }
+
+        selectCandidate();
+    }
+
+    void nextParameter()
+    {
+        param_++;
+        direction_ = 1;
+        improved_  = false;
+    }
+
+    //! @brief find the next valid candidate, or lock in the best parameters if there is none
+    void selectCandidate()
+    {
+        while (param_ < numParameters)
+        {
+            if (isTunable(param_))
+            {
+                DomainParameters c = move(best_, param_, direction_);
+                if (withinBounds(c) && !(c == best_))
+                {
+                    candidate_ = c;
+                    setParameters(domain_, candidate_);
+                    return;
+                }
+            }
+            if (direction_ > 0 && !improved_ && isTunable(param_)) { direction_ = -1; }
+            else { nextParameter(); }
+        }
+
+        candidate_ = best_;
+        setParameters(domain_, best_);
+        domain_.setObserver(nullptr);
+        locked_ = true;
+    }
+
+    DomainType&    domain_;
+    TuningSettings settings_;
+    SyncTimer      timer_;
+
+    DomainParameters best_;
+    DomainParameters candidate_;
+    double           bestCost_{0};
+
+    int    param_{0};
+    int    direction_{1};
+    bool   improved_{false};
+    bool   locked_{false};
+    int    stepInTrial_{0};
+    double trialSeconds_{0};
+
+    std::vector<Trial> trials_;
+};
+
+} // namespace cstone
@@ -0,0 +1,212 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Binary serialization of domain state and collective checkpoint files
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <mpi.h>
+
+namespace cstone
+{
+
+//! @brief appends the binary representation of trivially copyable values and vectors to a byte blob
+class StateWriter
+{
+public:
+    template<class V>
+    void write(const V& value)
+    {
+        static_assert(std::is_trivially_copyable_v<V>, "only trivially copyable state can be serialized\n");
+        append(&value, sizeof(V));
+    }
+
+    //! @brief write the number of elements, followed by the elements
+    template<class V>
+    void write(const std::vector<V>& values)
+    {
+        static_assert(std::is_trivially_copyable_v<V>, "only trivially copyable state can be serialized\n");
+        write(uint64_t(values.size()));
+        append(values.data(), values.size() * sizeof(V));
+    }
+
+    [[nodiscard]] const std::vector<char>& bytes() const { return bytes_; }
+
+private:
+    void append(const void* data, std::size_t numBytes)
+    {
+        const char* first = static_cast<const char*>(data);
+        bytes_.insert(bytes_.end(), first, first + numBytes);
+    }
+
+    std::vector<char> bytes_;
+};
+
+//! @brief reads back values in the order they were written by a StateWriter, throws if the blob is too short
+class StateReader
+{
+public:
+    explicit StateReader(const std::vector<char>& bytes)
+        : bytes_(bytes)
+    {
+    }
+
+    template<class V>
+    void read(V& value)
+    {
+        static_assert(std::is_trivially_copyable_v<V>, "only trivially copyable state can be serialized\n");
+        extract(&value, sizeof(V));
+    }
+
+    template<class V>
+    void read(std::vector<V>& values)
+    {
+        static_assert(std::is_trivially_copyable_v<V>, "only trivially copyable state can be serialized\n");
+        uint64_t numElements;
+        read(numElements);
+        if (numElements > (bytes_.size() - position_) / sizeof(V))
+        {
+            throw std::runtime_error("domain state is truncated\n");
+        }
+        values.resize(numElements);
+        extract(values.data(), numElements * sizeof(V));
+    }
+
+    //! @brief read a value and throw if it differs from @p expected
+    template<class V>
+    void expect(const V& expected, const char* what)
+    {
+        V value;
+        read(value);
+        if (!(value == expected))
+        {
+            throw std::runtime_error(std::string("domain state mismatch: ") + what + "\n");
+        }
+    }
+
+private:
+    void extract(void* data, std::size_t numBytes)
+    {
+        if (numBytes > bytes_.size() - position_) { throw std::runtime_error("domain state is truncated\n"); }
+        std::memcpy(data, bytes_.data() + position_, numBytes);
+        position_ += numBytes;
+    }
+
+    const std::vector<char>& bytes_;
+    std::size_t position_{0};
+};
+
+/*! @brief collectively write one state blob per rank into a single file
+ *
+ * @param filename   output file, existing content is overwritten
+ * @param blob       the state of the executing rank
+ * @param comm       collective call on all ranks of @p comm
+ *
+ * File layout: number of ranks, the blob size of each rank, followed by the concatenated blobs in rank order.
+ * All integers in the header are 64-bit.
+ */
+inline void writeStateFile(const std::string& filename, const std::vector<char>& blob, MPI_Comm comm = MPI_COMM_WORLD)
+{
+    int rank, numRanks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numRanks);
+
+    if (blob.size() > std::size_t(INT_MAX)) { throw std::runtime_error("domain state exceeds 2 GB per rank\n"); }
+
+    std::vector<uint64_t> header(numRanks + 1);
+    header[0]         = numRanks;
+    uint64_t blobSize = blob.size();
+    MPI_Allgather(&blobSize, 1, MPI_UINT64_T, header.data() + 1, 1, MPI_UINT64_T, comm);
+
+    MPI_Offset offset = header.size() * sizeof(uint64_t);
+    for (int i = 0; i < rank; ++i)
+    {
+        offset += header[i + 1];
+    }
+
+    MPI_File file;
+    int err = MPI_File_open(comm, filename.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file);
+    if (err != MPI_SUCCESS) { throw std::runtime_error("could not open " + filename + " for writing\n"); }
+    MPI_File_set_size(file, 0);
+
+    int headerBytes = rank == 0 ? header.size() * sizeof(uint64_t) : 0;
+    MPI_File_write_at_all(file, 0, header.data(), headerBytes, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_write_at_all(file, offset, blob.data(), int(blob.size()), MPI_BYTE, MPI_STATUS_IGNORE);
+
+    MPI_File_close(&file);
+}
+
+/*! @brief collectively read the state blob of the executing rank from a file written by writeStateFile
+ *
+ * Throws if the file was written with a different number of ranks.
+ */
+inline std::vector<char> readStateFile(const std::string& filename, MPI_Comm comm = MPI_COMM_WORLD)
+{
+    int rank, numRanks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numRanks);
+
+    MPI_File file;
+    int err = MPI_File_open(comm, filename.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file);
+    if (err != MPI_SUCCESS) { throw std::runtime_error("could not open " + filename + " for reading\n"); }
+
+    uint64_t fileRanks = 0;
+    MPI_File_read_at_all(file, 0, &fileRanks, sizeof(uint64_t), MPI_BYTE, MPI_STATUS_IGNORE);
+    if (fileRanks != uint64_t(numRanks))
+    {
+        MPI_File_close(&file);
+        throw std::runtime_error("domain state in " + filename + " was written with a different number of ranks\n");
+    }
+
+    std::vector<uint64_t> sizes(numRanks);
+    MPI_File_read_at_all(file, sizeof(uint64_t), sizes.data(), numRanks * sizeof(uint64_t), MPI_BYTE,
+                         MPI_STATUS_IGNORE);
+
+    MPI_Offset offset = (numRanks + 1) * sizeof(uint64_t);
+    for (int i = 0; i < rank; ++i)
+    {
+        offset += sizes[i];
+    }
+
+    std::vector<char> blob(sizes[rank]);
+    MPI_File_read_at_all(file, offset, blob.data(), int(blob.size()), MPI_BYTE, MPI_STATUS_IGNORE);
+
+    MPI_File_close(&file);
+    return blob;
+}
+
+} // namespace cstone
@@ -35,20 +35,37 @@
 #pragma once
 
 #include "cstone/sfc/box_mpi.hpp"
+#include "cstone/sfc/sfc.hpp"
+#include "checkpoint.hpp"
 #include "domain_traits.hpp"
 #include "domaindecomp_mpi.hpp"
 #include "cstone/halos/discovery.hpp"
+#include "cstone/halos/exchange_active.hpp"
 #include "cstone/halos/exchange_halos.hpp"
 #include "layout.hpp"
+#include "particle_container.hpp"
+#include "snapshot.hpp"
+#include "cstone/tree/lod_mpi.hpp"
 #include "cstone/tree/octree_mpi.hpp"
+#include "cstone/util/first_touch_allocator.hpp"
+#include "cstone/util/instrumentation_mpi.hpp"
+#include "cstone/util/scratch_arena.hpp"
+#include "cstone/util/tracing.hpp"
 
 namespace cstone
 {
 
-template<class KeyType, class T, class Accelerator = CpuTag>
+/*! @brief manages the distributed particle data and halos based on a global octree
+ *
+ * @tparam SfcKind      32- or 64-bit unsigned integer to use Morton keys,
+ *                      or MortonKey/HilbertKey<32- or 64-bit unsigned> to select the SFC, see sfc.hpp
+ * @tparam T            float or double
+ * @tparam Accelerator  CpuTag or CudaTag
+ */
+template<class SfcKind, class T, class Accelerator = CpuTag>
 class Domain
 {
-    static_assert(std::is_unsigned<KeyType>{}, "SFC key type needs to be an unsigned integer\n");
+    using KeyType = SfcKeyType_t<SfcKind>;
 
     using ReorderFunctor = ReorderFunctor_t<Accelerator, T, KeyType, LocalParticleIndex>;
 
@@ -61,10 +78,22 @@ public:
      * @param box         global bounding box, default is non-pbc box
      *                    for each periodic dimension in @a box, the coordinate min/max
      *                    limits will never be changed for the lifetime of the Domain
+     * @param haloRadiusTolerance  relative decrease of halo radii up to which the halo exchange pattern
+     *                             of the previous sync is reused if the tree did not change
+     * @param deviceId    GPU used by CudaTag domains for reordering and device halo exchanges, e.g. obtained
+     *                    from deviceOfRank, a negative value selects the current device, ignored for CpuTag
+     * @param comm        the ranks that share the domain, @p rank and @p nRanks refer to this communicator.
+     *                    All collective operations of the domain are restricted to it, such that independent
+     *                    domains can be decomposed concurrently on disjoint communicators. The domain works
+     *                    on a duplicate of @p comm, the constructor is therefore collective over @p comm.
      *
      */
-    explicit Domain(int rank, int nRanks, int bucketSize, const Box<T>& box = Box<T>{0,1})
-        : myRank_(rank), nRanks_(nRanks), bucketSize_(bucketSize), box_(box)
+    explicit Domain(int rank, int nRanks, int bucketSize, const Box<T>& box = Box<T>{0,1},
+                    float haloRadiusTolerance = 0, int deviceId = -1, MPI_Comm comm = MPI_COMM_WORLD)
+        : myRank_(rank), nRanks_(nRanks), comm_(comm), bucketSize_(bucketSize), box_(box),
+          deviceHaloExchanger_(makeDeviceFunctor<DeviceHaloExchanger_t<Accelerator, T>>(deviceId)),
+          haloBox_(box), haloRadiusTolerance_(haloRadiusTolerance),
+          reorderFunctor(makeDeviceFunctor<ReorderFunctor>(deviceId))
     {}
 
     /*! @brief Domain update sequence for particles with coordinates x,y,z, interaction radius h and their properties
@@ -73,10 +102,10 @@ public:
      * @param[inout] y
      * @param[inout] z
      * @param[inout] h      interaction radii in SPH convention, actual interaction radius is twice the value in h
-     * @param[out]   codes  Morton codes
+     * @param[out]   codes  SFC keys
      *
      * @param[inout] particleProperties  particle properties to distribute along with the coordinates
-     *                                   e.g. mass or charge
+     *                                   e.g. mass or charge, std::vector<T> or ParticleContainer
      *
      * ============================================================================================================
      * Preconditions:
@@ -87,9 +116,8 @@ public:
      *     on the first call. This is checked.
      *
      *     This means that none of the argument arrays can be resized between calls of this function.
-     *     Or in other words, particles cannot be created or destroyed.
-     *     (If this should ever be required though, it can be easily enabled by allowing the assigned
-     *     index range from startIndex() to endIndex() to be modified from the outside.)
+     *     Particles are created and destroyed with removeAndCreate instead, which adjusts the assigned
+     *     index range from startIndex() to endIndex().
      *
      *   - The particle order is irrelevant
      *
@@ -117,11 +145,14 @@ public:
      *     Content of elements outside this range is _undefined_, but can be filled with the corresponding halo data
      *     by a subsequent call to exchangeHalos(particleProperty), such that also for i outside [startIndex():endIndex()],
      *     particleProperty[i] is a property of the halo particle with coordinates (x[i], y[i], z[i]).
+     *   - For a ParticleContainer, this applies to its migrate fields. Its halo fields additionally contain
+     *     the halos, which are exchanged together with those of x,y,z,h. Transient fields are only resized.
+     *     Deferred fields hold the same content as migrate fields once they are accessed through the container.
      *
      *   Content of codes
      *   ----------------
-     *   - The codes output is sorted and contains the Morton codes of assigned _and_ halo particles,
-     *     i.e. all arrays will be output in Morton order.
+     *   - The codes output is sorted and contains the SFC keys of assigned _and_ halo particles,
+     *     i.e. all arrays will be output in SFC order.
      *
      *   Internal state of the domain
      *   ----------------------------
@@ -129,7 +160,9 @@ public:
      *   - Update of the global octree, for use as starting guess in the next call
      *   - Update of the assigned range startIndex() and endIndex()
      *   - Update of the total local particle count, i.e. assigned + halo particles
-     *   - Update of the halo exchange patterns, for subsequent use in exchangeHalos
+     *   - Update of the halo exchange patterns, for subsequent use in exchangeHalos.
+     *     If the tree, node counts, assignment and box did not change and the halo radii are within tolerance,
+     *     the pattern of the previous call is reused and steps 5. and 6. below are skipped.
      *   - Update of the global coordinate bounding box
      *
      * ============================================================================================================
@@ -151,6 +184,289 @@ public:
     void sync(std::vector<T>& x, std::vector<T>& y, std::vector<T>& z, std::vector<T>& h, std::vector<KeyType>& codes,
               Vectors&... particleProperties)
     {
+        syncImpl(nullptr, 0, x, y, z, h, codes, particleProperties...);
+    }
+
+    /*! @brief Domain update sequence that balances the sum of per-particle weights instead of particle counts
+     *
+     * @param[in] weights         per-particle cost, e.g. the number of neighbors, same size as @p x,
+     *                            only the elements of assigned particles are read
+     * @param[in] maxCountFactor  the number of assigned particles per rank is limited to @p maxCountFactor
+     *                            times the average number of particles per rank
+     *
+     * The weights are summed up per leaf of the global tree and the SFC is split into ranges
+     * with equal weights, see weightedSfcSplit. The remaining arguments are the same as for sync.
+     */
+    template<class... Vectors>
+    void syncWeighted(const std::vector<float>& weights, float maxCountFactor, std::vector<T>& x, std::vector<T>& y,
+                      std::vector<T>& z, std::vector<T>& h, std::vector<KeyType>& codes,
+                      Vectors&... particleProperties)
+    {
+        if (weights.size() != x.size())
+        {
+            throw std::runtime_error("Domain sync: particle weights size is inconsistent\n");
+        }
+        syncImpl(&weights, maxCountFactor, x, y, z, h, codes, particleProperties...);
+    }
+
+    /*! @brief lightweight domain update for time steps in which particles did not move far
+     *
+     * @return   true if the lazy update was performed, false if a full sync was performed instead
+     *
+     * If all assigned particles on all ranks are still located in the leaf of the global tree that they were
+     * in after the previous sync, with a smoothing length that does not exceed the halo radius of that leaf
+     * and inside the bounding box, then the box, the global tree, the assignment and the halo exchange pattern
+     * remain valid. In this case, the domain exchange and the update of the global tree are skipped.
+     * The assigned particles are only re-sorted by their new keys, which does not change the node counts,
+     * and the halos of x,y,z,h are refreshed. This check requires one pass over the assigned particles
+     * and a single allreduce. Otherwise, this function performs a full sync. The fallback is decided
+     * collectively, if any rank has no reusable halo pattern or changed array sizes, all ranks perform a full sync.
+     *
+     * Arguments, preconditions and postconditions are the same as for sync.
+     */
+    template<class... Vectors>
+    bool syncLazy(std::vector<T>& x, std::vector<T>& y, std::vector<T>& z, std::vector<T>& h,
+                  std::vector<KeyType>& codes, Vectors&... particleProperties)
+    {
+        CSTONE_TRACE_RANGE("Domain::syncLazy");
+        // after loadState or removeAndCreate, there is no halo pattern to reuse. Since this can differ between
+        // ranks, the decision to fall back to a full sync is part of the collective check below
+        bool fallback = firstCall_ || haloRadii_.empty() ||
+                        !sizesAllEqualTo(localNParticles_, x, y, z, h, codes, particleProperties...);
+
+        PhaseScope phase(observer_, SyncPhase::keys);
+        LocalParticleIndex nParticles = fallback ? 0 : particleEnd_ - particleStart_;
+        std::vector<KeyType> newKeys(nParticles);
+        if (!fallback)
+        {
+            computeSfcKeys<SfcKind>(cbegin(x) + particleStart_, cbegin(x) + particleEnd_,
+                                    cbegin(y) + particleStart_,
+                                    cbegin(z) + particleStart_,
+                                    begin(newKeys), box_);
+        }
+
+        int stayed = !fallback;
+        #pragma omp parallel for reduction(min : stayed)
+        for (LocalParticleIndex i = 0; i < nParticles; ++i)
+        {
+            LocalParticleIndex p = particleStart_ + i;
+            // the keys of the previous sync are sorted and belong to the current tree
+            TreeNodeIndex node = std::upper_bound(cbegin(tree_), cend(tree_), codes[p]) - cbegin(tree_) - 1;
+
+            bool inLeaf   = tree_[node] <= newKeys[i] && newKeys[i] < tree_[node + 1];
+            bool inRadius = float(2 * h[p]) <= haloRadii_[node];
+            bool inBox    = (box_.pbcX() || (box_.xmin() <= x[p] && x[p] <= box_.xmax())) &&
+                            (box_.pbcY() || (box_.ymin() <= y[p] && y[p] <= box_.ymax())) &&
+                            (box_.pbcZ() || (box_.zmin() <= z[p] && z[p] <= box_.zmax()));
+
+            if (!(inLeaf && inRadius && inBox)) { stayed = 0; }
+        }
+        MPI_Allreduce(MPI_IN_PLACE, &stayed, 1, MPI_INT, MPI_MIN, comm_);
+
+        if (!stayed)
+        {
+            phase.end();
+            sync(x, y, z, h, codes, particleProperties...);
+            return false;
+        }
+
+        std::copy(begin(newKeys), end(newKeys), begin(codes) + particleStart_);
+        particleExchangeVolume_.clear();
+        sortAssignedAndExchangeHalos(phase, x, y, z, h, codes, particleProperties...);
+
+        return true;
+    }
+
+    /*! @brief domain update for a substep of hierarchical time-stepping, in which only some particles moved
+     *
+     * @param[in] activeIndices  sorted indices of the particles that were updated since the previous sync,
+     *                           all in [startIndex():endIndex()]
+     * @return                   true if the partial update was performed, false if a full sync was performed
+     *
+     * Same as syncLazy, except that only the active particles are checked and updated. If all of them are still
+     * in their leaf of the global tree, with a smoothing length that does not exceed the halo radius of that
+     * leaf and inside the bounding box, then the tree, the assignment and the halo exchange pattern are kept.
+     * The keys of the active particles are recomputed, the leaves that contain active particles are re-sorted
+     * and only halos in these leaves are exchanged for x,y,z,h. Apart from a single allreduce and the exchange
+     * of the active node lists with the peers, the cost scales with the number of active particles and their
+     * leaves. Inactive particles must not have been modified. Otherwise, this function performs a full sync.
+     * As in syncLazy, the fallback is decided collectively. Invalid @p activeIndices on any rank throw on all ranks.
+     *
+     * Re-sorting leaves permutes the particles within these leaves, but does not move particles between leaves.
+     * @p activeIndices therefore still identifies the active leaves for exchangeHalosActive. To track which
+     * particles are active, a flag can be passed along as a particle property.
+     *
+     * Particle properties need to be std::vectors of type T, see sync for the other arguments.
+     */
+    template<class... Vectors>
+    bool syncActive(const std::vector<LocalParticleIndex>& activeIndices, std::vector<T>& x, std::vector<T>& y,
+                    std::vector<T>& z, std::vector<T>& h, std::vector<KeyType>& codes,
+                    Vectors&... particleProperties)
+    {
+        CSTONE_TRACE_RANGE("Domain::syncActive");
+        static_assert((std::is_same_v<Vectors, std::vector<T>> && ...),
+                      "syncActive only supports std::vector<T> particle properties\n");
+
+        // the fallback and the validity of the indices are decided collectively, such that all ranks either
+        // throw, perform a full sync or proceed with the partial update
+        bool fallback = firstCall_ || haloRadii_.empty() ||
+                        !sizesAllEqualTo(localNParticles_, x, y, z, h, codes, particleProperties...);
+        bool valid    = fallback || activeIndicesValid(activeIndices);
+
+        PhaseScope phase(observer_, SyncPhase::keys);
+        std::size_t numActive = (fallback || !valid) ? 0 : activeIndices.size();
+        std::vector<KeyType> newKeys(numActive);
+
+        int moved = fallback;
+        #pragma omp parallel for reduction(max : moved)
+        for (std::size_t i = 0; i < numActive; ++i)
+        {
+            LocalParticleIndex p = activeIndices[i];
+            newKeys[i]           = sfc3D<SfcKind>(x[p], y[p], z[p], box_);
+            TreeNodeIndex node   = std::upper_bound(cbegin(tree_), cend(tree_), codes[p]) - cbegin(tree_) - 1;
+
+            bool inLeaf   = tree_[node] <= newKeys[i] && newKeys[i] < tree_[node + 1];
+            bool inRadius = float(2 * h[p]) <= haloRadii_[node];
+            bool inBox    = (box_.pbcX() || (box_.xmin() <= x[p] && x[p] <= box_.xmax())) &&
+                            (box_.pbcY() || (box_.ymin() <= y[p] && y[p] <= box_.ymax())) &&
+                            (box_.pbcZ() || (box_.zmin() <= z[p] && z[p] <= box_.zmax()));
+
+            if (!(inLeaf && inRadius && inBox)) { moved = 1; }
+        }
+        int status[2] = {!valid, moved};
+        MPI_Allreduce(MPI_IN_PLACE, status, 2, MPI_INT, MPI_MAX, comm_);
+
+        if (status[0])
+        {
+            throw std::runtime_error("active particle indices need to be sorted and assigned to the executing rank\n");
+        }
+        if (status[1])
+        {
+            phase.end();
+            sync(x, y, z, h, codes, particleProperties...);
+            return false;
+        }
+
+        phase.next(SyncPhase::sort);
+        for (std::size_t i = 0; i < numActive; ++i)
+        {
+            codes[activeIndices[i]] = newKeys[i];
+        }
+
+        // the active particles are still in the same leaves, only these leaves can be out of order
+        std::vector<LocalParticleIndex> ordering;
+        TreeNodeIndex previousNode = -1;
+        for (LocalParticleIndex p : activeIndices)
+        {
+            TreeNodeIndex node = layoutNode(p);
+            if (node == previousNode) { continue; }
+            previousNode = node;
+
+            LocalParticleIndex first = nodeOffsets_[node];
+            LocalParticleIndex last  = nodeOffsets_[node + 1];
+            if (std::is_sorted(codes.begin() + first, codes.begin() + last)) { continue; }
+
+            ordering.resize(last - first);
+            std::iota(ordering.begin(), ordering.end(), 0);
+            std::stable_sort(ordering.begin(), ordering.end(), [&codes, first](auto a, auto b)
+                             { return codes[first + a] < codes[first + b]; });
+            (gatherRange(ordering, first, x), gatherRange(ordering, first, y), gatherRange(ordering, first, z),
+             gatherRange(ordering, first, h), gatherRange(ordering, first, codes));
+            (gatherRange(ordering, first, particleProperties), ...);
+        }
+
+        phase.next(SyncPhase::haloExchange);
+        SendList incomingHalos, outgoingHalos;
+        activeHaloPattern(activeIndices, incomingHalos, outgoingHalos);
+        haloexchange(comm_, incomingHalos, outgoingHalos, x.data(), y.data(), z.data(), h.data());
+        phase.recordTraffic(sendListTraffic(outgoingHalos, incomingHalos, myRank_, 4 * sizeof(T)));
+        particleExchangeVolume_.clear();
+        haloExchangeVolume_ =
+            peerVolumes(sendListCounts(outgoingHalos), sendListCounts(incomingHalos), myRank_, 4 * sizeof(T));
+
+        phase.next(SyncPhase::keys);
+        for (const auto& manifest : incomingHalos)
+        {
+            for (std::size_t i = 0; i < manifest.nRanges(); ++i)
+            {
+                computeSfcKeys<SfcKind>(cbegin(x) + manifest.rangeStart(i), cbegin(x) + manifest.rangeEnd(i),
+                                        cbegin(y) + manifest.rangeStart(i), cbegin(z) + manifest.rangeStart(i),
+                                        begin(codes) + manifest.rangeStart(i), box_);
+            }
+        }
+
+        return true;
+    }
+
+    /*! @brief remove assigned particles and create new ones between two syncs
+     *
+     * @param[in]    removeIndices       indices of the particles to remove, all in [startIndex():endIndex()],
+     *                                   without duplicates and in any order
+     * @param[in]    numNew              number of particles to create
+     * @param[inout] x                   coordinates, radii and particle properties as passed to sync
+     * @param[inout] y
+     * @param[inout] z
+     * @param[inout] h
+     * @param[inout] particleProperties  std::vectors of type T
+     * @return                           the index of the first created particle, the created particles occupy
+     *                                   [return value:endIndex()] and must be initialized before the next sync
+     *
+     * Removed particles are replaced by particles from the end of the assigned range and the created particles
+     * are placed behind the remaining ones, in place of the halos. The arrays only grow if the created particles
+     * do not fit. Apart from that, the cost is proportional to the number of removed and created particles.
+     * Afterwards, the halos are invalid and the assigned particles are no longer sorted, until the next sync,
+     * which updates the global tree incrementally with the changed particle counts and recomputes the halo pattern.
+     * syncLazy and syncActive fall back to a full sync.
+     * The call is not collective, each rank may remove and create any number of particles or skip the call.
+     * The subsequent sync, syncLazy or syncActive agree collectively on discarding the halo pattern, such that
+     * all ranks take the same path if at least one of them called removeAndCreate.
+     */
+    template<class... Vectors>
+    LocalParticleIndex removeAndCreate(const std::vector<LocalParticleIndex>& removeIndices, LocalParticleIndex numNew,
+                                       std::vector<T>& x, std::vector<T>& y, std::vector<T>& z, std::vector<T>& h,
+                                       Vectors&... particleProperties)
+    {
+        static_assert((std::is_same_v<Vectors, std::vector<T>> && ...),
+                      "removeAndCreate only supports std::vector<T> particle properties\n");
+        if (firstCall_)
+        {
+            throw std::runtime_error("Domain removeAndCreate: before the first sync, particle arrays can be resized\n");
+        }
+        if (!sizesAllEqualTo(localNParticles_, x, y, z, h, particleProperties...))
+        {
+            throw std::runtime_error("Domain removeAndCreate: input array sizes are inconsistent\n");
+        }
+
+        std::vector<LocalParticleIndex> destinations, sources;
+        removalMoves(removeIndices, particleStart_, particleEnd_, destinations, sources);
+        moveElements(destinations, sources, x, y, z, h, particleProperties...);
+
+        LocalParticleIndex firstNew = particleEnd_ - LocalParticleIndex(removeIndices.size());
+        particleEnd_                = firstNew + numNew;
+        if (particleEnd_ > localNParticles_)
+        {
+            localNParticles_ = particleEnd_;
+            reallocate(localNParticles_, x, y, z, h, particleProperties...);
+        }
+
+        // the halo pattern of the previous sync is no longer valid
+        haloTree_.clear();
+        haloNodeCounts_.clear();
+        haloRadii_.clear();
+
+        return firstNew;
+    }
+
+private:
+    //! @brief the update sequence of sync, with optional per-particle weights for the decomposition
+    template<class... Vectors>
+    void syncImpl(const std::vector<float>* weights, float maxCountFactor, std::vector<T>& x, std::vector<T>& y,
+                  std::vector<T>& z, std::vector<T>& h, std::vector<KeyType>& codes, Vectors&... particleProperties)
+    {
+        CSTONE_TRACE_RANGE("Domain::sync");
+        // temporaries of the previous sync are released, steady-state syncs reuse the same storage
+        scratch_.reset();
+
         // bounds initialization on first call, use all particles
         if (firstCall_)
         {
@@ -166,154 +482,332 @@ public:
             throw std::runtime_error("Domain sync: input array sizes are inconsistent\n");
         }
 
+        PhaseScope phase(observer_, SyncPhase::box);
         box_ = makeGlobalBox(cbegin(x) + particleStart_, cbegin(x) + particleEnd_,
                              cbegin(y) + particleStart_,
-                             cbegin(z) + particleStart_, box_);
+                             cbegin(z) + particleStart_, box_, comm_);
+        if (cubicKeySpace_) { box_ = makeCubicBox(box_); }
 
         // number of locally assigned particles to consider for global tree building
         LocalParticleIndex nParticles = particleEnd_ - particleStart_;
 
+        phase.next(SyncPhase::keys);
         codes.resize(nParticles);
 
         // compute morton codes only for particles participating in tree build
-        computeMortonCodes(cbegin(x) + particleStart_, cbegin(x) + particleEnd_,
-                           cbegin(y) + particleStart_,
-                           cbegin(z) + particleStart_,
-                           begin(codes), box_);
+        computeSfcKeys<SfcKind>(cbegin(x) + particleStart_, cbegin(x) + particleEnd_,
+                                cbegin(y) + particleStart_,
+                                cbegin(z) + particleStart_,
+                                begin(codes), box_);
 
         // reorder the codes according to the ordering
         // has the same net effect as std::sort(begin(mortonCodes), end(mortonCodes)),
         // but with the difference that we explicitly know the ordering, such
         // that we can later apply it to the x,y,z,h arrays or to access them in the Morton order
+        phase.next(SyncPhase::sort);
         reorderFunctor.setMapFromCodes(codes.data(), codes.data() + codes.size());
 
         // extract ordering for use in e.g. exchange particles
-        std::vector<LocalParticleIndex> mortonOrder(nParticles);
+        gsl::span<LocalParticleIndex> mortonOrder = scratch_.allocate<LocalParticleIndex>(nParticles);
         reorderFunctor.getReorderMap(mortonOrder.data());
 
         // compute the global octree in cornerstone format (leaves only)
         // the resulting tree and node counts will be identical on all ranks
-        updateOctreeGlobal(codes.data(), codes.data() + nParticles, bucketSize_, tree_, nodeCounts_);
-
+        phase.next(SyncPhase::globalTree);
         if (firstCall_)
         {
-            // full build on first call
-            while(!updateOctreeGlobal(codes.data(), codes.data() + nParticles, bucketSize_, tree_, nodeCounts_));
-            firstCall_ = false;
+            // full build on first call, bootstrapped from a sample of the keys for large particle counts
+            phase.recordIterations(computeOctreeGlobalSampled(codes.data(), codes.data() + nParticles, bucketSize_,
+                                                              tree_, nodeCounts_, std::size_t(1) << 20, comm_));
+            rankGroups_ = computeNodeRankGroups(comm_);
+            firstCall_  = false;
+        }
+        else
+        {
+            updateOctreeGlobal(codes.data(), codes.data() + nParticles, bucketSize_, tree_, nodeCounts_, comm_);
+            phase.recordIterations(1);
         }
 
-        // assign one single range of Morton codes each rank
-        SpaceCurveAssignment assignment  = singleRangeSfcSplit(nodeCounts_, nRanks_);
+        // assign one single range of Morton codes each rank, the ranks of a compute node get consecutive ranges
+        phase.next(SyncPhase::assignment);
+        SpaceCurveAssignment assignment;
+        if (weights)
+        {
+            gsl::span<float> sortedWeights = scratch_.allocate<float>(nParticles);
+            #pragma omp parallel for schedule(static)
+            for (LocalParticleIndex i = 0; i < nParticles; ++i)
+            {
+                sortedWeights[i] = (*weights)[particleStart_ + mortonOrder[i]];
+            }
+            std::vector<double> nodeWeights(nNodes(tree_));
+            computeNodeWeightsGlobal(tree_.data(), nodeWeights.data(), nNodes(tree_), codes.data(),
+                                     codes.data() + nParticles, sortedWeights.data(), comm_);
+
+            std::size_t numParticles = std::accumulate(begin(nodeCounts_), end(nodeCounts_), std::size_t(0));
+            auto maxCount = std::size_t(double(maxCountFactor) * numParticles / nRanks_);
+            assignment    = weightedSfcSplit(nodeCounts_, nodeWeights, nRanks_, maxCount);
+        }
+        else
+        {
+            assignment = hierarchicalSfcSplit(nodeCounts_, rankGroups_);
+        }
         LocalParticleIndex newNParticlesAssigned = assignment.totalCount(myRank_);
 
         // Compute the maximum smoothing length (=halo radii) in each global node.
         // Float has a 23-bit mantissa and is therefore sufficiently precise to be normalized
         // into the range [0, 2^maxTreelevel<CodeType>{}], which is at most 21-bit for 64-bit Morton codes
-        std::vector<float> haloRadii(nNodes(tree_));
+        phase.next(SyncPhase::haloRadii);
+        gsl::span<float> haloRadii = scratch_.allocate<float>(nNodes(tree_));
         computeHaloRadiiGlobal(tree_.data(), nNodes(tree_), codes.data(), codes.data() + nParticles,
-                               mortonOrder.data(), h.data() + particleStart_, haloRadii.data());
+                               mortonOrder.data(), h.data() + particleStart_, haloRadii.data(), comm_);
 
-        // find outgoing and incoming halo nodes of the tree
-        // uses 3D collision detection
-        std::vector<pair<TreeNodeIndex>> haloPairs;
-        findHalos<KeyType, float>(tree_, haloRadii, box_, assignment.firstNodeIdx(myRank_), assignment.lastNodeIdx(myRank_), haloPairs);
+        phase.next(SyncPhase::haloDiscovery);
+        // removeAndCreate drops the halo pattern on the calling rank only, the halo exchange setup is collective
+        int reusePattern = haloPatternUnchanged(assignment, haloRadii);
+        MPI_Allreduce(MPI_IN_PLACE, &reusePattern, 1, MPI_INT, MPI_MIN, comm_);
 
-        // group outgoing and incoming halo node indices by destination/source rank
-        std::vector<std::vector<TreeNodeIndex>> incomingHaloNodes;
-        std::vector<std::vector<TreeNodeIndex>> outgoingHaloNodes;
-        computeSendRecvNodeList(assignment, haloPairs, incomingHaloNodes, outgoingHaloNodes);
-
-        // compute list of local node index ranges
-        std::vector<TreeNodeIndex> incomingHalosFlattened = flattenNodeList(incomingHaloNodes);
-
-        // Put all local node indices and incoming halo node indices in one sorted list.
-        // and compute an offset for each node into these arrays.
-        // This will be the new layout for x,y,z,h arrays.
-        std::vector<TreeNodeIndex> presentNodes;
-        std::vector<LocalParticleIndex> nodeOffsets;
-        computeLayoutOffsets(assignment.firstNodeIdx(myRank_), assignment.lastNodeIdx(myRank_),
-                             incomingHalosFlattened, nodeCounts_, presentNodes, nodeOffsets);
-        localNParticles_ = nodeOffsets.back();
-
-        TreeNodeIndex firstLocalNode = std::lower_bound(cbegin(presentNodes), cend(presentNodes), assignment.firstNodeIdx(myRank_))
-                                       - begin(presentNodes);
-
-        LocalParticleIndex newParticleStart = nodeOffsets[firstLocalNode];
-        LocalParticleIndex newParticleEnd   = newParticleStart + newNParticlesAssigned;
+        LocalParticleIndex newParticleStart;
+        if (reusePattern)
+        {
+            // the tree, node counts, assignment and box together with the halo radii determine
+            // the particle layout and halo exchange pattern, which are therefore still valid
+            newParticleStart = particleStart_;
+        }
+        else
+        {
+            newParticleStart = updateHaloPattern(assignment, haloRadii, phase);
+        }
+        LocalParticleIndex newParticleEnd = newParticleStart + newNParticlesAssigned;
 
         // compute send array ranges for domain exchange
         // index ranges in domainExchangeSends are valid relative to the sorted code array mortonCodes
         // note that there is no offset applied to mortonCodes, because it was constructed
         // only with locally assigned particles
+        phase.next(SyncPhase::particleExchange);
         SendList domainExchangeSends = createSendList<KeyType>(assignment, tree_, codes);
 
         // resize arrays to new sizes
         reallocate(localNParticles_, x,y,z,h, particleProperties...);
         reallocate(localNParticles_, codes);
-        // exchange assigned particles
-        exchangeParticles<T>(domainExchangeSends, Rank(myRank_), newNParticlesAssigned,
-                             particleStart_, newParticleStart, mortonOrder.data(),
-                             x.data(), y.data(), z.data(), h.data(), particleProperties.data()...);
+
+        // The sorted keys are scattered back to the unsorted particle positions to be exchanged along with the
+        // particles. Each message holds an SFC-sorted range of its source, such that the new assigned particles
+        // consist of sorted segments that only need to be merged instead of recomputing and sorting all keys.
+        gsl::span<KeyType> exchangeKeys =
+            scratch_.allocate<KeyType>(std::max(localNParticles_, particleStart_ + nParticles));
+        #pragma omp parallel for schedule(static)
+        for (LocalParticleIndex i = 0; i < nParticles; ++i)
+        {
+            exchangeKeys[particleStart_ + mortonOrder[i]] = codes[i];
+        }
+
+        // exchange assigned particles, pending reorder maps of deferred fields are applied while packing
+        std::vector<std::size_t> segments;
+        {
+            std::vector<ByteArray> exchangeArrays = syncedArrays(false, x, y, z, h, particleProperties...);
+            std::vector<const LocalParticleIndex*> pendingOrderings(4, nullptr);
+            (appendPending(pendingOrderings, particleProperties), ...);
+            exchangeArrays.push_back(byteArray(exchangeKeys.data()));
+            pendingOrderings.push_back(nullptr);
+
+            ParticleExchange<LocalParticleIndex> particleExchange;
+            particleExchange.start(domainExchangeSends, myRank_, newNParticlesAssigned, particleStart_,
+                                   newParticleStart, mortonOrder.data(), exchangeArrays.data(),
+                                   int(exchangeArrays.size()), pendingOrderings.data(), comm_);
+            particleExchange.finish();
+            phase.recordTraffic(particleExchange.traffic());
+            particleExchangeVolume_ = peerVolumes(sendListCounts(domainExchangeSends),
+                                                  particleExchange.receiveCounts(), myRank_,
+                                                  particleExchange.elementBytes());
+            segments = particleExchange.segments();
+            (clearPending(particleProperties), ...);
+        }
 
         // assigned particles have been moved to their new locations starting at particleStart_
         // by the domain exchange exchangeParticles
         std::swap(particleStart_, newParticleStart);
         std::swap(particleEnd_, newParticleEnd);
 
-        computeMortonCodes(cbegin(x) + particleStart_, cbegin(x) + particleEnd_,
-                           cbegin(y) + particleStart_,
-                           cbegin(z) + particleStart_,
-                           begin(codes) + particleStart_, box_);
+        phase.next(SyncPhase::sort);
+        std::copy(exchangeKeys.begin() + particleStart_, exchangeKeys.begin() + particleEnd_,
+                  codes.begin() + particleStart_);
+        {
+            gsl::span<LocalParticleIndex> ordering    = scratch_.allocate<LocalParticleIndex>(newNParticlesAssigned);
+            gsl::span<KeyType>            keyBuffer   = scratch_.allocate<KeyType>(newNParticlesAssigned);
+            gsl::span<LocalParticleIndex> indexBuffer = scratch_.allocate<LocalParticleIndex>(newNParticlesAssigned);
+            std::iota(ordering.begin(), ordering.end(), LocalParticleIndex(0));
 
+            mergeSortedSegmentsByKey(codes.data() + particleStart_, ordering.data(), segments.data(),
+                                     segments.size() - 1, keyBuffer.data(), indexBuffer.data());
+            reorderFunctor.setReorderMap(ordering.data(), ordering.data() + newNParticlesAssigned);
+        }
+
+        reorderAssignedAndExchangeHalos(phase, x, y, z, h, codes, particleProperties...);
+    }
+
+    /*! @brief sort the assigned particles by their keys, then exchange the halos of x,y,z,h and compute their keys
+     *
+     * Precondition: the keys of the assigned particles are stored in codes[particleStart_:particleEnd_]
+     */
+    template<class... Vectors>
+    void sortAssignedAndExchangeHalos(PhaseScope& phase, std::vector<T>& x, std::vector<T>& y, std::vector<T>& z, std::vector<T>& h,
+                                      std::vector<KeyType>& codes, Vectors&... particleProperties)
+    {
+        phase.next(SyncPhase::sort);
         reorderFunctor.setMapFromCodes(codes.data() + particleStart_, codes.data() + particleEnd_);
 
+        reorderAssignedAndExchangeHalos(phase, x, y, z, h, codes, particleProperties...);
+    }
+
+    /*! @brief apply the reorder map of the assigned particles, then exchange the halos of x,y,z,h and compute their keys
+     *
+     * Precondition: the reorder map of reorderFunctor sorts the assigned particles by key
+     */
+    template<class... Vectors>
+    void reorderAssignedAndExchangeHalos(PhaseScope& phase, std::vector<T>& x, std::vector<T>& y, std::vector<T>& z,
+                                         std::vector<T>& h, std::vector<KeyType>& codes, Vectors&... particleProperties)
+    {
         // We have to reorder the locally assigned particles in the coordinate and property arrays
         // which are located in the index range [particleStart_, particleEnd_].
         // Due to the domain particle exchange, contributions from remote ranks
         // are received in arbitrary order.
+        // All arrays are passed in a single call, such that they are reordered in one pass over the ordering
+        // on the CPU and with overlapping transfers on the GPU.
+        phase.next(SyncPhase::reorder);
         {
-            std::array<std::vector<T>*, 4 + sizeof...(Vectors)> particleArrays{&x, &y, &z, &h, &particleProperties...};
-            for (std::size_t i = 0; i < particleArrays.size(); ++i)
-            {
-                reorderFunctor(particleArrays[i]->data() + particleStart_) ;
-            }
+            std::vector<std::vector<T>*> particleArrays{&x, &y, &z, &h};
+            (addReorderTarget(particleArrays, particleProperties), ...);
+            reorderFunctor(particleArrays.data(), int(particleArrays.size()), particleStart_);
+        }
+        // the fields of particle containers may have other types than T, they are reordered through the map
+        if constexpr ((std::is_same_v<Vectors, ParticleContainer> || ...))
+        {
+            std::vector<LocalParticleIndex> ordering(particleEnd_ - particleStart_);
+            reorderFunctor.getReorderMap(ordering.data());
+            (reorderContainer(ordering, particleProperties), ...);
         }
 
-        incomingHaloIndices_ = createHaloExchangeList(incomingHaloNodes, presentNodes, nodeOffsets);
-        outgoingHaloIndices_ = createHaloExchangeList(outgoingHaloNodes, presentNodes, nodeOffsets);
-
-        exchangeHalos(x,y,z,h);
+        // x,y,z,h and the halo fields of particle containers are exchanged together
+        phase.next(SyncPhase::haloExchange);
+        {
+            std::vector<ByteArray> haloArrays = syncedArrays(true, x, y, z, h, particleProperties...);
+            haloExchanger_.exchange(haloArrays.data(), int(haloArrays.size()));
+            std::size_t elementBytes = packedElementBytes(haloArrays.data(), int(haloArrays.size()));
+            phase.recordTraffic(sendListTraffic(outgoingHaloIndices_, incomingHaloIndices_, myRank_, elementBytes));
+            haloExchangeVolume_ = peerVolumes(sendListCounts(outgoingHaloIndices_),
+                                              sendListCounts(incomingHaloIndices_), myRank_, elementBytes);
+        }
 
         // compute Morton codes for halo particles just received, from 0 to particleStart_
         // and from particleEnd_ to localNParticles_
-        computeMortonCodes(cbegin(x), cbegin(x) + particleStart_,
-                           cbegin(y),
-                           cbegin(z),
-                           begin(codes), box_);
-        computeMortonCodes(cbegin(x) + particleEnd_, cend(x),
-                           cbegin(y) + particleEnd_,
-                           cbegin(z) + particleEnd_,
-                           begin(codes) + particleEnd_, box_);
+        phase.next(SyncPhase::keys);
+        computeSfcKeys<SfcKind>(cbegin(x), cbegin(x) + particleStart_,
+                                cbegin(y),
+                                cbegin(z),
+                                begin(codes), box_);
+        computeSfcKeys<SfcKind>(cbegin(x) + particleEnd_, cend(x),
+                                cbegin(y) + particleEnd_,
+                                cbegin(z) + particleEnd_,
+                                begin(codes) + particleEnd_, box_);
     }
 
+public:
     /*! @brief repeat the halo exchange pattern from the previous sync operation for a different set of arrays
      *
-     * @param[inout] arrays  std::vector<float or double> of size localNParticles_
+     * @param[inout] arrays  std::vectors of size localNParticles_ with trivially copyable
+     *                       elements of possibly different types, e.g. float, double or SFC keys.
+     *                       Floating point vectors wrapped as reducedPrecision<float>(vector) or
+     *                       reducedPrecision<BFloat16>(vector) are transferred with reduced precision.
      *
-     * Arrays are not resized or reallocated.
-     * This is used e.g. for densities.
+     * Arrays are not resized or reallocated. The exchange buffers and the peer graph communicator are set up
+     * once per sync operation and reused. This is used e.g. for densities.
      */
     template<class...Arrays>
-    void exchangeHalos(Arrays&... arrays) const
+    void exchangeHalos(Arrays&&... arrays)
     {
         if (!sizesAllEqualTo(localNParticles_, arrays...))
         {
             throw std::runtime_error("halo exchange array sizes inconsistent with previous sync operation\n");
         }
 
-        haloexchange<T>(incomingHaloIndices_, outgoingHaloIndices_, arrays.data()...);
+        haloExchanger_.exchange(arrays.data()...);
     }
 
+    /*! @brief start the halo exchange of the previous sync operation for a different set of arrays
+     *
+     * @param[inout] arrays  std::vectors of size localNParticles_ with trivially copyable
+     *                       elements of possibly different types, e.g. float, double or SFC keys,
+     *                       optionally wrapped with reducedPrecision, see exchangeHalos
+     * @return               a handle, the incoming halos are present in @p arrays after its wait() returned
+     *
+     * Between this call and wait(), the particles in interiorRanges() can be processed, since they
+     * do not interact with any incoming halos.
+     */
+    template<class...Arrays>
+    auto exchangeHalosAsync(Arrays&&... arrays)
+    {
+        if (!sizesAllEqualTo(localNParticles_, arrays...))
+        {
+            throw std::runtime_error("halo exchange array sizes inconsistent with previous sync operation\n");
+        }
+
+        return haloExchanger_.exchangeAsync(arrays.data()...);
+    }
+
+    /*! @brief exchange only the halos in the leaves that contain active particles
+     *
+     * @param[in]    activeIndices  sorted indices of the particles whose values changed since the last
+     *                              exchange, all in [startIndex():endIndex()]
+     * @param[inout] arrays         std::vectors of size localNParticles_ with trivially copyable elements
+     *
+     * Uses the exchange pattern of the previous sync, restricted to the nodes that contain at least one
+     * active particle on their owning rank. Incoming halos in other nodes are left unchanged, i.e. they retain
+     * the values of a previous exchange. Collective over all ranks. The arguments are validated collectively,
+     * invalid array sizes or @p activeIndices on any rank throw on all ranks.
+     */
+    template<class...Arrays>
+    void exchangeHalosActive(const std::vector<LocalParticleIndex>& activeIndices, Arrays&... arrays)
+    {
+        if (haloRadii_.empty())
+        {
+            throw std::runtime_error("active particle updates require the halo pattern of a previous sync\n");
+        }
+
+        int status[2] = {!sizesAllEqualTo(localNParticles_, arrays...), !activeIndicesValid(activeIndices)};
+        MPI_Allreduce(MPI_IN_PLACE, status, 2, MPI_INT, MPI_MAX, comm_);
+
+        if (status[0])
+        {
+            throw std::runtime_error("halo exchange array sizes inconsistent with previous sync operation\n");
+        }
+        if (status[1])
+        {
+            throw std::runtime_error("active particle indices need to be sorted and assigned to the executing rank\n");
+        }
+
+        SendList incomingHalos, outgoingHalos;
+        activeHaloPattern(activeIndices, incomingHalos, outgoingHalos);
+        haloexchange(comm_, incomingHalos, outgoingHalos, arrays.data()...);
+    }
+
+    /*! @brief repeat the halo exchange pattern of the previous sync operation for arrays in GPU memory
+     *
+     * @param[inout] arrays  device pointers to float or double arrays of size nParticlesWithHalos(),
+     *                       optionally wrapped with reducedPrecision<float> or reducedPrecision<BFloat16>
+     *
+     * Only the halo elements are transferred between host and device, or none at all if MPI is CUDA-aware.
+     * Requires a domain with Accelerator = CudaTag.
+     */
+    template<class...Arrays>
+    void exchangeHalosDevice(Arrays... arrays)
+    {
+        static_assert(std::is_same_v<Accelerator, CudaTag>, "device halo exchange requires a CudaTag domain\n");
+        deviceHaloExchanger_.exchange(arrays...);
+    }
+
+    //! @brief return the index ranges of assigned particles that do not interact with any halos
+    [[nodiscard]] const std::vector<IndexPair<LocalParticleIndex>>& interiorRanges() const { return interiorRanges_; }
+
     //! @brief return the index of the first particle that's part of the local assignment
     [[nodiscard]] LocalParticleIndex startIndex() const { return particleStart_; }
 
@@ -332,7 +826,388 @@ public:
     //! @brief return the coordinate bounding box from the previous sync call
     Box<T> box() const { return box_; }
 
+    /*! @brief extend the open dimensions of the global box to a cube at each sync, see makeCubicBox
+     *
+     * For elongated domains, this keeps the tree cells cubic in real space, which leads to smaller halo
+     * boxes and less conservative MACs, at the expense of SFC key space that is not occupied by particles.
+     */
+    void setCubicKeySpace(bool enable) { cubicKeySpace_ = enable; }
+
+    //! @brief maximum number of particles per leaf of the global tree
+    [[nodiscard]] unsigned bucketSize() const { return bucketSize_; }
+
+    /*! @brief change the maximum number of particles per leaf of the global tree, e.g. from an Autotuner
+     *
+     * The global tree is adapted to the new bucket size by the rebalance steps of the following syncs,
+     * i.e. by at most one level per sync.
+     */
+    void setBucketSize(unsigned bucketSize)
+    {
+        if (bucketSize == 0) { throw std::runtime_error("bucket size must be positive\n"); }
+        bucketSize_ = bucketSize;
+    }
+
+    /*! @brief report the phases of subsequent syncs to @p observer, e.g. a SyncTimer
+     *
+     * The observer is not owned and needs to outlive the domain or be detached by passing nullptr,
+     * which is also the default.
+     */
+    void setObserver(SyncObserver* observer) { observer_ = observer; }
+
+    //! @brief number of halo particles relative to the number of assigned particles of the executing rank
+    [[nodiscard]] double haloRatio() const
+    {
+        return nParticles() > 0 ? double(nParticlesWithHalos() - nParticles()) / nParticles() : 0.0;
+    }
+
+    //! @brief number of ranks that the executing rank sends halos to or receives halos from
+    [[nodiscard]] int numPeers() const { return numExchangePeers(incomingHaloIndices_, outgoingHaloIndices_, myRank_); }
+
+    //! @brief the private duplicate of the communicator passed to the constructor
+    [[nodiscard]] MPI_Comm comm() const { return comm_; }
+
+    /*! @brief per-peer communication volume of the particle exchange of the previous sync
+     *
+     * Empty if the previous sync did not exchange assigned particles, i.e. for syncLazy and syncActive
+     * calls that did not fall back to a full sync.
+     */
+    [[nodiscard]] const std::vector<PeerVolume>& particleExchangeVolume() const { return particleExchangeVolume_; }
+
+    /*! @brief per-peer communication volume of the halo exchange of the previous sync
+     *
+     * Covers x,y,z,h and the halo fields of particle containers. Subsequent calls to exchangeHalos
+     * with the same pattern are not included.
+     */
+    [[nodiscard]] const std::vector<PeerVolume>& haloExchangeVolume() const { return haloExchangeVolume_; }
+
+    /*! @brief collectively compute the distribution of assigned particles, halos and peers across ranks
+     *
+     * Requires a single allreduce of a few elements, see DomainBalance.
+     */
+    [[nodiscard]] DomainBalance balance() const
+    {
+        return reduceDomainBalance(nParticles(), nParticlesWithHalos() - nParticles(), numPeers(), 0.0, comm_);
+    }
+
+    /*! @brief as balance(), additionally reports the distribution of the sums of @p weights over the assigned particles
+     *
+     * @param weights  per-particle cost, e.g. the number of neighbors, of size nParticlesWithHalos(),
+     *                 only the elements of assigned particles are read
+     */
+    [[nodiscard]] DomainBalance balance(const std::vector<float>& weights) const
+    {
+        if (weights.size() != nParticlesWithHalos())
+        {
+            throw std::runtime_error("Domain balance: particle weights size is inconsistent\n");
+        }
+        double weightSum = std::accumulate(weights.begin() + particleStart_, weights.begin() + particleEnd_, 0.0);
+        return reduceDomainBalance(nParticles(), nParticlesWithHalos() - nParticles(), numPeers(), weightSum, comm_);
+    }
+
+    /*! @brief collectively write the decomposition state of the previous sync call to @p filename
+     *
+     * Stores the global tree and its node counts, the assigned particle index range and the bounding box.
+     * Together with the particle arrays in the order and size of the previous sync, this is sufficient
+     * to continue with an incremental sync after a restart, see loadState.
+     */
+    void saveState(const std::string& filename) const
+    {
+        StateWriter writer;
+        writer.write(uint32_t(sizeof(KeyType)));
+        writer.write(uint32_t(sizeof(T)));
+        writer.write(nRanks_);
+        writer.write(myRank_);
+        writer.write(bucketSize_);
+        writer.write(particleStart_);
+        writer.write(particleEnd_);
+        writer.write(localNParticles_);
+        writer.write(box_);
+        writer.write(tree_);
+        writer.write(nodeCounts_);
+
+        writeStateFile(filename, writer.bytes(), comm_);
+    }
+
+    /*! @brief collectively restore the state written by saveState, on the same number of ranks
+     *
+     * The next sync call expects the particle arrays with the sizes and contents they had when the state
+     * was saved and proceeds as an incremental update, i.e. the convergence of the global tree is skipped.
+     * The halo exchange pattern is recomputed by the next sync call.
+     */
+    void loadState(const std::string& filename)
+    {
+        std::vector<char> blob = readStateFile(filename, comm_);
+        StateReader reader(blob);
+
+        reader.expect(uint32_t(sizeof(KeyType)), "SFC key type");
+        reader.expect(uint32_t(sizeof(T)), "coordinate type");
+        reader.expect(nRanks_, "number of ranks");
+        reader.expect(myRank_, "rank");
+        reader.expect(bucketSize_, "bucket size");
+        reader.read(particleStart_);
+        reader.read(particleEnd_);
+        reader.read(localNParticles_);
+        reader.read(box_);
+        reader.read(tree_);
+        reader.read(nodeCounts_);
+
+        rankGroups_ = computeNodeRankGroups(comm_);
+        haloTree_.clear();
+        haloNodeCounts_.clear();
+        haloRadii_.clear();
+        firstCall_ = false;
+    }
+
+    /*! @brief collectively aggregate the assigned particles of the previous sync per node of a level-of-detail tree
+     *
+     * @param maxLevel   LOD nodes are the nodes of the global tree, truncated to a maximum level of @p maxLevel
+     * @param codes      SFC keys as returned by sync
+     * @param m          particle masses, if empty, all particles have unit mass
+     * @param field      optional user field, reduced per node with @p reduction
+     * @param root       rank of the domain communicator that receives the summary, other ranks get an empty summary
+     *
+     * See computeLodSummary for details.
+     */
+    LodSummary<KeyType, T> lodSummary(unsigned maxLevel, const std::vector<KeyType>& codes, const std::vector<T>& x,
+                                      const std::vector<T>& y, const std::vector<T>& z, const std::vector<T>& h,
+                                      const std::vector<T>& m, const std::vector<T>* field = nullptr,
+                                      LodReduction reduction = LodReduction::sum, int root = 0) const
+    {
+        return computeLodSummary<KeyType>(tree_, maxLevel, codes.data(), particleStart_, particleEnd_, x.data(),
+                                          y.data(), z.data(), h.data(), m.empty() ? nullptr : m.data(),
+                                          field ? field->data() : nullptr, reduction, root, comm_);
+    }
+
+    /*! @brief collectively write the assigned particles of the previous sync to a snapshot in SFC order
+     *
+     * @param filename  output file
+     * @param arrays    particle fields as passed to sync, e.g. x, y, z, h and particle properties
+     *
+     * The snapshot also stores the box and the global tree, see writeSnapshot for the file layout.
+     */
+    template<class... Arrays>
+    void writeSnapshot(const std::string& filename, const Arrays&... arrays) const
+    {
+        cstone::writeSnapshot(comm_, filename, box_, tree_, nodeCounts_, particleStart_, particleEnd_, arrays...);
+    }
+
+    /*! @brief collectively read a snapshot written by writeSnapshot, on any number of ranks
+     *
+     * The particle arrays are resized to the contiguous SFC range read by the executing rank. The domain
+     * continues from the stored box and global tree, the next sync is therefore an incremental update
+     * that skips the convergence of the global tree.
+     */
+    template<class... Arrays>
+    void readSnapshot(const std::string& filename, Arrays&... arrays)
+    {
+        cstone::readSnapshot(comm_, filename, box_, tree_, nodeCounts_, arrays...);
+
+        std::array<std::size_t, sizeof...(Arrays)> sizes{arrays.size()...};
+        particleStart_   = 0;
+        particleEnd_     = sizes.empty() ? 0 : sizes[0];
+        localNParticles_ = particleEnd_;
+
+        rankGroups_ = computeNodeRankGroups(comm_);
+        haloTree_.clear();
+        haloNodeCounts_.clear();
+        haloRadii_.clear();
+        firstCall_ = false;
+    }
+
 private:
+    /*! @brief return true if the halo pattern of the previous sync is valid for the current tree and @p haloRadii
+     *
+     * Requires the same tree, node counts, assignment and box as the previous sync. The halo radii may not be larger,
+     * since halos discovered with larger radii are a superset of the halos for smaller radii. To avoid exchanging
+     * too many halos, the radii may also not fall below the previous ones by more than the tolerance.
+     */
+    bool haloPatternUnchanged(const SpaceCurveAssignment& assignment, gsl::span<const float> haloRadii) const
+    {
+        if (tree_ != haloTree_ || nodeCounts_ != haloNodeCounts_ || !(assignment == haloAssignment_) ||
+            !(box_ == haloBox_))
+        {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < haloRadii.size(); ++i)
+        {
+            if (haloRadii[i] > haloRadii_[i] || haloRadii[i] < (1.0f - haloRadiusTolerance_) * haloRadii_[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*! @brief discover halos, compute the new particle layout and the halo exchange pattern
+     *
+     * @return the index of the first assigned particle in the new layout
+     */
+    LocalParticleIndex updateHaloPattern(const SpaceCurveAssignment& assignment, gsl::span<const float> haloRadii,
+                                         PhaseScope& phase)
+    {
+        // find outgoing and incoming halo nodes of the tree
+        // uses 3D collision detection
+        std::vector<pair<TreeNodeIndex>> haloPairs;
+        findHalos<KeyType, const float, T, SfcKind>(tree_, haloRadii, box_, assignment.firstNodeIdx(myRank_), assignment.lastNodeIdx(myRank_), haloPairs);
+
+        // group outgoing and incoming halo node indices by destination/source rank
+        std::vector<std::vector<TreeNodeIndex>> incomingHaloNodes;
+        std::vector<std::vector<TreeNodeIndex>> outgoingHaloNodes;
+        computeSendRecvNodeList(assignment, haloPairs, incomingHaloNodes, outgoingHaloNodes);
+        phase.next(SyncPhase::layout);
+
+        // compute list of local node index ranges
+        std::vector<TreeNodeIndex> incomingHalosFlattened = flattenNodeList(incomingHaloNodes);
+
+        // Put all local node indices and incoming halo node indices in one sorted list.
+        // and compute an offset for each node into these arrays.
+        // This will be the new layout for x,y,z,h arrays.
+        presentNodes_.clear();
+        computeLayoutOffsets(assignment.firstNodeIdx(myRank_), assignment.lastNodeIdx(myRank_),
+                             incomingHalosFlattened, nodeCounts_, presentNodes_, nodeOffsets_);
+        localNParticles_ = nodeOffsets_.back();
+
+        TreeNodeIndex firstLocalNode =
+            std::lower_bound(cbegin(presentNodes_), cend(presentNodes_), assignment.firstNodeIdx(myRank_)) -
+            begin(presentNodes_);
+
+        // flag interior nodes, translated from global tree node indices to indices into presentNodes_
+        {
+            TreeNodeIndex firstNode = assignment.firstNodeIdx(myRank_);
+            TreeNodeIndex lastNode  = assignment.lastNodeIdx(myRank_);
+            gsl::span<int> interiorFlags = scratch_.allocate<int>(nNodes(tree_));
+            findInteriorNodes<KeyType, const float, T, SfcKind>(tree_, haloRadii, box_, firstNode, lastNode,
+                                                                interiorFlags.data());
+
+            gsl::span<int> presentFlags = scratch_.allocate<int>(presentNodes_.size());
+            std::fill(presentFlags.begin(), presentFlags.end(), 0);
+            std::copy(interiorFlags.begin() + firstNode, interiorFlags.begin() + lastNode,
+                      presentFlags.begin() + firstLocalNode);
+            interiorRanges_ = markedParticleRanges(nodeOffsets_, presentFlags, firstLocalNode,
+                                                   firstLocalNode + lastNode - firstNode);
+        }
+
+        incomingHaloIndices_ = createHaloExchangeList(incomingHaloNodes, presentNodes_, nodeOffsets_);
+        outgoingHaloIndices_ = createHaloExchangeList(outgoingHaloNodes, presentNodes_, nodeOffsets_);
+        haloExchanger_.setup(incomingHaloIndices_, outgoingHaloIndices_, comm_);
+        deviceHaloExchanger_.setup(incomingHaloIndices_, outgoingHaloIndices_, comm_);
+
+        haloTree_          = tree_;
+        haloNodeCounts_    = nodeCounts_;
+        haloAssignment_    = assignment;
+        haloRadii_.assign(haloRadii.begin(), haloRadii.end());
+        haloBox_           = box_;
+        incomingHaloNodes_ = std::move(incomingHaloNodes);
+        outgoingHaloNodes_ = std::move(outgoingHaloNodes);
+
+        return nodeOffsets_[firstLocalNode];
+    }
+
+    /*! @brief type-erased views of the arrays that are exchanged by sync
+     *
+     * @param halosOnly  if true, return x,y,z,h and the halo fields of particle containers, otherwise also include
+     *                   the property vectors and the migrate fields
+     */
+    template<class... Vectors>
+    static std::vector<ByteArray> syncedArrays([[maybe_unused]] bool halosOnly, std::vector<T>& x,
+                                               std::vector<T>& y, std::vector<T>& z, std::vector<T>& h,
+                                               Vectors&... particleProperties)
+    {
+        std::vector<ByteArray> arrays{byteArray(x.data()), byteArray(y.data()), byteArray(z.data()),
+                                      byteArray(h.data())};
+        (appendSynced(arrays, halosOnly, particleProperties), ...);
+        return arrays;
+    }
+
+    static void appendSynced(std::vector<ByteArray>& arrays, bool halosOnly, std::vector<T>& property)
+    {
+        if (!halosOnly) { arrays.push_back(byteArray(property.data())); }
+    }
+
+    static void appendSynced(std::vector<ByteArray>& arrays, bool halosOnly, ParticleContainer& particles)
+    {
+        particles.appendByteArrays(arrays, halosOnly);
+    }
+
+    static void appendPending(std::vector<const LocalParticleIndex*>& orderings, std::vector<T>&)
+    {
+        orderings.push_back(nullptr);
+    }
+
+    void appendPending(std::vector<const LocalParticleIndex*>& orderings, ParticleContainer& particles) const
+    {
+        particles.appendPendingOrderings(orderings, particleStart_);
+    }
+
+    static void clearPending(std::vector<T>&) {}
+
+    static void clearPending(ParticleContainer& particles) { particles.clearPending(); }
+
+    static void addReorderTarget(std::vector<std::vector<T>*>& targets, std::vector<T>& property)
+    {
+        targets.push_back(&property);
+    }
+
+    static void addReorderTarget(std::vector<std::vector<T>*>&, ParticleContainer&) {}
+
+    void reorderContainer(const std::vector<LocalParticleIndex>&, std::vector<T>&) {}
+
+    void reorderContainer(const std::vector<LocalParticleIndex>& ordering, ParticleContainer& particles)
+    {
+        particles.reorder(ordering.data(), ordering.size(), particleStart_);
+    }
+
+    //! @brief index of the node in the layout of the current halo pattern that contains particle @p p
+    [[nodiscard]] TreeNodeIndex layoutNode(LocalParticleIndex p) const
+    {
+        // empty nodes have the same offset as their successor and are skipped by upper_bound
+        return std::upper_bound(nodeOffsets_.begin(), nodeOffsets_.end(), p) - nodeOffsets_.begin() - 1;
+    }
+
+    //! @brief true if @p activeIndices is sorted and only contains particles assigned to this rank
+    bool activeIndicesValid(const std::vector<LocalParticleIndex>& activeIndices) const
+    {
+        bool inRange = activeIndices.empty() ||
+                       (activeIndices.front() >= particleStart_ && activeIndices.back() < particleEnd_);
+        return inRange && std::is_sorted(activeIndices.begin(), activeIndices.end());
+    }
+
+    /*! @brief the halo exchange pattern of the previous sync, restricted to the nodes with active particles
+     *
+     * @param[in]  activeIndices  sorted indices of active particles, see activeIndicesValid
+     * @param[out] incomingHalos  per source rank, the index ranges of incoming halos in active nodes
+     * @param[out] outgoingHalos  per destination rank, the index ranges of outgoing halos in active nodes
+     */
+    void activeHaloPattern(const std::vector<LocalParticleIndex>& activeIndices, SendList& incomingHalos,
+                           SendList& outgoingHalos) const
+    {
+        std::vector<char> nodeActive(nNodes(tree_), 0);
+        for (LocalParticleIndex p : activeIndices)
+        {
+            nodeActive[presentNodes_[layoutNode(p)]] = 1;
+        }
+
+        std::vector<std::vector<TreeNodeIndex>> activeOutgoing = filterActiveNodes(outgoingHaloNodes_, nodeActive);
+        std::vector<std::vector<TreeNodeIndex>> activeIncoming =
+            exchangeActiveNodes(incomingHaloNodes_, activeOutgoing, outgoingHaloNodes_, comm_);
+
+        incomingHalos = createHaloExchangeList(activeIncoming, presentNodes_, nodeOffsets_);
+        outgoingHalos = createHaloExchangeList(activeOutgoing, presentNodes_, nodeOffsets_);
+    }
+
+    //! @brief permute the elements [offset:offset + ordering.size()] of @p array by @p ordering
+    template<class V>
+    static void gatherRange(const std::vector<LocalParticleIndex>& ordering, LocalParticleIndex offset,
+                            std::vector<V>& array)
+    {
+        std::vector<V> permuted(ordering.size());
+        for (std::size_t i = 0; i < ordering.size(); ++i)
+        {
+            permuted[i] = array[offset + ordering[i]];
+        }
+        std::copy(permuted.begin(), permuted.end(), array.begin() + offset);
+    }
 
     //! @brief return true if all array sizes are equal to value
     template<class... Arrays>
@@ -344,6 +1219,8 @@ private:
 
     int myRank_;
     int nRanks_;
+    //! @brief the ranks that share the domain
+    DuplicateComm comm_;
     int bucketSize_;
 
     /*! @brief array index of first local particle belonging to the assignment
@@ -357,14 +1234,46 @@ private:
 
     //! @brief coordinate bounding box, each non-periodic dimension is at a sync call
     Box<T> box_;
+    //! @brief whether box_ is extended to a cube after each global box reduction
+    bool cubicKeySpace_{false};
+
+    SyncObserver* observer_{nullptr};
+    //! @brief per-peer communication volumes of the previous sync
+    std::vector<PeerVolume> particleExchangeVolume_;
+    std::vector<PeerVolume> haloExchangeVolume_;
 
     SendList incomingHaloIndices_;
     SendList outgoingHaloIndices_;
+    //! @brief buffers and graph communicator for the halo exchange pattern of the last sync
+    HaloExchanger haloExchanger_;
+    //! @brief the same exchange pattern, uploaded to the device for CudaTag domains
+    DeviceHaloExchanger_t<Accelerator, T> deviceHaloExchanger_;
+    //! @brief assigned particles that do not interact with halos
+    std::vector<IndexPair<LocalParticleIndex>> interiorRanges_;
 
     std::vector<KeyType> tree_;
     std::vector<unsigned> nodeCounts_;
+    //! @brief the ranks on each compute node, the SFC is split across nodes first, then within each node
+    std::vector<std::vector<int>> rankGroups_;
     bool firstCall_{true};
 
+    //! @brief tree, node counts, assignment, halo radii and box used to compute the current halo exchange pattern
+    std::vector<KeyType> haloTree_;
+    std::vector<unsigned> haloNodeCounts_;
+    SpaceCurveAssignment haloAssignment_;
+    FirstTouchVector<float> haloRadii_;
+    Box<T> haloBox_;
+    float haloRadiusTolerance_;
+
+    //! @brief storage for the temporaries of one sync, reset at the start of each sync
+    ScratchArena scratch_;
+
+    //! @brief halo nodes per peer rank and the particle array layout of the current halo exchange pattern
+    std::vector<std::vector<TreeNodeIndex>> incomingHaloNodes_;
+    std::vector<std::vector<TreeNodeIndex>> outgoingHaloNodes_;
+    std::vector<TreeNodeIndex> presentNodes_;
+    std::vector<LocalParticleIndex> nodeOffsets_;
+
     ReorderFunctor reorderFunctor;
 };
 
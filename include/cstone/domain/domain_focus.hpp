@@ -34,6 +34,7 @@
 
 #pragma once
 
+#include "cstone/domain/checkpoint.hpp"
 #include "cstone/domain/domaindecomp_mpi.hpp"
 #include "cstone/domain/domain_traits.hpp"
 #include "cstone/domain/exchange_keys.hpp"
@@ -43,18 +44,31 @@
 #include "cstone/halos/discovery.hpp"
 #include "cstone/halos/exchange_halos.hpp"
 
+#include "cstone/tree/lod_mpi.hpp"
+#include "cstone/tree/node_statistics.hpp"
 #include "cstone/tree/octree_mpi.hpp"
 #include "cstone/tree/octree_focus_mpi.hpp"
+#include "cstone/util/instrumentation_mpi.hpp"
+#include "cstone/util/scratch_arena.hpp"
+#include "cstone/util/tracing.hpp"
 
 #include "cstone/sfc/box_mpi.hpp"
+#include "cstone/sfc/sfc.hpp"
 
 namespace cstone
 {
 
-template<class KeyType, class T, class Accelerator = CpuTag>
+/*! @brief manages the distributed particle data and halos based on a global and a locally focused octree
+ *
+ * @tparam SfcKind      32- or 64-bit unsigned integer to use Morton keys,
+ *                      or MortonKey/HilbertKey<32- or 64-bit unsigned> to select the SFC, see sfc.hpp
+ * @tparam T            float or double
+ * @tparam Accelerator  CpuTag or CudaTag
+ */
+template<class SfcKind, class T, class Accelerator = CpuTag>
 class FocusedDomain
 {
-    static_assert(std::is_unsigned<KeyType>{}, "SFC key type needs to be an unsigned integer\n");
+    using KeyType = SfcKeyType_t<SfcKind>;
 
     using ReorderFunctor = ReorderFunctor_t<Accelerator, T, KeyType, LocalParticleIndex>;
 
@@ -68,18 +82,24 @@ public:
      * @param box             global bounding box, default is non-pbc box
      *                        for each periodic dimension in @a box, the coordinate min/max
      *                        limits will never be changed for the lifetime of the Domain
+     * @param deviceId        GPU used by CudaTag domains for reordering and device halo exchanges, e.g. obtained
+     *                        from deviceOfRank, a negative value selects the current device, ignored for CpuTag
+     * @param comm            the ranks that share the domain, @p rank and @p nRanks refer to this communicator,
+     *                        see Domain. The constructor is collective over @p comm.
      *
      */
     explicit FocusedDomain(int rank, int nRanks, unsigned bucketSize, unsigned bucketSizeFocus,
-                           const Box<T>& box = Box<T>{0,1})
-        : myRank_(rank), nRanks_(nRanks), bucketSize_(bucketSize), bucketSizeFocus_(bucketSizeFocus), box_(box),
-          focusedTree_(bucketSizeFocus_, theta_)
+                           const Box<T>& box = Box<T>{0,1}, int deviceId = -1, MPI_Comm comm = MPI_COMM_WORLD)
+        : myRank_(rank), nRanks_(nRanks), comm_(comm), bucketSize_(bucketSize), bucketSizeFocus_(bucketSizeFocus),
+          box_(box), deviceHaloExchanger_(makeDeviceFunctor<DeviceHaloExchanger_t<Accelerator, T>>(deviceId)),
+          focusedTree_(bucketSizeFocus_, theta_), reorderFunctor(makeDeviceFunctor<ReorderFunctor>(deviceId))
     {
         if (bucketSize_ < bucketSizeFocus_)
         {
             throw std::runtime_error("The bucket size of the global tree must not be smaller than the bucket size"
                                      " of the focused tree\n");
         }
+        focusedTree_.peerExchange().setCommunicator(comm_);
     }
 
     /*! @brief Domain update sequence for particles with coordinates x,y,z, interaction radius h and their properties
@@ -88,7 +108,7 @@ public:
      * @param[inout] y
      * @param[inout] z
      * @param[inout] h      interaction radii in SPH convention, actual interaction radius is twice the value in h
-     * @param[out]   codes  Morton codes
+     * @param[out]   codes  SFC keys
      *
      * @param[inout] particleProperties  particle properties to distribute along with the coordinates
      *                                   e.g. mass or charge
@@ -102,9 +122,8 @@ public:
      *     on the first call. This is checked.
      *
      *     This means that none of the argument arrays can be resized between calls of this function.
-     *     Or in other words, particles cannot be created or destroyed.
-     *     (If this should ever be required though, it can be easily enabled by allowing the assigned
-     *     index range from startIndex() to endIndex() to be modified from the outside.)
+     *     Particles are created and destroyed with removeAndCreate instead, which adjusts the assigned
+     *     index range from startIndex() to endIndex().
      *
      *   - The particle order is irrelevant
      *
@@ -135,8 +154,8 @@ public:
      *
      *   Content of codes
      *   ----------------
-     *   - The codes output is sorted and contains the Morton codes of assigned _and_ halo particles,
-     *     i.e. all arrays will be output in Morton order.
+     *   - The codes output is sorted and contains the SFC keys of assigned _and_ halo particles,
+     *     i.e. all arrays will be output in SFC order.
      *
      *   Internal state of the domain
      *   ----------------------------
@@ -152,20 +171,25 @@ public:
      * ============================================================================================================
      *      1. compute global coordinate bounding box
      *      2. compute global octree
-     *      3. compute max_h per octree node
-     *      4. assign octree to ranks
-     *      5. discover halos
-     *      6. compute particle layout, i.e. count number of halos and assigned particles
+     *      3. assign octree to ranks
+     *      4. send out coordinates, h, and properties of particles assigned to other ranks
+     *      5. while the particles are in flight, find peer ranks and rebalance the focused tree
+     *      6. receive the incoming assigned particles and sort them in SFC order
+     *      7. update the focused tree counts from local particles, peer ranks and the global tree
+     *      8. discover halos
+     *      9. compute particle layout, i.e. count number of halos and assigned particles
      *         and compute halo send and receive index ranges
-     *      7. resize x,y,z,h,codes and properties to new number of assigned + halo particles
-     *      8. exchange coordinates, h, and properties of assigned particles
-     *      9. morton sort exchanged assigned particles
-     *     10. exchange halo particles
+     *     10. resize x,y,z,h,codes and properties to new number of assigned + halo particles
+     *     11. exchange halo particles
      */
     template<class... Vectors>
     void sync(std::vector<T>& x, std::vector<T>& y, std::vector<T>& z, std::vector<T>& h, std::vector<KeyType>& codes,
               Vectors&... particleProperties)
     {
+        CSTONE_TRACE_RANGE("FocusedDomain::sync");
+        // temporaries of the previous sync are released, steady-state syncs reuse the same storage
+        scratch_.reset();
+
         // bounds initialization on first call, use all particles
         if (firstCall_)
         {
@@ -183,43 +207,54 @@ public:
 
         /* SFC decomposition phase *********************************************************/
 
+        PhaseScope phase(observer_, SyncPhase::box);
         box_ = makeGlobalBox(cbegin(x) + particleStart_, cbegin(x) + particleEnd_,
                              cbegin(y) + particleStart_,
-                             cbegin(z) + particleStart_, box_);
+                             cbegin(z) + particleStart_, box_, comm_);
+        if (cubicKeySpace_) { box_ = makeCubicBox(box_); }
 
         // number of locally assigned particles to consider for global tree building
         LocalParticleIndex numParticles = particleEnd_ - particleStart_;
 
+        phase.next(SyncPhase::keys);
         codes.resize(numParticles);
 
         // compute morton codes only for particles participating in tree build
-        computeMortonCodes(cbegin(x) + particleStart_, cbegin(x) + particleEnd_,
-                           cbegin(y) + particleStart_,
-                           cbegin(z) + particleStart_,
-                           begin(codes), box_);
+        computeSfcKeys<SfcKind>(cbegin(x) + particleStart_, cbegin(x) + particleEnd_,
+                                cbegin(y) + particleStart_,
+                                cbegin(z) + particleStart_,
+                                begin(codes), box_);
 
         // reorder the codes according to the ordering
         // has the same net effect as std::sort(begin(mortonCodes), end(mortonCodes)),
         // but with the difference that we explicitly know the ordering, such
         // that we can later apply it to the x,y,z,h arrays or to access them in the Morton order
+        phase.next(SyncPhase::sort);
         reorderFunctor.setMapFromCodes(codes.data(), codes.data() + codes.size());
 
         // extract ordering for use in e.g. exchange particles
-        std::vector<LocalParticleIndex> mortonOrder(numParticles);
+        gsl::span<LocalParticleIndex> mortonOrder = scratch_.allocate<LocalParticleIndex>(numParticles);
         reorderFunctor.getReorderMap(mortonOrder.data());
 
         // compute the global octree in cornerstone format (leaves only)
         // the resulting tree and node counts will be identical on all ranks
-        updateOctreeGlobal(codes.data(), codes.data() + numParticles, bucketSize_, tree_, nodeCounts_);
-
+        phase.next(SyncPhase::globalTree);
         if (firstCall_)
         {
-            // full build on first call
-            while(!updateOctreeGlobal(codes.data(), codes.data() + numParticles, bucketSize_, tree_, nodeCounts_));
+            // full build on first call, bootstrapped from a sample of the keys for large particle counts
+            phase.recordIterations(computeOctreeGlobalSampled(codes.data(), codes.data() + numParticles, bucketSize_,
+                                                              tree_, nodeCounts_, std::size_t(1) << 20, comm_));
+            rankGroups_ = computeNodeRankGroups(comm_);
+        }
+        else
+        {
+            updateOctreeGlobal(codes.data(), codes.data() + numParticles, bucketSize_, tree_, nodeCounts_, comm_);
+            phase.recordIterations(1);
         }
 
-        // assign one single range of Morton codes each rank
-        SpaceCurveAssignment assignment = singleRangeSfcSplit(nodeCounts_, nRanks_);
+        // assign one single range of Morton codes each rank, the ranks of a compute node get consecutive ranges
+        phase.next(SyncPhase::assignment);
+        SpaceCurveAssignment assignment = hierarchicalSfcSplit(nodeCounts_, rankGroups_);
         LocalParticleIndex newNParticlesAssigned = assignment.totalCount(myRank_);
 
         /* Domain particles update phase *********************************************************/
@@ -228,42 +263,79 @@ public:
         // index ranges in domainExchangeSends are valid relative to the sorted code array mortonCodes
         // note that there is no offset applied to mortonCodes, because it was constructed
         // only with locally assigned particles
+        phase.next(SyncPhase::particleExchange);
         SendList domainExchangeSends = createSendList<KeyType>(assignment, tree_, codes);
 
         // resize arrays to new sizes
         reallocate(newNParticlesAssigned, x,y,z,h, particleProperties...);
         reallocate(newNParticlesAssigned, codes);
-        // exchange assigned particles
-        exchangeParticles<T>(domainExchangeSends, Rank(myRank_), newNParticlesAssigned,
-                             particleStart_, LocalParticleIndex(0), mortonOrder.data(),
-                             x.data(), y.data(), z.data(), h.data(), particleProperties.data()...);
-        // recompute SFC codes
-        computeMortonCodes(begin(x), end(x), begin(y), begin(z), begin(codes), box_);
-        // sort codes and update reorder-map inside the functor
-        reorderFunctor.setMapFromCodes(codes.data(), codes.data() + codes.size());
+
+        // the sorted keys are exchanged along with the particles, such that the received particles consist of
+        // sorted segments that only need to be merged, see Domain::sync
+        gsl::span<KeyType> exchangeKeys =
+            scratch_.allocate<KeyType>(std::max(newNParticlesAssigned, particleStart_ + numParticles));
+        #pragma omp parallel for schedule(static)
+        for (LocalParticleIndex i = 0; i < numParticles; ++i)
         {
-            std::array<std::vector<T>*, 4 + sizeof...(Vectors)> particleArrays{&x, &y, &z, &h, &particleProperties...};
-            for (std::size_t i = 0; i < particleArrays.size(); ++i)
-            {
-                //reorderFunctor(particleArrays[i]->data() + particleStart_) ;
-                reorderFunctor(particleArrays[i]->data()) ;
-            }
+            exchangeKeys[particleStart_ + mortonOrder[i]] = codes[i];
         }
 
-        /* Focus tree update phase *********************************************************/
+        // send out the assigned particles of other ranks, the incoming particles are received further below
+        std::array<ByteArray, 5 + sizeof...(Vectors)> exchangeArrays{byteArray(x.data()), byteArray(y.data()),
+                                                                     byteArray(z.data()), byteArray(h.data()),
+                                                                     byteArray(particleProperties.data())...,
+                                                                     byteArray(exchangeKeys.data())};
+        ParticleExchange<LocalParticleIndex> particleExchange;
+        particleExchange.start(domainExchangeSends, myRank_, newNParticlesAssigned, particleStart_,
+                               LocalParticleIndex(0), mortonOrder.data(), exchangeArrays.data(),
+                               int(exchangeArrays.size()), nullptr, comm_);
+
+        /* Focus tree structure update, overlaps with the particle exchange ***************************/
+
+        // peers and the structure of the focused tree only depend on the global tree and the assignment
+        // reuses the peers of the previous step if the tree and the assignment boundaries did not change
+        phase.next(SyncPhase::focusTree);
+        const std::vector<int>& peers = peerCache_.peers(myRank_, assignment, tree_, box_, theta_);
+        focusedTree_.updateTree(box_, tree_[assignment.firstNodeIdx(myRank_)], tree_[assignment.lastNodeIdx(myRank_)]);
+
+        phase.next(SyncPhase::particleExchange);
+        particleExchange.finish();
+        phase.recordTraffic(particleExchange.traffic());
+        particleExchangeVolume_ = peerVolumes(sendListCounts(domainExchangeSends), particleExchange.receiveCounts(),
+                                              myRank_, particleExchange.elementBytes());
+
+        // merge the sorted segments of received keys and update the reorder-map inside the functor
+        phase.next(SyncPhase::sort);
+        std::copy(exchangeKeys.begin(), exchangeKeys.begin() + newNParticlesAssigned, codes.begin());
+        {
+            const std::vector<std::size_t>& segments = particleExchange.segments();
+            gsl::span<LocalParticleIndex> ordering    = scratch_.allocate<LocalParticleIndex>(newNParticlesAssigned);
+            gsl::span<KeyType>            keyBuffer   = scratch_.allocate<KeyType>(newNParticlesAssigned);
+            gsl::span<LocalParticleIndex> indexBuffer = scratch_.allocate<LocalParticleIndex>(newNParticlesAssigned);
+            std::iota(ordering.begin(), ordering.end(), LocalParticleIndex(0));
+
+            mergeSortedSegmentsByKey(codes.data(), ordering.data(), segments.data(), segments.size() - 1,
+                                     keyBuffer.data(), indexBuffer.data());
+            reorderFunctor.setReorderMap(ordering.data(), ordering.data() + newNParticlesAssigned);
+        }
+        phase.next(SyncPhase::reorder);
+        {
+            std::array<std::vector<T>*, 4 + sizeof...(Vectors)> particleArrays{&x, &y, &z, &h, &particleProperties...};
+            reorderFunctor(particleArrays.data(), int(particleArrays.size()), 0);
+        }
 
-        Octree<KeyType> domainTree;
-        domainTree.update(begin(tree_), end(tree_));
-        std::vector<int> peers = findPeersMac(myRank_, assignment, domainTree, box_, theta_);
+        /* Focus tree count update phase *********************************************************/
 
-        focusedTree_.updateGlobal(box_, codes, myRank_, peers, assignment, tree_, nodeCounts_);
+        phase.next(SyncPhase::focusTree);
+        focusedTree_.updateGlobalCounts(box_, codes, myRank_, peers, assignment, tree_, nodeCounts_);
         if (firstCall_)
         {
             int converged = 0;
             while (converged != nRanks_)
             {
                 converged = focusedTree_.updateGlobal(box_, codes, myRank_, peers, assignment, tree_, nodeCounts_);
-                MPI_Allreduce(MPI_IN_PLACE, &converged, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+                MPI_Allreduce(MPI_IN_PLACE, &converged, 1, MPI_INT, MPI_SUM, comm_);
+                phase.recordIterations(1);
             }
             firstCall_ = false;
         }
@@ -273,29 +345,29 @@ public:
 
         /* Halo discovery phase *********************************************************/
 
-        mortonOrder.resize(newNParticlesAssigned);
-        std::iota(begin(mortonOrder), end(mortonOrder), LocalParticleIndex(0));
-
-        std::vector<float> haloRadii(nNodes(focusedTree_.treeLeaves()));
-        computeHaloRadii(focusedTree_.treeLeaves().data(),
-                         nNodes(focusedTree_.treeLeaves()),
-                         codes.data(),
-                         codes.data() + codes.size(),
-                         mortonOrder.data(),
-                         h.data(),
-                         haloRadii.data());
-
-        std::vector<int> haloFlags(nNodes(focusedTree_.treeLeaves()), 0);
-        findHalos<KeyType, float>(focusedTree_.treeLeaves(),
-                                  focusedTree_.binaryTree(),
-                                  haloRadii,
-                                  box_,
-                                  focusAssignment.firstNodeIdx(myRank_),
-                                  focusAssignment.lastNodeIdx(myRank_),
-                                  haloFlags.data());
+        phase.next(SyncPhase::haloRadii);
+        // the assigned particles have been sorted in SFC order above, h is therefore read linearly
+        gsl::span<float> haloRadii = scratch_.allocate<float>(nNodes(focusedTree_.treeLeaves()));
+        NodeStatisticsInput<T> radiiInput;
+        radiiInput.h = h.data();
+        NodeStatisticsOutput<T> radiiOutput;
+        radiiOutput.radii = haloRadii.data();
+        computeNodeStatistics(focusedTree_.treeLeaves().data(), nNodes(focusedTree_.treeLeaves()), codes.data(),
+                              codes.size(), radiiInput, radiiOutput);
+
+        phase.next(SyncPhase::haloDiscovery);
+        gsl::span<int> haloFlags = scratch_.allocate<int>(nNodes(focusedTree_.treeLeaves()));
+        std::fill(haloFlags.begin(), haloFlags.end(), 0);
+        findHalos<KeyType, float, T, SfcKind>(focusedTree_.octree(),
+                                              haloRadii,
+                                              box_,
+                                              focusAssignment.firstNodeIdx(myRank_),
+                                              focusAssignment.lastNodeIdx(myRank_),
+                                              haloFlags.data());
 
         /* Halo exchange phase *********************************************************/
 
+        phase.next(SyncPhase::layout);
         std::vector<LocalParticleIndex> layout = computeNodeLayout(focusedTree_.leafCounts(), haloFlags,
                                                                    focusAssignment.firstNodeIdx(myRank_),
                                                                    focusAssignment.lastNodeIdx(myRank_));
@@ -303,45 +375,153 @@ public:
         particleStart_   = layout[focusAssignment.firstNodeIdx(myRank_)];
         particleEnd_     = particleStart_ + newNParticlesAssigned;
 
-        outgoingHaloIndices_ = exchangeRequestKeys<KeyType>(focusedTree_.treeLeaves(), haloFlags, layout,
-                                                            focusAssignment, peers);
+        // communicates only if the halo requests of any rank changed since the previous sync
+        outgoingHaloIndices_ = requestKeyExchange_.exchange(focusedTree_.treeLeaves(), haloFlags, layout,
+                                                            focusAssignment, peers, comm_);
 
         incomingHaloIndices_ = computeHaloReceiveList(layout, haloFlags, focusAssignment, peers);
 
+        gsl::span<int> interiorFlags = scratch_.allocate<int>(nNodes(focusedTree_.treeLeaves()));
+        findInteriorNodes<KeyType, float, T, SfcKind>(focusedTree_.treeLeaves(), haloRadii, box_,
+                                                      focusAssignment.firstNodeIdx(myRank_),
+                                                      focusAssignment.lastNodeIdx(myRank_), interiorFlags.data());
+        interiorRanges_ = markedParticleRanges(layout, interiorFlags, focusAssignment.firstNodeIdx(myRank_),
+                                               focusAssignment.lastNodeIdx(myRank_));
+        haloExchanger_.setup(incomingHaloIndices_, outgoingHaloIndices_, comm_);
+        deviceHaloExchanger_.setup(incomingHaloIndices_, outgoingHaloIndices_, comm_);
+
         relocate(localNParticles_, particleStart_, x, y, z, h, particleProperties...);
         relocate(localNParticles_, particleStart_, codes);
 
+        phase.next(SyncPhase::haloExchange);
         exchangeHalos(x, y, z, h);
+        phase.recordTraffic(sendListTraffic(outgoingHaloIndices_, incomingHaloIndices_, myRank_, 4 * sizeof(T)));
+        haloExchangeVolume_ = peerVolumes(sendListCounts(outgoingHaloIndices_), sendListCounts(incomingHaloIndices_),
+                                          myRank_, 4 * sizeof(T));
 
         // compute SFC keys of received halo particles
-        computeMortonCodes(cbegin(x), cbegin(x) + particleStart_,
-                           cbegin(y),
-                           cbegin(z),
-                           begin(codes), box_);
-        computeMortonCodes(cbegin(x) + particleEnd_, cend(x),
-                           cbegin(y) + particleEnd_,
-                           cbegin(z) + particleEnd_,
-                           begin(codes) + particleEnd_, box_);
+        phase.next(SyncPhase::keys);
+        computeSfcKeys<SfcKind>(cbegin(x), cbegin(x) + particleStart_,
+                                cbegin(y),
+                                cbegin(z),
+                                begin(codes), box_);
+        computeSfcKeys<SfcKind>(cbegin(x) + particleEnd_, cend(x),
+                                cbegin(y) + particleEnd_,
+                                cbegin(z) + particleEnd_,
+                                begin(codes) + particleEnd_, box_);
+    }
+
+    /*! @brief remove assigned particles and create new ones between two syncs
+     *
+     * @param[in]    removeIndices       indices of the particles to remove, all in [startIndex():endIndex()],
+     *                                   without duplicates and in any order
+     * @param[in]    numNew              number of particles to create
+     * @param[inout] x                   coordinates, radii and particle properties as passed to sync
+     * @param[inout] y
+     * @param[inout] z
+     * @param[inout] h
+     * @param[inout] particleProperties  std::vectors of type T
+     * @return                           the index of the first created particle, the created particles occupy
+     *                                   [return value:endIndex()] and must be initialized before the next sync
+     *
+     * Removed particles are replaced by particles from the end of the assigned range and the created particles
+     * are placed behind the remaining ones, in place of the halos. The arrays only grow if the created particles
+     * do not fit. Apart from that, the cost is proportional to the number of removed and created particles.
+     * Afterwards, the halos are invalid and the assigned particles are no longer sorted, until the next sync,
+     * which updates the global tree incrementally with the changed particle counts.
+     * The call is not collective, each rank may remove and create any number of particles.
+     */
+    template<class... Vectors>
+    LocalParticleIndex removeAndCreate(const std::vector<LocalParticleIndex>& removeIndices, LocalParticleIndex numNew,
+                                       std::vector<T>& x, std::vector<T>& y, std::vector<T>& z, std::vector<T>& h,
+                                       Vectors&... particleProperties)
+    {
+        static_assert((std::is_same_v<Vectors, std::vector<T>> && ...),
+                      "removeAndCreate only supports std::vector<T> particle properties\n");
+        if (firstCall_)
+        {
+            throw std::runtime_error("Domain removeAndCreate: before the first sync, particle arrays can be resized\n");
+        }
+        if (!sizesAllEqualTo(localNParticles_, x, y, z, h, particleProperties...))
+        {
+            throw std::runtime_error("Domain removeAndCreate: input array sizes are inconsistent\n");
+        }
+
+        std::vector<LocalParticleIndex> destinations, sources;
+        removalMoves(removeIndices, particleStart_, particleEnd_, destinations, sources);
+        moveElements(destinations, sources, x, y, z, h, particleProperties...);
+
+        LocalParticleIndex firstNew = particleEnd_ - LocalParticleIndex(removeIndices.size());
+        particleEnd_                = firstNew + numNew;
+        if (particleEnd_ > localNParticles_)
+        {
+            localNParticles_ = particleEnd_;
+            reallocate(localNParticles_, x, y, z, h, particleProperties...);
+        }
+
+        return firstNew;
     }
 
     /*! @brief repeat the halo exchange pattern from the previous sync operation for a different set of arrays
      *
-     * @param[inout] arrays  std::vector<float or double> of size localNParticles_
+     * @param[inout] arrays  std::vectors of size localNParticles_ with trivially copyable
+     *                       elements of possibly different types, e.g. float, double or SFC keys.
+     *                       Floating point vectors wrapped as reducedPrecision<float>(vector) or
+     *                       reducedPrecision<BFloat16>(vector) are transferred with reduced precision.
      *
-     * Arrays are not resized or reallocated.
-     * This is used e.g. for densities.
+     * Arrays are not resized or reallocated. The exchange buffers and the peer graph communicator are set up
+     * once per sync operation and reused. This is used e.g. for densities.
      */
     template<class...Arrays>
-    void exchangeHalos(Arrays&... arrays) const
+    void exchangeHalos(Arrays&&... arrays)
     {
         if (!sizesAllEqualTo(localNParticles_, arrays...))
         {
             throw std::runtime_error("halo exchange array sizes inconsistent with previous sync operation\n");
         }
 
-        haloexchange<T>(incomingHaloIndices_, outgoingHaloIndices_, arrays.data()...);
+        haloExchanger_.exchange(arrays.data()...);
+    }
+
+    /*! @brief start the halo exchange of the previous sync operation for a different set of arrays
+     *
+     * @param[inout] arrays  std::vectors of size localNParticles_ with trivially copyable
+     *                       elements of possibly different types, e.g. float, double or SFC keys,
+     *                       optionally wrapped with reducedPrecision, see exchangeHalos
+     * @return               a handle, the incoming halos are present in @p arrays after its wait() returned
+     *
+     * Between this call and wait(), the particles in interiorRanges() can be processed, since they
+     * do not interact with any incoming halos.
+     */
+    template<class...Arrays>
+    auto exchangeHalosAsync(Arrays&&... arrays)
+    {
+        if (!sizesAllEqualTo(localNParticles_, arrays...))
+        {
+            throw std::runtime_error("halo exchange array sizes inconsistent with previous sync operation\n");
+        }
+
+        return haloExchanger_.exchangeAsync(arrays.data()...);
+    }
+
+    /*! @brief repeat the halo exchange pattern of the previous sync operation for arrays in GPU memory
+     *
+     * @param[inout] arrays  device pointers to float or double arrays of size nParticlesWithHalos(),
+     *                       optionally wrapped with reducedPrecision<float> or reducedPrecision<BFloat16>
+     *
+     * Only the halo elements are transferred between host and device, or none at all if MPI is CUDA-aware.
+     * Requires a domain with Accelerator = CudaTag.
+     */
+    template<class...Arrays>
+    void exchangeHalosDevice(Arrays... arrays)
+    {
+        static_assert(std::is_same_v<Accelerator, CudaTag>, "device halo exchange requires a CudaTag domain\n");
+        deviceHaloExchanger_.exchange(arrays...);
     }
 
+    //! @brief return the index ranges of assigned particles that do not interact with any halos
+    [[nodiscard]] const std::vector<IndexPair<LocalParticleIndex>>& interiorRanges() const { return interiorRanges_; }
+
     //! @brief return the index of the first particle that's part of the local assignment
     [[nodiscard]] LocalParticleIndex startIndex() const { return particleStart_; }
 
@@ -363,6 +543,173 @@ public:
     //! @brief return the coordinate bounding box from the previous sync call
     Box<T> box() const { return box_; }
 
+    //! @brief extend the open dimensions of the global box to a cube at each sync, see Domain::setCubicKeySpace
+    void setCubicKeySpace(bool enable) { cubicKeySpace_ = enable; }
+
+    //! @brief maximum number of particles per leaf of the global tree
+    [[nodiscard]] unsigned bucketSize() const { return bucketSize_; }
+
+    //! @brief maximum number of particles per leaf of the focused tree inside the assigned SFC range
+    [[nodiscard]] unsigned bucketSizeFocus() const { return bucketSizeFocus_; }
+
+    //! @brief opening parameter of the MAC that determines the resolution of the focused tree and the peers
+    [[nodiscard]] float theta() const { return theta_; }
+
+    /*! @brief change the bucket sizes of the global and the focused tree, e.g. from an Autotuner
+     *
+     * The trees are adapted by the rebalance steps of the following syncs, i.e. by at most one level per sync.
+     */
+    void setBucketSizes(unsigned bucketSize, unsigned bucketSizeFocus)
+    {
+        if (bucketSizeFocus == 0 || bucketSize < bucketSizeFocus)
+        {
+            throw std::runtime_error("The bucket size of the global tree must not be smaller than the bucket size"
+                                     " of the focused tree\n");
+        }
+        bucketSize_      = bucketSize;
+        bucketSizeFocus_ = bucketSizeFocus;
+        focusedTree_.setBucketSize(bucketSizeFocus);
+    }
+
+    //! @brief change the MAC opening parameter, takes effect with the next sync
+    void setTheta(float theta)
+    {
+        if (!(theta > 0)) { throw std::runtime_error("theta must be positive\n"); }
+        theta_ = theta;
+        focusedTree_.setTheta(theta);
+    }
+
+    /*! @brief compress the SFC keys and particle counts of the focused tree and halo request exchanges
+     *
+     * Keys are sent as variable-length encoded differences and counts as variable-length integers, which reduces
+     * the exchanged bytes to a fraction on interconnects where bandwidth or message size matter. All ranks need to
+     * use the same setting.
+     */
+    void setCompressTreeExchanges(bool enable)
+    {
+        focusedTree_.setCompression(enable);
+        requestKeyExchange_.setCompression(enable);
+    }
+
+    //! @brief report the phases of subsequent syncs to @p observer, see Domain::setObserver
+    void setObserver(SyncObserver* observer) { observer_ = observer; }
+
+    //! @brief number of halo particles relative to the number of assigned particles, see Domain::haloRatio
+    [[nodiscard]] double haloRatio() const
+    {
+        return nParticles() > 0 ? double(nParticlesWithHalos() - nParticles()) / nParticles() : 0.0;
+    }
+
+    //! @brief number of ranks that the executing rank sends halos to or receives halos from
+    [[nodiscard]] int numPeers() const
+    {
+        return numExchangePeers(incomingHaloIndices_, outgoingHaloIndices_, myRank_);
+    }
+
+    //! @brief the private duplicate of the communicator passed to the constructor
+    [[nodiscard]] MPI_Comm comm() const { return comm_; }
+
+    //! @brief per-peer communication volume of the particle exchange of the previous sync
+    [[nodiscard]] const std::vector<PeerVolume>& particleExchangeVolume() const { return particleExchangeVolume_; }
+
+    //! @brief per-peer communication volume of the x,y,z,h halo exchange of the previous sync
+    [[nodiscard]] const std::vector<PeerVolume>& haloExchangeVolume() const { return haloExchangeVolume_; }
+
+    //! @brief collectively compute the distribution of assigned particles, halos and peers, see Domain::balance
+    [[nodiscard]] DomainBalance balance() const
+    {
+        return reduceDomainBalance(nParticles(), nParticlesWithHalos() - nParticles(), numPeers(), 0.0, comm_);
+    }
+
+    //! @brief as balance(), with the distribution of the sums of @p weights over the assigned particles
+    [[nodiscard]] DomainBalance balance(const std::vector<float>& weights) const
+    {
+        if (weights.size() != nParticlesWithHalos())
+        {
+            throw std::runtime_error("FocusedDomain balance: particle weights size is inconsistent\n");
+        }
+        double weightSum = std::accumulate(weights.begin() + particleStart_, weights.begin() + particleEnd_, 0.0);
+        return reduceDomainBalance(nParticles(), nParticlesWithHalos() - nParticles(), numPeers(), weightSum, comm_);
+    }
+
+    //! @brief aggregate the assigned particles per node of a level-of-detail tree, see Domain::lodSummary
+    LodSummary<KeyType, T> lodSummary(unsigned maxLevel, const std::vector<KeyType>& codes, const std::vector<T>& x,
+                                      const std::vector<T>& y, const std::vector<T>& z, const std::vector<T>& h,
+                                      const std::vector<T>& m, const std::vector<T>* field = nullptr,
+                                      LodReduction reduction = LodReduction::sum, int root = 0) const
+    {
+        return computeLodSummary<KeyType>(tree_, maxLevel, codes.data(), particleStart_, particleEnd_, x.data(),
+                                          y.data(), z.data(), h.data(), m.empty() ? nullptr : m.data(),
+                                          field ? field->data() : nullptr, reduction, root, comm_);
+    }
+
+    /*! @brief collectively write the decomposition state of the previous sync call to @p filename
+     *
+     * Stores the global tree and its node counts, the focused tree with its leaf counts and MAC evaluations,
+     * the assigned particle index range and the bounding box. Together with the particle arrays in the order
+     * and size of the previous sync, this is sufficient to continue with an incremental sync after a restart.
+     */
+    void saveState(const std::string& filename) const
+    {
+        StateWriter writer;
+        writer.write(uint32_t(sizeof(KeyType)));
+        writer.write(uint32_t(sizeof(T)));
+        writer.write(nRanks_);
+        writer.write(myRank_);
+        writer.write(bucketSize_);
+        writer.write(bucketSizeFocus_);
+        writer.write(particleStart_);
+        writer.write(particleEnd_);
+        writer.write(localNParticles_);
+        writer.write(box_);
+        writer.write(tree_);
+        writer.write(nodeCounts_);
+
+        auto focusLeaves = focusedTree_.treeLeaves();
+        auto focusCounts = focusedTree_.leafCounts();
+        writer.write(std::vector<KeyType>(focusLeaves.begin(), focusLeaves.end()));
+        writer.write(std::vector<unsigned>(focusCounts.begin(), focusCounts.end()));
+        writer.write(focusedTree_.canonicalMacs());
+
+        writeStateFile(filename, writer.bytes(), comm_);
+    }
+
+    /*! @brief collectively restore the state written by saveState, on the same number of ranks
+     *
+     * The next sync call expects the particle arrays with the sizes and contents they had when the state
+     * was saved and proceeds as an incremental update, i.e. the convergence of the global and the focused
+     * tree is skipped.
+     */
+    void loadState(const std::string& filename)
+    {
+        std::vector<char> blob = readStateFile(filename, comm_);
+        StateReader reader(blob);
+
+        reader.expect(uint32_t(sizeof(KeyType)), "SFC key type");
+        reader.expect(uint32_t(sizeof(T)), "coordinate type");
+        reader.expect(nRanks_, "number of ranks");
+        reader.expect(myRank_, "rank");
+        reader.expect(bucketSize_, "bucket size");
+        reader.expect(bucketSizeFocus_, "focus bucket size");
+        reader.read(particleStart_);
+        reader.read(particleEnd_);
+        reader.read(localNParticles_);
+        reader.read(box_);
+        reader.read(tree_);
+        reader.read(nodeCounts_);
+
+        std::vector<KeyType> focusLeaves;
+        std::vector<unsigned> focusCounts;
+        std::vector<char> focusMacs;
+        reader.read(focusLeaves);
+        reader.read(focusCounts);
+        reader.read(focusMacs);
+        focusedTree_.restore(std::move(focusLeaves), std::move(focusCounts), std::move(focusMacs));
+
+        rankGroups_ = computeNodeRankGroups(comm_);
+        firstCall_  = false;
+    }
+
 private:
 
     //! @brief return true if all array sizes are equal to value
@@ -375,6 +722,8 @@ private:
 
     int myRank_;
     int nRanks_;
+    //! @brief the ranks that share the domain
+    DuplicateComm comm_;
     unsigned bucketSize_;
     unsigned bucketSizeFocus_;
 
@@ -389,13 +738,34 @@ private:
 
     //! @brief coordinate bounding box, each non-periodic dimension is at a sync call
     Box<T> box_;
+    //! @brief whether box_ is extended to a cube after each global box reduction
+    bool cubicKeySpace_{false};
+
+    SyncObserver* observer_{nullptr};
+    //! @brief per-peer communication volumes of the previous sync
+    std::vector<PeerVolume> particleExchangeVolume_;
+    std::vector<PeerVolume> haloExchangeVolume_;
 
     SendList incomingHaloIndices_;
     SendList outgoingHaloIndices_;
+    //! @brief buffers and graph communicator for the halo exchange pattern of the last sync
+    HaloExchanger haloExchanger_;
+    //! @brief the same exchange pattern, uploaded to the device for CudaTag domains
+    DeviceHaloExchanger_t<Accelerator, T> deviceHaloExchanger_;
+    //! @brief assigned particles that do not interact with halos
+    std::vector<IndexPair<LocalParticleIndex>> interiorRanges_;
 
     //! @brief cornerstone tree leaves for global domain decomposition
     std::vector<KeyType> tree_;
     std::vector<unsigned> nodeCounts_;
+    //! @brief the ranks on each compute node, the SFC is split across nodes first, then within each node
+    std::vector<std::vector<int>> rankGroups_;
+    //! @brief peer rank detection on a fully traversable version of tree_
+    PeerCache<T, KeyType, SfcKind> peerCache_;
+    //! @brief halo request keys of the previous sync, sent again only if they changed
+    RequestKeyExchange<KeyType> requestKeyExchange_;
+    //! @brief storage for the temporaries of one sync, reset at the start of each sync
+    ScratchArena scratch_;
 
     float theta_{1.0};
 
@@ -406,7 +776,7 @@ private:
      *  fulfills a MAC with theta as the opening parameter
      * -Also contains particle counts.
      */
-    FocusedOctree<KeyType> focusedTree_;
+    FocusedOctree<SfcKind> focusedTree_;
 
     bool firstCall_{true};
 
@@ -0,0 +1,553 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief A domain that keeps the particle data in GPU memory during the whole sync operation
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * Key computation, sorting, the global tree update, halo discovery, the particle reordering
+ * and the packing of particle and halo exchanges run on the device. Only the node counts, halo radii and halo flags
+ * of the global tree and the MPI messages are transferred to the host.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include <mpi.h>
+
+#include <thrust/binary_search.h>
+#include <thrust/copy.h>
+#include <thrust/device_vector.h>
+#include <thrust/execution_policy.h>
+#include <thrust/fill.h>
+#include <thrust/gather.h>
+#include <thrust/host_vector.h>
+#include <thrust/sequence.h>
+
+#include "cstone/cuda/device_halo_exchange.cuh"
+#include "cstone/cuda/errorcheck.cuh"
+#include "cstone/halos/discovery.cuh"
+#include "cstone/primitives/accelerator.hpp"
+#include "cstone/primitives/mpi_wrappers.hpp"
+#include "cstone/primitives/stl.hpp"
+#include "cstone/sfc/box_mpi.cuh"
+#include "cstone/sfc/sfc.cuh"
+#include "cstone/tree/btree.cuh"
+#include "cstone/tree/octree.cuh"
+#include "cstone/util/tracing.hpp"
+#include "domaindecomp_mpi.hpp"
+#include "layout.hpp"
+
+namespace cstone
+{
+
+//! @brief see computeHaloRadiiGpu
+template<class KeyType, class T, class IndexType>
+__global__ void computeHaloRadiiKernel(const KeyType* tree, TreeNodeIndex numNodes, const KeyType* keys,
+                                       std::size_t numKeys, const IndexType* ordering, const T* h, float* radii)
+{
+    TreeNodeIndex node = blockDim.x * blockIdx.x + threadIdx.x;
+    if (node >= numNodes) { return; }
+
+    std::size_t first = stl::lower_bound(keys, keys + numKeys, tree[node]) - keys;
+    std::size_t last  = stl::lower_bound(keys, keys + numKeys, tree[node + 1]) - keys;
+
+    T nodeMax = 0;
+    for (std::size_t i = first; i < last; ++i)
+    {
+        nodeMax = stl::max(nodeMax, h[ordering[i]]);
+    }
+
+    // note factor of 2 due to SPH conventions
+    radii[node] = float(2 * nodeMax);
+}
+
+/*! @brief device version of computeHaloRadii
+ *
+ * @param[in]  tree      cornerstone leaves in device memory, length @p numNodes + 1
+ * @param[in]  numNodes  number of leaves
+ * @param[in]  keys      sorted device SFC keys, length @p numKeys
+ * @param[in]  numKeys   number of keys
+ * @param[in]  ordering  h[ordering[i]] is the smoothing length of the particle with keys[i]
+ * @param[in]  h         device smoothing lengths
+ * @param[out] radii     device halo radius per leaf, length @p numNodes
+ */
+template<class KeyType, class T, class IndexType>
+void computeHaloRadiiGpu(const KeyType* tree, TreeNodeIndex numNodes, const KeyType* keys, std::size_t numKeys,
+                         const IndexType* ordering, const T* h, float* radii)
+{
+    constexpr unsigned numThreads = 256;
+    if (numNodes == 0) { return; }
+
+    computeHaloRadiiKernel<<<iceil(numNodes, numThreads), numThreads>>>(tree, numNodes, keys, numKeys, ordering, h,
+                                                                        radii);
+}
+
+/*! @brief manages distributed particle data in GPU memory, based on a global octree
+ *
+ * @tparam SfcKind  32- or 64-bit unsigned integer to use Morton keys,
+ *                  or MortonKey/HilbertKey<32- or 64-bit unsigned> to select the SFC, see sfc.hpp
+ * @tparam T        float or double
+ *
+ * Device counterpart of Domain, sync() performs the same update sequence with thrust::device_vector arrays.
+ * The global tree is kept both on the device and on the host, since the assignment and the halo exchange
+ * pattern are computed on the host from per-node data. If the MPI library is CUDA-aware, particle and halo
+ * messages are sent from device memory, otherwise they are staged through host memory.
+ */
+template<class SfcKind, class T>
+class DeviceDomain
+{
+    using KeyType = SfcKeyType_t<SfcKind>;
+
+    template<class V>
+    using DeviceVector = thrust::device_vector<V>;
+
+public:
+    /*! @brief construct empty domain
+     *
+     * @param rank        executing rank
+     * @param nRanks      number of ranks
+     * @param bucketSize  build tree with max @a bucketSize particles per node
+     * @param box         global bounding box, default is non-pbc box
+     * @param deviceId    GPU of the executing rank, e.g. obtained from deviceOfRank, a negative value keeps
+     *                    the current device
+     * @param comm        the ranks that share the domain, @p rank and @p nRanks refer to this communicator.
+     *                    The domain works on a duplicate of @p comm, the constructor is collective over @p comm.
+     *
+     * A non-negative @p deviceId makes it the current device of the calling thread, since the thrust arrays
+     * of the domain as well as the arrays passed to sync are allocated on the current device.
+     */
+    DeviceDomain(int rank, int nRanks, int bucketSize, const Box<T>& box = Box<T>{0, 1}, int deviceId = -1,
+                 MPI_Comm comm = MPI_COMM_WORLD)
+        : myRank_(rank), nRanks_(nRanks), comm_(comm), bucketSize_(bucketSize), box_(box),
+          haloExchanger_(bindDevice(deviceId))
+    {
+    }
+
+    /*! @brief domain update sequence for device arrays
+     *
+     * @param[inout] x      device coordinates
+     * @param[inout] y
+     * @param[inout] z
+     * @param[inout] h      device interaction radii in SPH convention
+     * @param[out]   keys   device SFC keys
+     * @param[inout] particleProperties  device particle properties to distribute along with the coordinates
+     *
+     * Pre- and postconditions are the same as for Domain::sync. In addition, every rank needs to have
+     * at least one assigned particle.
+     */
+    template<class... Vectors>
+    void sync(DeviceVector<T>& x, DeviceVector<T>& y, DeviceVector<T>& z, DeviceVector<T>& h,
+              DeviceVector<KeyType>& keys, Vectors&... particleProperties)
+    {
+        CSTONE_TRACE_RANGE("DeviceDomain::sync");
+        if (firstCall_)
+        {
+            particleStart_   = 0;
+            particleEnd_     = x.size();
+            localNParticles_ = x.size();
+        }
+
+        std::array<std::size_t, 4 + sizeof...(Vectors)> sizes{x.size(), y.size(), z.size(), h.size(),
+                                                              particleProperties.size()...};
+        if (std::count(begin(sizes), end(sizes), localNParticles_) != sizes.size())
+        {
+            throw std::runtime_error("DeviceDomain sync: input array sizes are inconsistent\n");
+        }
+
+        LocalParticleIndex numParticles = particleEnd_ - particleStart_;
+
+        box_ = makeGlobalBoxGpu(rawPtr(x) + particleStart_, rawPtr(y) + particleStart_, rawPtr(z) + particleStart_,
+                                numParticles, box_, comm_);
+        if (cubicKeySpace_) { box_ = makeCubicBox(box_); }
+
+        // the keys of the assigned particles in SFC order, ordering_ holds the array index of each key
+        sortedKeys_.resize(numParticles);
+        computeSfcKeysGpu<SfcKind>(rawPtr(x) + particleStart_, rawPtr(y) + particleStart_, rawPtr(z) + particleStart_,
+                                   rawPtr(sortedKeys_), numParticles, box_);
+        ordering_.resize(numParticles);
+        thrust::sequence(thrust::device, ordering_.begin(), ordering_.end(), particleStart_);
+        sortByKey(CudaTag{}, rawPtr(sortedKeys_), rawPtr(ordering_), numParticles);
+
+        updateTree(numParticles);
+
+        if (firstCall_) { rankGroups_ = computeNodeRankGroups(comm_); }
+        firstCall_ = false;
+
+        SpaceCurveAssignment assignment = hierarchicalSfcSplit(nodeCounts_, rankGroups_);
+        LocalParticleIndex newNParticlesAssigned = assignment.totalCount(myRank_);
+
+        LocalParticleIndex newParticleStart = updateHaloPattern(assignment, h, numParticles);
+
+        exchangeParticles(assignment, newParticleStart, newNParticlesAssigned, x, y, z, h, particleProperties...);
+
+        particleStart_ = newParticleStart;
+        particleEnd_   = newParticleStart + newNParticlesAssigned;
+
+        // received particles are in arbitrary order
+        keys.resize(localNParticles_);
+        computeSfcKeysGpu<SfcKind>(rawPtr(x) + particleStart_, rawPtr(y) + particleStart_, rawPtr(z) + particleStart_,
+                                   rawPtr(keys) + particleStart_, newNParticlesAssigned, box_);
+        ordering_.resize(newNParticlesAssigned);
+        thrust::sequence(thrust::device, ordering_.begin(), ordering_.end(), particleStart_);
+        sortByKey(CudaTag{}, rawPtr(keys) + particleStart_, rawPtr(ordering_), newNParticlesAssigned);
+
+        reorderAssigned(x);
+        reorderAssigned(y);
+        reorderAssigned(z);
+        reorderAssigned(h);
+        (reorderAssigned(particleProperties), ...);
+
+        exchangeHalos(x, y, z, h);
+
+        computeSfcKeysGpu<SfcKind>(rawPtr(x), rawPtr(y), rawPtr(z), rawPtr(keys), particleStart_, box_);
+        computeSfcKeysGpu<SfcKind>(rawPtr(x) + particleEnd_, rawPtr(y) + particleEnd_, rawPtr(z) + particleEnd_,
+                                   rawPtr(keys) + particleEnd_, localNParticles_ - particleEnd_, box_);
+    }
+
+    //! @brief repeat the halo exchange pattern from the previous sync operation for device arrays of size localNParticles_
+    template<class... Vectors>
+    void exchangeHalos(Vectors&... arrays)
+    {
+        std::array<std::size_t, sizeof...(Vectors)> sizes{arrays.size()...};
+        if (std::count(begin(sizes), end(sizes), localNParticles_) != sizes.size())
+        {
+            throw std::runtime_error("halo exchange array sizes inconsistent with previous sync operation\n");
+        }
+
+        haloExchanger_.exchange(rawPtr(arrays)...);
+    }
+
+    //! @brief return the index of the first particle that's part of the local assignment
+    [[nodiscard]] LocalParticleIndex startIndex() const { return particleStart_; }
+
+    //! @brief return one past the index of the last particle that's part of the local assignment
+    [[nodiscard]] LocalParticleIndex endIndex() const { return particleEnd_; }
+
+    //! @brief return number of locally assigned particles
+    [[nodiscard]] LocalParticleIndex nParticles() const { return endIndex() - startIndex(); }
+
+    //! @brief return number of locally assigned particles plus number of halos
+    [[nodiscard]] LocalParticleIndex nParticlesWithHalos() const { return localNParticles_; }
+
+    //! @brief host copy of the global octree leaves
+    const std::vector<KeyType>& tree() const { return tree_; }
+
+    //! @brief return the coordinate bounding box from the previous sync call
+    Box<T> box() const { return box_; }
+
+    //! @brief extend the open dimensions of the global box to a cube at each sync, see Domain::setCubicKeySpace
+    void setCubicKeySpace(bool enable) { cubicKeySpace_ = enable; }
+
+    //! @brief the device of the domain, negative if constructed without a device ID
+    [[nodiscard]] int deviceId() const { return haloExchanger_.deviceId(); }
+
+    //! @brief the private duplicate of the communicator passed to the constructor
+    [[nodiscard]] MPI_Comm comm() const { return comm_; }
+
+private:
+    template<class V>
+    static V* rawPtr(DeviceVector<V>& v) { return thrust::raw_pointer_cast(v.data()); }
+
+    static int bindDevice(int deviceId)
+    {
+        if (deviceId >= 0) { checkCudaErrors(cudaSetDevice(deviceId)); }
+        return deviceId;
+    }
+
+    //! @brief update the global tree on the device, node counts are summed up over all ranks on the host
+    void updateTree(LocalParticleIndex numParticles)
+    {
+        const KeyType* keysStart = rawPtr(sortedKeys_);
+        const KeyType* keysEnd   = keysStart + numParticles;
+
+        unsigned maxCount = std::numeric_limits<unsigned>::max() / nRanks_;
+
+        bool converged = false;
+        if (firstCall_)
+        {
+            unsigned numGlobal = numParticles;
+            MPI_Allreduce(MPI_IN_PLACE, &numGlobal, 1, MPI_UNSIGNED, MPI_SUM, comm_);
+
+            std::vector<KeyType> rootTree{0, nodeRange<KeyType>(0)};
+            deviceTree_   = rootTree;
+            deviceCounts_ = std::vector<unsigned>{numGlobal};
+        }
+
+        // the counts are global, therefore all ranks reach the same rebalance decisions and converge together
+        while (!converged)
+        {
+            converged = updateOctreeGpu(keysStart, keysEnd, bucketSize_, deviceTree_, deviceCounts_, tmpTree_,
+                                        workArray_, maxCount);
+
+            nodeCounts_.resize(deviceCounts_.size());
+            thrust::copy(deviceCounts_.begin(), deviceCounts_.end(), nodeCounts_.begin());
+            MPI_Allreduce(MPI_IN_PLACE, nodeCounts_.data(), nodeCounts_.size(), MPI_UNSIGNED, MPI_SUM,
+                          comm_);
+            thrust::copy(nodeCounts_.begin(), nodeCounts_.end(), deviceCounts_.begin());
+
+            // after the first call, a single update step per sync is sufficient, as in Domain::sync
+            converged = converged || !firstCall_;
+        }
+
+        tree_.resize(deviceTree_.size());
+        thrust::copy(deviceTree_.begin(), deviceTree_.end(), tree_.begin());
+    }
+
+    /*! @brief discover halos on the device, then compute the particle layout and the halo exchange pattern
+     *
+     * @return the index of the first assigned particle in the new layout
+     */
+    LocalParticleIndex updateHaloPattern(const SpaceCurveAssignment& assignment, DeviceVector<T>& h,
+                                         LocalParticleIndex numParticles)
+    {
+        TreeNodeIndex numNodes = nNodes(tree_);
+
+        haloRadii_.resize(numNodes);
+        computeHaloRadiiGpu(rawPtr(deviceTree_), numNodes, rawPtr(sortedKeys_), numParticles, rawPtr(ordering_),
+                            rawPtr(h), rawPtr(haloRadii_));
+
+        std::vector<float> haloRadii(numNodes);
+        thrust::copy(haloRadii_.begin(), haloRadii_.end(), haloRadii.begin());
+        MPI_Allreduce(MPI_IN_PLACE, haloRadii.data(), numNodes, MPI_FLOAT, MPI_MAX, comm_);
+        thrust::copy(haloRadii.begin(), haloRadii.end(), haloRadii_.begin());
+
+        binaryTree_.resize(numNodes);
+        createBinaryTreeGpu(rawPtr(deviceTree_), numNodes, rawPtr(binaryTree_));
+
+        TreeNodeIndex firstNode = assignment.firstNodeIdx(myRank_);
+        TreeNodeIndex lastNode  = assignment.lastNodeIdx(myRank_);
+
+        collisionFlags_.resize(numNodes);
+        thrust::fill(thrust::device, collisionFlags_.begin(), collisionFlags_.end(), 0);
+        findHalosGpu<KeyType, float, T, SfcKind>(rawPtr(deviceTree_), rawPtr(binaryTree_), rawPtr(haloRadii_), box_,
+                                                 firstNode, lastNode, rawPtr(collisionFlags_));
+
+        // compact the halo flags on the device, only the sorted list of halo nodes is downloaded
+        std::vector<TreeNodeIndex> haloNodes = flaggedIndicesGpu(rawPtr(collisionFlags_), numNodes);
+
+        std::vector<std::vector<TreeNodeIndex>> incomingHaloNodes = groupNodesByRank(haloNodes, assignment);
+        std::vector<std::vector<TreeNodeIndex>> outgoingHaloNodes = exchangeNodeLists(incomingHaloNodes);
+
+        std::vector<TreeNodeIndex> presentNodes;
+        std::vector<LocalParticleIndex> nodeOffsets;
+        computeLayoutOffsets(firstNode, lastNode, haloNodes, nodeCounts_, presentNodes, nodeOffsets);
+        localNParticles_ = nodeOffsets.back();
+
+        TreeNodeIndex firstLocalNode =
+            std::lower_bound(cbegin(presentNodes), cend(presentNodes), firstNode) - cbegin(presentNodes);
+
+        SendList incomingHalos = createHaloExchangeList(incomingHaloNodes, presentNodes, nodeOffsets);
+        SendList outgoingHalos = createHaloExchangeList(outgoingHaloNodes, presentNodes, nodeOffsets);
+        haloExchanger_.setup(incomingHalos, outgoingHalos, comm_);
+
+        return nodeOffsets[firstLocalNode];
+    }
+
+    /*! @brief send the lists of incoming halo nodes to their owners
+     *
+     * @param incomingNodes  per owner rank, the nodes that the calling rank needs as halos
+     * @return               per rank, the nodes of the calling rank that are halos of that rank
+     *
+     * Halo discovery on the device only flags the incoming halos. Since the halo radii of a node pair
+     * are not symmetric, the outgoing halos are obtained from the incoming halos of the other ranks.
+     */
+    std::vector<std::vector<TreeNodeIndex>> exchangeNodeLists(const std::vector<std::vector<TreeNodeIndex>>& incomingNodes)
+    {
+        std::vector<int> sendCounts(nRanks_), receiveCounts(nRanks_);
+        for (int r = 0; r < nRanks_; ++r)
+        {
+            sendCounts[r] = incomingNodes[r].size();
+        }
+        MPI_Alltoall(sendCounts.data(), 1, MPI_INT, receiveCounts.data(), 1, MPI_INT, comm_);
+
+        std::vector<int> sendDispls(nRanks_ + 1, 0), receiveDispls(nRanks_ + 1, 0);
+        std::partial_sum(begin(sendCounts), end(sendCounts), begin(sendDispls) + 1);
+        std::partial_sum(begin(receiveCounts), end(receiveCounts), begin(receiveDispls) + 1);
+
+        std::vector<TreeNodeIndex> sendNodes = flattenNodeList(incomingNodes);
+        std::vector<TreeNodeIndex> receiveNodes(receiveDispls.back());
+        MPI_Alltoallv(sendNodes.data(), sendCounts.data(), sendDispls.data(), MpiType<TreeNodeIndex>{},
+                      receiveNodes.data(), receiveCounts.data(), receiveDispls.data(), MpiType<TreeNodeIndex>{},
+                      comm_);
+
+        std::vector<std::vector<TreeNodeIndex>> outgoingNodes(nRanks_);
+        for (int r = 0; r < nRanks_; ++r)
+        {
+            outgoingNodes[r].assign(receiveNodes.begin() + receiveDispls[r],
+                                    receiveNodes.begin() + receiveDispls[r + 1]);
+        }
+        return outgoingNodes;
+    }
+
+    /*! @brief move the assigned particles to their new ranks and into the new layout
+     *
+     * The particles that this rank keeps are placed at @p newParticleStart, followed by the particles
+     * received from the other ranks, ordered by source rank. The particles to send to each rank form a
+     * contiguous range of the sorted keys, which is gathered on the device through ordering_.
+     */
+    template<class... Vectors>
+    void exchangeParticles(const SpaceCurveAssignment& assignment, LocalParticleIndex newParticleStart,
+                           LocalParticleIndex newNParticlesAssigned, Vectors&... arrays)
+    {
+        // locate the SFC ranges of all ranks in the sorted keys
+        std::vector<KeyType> rangeKeys(2 * nRanks_);
+        for (int r = 0; r < nRanks_; ++r)
+        {
+            rangeKeys[2 * r]     = tree_[assignment.firstNodeIdx(r)];
+            rangeKeys[2 * r + 1] = tree_[assignment.lastNodeIdx(r)];
+        }
+        DeviceVector<KeyType> deviceRangeKeys = rangeKeys;
+        DeviceVector<LocalParticleIndex> deviceRangeIndices(2 * nRanks_);
+        thrust::lower_bound(thrust::device, sortedKeys_.begin(), sortedKeys_.end(), deviceRangeKeys.begin(),
+                            deviceRangeKeys.end(), deviceRangeIndices.begin());
+        std::vector<LocalParticleIndex> rangeIndices(2 * nRanks_);
+        thrust::copy(deviceRangeIndices.begin(), deviceRangeIndices.end(), rangeIndices.begin());
+
+        std::vector<int> sendCounts(nRanks_), receiveCounts(nRanks_);
+        for (int r = 0; r < nRanks_; ++r)
+        {
+            sendCounts[r] = (r == myRank_) ? 0 : rangeIndices[2 * r + 1] - rangeIndices[2 * r];
+        }
+        MPI_Alltoall(sendCounts.data(), 1, MPI_INT, receiveCounts.data(), 1, MPI_INT, comm_);
+
+        LocalParticleIndex keepStart = rangeIndices[2 * myRank_];
+        LocalParticleIndex numKeep   = rangeIndices[2 * myRank_ + 1] - keepStart;
+
+        std::vector<LocalParticleIndex> receiveOffsets(nRanks_ + 1, 0);
+        std::partial_sum(begin(receiveCounts), end(receiveCounts), begin(receiveOffsets) + 1);
+        if (numKeep + receiveOffsets.back() != newNParticlesAssigned)
+        {
+            throw std::runtime_error("DeviceDomain sync: inconsistent number of received particles\n");
+        }
+
+        int tag = nextTagEpoch(comm_, ExchangeKind::particles);
+        (exchangeArray(arrays, tag, rangeIndices, sendCounts, receiveCounts, receiveOffsets, keepStart, numKeep,
+                       newParticleStart), ...);
+    }
+
+    //! @brief particle exchange of a single array, see exchangeParticles
+    void exchangeArray(DeviceVector<T>& array, int tag, const std::vector<LocalParticleIndex>& rangeIndices,
+                       const std::vector<int>& sendCounts, const std::vector<int>& receiveCounts,
+                       const std::vector<LocalParticleIndex>& receiveOffsets, LocalParticleIndex keepStart,
+                       LocalParticleIndex numKeep, LocalParticleIndex newParticleStart)
+    {
+        bool gpuAware = DeviceHaloExchanger<T>::gpuAwareMpi();
+
+        DeviceVector<T> newArray(localNParticles_);
+        thrust::gather(thrust::device, ordering_.begin() + keepStart, ordering_.begin() + keepStart + numKeep,
+                       array.begin(), newArray.begin() + newParticleStart);
+
+        // gather all outgoing particles in SFC order, the ranges of the receiving ranks are contiguous
+        sendBuffer_.resize(sortedKeys_.size());
+        thrust::gather(thrust::device, ordering_.begin(), ordering_.end(), array.begin(), sendBuffer_.begin());
+        thrust::host_vector<T> hostSend, hostReceive;
+        if (!gpuAware)
+        {
+            hostSend = sendBuffer_;
+            hostReceive.resize(receiveOffsets.back());
+        }
+
+        T* sendData = gpuAware ? rawPtr(sendBuffer_) : thrust::raw_pointer_cast(hostSend.data());
+        T* receiveBase = gpuAware ? rawPtr(newArray) + newParticleStart + numKeep
+                                  : thrust::raw_pointer_cast(hostReceive.data());
+
+        std::vector<MPI_Request> requests;
+        for (int r = 0; r < nRanks_; ++r)
+        {
+            if (receiveCounts[r] == 0) { continue; }
+            requests.push_back(MPI_Request{});
+            MPI_Irecv(receiveBase + receiveOffsets[r], receiveCounts[r], MpiType<T>{}, r, tag, comm_,
+                      &requests.back());
+        }
+        for (int r = 0; r < nRanks_; ++r)
+        {
+            if (sendCounts[r] == 0) { continue; }
+            requests.push_back(MPI_Request{});
+            MPI_Isend(sendData + rangeIndices[2 * r], sendCounts[r], MpiType<T>{}, r, tag, comm_,
+                      &requests.back());
+        }
+        MPI_Waitall(int(requests.size()), requests.data(), MPI_STATUSES_IGNORE);
+
+        if (!gpuAware)
+        {
+            thrust::copy(hostReceive.begin(), hostReceive.end(), newArray.begin() + newParticleStart + numKeep);
+        }
+
+        array.swap(newArray);
+    }
+
+    //! @brief apply ordering_ to the assigned particles of @p array
+    void reorderAssigned(DeviceVector<T>& array)
+    {
+        sendBuffer_.resize(ordering_.size());
+        thrust::gather(thrust::device, ordering_.begin(), ordering_.end(), array.begin(), sendBuffer_.begin());
+        thrust::copy(thrust::device, sendBuffer_.begin(), sendBuffer_.end(), array.begin() + particleStart_);
+    }
+
+    int myRank_;
+    int nRanks_;
+    //! @brief the ranks that share the domain
+    DuplicateComm comm_;
+    int bucketSize_;
+
+    LocalParticleIndex particleStart_{0};
+    LocalParticleIndex particleEnd_{0};
+    LocalParticleIndex localNParticles_{0};
+
+    Box<T> box_;
+    bool cubicKeySpace_{false};
+    bool firstCall_{true};
+
+    //! @brief global tree leaves on the host and on the device, with the global node counts
+    std::vector<KeyType> tree_;
+    std::vector<unsigned> nodeCounts_;
+    DeviceVector<KeyType> deviceTree_;
+    DeviceVector<unsigned> deviceCounts_;
+    std::vector<std::vector<int>> rankGroups_;
+
+    //! @brief sorted keys of the assigned particles and their array indices
+    DeviceVector<KeyType> sortedKeys_;
+    DeviceVector<LocalParticleIndex> ordering_;
+
+    DeviceVector<float> haloRadii_;
+    DeviceVector<BinaryNode<KeyType>> binaryTree_;
+    DeviceVector<int> collisionFlags_;
+    DeviceHaloExchanger<T> haloExchanger_;
+
+    //! @brief temporary storage
+    DeviceVector<KeyType> tmpTree_;
+    DeviceVector<TreeNodeIndex> workArray_;
+    DeviceVector<T> sendBuffer_;
+};
+
+} // namespace cstone
@@ -33,15 +33,14 @@
 
 #include <type_traits>
 
+#include "cstone/primitives/accelerator.hpp"
 #include "cstone/primitives/gather.hpp"
 #include "cstone/cuda/gather.cuh"
+#include "cstone/cuda/device_halo_exchange.cuh"
 
 namespace cstone
 {
 
-struct CpuTag {};
-struct CudaTag {};
-
 namespace detail
 {
 
@@ -62,12 +61,51 @@ struct ReorderFunctor<Accelerator, std::enable_if_t<std::is_same<Accelerator, Cu
     using type = DeviceGather<ValueType, CodeType, IndexType>;
 };
 
+//! @brief placeholder for domains without device-resident arrays, only keeps the interface of setup
+template<class ValueType>
+struct NoDeviceHaloExchanger
+{
+    void setup(const SendList& /*incomingHalos*/, const SendList& /*outgoingHalos*/, MPI_Comm /*comm*/) {}
+};
+
+template<class Accelerator, class = void>
+struct DeviceHaloExchange {};
+
+template<class Accelerator>
+struct DeviceHaloExchange<Accelerator, std::enable_if_t<std::is_same<Accelerator, CpuTag>{}>>
+{
+    template<class ValueType>
+    using type = NoDeviceHaloExchanger<ValueType>;
+};
+
+template<class Accelerator>
+struct DeviceHaloExchange<Accelerator, std::enable_if_t<std::is_same<Accelerator, CudaTag>{}>>
+{
+    template<class ValueType>
+    using type = cstone::DeviceHaloExchanger<ValueType>;
+};
+
 } // namespace detail
 
 //! @brief returns reorder functor type to be used, depending on the accelerator
 template<class Accelerator, class ValueType, class CodeType, class IndexType>
 using ReorderFunctor_t = typename detail::ReorderFunctor<Accelerator>::template type<ValueType, CodeType, IndexType>;
 
+//! @brief returns the halo exchanger type for device arrays to be used, depending on the accelerator
+template<class Accelerator, class ValueType>
+using DeviceHaloExchanger_t = typename detail::DeviceHaloExchange<Accelerator>::template type<ValueType>;
+
+/*! @brief construct an accelerator-dependent functor, bound to device @p deviceId if it operates on a device
+ *
+ * Types that run on the host are default-constructed and the device ID is ignored.
+ */
+template<class Functor>
+Functor makeDeviceFunctor(int deviceId)
+{
+    if constexpr (std::is_constructible_v<Functor, int>) { return Functor(deviceId); }
+    else { return Functor{}; }
+}
+
 
 } // namespace cstone
 
@@ -61,7 +61,10 @@ using Rank = StrongType<int, struct RankTag>;
  * @tparam I  32- or 64-bit unsigned integer
  *
  * The storage layout allows fast look-up of the SFC code ranges that a given rank
- * was assigned.
+ * was assigned. Ranges do not need to be assigned to ranks in SFC order, e.g. with
+ * a hierarchical assignment, the ranks of a compute node form a contiguous SFC segment
+ * regardless of their rank IDs. Look-up of the owning rank of a node is therefore performed
+ * on a separate list of the non-empty ranges, sorted by SFC position.
  *
  * Note: Assignment of SFC ranges to ranks should be unique, each SFC range should only
  * be assigned to one rank. This is NOT checked.
@@ -71,33 +74,45 @@ class SpaceCurveAssignment
 public:
     SpaceCurveAssignment() = default;
 
-    explicit SpaceCurveAssignment(int nRanks) : rankAssignment_(nRanks+1), counts_(nRanks+1) {}
+    explicit SpaceCurveAssignment(int nRanks) : firstNodes_(nRanks), lastNodes_(nRanks), counts_(nRanks) {}
 
     //! @brief add an index/code range to rank @p rank
     void addRange(Rank rank, TreeNodeIndex lower, TreeNodeIndex upper, std::size_t cnt)
     {
-        rankAssignment_[rank]   = lower;
-        // will be overwritten by @p lower of rank+1, except if rank == numRanks-1
-        rankAssignment_[rank+1] = upper;
-        counts_[rank]           = cnt;
+        eraseSplit(rank);
+
+        firstNodes_[rank] = lower;
+        lastNodes_[rank]  = upper;
+        counts_[rank]     = cnt;
+
+        // empty ranges do not own any nodes and are not needed for look-up
+        if (lower == upper) { return; }
+
+        // ranges usually arrive in SFC order, in which case this appends at the end
+        auto it  = std::upper_bound(begin(splitStarts_), end(splitStarts_), lower);
+        auto pos = it - begin(splitStarts_);
+        splitStarts_.insert(it, lower);
+        splitRanks_.insert(begin(splitRanks_) + pos, int(rank));
     }
 
-    [[nodiscard]] int numRanks() const { return int(rankAssignment_.size()) - 1; }
+    [[nodiscard]] int numRanks() const { return int(firstNodes_.size()); }
 
     [[nodiscard]] TreeNodeIndex firstNodeIdx(int rank) const
     {
-        return rankAssignment_[rank];
+        return firstNodes_[rank];
     }
 
     [[nodiscard]] TreeNodeIndex lastNodeIdx(int rank) const
     {
-        return rankAssignment_[rank+1];
+        return lastNodes_[rank];
     }
 
+    //! @brief return the rank whose range contains @p nodeIdx, -1 if @p nodeIdx precedes all assigned ranges
     [[nodiscard]] int findRank(TreeNodeIndex nodeIdx) const
     {
-        auto it = std::upper_bound(begin(rankAssignment_), end(rankAssignment_), nodeIdx);
-        return int(it - begin(rankAssignment_)) - 1;
+        auto it = std::upper_bound(begin(splitStarts_), end(splitStarts_), nodeIdx);
+        if (it == begin(splitStarts_)) { return -1; }
+        return splitRanks_[it - begin(splitStarts_) - 1];
     }
 
     //! @brief the sum of number of particles in all ranges, i.e. total number of assigned particles per range
@@ -106,14 +121,102 @@ public:
 private:
     friend bool operator==(const SpaceCurveAssignment& a, const SpaceCurveAssignment& b)
     {
-        return a.rankAssignment_ == b.rankAssignment_ && a.counts_ == b.counts_;
+        return a.firstNodes_ == b.firstNodes_ && a.lastNodes_ == b.lastNodes_ && a.counts_ == b.counts_;
+    }
+
+    //! @brief remove a previously added range of @p rank from the look-up list
+    void eraseSplit(int rank)
+    {
+        auto it = std::find(begin(splitRanks_), end(splitRanks_), rank);
+        if (it == end(splitRanks_)) { return; }
+
+        splitStarts_.erase(begin(splitStarts_) + (it - begin(splitRanks_)));
+        splitRanks_.erase(it);
     }
 
-    std::vector<TreeNodeIndex> rankAssignment_;
+    std::vector<TreeNodeIndex> firstNodes_;
+    std::vector<TreeNodeIndex> lastNodes_;
     std::vector<size_t>        counts_;
+
+    //! @brief start nodes of the non-empty ranges in ascending order and the ranks they belong to
+    std::vector<TreeNodeIndex> splitStarts_;
+    std::vector<int>           splitRanks_;
 };
 
 
+/*! @brief divide a range of leaves into consecutive pieces with the given target particle counts
+ *
+ * @param[in]  globalCounts  counts per leaf
+ * @param[in]  firstLeaf     first leaf of the range to divide
+ * @param[in]  lastLeaf      last leaf of the range to divide
+ * @param[in]  targetCounts  the desired particle count for each piece
+ * @param[out] splitCounts   the actual particle count of each piece, length = targetCounts.size()
+ * @return                   the leaf boundaries of the pieces, length = targetCounts.size() + 1,
+ *                           starting with @p firstLeaf, ending with @p lastLeaf
+ *
+ * Particles that are over- or under-assigned to a piece are carried over to the target of the next
+ * piece to avoid accumulating round off. The last piece receives all the remaining leaves.
+ */
+inline std::vector<TreeNodeIndex> splitLeafRange(const std::vector<unsigned>& globalCounts,
+                                                 TreeNodeIndex firstLeaf,
+                                                 TreeNodeIndex lastLeaf,
+                                                 std::vector<std::size_t> targetCounts,
+                                                 std::vector<std::size_t>& splitCounts)
+{
+    int nSplits = targetCounts.size();
+    std::vector<TreeNodeIndex> boundaries(nSplits + 1);
+    splitCounts.resize(nSplits);
+
+    TreeNodeIndex leavesDone = firstLeaf;
+    for (int split = 0; split < nSplits; ++split)
+    {
+        std::size_t targetCount = targetCounts[split];
+        std::size_t splitCount  = 0;
+        TreeNodeIndex j         = leavesDone;
+        while (splitCount < targetCount && j < lastLeaf)
+        {
+            // if adding the particles of the next leaf takes us further away from
+            // the target count than where we're now, we stop
+            if (targetCount < splitCount + globalCounts[j] && // overshoot
+                targetCount - splitCount < splitCount + globalCounts[j] - targetCount) // overshoot more than undershoot
+            { break; }
+
+            splitCount += globalCounts[j++];
+        }
+
+        if (split < nSplits - 1)
+        {
+            // carry over difference of particles over/under assigned to next split
+            // to avoid accumulating round off
+            long int delta = (long int)(targetCount) - (long int)(splitCount);
+            targetCounts[split+1] += delta;
+        }
+        // afaict, j < lastLeaf can only happen if there are empty nodes at the end
+        else {
+            for( ; j < lastLeaf; ++j)
+                splitCount += globalCounts[j];
+        }
+
+        boundaries[split]  = leavesDone;
+        splitCounts[split] = splitCount;
+        leavesDone = j;
+    }
+    boundaries[nSplits] = leavesDone;
+
+    return boundaries;
+}
+
+//! @brief distribute @p count evenly to @p nSplits pieces, the remainder gets distributed one by one
+inline std::vector<std::size_t> evenTargetCounts(std::size_t count, int nSplits)
+{
+    std::vector<std::size_t> targets(nSplits, count / nSplits);
+    for (std::size_t split = 0; split < count % nSplits; ++split)
+    {
+        targets[split]++;
+    }
+    return targets;
+}
+
 /*! @brief assign the global tree/SFC to nSplits ranks, assigning to each rank only a single Morton code range
  *
  * @param globalCounts       counts per leaf
@@ -133,45 +236,137 @@ SpaceCurveAssignment singleRangeSfcSplit(const std::vector<unsigned>& globalCoun
 
     std::size_t globalNParticles = std::accumulate(begin(globalCounts), end(globalCounts), std::size_t(0));
 
-    // distribute work, every rank gets global count / nSplits,
-    // the remainder gets distributed one by one
-    std::vector<std::size_t> nParticlesPerSplit(nSplits, globalNParticles/nSplits);
-    for (std::size_t split = 0; split < globalNParticles % nSplits; ++split)
+    // distribute work, every rank gets global count / nSplits
+    std::vector<std::size_t> splitCounts;
+    std::vector<TreeNodeIndex> boundaries = splitLeafRange(globalCounts, 0, globalCounts.size(),
+                                                           evenTargetCounts(globalNParticles, nSplits), splitCounts);
+
+    for (int split = 0; split < nSplits; ++split)
     {
-        nParticlesPerSplit[split]++;
+        // other distribution strategies might have more than one range per rank
+        ret.addRange(Rank(split), boundaries[split], boundaries[split + 1], splitCounts[split]);
     }
 
-    TreeNodeIndex leavesDone = 0;
-    for (int split = 0; split < nSplits; ++split)
+    return ret;
+}
+
+/*! @brief assign the global tree/SFC to groups of ranks first, then to the ranks within each group
+ *
+ * @param globalCounts       counts per leaf
+ * @param rankGroups         the ranks of each group, e.g. the ranks on each compute node, every rank
+ *                           has to appear exactly once
+ * @return                   the assignment of leaf ranges to ranks, with particle counts per rank
+ *
+ * Each group receives a single contiguous SFC segment with a share of the particles proportional
+ * to its number of ranks. The segment of a group is then divided evenly among its ranks, in the order
+ * in which they are listed. With compute nodes as groups, the SFC boundaries that are crossed by the
+ * communication between nodes are thus limited to one per node, independently of the rank numbering.
+ * With a single group that lists all ranks in ascending order, the result is identical to singleRangeSfcSplit.
+ */
+inline
+SpaceCurveAssignment hierarchicalSfcSplit(const std::vector<unsigned>& globalCounts,
+                                          const std::vector<std::vector<int>>& rankGroups)
+{
+    int numRanks = 0;
+    for (const auto& group : rankGroups)
     {
-        std::size_t targetCount = nParticlesPerSplit[split];
-        std::size_t splitCount  = 0;
-        TreeNodeIndex j         = leavesDone;
-        while (splitCount < targetCount && j < globalCounts.size())
-        {
-            // if adding the particles of the next leaf takes us further away from
-            // the target count than where we're now, we stop
-            if (targetCount < splitCount + globalCounts[j] && // overshoot
-                targetCount - splitCount < splitCount + globalCounts[j] - targetCount) // overshoot more than undershoot
-            { break; }
+        numRanks += group.size();
+    }
 
-            splitCount += globalCounts[j++];
+    SpaceCurveAssignment ret(numRanks);
+
+    std::size_t globalNParticles = std::accumulate(begin(globalCounts), end(globalCounts), std::size_t(0));
+
+    // every group gets a share of the particles proportional to its number of ranks
+    std::vector<std::size_t> groupTargets(rankGroups.size());
+    std::size_t assigned = 0;
+    int ranksDone        = 0;
+    for (std::size_t g = 0; g < rankGroups.size(); ++g)
+    {
+        ranksDone += rankGroups[g].size();
+        std::size_t upToGroup = globalNParticles / numRanks * ranksDone +
+                                std::min(std::size_t(ranksDone), globalNParticles % numRanks);
+        groupTargets[g] = upToGroup - assigned;
+        assigned        = upToGroup;
+    }
+
+    std::vector<std::size_t> groupCounts;
+    std::vector<TreeNodeIndex> groupBoundaries =
+        splitLeafRange(globalCounts, 0, globalCounts.size(), groupTargets, groupCounts);
+
+    for (std::size_t g = 0; g < rankGroups.size(); ++g)
+    {
+        const std::vector<int>& group = rankGroups[g];
+        if (group.empty()) { continue; }
+
+        std::vector<std::size_t> rankCounts;
+        std::vector<TreeNodeIndex> rankBoundaries =
+            splitLeafRange(globalCounts, groupBoundaries[g], groupBoundaries[g + 1],
+                           evenTargetCounts(groupCounts[g], group.size()), rankCounts);
+
+        for (std::size_t i = 0; i < group.size(); ++i)
+        {
+            ret.addRange(Rank(group[i]), rankBoundaries[i], rankBoundaries[i + 1], rankCounts[i]);
         }
+    }
+
+    return ret;
+}
+
+/*! @brief assign the global tree/SFC to nSplits ranks with equal weights, assigning to each rank a single range
+ *
+ * @param globalCounts       particle counts per leaf
+ * @param globalWeights      sum of the particle weights per leaf
+ * @param nSplits            divide the global tree into nSplits pieces, sensible choice e.g.: nSplits == numRanks
+ * @param maxCount           maximum number of particles per split
+ * @return                   the assignment of leaf ranges to splits, with particle counts per split
+ *
+ * Like singleRangeSfcSplit, but each split receives an equal share of the total weight instead of particles.
+ * A split is also ended before it exceeds @p maxCount particles, which bounds the memory needed on ranks
+ * with low-cost particles. The splits after it then receive a larger share of the weight.
+ * The last split receives all leaves that remain, therefore @p maxCount can be exceeded there if it is too small.
+ */
+inline
+SpaceCurveAssignment weightedSfcSplit(const std::vector<unsigned>& globalCounts,
+                                      const std::vector<double>& globalWeights, int nSplits, std::size_t maxCount)
+{
+    SpaceCurveAssignment ret(nSplits);
+
+    TreeNodeIndex numLeaves = globalCounts.size();
+    double remainingWeight  = std::accumulate(begin(globalWeights), end(globalWeights), 0.0);
+
+    TreeNodeIndex leavesDone = 0;
+    for (int split = 0; split < nSplits; ++split)
+    {
+        // remaining weight is distributed evenly, this carries over deviations of previous splits
+        double targetWeight    = remainingWeight / (nSplits - split);
+        double splitWeight     = 0;
+        std::size_t splitCount = 0;
+        TreeNodeIndex j        = leavesDone;
 
         if (split < nSplits - 1)
         {
-            // carry over difference of particles over/under assigned to next split
-            // to avoid accumulating round off
-            long int delta = (long int)(targetCount) - (long int)(splitCount);
-            nParticlesPerSplit[split+1] += delta;
+            while (splitWeight < targetWeight && j < numLeaves)
+            {
+                double nextWeight = splitWeight + globalWeights[j];
+                // stop if adding the next leaf overshoots the target by more than the current undershoot
+                if (targetWeight < nextWeight && targetWeight - splitWeight < nextWeight - targetWeight) { break; }
+                if (splitCount > 0 && splitCount + globalCounts[j] > maxCount) { break; }
+
+                splitWeight = nextWeight;
+                splitCount += globalCounts[j++];
+            }
         }
-        // afaict, j < nNodes(globalTree) can only happen if there are empty nodes at the end
-        else {
-            for( ; j < globalCounts.size(); ++j)
+        else
+        {
+            for (; j < numLeaves; ++j)
+            {
+                splitWeight += globalWeights[j];
                 splitCount += globalCounts[j];
+            }
         }
 
-        // other distribution strategies might have more than one range per rank
+        remainingWeight -= splitWeight;
         ret.addRange(Rank(split), leavesDone, j, splitCount);
         leavesDone = j;
     }
@@ -31,118 +31,335 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
 #include "domaindecomp.hpp"
 
+#include "cstone/primitives/byte_array.hpp"
 #include "cstone/primitives/mpi_wrappers.hpp"
+#include "cstone/util/executor.hpp"
+#include "cstone/util/instrumentation.hpp"
+#include "cstone/util/tracing.hpp"
 
 namespace cstone
 {
 
-template<class T, class IndexType, class... Arrays>
-void exchangeParticlesImpl(const SendList& sendList, int thisRank, std::size_t nParticlesAssigned,
-                           IndexType inputOffset, IndexType outputOffset,
-                           const IndexType* ordering, T* tempBuffer, Arrays... arrays)
+/*! @brief gather the elements of @p arrays at @p indices into a contiguous byte buffer
+ *
+ * @param[in]  indices    element indices to pack, length @p count
+ * @param[in]  count      number of elements to pack per array
+ * @param[out] buffer     output, length count * packedElementBytes(arrays, numArrays) bytes
+ * @param[in]  arrays     type-erased arrays, possibly of different element types
+ * @param[in]  numArrays  number of arrays
+ *
+ * The buffer holds the @p count elements of the first array, followed by the elements of the second array and so on.
+ */
+template<class IndexType>
+void packArrays(const IndexType* indices, std::size_t count, char* buffer, const ByteArray* arrays, int numArrays)
 {
-    constexpr int nArrays = sizeof...(Arrays);
-    std::array<T*, nArrays> sourceArrays{ (arrays + inputOffset)... };
-    std::array<T*, nArrays> destinationArrays{ (arrays + outputOffset)... };
+    for (int i = 0; i < numArrays; ++i)
+    {
+        gatherBytes(indices, count, arrays[i], buffer);
+        buffer += count * arrays[i].elementSize;
+    }
+}
 
-    int nRanks = int(sendList.size());
+/*! @brief packArrays with an optional additional reorder map per array
+ *
+ * @param[in] arrayOrderings  nullptr or one entry per array, element indices[j] of array i is read from
+ *                            arrayOrderings[i][indices[j]] if arrayOrderings[i] is not nullptr
+ * @param[-]  scratch         temporary storage for the composed indices
+ */
+template<class IndexType>
+void packArrays(const IndexType* indices, std::size_t count, char* buffer, const ByteArray* arrays, int numArrays,
+                const IndexType* const* arrayOrderings, std::vector<IndexType>& scratch)
+{
+    const IndexType* composedFrom = nullptr;
+    for (int i = 0; i < numArrays; ++i)
+    {
+        const IndexType* arrayIndices = indices;
+        if (arrayOrderings && arrayOrderings[i])
+        {
+            // arrays that share a reorder map also share the composed indices
+            if (arrayOrderings[i] != composedFrom)
+            {
+                scratch.resize(count);
+                for (std::size_t j = 0; j < count; ++j)
+                {
+                    scratch[j] = arrayOrderings[i][indices[j]];
+                }
+                composedFrom = arrayOrderings[i];
+            }
+            arrayIndices = scratch.data();
+        }
+        gatherBytes(arrayIndices, count, arrays[i], buffer);
+        buffer += count * arrays[i].elementSize;
+    }
+}
 
-    std::vector<std::vector<T>> sendBuffers;
-    sendBuffers.reserve(nArrays * (nRanks-1));
+/*! @brief inverse of packArrays, write the buffer contiguously into [arrays, arrays + count)
+ *
+ * The arrays are copied in chunks of fixed size in a single parallel loop over all chunks of all arrays.
+ */
+inline void unpackArrays(const char* buffer, std::size_t count, const ByteArray* arrays, int numArrays)
+{
+    constexpr std::size_t chunkBytes = 65536;
 
-    std::vector<MPI_Request> sendRequests;
-    sendRequests.reserve(nArrays * (nRanks-1));
+    // byte offset of each array in the buffer and index of its first chunk
+    std::vector<std::size_t> bufferOffsets(numArrays + 1, 0);
+    std::vector<std::size_t> chunkOffsets(numArrays + 1, 0);
+    for (int i = 0; i < numArrays; ++i)
+    {
+        std::size_t numBytes = count * arrays[i].elementSize;
+        bufferOffsets[i + 1] = bufferOffsets[i] + numBytes;
+        chunkOffsets[i + 1]  = chunkOffsets[i] + (numBytes + chunkBytes - 1) / chunkBytes;
+    }
 
-    for (int destinationRank = 0; destinationRank < nRanks; ++destinationRank)
+    parallelFor(std::size_t(0), chunkOffsets.back(), [&](std::size_t chunk)
     {
-        if (destinationRank == thisRank || sendList[destinationRank].totalCount() == 0) { continue; }
+        int i = int(std::upper_bound(chunkOffsets.begin(), chunkOffsets.end(), chunk) - chunkOffsets.begin()) - 1;
 
-        for (int arrayIndex = 0; arrayIndex < nArrays; ++arrayIndex)
-        {
-            auto arrayBuffer = createSendBuffer(sendList[destinationRank], sourceArrays[arrayIndex], ordering);
-            mpiSendAsync(arrayBuffer.data(), arrayBuffer.size(), destinationRank, arrayIndex, sendRequests);
-            sendBuffers.emplace_back(std::move(arrayBuffer));
-        }
+        std::size_t first = (chunk - chunkOffsets[i]) * chunkBytes;
+        std::size_t last  = std::min(first + chunkBytes, bufferOffsets[i + 1] - bufferOffsets[i]);
+        std::memcpy(arrays[i].data + first, buffer + bufferOffsets[i] + first, last - first);
+    });
+}
+
+//! @brief apply an element offset to each of the @p arrays
+inline std::vector<ByteArray> offsetArrays(const ByteArray* arrays, int numArrays, std::size_t offset)
+{
+    std::vector<ByteArray> ret(numArrays);
+    for (int i = 0; i < numArrays; ++i)
+    {
+        ret[i] = arrays[i] + offset;
     }
+    return ret;
+}
 
-    // handle thisRank
-    for (int arrayIndex = 0; arrayIndex < nArrays; ++arrayIndex)
+//! @brief collect the indices of all elements referenced by the ranges of @p manifest through @p ordering
+template<class IndexType>
+std::vector<IndexType> manifestIndices(const SendManifest& manifest, const IndexType* ordering)
+{
+    std::vector<IndexType> indices(manifest.totalCount());
+    for (std::size_t rangeIdx = 0, offset = 0; rangeIdx < manifest.nRanges(); ++rangeIdx)
     {
-        // TODO: eliminate one copy by swapping the source with tempBuffer
-        extractRange(sendList[thisRank], sourceArrays[arrayIndex], ordering, tempBuffer);
-        std::copy(tempBuffer, tempBuffer + sendList[thisRank].totalCount(), destinationArrays[arrayIndex]);
+        for (auto i = manifest.rangeStart(rangeIdx); i < manifest.rangeEnd(rangeIdx); ++i)
+        {
+            indices[offset++] = ordering[i];
+        }
     }
 
-    std::size_t nParticlesPresent = sendList[thisRank].totalCount();
+    return indices;
+}
+
+/*! @brief exchange of particles between ranks in two phases
+ *
+ * start() sends out the particles that leave the executing rank and moves the particles that stay,
+ * finish() receives the incoming particles. Work that depends neither on the incoming particles nor on
+ * the arrays being exchanged can be performed in between, while the messages are in flight.
+ * The arrays passed to start() must not be accessed until finish() has returned.
+ */
+template<class IndexType>
+class ParticleExchange
+{
+public:
+    ParticleExchange() = default;
+
+    ParticleExchange(const ParticleExchange&) = delete;
+    ParticleExchange& operator=(const ParticleExchange&) = delete;
+
+    //! @brief completes an exchange in progress, without reporting an excess of received particles
+    ~ParticleExchange() { receiveAll(); }
 
-    while (nParticlesPresent != nParticlesAssigned)
+    /*! @brief send the outgoing particles and copy the remaining ones to their destination
+     *
+     * Arguments are the same as for exchangeParticles, see documentation there. The ranks of @p sendList
+     * and @p thisRank are numbered in @p comm, which is used for this exchange until finish() returns.
+     */
+    void start(const SendList& sendList, int thisRank, std::size_t nParticlesAssigned, IndexType inputOffset,
+               IndexType outputOffset, const IndexType* ordering, const ByteArray* arrays, int numArrays,
+               const IndexType* const* arrayOrderings = nullptr, MPI_Comm comm = MPI_COMM_WORLD)
     {
-        MPI_Status status;
-        MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-        int receiveRank  = status.MPI_SOURCE;
-        //int receiveTag   = status[0].MPI_TAG;
-        int receiveCount;
-        MPI_Get_count(&status, MpiType<T>{}, &receiveCount);
-
-        if (nParticlesPresent + (std::size_t)receiveCount > nParticlesAssigned)
+        CSTONE_TRACE_RANGE("exchangeParticles::start");
+        finish();
+        comm_ = comm;
+
+        elementSize_        = packedElementBytes(arrays, numArrays);
+        nParticlesAssigned_ = nParticlesAssigned;
+        traffic_            = {};
+        receiveCounts_.assign(sendList.size(), 0);
+        particleTag_        = nextTagEpoch(comm_, ExchangeKind::particles);
+
+        std::vector<ByteArray> inputArrays = offsetArrays(arrays, numArrays, inputOffset);
+        outputArrays_                      = offsetArrays(arrays, numArrays, outputOffset);
+
+        int nRanks = int(sendList.size());
+
+        // all arrays for one destination are sent as a single message
+        sendBuffers_.clear();
+        sendBuffers_.reserve(nRanks - 1);
+        sendRequests_.clear();
+        sendRequests_.reserve(nRanks - 1);
+
+        for (int destinationRank = 0; destinationRank < nRanks; ++destinationRank)
         {
-            throw std::runtime_error("Particle exchange: cannot receive more particles than assigned\n");
+            std::size_t sendCount = sendList[destinationRank].totalCount();
+            if (destinationRank == thisRank || sendCount == 0) { continue; }
+
+            std::vector<IndexType> indices = manifestIndices(sendList[destinationRank], ordering);
+            std::vector<char> buffer(sendCount * elementSize_);
+            packArrays(indices.data(), sendCount, buffer.data(), inputArrays.data(), numArrays, arrayOrderings,
+                       scratchIndices_);
+
+            sendRequests_.push_back(MPI_Request{});
+            MPI_Isend(buffer.data(), int(buffer.size()), MPI_CHAR, destinationRank, particleTag_, comm_,
+                      &sendRequests_.back());
+            traffic_ += {buffer.size(), 0, 1, 0};
+            sendBuffers_.push_back(std::move(buffer));
         }
 
-        for (int arrayIndex = 0; arrayIndex < nArrays; ++arrayIndex)
+        // handle thisRank, source and destination ranges may overlap, hence the copy through a temporary buffer
+        nParticlesPresent_ = sendList[thisRank].totalCount();
+        segments_.assign({0, nParticlesPresent_});
         {
-            mpiRecvSync(destinationArrays[arrayIndex] + nParticlesPresent, receiveCount,
-                        receiveRank, arrayIndex, &status);
+            std::vector<char> tempBuffer(nParticlesPresent_ * elementSize_);
+            std::vector<IndexType> indices = manifestIndices(sendList[thisRank], ordering);
+            packArrays(indices.data(), nParticlesPresent_, tempBuffer.data(), inputArrays.data(), numArrays,
+                       arrayOrderings, scratchIndices_);
+            unpackArrays(tempBuffer.data(), nParticlesPresent_, outputArrays_.data(), numArrays);
         }
 
-        nParticlesPresent += receiveCount;
+        active_ = true;
     }
 
-    if (not sendRequests.empty())
+    //! @brief receive the incoming particles and wait for the outgoing ones, no-op if no exchange is in progress
+    void finish()
     {
-        MPI_Status status[sendRequests.size()];
-        MPI_Waitall(int(sendRequests.size()), sendRequests.data(), status);
+        if (!receiveAll())
+        {
+            throw std::runtime_error("Particle exchange: cannot receive more particles than assigned\n");
+        }
     }
 
-    // If this process is going to send messages with rank/tag combinations
-    // already sent in this function, this can lead to messages being mixed up
-    // on the receiver side. This happens e.g. with repeated consecutive calls of
-    // this function. For this reason, a barrier is enacted here.
-    // If there are no interfering messages going to be sent, it would be possible to
-    // remove the barrier. But if that assumption turns out to be wrong, arising bugs
-    // will be hard to detect.
-    MPI_Barrier(MPI_COMM_WORLD);
-}
+    //! @brief communication volume of the last exchange, complete after finish()
+    [[nodiscard]] const PhaseTraffic& traffic() const { return traffic_; }
 
-//! @brief reallocate arrays to the specified size
-template<class... Arrays>
-void reallocate(std::size_t size, Arrays&... arrays)
-{
-    std::array data{ (&arrays)... };
+    //! @brief number of particles received from each rank in the last exchange, complete after finish()
+    [[nodiscard]] const std::vector<std::size_t>& receiveCounts() const { return receiveCounts_; }
+
+    //! @brief bytes per particle of the last exchange, summed over all exchanged arrays
+    [[nodiscard]] std::size_t elementBytes() const { return elementSize_; }
 
-    size_t current_capacity = data[0]->capacity();
-    if (size > current_capacity)
+    /*! @brief boundaries of the contiguous output segments of the last exchange, complete after finish()
+     *
+     * Relative to the output offset, the first segment holds the particles that stayed on the executing rank,
+     * followed by one segment per received message in the order of arrival. Each message is a range of the
+     * SFC-sorted particles of its source, therefore each segment is sorted by key if the elements are accessed
+     * through an SFC ordering in start(). The last element is the number of assigned particles.
+     */
+    [[nodiscard]] const std::vector<std::size_t>& segments() const { return segments_; }
+
+private:
+    /*! @brief complete the exchange in progress, reports errors through the return value instead of exceptions
+     *
+     * @return  false if a message exceeded the number of assigned particles, in which case the receives stop,
+     *          but the outgoing messages are still completed before the send buffers may be released
+     */
+    bool receiveAll()
     {
-        // limit reallocation growth to 5% instead of 200%
-        auto reserve_size = static_cast<size_t>(double(size) * 1.05);
-        for (auto array : data)
+        CSTONE_TRACE_RANGE("exchangeParticles::finish");
+        if (!active_) { return true; }
+        active_ = false;
+
+        bool withinAssigned = true;
+
+        int numArrays = int(outputArrays_.size());
+        while (nParticlesPresent_ != nParticlesAssigned_)
+        {
+            MPI_Status status;
+            MPI_Probe(MPI_ANY_SOURCE, particleTag_, comm_, &status);
+            int receiveRank = status.MPI_SOURCE;
+            int receiveBytes;
+            MPI_Get_count(&status, MPI_CHAR, &receiveBytes);
+
+            std::size_t receiveCount = std::size_t(receiveBytes) / elementSize_;
+            if (nParticlesPresent_ + receiveCount > nParticlesAssigned_)
+            {
+                withinAssigned = false;
+                break;
+            }
+
+            receiveBuffer_.resize(receiveBytes);
+            MPI_Recv(receiveBuffer_.data(), receiveBytes, MPI_CHAR, receiveRank, particleTag_, comm_,
+                     &status);
+            std::vector<ByteArray> receiveArrays = offsetArrays(outputArrays_.data(), numArrays, nParticlesPresent_);
+            unpackArrays(receiveBuffer_.data(), receiveCount, receiveArrays.data(), numArrays);
+
+            nParticlesPresent_ += receiveCount;
+            segments_.push_back(nParticlesPresent_);
+            receiveCounts_[receiveRank] += receiveCount;
+            traffic_ += {0, uint64_t(receiveBytes), 0, 1};
+        }
+
+        if (not sendRequests_.empty())
         {
-            array->reserve(reserve_size);
+            MPI_Waitall(int(sendRequests_.size()), sendRequests_.data(), MPI_STATUSES_IGNORE);
         }
+
+        // Messages of repeated consecutive exchanges are kept apart by the rotating tags,
+        // therefore no barrier is required here.
+        return withinAssigned;
     }
 
-    for (auto array : data)
+    bool active_{false};
+    MPI_Comm comm_{MPI_COMM_WORLD};
+    int particleTag_{0};
+    std::size_t elementSize_{0};
+    std::size_t nParticlesPresent_{0};
+    std::size_t nParticlesAssigned_{0};
+    std::vector<ByteArray> outputArrays_;
+    std::vector<std::vector<char>> sendBuffers_;
+    std::vector<MPI_Request> sendRequests_;
+    std::vector<char> receiveBuffer_;
+    std::vector<IndexType> scratchIndices_;
+    std::vector<std::size_t> receiveCounts_;
+    std::vector<std::size_t> segments_;
+    PhaseTraffic traffic_;
+};
+
+/*! @brief reallocate arrays to the specified size
+ *
+ * @param[in]    size    new size of all arrays
+ * @param[inout] arrays  std::vectors of possibly different element types and allocators, or other types with
+ *                       the same capacity/reserve/resize interface, such as ParticleContainer
+ *
+ * Vectors with a FirstTouchAllocator distribute newly reserved storage across NUMA domains in the same
+ * schedule(static) partitioning as the compute loops.
+ */
+template<class... Arrays>
+void reallocate(std::size_t size, Arrays&... arrays)
+{
+    auto reallocateArray = [size](auto& array)
     {
-        array->resize(size);
-    }
+        if (size > array.capacity())
+        {
+            // limit reallocation growth to 5% instead of 200%
+            array.reserve(static_cast<size_t>(double(size) * 1.05));
+        }
+        array.resize(size);
+    };
+
+    (reallocateArray(arrays), ...);
 }
 
 /*! @brief exchange array elements with other ranks according to the specified ranges
  *
- * @tparam T                      double, float or int
- * @tparam Arrays                 all std::vector<T>
+ * @tparam Arrays                 pointers to trivially copyable types, e.g. double, float, int or SFC keys
  * @param[in] sendList            List of index ranges to be sent to each rank, indices
  *                                are valid w.r.t to arrays present on @p thisRank relative to the @p inputOffset.
  * @param[in] thisRank            Rank of the executing process
@@ -151,11 +368,13 @@ void reallocate(std::size_t size, Arrays&... arrays)
  * @param[in] inputOffset         Access arrays starting from @p inputOffset when extracting particles for sending
  * @param[in] outputOffset        Incoming particles will be added to their destination arrays starting from @p outputOffset
  * @param[in] ordering            Ordering through which to access arrays
- * @param[inout] arrays           T* pointers of identical sizes. The index range based exchange operations
+ * @param[inout] arrays           pointers to arrays of identical sizes. The index range based exchange operations
  *                                performed are identical for each input array. Upon completion, arrays will
  *                                contain elements from the specified ranges from all ranks.
  *                                The order in which the incoming ranges are grouped is random.
  *
+ *  All arrays for one destination rank are packed into a single message.
+ *
  *  Example: If sendList[ri] contains the range [upper, lower), all elements (arrays+inputOffset)[ordering[upper:lower]]
  *           will be sent to rank ri. At the destination ri, any assigned particles already present,
  *           are moved to their destination arrays, starting from @p outputOffset. The incoming elements to ri
@@ -179,37 +398,104 @@ void reallocate(std::size_t size, Arrays&... arrays)
  *      ordering.size() == nOldAssignment
  *      *std::max_element(begin(ordering), end(ordering)) == nOldAssignment - 1
  */
-template<class T, class IndexType, class... Arrays>
-void exchangeParticles(const SendList& sendList, Rank thisRank, IndexType nParticlesAssigned,
-                       IndexType inputOffset, IndexType outputOffset, const IndexType* ordering, Arrays... arrays)
+template<class IndexType, class... Arrays>
+std::enable_if_t<areTypedArrays<Arrays...>>
+exchangeParticles(const SendList& sendList, Rank thisRank, IndexType nParticlesAssigned,
+                  IndexType inputOffset, IndexType outputOffset, const IndexType* ordering, Arrays... arrays)
+{
+    std::array<ByteArray, sizeof...(Arrays)> byteArrays{byteArray(arrays)...};
+    exchangeParticles(sendList, thisRank, nParticlesAssigned, inputOffset, outputOffset, ordering,
+                      byteArrays.data(), int(byteArrays.size()));
+}
+
+/*! @brief exchange the elements of type-erased arrays, e.g. the fields of a ParticleContainer
+ *
+ * @param[inout] arrays          @p numArrays arrays with element sizes known at runtime
+ * @param[in]    arrayOrderings  nullptr or one entry per array, a reorder map relative to @p inputOffset that
+ *                               is applied to the array before @p ordering, or nullptr for arrays without one
+ * @param[in]    comm            communicator in which the ranks of @p sendList and @p thisRank are numbered
+ *
+ * See documentation of exchangeParticles for typed arrays, all arrays are packed into a single message per rank.
+ * The outgoing elements of array i are (arrays[i] + inputOffset)[arrayOrderings[i][ordering[j]]] for the indices j
+ * of the send ranges, which allows pending reorder maps of deferred fields to be applied as part of the exchange.
+ *
+ * @return the communication volume of the executing rank
+ */
+template<class IndexType>
+PhaseTraffic exchangeParticles(const SendList& sendList, Rank thisRank, IndexType nParticlesAssigned,
+                       IndexType inputOffset, IndexType outputOffset, const IndexType* ordering,
+                       const ByteArray* arrays, int numArrays, const IndexType* const* arrayOrderings = nullptr,
+                       MPI_Comm comm = MPI_COMM_WORLD)
 {
-    IndexType nParticlesAlreadyPresent = sendList[thisRank].totalCount();
-    std::vector<T> tempBuffer(nParticlesAlreadyPresent);
-    exchangeParticlesImpl(sendList, thisRank, nParticlesAssigned, inputOffset, outputOffset,
-                          ordering, tempBuffer.data(), arrays...);
+    ParticleExchange<IndexType> exchange;
+    exchange.start(sendList, thisRank, nParticlesAssigned, inputOffset, outputOffset, ordering, arrays, numArrays,
+                   arrayOrderings, comm);
+    exchange.finish();
+    return exchange.traffic();
 }
 
 /*! @brief exchange array elements with other ranks according to the specified ranges
  *
- * @tparam T                         double, float or int
- * @tparam Arrays                    all std::vector<T>
+ * @tparam Arrays                    pointers to trivially copyable types
  * @param[in]    sendList            List of index ranges assigned to each rank, indices
  *                                   are valid w.r.t to arrays present on @p thisRank
  * @param[in]    thisRank            Rank of the executing process
  * @param[in]    nParticlesAssigned  Number of elements that each array will hold on @p thisRank after the exchange
  * @param[in]    ordering            Ordering through which to access arrays
- * @param[inout] arrays              T* pointers of identical sizes, the index range based exchange operations
+ * @param[inout] arrays              pointers to arrays of identical sizes, the index range based exchange operations
  *                                   performed are identical for each input array. Upon completion, arrays will
  *                                   contain elements from the specified ranges from all ranks.
  *                                   The order in which the incoming ranges are grouped is random.
  *
  * See documentation of exchangeParticles with the full signature
  */
-template<class T, class IndexType, class... Arrays>
+template<class IndexType, class... Arrays>
 void exchangeParticles(const SendList& sendList, Rank thisRank, IndexType nParticlesAssigned,
                        const IndexType* ordering, Arrays... arrays)
 {
-    exchangeParticles<T>(sendList, thisRank, nParticlesAssigned, IndexType(0), IndexType(0), ordering, arrays...);
+    exchangeParticles(sendList, thisRank, nParticlesAssigned, IndexType(0), IndexType(0), ordering, arrays...);
+}
+
+/*! @brief group the ranks of @p comm by the compute node that they run on
+ *
+ * @param comm   MPI communicator, collective call on all ranks of @p comm
+ * @return       for each node, the ranks of @p comm placed on it, in ascending order,
+ *               identical on all ranks
+ *
+ * Nodes are identified with MPI_Comm_split_type(MPI_COMM_TYPE_SHARED) and ordered by their lowest rank.
+ * The result can be used with hierarchicalSfcSplit to assign a contiguous SFC segment to each node.
+ */
+inline std::vector<std::vector<int>> computeNodeRankGroups(MPI_Comm comm = MPI_COMM_WORLD)
+{
+    int rank, numRanks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numRanks);
+
+    MPI_Comm nodeComm;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nodeComm);
+
+    // the lowest rank on each node serves as node ID
+    int nodeId;
+    MPI_Allreduce(&rank, &nodeId, 1, MPI_INT, MPI_MIN, nodeComm);
+    MPI_Comm_free(&nodeComm);
+
+    std::vector<int> nodeIds(numRanks);
+    MPI_Allgather(&nodeId, 1, MPI_INT, nodeIds.data(), 1, MPI_INT, comm);
+
+    std::vector<std::vector<int>> groups;
+    std::vector<int> groupOfNode(numRanks, -1);
+    for (int r = 0; r < numRanks; ++r)
+    {
+        // node IDs are first encountered in ascending order, because a node ID is the lowest rank of its node
+        if (groupOfNode[nodeIds[r]] < 0)
+        {
+            groupOfNode[nodeIds[r]] = groups.size();
+            groups.emplace_back();
+        }
+        groups[groupOfNode[nodeIds[r]]].push_back(r);
+    }
+
+    return groups;
 }
 
 } // namespace cstone
@@ -31,13 +31,99 @@
 
 #pragma once
 
+#include <algorithm>
+#include <vector>
+
 #include "cstone/domain/domaindecomp.hpp"
 #include "cstone/halos/discovery.hpp"
 #include "cstone/primitives/mpi_wrappers.hpp"
+#include "cstone/primitives/varint.hpp"
+#include "cstone/util/tracing.hpp"
 
 namespace cstone
 {
 
+/*! @brief add the particle index ranges of the key ranges requested by a peer rank to @p ranges
+ *
+ * @param treeLeaves    cornerstone octree leaves, length N+1
+ * @param layout        location of each node in particle arrays, given as offsets, length N
+ * @param requestKeys   pairs of lower and upper keys of the requested ranges
+ * @param ranges        particle index ranges to send to the requesting rank
+ */
+template<class KeyType>
+void addRequestedRanges(gsl::span<const KeyType> treeLeaves, gsl::span<const LocalParticleIndex> layout,
+                        gsl::span<const KeyType> requestKeys, SendManifest& ranges)
+{
+    for (std::size_t i = 0; i < requestKeys.size(); i += 2)
+    {
+        KeyType lowerKey = requestKeys[i];
+        KeyType upperKey = requestKeys[i+1];
+
+        TreeNodeIndex lowerIdx = findNodeBelow(treeLeaves, lowerKey);
+        TreeNodeIndex upperIdx = findNodeAbove(treeLeaves, upperKey);
+
+        // the sending rank cannot have a higher tree resolution than
+        // the receiving rank in its assigned range, so the received
+        // keys should match exactly with nodes in the local tree
+        assert(treeLeaves[lowerIdx] == lowerKey);
+        assert(treeLeaves[upperIdx] == upperKey);
+
+        ranges.addRange(layout[lowerIdx], layout[upperIdx]);
+    }
+}
+
+namespace detail
+{
+
+/*! @brief send @p keys to @p peer, as encoded key differences stored in @p encoded if @p compress is true
+ *
+ * Both @p keys and @p encoded need to stay alive until the send request has completed.
+ */
+template<class KeyType>
+void sendRequestKeys(std::vector<KeyType>& keys, std::vector<uint8_t>& encoded, bool compress, int peer, int tag,
+                     std::vector<MPI_Request>& requests, MPI_Comm comm)
+{
+    if (compress)
+    {
+        encodeSortedKeys<KeyType>(keys, encoded);
+        requests.push_back(MPI_Request{});
+        MPI_Isend(encoded.data(), int(encoded.size()), MPI_BYTE, peer, tag, comm, &requests.back());
+    }
+    else { mpiSendAsync(keys.data(), int(keys.size()), peer, tag, requests, comm); }
+}
+
+/*! @brief receive request keys sent with sendRequestKeys from any rank
+ *
+ * @param[out] keys     the received keys, needs to be big enough for the longest message
+ * @param[-]   encoded  temporary storage for compressed messages
+ * @param[out] source   the sending rank
+ * @return              the number of received keys
+ */
+template<class KeyType>
+std::size_t receiveRequestKeys(gsl::span<KeyType> keys, std::vector<uint8_t>& encoded, bool compress, int tag,
+                               int& source, MPI_Comm comm)
+{
+    MPI_Status status;
+    if (compress)
+    {
+        MPI_Probe(MPI_ANY_SOURCE, tag, comm, &status);
+        int numBytes;
+        MPI_Get_count(&status, MPI_BYTE, &numBytes);
+        encoded.resize(numBytes);
+        source = status.MPI_SOURCE;
+        MPI_Recv(encoded.data(), numBytes, MPI_BYTE, source, tag, comm, MPI_STATUS_IGNORE);
+        return decodeSortedKeys<KeyType>(encoded, keys);
+    }
+
+    mpiRecvSync(keys.data(), keys.size(), MPI_ANY_SOURCE, tag, &status, comm);
+    int numKeys;
+    MPI_Get_count(&status, MpiType<KeyType>{}, &numKeys);
+    source = status.MPI_SOURCE;
+    return numKeys;
+}
+
+} // namespace detail
+
 /*! @brief exchange halo request keys, establish particle indices to send
  *
  * @tparam KeyType      32- or 64-bit unsigned integer
@@ -48,6 +134,9 @@ namespace cstone
  * @param assignment    assignment of @p treeLeaves to ranks, only ranks listed in @p peerRanks
  *                      are accessed
  * @param peerRanks     list of peer rank IDs
+ * @param compress      send the keys as variable-length encoded differences, which reduces the message sizes
+ *                      at the cost of encoding and decoding, all ranks need to pass the same value
+ * @param comm          communicator in which @p peerRanks and the ranks of @p assignment are numbered
  * @return              a SendList, containing ranges of local particle indices to send out
  *                      to each peer rank in subsequent halo particle exchanges.
  *
@@ -65,19 +154,25 @@ SendList exchangeRequestKeys(gsl::span<const KeyType> treeLeaves,
                              gsl::span<const int> haloFlags,
                              gsl::span<const LocalParticleIndex> layout,
                              const SpaceCurveAssignment& assignment,
-                             gsl::span<const int> peerRanks)
+                             gsl::span<const int> peerRanks,
+                             bool compress = false,
+                             MPI_Comm comm = MPI_COMM_WORLD)
 {
+    CSTONE_TRACE_RANGE("exchangeRequestKeys");
+    int keyTag = nextTagEpoch(comm, ExchangeKind::haloKeys);
+
     std::vector<std::vector<KeyType>> sendBuffers;
     sendBuffers.reserve(peerRanks.size());
+    std::vector<std::vector<uint8_t>> encodedBuffers(peerRanks.size());
 
     std::vector<MPI_Request> sendRequests;
 
-    for (int peer : peerRanks)
+    for (size_t i = 0; i < peerRanks.size(); ++i)
     {
-        auto requestKeys =
-            extractMarkedElements(treeLeaves, haloFlags, assignment.firstNodeIdx(peer), assignment.lastNodeIdx(peer));
-        mpiSendAsync(requestKeys.data(), int(requestKeys.size()), peer, 0, sendRequests);
-        sendBuffers.push_back(std::move(requestKeys));
+        int peer = peerRanks[i];
+        sendBuffers.push_back(
+            extractMarkedElements(treeLeaves, haloFlags, assignment.firstNodeIdx(peer), assignment.lastNodeIdx(peer)));
+        detail::sendRequestKeys(sendBuffers.back(), encodedBuffers[i], compress, peer, keyTag, sendRequests, comm);
     }
 
     size_t maxReceiveCount = 0;
@@ -88,34 +183,18 @@ SendList exchangeRequestKeys(gsl::span<const KeyType> treeLeaves,
                                    size_t(assignment.lastNodeIdx(peer) - assignment.firstNodeIdx(peer)) + 1);
     }
     std::vector<KeyType> receiveBuffer(maxReceiveCount);
+    std::vector<uint8_t> encodedReceive;
 
     SendList ret(assignment.numRanks());
 
     size_t numMessages = peerRanks.size();
     while (numMessages > 0)
     {
-        MPI_Status status;
-        mpiRecvSync(receiveBuffer.data(), receiveBuffer.size(), MPI_ANY_SOURCE, 0, &status);
-        int receiveRank = status.MPI_SOURCE;
-        TreeNodeIndex numKeys;
-        MPI_Get_count(&status, MpiType<KeyType>{}, &numKeys);
-
-        for (TreeNodeIndex i = 0; i < numKeys; i += 2)
-        {
-            KeyType lowerKey = receiveBuffer[i];
-            KeyType upperKey = receiveBuffer[i+1];
+        int receiveRank;
+        size_t numKeys = detail::receiveRequestKeys<KeyType>(receiveBuffer, encodedReceive, compress, keyTag,
+                                                             receiveRank, comm);
 
-            TreeNodeIndex lowerIdx = findNodeBelow(treeLeaves, lowerKey);
-            TreeNodeIndex upperIdx = findNodeAbove(treeLeaves, upperKey);
-
-            // the sending rank cannot have a higher tree resolution than
-            // the receiving rank in its assigned range, so the received
-            // keys should match exactly with nodes in the local tree
-            assert(treeLeaves[lowerIdx] == lowerKey);
-            assert(treeLeaves[upperIdx] == upperKey);
-
-            ret[receiveRank].addRange(layout[lowerIdx], layout[upperIdx]);
-        }
+        addRequestedRanges<KeyType>(treeLeaves, layout, {receiveBuffer.data(), numKeys}, ret[receiveRank]);
 
         numMessages--;
     }
@@ -123,9 +202,120 @@ SendList exchangeRequestKeys(gsl::span<const KeyType> treeLeaves,
     MPI_Status status[sendRequests.size()];
     MPI_Waitall(int(sendRequests.size()), sendRequests.data(), status);
 
-    MPI_Barrier(MPI_COMM_WORLD);
-
     return ret;
 }
 
+/*! @brief exchangeRequestKeys with the request keys of the previous call kept on both sides
+ *
+ * The request keys that a rank sends to a peer only change if the halo flags or the focused tree leaves
+ * in the assignment of the peer changed. A single allreduce determines whether this happened on any rank.
+ * If not, the send list is recomputed from the stored keys of the previous exchange and the current layout
+ * without point-to-point communication. Otherwise, only the requests that changed are sent in full, for the
+ * other peers a single key signals that the previous request is still valid.
+ * With compression enabled, see exchangeRequestKeys, the keys are sent as variable-length encoded differences.
+ */
+template<class KeyType>
+class RequestKeyExchange
+{
+public:
+    //! @brief arguments and return value are the same as for exchangeRequestKeys
+    SendList exchange(gsl::span<const KeyType> treeLeaves, gsl::span<const int> haloFlags,
+                      gsl::span<const LocalParticleIndex> layout, const SpaceCurveAssignment& assignment,
+                      gsl::span<const int> peerRanks, MPI_Comm comm = MPI_COMM_WORLD)
+    {
+        int numRanks = assignment.numRanks();
+        bool samePeers = peers_.size() == peerRanks.size() && std::equal(peerRanks.begin(), peerRanks.end(),
+                                                                         peers_.begin());
+        if (int(sentKeys_.size()) != numRanks)
+        {
+            samePeers = false;
+            sentKeys_.assign(numRanks, {});
+            receivedKeys_.assign(numRanks, {});
+        }
+
+        std::vector<char> changed(peerRanks.size());
+        int anyChanged = !samePeers;
+        for (size_t i = 0; i < peerRanks.size(); ++i)
+        {
+            int peer = peerRanks[i];
+            auto requestKeys = extractMarkedElements(treeLeaves, haloFlags, assignment.firstNodeIdx(peer),
+                                                     assignment.lastNodeIdx(peer));
+            changed[i] = !samePeers || requestKeys != sentKeys_[peer];
+            if (changed[i]) { sentKeys_[peer] = std::move(requestKeys); }
+            anyChanged = anyChanged || changed[i];
+        }
+        MPI_Allreduce(MPI_IN_PLACE, &anyChanged, 1, MPI_INT, MPI_MAX, comm);
+
+        exchanged_ = anyChanged;
+        if (anyChanged) { exchangeChanged(assignment, peerRanks, changed, comm); }
+        peers_.assign(peerRanks.begin(), peerRanks.end());
+
+        SendList ret(numRanks);
+        for (int peer : peerRanks)
+        {
+            addRequestedRanges<KeyType>(treeLeaves, layout, receivedKeys_[peer], ret[peer]);
+        }
+        return ret;
+    }
+
+    //! @brief true if the last call to exchange() communicated with the peer ranks
+    [[nodiscard]] bool exchanged() const { return exchanged_; }
+
+    //! @brief enable compressed request keys for subsequent exchanges, all ranks need to use the same setting
+    void setCompression(bool enable) { compress_ = enable; }
+
+private:
+    //! @brief request keys have an even length, a single key means that the previous request is still valid
+    void exchangeChanged(const SpaceCurveAssignment& assignment, gsl::span<const int> peerRanks,
+                         const std::vector<char>& changed, MPI_Comm comm)
+    {
+        int keyTag = nextTagEpoch(comm, ExchangeKind::haloKeys);
+
+        std::vector<KeyType> unchanged{0};
+        encodedSend_.resize(peerRanks.size());
+        std::vector<MPI_Request> sendRequests;
+        for (size_t i = 0; i < peerRanks.size(); ++i)
+        {
+            int peer                   = peerRanks[i];
+            std::vector<KeyType>& keys = changed[i] ? sentKeys_[peer] : unchanged;
+            detail::sendRequestKeys(keys, encodedSend_[i], compress_, peer, keyTag, sendRequests, comm);
+        }
+
+        size_t maxReceiveCount = 1;
+        for (int peer : peerRanks)
+        {
+            // +1 for the last range delimiter
+            maxReceiveCount = std::max(maxReceiveCount,
+                                       size_t(assignment.lastNodeIdx(peer) - assignment.firstNodeIdx(peer)) + 1);
+        }
+        receiveBuffer_.resize(maxReceiveCount);
+
+        for (size_t numMessages = 0; numMessages < peerRanks.size(); ++numMessages)
+        {
+            int source;
+            size_t numKeys =
+                detail::receiveRequestKeys<KeyType>(receiveBuffer_, encodedReceive_, compress_, keyTag, source, comm);
+
+            if (numKeys != 1)
+            {
+                receivedKeys_[source].assign(receiveBuffer_.begin(), receiveBuffer_.begin() + numKeys);
+            }
+        }
+
+        MPI_Waitall(int(sendRequests.size()), sendRequests.data(), MPI_STATUSES_IGNORE);
+    }
+
+    bool exchanged_{false};
+    bool compress_{false};
+    //! @brief the peer ranks of the previous call
+    std::vector<int> peers_;
+    //! @brief the request keys sent to and received from each rank in the previous calls
+    std::vector<std::vector<KeyType>> sentKeys_;
+    std::vector<std::vector<KeyType>> receivedKeys_;
+    std::vector<KeyType> receiveBuffer_;
+    //! @brief encoded messages if compression is enabled
+    std::vector<std::vector<uint8_t>> encodedSend_;
+    std::vector<uint8_t> encodedReceive_;
+};
+
 } // namespace cstone
@@ -48,6 +48,9 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
 #include <vector>
 
 #include "cstone/domain/domaindecomp.hpp"
@@ -56,6 +59,59 @@
 namespace cstone
 {
 
+/*! @brief sorted list of the indices of the non-zero elements of @p flags
+ *
+ * @param flags        flag array, length @p numElements
+ * @param numElements
+ * @param offset       added to each returned index
+ * @return             offset + i for each i in [0:numElements] with flags[i] != 0, in ascending order
+ *
+ * Parallel stream compaction: flag, scan, scatter
+ */
+template<class T>
+std::vector<TreeNodeIndex> flaggedIndices(const T* flags, TreeNodeIndex numElements, TreeNodeIndex offset = 0)
+{
+    std::vector<TreeNodeIndex> scatterMap(numElements + 1);
+
+    #pragma omp parallel for schedule(static)
+    for (TreeNodeIndex i = 0; i < numElements; ++i)
+    {
+        scatterMap[i] = flags[i] != 0;
+    }
+    scatterMap[numElements] = 0;
+
+    exclusiveScan(scatterMap.data(), scatterMap.size());
+
+    std::vector<TreeNodeIndex> indices(scatterMap.back());
+
+    #pragma omp parallel for schedule(static)
+    for (TreeNodeIndex i = 0; i < numElements; ++i)
+    {
+        if (flags[i]) { indices[scatterMap[i]] = offset + i; }
+    }
+
+    return indices;
+}
+
+/*! @brief split a sorted list of node indices into one list per owning rank
+ *
+ * @param sortedNodes  sorted list of global node indices
+ * @param assignment   stores which rank owns which part of the SFC
+ * @return             per rank, the sorted nodes of @p sortedNodes assigned to that rank
+ */
+inline std::vector<std::vector<TreeNodeIndex>> groupNodesByRank(const std::vector<TreeNodeIndex>& sortedNodes,
+                                                                const SpaceCurveAssignment& assignment)
+{
+    std::vector<std::vector<TreeNodeIndex>> groupedNodes(assignment.numRanks());
+    for (int rank = 0; rank < assignment.numRanks(); ++rank)
+    {
+        auto first = std::lower_bound(sortedNodes.begin(), sortedNodes.end(), assignment.firstNodeIdx(rank));
+        auto last  = std::lower_bound(first, sortedNodes.end(), assignment.lastNodeIdx(rank));
+        groupedNodes[rank].assign(first, last);
+    }
+    return groupedNodes;
+}
+
 /*! @brief Compute send/receive node lists from halo pair node indices
  *
  * @param[in]  assignment       stores which rank owns which part of the SFC
@@ -64,6 +120,10 @@ namespace cstone
  *                              grouped by source rank
  * @param[out] outgoingNodes    sorted list of internal nodes to be sent,
  *                              grouped by destination rank
+ *
+ * Instead of sorting per-rank lists, the pairs are marked in flag arrays over the nodes, one for the remote
+ * nodes and one per peer rank for the internal nodes, which are then compacted in parallel into sorted lists
+ * without duplicates.
  */
 inline
 void computeSendRecvNodeList(const SpaceCurveAssignment& assignment,
@@ -71,51 +131,80 @@ void computeSendRecvNodeList(const SpaceCurveAssignment& assignment,
                              std::vector<std::vector<TreeNodeIndex>>& incomingNodes,
                              std::vector<std::vector<TreeNodeIndex>>& outgoingNodes)
 {
-    incomingNodes.resize(assignment.numRanks());
-    outgoingNodes.resize(assignment.numRanks());
+    int numRanks = assignment.numRanks();
+    std::size_t numPairs = haloPairs.size();
 
-    for (auto& p : haloPairs)
+    TreeNodeIndex numNodes = 0;
+    for (int rank = 0; rank < numRanks; ++rank)
     {
-        // as defined in findHalos, the internal node index is stored first
-        TreeNodeIndex internalNodeIdx = p[0];
-        TreeNodeIndex remoteNodeIdx   = p[1];
+        numNodes = std::max(numNodes, assignment.lastNodeIdx(rank));
+    }
+
+    // as defined in findHalos, the internal node index is stored first
+    std::vector<uint8_t> remoteFlags(numNodes, 0);
+    TreeNodeIndex firstInternal = numNodes;
+    TreeNodeIndex lastInternal  = 0;
+
+    // concurrent threads only ever store the same value, therefore no atomic operations are required
+    #pragma omp parallel for schedule(static) reduction(min : firstInternal) reduction(max : lastInternal)
+    for (std::size_t i = 0; i < numPairs; ++i)
+    {
+        remoteFlags[haloPairs[i][1]] = 1;
+        firstInternal = std::min(firstInternal, haloPairs[i][0]);
+        lastInternal  = std::max(lastInternal, haloPairs[i][0] + 1);
+    }
 
-        int remoteRank = assignment.findRank(remoteNodeIdx);
+    incomingNodes = groupNodesByRank(flaggedIndices(remoteFlags.data(), numNodes), assignment);
 
-        incomingNodes[remoteRank].push_back(remoteNodeIdx);
-        outgoingNodes[remoteRank].push_back(internalNodeIdx);
+    std::vector<int> peerIndex(numRanks, -1);
+    int numPeers = 0;
+    for (int rank = 0; rank < numRanks; ++rank)
+    {
+        if (!incomingNodes[rank].empty()) { peerIndex[rank] = numPeers++; }
     }
 
-    // remove duplicates in receiver list
-    for (auto& v : incomingNodes)
+    // one flag array over the internal nodes per peer rank
+    TreeNodeIndex numInternal = std::max(lastInternal - firstInternal, TreeNodeIndex(0));
+    std::vector<uint8_t> internalFlags(std::size_t(numPeers) * numInternal, 0);
+
+    #pragma omp parallel for schedule(static)
+    for (std::size_t i = 0; i < numPairs; ++i)
     {
-        std::sort(begin(v), end(v));
-        auto unique_end = std::unique(begin(v), end(v));
-        v.erase(unique_end, end(v));
+        int peer = peerIndex[assignment.findRank(haloPairs[i][1])];
+        internalFlags[std::size_t(peer) * numInternal + haloPairs[i][0] - firstInternal] = 1;
     }
 
-    // remove duplicates in sender list
-    for (auto& v : outgoingNodes)
+    outgoingNodes.assign(numRanks, {});
+    for (int rank = 0; rank < numRanks; ++rank)
     {
-        std::sort(begin(v), end(v));
-        auto unique_end = std::unique(begin(v), end(v));
-        v.erase(unique_end, end(v));
+        if (peerIndex[rank] < 0) { continue; }
+        outgoingNodes[rank] =
+            flaggedIndices(internalFlags.data() + std::size_t(peerIndex[rank]) * numInternal, numInternal,
+                           firstInternal);
     }
 }
 
 //! @brief create a sorted list of nodes from the hierarchical per rank node list
 inline std::vector<TreeNodeIndex> flattenNodeList(const std::vector<std::vector<TreeNodeIndex>>& groupedNodes)
 {
-    TreeNodeIndex nNodes = 0;
-    for (auto& v : groupedNodes) nNodes += v.size();
+    std::vector<std::size_t> groupOffsets(groupedNodes.size() + 1, 0);
+    for (std::size_t g = 0; g < groupedNodes.size(); ++g)
+    {
+        groupOffsets[g + 1] = groupOffsets[g] + groupedNodes[g].size();
+    }
 
-    std::vector<TreeNodeIndex> nodeList;
-    nodeList.reserve(nNodes);
+    std::vector<TreeNodeIndex> nodeList(groupOffsets.back());
 
-    // add all halos to nodeList
-    for (const auto& group : groupedNodes)
+    // all threads split each group among them, without synchronization between groups
+    #pragma omp parallel
+    for (std::size_t g = 0; g < groupedNodes.size(); ++g)
     {
-        std::copy(begin(group), end(group), std::back_inserter(nodeList));
+        const auto& group = groupedNodes[g];
+        #pragma omp for schedule(static) nowait
+        for (std::size_t i = 0; i < group.size(); ++i)
+        {
+            nodeList[groupOffsets[g] + i] = group[i];
+        }
     }
 
     return nodeList;
@@ -125,7 +214,7 @@ inline std::vector<TreeNodeIndex> flattenNodeList(const std::vector<std::vector<
  *
  * @param[in]  firstLocalNode     First tree node index assigned to executing rank
  * @param[in]  lastLocalNode      Last tree node index assigned to executing rank
- * @param[in]  haloNodes          List of halo node indices without duplicates.
+ * @param[in]  haloNodes          List of halo node indices.
  *                                From the perspective of the
  *                                executing rank, these are incoming halo nodes.
  * @param[in]  globalNodeCounts   Particle count per node in the global octree
@@ -143,27 +232,29 @@ static void computeLayoutOffsets(TreeNodeIndex firstLocalNode,
                                  std::vector<TreeNodeIndex>& presentNodes,
                                  std::vector<IndexType>& offsets)
 {
-    // add all halo nodes to present
-    std::copy(begin(haloNodes), end(haloNodes), std::back_inserter(presentNodes));
+    TreeNodeIndex numNodes = globalNodeCounts.size();
+    std::vector<uint8_t> presentFlags(numNodes, 0);
 
-    for (TreeNodeIndex i = firstLocalNode; i < lastLocalNode; ++i)
-        presentNodes.push_back(i);
+    #pragma omp parallel for schedule(static)
+    for (std::size_t i = 0; i < haloNodes.size(); ++i)
+    {
+        presentFlags[haloNodes[i]] = 1;
+    }
+    std::fill(presentFlags.begin() + firstLocalNode, presentFlags.begin() + lastLocalNode, 1);
 
-    std::sort(begin(presentNodes), end(presentNodes));
+    presentNodes = flaggedIndices(presentFlags.data(), numNodes);
 
-    // an extract of globalNodeCounts, containing only nodes listed in localNodes and incomingHalos
-    std::vector<unsigned> nodeCounts(presentNodes.size());
+    // an extract of globalNodeCounts, containing only nodes listed in presentNodes, followed by the scan
+    offsets.resize(presentNodes.size() + 1);
 
-    // extract particle count information for all nodes in nodeList
+    #pragma omp parallel for schedule(static)
     for (std::size_t i = 0; i < presentNodes.size(); ++i)
     {
-        TreeNodeIndex globalNodeIndex = presentNodes[i];
-        nodeCounts[i]                 = globalNodeCounts[globalNodeIndex];
+        offsets[i] = globalNodeCounts[presentNodes[i]];
     }
+    offsets.back() = 0;
 
-    offsets.resize(nodeCounts.size() + 1);
-    stl::exclusive_scan(nodeCounts.begin(), nodeCounts.end(), offsets.begin(), 0);
-    offsets.back() = offsets[nodeCounts.size()-1] + nodeCounts.back();
+    exclusiveScan(offsets.data(), offsets.size());
 }
 
 
@@ -265,6 +356,58 @@ SendList computeHaloReceiveList(gsl::span<const LocalParticleIndex> layout,
     return ret;
 }
 
+/*! @brief determine the element moves that remove the elements at @p removeIndices from the range [first:last]
+ *
+ * @param[in]  removeIndices  indices in [first:last] of the elements to remove, without duplicates, in any order
+ * @param[in]  first          start of the range
+ * @param[in]  last           end of the range
+ * @param[out] destinations   removed elements in [first:last - removeIndices.size()] that are overwritten
+ * @param[out] sources        remaining elements in [last - removeIndices.size():last] that replace them
+ *
+ * After copying each sources[i] to destinations[i], the range [first:last - removeIndices.size()] contains all
+ * remaining elements. The cost is O(R log R) for R removed elements, independent of the length of the range.
+ * The relative order of the remaining elements is not preserved.
+ */
+template<class IndexType>
+void removalMoves(std::vector<IndexType> removeIndices, IndexType first, IndexType last,
+                  std::vector<IndexType>& destinations, std::vector<IndexType>& sources)
+{
+    std::sort(removeIndices.begin(), removeIndices.end());
+    if (!removeIndices.empty() && (removeIndices.front() < first || removeIndices.back() >= last ||
+                                   std::adjacent_find(removeIndices.begin(), removeIndices.end()) != removeIndices.end()))
+    {
+        throw std::runtime_error("Indices of removed particles must be unique and within the assigned range\n");
+    }
+
+    IndexType newLast = last - IndexType(removeIndices.size());
+    auto      tail    = std::lower_bound(removeIndices.begin(), removeIndices.end(), newLast);
+
+    destinations.assign(removeIndices.begin(), tail);
+    sources.clear();
+    for (IndexType i = newLast; i < last; ++i)
+    {
+        if (tail != removeIndices.end() && *tail == i) { ++tail; }
+        else { sources.push_back(i); }
+    }
+}
+
+//! @brief copy element sources[i] to destinations[i] in each of @p arrays, see removalMoves
+template<class IndexType, class... Arrays>
+void moveElements(const std::vector<IndexType>& destinations, const std::vector<IndexType>& sources,
+                  Arrays&... arrays)
+{
+    auto moveArray = [&destinations, &sources](auto& array)
+    {
+        #pragma omp parallel for schedule(static)
+        for (std::size_t i = 0; i < destinations.size(); ++i)
+        {
+            array[destinations[i]] = array[sources[i]];
+        }
+    };
+
+    (moveArray(arrays), ...);
+}
+
 template<class... Arrays>
 void relocate(LocalParticleIndex newSize, LocalParticleIndex offset, Arrays&... arrays)
 {
@@ -0,0 +1,391 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief A structure-of-arrays particle container with a registry of typed fields
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cstone/primitives/byte_array.hpp"
+#include "cstone/primitives/gather.hpp"
+#include "cstone/tree/definitions.h"
+
+namespace cstone
+{
+
+//! @brief determines how a registered field is treated by Domain::sync
+enum class FieldKind : int
+{
+    //! @brief scratch storage, resized by sync but neither exchanged nor reordered, contents are undefined after sync
+    transient,
+    //! @brief moved and reordered along with the assigned particles, halo elements are undefined after sync
+    migrate,
+    //! @brief like migrate, additionally the halo elements are exchanged by sync
+    halo,
+    /*! @brief like migrate, but reorder maps are recorded and composed instead of being applied to the elements
+     *
+     * Pending reorder maps are applied when the field is accessed through ParticleContainer::field, or as part
+     * of packing the particles in the next domain exchange. Fields that are not accessed between syncs are
+     * therefore never reordered separately.
+     */
+    deferred,
+};
+
+//! @brief typed handle to a field of a ParticleContainer, returned when registering the field
+template<class ValueType>
+struct FieldHandle
+{
+    int index;
+};
+
+namespace detail
+{
+
+//! @brief type-erased interface to one field of a ParticleContainer
+class ParticleFieldBase
+{
+public:
+    ParticleFieldBase(std::string name, FieldKind kind)
+        : name_(std::move(name))
+        , kind_(kind)
+    {
+    }
+
+    virtual ~ParticleFieldBase() = default;
+
+    virtual std::size_t size() const              = 0;
+    virtual void reserve(std::size_t capacity)    = 0;
+    virtual void resize(std::size_t size)         = 0;
+    virtual ByteArray bytes()                     = 0;
+
+    /*! @brief reorder the elements [offset:offset + numElements] with element i = element ordering[i]
+     *
+     * The other elements are preserved.
+     */
+    virtual void reorder(const LocalParticleIndex* ordering, std::size_t numElements, std::size_t offset) = 0;
+
+    [[nodiscard]] const std::string& name() const { return name_; }
+    [[nodiscard]] FieldKind kind() const { return kind_; }
+
+    //! @brief the reorder map that still needs to be applied to the elements starting at pendingOffset()
+    [[nodiscard]] const std::shared_ptr<const std::vector<LocalParticleIndex>>& pending() const { return pending_; }
+    [[nodiscard]] std::size_t pendingOffset() const { return pendingOffset_; }
+
+    //! @brief record a reorder map instead of applying it, replaces any previous pending map
+    void defer(std::shared_ptr<const std::vector<LocalParticleIndex>> ordering, std::size_t offset)
+    {
+        pending_       = std::move(ordering);
+        pendingOffset_ = offset;
+    }
+
+    //! @brief apply the pending reorder map, if any
+    void applyPending()
+    {
+        if (!pending_) { return; }
+        auto ordering = std::move(pending_);
+        reorder(ordering->data(), ordering->size(), pendingOffset_);
+    }
+
+    //! @brief drop the pending reorder map, after it has been applied by other means, e.g. in a domain exchange
+    void clearPending() { pending_.reset(); }
+
+private:
+    std::string name_;
+    FieldKind kind_;
+    std::shared_ptr<const std::vector<LocalParticleIndex>> pending_;
+    std::size_t pendingOffset_{0};
+};
+
+template<class ValueType>
+class ParticleField : public ParticleFieldBase
+{
+public:
+    using ParticleFieldBase::ParticleFieldBase;
+
+    std::size_t size() const override { return data_.size(); }
+    void reserve(std::size_t capacity) override { data_.reserve(capacity); }
+    void resize(std::size_t size) override { data_.resize(size); }
+    ByteArray bytes() override { return byteArray(data_.data()); }
+
+    void reorder(const LocalParticleIndex* ordering, std::size_t numElements, std::size_t offset) override
+    {
+        // gather into the scratch vector and swap, such that the capacity of both vectors is reused
+        scratch_.resize(data_.size());
+        const ValueType* source = data_.data() + offset;
+        ValueType* destination  = scratch_.data() + offset;
+        gatherArrays(ordering, numElements, &source, &destination, 1);
+
+        std::copy(data_.begin(), data_.begin() + offset, scratch_.begin());
+        std::copy(data_.begin() + offset + numElements, data_.end(), scratch_.begin() + offset + numElements);
+        data_.swap(scratch_);
+    }
+
+    std::vector<ValueType>& data() { return data_; }
+
+private:
+    std::vector<ValueType> data_;
+    std::vector<ValueType> scratch_;
+};
+
+} // namespace detail
+
+/*! @brief structure-of-arrays storage of additional particle properties of different types
+ *
+ * Each field is registered once with its element type and a FieldKind. A container can be passed to
+ * Domain::sync in place of, or in addition to, vectors of particle properties. Sync then exchanges and reorders
+ * the migrate and halo fields, exchanges the halos of the halo fields together with those of x,y,z,h, and only
+ * resizes the transient fields. Deferred fields are exchanged like migrate fields, but their reordering is
+ * postponed until they are accessed. All fields have the same size and are reallocated together, with a single
+ * capacity shared by all fields.
+ *
+ * Example:
+ *      ParticleContainer particles;
+ *      auto mass    = particles.registerField<double>("m", FieldKind::migrate);
+ *      auto density = particles.registerField<float>("rho", FieldKind::halo);
+ *      auto scratch = particles.registerField<double>("tmp", FieldKind::transient);
+ *      particles.resize(n);
+ *      domain.sync(x, y, z, h, codes, particles);
+ *      std::vector<double>& m = particles.field(mass);
+ */
+class ParticleContainer
+{
+public:
+    ParticleContainer() = default;
+
+    /*! @brief add a field with elements of type @p ValueType
+     *
+     * @param name  name of the field, must be unique within the container
+     * @param kind  determines whether the field is exchanged and reordered by Domain::sync
+     * @return      handle to access the field
+     *
+     * The new field has the current size of the container, with value-initialized elements.
+     */
+    template<class ValueType>
+    FieldHandle<ValueType> registerField(const std::string& name, FieldKind kind)
+    {
+        static_assert(std::is_trivially_copyable_v<ValueType>, "particle fields need to be trivially copyable\n");
+        if (findField(name) >= 0)
+        {
+            throw std::runtime_error("ParticleContainer: field " + name + " is already registered\n");
+        }
+
+        auto field = std::make_unique<detail::ParticleField<ValueType>>(name, kind);
+        field->reserve(capacity_);
+        field->resize(size_);
+        fields_.push_back(std::move(field));
+
+        return {int(fields_.size()) - 1};
+    }
+
+    //! @brief access the elements of a registered field, applies pending reorder maps of deferred fields
+    template<class ValueType>
+    std::vector<ValueType>& field(FieldHandle<ValueType> handle)
+    {
+        auto& f = *fields_.at(handle.index);
+        f.applyPending();
+        return static_cast<detail::ParticleField<ValueType>&>(f).data();
+    }
+
+    //! @brief return the index of the field with the given name, or -1 if no such field exists
+    [[nodiscard]] int findField(const std::string& name) const
+    {
+        auto it = std::find_if(fields_.begin(), fields_.end(), [&name](const auto& f) { return f->name() == name; });
+        return it == fields_.end() ? -1 : int(it - fields_.begin());
+    }
+
+    //! @brief number of registered fields
+    [[nodiscard]] int numFields() const { return int(fields_.size()); }
+
+    [[nodiscard]] const std::string& fieldName(int i) const { return fields_.at(i)->name(); }
+    [[nodiscard]] FieldKind fieldKind(int i) const { return fields_.at(i)->kind(); }
+
+    /*! @brief the common size of all fields
+     *
+     * Throws if the size of a field was changed through its vector, since the fields can then no longer be synced.
+     */
+    [[nodiscard]] std::size_t size() const
+    {
+        for (const auto& f : fields_)
+        {
+            if (f->size() != size_)
+            {
+                throw std::runtime_error("ParticleContainer: field " + f->name() + " was resized individually\n");
+            }
+        }
+        return size_;
+    }
+
+    //! @brief the number of elements each field can hold without reallocating
+    [[nodiscard]] std::size_t capacity() const { return capacity_; }
+
+    //! @brief reserve memory for @p capacity elements in all fields
+    void reserve(std::size_t capacity)
+    {
+        if (capacity <= capacity_) { return; }
+        for (auto& f : fields_)
+        {
+            f->reserve(capacity);
+        }
+        capacity_ = capacity;
+    }
+
+    //! @brief resize all fields, including the transient ones
+    void resize(std::size_t size)
+    {
+        reserve(size);
+        for (auto& f : fields_)
+        {
+            f->resize(size);
+        }
+        size_ = size;
+    }
+
+    /*! @brief append type-erased views of the fields that are exchanged for the given purpose
+     *
+     * @param[inout] arrays     output list, fields are appended in registration order
+     * @param[in]    haloOnly   if true, only append halo fields, otherwise migrate and halo fields
+     */
+    void appendByteArrays(std::vector<ByteArray>& arrays, bool haloOnly)
+    {
+        for (auto& f : fields_)
+        {
+            if (isSelected(f->kind(), haloOnly)) { arrays.push_back(f->bytes()); }
+        }
+    }
+
+    /*! @brief reorder the elements [offset:offset + numElements] of all migrate, halo and deferred fields
+     *
+     * Migrate and halo fields are reordered immediately. For deferred fields, @p ordering is composed with
+     * their pending map if it refers to the same elements, otherwise the pending map is applied first.
+     * Deferred fields that share a pending map also share the composed one.
+     */
+    void reorder(const LocalParticleIndex* ordering, std::size_t numElements, std::size_t offset)
+    {
+        using Ordering = std::shared_ptr<const std::vector<LocalParticleIndex>>;
+
+        Ordering plain;
+        std::vector<std::pair<Ordering, Ordering>> composed;
+
+        for (auto& f : fields_)
+        {
+            if (f->kind() != FieldKind::deferred)
+            {
+                if (isSelected(f->kind(), false)) { f->reorder(ordering, numElements, offset); }
+                continue;
+            }
+
+            if (f->pending() && (f->pending()->size() != numElements || f->pendingOffset() != offset))
+            {
+                f->applyPending();
+            }
+
+            Ordering pending = f->pending();
+            if (!pending)
+            {
+                if (!plain)
+                {
+                    plain = std::make_shared<const std::vector<LocalParticleIndex>>(ordering, ordering + numElements);
+                }
+                f->defer(plain, offset);
+                continue;
+            }
+
+            auto it = std::find_if(composed.begin(), composed.end(),
+                                   [&pending](const auto& c) { return c.first == pending; });
+            if (it == composed.end())
+            {
+                // element i after both reorderings is element pending[ordering[i]] before
+                auto product = std::make_shared<std::vector<LocalParticleIndex>>(numElements);
+                for (std::size_t i = 0; i < numElements; ++i)
+                {
+                    (*product)[i] = (*pending)[ordering[i]];
+                }
+                composed.emplace_back(pending, std::move(product));
+                it = composed.end() - 1;
+            }
+            f->defer(it->second, offset);
+        }
+    }
+
+    /*! @brief append the pending reorder maps of the fields selected by appendByteArrays with haloOnly = false
+     *
+     * @param[inout] orderings  output list, one entry per field selected by appendByteArrays in the same order,
+     *                          the pending map of deferred fields or nullptr for fields without pending map
+     * @param[in]    offset     first element of the range to be accessed through the maps
+     *
+     * Pending maps that start at a different element than @p offset are applied instead of being appended.
+     */
+    void appendPendingOrderings(std::vector<const LocalParticleIndex*>& orderings, std::size_t offset)
+    {
+        for (auto& f : fields_)
+        {
+            if (!isSelected(f->kind(), false)) { continue; }
+
+            if (f->pending() && f->pendingOffset() != offset) { f->applyPending(); }
+            orderings.push_back(f->pending() ? f->pending()->data() : nullptr);
+        }
+    }
+
+    //! @brief drop the pending reorder maps of all deferred fields, after a domain exchange has applied them
+    void clearPending()
+    {
+        for (auto& f : fields_)
+        {
+            f->clearPending();
+        }
+    }
+
+    //! @brief apply the pending reorder maps of all deferred fields
+    void applyPending()
+    {
+        for (auto& f : fields_)
+        {
+            f->applyPending();
+        }
+    }
+
+private:
+    static bool isSelected(FieldKind kind, bool haloOnly)
+    {
+        return haloOnly ? kind == FieldKind::halo : kind != FieldKind::transient;
+    }
+
+    std::vector<std::unique_ptr<detail::ParticleFieldBase>> fields_;
+    std::size_t size_{0};
+    std::size_t capacity_{0};
+};
+
+} // namespace cstone
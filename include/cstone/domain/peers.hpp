@@ -31,7 +31,17 @@
 
 #pragma once
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
 #include "cstone/tree/macs.hpp"
+#include "cstone/util/index_ranges.hpp"
+#include "cstone/util/tracing.hpp"
 #include "domaindecomp.hpp"
 
 namespace cstone
@@ -41,11 +51,15 @@ namespace cstone
  *
  * @tparam T            float or double
  * @tparam KeyType      32- or 64-bit unsigned integer
+ * @tparam SfcKind      SFC used to construct @p domainTree, see sfc.hpp
+ * @tparam MacTag       MinDistanceMacTag or VectorMacTag
  * @param myRank        find peers for the globally assigned SFC segment with index myRank
  * @param assignment    Decomposition of the global SFC into segments
  * @param domainTree    octree built on top of the global cornerstone leaves
  * @param box           global coordinate bounding box
  * @param theta         MAC opening parameter
+ * @param centers       expansion centers of the @p domainTree nodes for the vector MAC. Need to be identical
+ *                      on all ranks. Required with VectorMacTag, ignored otherwise.
  * @return              list of segment indices (i.e. "ranks") that contain tree leaf nodes
  *                      that fail the MAC paired with at least one tree leaf node inside
  *                      the @p myRank segment. This list contains at least the segments
@@ -56,15 +70,24 @@ namespace cstone
  * Except for @p myRank, this function acts on data that is identical on all MPI ranks and
  * doesn't need to do any communication.
  */
-template<class T, class KeyType>
+template<class T, class KeyType, class SfcKind = KeyType, class MacTag = MinDistanceMacTag>
 std::vector<int> findPeersMac(int myRank, const SpaceCurveAssignment& assignment,
-                              const Octree<KeyType>& domainTree, const Box<T>& box, float theta)
+                              const Octree<KeyType>& domainTree, const Box<T>& box, float theta,
+                              const ExpansionCenter<T>* centers = nullptr)
 {
+    CSTONE_TRACE_RANGE("findPeersMac");
     float invThetaSq = 1.0f / (theta * theta);
     KeyType domainStart = domainTree.codeStart(domainTree.toInternal(assignment.firstNodeIdx(myRank)));
     KeyType domainEnd   = domainTree.codeStart(domainTree.toInternal(assignment.lastNodeIdx(myRank)));
 
-    auto crossFocusPairs = [domainStart, domainEnd, invThetaSq, &tree = domainTree, &box]
+    const TraversalOctree<KeyType>& traversalTree = domainTree.traversalTree();
+
+    if constexpr (std::is_same_v<MacTag, VectorMacTag>)
+    {
+        if (centers == nullptr) { throw std::runtime_error("findPeersMac: the vector MAC requires expansion centers\n"); }
+    }
+
+    auto crossFocusPairs = [domainStart, domainEnd, invThetaSq, &tree = traversalTree, &box, centers]
         (TreeNodeIndex a, TreeNodeIndex b)
     {
       bool aFocusOverlap = overlapTwoRanges(domainStart, domainEnd, tree.codeStart(a), tree.codeEnd(a));
@@ -72,46 +95,74 @@ std::vector<int> findPeersMac(int myRank, const SpaceCurveAssignment& assignment
       // node a has to overlap/be contained in the focus, while b must not be inside it
       if (!aFocusOverlap || bInFocus) { return false; }
 
-      IBox aBox = makeIBox(tree.codeStart(a), tree.codeEnd(a));
-      IBox bBox = makeIBox(tree.codeStart(b), tree.codeEnd(b));
-      return !minDistanceMacMutual<KeyType>(aBox, bBox, box, invThetaSq);
+      IBox aBox = makeIBox<KeyType, SfcKind>(tree.codeStart(a), tree.codeEnd(a));
+      IBox bBox = makeIBox<KeyType, SfcKind>(tree.codeStart(b), tree.codeEnd(b));
+      if constexpr (std::is_same_v<MacTag, VectorMacTag>)
+      {
+          return !vectorMacMutual<KeyType>(centers[tree.octreeIndex(a)], aBox, centers[tree.octreeIndex(b)], bBox,
+                                           box, invThetaSq);
+      }
+      else { return !minDistanceMacMutual<KeyType>(aBox, bBox, box, invThetaSq); }
     };
 
-    auto m2l = [](TreeNodeIndex a, TreeNodeIndex b) {};
+    auto m2l = [](TreeNodeIndex, TreeNodeIndex) {};
 
-    TreeNodeIndex numInternalNodes = domainTree.numInternalNodes();
-    std::vector<int> peerRanks(assignment.numRanks(), 0);
-    auto p2p = [numInternalNodes, &assignment, &peerRanks](TreeNodeIndex a, TreeNodeIndex b)
+    int numThreads = 1;
+#ifdef _OPENMP
+    numThreads = omp_get_max_threads();
+#endif
+
+    // one peer flag array per thread, p2p is called concurrently from the traversal tasks
+    int numRanks = assignment.numRanks();
+    std::vector<char> threadPeers(numThreads * numRanks, 0);
+    auto p2p = [&tree = traversalTree, &assignment, &threadPeers, numRanks](TreeNodeIndex, TreeNodeIndex b)
     {
-        int peerRank = assignment.findRank(b - numInternalNodes);
-        if (peerRanks[peerRank] == 0) { peerRanks[peerRank] = 1; }
+#ifdef _OPENMP
+        int tid = omp_get_thread_num();
+#else
+        int tid = 0;
+#endif
+        int peerRank = assignment.findRank(tree.toLeaf(b));
+        threadPeers[tid * numRanks + peerRank] = 1;
     };
 
     std::vector<KeyType> spanningNodeKeys(spanSfcRange(domainStart, domainEnd) + 1);
     spanSfcRange(domainStart, domainEnd, spanningNodeKeys.data());
     spanningNodeKeys.back() = domainEnd;
 
-    #pragma omp parallel for schedule(dynamic)
-    for (TreeNodeIndex i = 0; i < spanningNodeKeys.size() - 1; ++i)
+    #pragma omp parallel num_threads(numThreads)
     {
-        TreeNodeIndex nodeIdx = domainTree.locate(spanningNodeKeys[i], spanningNodeKeys[i+1]);
-        dualTraversal(domainTree, nodeIdx, 0, crossFocusPairs, m2l, p2p);
+        #pragma omp single
+        for (TreeNodeIndex i = 0; i < TreeNodeIndex(spanningNodeKeys.size() - 1); ++i)
+        {
+            #pragma omp task default(shared) firstprivate(i)
+            {
+                TreeNodeIndex nodeIdx = traversalTree.locate(spanningNodeKeys[i], spanningNodeKeys[i + 1]);
+                dualTraversalTasks(traversalTree, nodeIdx, 0, crossFocusPairs, m2l, p2p);
+            }
+        }
     }
 
     std::vector<int> ret;
-    for (int i = 0; i < peerRanks.size(); ++i)
+    for (int i = 0; i < numRanks; ++i)
     {
-        if (peerRanks[i]) { ret.push_back(i); }
+        bool isPeer = false;
+        for (int t = 0; t < numThreads; ++t)
+        {
+            isPeer = isPeer || threadPeers[t * numRanks + i];
+        }
+        if (isPeer) { ret.push_back(i); }
     }
 
     return ret;
 }
 
 //! @brief Args identical to findPeersMac, but implemented with single tree traversal for comparison
-template<class T, class KeyType>
+template<class T, class KeyType, class SfcKind = KeyType>
 std::vector<int> findPeersMacStt(int myRank, const SpaceCurveAssignment& assignment, const Octree<KeyType>& octree,
                                  const Box<T>& box, float theta)
 {
+    CSTONE_TRACE_RANGE("findPeersMacStt");
     float invThetaSq = 1.0f / (theta * theta);
     KeyType domainStart = octree.codeStart(octree.toInternal(assignment.firstNodeIdx(myRank)));
     KeyType domainEnd   = octree.codeStart(octree.toInternal(assignment.lastNodeIdx(myRank)));
@@ -121,7 +172,8 @@ std::vector<int> findPeersMacStt(int myRank, const SpaceCurveAssignment& assignm
     #pragma omp parallel for
     for (TreeNodeIndex i = assignment.firstNodeIdx(myRank); i < assignment.lastNodeIdx(myRank); ++i)
     {
-        IBox target = makeIBox(octree.codeStart(octree.toInternal(i)), octree.codeEnd(octree.toInternal(i)));
+        IBox target = makeIBox<KeyType, SfcKind>(octree.codeStart(octree.toInternal(i)),
+                                                 octree.codeEnd(octree.toInternal(i)));
 
         auto violatesMac = [target, &octree, &box, invThetaSq, domainStart, domainEnd](TreeNodeIndex idx)
         {
@@ -130,7 +182,7 @@ std::vector<int> findPeersMacStt(int myRank, const SpaceCurveAssignment& assignm
             // if the tree node with index idx is fully contained in the focus, we stop traversal
             if (containedIn(nodeStart, nodeEnd, domainStart, domainEnd)) { return false; }
 
-            IBox sourceBox = makeIBox(nodeStart, nodeEnd);
+            IBox sourceBox = makeIBox<KeyType, SfcKind>(nodeStart, nodeEnd);
             return !minDistanceMacMutual<KeyType>(target, sourceBox, box, invThetaSq);
         };
 
@@ -152,4 +204,90 @@ std::vector<int> findPeersMacStt(int myRank, const SpaceCurveAssignment& assignm
     return ret;
 }
 
-} // namespace cstone
\ No newline at end of file
+/*! @brief computes peer ranks with findPeersMac and returns the previous result if it is still valid
+ *
+ * @tparam T            float or double
+ * @tparam KeyType      32- or 64-bit unsigned integer
+ * @tparam SfcKind      SFC used to construct the octree of the global leaves, see sfc.hpp
+ *
+ * The peers only depend on the global tree leaves, on the node index ranges of the assignment,
+ * on the bounding box and on the opening parameter. If all of them are unchanged, which is the case if only
+ * the node counts of the global tree changed since the previous call, the previous peers are returned without
+ * a traversal. The octree of the global leaves is only rebuilt if the leaves changed.
+ */
+template<class T, class KeyType, class SfcKind = KeyType>
+class PeerCache
+{
+public:
+    /*! @brief return the peer ranks of @p myRank, arguments as in findPeersMac
+     *
+     * @param myRank        find peers for the globally assigned SFC segment with index myRank
+     * @param assignment    Decomposition of the global SFC into segments
+     * @param globalLeaves  global cornerstone leaves
+     * @param box           global coordinate bounding box
+     * @param theta         MAC opening parameter
+     */
+    const std::vector<int>& peers(int myRank, const SpaceCurveAssignment& assignment,
+                                  gsl::span<const KeyType> globalLeaves, const Box<T>& box, float theta)
+    {
+        bool sameLeaves = leaves_.size() == globalLeaves.size() &&
+                          std::equal(globalLeaves.begin(), globalLeaves.end(), leaves_.begin());
+
+        reused_ = valid_ && sameLeaves && myRank == myRank_ && theta == theta_ && box == box_ &&
+                  sameRanges(assignment);
+        if (reused_) { return peers_; }
+
+        if (!sameLeaves)
+        {
+            leaves_.assign(globalLeaves.begin(), globalLeaves.end());
+            domainTree_.update(leaves_.begin(), leaves_.end());
+        }
+        peers_ = findPeersMac<T, KeyType, SfcKind>(myRank, assignment, domainTree_, box, theta);
+
+        myRank_ = myRank;
+        theta_  = theta;
+        box_    = box;
+        ranges_.resize(assignment.numRanks());
+        for (int rank = 0; rank < assignment.numRanks(); ++rank)
+        {
+            ranges_[rank] = {assignment.firstNodeIdx(rank), assignment.lastNodeIdx(rank)};
+        }
+        valid_ = true;
+
+        return peers_;
+    }
+
+    //! @brief true if the last call of peers() returned the peers of the call before without a traversal
+    [[nodiscard]] bool reused() const { return reused_; }
+
+    //! @brief the octree of the global leaves of the last call of peers()
+    const Octree<KeyType>& domainTree() const { return domainTree_; }
+
+private:
+    //! @brief compare node index ranges of all ranks, but not the particle counts
+    bool sameRanges(const SpaceCurveAssignment& assignment) const
+    {
+        if (int(ranges_.size()) != assignment.numRanks()) { return false; }
+        for (int rank = 0; rank < assignment.numRanks(); ++rank)
+        {
+            if (ranges_[rank].start() != assignment.firstNodeIdx(rank) ||
+                ranges_[rank].end() != assignment.lastNodeIdx(rank))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool valid_{false};
+    bool reused_{false};
+    int myRank_{0};
+    float theta_{0};
+    Box<T> box_{0, 1};
+    std::vector<IndexPair<TreeNodeIndex>> ranges_;
+    std::vector<KeyType> leaves_;
+    Octree<KeyType> domainTree_;
+    std::vector<int> peers_;
+};
+
+} // namespace cstone
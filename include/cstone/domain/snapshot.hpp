@@ -0,0 +1,247 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Collective particle snapshots in SFC order with MPI-IO
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * File layout:
+ *   - uint64: size of the header in bytes
+ *   - header, serialized with StateWriter: key size, coordinate size, global particle count, bounding box,
+ *     global tree leaves, global leaf counts and the element size of each particle field
+ *   - the particle fields one after the other, each holding all particles in SFC order
+ *
+ * Since the ranks hold contiguous SFC ranges in rank order, the file offset of the particles of each rank
+ * is the exclusive scan of the assigned particle counts and each rank writes and reads a single
+ * contiguous block per field.
+ */
+
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include "cstone/domain/checkpoint.hpp"
+#include "cstone/domain/domaindecomp.hpp"
+#include "cstone/sfc/box.hpp"
+
+namespace cstone
+{
+
+namespace detail
+{
+
+//! @brief collectively write or read @p numElements elements of size @p elementSize at byte offset @p offset
+template<class IoFunction>
+void accessSnapshotBlock(MPI_File file, MPI_Offset offset, void* data, std::size_t numElements,
+                         std::size_t elementSize, IoFunction&& io)
+{
+    if (numElements > std::size_t(INT_MAX)) { throw std::runtime_error("snapshot block exceeds 2^31 elements\n"); }
+
+    MPI_Datatype elementType;
+    MPI_Type_contiguous(int(elementSize), MPI_BYTE, &elementType);
+    MPI_Type_commit(&elementType);
+    io(file, offset, data, int(numElements), elementType, MPI_STATUS_IGNORE);
+    MPI_Type_free(&elementType);
+}
+
+} // namespace detail
+
+/*! @brief collectively write the particles [first:last) of each rank into a snapshot file in SFC order
+ *
+ * @param comm        the ranks that write the snapshot, e.g. Domain::comm()
+ * @param filename    output file, existing content is overwritten
+ * @param box         global coordinate bounding box
+ * @param tree        global cornerstone tree leaves, identical on all ranks
+ * @param nodeCounts  global particle counts per leaf of @p tree, identical on all ranks
+ * @param first       first particle to write, e.g. Domain::startIndex()
+ * @param last        one past the last particle to write, e.g. Domain::endIndex()
+ * @param arrays      particle fields, e.g. x, y, z, h, followed by particle properties
+ *
+ * The ranges [first:last) of all ranks have to be contiguous SFC ranges in rank order, as is the case
+ * for the assigned particles after a sync.
+ */
+template<class T, class KeyType, class... Arrays>
+void writeSnapshot(MPI_Comm comm, const std::string& filename, const Box<T>& box, const std::vector<KeyType>& tree,
+                   const std::vector<unsigned>& nodeCounts, std::size_t first, std::size_t last,
+                   const Arrays&... arrays)
+{
+    uint64_t numLocal  = last - first;
+    uint64_t offset    = 0;
+    uint64_t numGlobal = 0;
+    MPI_Exscan(&numLocal, &offset, 1, MPI_UINT64_T, MPI_SUM, comm);
+    MPI_Allreduce(&numLocal, &numGlobal, 1, MPI_UINT64_T, MPI_SUM, comm);
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    // MPI_Exscan leaves the result of the first rank undefined
+    if (rank == 0) { offset = 0; }
+
+    std::vector<uint32_t> elementSizes{uint32_t(sizeof(typename Arrays::value_type))...};
+
+    StateWriter writer;
+    writer.write(uint32_t(sizeof(KeyType)));
+    writer.write(uint32_t(sizeof(T)));
+    writer.write(numGlobal);
+    writer.write(box);
+    writer.write(tree);
+    writer.write(nodeCounts);
+    writer.write(elementSizes);
+    uint64_t headerBytes = writer.bytes().size();
+
+    MPI_File file;
+    int err = MPI_File_open(comm, filename.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                            &file);
+    if (err != MPI_SUCCESS) { throw std::runtime_error("could not open " + filename + " for writing\n"); }
+    MPI_File_set_size(file, 0);
+
+    int numSizeBytes   = rank == 0 ? int(sizeof(uint64_t)) : 0;
+    int numHeaderBytes = rank == 0 ? int(headerBytes) : 0;
+    MPI_File_write_at_all(file, 0, &headerBytes, numSizeBytes, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_write_at_all(file, sizeof(uint64_t), writer.bytes().data(), numHeaderBytes, MPI_BYTE,
+                          MPI_STATUS_IGNORE);
+
+    MPI_Offset fieldStart = sizeof(uint64_t) + headerBytes;
+    auto writeField = [&](const auto& array)
+    {
+        using V = typename std::decay_t<decltype(array)>::value_type;
+        detail::accessSnapshotBlock(file, fieldStart + offset * sizeof(V), const_cast<V*>(array.data() + first),
+                                    numLocal, sizeof(V), MPI_File_write_at_all);
+        fieldStart += numGlobal * sizeof(V);
+    };
+    (writeField(arrays), ...);
+
+    MPI_File_close(&file);
+}
+
+//! @brief writeSnapshot by all ranks of MPI_COMM_WORLD
+template<class T, class KeyType, class... Arrays>
+void writeSnapshot(const std::string& filename, const Box<T>& box, const std::vector<KeyType>& tree,
+                   const std::vector<unsigned>& nodeCounts, std::size_t first, std::size_t last,
+                   const Arrays&... arrays)
+{
+    writeSnapshot(MPI_COMM_WORLD, filename, box, tree, nodeCounts, first, last, arrays...);
+}
+
+/*! @brief collectively read a snapshot written by writeSnapshot
+ *
+ * @param[in]  comm        the ranks that read the snapshot
+ * @param[in]  filename    snapshot file
+ * @param[out] box         global coordinate bounding box
+ * @param[out] tree        global cornerstone tree leaves
+ * @param[out] nodeCounts  global particle counts per leaf of @p tree
+ * @param[out] arrays      particle fields in the same order and with the same types as when written,
+ *                         resized to the number of particles read by the executing rank
+ *
+ * The stored tree is split into contiguous SFC ranges with singleRangeSfcSplit and each rank reads the particles
+ * of its range, in SFC order. The number of ranks may differ from the one that wrote the snapshot.
+ */
+template<class T, class KeyType, class... Arrays>
+void readSnapshot(MPI_Comm comm, const std::string& filename, Box<T>& box, std::vector<KeyType>& tree,
+                  std::vector<unsigned>& nodeCounts, Arrays&... arrays)
+{
+    int rank, numRanks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numRanks);
+
+    MPI_File file;
+    int err = MPI_File_open(comm, filename.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file);
+    if (err != MPI_SUCCESS) { throw std::runtime_error("could not open " + filename + " for reading\n"); }
+
+    uint64_t headerBytes = 0;
+    MPI_File_read_at_all(file, 0, &headerBytes, sizeof(uint64_t), MPI_BYTE, MPI_STATUS_IGNORE);
+    if (headerBytes > uint64_t(INT_MAX))
+    {
+        MPI_File_close(&file);
+        throw std::runtime_error(filename + " is not a valid snapshot\n");
+    }
+    std::vector<char> header(headerBytes);
+    MPI_File_read_at_all(file, sizeof(uint64_t), header.data(), int(headerBytes), MPI_BYTE, MPI_STATUS_IGNORE);
+
+    uint64_t numGlobal;
+    std::vector<uint32_t> elementSizes;
+    try
+    {
+        StateReader reader(header);
+        reader.expect(uint32_t(sizeof(KeyType)), "SFC key type");
+        reader.expect(uint32_t(sizeof(T)), "coordinate type");
+        reader.read(numGlobal);
+        reader.read(box);
+        reader.read(tree);
+        reader.read(nodeCounts);
+        reader.read(elementSizes);
+        if (elementSizes != std::vector<uint32_t>{uint32_t(sizeof(typename Arrays::value_type))...})
+        {
+            throw std::runtime_error("snapshot fields differ from the requested arrays\n");
+        }
+        if (std::accumulate(nodeCounts.begin(), nodeCounts.end(), uint64_t(0)) != numGlobal)
+        {
+            throw std::runtime_error("snapshot tree counts do not match the number of particles\n");
+        }
+    }
+    catch (...)
+    {
+        MPI_File_close(&file);
+        throw;
+    }
+
+    SpaceCurveAssignment assignment = singleRangeSfcSplit(nodeCounts, numRanks);
+    uint64_t offset = 0;
+    for (int i = 0; i < rank; ++i)
+    {
+        offset += assignment.totalCount(i);
+    }
+    uint64_t numLocal = assignment.totalCount(rank);
+
+    MPI_Offset fieldStart = sizeof(uint64_t) + headerBytes;
+    auto readField = [&](auto& array)
+    {
+        using V = typename std::decay_t<decltype(array)>::value_type;
+        array.resize(numLocal);
+        detail::accessSnapshotBlock(file, fieldStart + offset * sizeof(V), array.data(), numLocal, sizeof(V),
+                                    MPI_File_read_at_all);
+        fieldStart += numGlobal * sizeof(V);
+    };
+    (readField(arrays), ...);
+
+    MPI_File_close(&file);
+}
+
+//! @brief readSnapshot by all ranks of MPI_COMM_WORLD
+template<class T, class KeyType, class... Arrays>
+void readSnapshot(const std::string& filename, Box<T>& box, std::vector<KeyType>& tree,
+                  std::vector<unsigned>& nodeCounts, Arrays&... arrays)
+{
+    readSnapshot(MPI_COMM_WORLD, filename, box, tree, nodeCounts, arrays...);
+}
+
+} // namespace cstone
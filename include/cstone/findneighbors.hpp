@@ -35,7 +35,7 @@
 #include <cmath>
 
 #include "cstone/primitives/stl.hpp"
-#include "cstone/sfc/morton.hpp"
+#include "cstone/sfc/sfc.hpp"
 
 namespace cstone
 {
@@ -44,9 +44,9 @@ namespace cstone
  *
  * Note that if box.pbc{X,Y,Z} is false, the result is identical to distancesq below.
  */
-template<class T>
+template<class T, class BoxType = Box<T>>
 CUDA_HOST_DEVICE_FUN
-constexpr T distanceSqPbc(T x1, T y1, T z1, T x2, T y2, T z2, const Box<T>& box)
+constexpr T distanceSqPbc(T x1, T y1, T z1, T x2, T y2, T z2, const BoxType& box)
 {
     T dx = x1 - x2;
     T dy = y1 - y2;
@@ -112,9 +112,9 @@ inline void storeCode(bool pbc, int* iNonPbc, int* iPbc, KeyType code, KeyType*
  * This function only adds a neighbor box if the sphere (xi,yi,zi)+-radius actually overlaps
  * with said box, which means that there are 26 different overlap checks.
  */
-template<class T, class KeyType>
+template<class T, class KeyType, class SfcKind = KeyType, class BoxType = Box<T>>
 CUDA_HOST_DEVICE_FUN
-pair<int> findNeighborBoxes(T xi, T yi, T zi, T radius, const Box<T>& bbox, KeyType* nCodes)
+pair<int> findNeighborBoxes(T xi, T yi, T zi, T radius, const BoxType& bbox, KeyType* nCodes)
 {
     constexpr int maxCoord = 1u<<maxTreeLevel<KeyType>{};
     // smallest octree cell edge length in unit cube
@@ -124,12 +124,13 @@ pair<int> findNeighborBoxes(T xi, T yi, T zi, T radius, const Box<T>& bbox, KeyT
 
     // level is the smallest tree subdivision level at which the node edge length is still bigger than radius
     unsigned level = radiusToTreeLevel(radius, bbox.minExtent());
-    KeyType xyzCode = morton3D<KeyType>(xi, yi, zi, bbox);
+    KeyType xyzCode = sfc3D<SfcKind>(xi, yi, zi, bbox);
     KeyType boxCode = enclosingBoxCode(xyzCode, level);
 
-    int ixBox = idecodeMortonX(boxCode);
-    int iyBox = idecodeMortonY(boxCode);
-    int izBox = idecodeMortonZ(boxCode);
+    IBox homeBox = sfcIBox<SfcKind>(boxCode, 3 * level);
+    int ixBox    = homeBox.xmin();
+    int iyBox    = homeBox.ymin();
+    int izBox    = homeBox.zmin();
     T xBox = bbox.xmin() + ixBox * uL * bbox.lx();
     T yBox = bbox.ymin() + iyBox * uL * bbox.ly();
     T zBox = bbox.zmin() + izBox * uL * bbox.lz();
@@ -172,66 +173,66 @@ pair<int> findNeighborBoxes(T xi, T yi, T zi, T radius, const Box<T>& bbox, KeyT
 
     // X,Y,Z face touch
     if (dx0 < radiusSq && stepXdown)
-        storeCode(hxd, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level, -1, 0, 0), nCodes);
+        storeCode(hxd, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level, -1, 0, 0), nCodes);
     if (dx1 < radiusSq && stepXup)
-        storeCode(hxu, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level,  1, 0, 0), nCodes);
+        storeCode(hxu, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level,  1, 0, 0), nCodes);
     if (dy0 < radiusSq && stepYdown)
-        storeCode(hyd, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level, 0, -1, 0), nCodes);
+        storeCode(hyd, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level, 0, -1, 0), nCodes);
     if (dy1 < radiusSq && stepYup)
-        storeCode(hyu, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level, 0,  1, 0), nCodes);
+        storeCode(hyu, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level, 0,  1, 0), nCodes);
     if (dz0 < radiusSq && stepZdown)
-        storeCode(hzd, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level, 0, 0, -1), nCodes);
+        storeCode(hzd, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level, 0, 0, -1), nCodes);
     if (dz1 < radiusSq && stepZup)
-        storeCode(hzu, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level, 0, 0, 1), nCodes);
+        storeCode(hzu, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level, 0, 0, 1), nCodes);
 
     // XY edge touch
     if (dx0 + dy0 < radiusSq && stepXdown && stepYdown)
-        storeCode(hxd || hyd, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level, -1, -1, 0), nCodes);
+        storeCode(hxd || hyd, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level, -1, -1, 0), nCodes);
     if (dx0 + dy1 < radiusSq && stepXdown && stepYup)
-        storeCode(hxd || hyu, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level, -1,  1, 0), nCodes);
+        storeCode(hxd || hyu, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level, -1,  1, 0), nCodes);
     if (dx1 + dy0 < radiusSq && stepXup && stepYdown)
-        storeCode(hxu || hyd, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level,  1, -1, 0), nCodes);
+        storeCode(hxu || hyd, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level,  1, -1, 0), nCodes);
     if (dx1 + dy1 < radiusSq && stepXup && stepYup)
-        storeCode(hxu || hyu, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level,  1,  1, 0), nCodes);
+        storeCode(hxu || hyu, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level,  1,  1, 0), nCodes);
 
     // XZ edge touch
     if (dx0 + dz0 < radiusSq && stepXdown && stepZdown)
-        storeCode(hxd || hzd, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level, -1, 0, -1), nCodes);
+        storeCode(hxd || hzd, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level, -1, 0, -1), nCodes);
     if (dx0 + dz1 < radiusSq && stepXdown && stepZup)
-        storeCode(hxd || hzu, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level, -1,  0, 1), nCodes);
+        storeCode(hxd || hzu, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level, -1,  0, 1), nCodes);
     if (dx1 + dz0 < radiusSq && stepXup && stepZdown)
-        storeCode(hxu || hzd, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level,  1, 0, -1), nCodes);
+        storeCode(hxu || hzd, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level,  1, 0, -1), nCodes);
     if (dx1 + dz1 < radiusSq && stepXup && stepZup)
-        storeCode(hxu || hzu, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level,  1,  0, 1), nCodes);
+        storeCode(hxu || hzu, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level,  1,  0, 1), nCodes);
 
     // YZ edge touch
     if (dy0 + dz0 < radiusSq && stepYdown && stepZdown)
-        storeCode(hyd || hzd, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level, 0, -1, -1), nCodes);
+        storeCode(hyd || hzd, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level, 0, -1, -1), nCodes);
     if (dy0 + dz1 < radiusSq && stepYdown && stepZup)
-        storeCode(hyd || hzu, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level,  0, -1, 1), nCodes);
+        storeCode(hyd || hzu, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level,  0, -1, 1), nCodes);
     if (dy1 + dz0 < radiusSq && stepYup && stepZdown)
-        storeCode(hyu || hzd, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level,  0, 1, -1), nCodes);
+        storeCode(hyu || hzd, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level,  0, 1, -1), nCodes);
     if (dy1 + dz1 < radiusSq && stepYup && stepZup)
-        storeCode(hyu || hzu, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level,  0,  1, 1), nCodes);
+        storeCode(hyu || hzu, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level,  0,  1, 1), nCodes);
 
     // corner touches
     if (dx0 + dy0 + dz0 < radiusSq && stepXdown && stepYdown && stepZdown)
-        storeCode(hxd || hyd || hzd, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level, -1, -1, -1), nCodes);
+        storeCode(hxd || hyd || hzd, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level, -1, -1, -1), nCodes);
     if (dx0 + dy0 + dz1 < radiusSq && stepXdown && stepYdown && stepZup)
-        storeCode(hxd || hyd || hzu, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level, -1, -1,  1), nCodes);
+        storeCode(hxd || hyd || hzu, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level, -1, -1,  1), nCodes);
     if (dx0 + dy1 + dz0 < radiusSq && stepXdown && stepYup && stepZdown)
-        storeCode(hxd || hyu || hzd, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level, -1,  1, -1), nCodes);
+        storeCode(hxd || hyu || hzd, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level, -1,  1, -1), nCodes);
     if (dx0 + dy1 + dz1 < radiusSq && stepXdown && stepYup && stepZup)
-        storeCode(hxd || hyu || hzu, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level, -1,  1,  1), nCodes);
+        storeCode(hxd || hyu || hzu, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level, -1,  1,  1), nCodes);
 
     if (dx1 + dy0 + dz0 < radiusSq && stepXup && stepYdown && stepZdown)
-        storeCode(hxu || hyd || hzd, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level,  1, -1, -1), nCodes);
+        storeCode(hxu || hyd || hzd, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level,  1, -1, -1), nCodes);
     if (dx1 + dy0 + dz1 < radiusSq && stepXup && stepYdown && stepZup)
-        storeCode(hxu || hyd || hzu, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level,  1, -1,  1), nCodes);
+        storeCode(hxu || hyd || hzu, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level,  1, -1,  1), nCodes);
     if (dx1 + dy1 + dz0 < radiusSq && stepXup && stepYup && stepZdown)
-        storeCode(hxu || hyu || hzd, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level,  1,  1, -1), nCodes);
+        storeCode(hxu || hyu || hzd, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level,  1,  1, -1), nCodes);
     if (dx1 + dy1 + dz1 < radiusSq && stepXup && stepYup && stepZup)
-        storeCode(hxu || hyu || hzu, &nBoxes, &iBoxPbc, mortonNeighbor(boxCode, level,  1,  1,  1), nCodes);
+        storeCode(hxu || hyu || hzu, &nBoxes, &iBoxPbc, sfcNeighbor<SfcKind>(boxCode, level,  1,  1,  1), nCodes);
 
     return pair<int>(nBoxes, iBoxPbc);
 }
@@ -254,13 +255,13 @@ pair<int> findNeighborBoxes(T xi, T yi, T zi, T radius, const Box<T>& bbox, KeyT
  * return in the PBC-enabled part of @p nCodes, such that distanceSqPbc will be used to
  * calculate distances.
  */
-template<class T, class KeyType>
+template<class T, class KeyType, class SfcKind = KeyType>
 CUDA_HOST_DEVICE_FUN
 pair<int> findNeighborBoxesSimple(T xi, T yi, T zi, T radius, const Box<T>& bbox, KeyType* nCodes)
 {
     // level is the smallest tree subdivision level at which the node edge length is still bigger than radius
     unsigned level = radiusToTreeLevel(radius, bbox.minExtent());
-    KeyType xyzCode = morton3D<KeyType>(xi, yi, zi, bbox);
+    KeyType xyzCode = sfc3D<SfcKind>(xi, yi, zi, bbox);
     KeyType boxCode = enclosingBoxCode(xyzCode, level);
 
     int ibox = 27;
@@ -268,7 +269,7 @@ pair<int> findNeighborBoxesSimple(T xi, T yi, T zi, T radius, const Box<T>& bbox
         for (int dy = -1; dy < 2; ++dy)
             for (int dz = -1; dz < 2; ++dz)
             {
-                KeyType searchBoxCode = mortonNeighbor(boxCode, level, dx, dy, dz);
+                KeyType searchBoxCode = sfcNeighbor<SfcKind>(boxCode, level, dx, dy, dz);
                 bool alreadyThere = false;
                 for (int i = ibox; i < 27; ++i)
                 {
@@ -283,38 +284,145 @@ pair<int> findNeighborBoxesSimple(T xi, T yi, T zi, T radius, const Box<T>& bbox
     return {0, ibox};
 }
 
-template<class KeyType, class T, class F>
+//! @brief number of candidates whose distances are computed together in visitBoxes
+constexpr int neighborBatchSize = 32;
+
+//! @brief visit the particles in [first:last] within a squared radius of (xi, yi, zi), see visitBoxes
+template<class T, class D, class F>
 CUDA_HOST_DEVICE_FUN
-void searchBoxes(const KeyType* nCodes, int firstBox, int lastBox, const KeyType* mortonCodes, int n, int depth, int id,
-                 const T* x, const T* y, const T* z, T radiusSq, int* neighbors, int* neighborsCount, int ngmax, F&& distance)
+bool visitRange(int first, int last, T xi, T yi, T zi, const T* x, const T* y, const T* z, T radiusSq,
+                D&& distance, F&& visit)
+{
+    // distances are evaluated branch-free in batches to allow vectorization, hits are compressed afterwards
+    for (int batchStart = first; batchStart < last; batchStart += neighborBatchSize)
+    {
+        int batchSize = stl::min(neighborBatchSize, last - batchStart);
+
+        bool hit[neighborBatchSize];
+        #pragma omp simd
+        for (int k = 0; k < batchSize; ++k)
+        {
+            int j  = batchStart + k;
+            hit[k] = distance(xi, yi, zi, x[j], y[j], z[j]) < radiusSq;
+        }
+
+        for (int k = 0; k < batchSize; ++k)
+        {
+            if (hit[k] && !visit(batchStart + k)) { return false; }
+        }
+    }
+    return true;
+}
+
+/*! @brief visit all particles within a squared radius of particle @p id that lie in the given neighbor boxes
+ *
+ * @param[in] excludeFirst  candidates in [excludeFirst:id+1] are skipped, equal to @p id to only skip @p id itself
+ * @param[in] visit         callable with signature bool(int j), called with each neighbor j of @p id,
+ *                          the search is aborted if it returns false
+ * @return                  false if the search was aborted by @p visit
+ */
+template<class KeyType, class T, class D, class F>
+CUDA_HOST_DEVICE_FUN
+bool visitBoxes(const KeyType* nCodes, int firstBox, int lastBox, const KeyType* mortonCodes, int n, int depth,
+                int id, int excludeFirst, const T* x, const T* y, const T* z, T radiusSq, D&& distance, F&& visit)
 {
     T xi = x[id];
     T yi = y[id];
     T zi = z[id];
 
-    int ngcount = *neighborsCount;
     for (int ibox = firstBox; ibox < lastBox; ++ibox)
     {
         KeyType neighbor = nCodes[ibox];
         int startIndex = stl::lower_bound(mortonCodes, mortonCodes + n, neighbor) - mortonCodes;
         int endIndex = stl::upper_bound(mortonCodes + startIndex, mortonCodes + n, neighbor + nodeRange<KeyType>(depth)) - mortonCodes;
 
-        for (int j = startIndex; j < endIndex; ++j)
-        {
-            if (j == id) { continue; }
+        bool completed =
+            visitRange(startIndex, stl::min(endIndex, excludeFirst), xi, yi, zi, x, y, z, radiusSq, distance, visit) &&
+            visitRange(stl::max(startIndex, id + 1), endIndex, xi, yi, zi, x, y, z, radiusSq, distance, visit);
+        if (!completed) { return false; }
+    }
+    return true;
+}
 
-            if (ngcount == ngmax)
-            {
-                *neighborsCount = ngmax;
-                return;
-            }
+template<class KeyType, class T, class F>
+CUDA_HOST_DEVICE_FUN
+void searchBoxes(const KeyType* nCodes, int firstBox, int lastBox, const KeyType* mortonCodes, int n, int depth, int id,
+                 const T* x, const T* y, const T* z, T radiusSq, int* neighbors, int* neighborsCount, int ngmax, F&& distance)
+{
+    int ngcount = *neighborsCount;
+    if (ngcount == ngmax) { return; }
+
+    auto store = [neighbors, ngmax, &ngcount](int j)
+    {
+        neighbors[ngcount++] = j;
+        return ngcount < ngmax;
+    };
+    visitBoxes(nCodes, firstBox, lastBox, mortonCodes, n, depth, id, id, x, y, z, radiusSq, distance, store);
 
-            if (distance(xi, yi, zi, x[j], y[j], z[j]) < radiusSq) { neighbors[ngcount++] = j; }
-        }
-    }
     *neighborsCount = ngcount;
 }
 
+/*! @brief visit the particles within @p radius of particle @p id, skipping those in [excludeFirst:id]
+ *
+ * @param[in] visit   callable with signature void(int j)
+ */
+template<class T, class KeyType, class SfcKind = KeyType, class F>
+CUDA_HOST_DEVICE_FUN
+void forEachNeighborInRadius(int id, int excludeFirst, T radius, const T* x, const T* y, const T* z,
+                             const Box<T>& box, const KeyType* mortonCodes, int n, F&& visit)
+{
+    T radiusSq     = radius * radius;
+    unsigned depth = radiusToTreeLevel(radius, box.minExtent());
+
+    KeyType neighborCodes[27];
+    pair<int> boxCodeIndices = findNeighborBoxes<T, KeyType, SfcKind>(x[id], y[id], z[id], radius, box, neighborCodes);
+
+    auto visitAll = [&visit](int j)
+    {
+        visit(j);
+        return true;
+    };
+
+    visitBoxes(neighborCodes, 0, boxCodeIndices[0], mortonCodes, n, depth, id, excludeFirst, x, y, z, radiusSq,
+               [](T xi, T yi, T zi, T xj, T yj, T zj) { return distancesq(xi, yi, zi, xj, yj, zj); }, visitAll);
+    visitBoxes(neighborCodes, boxCodeIndices[1], 27, mortonCodes, n, depth, id, excludeFirst, x, y, z, radiusSq,
+               [&box](T xi, T yi, T zi, T xj, T yj, T zj) { return distanceSqPbc(xi, yi, zi, xj, yj, zj, box); },
+               visitAll);
+}
+
+/*! @brief visit the neighbors of particle number @p id for a symmetric half neighbor list
+ *
+ * @param[in] firstId  first particle of the range [firstId:lastId] whose half lists are searched
+ * @param[in] visit    callable with signature void(int j), called with each neighbor j of @p id
+ *                     with j > id or j < firstId
+ *
+ * Neighbors in [firstId:id] are skipped without computing their distances. For particles i < j
+ * in [firstId:lastId], the pair is therefore only visited in the search of i. Neighbors outside the range, e.g.
+ * halos, are always visited, since the pair is not visited from their side. For a symmetric pair criterion,
+ * such as a uniform h, each local pair appears exactly once. See findNeighbors for the remaining arguments.
+ */
+template<class T, class KeyType, class SfcKind = KeyType, class F>
+CUDA_HOST_DEVICE_FUN
+void forEachHalfNeighbor(int id, int firstId, const T* x, const T* y, const T* z, const T* h, const Box<T>& box,
+                         const KeyType* mortonCodes, int n, F&& visit)
+{
+    forEachNeighborInRadius<T, KeyType, SfcKind>(id, stl::min(firstId, id), 2 * h[id], x, y, z, box, mortonCodes, n,
+                                                 visit);
+}
+
+/*! @brief visit all neighbors of particle number @p id within radius, without limit on their number
+ *
+ * @param[in] visit   callable with signature void(int j), called with each neighbor j of @p id
+ *
+ * See findNeighbors for a description of the remaining arguments.
+ */
+template<class T, class KeyType, class SfcKind = KeyType, class F>
+CUDA_HOST_DEVICE_FUN
+void forEachNeighbor(int id, const T* x, const T* y, const T* z, const T* h, const Box<T>& box,
+                     const KeyType* mortonCodes, int n, F&& visit)
+{
+    forEachHalfNeighbor<T, KeyType, SfcKind>(id, id, x, y, z, h, box, mortonCodes, n, visit);
+}
 
 /*! @brief findNeighbors of particle number @p id within radius
  *
@@ -327,6 +435,7 @@ void searchBoxes(const KeyType* nCodes, int firstBox, int lastBox, const KeyType
  *
  * @tparam T                   coordinate type, float or double
  * @tparam KeyType             Morton code type, uint32 uint64
+ * @tparam SfcKind             SFC used to compute @p mortonCodes, see sfc.hpp
  * @param[in]  id              the index of the particle for which to look for neighbors
  * @param[in]  x               particle x-coordinates in Morton order
  * @param[in]  y               particle y-coordinates in Morton order
@@ -338,8 +447,10 @@ void searchBoxes(const KeyType* nCodes, int firstBox, int lastBox, const KeyType
  * @param[out] neighborsCount  output to store the number of neighbors
  * @param[in]  n               number of particles in x,y,z
  * @param[in]  ngmax           maximum number of neighbors per particle
+ *
+ * The search is instantiated with the periodicity of @p box fixed at compile time, see dispatchPbc.
  */
-template<class T, class KeyType>
+template<class T, class KeyType, class SfcKind = KeyType>
 CUDA_HOST_DEVICE_FUN
 void findNeighbors(int id, const T* x, const T* y, const T* z, const T* h, const Box<T>& box,
                    const KeyType* mortonCodes, int *neighbors, int *neighborsCount,
@@ -355,23 +466,29 @@ void findNeighbors(int id, const T* x, const T* y, const T* z, const T* h, const
     // load coordinates for particle #id
     T xi = x[id], yi = y[id], zi = z[id];
 
-    KeyType neighborCodes[27];
-    pair<int> boxCodeIndices = findNeighborBoxes(xi, yi, zi, radius, box, neighborCodes);
-    //pair<int> boxCodeIndices = findNeighborBoxesSimple(xi, yi, zi, radius, box, neighborCodes);
-    int       nBoxes         = boxCodeIndices[0];
-    int       iBoxPbc        = boxCodeIndices[1];
+    auto search = [&](const auto& pbcBox)
+    {
+        KeyType neighborCodes[27];
+        pair<int> boxCodeIndices = findNeighborBoxes<T, KeyType, SfcKind>(xi, yi, zi, radius, pbcBox, neighborCodes);
+        //pair<int> boxCodeIndices = findNeighborBoxesSimple(xi, yi, zi, radius, box, neighborCodes);
+        int       nBoxes         = boxCodeIndices[0];
+        int       iBoxPbc        = boxCodeIndices[1];
+
+        *neighborsCount = 0;
 
-    *neighborsCount = 0;
+        // search non-PBC boxes
+        searchBoxes(neighborCodes, 0, nBoxes, mortonCodes, n, depth, id, x, y, z, radiusSq, neighbors, neighborsCount,
+                    ngmax, [](T xi, T yi, T zi, T xj, T yj, T zj) { return distancesq(xi, yi, zi, xj, yj, zj); });
 
-    // search non-PBC boxes
-    searchBoxes(neighborCodes, 0, nBoxes, mortonCodes, n, depth, id, x, y, z, radiusSq, neighbors, neighborsCount,
-                ngmax, [](T xi, T yi, T zi, T xj, T yj, T zj) { return distancesq(xi, yi, zi, xj, yj, zj); } );
+        if (*neighborsCount == ngmax) { return; }
 
-    if (*neighborsCount == ngmax) { return; }
+        // search PBC boxes
+        searchBoxes(neighborCodes, iBoxPbc, 27, mortonCodes, n, depth, id, x, y, z, radiusSq, neighbors,
+                    neighborsCount, ngmax, [&pbcBox](T xi, T yi, T zi, T xj, T yj, T zj)
+                    { return distanceSqPbc(xi, yi, zi, xj, yj, zj, pbcBox); });
+    };
 
-    // search PBC boxes
-    searchBoxes(neighborCodes, iBoxPbc, 27, mortonCodes, n, depth, id, x, y, z, radiusSq, neighbors, neighborsCount, ngmax,
-                [&box](T xi, T yi, T zi, T xj, T yj, T zj) { return distanceSqPbc(xi, yi, zi, xj, yj, zj, box); } );
+    dispatchPbc(box, search);
 }
 
 } // namespace cstone
@@ -0,0 +1,250 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Neighbor search driven by octree leaf cells
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "cstone/findneighbors.hpp"
+#include "cstone/halos/discovery.hpp"
+#include "cstone/tree/relative_coordinates.hpp"
+#include "cstone/util/tracing.hpp"
+
+namespace cstone
+{
+
+/*! @brief determine the leaves that may contain neighbors of the particles in a leaf
+ *
+ * @tparam T               coordinate type, float or double
+ * @tparam KeyType         32- or 64-bit unsigned integer
+ * @tparam SfcKind         SFC used to construct @p octree, see sfc.hpp
+ * @param[in]  octree      octree, including internal part
+ * @param[in]  leafIdx     the leaf to search candidates for
+ * @param[in]  radius      the maximum search radius of all particles in @p leafIdx
+ * @param[in]  box         coordinate bounding box
+ * @param[out] candidates  sorted indices of all leaves within @p radius of leaf @p leafIdx
+ * @return                 true if the candidates can only be reached across a periodic boundary
+ */
+template<class T, class KeyType, class SfcKind = KeyType>
+bool findCandidateLeaves(const Octree<KeyType>& octree, TreeNodeIndex leafIdx, T radius, const Box<T>& box,
+                         std::vector<TreeNodeIndex>& candidates)
+{
+    constexpr int maxCoord = 1u << maxTreeLevel<KeyType>{};
+
+    gsl::span<const KeyType> leaves = octree.treeLeaves();
+    IBox haloBox = makeHaloBox<T, T, KeyType, SfcKind>(leaves[leafIdx], leaves[leafIdx + 1], radius, box);
+
+    candidates.clear();
+    auto collect = [&candidates](TreeNodeIndex idx) { candidates.push_back(idx); };
+    findCollisions<KeyType, SfcKind>(octree, collect, haloBox, {KeyType(0), KeyType(0)});
+    std::sort(candidates.begin(), candidates.end());
+
+    return haloBox.xmin() < 0 || haloBox.xmax() > maxCoord || haloBox.ymin() < 0 || haloBox.ymax() > maxCoord ||
+           haloBox.zmin() < 0 || haloBox.zmax() > maxCoord;
+}
+
+/*! @brief determine the particle index ranges that may contain neighbors of the particles in a leaf
+ *
+ * @param[in]  layout      particle index offset of each leaf in @p octree, length numLeafNodes + 1
+ * @param[out] ranges      contiguous particle index ranges of all leaves within @p radius of leaf @p leafIdx,
+ *                         sorted and with adjacent ranges merged
+ * @return                 true if the candidates can only be reached across a periodic boundary
+ *
+ * See findCandidateLeaves for the remaining arguments.
+ */
+template<class T, class KeyType, class SfcKind = KeyType>
+bool findCandidateRanges(const Octree<KeyType>& octree, const LocalParticleIndex* layout, TreeNodeIndex leafIdx,
+                         T radius, const Box<T>& box, std::vector<pair<LocalParticleIndex>>& ranges)
+{
+    std::vector<TreeNodeIndex> candidates;
+    bool usePbc = findCandidateLeaves<T, KeyType, SfcKind>(octree, leafIdx, radius, box, candidates);
+
+    ranges.clear();
+    for (TreeNodeIndex idx : candidates)
+    {
+        if (layout[idx] == layout[idx + 1]) { continue; }
+
+        if (!ranges.empty() && ranges.back()[1] == layout[idx]) { ranges.back()[1] = layout[idx + 1]; }
+        else { ranges.emplace_back(layout[idx], layout[idx + 1]); }
+    }
+
+    return usePbc;
+}
+
+/*! @brief find neighbors of all particles in a range of octree leaves
+ *
+ * @tparam T                   coordinate type, float or double
+ * @tparam KeyType             32- or 64-bit unsigned integer
+ * @tparam SfcKind             SFC used to construct @p octree, see sfc.hpp
+ * @param[in]  octree          octree, including internal part, whose leaves map to the particle arrays
+ *                             through @p layout, e.g. the focused tree of a domain
+ * @param[in]  layout          particle index offset of each leaf in @p octree, length numLeafNodes + 1,
+ *                             see computeNodeLayout
+ * @param[in]  firstLeaf       first leaf with particles to search neighbors for
+ * @param[in]  lastLeaf        last leaf with particles to search neighbors for
+ * @param[in]  x               particle x-coordinates in SFC order
+ * @param[in]  y               particle y-coordinates in SFC order
+ * @param[in]  z               particle z-coordinates in SFC order
+ * @param[in]  h               smoothing lengths (1/2 the search radius) in SFC order
+ * @param[in]  box             coordinate bounding box that was used to calculate the SFC keys
+ * @param[out] neighbors       output to store the neighbors, particle i is stored at
+ *                             (i - layout[firstLeaf]) * ngmax
+ * @param[out] neighborsCount  output to store the number of neighbors, particle i is stored at i - layout[firstLeaf]
+ * @param[in]  ngmax           maximum number of neighbors per particle
+ *
+ * In contrast to findNeighbors, which locates up to 27 neighbor boxes per particle with two binary searches each
+ * over all SFC keys, the candidate particle ranges are determined once per leaf by a collision search of the leaf
+ * enlarged by the largest search radius of its particles. All particles in the leaf then share these ranges.
+ * The neighbors found are identical to those of findNeighbors, apart from their order and apart from
+ * which neighbors are kept if a particle has more than @p ngmax of them.
+ */
+template<class T, class KeyType, class SfcKind = KeyType>
+void findNeighborsCells(const Octree<KeyType>& octree, const LocalParticleIndex* layout, TreeNodeIndex firstLeaf,
+                        TreeNodeIndex lastLeaf, const T* x, const T* y, const T* z, const T* h, const Box<T>& box,
+                        int* neighbors, int* neighborsCount, int ngmax)
+{
+    CSTONE_TRACE_RANGE("findNeighborsCells");
+    LocalParticleIndex firstIndex = layout[firstLeaf];
+
+    #pragma omp parallel
+    {
+        std::vector<pair<LocalParticleIndex>> ranges;
+
+        #pragma omp for schedule(dynamic)
+        for (TreeNodeIndex leafIdx = firstLeaf; leafIdx < lastLeaf; ++leafIdx)
+        {
+            if (layout[leafIdx] == layout[leafIdx + 1]) { continue; }
+
+            // SPH convention is search radius = 2 * h
+            T radius = 2 * *std::max_element(h + layout[leafIdx], h + layout[leafIdx + 1]);
+            bool usePbc = findCandidateRanges<T, KeyType, SfcKind>(octree, layout, leafIdx, radius, box, ranges);
+
+            for (LocalParticleIndex i = layout[leafIdx]; i < layout[leafIdx + 1]; ++i)
+            {
+                T xi = x[i], yi = y[i], zi = z[i];
+                T radiusI  = 2 * h[i];
+                T radiusSq = radiusI * radiusI;
+
+                int* iNeighbors = neighbors + (i - firstIndex) * ngmax;
+                int ngcount     = 0;
+                for (const auto& range : ranges)
+                {
+                    for (LocalParticleIndex j = range[0]; j < range[1] && ngcount < ngmax; ++j)
+                    {
+                        if (j == i) { continue; }
+
+                        T d2 = usePbc ? distanceSqPbc(xi, yi, zi, x[j], y[j], z[j], box)
+                                      : distancesq(xi, yi, zi, x[j], y[j], z[j]);
+                        if (d2 < radiusSq) { iNeighbors[ngcount++] = j; }
+                    }
+                }
+                neighborsCount[i - firstIndex] = ngcount;
+            }
+        }
+    }
+}
+
+/*! @brief find neighbors of all particles in a range of octree leaves, reading the compact coordinate mirror
+ *
+ * @tparam OffsetType          float or uint16_t, see encodeCellOffset
+ * @param[in]  rx,ry,rz        particle offsets from their leaf corners, see computeCellRelativeCoordinates
+ *
+ * Same as findNeighborsCells, but candidate coordinates are read from the mirror instead of the full-precision
+ * coordinates. The separation of two particles is evaluated as the exact difference of their leaf corners plus
+ * the difference of their offsets. Particles whose distance differs from the search radius by less than the
+ * offset precision, i.e. 6e-8 (float) or 8e-6 (uint16_t) times the leaf edge length, may therefore be classified
+ * differently than by findNeighborsCells. See findNeighborsCells for the remaining arguments.
+ */
+template<class T, class KeyType, class SfcKind = KeyType, class OffsetType>
+void findNeighborsCellsRelative(const Octree<KeyType>& octree, const LocalParticleIndex* layout,
+                                TreeNodeIndex firstLeaf, TreeNodeIndex lastLeaf, const OffsetType* rx,
+                                const OffsetType* ry, const OffsetType* rz, const T* h, const Box<T>& box,
+                                int* neighbors, int* neighborsCount, int ngmax)
+{
+    CSTONE_TRACE_RANGE("findNeighborsCellsRelative");
+    LocalParticleIndex firstIndex   = layout[firstLeaf];
+    gsl::span<const KeyType> leaves = octree.treeLeaves();
+
+    #pragma omp parallel
+    {
+        std::vector<TreeNodeIndex> candidates;
+        std::vector<CellFrame<T>> shifts;
+
+        #pragma omp for schedule(dynamic)
+        for (TreeNodeIndex leafIdx = firstLeaf; leafIdx < lastLeaf; ++leafIdx)
+        {
+            if (layout[leafIdx] == layout[leafIdx + 1]) { continue; }
+
+            T radius    = 2 * *std::max_element(h + layout[leafIdx], h + layout[leafIdx + 1]);
+            bool usePbc = findCandidateLeaves<T, KeyType, SfcKind>(octree, leafIdx, radius, box, candidates);
+
+            IBox leafBox       = makeIBox<KeyType, SfcKind>(leaves[leafIdx], leaves[leafIdx + 1]);
+            CellFrame<T> frame = cellFrame<KeyType>(leafBox, box);
+            shifts.resize(candidates.size());
+            for (std::size_t c = 0; c < candidates.size(); ++c)
+            {
+                TreeNodeIndex idx = candidates[c];
+                shifts[c] = cellShift<KeyType>(leafBox, makeIBox<KeyType, SfcKind>(leaves[idx], leaves[idx + 1]), box);
+            }
+
+            for (LocalParticleIndex i = layout[leafIdx]; i < layout[leafIdx + 1]; ++i)
+            {
+                T xi = decodeCellOffset(rx[i], frame.lx);
+                T yi = decodeCellOffset(ry[i], frame.ly);
+                T zi = decodeCellOffset(rz[i], frame.lz);
+                T radiusI  = 2 * h[i];
+                T radiusSq = radiusI * radiusI;
+
+                int* iNeighbors = neighbors + (i - firstIndex) * ngmax;
+                int ngcount     = 0;
+                for (std::size_t c = 0; c < candidates.size(); ++c)
+                {
+                    const CellFrame<T>& s = shifts[c];
+                    TreeNodeIndex idx     = candidates[c];
+                    for (LocalParticleIndex j = layout[idx]; j < layout[idx + 1] && ngcount < ngmax; ++j)
+                    {
+                        if (j == i) { continue; }
+
+                        T dx = s.x + decodeCellOffset(rx[j], s.lx) - xi;
+                        T dy = s.y + decodeCellOffset(ry[j], s.ly) - yi;
+                        T dz = s.z + decodeCellOffset(rz[j], s.lz) - zi;
+                        T d2 = usePbc ? distanceSqPbc(dx, dy, dz, T(0), T(0), T(0), box) : dx * dx + dy * dy + dz * dz;
+                        if (d2 < radiusSq) { iNeighbors[ngcount++] = j; }
+                    }
+                }
+                neighborsCount[i - firstIndex] = ngcount;
+            }
+        }
+    }
+}
+
+} // namespace cstone
@@ -0,0 +1,283 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Neighbor search with neighbor lists in compressed sparse row (CSR) format
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "cstone/findneighbors.hpp"
+#include "cstone/primitives/scan.hpp"
+#include "cstone/util/tracing.hpp"
+
+namespace cstone
+{
+
+/*! @brief find the neighbors of particles [firstId:lastId] and store them in CSR format
+ *
+ * @tparam T                   coordinate type, float or double
+ * @tparam KeyType             32- or 64-bit unsigned integer
+ * @tparam SfcKind             SFC used to compute @p codes, see sfc.hpp
+ * @param[in]  firstId         first particle index in [0:n] for which to compute neighbors
+ * @param[in]  lastId          last particle index in [0:n] for which to compute neighbors
+ * @param[in]  x               particle x-coordinates in SFC order, length @p n
+ * @param[in]  y               particle y-coordinates in SFC order, length @p n
+ * @param[in]  z               particle z-coordinates in SFC order, length @p n
+ * @param[in]  h               smoothing lengths (1/2 the search radius) in SFC order, length @p n
+ * @param[in]  box             coordinate bounding box that was used to calculate @p codes
+ * @param[in]  codes           sorted SFC keys of all particles, length @p n
+ * @param[in]  n               number of particles in x,y,z,h
+ * @param[out] offsets         CSR offsets, length lastId - firstId + 1
+ * @param[out] neighbors       CSR neighbor indices, the neighbors of particle i are stored in
+ *                             neighbors[offsets[i - firstId]:offsets[i - firstId + 1]]
+ * @param[in]  halfList        if true, store symmetric half lists, in which neighbors j in [firstId:lastId]
+ *                             of particle i are only kept if j > i, see forEachHalfNeighbor
+ *
+ * In a first pass the neighbors of each particle are counted, the offsets are then obtained with an exclusive scan
+ * and the neighbors are stored in a second pass. In contrast to findNeighbors, there is no limit on the number
+ * of neighbors per particle and no memory is reserved for neighbors that are not present.
+ */
+template<class T, class KeyType, class SfcKind = KeyType>
+void findNeighborsCsr(int firstId, int lastId, const T* x, const T* y, const T* z, const T* h, const Box<T>& box,
+                      const KeyType* codes, int n, std::vector<std::size_t>& offsets, std::vector<int>& neighbors,
+                      bool halfList = false)
+{
+    CSTONE_TRACE_RANGE("findNeighborsCsr");
+    offsets.assign(lastId - firstId + 1, 0);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = firstId; i < lastId; ++i)
+    {
+        std::size_t count = 0;
+        forEachHalfNeighbor<T, KeyType, SfcKind>(i, halfList ? firstId : i, x, y, z, h, box, codes, n,
+                                                 [&count](int) { ++count; });
+        offsets[i - firstId] = count;
+    }
+
+    exclusiveScan(offsets.data(), offsets.size());
+    neighbors.resize(offsets.back());
+
+    #pragma omp parallel for schedule(static)
+    for (int i = firstId; i < lastId; ++i)
+    {
+        int* iNeighbors = neighbors.data() + offsets[i - firstId];
+        forEachHalfNeighbor<T, KeyType, SfcKind>(i, halfList ? firstId : i, x, y, z, h, box, codes, n,
+                                                 [&iNeighbors](int j) { *iNeighbors++ = j; });
+    }
+}
+
+/*! @brief adapt the smoothing lengths of particles [firstId:lastId] to a target neighbor count, find their neighbors
+ *
+ * @param[inout] h              smoothing lengths in SFC order, length @p n, elements [firstId:lastId] are updated
+ * @param[in]    targetCount    desired number of neighbors per particle
+ * @param[in]    tolerance      a particle is converged if its neighbor count differs by at most @p tolerance
+ *                              from @p targetCount
+ * @param[in]    maxIterations  maximum number of smoothing length updates per particle
+ * @param[out]   offsets        CSR offsets, length lastId - firstId + 1
+ * @param[out]   neighbors      CSR neighbors within 2 * h of each particle, with the updated h
+ * @return                      number of particles that did not converge within @p maxIterations
+ *
+ * The candidates of each particle are searched once with a radius enlarged by searchFactor. The smoothing length
+ * is then updated with h *= (1 + (targetCount / count)^(1/3)) / 2, where the neighbor count of each iteration is
+ * recomputed from the candidate distances. New candidates are only searched if the smoothing length grows beyond
+ * the searched radius. See findNeighborsCsr for a description of the remaining arguments.
+ */
+template<class T, class KeyType, class SfcKind = KeyType>
+int findNeighborsTargetCount(int firstId, int lastId, const T* x, const T* y, const T* z, T* h, const Box<T>& box,
+                             const KeyType* codes, int n, int targetCount, int tolerance, int maxIterations,
+                             std::vector<std::size_t>& offsets, std::vector<int>& neighbors)
+{
+    CSTONE_TRACE_RANGE("findNeighborsTargetCount");
+    // candidates are searched within searchFactor * 2h to leave room for growing h without a new search
+    constexpr T searchFactor = 1.25;
+    // the fill pass searches with a small margin such that it finds the same particles as the candidate search
+    constexpr T fillMargin = 1.001;
+
+    offsets.assign(lastId - firstId + 1, 0);
+    int numUnconverged = 0;
+
+    #pragma omp parallel reduction(+ : numUnconverged)
+    {
+        std::vector<T> candidateDistSq;
+
+        #pragma omp for schedule(dynamic, 64)
+        for (int i = firstId; i < lastId; ++i)
+        {
+            T hi           = h[i];
+            T searchRadius = 0;
+            std::size_t count = 0;
+
+            for (int iteration = 0;; ++iteration)
+            {
+                if (2 * hi > searchRadius)
+                {
+                    searchRadius = 2 * hi * searchFactor;
+                    candidateDistSq.clear();
+                    forEachNeighborInRadius<T, KeyType, SfcKind>(
+                        i, i, searchRadius, x, y, z, box, codes, n, [&](int j)
+                        { candidateDistSq.push_back(distanceSqPbc(x[i], y[i], z[i], x[j], y[j], z[j], box)); });
+                }
+
+                T radiusSq = 4 * hi * hi;
+                count = std::count_if(candidateDistSq.begin(), candidateDistSq.end(),
+                                      [radiusSq](T d2) { return d2 < radiusSq; });
+
+                if (std::abs(int(count) - targetCount) <= tolerance) { break; }
+                if (iteration + 1 >= maxIterations)
+                {
+                    numUnconverged++;
+                    break;
+                }
+
+                T ratio = T(targetCount) / T(std::max(count, std::size_t(1)));
+                hi *= T(0.5) * (T(1) + std::cbrt(ratio));
+            }
+
+            h[i] = hi;
+            offsets[i - firstId] = count;
+        }
+    }
+
+    exclusiveScan(offsets.data(), offsets.size());
+    neighbors.resize(offsets.back());
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int i = firstId; i < lastId; ++i)
+    {
+        T radiusSq      = 4 * h[i] * h[i];
+        int* iNeighbors = neighbors.data() + offsets[i - firstId];
+
+        // same distance criterion as in the iteration, such that the counts match
+        forEachNeighborInRadius<T, KeyType, SfcKind>(
+            i, i, 2 * h[i] * fillMargin, x, y, z, box, codes, n, [&](int j)
+            {
+                if (distanceSqPbc(x[i], y[i], z[i], x[j], y[j], z[j], box) < radiusSq) { *iNeighbors++ = j; }
+            });
+    }
+
+    return numUnconverged;
+}
+
+//! @brief marks a neighbor in a delta encoded list whose index is stored in full in the two subsequent entries
+constexpr int16_t neighborDeltaEscape = std::numeric_limits<int16_t>::min();
+
+//! @brief number of int16_t entries needed to store neighbor @p j of particle @p i in a delta encoded list
+inline int neighborDeltaSize(int i, int j)
+{
+    int delta = j - i;
+    return (delta > neighborDeltaEscape && delta <= std::numeric_limits<int16_t>::max()) ? 1 : 3;
+}
+
+//! @brief store neighbor @p j of particle @p i at @p out, returns the position past the stored entries
+inline int16_t* encodeNeighborDelta(int i, int j, int16_t* out)
+{
+    if (neighborDeltaSize(i, j) == 1)
+    {
+        *out++ = int16_t(j - i);
+        return out;
+    }
+
+    auto index = uint32_t(j);
+    *out++     = neighborDeltaEscape;
+    *out++     = int16_t(uint16_t(index & 0xFFFFu));
+    *out++     = int16_t(uint16_t(index >> 16u));
+    return out;
+}
+
+/*! @brief call @p visit with each neighbor index stored in a delta encoded list of particle @p i
+ *
+ * @param[in] i       the particle index to which the deltas are relative
+ * @param[in] first   first entry of the list of particle @p i
+ * @param[in] last    end of the list of particle @p i
+ * @param[in] visit   callable with signature void(int j)
+ */
+template<class F>
+void forEachNeighborDelta(int i, const int16_t* first, const int16_t* last, F&& visit)
+{
+    while (first != last)
+    {
+        if (*first != neighborDeltaEscape)
+        {
+            visit(i + *first++);
+            continue;
+        }
+
+        uint32_t low  = uint16_t(first[1]);
+        uint32_t high = uint16_t(first[2]);
+        visit(int(low | (high << 16u)));
+        first += 3;
+    }
+}
+
+/*! @brief find the neighbors of particles [firstId:lastId] and store them as 16-bit deltas in CSR format
+ *
+ * @param[out] offsets     CSR offsets into @p deltas, length lastId - firstId + 1
+ * @param[out] deltas      delta encoded neighbors, the list of particle i is
+ *                         deltas[offsets[i - firstId]:offsets[i - firstId + 1]], see forEachNeighborDelta
+ *
+ * Since particles are sorted along the SFC, most neighbor indices differ from the index of the particle by less than
+ * 2^15 and occupy a single 16-bit entry. Neighbors further away in the particle arrays, e.g. across periodic
+ * boundaries, are stored with an escape entry followed by their full index. See findNeighborsCsr for a description
+ * of the remaining arguments.
+ */
+template<class T, class KeyType, class SfcKind = KeyType>
+void findNeighborsCsrDelta(int firstId, int lastId, const T* x, const T* y, const T* z, const T* h,
+                           const Box<T>& box, const KeyType* codes, int n, std::vector<std::size_t>& offsets,
+                           std::vector<int16_t>& deltas, bool halfList = false)
+{
+    CSTONE_TRACE_RANGE("findNeighborsCsrDelta");
+    offsets.assign(lastId - firstId + 1, 0);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = firstId; i < lastId; ++i)
+    {
+        std::size_t size = 0;
+        forEachHalfNeighbor<T, KeyType, SfcKind>(i, halfList ? firstId : i, x, y, z, h, box, codes, n,
+                                                 [i, &size](int j) { size += neighborDeltaSize(i, j); });
+        offsets[i - firstId] = size;
+    }
+
+    exclusiveScan(offsets.data(), offsets.size());
+    deltas.resize(offsets.back());
+
+    #pragma omp parallel for schedule(static)
+    for (int i = firstId; i < lastId; ++i)
+    {
+        int16_t* out = deltas.data() + offsets[i - firstId];
+        forEachHalfNeighbor<T, KeyType, SfcKind>(i, halfList ? firstId : i, x, y, z, h, box, codes, n,
+                                                 [i, &out](int j) { out = encodeNeighborDelta(i, j, out); });
+    }
+}
+
+} // namespace cstone
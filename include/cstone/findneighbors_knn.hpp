@@ -0,0 +1,258 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  k-nearest-neighbor queries on octrees
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include "cstone/findneighbors.hpp"
+#include "cstone/tree/macs.hpp"
+#include "cstone/util/tracing.hpp"
+
+namespace cstone
+{
+
+//! @brief maximum number of pending nodes in a depth-first kNN traversal, at most 7 per level plus 8 for the last
+template<class KeyType>
+struct KnnStackSize : stl::integral_constant<int, 8 * maxTreeLevel<KeyType>{}>
+{
+};
+
+/*! @brief insert a candidate into a bounded max-heap of the nearest neighbors found so far
+ *
+ * @param[inout] heapIdx     neighbor indices of the heap, length @p k
+ * @param[inout] heapDistSq  squared distances of the heap, length @p k, the largest one is at heapDistSq[0]
+ * @param[in]    size        current number of elements in the heap
+ * @param[in]    k           heap capacity
+ * @param[in]    j           candidate index
+ * @param[in]    d2          candidate squared distance
+ * @return                   number of elements in the heap after the insertion
+ *
+ * If the heap is full, the candidate replaces the root if it is closer, otherwise it is discarded.
+ */
+template<class T>
+CUDA_HOST_DEVICE_FUN int knnHeapPush(int* heapIdx, T* heapDistSq, int size, int k, int j, T d2)
+{
+    int pos;
+    if (size < k)
+    {
+        // sift up
+        pos = size++;
+        while (pos > 0)
+        {
+            int parent = (pos - 1) / 2;
+            if (heapDistSq[parent] >= d2) { break; }
+            heapIdx[pos]    = heapIdx[parent];
+            heapDistSq[pos] = heapDistSq[parent];
+            pos             = parent;
+        }
+    }
+    else
+    {
+        if (d2 >= heapDistSq[0]) { return size; }
+
+        // replace root and sift down
+        pos = 0;
+        while (true)
+        {
+            int c = 2 * pos + 1;
+            if (c >= size) { break; }
+            if (c + 1 < size && heapDistSq[c + 1] > heapDistSq[c]) { c++; }
+            if (heapDistSq[c] <= d2) { break; }
+            heapIdx[pos]    = heapIdx[c];
+            heapDistSq[pos] = heapDistSq[c];
+            pos             = c;
+        }
+    }
+    heapIdx[pos]    = j;
+    heapDistSq[pos] = d2;
+    return size;
+}
+
+//! @brief sort a max-heap of @p size elements in place into ascending order of distance
+template<class T>
+CUDA_HOST_DEVICE_FUN void knnHeapSort(int* heapIdx, T* heapDistSq, int size)
+{
+    for (int last = size - 1; last > 0; --last)
+    {
+        int j  = heapIdx[last];
+        T   d2 = heapDistSq[last];
+
+        heapIdx[last]    = heapIdx[0];
+        heapDistSq[last] = heapDistSq[0];
+
+        // sift down the former last element in the heap [0:last]
+        int pos = 0;
+        while (true)
+        {
+            int c = 2 * pos + 1;
+            if (c >= last) { break; }
+            if (c + 1 < last && heapDistSq[c + 1] > heapDistSq[c]) { c++; }
+            if (heapDistSq[c] <= d2) { break; }
+            heapIdx[pos]    = heapIdx[c];
+            heapDistSq[pos] = heapDistSq[c];
+            pos             = c;
+        }
+        heapIdx[pos]    = j;
+        heapDistSq[pos] = d2;
+    }
+}
+
+/*! @brief find the @p k particles nearest to a query point
+ *
+ * @tparam T                  float or double
+ * @tparam KeyType            32- or 64-bit unsigned integer
+ * @tparam SfcKind            SFC used to construct @p tree, see sfc.hpp
+ * @tparam TreeView           Octree or a device view of an octree, like OctreeGpuDataView
+ * @tparam IndexType          integer type of @p layout
+ * @param[in]  tree           octree, including internal part
+ * @param[in]  layout         particle index offset of each leaf of @p tree, length numLeafNodes + 1
+ * @param[in]  x              particle x-coordinates, leaf i contains particles [layout[i]:layout[i+1]]
+ * @param[in]  y              particle y-coordinates
+ * @param[in]  z              particle z-coordinates
+ * @param[in]  box            coordinate bounding box that was used to construct @p tree
+ * @param[in]  qx             query point x-coordinate
+ * @param[in]  qy             query point y-coordinate
+ * @param[in]  qz             query point z-coordinate
+ * @param[in]  k              number of neighbors to find
+ * @param[out] neighbors      the indices of the nearest particles, length @p k, in ascending order of distance
+ * @param[out] distancesSq    the squared distances of the nearest particles, length @p k
+ * @return                    number of neighbors found, smaller than @p k only if the tree holds fewer particles
+ *
+ * The tree is traversed depth-first with the children of each node visited in order of increasing distance.
+ * Nodes that are further away than the current k-th nearest neighbor are pruned. The two output arrays
+ * hold a bounded max-heap during the traversal, such that no additional storage is needed.
+ */
+template<class T, class KeyType, class SfcKind = KeyType, class TreeView, class IndexType>
+CUDA_HOST_DEVICE_FUN int knnQuery(const TreeView& tree, const IndexType* layout, const T* x, const T* y, const T* z,
+                                  const Box<T>& box, T qx, T qy, T qz, int k, int* neighbors, T* distancesSq)
+{
+    ExpansionCenter<T> query{qx, qy, qz, T(0)};
+
+    TreeNodeIndex nodeStack[KnnStackSize<KeyType>{}];
+    T             distStack[KnnStackSize<KeyType>{}];
+
+    int stackSize = 0;
+    int numFound  = 0;
+
+    nodeStack[stackSize]   = 0;
+    distStack[stackSize++] = T(0);
+
+    while (stackSize > 0)
+    {
+        TreeNodeIndex node = nodeStack[--stackSize];
+        T nodeDistSq       = distStack[stackSize];
+
+        // the k-th neighbor may have improved since the node was pushed
+        if (numFound == k && nodeDistSq >= distancesSq[0]) { continue; }
+
+        if (tree.isLeaf(node))
+        {
+            TreeNodeIndex leafIdx = tree.toLeaf(node);
+            for (IndexType j = layout[leafIdx]; j < layout[leafIdx + 1]; ++j)
+            {
+                T d2     = distanceSqPbc(qx, qy, qz, x[j], y[j], z[j], box);
+                numFound = knnHeapPush(neighbors, distancesSq, numFound, k, int(j), d2);
+            }
+            continue;
+        }
+
+        TreeNodeIndex children[8];
+        T childDistSq[8];
+        int numChildren = 0;
+        for (int octant = 0; octant < 8; ++octant)
+        {
+            TreeNodeIndex child = tree.child(node, octant);
+            T d2 = minDistanceSq<KeyType>(query, makeIBox<KeyType, SfcKind>(tree.codeStart(child), tree.codeEnd(child)),
+                                          box);
+            if (numFound == k && d2 >= distancesSq[0]) { continue; }
+
+            // insertion sort in descending order, such that the closest child is popped first
+            int pos = numChildren++;
+            while (pos > 0 && childDistSq[pos - 1] < d2)
+            {
+                children[pos]    = children[pos - 1];
+                childDistSq[pos] = childDistSq[pos - 1];
+                pos--;
+            }
+            children[pos]    = child;
+            childDistSq[pos] = d2;
+        }
+
+        for (int i = 0; i < numChildren; ++i)
+        {
+            nodeStack[stackSize]   = children[i];
+            distStack[stackSize++] = childDistSq[i];
+        }
+    }
+
+    knnHeapSort(neighbors, distancesSq, numFound);
+    for (int i = numFound; i < k; ++i)
+    {
+        neighbors[i]   = -1;
+        distancesSq[i] = T(-1);
+    }
+
+    return numFound;
+}
+
+/*! @brief find the @p k nearest particles of each point in a batch of query points
+ *
+ * @param[in]  octree       octree, including internal part, whose leaves map to the particle arrays
+ *                          through @p layout, e.g. the focused tree of a domain
+ * @param[in]  layout       particle index offset of each leaf in @p octree, length numLeafNodes + 1
+ * @param[in]  x,y,z        particle coordinates in SFC order
+ * @param[in]  box          coordinate bounding box that was used to construct @p octree
+ * @param[in]  qx,qy,qz     query point coordinates, length @p numQueries
+ * @param[in]  numQueries   number of query points
+ * @param[in]  k            number of neighbors per query
+ * @param[out] neighbors    neighbor indices, the neighbors of query i are stored in [i * k:(i + 1) * k]
+ *                          in ascending order of distance
+ * @param[out] distancesSq  squared distances to the neighbors, same layout as @p neighbors
+ *
+ * If the tree holds fewer than @p k particles, the remaining entries are set to -1. If the particles themselves
+ * are used as queries, every particle finds itself at distance zero, which can be accounted for by querying
+ * k + 1 neighbors. Queries that are close to each other visit the same nodes, therefore queries in SFC order
+ * result in better cache reuse.
+ */
+template<class T, class KeyType, class SfcKind = KeyType>
+void findKNearestNeighbors(const Octree<KeyType>& octree, const LocalParticleIndex* layout, const T* x, const T* y,
+                           const T* z, const Box<T>& box, const T* qx, const T* qy, const T* qz,
+                           std::size_t numQueries, int k, int* neighbors, T* distancesSq)
+{
+    CSTONE_TRACE_RANGE("findKNearestNeighbors");
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (std::size_t i = 0; i < numQueries; ++i)
+    {
+        knnQuery<T, KeyType, SfcKind>(octree, layout, x, y, z, box, qx[i], qy[i], qz[i], k, neighbors + i * k,
+                                      distancesSq + i * k);
+    }
+}
+
+} // namespace cstone
@@ -0,0 +1,258 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Neighbor lists with a skin radius that are reused over several time steps
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "cstone/findneighbors_csr.hpp"
+#include "cstone/tree/definitions.h"
+
+namespace cstone
+{
+
+/*! @brief Verlet neighbor list, searched with a radius enlarged by a skin and rebuilt only when needed
+ *
+ * @tparam T         coordinate type, float or double
+ * @tparam KeyType   32- or 64-bit unsigned integer
+ * @tparam SfcKind   SFC used to compute the keys passed to build, see sfc.hpp
+ *
+ * The candidate neighbors of each particle i in [firstId:lastId] are all particles within 2 * h[i] + skin at the
+ * time of the last build, stored in CSR format. As long as the largest displacement of any particle since the
+ * build plus the largest growth of a smoothing length do not exceed skin / 2, the candidates contain all particles
+ * within 2 * h[i] and forEachNeighbor yields the same neighbors as a new search.
+ *
+ * The list refers to particles by their index. Between rebuilds, particles therefore have to keep their positions
+ * in the arrays, which is the case if the halos are refreshed with Domain::exchangeHalos instead of calling
+ * Domain::sync. After a sync, the list has to be invalidated, unless the sync only permuted the particles in a
+ * range, in which case the list can be remapped with reorder.
+ */
+template<class T, class KeyType, class SfcKind = KeyType>
+class VerletList
+{
+public:
+    explicit VerletList(T skin)
+        : skin_(skin)
+    {
+    }
+
+    /*! @brief rebuild the list if needed
+     *
+     * @return  true if the list was rebuilt
+     *
+     * Arguments are the same as for build.
+     */
+    bool update(int firstId, int lastId, const T* x, const T* y, const T* z, const T* h, const Box<T>& box,
+                const KeyType* codes, int n)
+    {
+        if (!needsRebuild(firstId, lastId, x, y, z, h, box, n)) { return false; }
+
+        build(firstId, lastId, x, y, z, h, box, codes, n);
+        return true;
+    }
+
+    /*! @brief return true if the list cannot be reused for the given particles
+     *
+     * The list cannot be reused if it was invalidated, if the particle index range changed or if the displacement
+     * of some particle together with the growth of the smoothing lengths exceeds the skin.
+     */
+    bool needsRebuild(int firstId, int lastId, const T* x, const T* y, const T* z, const T* h, const Box<T>& box,
+                      int n) const
+    {
+        if (!valid_ || firstId != firstId_ || lastId != lastId_ || std::size_t(n) != x0_.size()) { return true; }
+
+        T maxDisplacementSq = 0;
+        #pragma omp parallel for reduction(max : maxDisplacementSq) schedule(static)
+        for (int i = 0; i < n; ++i)
+        {
+            T d2 = distanceSqPbc(x[i], y[i], z[i], x0_[i], y0_[i], z0_[i], box);
+            maxDisplacementSq = std::max(maxDisplacementSq, d2);
+        }
+
+        T maxGrowth = 0;
+        #pragma omp parallel for reduction(max : maxGrowth) schedule(static)
+        for (int i = firstId; i < lastId; ++i)
+        {
+            maxGrowth = std::max(maxGrowth, h[i] - h0_[i - firstId]);
+        }
+
+        // a neighbor within 2 * h[i] was within 2 * h0[i] + 2 * (growth + displacement) at the last build
+        return 2 * (std::sqrt(maxDisplacementSq) + maxGrowth) > skin_;
+    }
+
+    /*! @brief search the candidate neighbors of particles [firstId:lastId] within 2 * h + skin
+     *
+     * @param[in] firstId   first particle index in [0:n] for which to compute neighbors
+     * @param[in] lastId    last particle index in [0:n] for which to compute neighbors
+     * @param[in] x,y,z     particle coordinates in SFC order, length @p n
+     * @param[in] h         smoothing lengths in SFC order, length @p n
+     * @param[in] box       coordinate bounding box that was used to calculate @p codes
+     * @param[in] codes     sorted SFC keys of all particles, length @p n
+     * @param[in] n         number of particles in x,y,z,h
+     */
+    void build(int firstId, int lastId, const T* x, const T* y, const T* z, const T* h, const Box<T>& box,
+               const KeyType* codes, int n)
+    {
+        hSearch_.resize(n);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; ++i)
+        {
+            hSearch_[i] = h[i] + skin_ / 2;
+        }
+
+        findNeighborsCsr<T, KeyType, SfcKind>(firstId, lastId, x, y, z, hSearch_.data(), box, codes, n, offsets_,
+                                              candidates_);
+
+        x0_.assign(x, x + n);
+        y0_.assign(y, y + n);
+        z0_.assign(z, z + n);
+        h0_.assign(h + firstId, h + lastId);
+
+        firstId_ = firstId;
+        lastId_  = lastId;
+        valid_   = true;
+    }
+
+    //! @brief mark the list as outdated, e.g. after a Domain::sync, such that the next update rebuilds it
+    void invalidate() { valid_ = false; }
+
+    /*! @brief remap the list after the particles [offset:offset + numElements] were permuted
+     *
+     * @param[in] ordering     the permutation, element i after the reordering was element ordering[i] before,
+     *                         relative to @p offset
+     * @param[in] numElements  number of permuted elements
+     * @param[in] offset       first permuted element, [offset:offset + numElements] needs to be within
+     *                         [firstId:lastId] of the last build
+     *
+     * This is the same convention as ParticleContainer::reorder. Particles outside the permuted range keep
+     * their indices.
+     */
+    void reorder(const LocalParticleIndex* ordering, std::size_t numElements, std::size_t offset)
+    {
+        std::vector<LocalParticleIndex> newIndex(numElements);
+        for (std::size_t i = 0; i < numElements; ++i)
+        {
+            newIndex[ordering[i]] = i + offset;
+        }
+
+        auto mapIndex = [&newIndex, numElements, offset](int j)
+        {
+            bool permuted = std::size_t(j) >= offset && std::size_t(j) < offset + numElements;
+            return permuted ? int(newIndex[j - offset]) : j;
+        };
+
+        std::size_t first = offset - firstId_;
+        std::vector<std::size_t> newOffsets(offsets_.size());
+        std::copy(offsets_.begin(), offsets_.begin() + first + 1, newOffsets.begin());
+        for (std::size_t i = 0; i < numElements; ++i)
+        {
+            std::size_t old = first + ordering[i];
+            newOffsets[first + i + 1] = newOffsets[first + i] + offsets_[old + 1] - offsets_[old];
+        }
+        std::copy(offsets_.begin() + first + numElements + 1, offsets_.end(),
+                  newOffsets.begin() + first + numElements + 1);
+
+        std::vector<int> newCandidates(candidates_.size());
+        #pragma omp parallel for schedule(static)
+        for (std::size_t i = 0; i < offsets_.size() - 1; ++i)
+        {
+            bool permuted = i >= first && i < first + numElements;
+            std::size_t old = permuted ? first + ordering[i - first] : i;
+            std::transform(candidates_.begin() + offsets_[old], candidates_.begin() + offsets_[old + 1],
+                           newCandidates.begin() + newOffsets[i], mapIndex);
+        }
+
+        offsets_.swap(newOffsets);
+        candidates_.swap(newCandidates);
+
+        permute(x0_, ordering, numElements, offset);
+        permute(y0_, ordering, numElements, offset);
+        permute(z0_, ordering, numElements, offset);
+        permute(h0_, ordering, numElements, first);
+    }
+
+    /*! @brief call @p visit for each neighbor j of particle @p i within 2 * h[i]
+     *
+     * @param[in] i       particle index in [firstId:lastId] of the last build
+     * @param[in] x,y,z   current particle coordinates
+     * @param[in] h       current smoothing lengths
+     * @param[in] box     coordinate bounding box
+     * @param[in] visit   callable with signature void(int j)
+     */
+    template<class F>
+    void forEachNeighbor(int i, const T* x, const T* y, const T* z, const T* h, const Box<T>& box, F&& visit) const
+    {
+        T radius   = 2 * h[i];
+        T radiusSq = radius * radius;
+
+        const int* first = candidates_.data() + offsets_[i - firstId_];
+        const int* last  = candidates_.data() + offsets_[i - firstId_ + 1];
+        for (const int* j = first; j != last; ++j)
+        {
+            if (distanceSqPbc(x[i], y[i], z[i], x[*j], y[*j], z[*j], box) < radiusSq) { visit(*j); }
+        }
+    }
+
+    //! @brief CSR offsets of the candidate lists, length lastId - firstId + 1 of the last build
+    const std::vector<std::size_t>& offsets() const { return offsets_; }
+
+    //! @brief candidate neighbors within 2 * h + skin at the last build
+    const std::vector<int>& candidates() const { return candidates_; }
+
+private:
+    template<class U>
+    static void permute(std::vector<U>& array, const LocalParticleIndex* ordering, std::size_t numElements,
+                        std::size_t offset)
+    {
+        std::vector<U> tmp(array.begin() + offset, array.begin() + offset + numElements);
+        for (std::size_t i = 0; i < numElements; ++i)
+        {
+            array[offset + i] = tmp[ordering[i]];
+        }
+    }
+
+    T skin_;
+    bool valid_{false};
+    int firstId_{0};
+    int lastId_{0};
+
+    std::vector<std::size_t> offsets_;
+    std::vector<int> candidates_;
+
+    //! @brief coordinates of all particles and smoothing lengths of [firstId:lastId] at the last build
+    std::vector<T> x0_, y0_, z0_, h0_;
+    //! @brief smoothing lengths enlarged by half the skin, scratch space for the build
+    std::vector<T> hSearch_;
+};
+
+} // namespace cstone
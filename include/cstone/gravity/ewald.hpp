@@ -0,0 +1,579 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Ewald summation for Barnes-Hut gravity in fully periodic boxes
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * In a box that is periodic in all dimensions, each particle interacts with all periodic images of all other
+ * particles and of itself, on top of a uniform background that neutralizes the mean density. The interaction
+ * with the images is split into two parts:
+ *
+ *  1. The Barnes-Hut interaction lists are evaluated with minimum-image displacements. This captures the
+ *     nearest image of each source, i.e. the part of the interaction that varies on the scale of the particles.
+ *
+ *  2. The remaining images and the background are added as an Ewald correction, the difference between the
+ *     Ewald sum and the Newtonian interaction with the nearest image. Within the minimum-image cell, the
+ *     correction is a smooth function of the displacement that varies on the scale of the box. It is precomputed
+ *     once per box on a grid over one octant of the cell, see EwaldTable, and interpolated.
+ *
+ * Since the correction is discontinuous where the minimum image changes, it is applied with the monopole
+ * of each M2P source node and each P2P source leaf, for the same image as the Newtonian interaction. Only the
+ * particles of source leaves that straddle the minimum-image boundary are corrected individually. Nodes larger
+ * than a fraction ewaldTheta of the box are always opened, see ewaldCutLevel. No replicas of the tree are
+ * traversed, and the correction adds one table lookup per M2P and P2P list entry.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "cstone/util/executor.hpp"
+#include "gravity.hpp"
+
+namespace cstone
+{
+
+//! @brief potential and acceleration at a displacement from a unit mass, excluding the gravitational constant
+template<class T>
+struct EwaldValue
+{
+    T phi;
+    T ax;
+    T ay;
+    T az;
+};
+
+namespace detail
+{
+
+/*! @brief Ewald correction for the displacement (x,y,z) from a unit mass in a periodic box
+ *
+ * @param x,y,z      displacement of the target from the source, no minimum image is applied
+ * @param lx,ly,lz   edge lengths of the periodic box
+ * @param alpha      Ewald splitting parameter, the result does not depend on it up to round-off
+ * @return           potential and acceleration of the periodic images and the neutralizing background,
+ *                   minus the Newtonian interaction with the source at (x,y,z)
+ *
+ * Real space terms are summed until erfc(alpha * r) and reciprocal space terms until exp(-k^2 / (4 alpha^2))
+ * drop below double precision. The correction is finite at the origin, where it is the interaction of a particle
+ * with its own images.
+ */
+inline EwaldValue<double> ewaldCorrection(double x, double y, double z, double lx, double ly, double lz,
+                                          double alpha)
+{
+    constexpr double pi      = 3.14159265358979323846;
+    constexpr double erfcMax = 5.9;  // erfc(5.9) < 1e-16
+    constexpr double expMax  = 12.2; // exp(-(12.2 / 2)^2) < 1e-16
+
+    double volume     = lx * ly * lz;
+    double twoAlphaPi = 2.0 * alpha / std::sqrt(pi);
+
+    double psi = -pi / (alpha * alpha * volume);
+    double gx = 0, gy = 0, gz = 0;
+
+    int nx = int(std::ceil(erfcMax / (alpha * lx) + 0.5));
+    int ny = int(std::ceil(erfcMax / (alpha * ly) + 0.5));
+    int nz = int(std::ceil(erfcMax / (alpha * lz) + 0.5));
+    for (int ix = -nx; ix <= nx; ++ix)
+        for (int iy = -ny; iy <= ny; ++iy)
+            for (int iz = -nz; iz <= nz; ++iz)
+            {
+                double rx = x - ix * lx;
+                double ry = y - iy * ly;
+                double rz = z - iz * lz;
+                double r  = std::sqrt(rx * rx + ry * ry + rz * rz);
+                double ar = alpha * r;
+
+                if (ix == 0 && iy == 0 && iz == 0)
+                {
+                    // the Newtonian term of the nearest image is subtracted: erfc(ar)/r - 1/r = -erf(ar)/r
+                    if (ar < 1e-4)
+                    {
+                        psi -= twoAlphaPi;
+                        double radial = 2.0 * twoAlphaPi * alpha * alpha / 3.0;
+                        gx += radial * rx;
+                        gy += radial * ry;
+                        gz += radial * rz;
+                    }
+                    else
+                    {
+                        double invR3  = 1.0 / (r * r * r);
+                        double radial = (std::erf(ar) - twoAlphaPi * r * std::exp(-ar * ar)) * invR3;
+                        psi -= std::erf(ar) / r;
+                        gx += radial * rx;
+                        gy += radial * ry;
+                        gz += radial * rz;
+                    }
+                    continue;
+                }
+
+                double invR3  = 1.0 / (r * r * r);
+                double radial = -(std::erfc(ar) + twoAlphaPi * r * std::exp(-ar * ar)) * invR3;
+                psi += std::erfc(ar) / r;
+                gx += radial * rx;
+                gy += radial * ry;
+                gz += radial * rz;
+            }
+
+    int hxMax = int(std::ceil(expMax * alpha * lx / (2.0 * pi)));
+    int hyMax = int(std::ceil(expMax * alpha * ly / (2.0 * pi)));
+    int hzMax = int(std::ceil(expMax * alpha * lz / (2.0 * pi)));
+    for (int hx = -hxMax; hx <= hxMax; ++hx)
+        for (int hy = -hyMax; hy <= hyMax; ++hy)
+            for (int hz = -hzMax; hz <= hzMax; ++hz)
+            {
+                if (hx == 0 && hy == 0 && hz == 0) { continue; }
+
+                double kx = 2.0 * pi * hx / lx;
+                double ky = 2.0 * pi * hy / ly;
+                double kz = 2.0 * pi * hz / lz;
+                double k2 = kx * kx + ky * ky + kz * kz;
+                double w  = 4.0 * pi / volume * std::exp(-k2 / (4.0 * alpha * alpha)) / k2;
+                double kr = kx * x + ky * y + kz * z;
+
+                psi += w * std::cos(kr);
+                double s = -w * std::sin(kr);
+                gx += s * kx;
+                gy += s * ky;
+                gz += s * kz;
+            }
+
+    // psi is the potential of a unit mass with the sign convention of the Newtonian 1/r, phi = -psi, a = grad(psi)
+    return {-psi, gx, gy, gz};
+}
+
+} // namespace detail
+
+/*! @brief Ewald correction for the displacement (x,y,z) from a unit mass in the fully periodic @p box
+ *
+ * Exact up to double precision and expensive, used to build EwaldTable. See detail::ewaldCorrection.
+ */
+template<class T>
+EwaldValue<T> ewaldCorrection(T x, T y, T z, const Box<T>& box)
+{
+    double alpha         = 2.0 / box.minExtent();
+    EwaldValue<double> e = detail::ewaldCorrection(x, y, z, box.lx(), box.ly(), box.lz(), alpha);
+    return {T(e.phi), T(e.ax), T(e.ay), T(e.az)};
+}
+
+//! @brief non-owning view of an EwaldTable, usable on the host and on devices
+template<class T>
+struct EwaldTableView
+{
+    //! @brief (n+1)^3 grid points with 4 values each, see EwaldTable
+    const T* values;
+    int      n;
+    T        lx, ly, lz;
+
+    /*! @brief interpolated Ewald correction for the displacement (x,y,z) from a unit mass
+     *
+     * The displacement is reduced to its minimum image, such that the correction refers to the nearest image.
+     * The potential is even and each acceleration component is odd in the respective coordinate, the table
+     * therefore only covers the octant [0, l/2] of the minimum-image cell.
+     */
+    CUDA_HOST_DEVICE_FUN EwaldValue<T> correction(T x, T y, T z) const
+    {
+        x -= lx * std::rint(x / lx);
+        y -= ly * std::rint(y / ly);
+        z -= lz * std::rint(z / lz);
+
+        T ux = std::abs(x) * T(2 * n) / lx;
+        T uy = std::abs(y) * T(2 * n) / ly;
+        T uz = std::abs(z) * T(2 * n) / lz;
+
+        int i = stl::min(int(ux), n - 1);
+        int j = stl::min(int(uy), n - 1);
+        int k = stl::min(int(uz), n - 1);
+
+        T fx = ux - T(i), fy = uy - T(j), fz = uz - T(k);
+
+        EwaldValue<T> e{0, 0, 0, 0};
+        for (int c = 0; c < 8; ++c)
+        {
+            int di = c >> 2, dj = (c >> 1) & 1, dk = c & 1;
+            T w = (di ? fx : T(1) - fx) * (dj ? fy : T(1) - fy) * (dk ? fz : T(1) - fz);
+
+            const T* v = values + 4 * (((i + di) * (n + 1) + j + dj) * (n + 1) + k + dk);
+            e.phi += w * v[0];
+            e.ax += w * v[1];
+            e.ay += w * v[2];
+            e.az += w * v[3];
+        }
+
+        if (x < T(0)) { e.ax = -e.ax; }
+        if (y < T(0)) { e.ay = -e.ay; }
+        if (z < T(0)) { e.az = -e.az; }
+        return e;
+    }
+};
+
+/*! @brief Ewald corrections of a fully periodic box, tabulated on a grid for trilinear interpolation
+ *
+ * The grid has n cells per dimension over [0, l/2] of each box edge length l. The default of 32 cells bounds the
+ * interpolation error to about 1e-4 relative to the correction at half the box length. Construction evaluates
+ * the full Ewald sum on (n+1)^3 grid points in parallel and is meant to be done once per box size.
+ */
+template<class T>
+class EwaldTable
+{
+public:
+    explicit EwaldTable(const Box<T>& box, int n = 32)
+        : box_(box)
+        , n_(n)
+    {
+        if (!(box.pbcX() && box.pbcY() && box.pbcZ()))
+        {
+            throw std::runtime_error("EwaldTable: the box has to be periodic in all dimensions\n");
+        }
+        if (n < 1) { throw std::runtime_error("EwaldTable: at least one grid cell per dimension is required\n"); }
+
+        int numPoints = (n + 1) * (n + 1) * (n + 1);
+        values_.resize(4 * numPoints);
+
+        double alpha = 2.0 / box.minExtent();
+        double hx = 0.5 * box.lx() / n, hy = 0.5 * box.ly() / n, hz = 0.5 * box.lz() / n;
+        parallelFor(0, numPoints,
+                    [this, n, alpha, hx, hy, hz](int idx)
+                    {
+                        int i = idx / ((n + 1) * (n + 1));
+                        int j = (idx / (n + 1)) % (n + 1);
+                        int k = idx % (n + 1);
+
+                        EwaldValue<double> e = detail::ewaldCorrection(i * hx, j * hy, k * hz, box_.lx(),
+                                                                       box_.ly(), box_.lz(), alpha);
+                        values_[4 * idx]     = T(e.phi);
+                        values_[4 * idx + 1] = T(e.ax);
+                        values_[4 * idx + 2] = T(e.ay);
+                        values_[4 * idx + 3] = T(e.az);
+                    });
+    }
+
+    [[nodiscard]] const Box<T>& box() const { return box_; }
+
+    //! @brief number of grid cells per dimension
+    [[nodiscard]] int size() const { return n_; }
+
+    [[nodiscard]] EwaldTableView<T> view() const
+    {
+        return {values_.data(), n_, box_.lx(), box_.ly(), box_.lz()};
+    }
+
+    //! @brief the tabulated values, 4 per grid point: potential and acceleration of a unit mass
+    [[nodiscard]] const std::vector<T>& values() const { return values_; }
+
+private:
+    Box<T>         box_;
+    int            n_;
+    std::vector<T> values_;
+};
+
+/*! @brief the replica-skipping criterion: the lowest tree level at which nodes may be accepted as M2P sources
+ *
+ * @param box          fully periodic global bounding box
+ * @param ewaldTheta   maximum node edge length in units of the shortest box edge
+ * @return             the lowest tree level whose nodes satisfy the edge length bound in all dimensions
+ *
+ * An accepted node interacts with its nearest image only, the other images are accounted for by the Ewald
+ * correction at its center of mass. Relative to the nearest image of the node, the correction is smooth up to the
+ * closest other image of the target, at least half a box length away. The monopole approximation of the
+ * correction therefore has an error of the order of ewaldTheta^2 times the correction, provided larger nodes are
+ * always opened.
+ */
+template<class T>
+int ewaldCutLevel(const Box<T>& box, float ewaldTheta)
+{
+    int level = 0;
+    while (box.maxExtent() / T(1 << level) > ewaldTheta * box.minExtent())
+    {
+        level++;
+    }
+    return level;
+}
+
+/*! @brief true if the minimum-image displacements between points of @p target and @p source are not all
+ *         obtained with the same periodic shift
+ *
+ * Particles of a straddling source leaf need individual Ewald corrections, since the correction is discontinuous
+ * where the minimum image changes.
+ */
+template<class KeyType>
+CUDA_HOST_DEVICE_FUN bool straddlesImageBoundary(IBox target, IBox source)
+{
+    constexpr int R = 1 << maxTreeLevel<KeyType>{};
+
+    auto straddles = [](int tmin, int tmax, int smin, int smax)
+    {
+        // twice the range of displacements, shifted to the image of the displacement of the centers
+        int lo    = 2 * (tmin - smax);
+        int hi    = 2 * (tmax - smin);
+        int mid   = (lo + hi) / 2;
+        int shift = pbcDistance<2 * R>(mid) - mid;
+        return lo + shift < -R || hi + shift > R;
+    };
+
+    return straddles(target.xmin(), target.xmax(), source.xmin(), source.xmax()) ||
+           straddles(target.ymin(), target.ymax(), source.ymin(), source.ymax()) ||
+           straddles(target.zmin(), target.zmax(), source.zmin(), source.zmax());
+}
+
+/*! @brief particle2Particle with minimum-image displacements in a periodic box with edge lengths lx,ly,lz
+ *
+ * See particle2Particle for the arguments.
+ */
+template<class T, class LocalIndex>
+CUDA_HOST_DEVICE_FUN void particle2ParticlePeriodic(T tx, T ty, T tz, const T* x, const T* y, const T* z,
+                                                    const T* m, LocalIndex first, LocalIndex last, T lx, T ly, T lz,
+                                                    T eps2, T& ax, T& ay, T& az, T& phi)
+{
+    T axLoc = 0, ayLoc = 0, azLoc = 0, phiLoc = 0;
+
+    #pragma omp simd reduction(+ : axLoc, ayLoc, azLoc, phiLoc)
+    for (LocalIndex j = first; j < last; ++j)
+    {
+        T dx = x[j] - tx;
+        T dy = y[j] - ty;
+        T dz = z[j] - tz;
+        dx -= lx * std::rint(dx / lx);
+        dy -= ly * std::rint(dy / ly);
+        dz -= lz * std::rint(dz / lz);
+        T r2 = dx * dx + dy * dy + dz * dz;
+
+        T invR  = (r2 > T(0)) ? T(1) / std::sqrt(r2 + eps2) : T(0);
+        T mInvR = m[j] * invR;
+        T mInvR3 = mInvR * invR * invR;
+
+        axLoc += dx * mInvR3;
+        ayLoc += dy * mInvR3;
+        azLoc += dz * mInvR3;
+        phiLoc -= mInvR;
+    }
+
+    ax += axLoc;
+    ay += ayLoc;
+    az += azLoc;
+    phi += phiLoc;
+}
+
+/*! @brief add the Ewald corrections of source particles [first:last] to the acceleration and potential at a target
+ *
+ * See particle2Particle and EwaldTableView::correction for the arguments. Targets are not skipped, the correction at zero
+ * displacement is the interaction of a particle with its own periodic images.
+ */
+template<class T, class LocalIndex>
+CUDA_HOST_DEVICE_FUN void ewaldParticle2Particle(T tx, T ty, T tz, const EwaldTableView<T>& ewald, const T* x,
+                                                 const T* y, const T* z, const T* m, LocalIndex first,
+                                                 LocalIndex last, T& ax, T& ay, T& az, T& phi)
+{
+    for (LocalIndex j = first; j < last; ++j)
+    {
+        EwaldValue<T> e = ewald.correction(tx - x[j], ty - y[j], tz - z[j]);
+
+        ax += m[j] * e.ax;
+        ay += m[j] * e.ay;
+        az += m[j] * e.az;
+        phi += m[j] * e.phi;
+    }
+}
+
+/*! @brief evaluate the interaction lists of a batch of target leaves in a fully periodic box
+ *
+ * @tparam SfcKind          SFC used to construct @p leaves, see sfc.hpp
+ * @param[in]  leaves       cornerstone leaf keys of the octree, length = numLeafNodes + 1
+ * @param[in]  box          fully periodic global bounding box
+ * @param[in]  ewald        Ewald correction table of @p box
+ *
+ * P2P and M2P interactions use minimum-image displacements. Each interaction is complemented by the Ewald
+ * correction for the same image: M2P sources and P2P source leaves with their monopoles, particles of P2P source
+ * leaves that straddle the minimum-image boundary individually. The monopole corrections of the potential include
+ * the second order term of the source extent, since the Laplacian of the correction is the constant -4 pi / V
+ * of the neutralizing background. See evaluateInteractionLists for the remaining arguments.
+ */
+template<class T, int P, class KeyType, class SfcKind = KeyType, class LocalIndex>
+void evaluateInteractionListsPeriodic(const GravityInteractionLists& lists, const KeyType* leaves,
+                                      const LocalIndex* layout, const Box<T>& box, const T* x, const T* y,
+                                      const T* z, const T* m, const MultipoleView<T, P>& multipoles,
+                                      const EwaldTableView<T>& ewald, T G, T eps2, T* ax, T* ay, T* az, T* phi)
+{
+    //! @brief center of mass of a P2P source leaf, zero mass if the leaf straddles the minimum-image boundary
+    struct LeafMonopole
+    {
+        T x, y, z, m;
+        //! @brief trace of the second moments about the center of mass
+        T trQ;
+    };
+
+    constexpr double pi = 3.14159265358979323846;
+
+    TreeNodeIndex numTargets = lists.lastTarget - lists.firstTarget;
+    T lx = box.lx(), ly = box.ly(), lz = box.lz();
+    // potential correction per unit trace of the second moments, 1/6 of the Laplacian of the correction
+    T traceFactor = T(2.0 * pi / 3.0) / (lx * ly * lz);
+
+    #pragma omp parallel
+    {
+        std::vector<LeafMonopole> monopoles;
+
+        #pragma omp for schedule(dynamic)
+        for (TreeNodeIndex i = 0; i < numTargets; ++i)
+        {
+            TreeNodeIndex target = lists.firstTarget + i;
+            IBox targetBox       = makeIBox<KeyType, SfcKind>(leaves[target], leaves[target + 1]);
+
+            TreeNodeIndex numP2P = lists.p2pOffsets[i + 1] - lists.p2pOffsets[i];
+            monopoles.resize(numP2P);
+            for (TreeNodeIndex s = 0; s < numP2P; ++s)
+            {
+                TreeNodeIndex source = lists.p2pSources[lists.p2pOffsets[i] + s];
+                IBox sourceBox       = makeIBox<KeyType, SfcKind>(leaves[source], leaves[source + 1]);
+
+                LeafMonopole mono{0, 0, 0, 0, 0};
+                if (!straddlesImageBoundary<KeyType>(targetBox, sourceBox))
+                {
+                    for (LocalIndex j = layout[source]; j < layout[source + 1]; ++j)
+                    {
+                        mono.x += m[j] * x[j];
+                        mono.y += m[j] * y[j];
+                        mono.z += m[j] * z[j];
+                        mono.m += m[j];
+                    }
+                    if (mono.m > T(0))
+                    {
+                        mono.x /= mono.m;
+                        mono.y /= mono.m;
+                        mono.z /= mono.m;
+                    }
+                    for (LocalIndex j = layout[source]; j < layout[source + 1]; ++j)
+                    {
+                        T dx = x[j] - mono.x, dy = y[j] - mono.y, dz = z[j] - mono.z;
+                        mono.trQ += m[j] * (dx * dx + dy * dy + dz * dz);
+                    }
+                }
+                monopoles[s] = mono;
+            }
+
+            for (LocalIndex t = layout[target]; t < layout[target + 1]; ++t)
+            {
+                T axt = 0, ayt = 0, azt = 0, phit = 0;
+                for (TreeNodeIndex s = 0; s < numP2P; ++s)
+                {
+                    TreeNodeIndex source = lists.p2pSources[lists.p2pOffsets[i] + s];
+                    particle2ParticlePeriodic(x[t], y[t], z[t], x, y, z, m, layout[source], layout[source + 1], lx,
+                                              ly, lz, eps2, axt, ayt, azt, phit);
+
+                    const LeafMonopole& mono = monopoles[s];
+                    if (mono.m > T(0))
+                    {
+                        EwaldValue<T> e = ewald.correction(x[t] - mono.x, y[t] - mono.y, z[t] - mono.z);
+                        axt += mono.m * e.ax;
+                        ayt += mono.m * e.ay;
+                        azt += mono.m * e.az;
+                        phit += mono.m * e.phi - traceFactor * mono.trQ;
+                    }
+                    else
+                    {
+                        ewaldParticle2Particle(x[t], y[t], z[t], ewald, x, y, z, m, layout[source],
+                                               layout[source + 1], axt, ayt, azt, phit);
+                    }
+                }
+                for (TreeNodeIndex s = lists.m2pOffsets[i]; s < lists.m2pOffsets[i + 1]; ++s)
+                {
+                    // minimum image of the target relative to the expansion center
+                    TreeNodeIndex node = lists.m2pSources[s];
+                    T dx = x[t] - multipoles.x[node];
+                    T dy = y[t] - multipoles.y[node];
+                    T dz = z[t] - multipoles.z[node];
+                    dx -= lx * std::rint(dx / lx);
+                    dy -= ly * std::rint(dy / ly);
+                    dz -= lz * std::rint(dz / lz);
+
+                    multipole2Particle(multipoles.x[node] + dx, multipoles.y[node] + dy, multipoles.z[node] + dz,
+                                       multipoles, node, axt, ayt, azt, phit);
+
+                    T M             = multipoles.mass(node);
+                    EwaldValue<T> e = ewald.correction(dx, dy, dz);
+                    axt += M * e.ax;
+                    ayt += M * e.ay;
+                    azt += M * e.az;
+                    phit += M * e.phi;
+                    if constexpr (P >= 2)
+                    {
+                        phit -= traceFactor * (multipoles.moment(node, multipoleIndex(2, 0, 0)) +
+                                               multipoles.moment(node, multipoleIndex(0, 2, 0)) +
+                                               multipoles.moment(node, multipoleIndex(0, 0, 2)));
+                    }
+                }
+
+                ax[t]  = G * axt;
+                ay[t]  = G * ayt;
+                az[t]  = G * azt;
+                phi[t] = G * phit;
+            }
+        }
+    }
+}
+
+/*! @brief compute gravitational accelerations and potentials of all particles in a fully periodic box
+ *
+ * @param[in]  ewald        Ewald correction table of @p box
+ * @param[in]  ewaldTheta   nodes larger than this fraction of the box are always opened, see ewaldCutLevel
+ *
+ * The potential is the one of the periodic particle distribution on a uniform background of the negative mean
+ * density. See computeGravity for the remaining arguments.
+ */
+template<class T, int P, class KeyType, class SfcKind = KeyType, class LocalIndex>
+void computeGravityPeriodic(const Octree<KeyType>& octree, const LocalIndex* layout, const T* x, const T* y,
+                            const T* z, const T* m, const MultipoleView<T, P>& multipoles, const Box<T>& box,
+                            float theta, T G, T eps, const EwaldTable<T>& ewald, T* ax, T* ay, T* az, T* phi,
+                            float ewaldTheta = 0.25f, TreeNodeIndex batchSize = 4096)
+{
+    if (!(box.pbcX() && box.pbcY() && box.pbcZ()))
+    {
+        throw std::runtime_error("computeGravityPeriodic: the box has to be periodic in all dimensions\n");
+    }
+    if (box.lx() != ewald.box().lx() || box.ly() != ewald.box().ly() || box.lz() != ewald.box().lz())
+    {
+        throw std::runtime_error("computeGravityPeriodic: the Ewald table was built for a different box\n");
+    }
+
+    GravityInteractionLists lists;
+    float invThetaSq = 1.0f / (theta * theta);
+    int cutLevel     = ewaldCutLevel(box, ewaldTheta);
+
+    for (TreeNodeIndex firstTarget = 0; firstTarget < octree.numLeafNodes(); firstTarget += batchSize)
+    {
+        TreeNodeIndex lastTarget = std::min(firstTarget + batchSize, octree.numLeafNodes());
+        buildInteractionLists<T, P, KeyType, SfcKind>(octree, multipoles, box, invThetaSq, firstTarget, lastTarget,
+                                                      lists, cutLevel);
+        evaluateInteractionListsPeriodic<T, P, KeyType, SfcKind>(lists, octree.treeLeaves().data(), layout, box, x,
+                                                                 y, z, m, multipoles, ewald.view(), G, eps * eps, ax,
+                                                                 ay, az, phi);
+    }
+}
+
+} // namespace cstone
@@ -0,0 +1,131 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Evaluation of Barnes-Hut gravity interaction lists on the GPU, see gravity.hpp
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * Interaction lists are built on the host with buildInteractionLists and uploaded per batch of target leaves.
+ * The evaluation uses one thread per target particle, threads of the same target leaf traverse the same
+ * source lists and therefore access the same source particles and multipoles.
+ */
+
+#pragma once
+
+#include <thrust/device_vector.h>
+
+#include "cstone/primitives/stl.hpp"
+#include "gravity.hpp"
+
+namespace cstone
+{
+
+//! @brief evaluate the P2P and M2P lists of target leaves [firstTarget:lastTarget], one thread per target particle
+template<class T, int P, class LocalIndex>
+__global__ void evaluateInteractionListsKernel(TreeNodeIndex firstTarget, TreeNodeIndex lastTarget,
+                                               const TreeNodeIndex* m2pOffsets, const TreeNodeIndex* m2pSources,
+                                               const TreeNodeIndex* p2pOffsets, const TreeNodeIndex* p2pSources,
+                                               const LocalIndex* layout, const T* x, const T* y, const T* z,
+                                               const T* m, MultipoleView<T, P> multipoles, T G, T eps2, T* ax,
+                                               T* ay, T* az, T* phi)
+{
+    LocalIndex t = layout[firstTarget] + blockDim.x * blockIdx.x + threadIdx.x;
+    if (t >= layout[lastTarget]) { return; }
+
+    // target leaf of particle t, relative to firstTarget
+    TreeNodeIndex i = stl::upper_bound(layout + firstTarget, layout + lastTarget + 1, t) - layout - 1 - firstTarget;
+
+    T axt = 0, ayt = 0, azt = 0, phit = 0;
+    for (TreeNodeIndex s = p2pOffsets[i]; s < p2pOffsets[i + 1]; ++s)
+    {
+        TreeNodeIndex source = p2pSources[s];
+        particle2Particle(x[t], y[t], z[t], x, y, z, m, layout[source], layout[source + 1], eps2, axt, ayt, azt,
+                          phit);
+    }
+    for (TreeNodeIndex s = m2pOffsets[i]; s < m2pOffsets[i + 1]; ++s)
+    {
+        multipole2Particle(x[t], y[t], z[t], multipoles, m2pSources[s], axt, ayt, azt, phit);
+    }
+
+    ax[t]  = G * axt;
+    ay[t]  = G * ayt;
+    az[t]  = G * azt;
+    phi[t] = G * phit;
+}
+
+/*! @brief compute gravitational accelerations and potentials of all particles with the Barnes-Hut method
+ *
+ * @param[in]  octree          host octree, including internal part
+ * @param[in]  hostMultipoles  multipoles of all @p octree nodes on the host, used to build the interaction lists
+ * @param[in]  d_layout        device array of leaf particle offsets, length = octree.numLeafNodes() + 1
+ * @param[in]  d_x,d_y,d_z,d_m device arrays with particle coordinates and masses, sorted in SFC order
+ * @param[in]  d_multipoles    copy of @p hostMultipoles in device memory
+ * @param[out] d_ax,d_ay,d_az,d_phi  device arrays for the accelerations and potentials
+ *
+ * Remaining arguments as computeGravity. List construction of the next batch on the host
+ * overlaps with the asynchronous evaluation of the current batch on the device.
+ */
+template<class T, int P, class KeyType, class SfcKind = KeyType, class LocalIndex>
+void computeGravityGpu(const Octree<KeyType>& octree, const MultipoleView<T, P>& hostMultipoles,
+                       const LocalIndex* d_layout, const T* d_x, const T* d_y, const T* d_z, const T* d_m,
+                       MultipoleView<T, P> d_multipoles, const Box<T>& box, float theta, T G, T eps, T* d_ax,
+                       T* d_ay, T* d_az, T* d_phi, TreeNodeIndex batchSize = 4096)
+{
+    constexpr unsigned nThreads = 256;
+
+    GravityInteractionLists lists;
+    thrust::device_vector<TreeNodeIndex> d_m2pOffsets, d_m2pSources, d_p2pOffsets, d_p2pSources;
+
+    std::vector<LocalIndex> layout(octree.numLeafNodes() + 1);
+    thrust::copy(thrust::device_pointer_cast(d_layout), thrust::device_pointer_cast(d_layout) + layout.size(),
+                 layout.begin());
+
+    float invThetaSq = 1.0f / (theta * theta);
+    for (TreeNodeIndex firstTarget = 0; firstTarget < octree.numLeafNodes(); firstTarget += batchSize)
+    {
+        TreeNodeIndex lastTarget = std::min(firstTarget + batchSize, octree.numLeafNodes());
+        buildInteractionLists<T, P, KeyType, SfcKind>(octree, hostMultipoles, box, invThetaSq, firstTarget,
+                                                      lastTarget, lists);
+
+        // assignment waits for the previous evaluation to finish
+        d_m2pOffsets = lists.m2pOffsets;
+        d_m2pSources = lists.m2pSources;
+        d_p2pOffsets = lists.p2pOffsets;
+        d_p2pSources = lists.p2pSources;
+
+        LocalIndex numTargetParticles = layout[lastTarget] - layout[firstTarget];
+        if (numTargetParticles == 0) { continue; }
+
+        evaluateInteractionListsKernel<<<iceil(numTargetParticles, nThreads), nThreads>>>(
+            firstTarget, lastTarget, thrust::raw_pointer_cast(d_m2pOffsets.data()),
+            thrust::raw_pointer_cast(d_m2pSources.data()), thrust::raw_pointer_cast(d_p2pOffsets.data()),
+            thrust::raw_pointer_cast(d_p2pSources.data()), d_layout, d_x, d_y, d_z, d_m, d_multipoles, G, eps * eps,
+            d_ax, d_ay, d_az, d_phi);
+    }
+    cudaDeviceSynchronize();
+}
+
+} // namespace cstone
@@ -0,0 +1,450 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Barnes-Hut gravity: interaction list construction and evaluation
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * Gravitational accelerations and potentials are computed in two separate phases per batch of target leaves:
+ *
+ *  1. For each target leaf, a stackless traversal of the octree with the vector MAC collects all source nodes
+ *     that can be approximated by their multipoles (M2P list) and all source leaves whose particles
+ *     need to be summed up directly (P2P list). Lists are stored in compressed row format.
+ *
+ *  2. The lists are evaluated with particle-to-particle kernels over the particles of each target and source leaf
+ *     pair and multipole-to-particle kernels over the source nodes of each target leaf.
+ *
+ * Since list building and evaluation are decoupled, the evaluation loops have no data-dependent control flow
+ * and can be vectorized or executed on a GPU, see gravity.cuh.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "cstone/cuda/annotation.hpp"
+#include "cstone/tree/macs.hpp"
+#include "cstone/tree/relative_coordinates.hpp"
+#include "cstone/tree/traversal.hpp"
+#include "multipole.hpp"
+
+namespace cstone
+{
+
+//! @brief interaction lists of a batch of target leaves [firstTarget:lastTarget] in compressed row format
+struct GravityInteractionLists
+{
+    TreeNodeIndex firstTarget{0};
+    TreeNodeIndex lastTarget{0};
+
+    //! @brief the M2P sources of target leaf firstTarget + i are m2pSources[m2pOffsets[i]:m2pOffsets[i+1]]
+    std::vector<TreeNodeIndex> m2pOffsets;
+    //! @brief Octree node indices of the sources that pass the MAC
+    std::vector<TreeNodeIndex> m2pSources;
+    //! @brief the P2P sources of target leaf firstTarget + i are p2pSources[p2pOffsets[i]:p2pOffsets[i+1]]
+    std::vector<TreeNodeIndex> p2pOffsets;
+    //! @brief leaf indices of the sources that fail the MAC
+    std::vector<TreeNodeIndex> p2pSources;
+};
+
+/*! @brief traverse the octree for one target leaf and report the M2P and P2P sources
+ *
+ * @param m2p   called with the Octree index of each source node that passes the MAC
+ * @param p2p   called with the leaf index of each source leaf that fails the MAC
+ *
+ * Nodes without mass are skipped. Internal nodes above tree level @p minLevel are always opened.
+ */
+template<class T, int P, class KeyType, class SfcKind, class M2P, class P2P>
+void gravityTraversal(const Octree<KeyType>& octree, const MultipoleView<T, P>& multipoles, const Box<T>& box,
+                      float invThetaSq, TreeNodeIndex target, M2P&& m2p, P2P&& p2p, int minLevel = 0)
+{
+    const TraversalOctree<KeyType>& tree = octree.traversalTree();
+    gsl::span<const KeyType> leaves      = octree.treeLeaves();
+
+    IBox targetBox = makeIBox<KeyType, SfcKind>(leaves[target], leaves[target + 1]);
+
+    auto descend = [&tree, &multipoles, &box, invThetaSq, targetBox, minLevel, &m2p](TreeNodeIndex idx)
+    {
+        TreeNodeIndex node = tree.octreeIndex(idx);
+        if (multipoles.mass(node) == T(0)) { return false; }
+        if (tree.level(idx) < minLevel) { return true; }
+
+        ExpansionCenter<T> center{multipoles.x[node], multipoles.y[node], multipoles.z[node], multipoles.mass(node)};
+        IBox sourceBox = makeIBox<KeyType, SfcKind>(tree.codeStart(idx), tree.codeEnd(idx));
+        if (vectorMac<KeyType>(center, sourceBox, targetBox, box, invThetaSq))
+        {
+            m2p(node);
+            return false;
+        }
+        return true;
+    };
+
+    singleTraversalStackless(tree, descend, p2p);
+}
+
+/*! @brief build the gravity interaction lists for the target leaves [firstTarget:lastTarget]
+ *
+ * @tparam T                 float or double
+ * @tparam P                 expansion order of @p multipoles
+ * @tparam SfcKind           SFC used to construct @p octree, see sfc.hpp
+ * @param[in]  octree        octree, including internal part
+ * @param[in]  multipoles    multipoles of all @p octree nodes, see computeMultipoles
+ * @param[in]  box           global coordinate bounding box
+ * @param[in]  invThetaSq    1./theta^2 for the vector MAC
+ * @param[in]  firstTarget   first target leaf index of the batch
+ * @param[in]  lastTarget    last target leaf index of the batch
+ * @param[out] lists         interaction lists, existing allocations are reused
+ * @param[in]  minLevel      internal nodes above this tree level are not accepted as M2P sources
+ *
+ * Each target leaf is traversed twice, first to count the list lengths, then to fill the lists,
+ * such that each thread can write into its own part of the output without synchronization.
+ */
+template<class T, int P, class KeyType, class SfcKind = KeyType>
+void buildInteractionLists(const Octree<KeyType>& octree, const MultipoleView<T, P>& multipoles, const Box<T>& box,
+                           float invThetaSq, TreeNodeIndex firstTarget, TreeNodeIndex lastTarget,
+                           GravityInteractionLists& lists, int minLevel = 0)
+{
+    TreeNodeIndex numTargets = lastTarget - firstTarget;
+
+    lists.firstTarget = firstTarget;
+    lists.lastTarget  = lastTarget;
+    lists.m2pOffsets.resize(numTargets + 1);
+    lists.p2pOffsets.resize(numTargets + 1);
+    lists.m2pOffsets[0] = 0;
+    lists.p2pOffsets[0] = 0;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (TreeNodeIndex i = 0; i < numTargets; ++i)
+    {
+        TreeNodeIndex numM2p = 0, numP2p = 0;
+        gravityTraversal<T, P, KeyType, SfcKind>(octree, multipoles, box, invThetaSq, firstTarget + i,
+                                                 [&numM2p](TreeNodeIndex) { numM2p++; },
+                                                 [&numP2p](TreeNodeIndex) { numP2p++; }, minLevel);
+        lists.m2pOffsets[i + 1] = numM2p;
+        lists.p2pOffsets[i + 1] = numP2p;
+    }
+
+    std::partial_sum(lists.m2pOffsets.begin(), lists.m2pOffsets.end(), lists.m2pOffsets.begin());
+    std::partial_sum(lists.p2pOffsets.begin(), lists.p2pOffsets.end(), lists.p2pOffsets.begin());
+    lists.m2pSources.resize(lists.m2pOffsets.back());
+    lists.p2pSources.resize(lists.p2pOffsets.back());
+
+    #pragma omp parallel for schedule(dynamic)
+    for (TreeNodeIndex i = 0; i < numTargets; ++i)
+    {
+        TreeNodeIndex* m2pOut = lists.m2pSources.data() + lists.m2pOffsets[i];
+        TreeNodeIndex* p2pOut = lists.p2pSources.data() + lists.p2pOffsets[i];
+        gravityTraversal<T, P, KeyType, SfcKind>(octree, multipoles, box, invThetaSq, firstTarget + i,
+                                                 [&m2pOut](TreeNodeIndex node) { *m2pOut++ = node; },
+                                                 [&p2pOut](TreeNodeIndex leaf) { *p2pOut++ = leaf; }, minLevel);
+    }
+}
+
+/*! @brief add the contributions of source particles [first:last] to the acceleration and potential at a target
+ *
+ * @param[in]    tx,ty,tz   target coordinates
+ * @param[in]    x,y,z,m    source particle coordinates and masses
+ * @param[in]    eps2       square of the Plummer softening length
+ * @param[inout] ax,ay,az   target acceleration, excluding the gravitational constant
+ * @param[inout] phi        target potential, excluding the gravitational constant
+ *
+ * Sources at the same position as the target, i.e. the target itself, are skipped.
+ */
+template<class T, class LocalIndex>
+CUDA_HOST_DEVICE_FUN void particle2Particle(T tx, T ty, T tz, const T* x, const T* y, const T* z, const T* m,
+                                            LocalIndex first, LocalIndex last, T eps2, T& ax, T& ay, T& az, T& phi)
+{
+    T axLoc = 0, ayLoc = 0, azLoc = 0, phiLoc = 0;
+
+    #pragma omp simd reduction(+ : axLoc, ayLoc, azLoc, phiLoc)
+    for (LocalIndex j = first; j < last; ++j)
+    {
+        T dx = x[j] - tx;
+        T dy = y[j] - ty;
+        T dz = z[j] - tz;
+        T r2 = dx * dx + dy * dy + dz * dz;
+
+        T invR  = (r2 > T(0)) ? T(1) / std::sqrt(r2 + eps2) : T(0);
+        T mInvR = m[j] * invR;
+        T mInvR3 = mInvR * invR * invR;
+
+        axLoc += dx * mInvR3;
+        ayLoc += dy * mInvR3;
+        azLoc += dz * mInvR3;
+        phiLoc -= mInvR;
+    }
+
+    ax += axLoc;
+    ay += ayLoc;
+    az += azLoc;
+    phi += phiLoc;
+}
+
+/*! @brief particle2Particle with source coordinates read from the compact coordinate mirror
+ *
+ * @param[in]    tx,ty,tz      target coordinates relative to the lower corner of the source leaf
+ * @param[in]    rx,ry,rz      source offsets from the lower corner of the source leaf,
+ *                             see computeCellRelativeCoordinates
+ * @param[in]    lx,ly,lz      edge lengths of the source leaf
+ *
+ * See particle2Particle for the remaining arguments.
+ */
+template<class T, class OffsetType, class LocalIndex>
+CUDA_HOST_DEVICE_FUN void particle2ParticleRelative(T tx, T ty, T tz, const OffsetType* rx, const OffsetType* ry,
+                                                    const OffsetType* rz, T lx, T ly, T lz, const T* m,
+                                                    LocalIndex first, LocalIndex last, T eps2, T& ax, T& ay, T& az,
+                                                    T& phi)
+{
+    T axLoc = 0, ayLoc = 0, azLoc = 0, phiLoc = 0;
+
+    #pragma omp simd reduction(+ : axLoc, ayLoc, azLoc, phiLoc)
+    for (LocalIndex j = first; j < last; ++j)
+    {
+        T dx = decodeCellOffset(rx[j], lx) - tx;
+        T dy = decodeCellOffset(ry[j], ly) - ty;
+        T dz = decodeCellOffset(rz[j], lz) - tz;
+        T r2 = dx * dx + dy * dy + dz * dz;
+
+        T invR  = (r2 > T(0)) ? T(1) / std::sqrt(r2 + eps2) : T(0);
+        T mInvR = m[j] * invR;
+        T mInvR3 = mInvR * invR * invR;
+
+        axLoc += dx * mInvR3;
+        ayLoc += dy * mInvR3;
+        azLoc += dz * mInvR3;
+        phiLoc -= mInvR;
+    }
+
+    ax += axLoc;
+    ay += ayLoc;
+    az += azLoc;
+    phi += phiLoc;
+}
+
+/*! @brief add the contribution of the multipole of @p node to the acceleration and potential at a target
+ *
+ * The expansion is evaluated up to quadrupole order, monopole only if P < 2.
+ * Dipole terms vanish, since the expansion center is the center of mass.
+ * Arguments as particle2Particle.
+ */
+template<class T, int P>
+CUDA_HOST_DEVICE_FUN void multipole2Particle(T tx, T ty, T tz, const MultipoleView<T, P>& multipoles,
+                                             TreeNodeIndex node, T& ax, T& ay, T& az, T& phi)
+{
+    T rx = tx - multipoles.x[node];
+    T ry = ty - multipoles.y[node];
+    T rz = tz - multipoles.z[node];
+    T r2 = rx * rx + ry * ry + rz * rz;
+
+    T invR  = T(1) / std::sqrt(r2);
+    T invR2 = invR * invR;
+    T invR3 = invR * invR2;
+    T M     = multipoles.mass(node);
+
+    ax -= M * rx * invR3;
+    ay -= M * ry * invR3;
+    az -= M * rz * invR3;
+    phi -= M * invR;
+
+    if constexpr (P >= 2)
+    {
+        T qxx = multipoles.moment(node, multipoleIndex(2, 0, 0));
+        T qyy = multipoles.moment(node, multipoleIndex(0, 2, 0));
+        T qzz = multipoles.moment(node, multipoleIndex(0, 0, 2));
+        T qxy = multipoles.moment(node, multipoleIndex(1, 1, 0));
+        T qxz = multipoles.moment(node, multipoleIndex(1, 0, 1));
+        T qyz = multipoles.moment(node, multipoleIndex(0, 1, 1));
+
+        T qrx = qxx * rx + qxy * ry + qxz * rz;
+        T qry = qxy * rx + qyy * ry + qyz * rz;
+        T qrz = qxz * rx + qyz * ry + qzz * rz;
+        T rqr = rx * qrx + ry * qry + rz * qrz;
+        T trQ = qxx + qyy + qzz;
+
+        T invR5 = invR3 * invR2;
+        T invR7 = invR5 * invR2;
+
+        // phi_2 = -1/2 * (3 r.Q.r / r^5 - tr(Q) / r^3), a_2 = -grad(phi_2)
+        phi -= T(0.5) * (T(3) * rqr * invR5 - trQ * invR3);
+
+        T radial = T(1.5) * trQ * invR5 - T(7.5) * rqr * invR7;
+        ax += T(3) * qrx * invR5 + radial * rx;
+        ay += T(3) * qry * invR5 + radial * ry;
+        az += T(3) * qrz * invR5 + radial * rz;
+    }
+}
+
+/*! @brief evaluate the interaction lists of a batch of target leaves
+ *
+ * @param[in]  lists        interaction lists, see buildInteractionLists
+ * @param[in]  layout       particle index offsets of the leaves, length = numLeafNodes + 1
+ * @param[in]  x,y,z,m      particle coordinates and masses, sorted in SFC order
+ * @param[in]  multipoles   multipoles of the octree nodes
+ * @param[in]  G            gravitational constant
+ * @param[in]  eps2         square of the Plummer softening length for P2P interactions
+ * @param[out] ax,ay,az     accelerations of the particles in the target leaves
+ * @param[out] phi          potentials of the particles in the target leaves
+ */
+template<class T, int P, class LocalIndex>
+void evaluateInteractionLists(const GravityInteractionLists& lists, const LocalIndex* layout, const T* x, const T* y,
+                              const T* z, const T* m, const MultipoleView<T, P>& multipoles, T G, T eps2, T* ax,
+                              T* ay, T* az, T* phi)
+{
+    TreeNodeIndex numTargets = lists.lastTarget - lists.firstTarget;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (TreeNodeIndex i = 0; i < numTargets; ++i)
+    {
+        TreeNodeIndex target = lists.firstTarget + i;
+        for (LocalIndex t = layout[target]; t < layout[target + 1]; ++t)
+        {
+            T axt = 0, ayt = 0, azt = 0, phit = 0;
+            for (TreeNodeIndex s = lists.p2pOffsets[i]; s < lists.p2pOffsets[i + 1]; ++s)
+            {
+                TreeNodeIndex source = lists.p2pSources[s];
+                particle2Particle(x[t], y[t], z[t], x, y, z, m, layout[source], layout[source + 1], eps2, axt, ayt,
+                                  azt, phit);
+            }
+            for (TreeNodeIndex s = lists.m2pOffsets[i]; s < lists.m2pOffsets[i + 1]; ++s)
+            {
+                multipole2Particle(x[t], y[t], z[t], multipoles, lists.m2pSources[s], axt, ayt, azt, phit);
+            }
+
+            ax[t]  = G * axt;
+            ay[t]  = G * ayt;
+            az[t]  = G * azt;
+            phi[t] = G * phit;
+        }
+    }
+}
+
+/*! @brief evaluate the interaction lists of a batch of target leaves, P2P sources are read from the compact mirror
+ *
+ * @tparam SfcKind          SFC used to construct @p leaves, see sfc.hpp
+ * @param[in]  leaves       cornerstone leaf keys of the octree, length = numLeafNodes + 1
+ * @param[in]  box          global coordinate bounding box
+ * @param[in]  rx,ry,rz     particle offsets from their leaf corners, see computeCellRelativeCoordinates
+ *
+ * Target positions are also taken from the mirror, such that the target and source separations are exact corner
+ * differences of the leaves plus offset differences. Targets therefore skip themselves exactly. The results agree
+ * with evaluateInteractionLists up to the precision of the offsets. See evaluateInteractionLists for the remaining
+ * arguments, the full-precision coordinates are only used for the M2P interactions.
+ */
+template<class T, int P, class KeyType, class SfcKind = KeyType, class LocalIndex, class OffsetType>
+void evaluateInteractionListsRelative(const GravityInteractionLists& lists, const KeyType* leaves,
+                                      const LocalIndex* layout, const Box<T>& box, const T* x, const T* y,
+                                      const T* z, const OffsetType* rx, const OffsetType* ry, const OffsetType* rz,
+                                      const T* m, const MultipoleView<T, P>& multipoles, T G, T eps2, T* ax, T* ay,
+                                      T* az, T* phi)
+{
+    TreeNodeIndex numTargets = lists.lastTarget - lists.firstTarget;
+
+    #pragma omp parallel
+    {
+        std::vector<CellFrame<T>> shifts;
+
+        #pragma omp for schedule(dynamic)
+        for (TreeNodeIndex i = 0; i < numTargets; ++i)
+        {
+            TreeNodeIndex target = lists.firstTarget + i;
+            IBox targetBox       = makeIBox<KeyType, SfcKind>(leaves[target], leaves[target + 1]);
+            CellFrame<T> frame   = cellFrame<KeyType>(targetBox, box);
+
+            // displacements from the target leaf corner to the source leaf corners and source edge lengths
+            TreeNodeIndex numP2P = lists.p2pOffsets[i + 1] - lists.p2pOffsets[i];
+            shifts.resize(numP2P);
+            for (TreeNodeIndex s = 0; s < numP2P; ++s)
+            {
+                TreeNodeIndex source = lists.p2pSources[lists.p2pOffsets[i] + s];
+                IBox sourceBox       = makeIBox<KeyType, SfcKind>(leaves[source], leaves[source + 1]);
+                shifts[s]            = cellShift<KeyType>(targetBox, sourceBox, box);
+            }
+
+            for (LocalIndex t = layout[target]; t < layout[target + 1]; ++t)
+            {
+                T txRel = decodeCellOffset(rx[t], frame.lx);
+                T tyRel = decodeCellOffset(ry[t], frame.ly);
+                T tzRel = decodeCellOffset(rz[t], frame.lz);
+
+                T axt = 0, ayt = 0, azt = 0, phit = 0;
+                for (TreeNodeIndex s = 0; s < numP2P; ++s)
+                {
+                    TreeNodeIndex source    = lists.p2pSources[lists.p2pOffsets[i] + s];
+                    const CellFrame<T>& sft = shifts[s];
+                    particle2ParticleRelative(txRel - sft.x, tyRel - sft.y, tzRel - sft.z, rx, ry, rz, sft.lx, sft.ly,
+                                              sft.lz, m, layout[source], layout[source + 1], eps2, axt, ayt, azt, phit);
+                }
+                for (TreeNodeIndex s = lists.m2pOffsets[i]; s < lists.m2pOffsets[i + 1]; ++s)
+                {
+                    multipole2Particle(x[t], y[t], z[t], multipoles, lists.m2pSources[s], axt, ayt, azt, phit);
+                }
+
+                ax[t]  = G * axt;
+                ay[t]  = G * ayt;
+                az[t]  = G * azt;
+                phi[t] = G * phit;
+            }
+        }
+    }
+}
+
+/*! @brief compute gravitational accelerations and potentials of all particles with the Barnes-Hut method
+ *
+ * @tparam T                 float or double
+ * @tparam P                 expansion order of @p multipoles
+ * @tparam SfcKind           SFC used to construct @p octree, see sfc.hpp
+ * @param[in]  octree        octree, including internal part, e.g. built on the leaves of a focused octree
+ * @param[in]  layout        particle index offsets of the leaves, length = octree.numLeafNodes() + 1
+ * @param[in]  x,y,z,m       particle coordinates and masses, sorted in SFC order
+ * @param[in]  multipoles    multipoles of all @p octree nodes, see computeMultipoles
+ * @param[in]  box           global coordinate bounding box
+ * @param[in]  theta         opening angle for the vector MAC
+ * @param[in]  G             gravitational constant
+ * @param[in]  eps           Plummer softening length for P2P interactions
+ * @param[out] ax,ay,az,phi  accelerations and potentials of all particles
+ * @param[in]  batchSize     number of target leaves per batch, bounds the memory used by the interaction lists
+ */
+template<class T, int P, class KeyType, class SfcKind = KeyType, class LocalIndex>
+void computeGravity(const Octree<KeyType>& octree, const LocalIndex* layout, const T* x, const T* y, const T* z,
+                    const T* m, const MultipoleView<T, P>& multipoles, const Box<T>& box, float theta, T G, T eps,
+                    T* ax, T* ay, T* az, T* phi, TreeNodeIndex batchSize = 4096)
+{
+    GravityInteractionLists lists;
+    float invThetaSq = 1.0f / (theta * theta);
+
+    for (TreeNodeIndex firstTarget = 0; firstTarget < octree.numLeafNodes(); firstTarget += batchSize)
+    {
+        TreeNodeIndex lastTarget = std::min(firstTarget + batchSize, octree.numLeafNodes());
+        buildInteractionLists<T, P, KeyType, SfcKind>(octree, multipoles, box, invThetaSq, firstTarget, lastTarget,
+                                                      lists);
+        evaluateInteractionLists(lists, layout, x, y, z, m, multipoles, G, eps * eps, ax, ay, az, phi);
+    }
+}
+
+} // namespace cstone
@@ -0,0 +1,94 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Multipole moments of octree nodes on the GPU, see multipole.hpp
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include "cstone/tree/octree_internal.cuh"
+#include "multipole.hpp"
+
+namespace cstone
+{
+
+//! @brief particle-to-multipole for all leaves of @p octree, one thread per leaf
+template<class T, int P, class KeyType, class SfcKind, class LocalIndex>
+__global__ void particle2MultipoleKernel(OctreeGpuDataView<KeyType> octree, const LocalIndex* layout, const T* x,
+                                         const T* y, const T* z, const T* m, Box<T> box, MultipoleView<T, P> view)
+{
+    TreeNodeIndex leafIdx = blockDim.x * blockIdx.x + threadIdx.x;
+    if (leafIdx < octree.numLeafNodes)
+    {
+        ExpansionCenter<T> geoCenter = geometricCenter<KeyType>(
+            makeIBox<KeyType, SfcKind>(octree.leaves[leafIdx], octree.leaves[leafIdx + 1]), box);
+        particle2Multipole(view, octree.numInternalNodes + leafIdx, x, y, z, m, layout[leafIdx], layout[leafIdx + 1],
+                           geoCenter);
+    }
+}
+
+//! @brief multipole-to-multipole for internal nodes [firstNode:lastNode], all of which have the same max depth
+template<class T, int P, class KeyType>
+__global__ void multipole2MultipoleKernel(OctreeGpuDataView<KeyType> octree, TreeNodeIndex firstNode,
+                                          TreeNodeIndex lastNode, MultipoleView<T, P> view)
+{
+    TreeNodeIndex nodeIdx = firstNode + blockDim.x * blockIdx.x + threadIdx.x;
+    if (nodeIdx < lastNode) { multipole2Multipole(octree, view, nodeIdx); }
+}
+
+/*! @brief compute the multipoles of all nodes of a device octree
+ *
+ * @param[in]  octree      the device octree
+ * @param[in]  layout      device array of leaf particle offsets, length = octree.numLeafNodes() + 1
+ * @param[in]  x,y,z,m     device arrays with particle coordinates and masses, sorted in SFC order
+ * @param[in]  box         global coordinate bounding box
+ * @param[out] view        multipole storage for octree.numTreeNodes() nodes in device memory
+ *
+ * See computeMultipoles for details. One kernel is launched per max depth for the M2M part.
+ */
+template<class T, int P, class KeyType, class SfcKind = KeyType, class LocalIndex>
+void computeMultipolesGpu(const OctreeGpu<KeyType>& octree, const LocalIndex* layout, const T* x, const T* y,
+                          const T* z, const T* m, const Box<T>& box, MultipoleView<T, P> view)
+{
+    constexpr unsigned nThreads = 256;
+
+    particle2MultipoleKernel<T, P, KeyType, SfcKind><<<iceil(octree.numLeafNodes(), nThreads), nThreads>>>(
+        octree.data(), layout, x, y, z, m, box, view);
+
+    TreeNodeIndex internalNodeIndex = octree.numInternalNodes();
+    for (int depth = 1; depth < maxTreeLevel<KeyType>{} && octree.numTreeNodes(depth) > 0; ++depth)
+    {
+        TreeNodeIndex numLevelNodes = octree.numTreeNodes(depth);
+        internalNodeIndex -= numLevelNodes;
+
+        multipole2MultipoleKernel<<<iceil(numLevelNodes, nThreads), nThreads>>>(
+            octree.data(), internalNodeIndex, internalNodeIndex + numLevelNodes, view);
+    }
+}
+
+} // namespace cstone
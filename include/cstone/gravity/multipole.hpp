@@ -0,0 +1,311 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Cartesian multipole moments of octree nodes: particle-to-multipole (P2M) and multipole-to-multipole (M2M)
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * The moments of a node with expansion center c, up to expansion order P, are
+ *
+ *      M_ijk = sum_particles m * (x - cx)^i * (y - cy)^j * (z - cz)^k,    i + j + k <= P
+ *
+ * The expansion center is the center of mass of the node, such that the dipole terms vanish.
+ * M_000 is the node mass. Moments are stored as structure of arrays, one array of length numNodes
+ * per term, such that the same term of consecutive nodes is contiguous in memory.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "cstone/cuda/annotation.hpp"
+#include "cstone/tree/macs.hpp"
+#include "cstone/tree/octree_internal.hpp"
+#include "cstone/tree/upsweep.hpp"
+
+namespace cstone
+{
+
+//! @brief number of Cartesian multipole terms up to and including order @p P
+CUDA_HOST_DEVICE_FUN constexpr int multipoleNumTerms(int P) { return (P + 1) * (P + 2) * (P + 3) / 6; }
+
+/*! @brief storage index of the multipole term with exponents i,j,k
+ *
+ * Terms are ordered by increasing order n = i + j + k. Within an order, by decreasing i, then decreasing j.
+ */
+CUDA_HOST_DEVICE_FUN constexpr int multipoleIndex(int i, int j, int k)
+{
+    int n = i + j + k;
+    return n * (n + 1) * (n + 2) / 6 + (n - i) * (n - i + 1) / 2 + k;
+}
+
+//! @brief binomial coefficient n over k, for the small arguments that occur in multipole shifts
+CUDA_HOST_DEVICE_FUN constexpr int binomial(int n, int k)
+{
+    int ret = 1;
+    for (int i = 1; i <= k; ++i)
+    {
+        ret = ret * (n - k + i) / i;
+    }
+    return ret;
+}
+
+/*! @brief non-owning structure-of-arrays view of the multipoles of an octree
+ *
+ * @tparam T  float or double
+ * @tparam P  expansion order
+ *
+ * Node indices are those of the Octree, i.e. internal nodes first, followed by the leaves.
+ */
+template<class T, int P>
+struct MultipoleView
+{
+    static constexpr int numTerms = multipoleNumTerms(P);
+
+    //! @brief expansion centers, length = numNodes
+    T* x;
+    T* y;
+    T* z;
+    //! @brief term t of node i is stored at moments[t * numNodes + i]
+    T* moments;
+    TreeNodeIndex numNodes;
+
+    CUDA_HOST_DEVICE_FUN T& moment(TreeNodeIndex node, int term) const { return moments[term * numNodes + node]; }
+    CUDA_HOST_DEVICE_FUN T& mass(TreeNodeIndex node) const { return moments[node]; }
+};
+
+/*! @brief owning multipole storage for all nodes of an octree
+ *
+ * @tparam T  float or double
+ * @tparam P  expansion order
+ */
+template<class T, int P>
+class Multipoles
+{
+public:
+    static constexpr int numTerms = multipoleNumTerms(P);
+
+    //! @brief resize for @p numNodes nodes, contents are undefined afterwards
+    void resize(TreeNodeIndex numNodes)
+    {
+        numNodes_ = numNodes;
+        x_.resize(numNodes);
+        y_.resize(numNodes);
+        z_.resize(numNodes);
+        moments_.resize(numTerms * numNodes);
+    }
+
+    [[nodiscard]] TreeNodeIndex numNodes() const { return numNodes_; }
+
+    //! @brief expansion center of @p node
+    [[nodiscard]] T centerX(TreeNodeIndex node) const { return x_[node]; }
+    [[nodiscard]] T centerY(TreeNodeIndex node) const { return y_[node]; }
+    [[nodiscard]] T centerZ(TreeNodeIndex node) const { return z_[node]; }
+
+    //! @brief the moment M_ijk of @p node
+    [[nodiscard]] T moment(TreeNodeIndex node, int i, int j, int k) const
+    {
+        return moments_[multipoleIndex(i, j, k) * numNodes_ + node];
+    }
+
+    [[nodiscard]] MultipoleView<T, P> view()
+    {
+        return {x_.data(), y_.data(), z_.data(), moments_.data(), numNodes_};
+    }
+
+private:
+    TreeNodeIndex  numNodes_{0};
+    std::vector<T> x_, y_, z_;
+    std::vector<T> moments_;
+};
+
+//! @brief compute the powers d^0, d^1, ..., d^P
+template<int P, class T>
+CUDA_HOST_DEVICE_FUN void multipolePowers(T d, T* powers)
+{
+    powers[0] = T(1);
+    for (int n = 1; n <= P; ++n)
+    {
+        powers[n] = powers[n - 1] * d;
+    }
+}
+
+/*! @brief particle-to-multipole: compute the expansion center and moments of a single node
+ *
+ * @param[inout] view       multipole storage
+ * @param[in]    node       node index in @p view
+ * @param[in]    x,y,z,m    particle coordinates and masses
+ * @param[in]    first      first particle index of the node
+ * @param[in]    last       last particle index of the node
+ * @param[in]    fallback   expansion center to use if the node has no mass, e.g. its geometric center
+ */
+template<class T, int P, class LocalIndex>
+CUDA_HOST_DEVICE_FUN void particle2Multipole(const MultipoleView<T, P>& view, TreeNodeIndex node, const T* x,
+                                             const T* y, const T* z, const T* m, LocalIndex first, LocalIndex last,
+                                             const ExpansionCenter<T>& fallback)
+{
+    T mass = 0, cx = 0, cy = 0, cz = 0;
+    for (LocalIndex p = first; p < last; ++p)
+    {
+        mass += m[p];
+        cx += m[p] * x[p];
+        cy += m[p] * y[p];
+        cz += m[p] * z[p];
+    }
+
+    if (mass > T(0)) { cx /= mass, cy /= mass, cz /= mass; }
+    else { cx = fallback.x, cy = fallback.y, cz = fallback.z; }
+
+    view.x[node] = cx;
+    view.y[node] = cy;
+    view.z[node] = cz;
+
+    T M[MultipoleView<T, P>::numTerms] = {0};
+    for (LocalIndex p = first; p < last; ++p)
+    {
+        T px[P + 1], py[P + 1], pz[P + 1];
+        multipolePowers<P>(x[p] - cx, px);
+        multipolePowers<P>(y[p] - cy, py);
+        multipolePowers<P>(z[p] - cz, pz);
+
+        for (int i = 0; i <= P; ++i)
+            for (int j = 0; j <= P - i; ++j)
+                for (int k = 0; k <= P - i - j; ++k)
+                {
+                    M[multipoleIndex(i, j, k)] += m[p] * px[i] * py[j] * pz[k];
+                }
+    }
+
+    for (int t = 0; t < MultipoleView<T, P>::numTerms; ++t)
+    {
+        view.moment(node, t) = M[t];
+    }
+}
+
+/*! @brief multipole-to-multipole: combine the moments of the 8 children of an internal node
+ *
+ * @tparam Tree          Octree or OctreeGpuDataView
+ * @param[in] octree     the octree
+ * @param[inout] view    multipole storage, the children of @p node need to be complete
+ * @param[in] node       internal node index
+ *
+ * The expansion center of @p node is the mass-weighted mean of the child centers, or their plain
+ * mean if the node has no mass. The child moments are then shifted to the new center and summed up.
+ */
+template<class T, int P, class Tree>
+CUDA_HOST_DEVICE_FUN void multipole2Multipole(const Tree& octree, const MultipoleView<T, P>& view, TreeNodeIndex node)
+{
+    T mass = 0, cx = 0, cy = 0, cz = 0, gx = 0, gy = 0, gz = 0;
+    for (int octant = 0; octant < 8; ++octant)
+    {
+        TreeNodeIndex child = octree.child(node, octant);
+        T childMass         = view.mass(child);
+
+        mass += childMass;
+        cx += childMass * view.x[child];
+        cy += childMass * view.y[child];
+        cz += childMass * view.z[child];
+        gx += view.x[child];
+        gy += view.y[child];
+        gz += view.z[child];
+    }
+
+    if (mass > T(0)) { cx /= mass, cy /= mass, cz /= mass; }
+    else { cx = gx / 8, cy = gy / 8, cz = gz / 8; }
+
+    view.x[node] = cx;
+    view.y[node] = cy;
+    view.z[node] = cz;
+
+    T M[MultipoleView<T, P>::numTerms] = {0};
+    for (int octant = 0; octant < 8; ++octant)
+    {
+        TreeNodeIndex child = octree.child(node, octant);
+
+        T dx[P + 1], dy[P + 1], dz[P + 1];
+        multipolePowers<P>(view.x[child] - cx, dx);
+        multipolePowers<P>(view.y[child] - cy, dy);
+        multipolePowers<P>(view.z[child] - cz, dz);
+
+        for (int i = 0; i <= P; ++i)
+            for (int j = 0; j <= P - i; ++j)
+                for (int k = 0; k <= P - i - j; ++k)
+                {
+                    T shifted = 0;
+                    for (int a = 0; a <= i; ++a)
+                        for (int b = 0; b <= j; ++b)
+                            for (int c = 0; c <= k; ++c)
+                            {
+                                shifted += T(binomial(i, a) * binomial(j, b) * binomial(k, c)) * dx[i - a] *
+                                           dy[j - b] * dz[k - c] * view.moment(child, multipoleIndex(a, b, c));
+                            }
+                    M[multipoleIndex(i, j, k)] += shifted;
+                }
+    }
+
+    for (int t = 0; t < MultipoleView<T, P>::numTerms; ++t)
+    {
+        view.moment(node, t) = M[t];
+    }
+}
+
+/*! @brief compute the multipoles of all nodes of an octree
+ *
+ * @tparam T                 float or double
+ * @tparam P                 expansion order
+ * @tparam SfcKind           SFC used to construct @p octree, see sfc.hpp
+ * @param[in]  octree        octree, including internal part
+ * @param[in]  layout        particle index offsets of the leaves, the particles of leaf i are
+ *                           [layout[i]:layout[i+1]], length = octree.numLeafNodes() + 1
+ * @param[in]  x,y,z,m       particle coordinates and masses, sorted in SFC order
+ * @param[in]  box           global coordinate bounding box
+ * @param[out] multipoles    resized to octree.numTreeNodes() and filled with the multipoles of each node
+ *
+ * P2M is performed for all leaves in parallel, internal nodes are computed with M2M, level by level
+ * in upsweep order.
+ */
+template<class T, int P, class KeyType, class SfcKind = KeyType, class LocalIndex>
+void computeMultipoles(const Octree<KeyType>& octree, const LocalIndex* layout, const T* x, const T* y, const T* z,
+                       const T* m, const Box<T>& box, Multipoles<T, P>& multipoles)
+{
+    multipoles.resize(octree.numTreeNodes());
+    MultipoleView<T, P> view = multipoles.view();
+
+    TreeNodeIndex numInternal = octree.numInternalNodes();
+    gsl::span<const KeyType> leaves = octree.treeLeaves();
+
+    #pragma omp parallel for schedule(static)
+    for (TreeNodeIndex i = 0; i < octree.numLeafNodes(); ++i)
+    {
+        ExpansionCenter<T> geoCenter =
+            geometricCenter<KeyType>(makeIBox<KeyType, SfcKind>(leaves[i], leaves[i + 1]), box);
+        particle2Multipole(view, numInternal + i, x, y, z, m, layout[i], layout[i + 1], geoCenter);
+    }
+
+    upsweepNodes(octree, [&octree, &view](TreeNodeIndex node) { multipole2Multipole(octree, view, node); });
+}
+
+} // namespace cstone
@@ -32,7 +32,7 @@
 #pragma once
 
 #include "cstone/sfc/box.hpp"
-#include "cstone/sfc/morton.hpp"
+#include "cstone/sfc/sfc.hpp"
 
 namespace cstone
 {
@@ -75,58 +75,60 @@ constexpr bool overlapRange(int a, int b, int c, int d)
 
 /*! @brief check for overlap between a binary or octree node and a box in 3D space
  *
- * @tparam KeyType
- * @param prefix    Morton code node prefix, defines the corner of node
- *                  closest to origin. Also equals the lower Morton code bound
- *                  of the node.
+ * @tparam KeyType  32- or 64-bit unsigned integer
+ * @tparam SfcKind  SFC used to compute @p prefix, see sfc.hpp
+ * @param prefix    SFC key node prefix, defines the lower SFC key bound of the node
  * @param length    Number of bits in the prefix to treat as the key. Defines
- *                  the Morton code range of the node.
+ *                  the SFC key range of the node.
  * @param box       3D coordinate range, defines an arbitrary box in space to
  *                  test for overlap.
  * @return          true or false
  *
  */
-template <class KeyType>
+template <class KeyType, class SfcKind = KeyType>
 CUDA_HOST_DEVICE_FUN
 bool overlap(KeyType prefix, int length, const IBox& box)
 {
-    pair<int> xRange = idecodeMortonXRange(prefix, length);
-    pair<int> yRange = idecodeMortonYRange(prefix, length);
-    pair<int> zRange = idecodeMortonZRange(prefix, length);
+    IBox nodeBox = sfcIBox<SfcKind>(prefix, length);
 
     constexpr int maxCoord = 1u<<maxTreeLevel<KeyType>{};
-    bool xOverlap = overlapRange<maxCoord>(xRange[0], xRange[1], box.xmin(), box.xmax());
-    bool yOverlap = overlapRange<maxCoord>(yRange[0], yRange[1], box.ymin(), box.ymax());
-    bool zOverlap = overlapRange<maxCoord>(zRange[0], zRange[1], box.zmin(), box.zmax());
+    bool xOverlap = overlapRange<maxCoord>(nodeBox.xmin(), nodeBox.xmax(), box.xmin(), box.xmax());
+    bool yOverlap = overlapRange<maxCoord>(nodeBox.ymin(), nodeBox.ymax(), box.ymin(), box.ymax());
+    bool zOverlap = overlapRange<maxCoord>(nodeBox.zmin(), nodeBox.zmax(), box.zmin(), box.zmax());
 
     return xOverlap && yOverlap && zOverlap;
 }
 
-template <class KeyType>
+template <class KeyType, class SfcKind = KeyType>
 CUDA_HOST_DEVICE_FUN
 bool overlap(KeyType prefixBitKey, const IBox& box)
 {
     int prefixLength = decodePrefixLength(prefixBitKey);
-    return overlap(decodePlaceholderBit(prefixBitKey), prefixLength, box);
+    return overlap<KeyType, SfcKind>(decodePlaceholderBit(prefixBitKey), prefixLength, box);
 }
 
-template <class KeyType>
+template <class KeyType, class SfcKind = KeyType>
 CUDA_HOST_DEVICE_FUN
 bool overlap(KeyType codeStart, KeyType codeEnd, const IBox& box)
 {
     int level = treeLevel(codeEnd - codeStart);
-    return overlap(codeStart, level*3, box);
+    return overlap<KeyType, SfcKind>(codeStart, level*3, box);
 }
 
-/*! @brief Check whether a coordinate box is fully contained in a Morton code range
+/*! @brief Check whether a coordinate box is fully contained in an SFC key range
  *
  * @tparam KeyType   32- or 64-bit unsigned integer
- * @param codeStart  Morton code range start
- * @param codeEnd    Morton code range end
+ * @tparam SfcKind   SFC used to compute @p codeStart and @p codeEnd, see sfc.hpp
+ * @param codeStart  SFC key range start
+ * @param codeEnd    SFC key range end
  * @param box        3D box with x,y,z integer coordinates in [0,2^maxTreeLevel<KeyType>{}-1]
- * @return           true if the box is fully contained within the specified Morton code range
+ * @return           true if the box is fully contained within the specified SFC key range
+ *
+ * For Morton keys, the result is exact. For Hilbert keys, which are not monotonic in the
+ * coordinates, the smallest octree node enclosing @p box is checked instead, i.e. false
+ * may be returned for boxes that are actually contained in the key range.
  */
-template <class KeyType>
+template <class KeyType, class SfcKind = KeyType>
 CUDA_HOST_DEVICE_FUN
 std::enable_if_t<std::is_unsigned_v<KeyType>, bool>
 containedIn(KeyType codeStart, KeyType codeEnd, const IBox& box)
@@ -145,12 +147,30 @@ containedIn(KeyType codeStart, KeyType codeEnd, const IBox& box)
         return codeStart == 0 && codeEnd == nodeRange<KeyType>(0);
     }
 
-    KeyType lowCode  = imorton3D<KeyType>(box.xmin(), box.ymin(), box.zmin());
-    // we have to subtract 1 and use strict <, because we cannot generate
-    // Morton codes for x,y,z >= 2^maxTreeLevel<KeyType>{} (2^10 or 2^21)
-    KeyType highCode = imorton3D<KeyType>(box.xmax()-1, box.ymax()-1, box.zmax()-1);
+    if constexpr (IsHilbert<SfcKind>{})
+    {
+        // number of leading bits that are identical for the first and last coordinate in each dimension
+        constexpr int unusedCoordBits = 32 - maxTreeLevel<KeyType>{};
+        int commonBitsX = countLeadingZeros(uint32_t(box.xmin() ^ (box.xmax() - 1))) - unusedCoordBits;
+        int commonBitsY = countLeadingZeros(uint32_t(box.ymin() ^ (box.ymax() - 1))) - unusedCoordBits;
+        int commonBitsZ = countLeadingZeros(uint32_t(box.zmin() ^ (box.zmax() - 1))) - unusedCoordBits;
+
+        unsigned level = stl::min(stl::min(commonBitsX, commonBitsY), commonBitsZ);
+
+        KeyType nodeStart = enclosingBoxCode(iHilbert<KeyType>(box.xmin(), box.ymin(), box.zmin()), level);
+        KeyType nodeEnd   = nodeStart + nodeRange<KeyType>(level);
+
+        return (nodeStart >= codeStart) && (nodeEnd <= codeEnd);
+    }
+    else
+    {
+        KeyType lowCode  = imorton3D<KeyType>(box.xmin(), box.ymin(), box.zmin());
+        // we have to subtract 1 and use strict <, because we cannot generate
+        // Morton codes for x,y,z >= 2^maxTreeLevel<KeyType>{} (2^10 or 2^21)
+        KeyType highCode = imorton3D<KeyType>(box.xmax()-1, box.ymax()-1, box.zmax()-1);
 
-    return (lowCode >= codeStart) && (highCode < codeEnd);
+        return (lowCode >= codeStart) && (highCode < codeEnd);
+    }
 }
 
 /*! @brief determine whether a binary/octree node (prefix, prefixLength) is fully contained in an SFC range
@@ -182,16 +202,20 @@ containedIn(KeyType prefixBitKey, KeyType codeStart, KeyType codeEnd)
     return !(firstPrefix < codeStart || secondPrefix > codeEnd);
 }
 
-template <class KeyType>
-inline IBox makeIBox(KeyType mortonCodeStart, KeyType mortonCodeEnd)
+/*! @brief compute the integer coordinate box of an octree node
+ *
+ * @tparam KeyType   32- or 64-bit unsigned integer
+ * @tparam SfcKind   SFC used to compute the node keys, see sfc.hpp
+ * @param codeStart  node start key
+ * @param codeEnd    node end key, codeEnd - codeStart needs to be a power of 8
+ * @return           the box occupied by the node
+ */
+template <class KeyType, class SfcKind = KeyType>
+CUDA_HOST_DEVICE_FUN
+inline IBox makeIBox(KeyType codeStart, KeyType codeEnd)
 {
-    int prefixNBits = treeLevel(mortonCodeEnd -mortonCodeStart) * 3;
-
-    pair<int> xrange = idecodeMortonXRange(mortonCodeStart, prefixNBits);
-    pair<int> yrange = idecodeMortonYRange(mortonCodeStart, prefixNBits);
-    pair<int> zrange = idecodeMortonZRange(mortonCodeStart, prefixNBits);
-
-    return IBox(xrange[0], xrange[1], yrange[0], yrange[1], zrange[0], zrange[1]);
+    int prefixNBits = treeLevel(codeEnd - codeStart) * 3;
+    return sfcIBox<SfcKind>(codeStart, prefixNBits);
 }
 
 template<class KeyType>
@@ -216,22 +240,24 @@ inline int addDelta(int value, int delta, bool pbc)
  * @return               a box containing the integer coordinate ranges
  *                       of the input octree node extended by (dx,dy,dz)
  */
-template <class KeyType>
+template <class KeyType, class SfcKind = KeyType>
 CUDA_HOST_DEVICE_FUN
 IBox makeHaloBox(KeyType codeStart, KeyType codeEnd, int dx, int dy, int dz,
                  bool pbcX = false, bool pbcY = false, bool pbcZ = false)
 {
-    IBox nodeBox = makeIBox(codeStart, codeEnd);
+    IBox nodeBox = makeIBox<KeyType, SfcKind>(codeStart, codeEnd);
 
     return IBox(addDelta<KeyType>(nodeBox.xmin(), -dx, pbcX), addDelta<KeyType>(nodeBox.xmax(), dx, pbcX),
                 addDelta<KeyType>(nodeBox.ymin(), -dy, pbcY), addDelta<KeyType>(nodeBox.ymax(), dy, pbcY),
                 addDelta<KeyType>(nodeBox.zmin(), -dz, pbcZ), addDelta<KeyType>(nodeBox.zmax(), dz, pbcZ));
 }
 
-//! @brief create a box with specified radius around node delineated by codeStart/End
-template <class CoordinateType, class RadiusType, class KeyType>
+namespace detail
+{
+
+template<class KeyType, class SfcKind, class RadiusType, class BoxType>
 CUDA_HOST_DEVICE_FUN
-IBox makeHaloBox(KeyType codeStart, KeyType codeEnd, RadiusType radius, const Box<CoordinateType>& box)
+IBox makeRadiusHaloBox(KeyType codeStart, KeyType codeEnd, RadiusType radius, const BoxType& box)
 {
     // disallow boxes with no volume
     assert(codeEnd > codeStart);
@@ -239,7 +265,27 @@ IBox makeHaloBox(KeyType codeStart, KeyType codeEnd, RadiusType radius, const Bo
     int dy = toNBitIntCeil<KeyType>(radius / (box.ymax() - box.ymin()));
     int dz = toNBitIntCeil<KeyType>(radius / (box.zmax() - box.zmin()));
 
-    return makeHaloBox(codeStart, codeEnd, dx, dy, dz, box.pbcX(), box.pbcY(), box.pbcZ());
+    return makeHaloBox<KeyType, SfcKind>(codeStart, codeEnd, dx, dy, dz, box.pbcX(), box.pbcY(), box.pbcZ());
+}
+
+} // namespace detail
+
+//! @brief create a box with specified radius around node delineated by codeStart/End
+template <class CoordinateType, class RadiusType, class KeyType, class SfcKind = KeyType>
+CUDA_HOST_DEVICE_FUN
+IBox makeHaloBox(KeyType codeStart, KeyType codeEnd, RadiusType radius, const Box<CoordinateType>& box)
+{
+    return detail::makeRadiusHaloBox<KeyType, SfcKind>(codeStart, codeEnd, radius, box);
+}
+
+//! @brief overload for boxes with compile-time periodicity
+template <class CoordinateType, class RadiusType, class KeyType, class SfcKind = KeyType, bool PbcX, bool PbcY,
+          bool PbcZ>
+CUDA_HOST_DEVICE_FUN
+IBox makeHaloBox(KeyType codeStart, KeyType codeEnd, RadiusType radius,
+                 const StaticPbcBox<CoordinateType, PbcX, PbcY, PbcZ>& box)
+{
+    return detail::makeRadiusHaloBox<KeyType, SfcKind>(codeStart, codeEnd, radius, box);
 }
 
 } // namespace cstone
@@ -42,18 +42,18 @@ class CollisionList
 {
 public:
     //! @brief add an index to the list of colliding leaf tree nodes
-    void add(int i)
+    void add(TreeNodeIndex i)
     {
         list_[n_] = i;
         n_ = (n_ < collisionMax-1) ? n_+1 : n_;
     }
 
     //! @brief access collision list as a range
-    [[nodiscard]] const int* begin() const { return list_; }
-    [[nodiscard]] const int* end()   const { return list_ + n_; }
+    [[nodiscard]] const TreeNodeIndex* begin() const { return list_; }
+    [[nodiscard]] const TreeNodeIndex* end()   const { return list_ + n_; }
 
     //! @brief access collision list elements
-    int operator[](int i) const
+    TreeNodeIndex operator[](int i) const
     {
         assert(i < collisionMax);
         return list_[i];
@@ -71,22 +71,22 @@ public:
 private:
     static constexpr int collisionMax = 512;
     std::size_t n_{0};
-    int list_[collisionMax]{0};
+    TreeNodeIndex list_[collisionMax]{0};
 };
 
-template<class KeyType>
+template<class KeyType, class SfcKind = KeyType>
 CUDA_HOST_DEVICE_FUN
 inline bool traverseNode(const BinaryNode<KeyType>* root, TreeNodeIndex idx,
                          const IBox& collisionBox, pair<KeyType> excludeRange)
 {
     return (!isLeafIndex(idx))
     && !containedIn(root[idx].prefix, excludeRange[0], excludeRange[1])
-    && overlap(root[idx].prefix, collisionBox);
+    && overlap<KeyType, SfcKind>(root[idx].prefix, collisionBox);
 }
 
-template<class KeyType>
+template<class KeyType, class SfcKind = KeyType>
 CUDA_HOST_DEVICE_FUN
-inline bool leafOverlap(int leafIndex, const KeyType* leafNodes,
+inline bool leafOverlap(TreeNodeIndex leafIndex, const KeyType* leafNodes,
                         const IBox& collisionBox, pair<KeyType> excludeRange)
 {
     if (!isLeafIndex(leafIndex))
@@ -97,12 +97,13 @@ inline bool leafOverlap(int leafIndex, const KeyType* leafNodes,
     KeyType leafUpperBound = leafNodes[effectiveIndex + 1];
 
     bool notExcluded = !containedIn(leafCode, leafUpperBound, excludeRange[0], excludeRange[1]);
-    return notExcluded && overlap(leafCode, leafUpperBound, collisionBox);
+    return notExcluded && overlap<KeyType, SfcKind>(leafCode, leafUpperBound, collisionBox);
 }
 
 /*! @brief find all collisions between a leaf node enlarged by (dx,dy,dz) and the rest of the tree
  *
  * @tparam KeyType              32- or 64-bit unsigned integer
+ * @tparam SfcKind              SFC used to construct @p leafNodes, see sfc.hpp
  * @param[in]    internalRoot   root of the internal binary radix tree
  * @param[in]    leafNodes      octree leaf nodes
  * @param[inout] collisionList  endpoint action to perform with each colliding leaf node
@@ -132,7 +133,7 @@ inline bool leafOverlap(int leafIndex, const KeyType* leafNodes,
  * cost to check all 3 dimensions at each step should not be very high, we keep
  * the implementation general.
  */
-template <class KeyType, class Endpoint>
+template <class KeyType, class SfcKind = KeyType, class Endpoint>
 CUDA_HOST_DEVICE_FUN
 void findCollisions(const BinaryNode<KeyType>* root, const KeyType* leafNodes, Endpoint&& reportCollision,
                     const IBox& collisionBox, pair<KeyType> excludeRange)
@@ -149,11 +150,11 @@ void findCollisions(const BinaryNode<KeyType>* root, const KeyType* leafNodes, E
     {
         TreeNodeIndex leftChild  = root[node].child[Node::left];
         TreeNodeIndex rightChild = root[node].child[Node::right];
-        bool traverseL = traverseNode(root, leftChild, collisionBox, excludeRange);
-        bool traverseR = traverseNode(root, rightChild, collisionBox, excludeRange);
+        bool traverseL = traverseNode<KeyType, SfcKind>(root, leftChild, collisionBox, excludeRange);
+        bool traverseR = traverseNode<KeyType, SfcKind>(root, rightChild, collisionBox, excludeRange);
 
-        bool overlapLeafL = leafOverlap(leftChild, leafNodes, collisionBox, excludeRange);
-        bool overlapLeafR = leafOverlap(rightChild, leafNodes, collisionBox, excludeRange);
+        bool overlapLeafL = leafOverlap<KeyType, SfcKind>(leftChild, leafNodes, collisionBox, excludeRange);
+        bool overlapLeafR = leafOverlap<KeyType, SfcKind>(rightChild, leafNodes, collisionBox, excludeRange);
 
         if (overlapLeafL) { reportCollision(loadLeafIndex(leftChild)); }
         if (overlapLeafR) { reportCollision(loadLeafIndex(rightChild)); }
@@ -182,21 +183,21 @@ void findCollisions(const BinaryNode<KeyType>* root, const KeyType* leafNodes, E
 }
 
 //! @brief convenience overload for storing colliding indices
-template <class KeyType>
+template <class KeyType, class SfcKind = KeyType>
 void findCollisions(const BinaryNode<KeyType>* root, const KeyType* leafNodes, CollisionList& collisions,
                     const IBox& collisionBox, pair<KeyType> excludeRange)
 {
     auto storeCollisions = [&collisions](TreeNodeIndex i) { collisions.add(i); };
-    findCollisions(root, leafNodes, storeCollisions, collisionBox, excludeRange);
+    findCollisions<KeyType, SfcKind>(root, leafNodes, storeCollisions, collisionBox, excludeRange);
 }
 
 //! @brief convenience overload for marking colliding node indices
-template <class KeyType>
+template <class KeyType, class SfcKind = KeyType>
 void findCollisions(const BinaryNode<KeyType>* root, const KeyType* leafNodes, int* flags,
                     const IBox& collisionBox, pair<KeyType> excludeRange)
 {
     auto markCollisions = [flags](TreeNodeIndex i) { flags[i] = 1; };
-    findCollisions(root, leafNodes, markCollisions, collisionBox, excludeRange);
+    findCollisions<KeyType, SfcKind>(root, leafNodes, markCollisions, collisionBox, excludeRange);
 }
 
 
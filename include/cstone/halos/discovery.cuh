@@ -0,0 +1,137 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  GPU driver for halo discovery using traversal of an internal binary radix tree
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <thrust/copy.h>
+#include <thrust/count.h>
+#include <thrust/device_vector.h>
+#include <thrust/execution_policy.h>
+#include <thrust/iterator/counting_iterator.h>
+
+#include "cstone/halos/btreetraversal.hpp"
+#include "cstone/util/util.hpp"
+#include "cstone/util/tracing.hpp"
+
+namespace cstone
+{
+
+//! @brief mark halo nodes of [firstNode:lastNode], one thread per node, see findHalosGpu
+template<class KeyType, class RadiusType, class CoordinateType, class SfcKind>
+__global__ void findHalosKernel(const KeyType* leaves, const BinaryNode<KeyType>* binaryTree,
+                                const RadiusType* interactionRadii, Box<CoordinateType> box,
+                                TreeNodeIndex firstNode, TreeNodeIndex lastNode, int* collisionFlags)
+{
+    TreeNodeIndex nodeIdx = firstNode + blockDim.x * blockIdx.x + threadIdx.x;
+    if (nodeIdx >= lastNode) { return; }
+
+    KeyType lowestCode  = leaves[firstNode];
+    KeyType highestCode = leaves[lastNode];
+
+    IBox haloBox = makeHaloBox<CoordinateType, RadiusType, KeyType, SfcKind>(leaves[nodeIdx], leaves[nodeIdx + 1],
+                                                                              interactionRadii[nodeIdx], box);
+
+    // if the halo box is fully inside the assigned SFC range, we skip collision detection
+    if (containedIn<KeyType, SfcKind>(lowestCode, highestCode, haloBox)) { return; }
+
+    // concurrent threads only ever store the same value, therefore no atomic operations are required
+    auto markCollisions = [collisionFlags](TreeNodeIndex i) { collisionFlags[i] = 1; };
+    findCollisions<KeyType, SfcKind>(binaryTree, leaves, markCollisions, haloBox, {lowestCode, highestCode});
+}
+
+/*! @brief mark halo nodes with flags on the GPU
+ *
+ * @tparam KeyType               32- or 64-bit unsigned integer
+ * @tparam RadiusType            float or double, float is sufficient for 64-bit codes or less
+ * @tparam CoordinateType        float or double
+ * @tparam SfcKind               SFC used to construct @p leaves, see sfc.hpp
+ * @param[in]  leaves            cornerstone octree leaves in device memory
+ * @param[in]  binaryTree        matching binary tree on top of @p leaves in device memory, e.g. from OctreeGpu
+ * @param[in]  interactionRadii  effective halo search radii per octree (leaf) node in device memory
+ * @param[in]  box               coordinate bounding box
+ * @param[in]  firstNode         first node to consider as local
+ * @param[in]  lastNode          last node to consider as local
+ * @param[out] collisionFlags    device array of length nNodes(leaves), each node that is a halo
+ *                               from the perspective of [firstNode:lastNode] will be marked
+ *                               with a non-zero value, needs to be zero-initialized
+ *
+ * Device version of findHalos, none of the arguments need to be present on the host.
+ */
+template<class KeyType, class RadiusType, class CoordinateType, class SfcKind = KeyType>
+void findHalosGpu(const KeyType* leaves, const BinaryNode<KeyType>* binaryTree, const RadiusType* interactionRadii,
+                  const Box<CoordinateType>& box, TreeNodeIndex firstNode, TreeNodeIndex lastNode,
+                  int* collisionFlags)
+{
+    CSTONE_TRACE_RANGE("findHalosGpu");
+    constexpr unsigned numThreads = 128;
+    TreeNodeIndex numNodes = lastNode - firstNode;
+    if (numNodes == 0) { return; }
+
+    findHalosKernel<KeyType, RadiusType, CoordinateType, SfcKind><<<iceil(numNodes, numThreads), numThreads>>>(
+        leaves, binaryTree, interactionRadii, box, firstNode, lastNode, collisionFlags);
+}
+
+//! @brief predicate for flag compaction
+struct IsNonZero
+{
+    template<class T>
+    __host__ __device__ bool operator()(T flag) const
+    {
+        return flag != 0;
+    }
+};
+
+/*! @brief sorted list of the indices of the non-zero elements of a device flag array, e.g. from findHalosGpu
+ *
+ * @param[in]  flags        device array, length @p numElements
+ * @param[in]  numElements
+ * @return                  host vector with the indices i of all flags[i] != 0 in ascending order
+ *
+ * Device version of flaggedIndices, the compaction runs on the device and only the compacted list is
+ * downloaded.
+ */
+template<class T>
+std::vector<TreeNodeIndex> flaggedIndicesGpu(const T* flags, TreeNodeIndex numElements)
+{
+    TreeNodeIndex numFlagged = thrust::count_if(thrust::device, flags, flags + numElements, IsNonZero{});
+
+    thrust::device_vector<TreeNodeIndex> d_indices(numFlagged);
+    thrust::copy_if(thrust::device, thrust::counting_iterator<TreeNodeIndex>(0),
+                    thrust::counting_iterator<TreeNodeIndex>(numElements), flags, d_indices.begin(), IsNonZero{});
+
+    std::vector<TreeNodeIndex> indices(numFlagged);
+    thrust::copy(d_indices.begin(), d_indices.end(), indices.begin());
+    return indices;
+}
+
+} // namespace cstone
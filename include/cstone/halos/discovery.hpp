@@ -24,7 +24,7 @@
  */
 
 /*! @file
- * @brief  CPU driver for halo discovery using traversal of an internal binary radix tree
+ * @brief  CPU driver for halo discovery using traversal of the internal part of an octree
  *
  * @author Sebastian Keller <sebastian.f.keller@gmail.com>
  */
@@ -35,17 +35,61 @@
 #include <vector>
 
 #include "cstone/halos/btreetraversal.hpp"
+#include "cstone/primitives/scan.hpp"
+#include "cstone/tree/octree_internal.hpp"
+#include "cstone/tree/traversal.hpp"
+#include "cstone/util/executor.hpp"
+#include "cstone/util/index_ranges.hpp"
 #include "cstone/util/gsl-lite.hpp"
+#include "cstone/util/tracing.hpp"
 
 namespace cstone
 {
 
+/*! @brief find all leaves of an octree that collide with a query box
+ *
+ * @tparam KeyType               32- or 64-bit unsigned integer
+ * @tparam SfcKind               SFC used to construct @p octree, see sfc.hpp
+ * @param[in] octree             octree, including internal part
+ * @param[in] reportCollision    endpoint action to perform with each colliding leaf index,
+ *                               callable with signature void(TreeNodeIndex)
+ * @param[in] collisionBox       query box to look for collisions with leaf nodes
+ * @param[in] excludeRange       range defined by two SFC codes to exclude from collision search,
+ *                               nodes fully contained in the specified range are not traversed or reported
+ *
+ * In contrast to the binary tree version in btreetraversal.hpp, there is no limit on the number of collisions.
+ */
+template<class KeyType, class SfcKind = KeyType, class F>
+void findCollisions(const Octree<KeyType>& octree, F&& reportCollision, const IBox& collisionBox,
+                    pair<KeyType> excludeRange)
+{
+    gsl::span<const KeyType> leaves = octree.treeLeaves();
+
+    auto overlaps = [excludeRange, &collisionBox](KeyType nodeStart, KeyType nodeEnd)
+    {
+        return !containedIn(nodeStart, nodeEnd, excludeRange[0], excludeRange[1]) &&
+               overlap<KeyType, SfcKind>(nodeStart, nodeEnd, collisionBox);
+    };
+
+    auto descend = [&octree, &overlaps](TreeNodeIndex node)
+    { return overlaps(octree.codeStart(node), octree.codeEnd(node)); };
+
+    // the root is reported as endpoint even if it does not pass the criterion, therefore leaves are checked again
+    auto endpoint = [&leaves, &overlaps, &reportCollision](TreeNodeIndex leafIdx)
+    {
+        if (overlaps(leaves[leafIdx], leaves[leafIdx + 1])) { reportCollision(leafIdx); }
+    };
+
+    singleTraversal(octree, descend, endpoint);
+}
+
 /*! @brief Compute halo node pairs
  *
  * @tparam KeyType             32- or 64-bit unsigned integer
  * @tparam RadiusType          float or double, float is sufficient for 64-bit codes or less
  * @tparam CoordinateType      float or double
- * @param tree                 cornerstone octree
+ * @tparam SfcKind             SFC used to construct @p octree, see sfc.hpp
+ * @param octree               octree, including internal part
  * @param interactionRadii     effective halo search radii per octree (leaf) node
  * @param box                  coordinate bounding box
  * @param firstNode            first node to consider as local
@@ -62,69 +106,91 @@ namespace cstone
  * This means that the first element in each index pair in @p haloPairs is the index of a
  * node (in @p tree) that must be sent out to another rank.
  * The second element of each pair is the index of a remote node not in [firstNode:lastNode].
+ * The search is instantiated with the periodicity of @p box fixed at compile time, see dispatchPbc.
  */
-template<class KeyType, class RadiusType, class CoordinateType>
-void findHalos(gsl::span<const KeyType>          tree,
+template<class KeyType, class RadiusType, class CoordinateType, class SfcKind = KeyType>
+void findHalos(const Octree<KeyType>&            octree,
                gsl::span<RadiusType>             interactionRadii,
                const Box<CoordinateType>&        box,
                TreeNodeIndex                     firstNode,
                TreeNodeIndex                     lastNode,
                std::vector<pair<TreeNodeIndex>>& haloPairs)
 {
-    std::vector<BinaryNode<KeyType>> internalTree(nNodes(tree));
-    createBinaryTree(tree.data(), nNodes(tree), internalTree.data());
+    CSTONE_TRACE_RANGE("findHalos");
+    gsl::span<const KeyType> tree = octree.treeLeaves();
 
     KeyType lowestCode  = tree[firstNode];
     KeyType highestCode = tree[lastNode];
 
-    #pragma omp parallel
+    auto findPairs = [&](const auto& pbcBox)
     {
-        std::vector<pair<TreeNodeIndex>> threadHaloPairs;
+        // one chunk of nodes per thread, each collecting its pairs in a separate list
+        TreeNodeIndex numChunks =
+            std::max(std::min(lastNode - firstNode, TreeNodeIndex(parallelism())), TreeNodeIndex(1));
+        TreeNodeIndex chunkSize = (lastNode - firstNode + numChunks - 1) / numChunks;
+        std::vector<std::vector<pair<TreeNodeIndex>>> chunkHaloPairs(numChunks);
 
-        // loop over all the nodes in range
-        #pragma omp for
-        for (TreeNodeIndex nodeIdx = firstNode; nodeIdx < lastNode; ++nodeIdx)
+        parallelFor(TreeNodeIndex(0), numChunks, [&](TreeNodeIndex chunk)
         {
-            CollisionList collisions;
-            RadiusType radius = interactionRadii[nodeIdx];
-
-            IBox haloBox = makeHaloBox(tree[nodeIdx], tree[nodeIdx + 1], radius, box);
-
-            // if the halo box is fully inside the assigned SFC range, we skip collision detection
-            if (containedIn(lowestCode, highestCode, haloBox))
-            {
-                continue;
-            }
+            std::vector<pair<TreeNodeIndex>>& threadHaloPairs = chunkHaloPairs[chunk];
 
-            // find out with which other nodes in the octree that the node at nodeIdx
-            // enlarged by the halo radius collides with
-            findCollisions(internalTree.data(), tree.data(), collisions, haloBox, {lowestCode, highestCode});
+            TreeNodeIndex chunkFirst = firstNode + chunk * chunkSize;
+            TreeNodeIndex chunkLast  = std::min(chunkFirst + chunkSize, lastNode);
 
-            if (collisions.exhausted()) throw std::runtime_error("collision list exhausted\n");
-
-            // collisions now has all nodes that collide with the haloBox around the node at tree[nodeIdx]
-            // we only mark those nodes in collisions as halos if their haloBox collides with tree[nodeIdx]
-            // i.e. we make sure that the local node (nodeIdx) is also a halo of the remote node
-            for (std::size_t i = 0; i < collisions.size(); ++i)
+            // loop over all the nodes in range
+            for (TreeNodeIndex nodeIdx = chunkFirst; nodeIdx < chunkLast; ++nodeIdx)
             {
-                TreeNodeIndex collidingNodeIdx = collisions[i];
+                RadiusType radius = interactionRadii[nodeIdx];
 
-                KeyType collidingNodeStart = tree[collidingNodeIdx];
-                KeyType collidingNodeEnd   = tree[collidingNodeIdx + 1];
+                IBox haloBox = makeHaloBox<CoordinateType, RadiusType, KeyType, SfcKind>(
+                    tree[nodeIdx], tree[nodeIdx + 1], radius, pbcBox);
 
-                IBox remoteNodeBox = makeHaloBox(collidingNodeStart, collidingNodeEnd,
-                                                 interactionRadii[collidingNodeIdx], box);
-                if (overlap(tree[nodeIdx], tree[nodeIdx + 1], remoteNodeBox))
+                // if the halo box is fully inside the assigned SFC range, we skip collision detection
+                if (containedIn<KeyType, SfcKind>(lowestCode, highestCode, haloBox))
                 {
-                    threadHaloPairs.emplace_back(nodeIdx, collidingNodeIdx);
+                    continue;
                 }
+
+                // we only mark colliding nodes as halos if their haloBox collides with tree[nodeIdx]
+                // i.e. we make sure that the local node (nodeIdx) is also a halo of the remote node
+                auto reportMutual = [&](TreeNodeIndex collidingNodeIdx)
+                {
+                    IBox remoteNodeBox = makeHaloBox<CoordinateType, RadiusType, KeyType, SfcKind>(
+                        tree[collidingNodeIdx], tree[collidingNodeIdx + 1], interactionRadii[collidingNodeIdx],
+                        pbcBox);
+                    if (overlap<KeyType, SfcKind>(tree[nodeIdx], tree[nodeIdx + 1], remoteNodeBox))
+                    {
+                        threadHaloPairs.emplace_back(nodeIdx, collidingNodeIdx);
+                    }
+                };
+
+                findCollisions<KeyType, SfcKind>(octree, reportMutual, haloBox, {lowestCode, highestCode});
             }
-        }
-        #pragma omp critical
+        });
+
+        for (const auto& threadHaloPairs : chunkHaloPairs)
         {
             std::copy(begin(threadHaloPairs), end(threadHaloPairs), std::back_inserter(haloPairs));
         }
-    }
+    };
+
+    dispatchPbc(box, findPairs);
+}
+
+//! @brief convenience overload for a cornerstone leaf array, constructs the internal part of the octree
+template<class KeyType, class RadiusType, class CoordinateType, class SfcKind = KeyType>
+void findHalos(gsl::span<const KeyType>          tree,
+               gsl::span<RadiusType>             interactionRadii,
+               const Box<CoordinateType>&        box,
+               TreeNodeIndex                     firstNode,
+               TreeNodeIndex                     lastNode,
+               std::vector<pair<TreeNodeIndex>>& haloPairs)
+{
+    CSTONE_TRACE_RANGE("findHalos");
+    Octree<KeyType> octree;
+    octree.update(tree.begin(), tree.end());
+    findHalos<KeyType, RadiusType, CoordinateType, SfcKind>(octree, interactionRadii, box, firstNode, lastNode,
+                                                            haloPairs);
 }
 
 /*! @brief mark halo nodes with flags
@@ -132,41 +198,89 @@ void findHalos(gsl::span<const KeyType>          tree,
  * @tparam KeyType               32- or 64-bit unsigned integer
  * @tparam RadiusType            float or double, float is sufficient for 64-bit codes or less
  * @tparam CoordinateType        float or double
- * @param[in]  tree              cornerstone octree leaves
- * @param[in]  binaryTree        matching binary tree on top of @p tree
+ * @tparam SfcKind               SFC used to construct @p octree, see sfc.hpp
+ * @param[in]  octree            octree, including internal part, e.g. the one of the focused tree
  * @param[in]  interactionRadii  effective halo search radii per octree (leaf) node
  * @param[in]  box               coordinate bounding box
  * @param[in]  firstNode         first node to consider as local
  * @param[in]  lastNode          last node to consider as local
- * @param[out] collisionFlags    array of length nNodes(tree), each node that is a halo
+ * @param[out] collisionFlags    array of length octree.numLeafNodes(), each node that is a halo
  *                               from the perspective of [firstNode:lastNode] will be marked
  *                               with a non-zero value
  */
-template<class KeyType, class RadiusType, class CoordinateType>
-void findHalos(gsl::span<const KeyType> tree,
-               gsl::span<const BinaryNode<KeyType>> binaryTree,
+template<class KeyType, class RadiusType, class CoordinateType, class SfcKind = KeyType>
+void findHalos(const Octree<KeyType>& octree,
                gsl::span<RadiusType> interactionRadii,
                const Box<CoordinateType>& box,
                TreeNodeIndex firstNode,
                TreeNodeIndex lastNode,
                int* collisionFlags)
 {
+    CSTONE_TRACE_RANGE("findHalos");
+    gsl::span<const KeyType> tree = octree.treeLeaves();
+
     KeyType lowestCode  = tree[firstNode];
     KeyType highestCode = tree[lastNode];
 
-    // loop over all the nodes in range
-    #pragma omp parallel for
-    for (TreeNodeIndex nodeIdx = firstNode; nodeIdx < lastNode; ++nodeIdx)
+    auto markCollisions = [collisionFlags](TreeNodeIndex i) { collisionFlags[i] = 1; };
+
+    auto markHalos = [&](const auto& pbcBox)
     {
-        RadiusType radius = interactionRadii[nodeIdx];
-        IBox haloBox      = makeHaloBox(tree[nodeIdx], tree[nodeIdx + 1], radius, box);
+        // loop over all the nodes in range
+        parallelFor(firstNode, lastNode, [&](TreeNodeIndex nodeIdx)
+        {
+            RadiusType radius = interactionRadii[nodeIdx];
+            IBox haloBox = makeHaloBox<CoordinateType, RadiusType, KeyType, SfcKind>(tree[nodeIdx], tree[nodeIdx + 1],
+                                                                                      radius, pbcBox);
+
+            // if the halo box is fully inside the assigned SFC range, we skip collision detection
+            if (containedIn<KeyType, SfcKind>(lowestCode, highestCode, haloBox)) { return; }
 
-        // if the halo box is fully inside the assigned SFC range, we skip collision detection
-        if (containedIn(lowestCode, highestCode, haloBox)) { continue; }
+            // mark all colliding node indices outside [lowestCode:highestCode]
+            findCollisions<KeyType, SfcKind>(octree, markCollisions, haloBox, {lowestCode, highestCode});
+        });
+    };
 
-        // mark all colliding node indices outside [lowestCode:highestCode]
-        findCollisions(binaryTree.data(), tree.data(), collisionFlags, haloBox, {lowestCode, highestCode});
-    }
+    dispatchPbc(box, markHalos);
+}
+
+/*! @brief mark local nodes whose particles do not interact with any halos
+ *
+ * @tparam KeyType               32- or 64-bit unsigned integer
+ * @tparam RadiusType            float or double, float is sufficient for 64-bit codes or less
+ * @tparam CoordinateType        float or double
+ * @tparam SfcKind               SFC used to construct @p tree, see sfc.hpp
+ * @param[in]  tree              cornerstone octree leaves
+ * @param[in]  interactionRadii  effective halo search radii per octree (leaf) node
+ * @param[in]  box               coordinate bounding box
+ * @param[in]  firstNode         first node to consider as local
+ * @param[in]  lastNode          last node to consider as local
+ * @param[out] interiorFlags     array of length nNodes(tree), nodes in [firstNode:lastNode] that are enclosed
+ *                               in the local range including their search radius are set to 1, all others to 0
+ *
+ * Computations on particles of interior nodes only access assigned particles and can therefore
+ * overlap with the halo exchange.
+ */
+template<class KeyType, class RadiusType, class CoordinateType, class SfcKind = KeyType>
+void findInteriorNodes(gsl::span<const KeyType> tree,
+                       gsl::span<const RadiusType> interactionRadii,
+                       const Box<CoordinateType>& box,
+                       TreeNodeIndex firstNode,
+                       TreeNodeIndex lastNode,
+                       int* interiorFlags)
+{
+    KeyType lowestCode  = tree[firstNode];
+    KeyType highestCode = tree[lastNode];
+
+    std::fill(interiorFlags, interiorFlags + firstNode, 0);
+    std::fill(interiorFlags + lastNode, interiorFlags + nNodes(tree), 0);
+
+    parallelFor(firstNode, lastNode, [&](TreeNodeIndex nodeIdx)
+    {
+        IBox haloBox = makeHaloBox<CoordinateType, RadiusType, KeyType, SfcKind>(tree[nodeIdx], tree[nodeIdx + 1],
+                                                                                  interactionRadii[nodeIdx], box);
+        interiorFlags[nodeIdx] = containedIn<KeyType, SfcKind>(lowestCode, highestCode, haloBox) ? 1 : 0;
+    });
 }
 
 /*! @brief extract ranges of marked indices from a source array
@@ -182,6 +296,9 @@ void findHalos(gsl::span<const KeyType> tree,
  *
  * Even indices mark the start of a range, uneven indices mark the end of the previous
  * range start. If two ranges are consecutive, they are fused into a single range.
+ *
+ * Implemented as a flag-scan-compact pipeline: each index at which the marked state changes
+ * contributes one element, in ascending order the resulting elements alternate between range starts and ends.
  */
 template<class IntegralType>
 std::vector<IntegralType> extractMarkedElements(gsl::span<const IntegralType> source,
@@ -189,24 +306,55 @@ std::vector<IntegralType> extractMarkedElements(gsl::span<const IntegralType> so
                                                 TreeNodeIndex firstReqIdx,
                                                 TreeNodeIndex secondReqIdx)
 {
-    std::vector<IntegralType> requestKeys;
+    if (firstReqIdx >= secondReqIdx) { return {}; }
+
+    auto isMarked = [flags, firstReqIdx, secondReqIdx](TreeNodeIndex i)
+    { return firstReqIdx <= i && i < secondReqIdx && flags[i] != 0; };
 
-    while (firstReqIdx != secondReqIdx)
+    // one slot per index in [firstReqIdx:secondReqIdx], plus one for the total count
+    TreeNodeIndex numIndices = secondReqIdx - firstReqIdx + 1;
+    std::vector<TreeNodeIndex> scatterMap(numIndices + 1);
+
+    parallelFor(TreeNodeIndex(0), numIndices, [&](TreeNodeIndex k)
     {
-        // advance to first halo (or to secondReqIdx)
-        while (firstReqIdx < secondReqIdx && flags[firstReqIdx] == 0) { firstReqIdx++; }
+        TreeNodeIndex i = firstReqIdx + k;
+        scatterMap[k]   = isMarked(i) != isMarked(i - 1);
+    });
+    scatterMap[numIndices] = 0;
 
-        // add one request key range
-        if (firstReqIdx != secondReqIdx)
-        {
-            requestKeys.push_back(source[firstReqIdx]);
-            // advance until not a halo or end of range
-            while (firstReqIdx < secondReqIdx && flags[firstReqIdx] == 1) { firstReqIdx++; }
-            requestKeys.push_back(source[firstReqIdx]);
-        }
-    }
+    exclusiveScan(scatterMap.data(), scatterMap.size());
+
+    std::vector<IntegralType> requestKeys(scatterMap.back());
+
+    parallelFor(TreeNodeIndex(0), numIndices, [&](TreeNodeIndex k)
+    {
+        if (scatterMap[k + 1] != scatterMap[k]) { requestKeys[scatterMap[k]] = source[firstReqIdx + k]; }
+    });
 
     return requestKeys;
 }
 
+/*! @brief particle index ranges of the nodes marked in @p flags
+ *
+ * @param layout         particle offsets of the nodes, length N+1
+ * @param flags          0 or 1 flags per node, length N
+ * @param firstNode      first node to consider
+ * @param lastNode       last node to consider
+ * @return               ranges of particle indices, consecutive marked nodes are fused into a single range
+ */
+inline std::vector<IndexPair<LocalParticleIndex>> markedParticleRanges(gsl::span<const LocalParticleIndex> layout,
+                                                                      gsl::span<const int> flags,
+                                                                      TreeNodeIndex firstNode,
+                                                                      TreeNodeIndex lastNode)
+{
+    std::vector<LocalParticleIndex> elements = extractMarkedElements(layout, flags, firstNode, lastNode);
+
+    std::vector<IndexPair<LocalParticleIndex>> ranges;
+    for (std::size_t i = 0; i < elements.size(); i += 2)
+    {
+        ranges.emplace_back(elements[i], elements[i + 1]);
+    }
+    return ranges;
+}
+
 } // namespace cstone
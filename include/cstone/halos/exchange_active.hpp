@@ -0,0 +1,118 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Restriction of the halo exchange pattern to nodes that contain active particles
+ *
+ * With hierarchical time-stepping, only a subset of the particles is updated on most substeps. Their halos
+ * only need to be refreshed in the nodes that contain at least one of them.
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "cstone/primitives/mpi_wrappers.hpp"
+#include "cstone/tree/definitions.h"
+
+namespace cstone
+{
+
+/*! @brief per rank, the subset of @p nodes that is flagged in @p nodeActive
+ *
+ * @param nodes       per rank, a list of global node indices
+ * @param nodeActive  flag per global node, non-zero for nodes that contain active particles
+ * @return            per rank, the nodes of @p nodes with a non-zero flag, in the same order
+ */
+inline std::vector<std::vector<TreeNodeIndex>> filterActiveNodes(const std::vector<std::vector<TreeNodeIndex>>& nodes,
+                                                                 const std::vector<char>& nodeActive)
+{
+    std::vector<std::vector<TreeNodeIndex>> activeNodes(nodes.size());
+    for (std::size_t rank = 0; rank < nodes.size(); ++rank)
+    {
+        for (TreeNodeIndex node : nodes[rank])
+        {
+            if (nodeActive[node]) { activeNodes[rank].push_back(node); }
+        }
+    }
+    return activeNodes;
+}
+
+/*! @brief send the active outgoing halo nodes to each peer and receive the active incoming halo nodes
+ *
+ * @param incomingNodes   per source rank, the global indices of all incoming halo nodes
+ * @param activeOutgoing  per destination rank, the global indices of the outgoing halo nodes that contain
+ *                        active particles, a subset of the outgoing nodes of the full exchange pattern
+ * @param outgoingNodes   per destination rank, the global indices of all outgoing halo nodes
+ * @param comm            communicator in which the ranks of the node lists are numbered
+ * @return                per source rank, the incoming halo nodes that contain active particles on their owner
+ *
+ * Each rank that has outgoing halo nodes for a peer sends one message to it, which is empty if none of these
+ * nodes is active. The message sizes therefore scale with the number of active nodes, not the number of halos.
+ * Requires the outgoing node lists of the full pattern of each rank to match the incoming lists of its peers.
+ */
+inline std::vector<std::vector<TreeNodeIndex>>
+exchangeActiveNodes(const std::vector<std::vector<TreeNodeIndex>>& incomingNodes,
+                    const std::vector<std::vector<TreeNodeIndex>>& activeOutgoing,
+                    const std::vector<std::vector<TreeNodeIndex>>& outgoingNodes,
+                    MPI_Comm comm = MPI_COMM_WORLD)
+{
+    int tag = nextTagEpoch(comm, ExchangeKind::halos);
+
+    std::vector<MPI_Request> sendRequests;
+    for (std::size_t rank = 0; rank < outgoingNodes.size(); ++rank)
+    {
+        if (outgoingNodes[rank].empty()) { continue; }
+        mpiSendAsync(activeOutgoing[rank].data(), int(activeOutgoing[rank].size()), int(rank), tag, sendRequests, comm);
+    }
+
+    int numMessages = 0;
+    for (const auto& nodes : incomingNodes)
+    {
+        if (!nodes.empty()) { numMessages++; }
+    }
+
+    std::vector<std::vector<TreeNodeIndex>> activeIncoming(incomingNodes.size());
+    for (int i = 0; i < numMessages; ++i)
+    {
+        MPI_Status status;
+        MPI_Probe(MPI_ANY_SOURCE, tag, comm, &status);
+
+        int count;
+        MPI_Get_count(&status, MpiType<TreeNodeIndex>{}, &count);
+
+        auto& nodes = activeIncoming[status.MPI_SOURCE];
+        nodes.resize(count);
+        mpiRecvSync(nodes.data(), count, status.MPI_SOURCE, tag, &status, comm);
+    }
+
+    if (!sendRequests.empty()) { MPI_Waitall(int(sendRequests.size()), sendRequests.data(), MPI_STATUSES_IGNORE); }
+
+    return activeIncoming;
+}
+
+} // namespace cstone
@@ -31,49 +31,188 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
+#include "cstone/primitives/byte_array.hpp"
+#include "cstone/primitives/mpi_graph.hpp"
+#include "cstone/primitives/mpi_shared_window.hpp"
 #include "cstone/primitives/mpi_wrappers.hpp"
+#include "cstone/primitives/reduced_precision.hpp"
 #include "cstone/util/index_ranges.hpp"
+#include "cstone/util/tracing.hpp"
 
 namespace cstone
 {
 
-template<class T, class...Arrays>
-void haloexchange(const SendList& incomingHalos,
+/*! @brief copy the elements of @p arrays in the index ranges of @p manifest into a byte buffer
+ *
+ * @param[in]  manifest   index ranges to pack
+ * @param[out] buffer     output, length manifest.totalCount() * packedElementBytes(arrays, numArrays) bytes
+ * @param[in]  arrays     type-erased arrays, possibly of different element types
+ * @param[in]  numArrays  number of arrays
+ * @return                one past the last byte written to @p buffer
+ *
+ * The buffer holds the elements of the first array in all ranges, followed by those of the second array and so on.
+ */
+inline char* packRanges(const SendManifest& manifest, char* buffer, const ByteArray* arrays, int numArrays)
+{
+    for (int i = 0; i < numArrays; ++i)
+    {
+        for (std::size_t rangeIdx = 0; rangeIdx < manifest.nRanges(); ++rangeIdx)
+        {
+            std::size_t numBytes = manifest.count(rangeIdx) * arrays[i].elementSize;
+            std::memcpy(buffer, (arrays[i] + manifest.rangeStart(rangeIdx)).data, numBytes);
+            buffer += numBytes;
+        }
+    }
+    return buffer;
+}
+
+//! @brief inverse of packRanges, copy the buffer into the index ranges of @p manifest
+inline const char* unpackRanges(const SendManifest& manifest, const char* buffer, const ByteArray* arrays,
+                                int numArrays)
+{
+    for (int i = 0; i < numArrays; ++i)
+    {
+        for (std::size_t rangeIdx = 0; rangeIdx < manifest.nRanges(); ++rangeIdx)
+        {
+            std::size_t numBytes = manifest.count(rangeIdx) * arrays[i].elementSize;
+            std::memcpy((arrays[i] + manifest.rangeStart(rangeIdx)).data, buffer, numBytes);
+            buffer += numBytes;
+        }
+    }
+    return buffer;
+}
+
+namespace detail
+{
+
+template<class T>
+char* packArray(const SendManifest& manifest, char* buffer, T* array)
+{
+    static_assert(std::is_trivially_copyable_v<T>, "exchanged array elements need to be trivially copyable\n");
+    for (std::size_t rangeIdx = 0; rangeIdx < manifest.nRanges(); ++rangeIdx)
+    {
+        std::size_t numBytes = manifest.count(rangeIdx) * sizeof(T);
+        std::memcpy(buffer, array + manifest.rangeStart(rangeIdx), numBytes);
+        buffer += numBytes;
+    }
+    return buffer;
+}
+
+//! @brief convert the elements in the ranges of @p manifest to Wire while packing
+template<class Wire, class T>
+char* packArray(const SendManifest& manifest, char* buffer, ReducedPrecision<Wire, T> array)
+{
+    for (std::size_t rangeIdx = 0; rangeIdx < manifest.nRanges(); ++rangeIdx)
+    {
+        for (auto i = manifest.rangeStart(rangeIdx); i < manifest.rangeEnd(rangeIdx); ++i)
+        {
+            Wire value(array.data[i]);
+            std::memcpy(buffer, &value, sizeof(Wire));
+            buffer += sizeof(Wire);
+        }
+    }
+    return buffer;
+}
+
+template<class T>
+const char* unpackArray(const SendManifest& manifest, const char* buffer, T* array)
+{
+    for (std::size_t rangeIdx = 0; rangeIdx < manifest.nRanges(); ++rangeIdx)
+    {
+        std::size_t numBytes = manifest.count(rangeIdx) * sizeof(T);
+        std::memcpy(array + manifest.rangeStart(rangeIdx), buffer, numBytes);
+        buffer += numBytes;
+    }
+    return buffer;
+}
+
+template<class Wire, class T>
+const char* unpackArray(const SendManifest& manifest, const char* buffer, ReducedPrecision<Wire, T> array)
+{
+    for (std::size_t rangeIdx = 0; rangeIdx < manifest.nRanges(); ++rangeIdx)
+    {
+        for (auto i = manifest.rangeStart(rangeIdx); i < manifest.rangeEnd(rangeIdx); ++i)
+        {
+            Wire value;
+            std::memcpy(&value, buffer, sizeof(Wire));
+            array.data[i] = T(value);
+            buffer += sizeof(Wire);
+        }
+    }
+    return buffer;
+}
+
+} // namespace detail
+
+/*! @brief packRanges for pointers to trivially copyable elements, possibly of different types
+ *
+ * Arrays wrapped in ReducedPrecision are converted to their transfer type.
+ */
+template<class... Arrays>
+std::enable_if_t<areHaloArrays<Arrays...>, char*> packRanges(const SendManifest& manifest, char* buffer,
+                                                             Arrays... arrays)
+{
+    ((buffer = detail::packArray(manifest, buffer, arrays)), ...);
+    return buffer;
+}
+
+//! @brief unpackRanges for pointers to trivially copyable elements, possibly of different types
+template<class... Arrays>
+std::enable_if_t<areHaloArrays<Arrays...>, const char*> unpackRanges(const SendManifest& manifest,
+                                                                     const char* buffer, Arrays... arrays)
+{
+    ((buffer = detail::unpackArray(manifest, buffer, arrays)), ...);
+    return buffer;
+}
+
+/*! @brief exchange the halos of the specified arrays in a single round of messages
+ *
+ * @param comm            communicator in which the ranks of @p incomingHalos and @p outgoingHalos are numbered
+ * @param incomingHalos   per source rank, the array index ranges to receive
+ * @param outgoingHalos   per destination rank, the array index ranges to send
+ * @param arrays          pointers to arrays of trivially copyable types, e.g. double coordinates together
+ *                        with float densities, integer flags and SFC keys. Floating point arrays wrapped
+ *                        with reducedPrecision are transferred with the precision of the wrapper.
+ *
+ * All arrays for one peer are packed into a single message.
+ */
+template<class... Arrays>
+void haloexchange(MPI_Comm comm,
+                  const SendList& incomingHalos,
                   const SendList& outgoingHalos,
                   Arrays... arrays)
 {
-    using IndexType = SendManifest::IndexType;
+    CSTONE_TRACE_RANGE("haloexchange");
+    static_assert((std::is_trivially_copyable_v<TransferElement_t<Arrays>> && ...),
+                  "exchanged array elements need to be trivially copyable\n");
+
+    constexpr std::size_t elementSize = transferElementSize<Arrays...>();
 
-    constexpr int nArrays = sizeof...(Arrays);
-    std::array<T*, nArrays> data{arrays...};
+    int haloTag = nextTagEpoch(comm, ExchangeKind::halos);
 
-    std::vector<std::vector<T>> sendBuffers;
-    std::vector<MPI_Request>    sendRequests;
+    std::vector<std::vector<char>> sendBuffers;
+    std::vector<MPI_Request>       sendRequests;
 
     for (std::size_t destinationRank = 0; destinationRank < outgoingHalos.size(); ++destinationRank)
     {
-        IndexType sendCount = outgoingHalos[destinationRank].totalCount();
+        std::size_t sendCount = outgoingHalos[destinationRank].totalCount();
         if (sendCount == 0)
             continue;
 
-        std::vector<T> buffer(sendCount * nArrays);
-        for (int arrayIndex = 0; arrayIndex < nArrays; ++arrayIndex)
-        {
-            IndexType outputOffset = sendCount * arrayIndex;
-            for (std::size_t rangeIdx = 0; rangeIdx < outgoingHalos[destinationRank].nRanges(); ++rangeIdx)
-            {
-                IndexType lowerIndex = outgoingHalos[destinationRank].rangeStart(rangeIdx);
-                IndexType upperIndex = outgoingHalos[destinationRank].rangeEnd(rangeIdx);
+        std::vector<char> buffer(sendCount * elementSize);
+        packRanges(outgoingHalos[destinationRank], buffer.data(), arrays...);
 
-                std::copy(data[arrayIndex]+lowerIndex, data[arrayIndex]+upperIndex,
-                          buffer.data() + outputOffset);
-                outputOffset += upperIndex - lowerIndex;
-            }
-        }
-
-        mpiSendAsync(buffer.data(), sendCount * nArrays, destinationRank, 0, sendRequests);
+        sendRequests.push_back(MPI_Request{});
+        MPI_Isend(buffer.data(), int(buffer.size()), MPI_CHAR, int(destinationRank), haloTag, comm,
+                  &sendRequests.back());
         sendBuffers.push_back(std::move(buffer));
     }
 
@@ -86,42 +225,396 @@ void haloexchange(const SendList& incomingHalos,
             maxReceiveSize = std::max(maxReceiveSize, incomingHalos[sourceRank].totalCount());
         }
 
-    std::vector<T> receiveBuffer(maxReceiveSize * nArrays);
+    std::vector<char> receiveBuffer(maxReceiveSize * elementSize);
 
     while (nMessages > 0)
     {
         MPI_Status status;
-        mpiRecvSync(receiveBuffer.data(), receiveBuffer.size(), MPI_ANY_SOURCE, 0, &status);
-        int receiveRank = status.MPI_SOURCE;
-        size_t countPerArray = incomingHalos[receiveRank].totalCount();
+        MPI_Recv(receiveBuffer.data(), int(receiveBuffer.size()), MPI_CHAR, MPI_ANY_SOURCE, haloTag, comm,
+                 &status);
+        unpackRanges(incomingHalos[status.MPI_SOURCE], receiveBuffer.data(), arrays...);
+        nMessages--;
+    }
+
+    if (not sendRequests.empty())
+    {
+        MPI_Waitall(int(sendRequests.size()), sendRequests.data(), MPI_STATUSES_IGNORE);
+    }
+}
+
+//! @brief haloexchange among the ranks of MPI_COMM_WORLD
+template<class... Arrays>
+void haloexchange(const SendList& incomingHalos,
+                  const SendList& outgoingHalos,
+                  Arrays... arrays)
+{
+    haloexchange(MPI_COMM_WORLD, incomingHalos, outgoingHalos, arrays...);
+}
+
+/*! @brief halo exchange with persistent buffers through a neighborhood collective
+ *
+ * Performs the same exchange as haloexchange. The send and receive buffers are allocated once per exchange
+ * pattern and a distributed graph communicator is created from the peer ranks of the pattern, rebuilt only
+ * when the peers change. Each exchange is a single MPI_Ineighbor_alltoallv on that communicator, which allows the
+ * MPI library to apply its own schedule and avoids matching messages from MPI_ANY_SOURCE.
+ *
+ * Halos of peers on the same compute node bypass the MPI library. The sender packs them into its segment
+ * of an MPI-3 shared memory window and the receiver unpacks them directly from there, after a fence.
+ * Only halos of peers on other nodes are part of the neighborhood collective.
+ *
+ * setup() and all exchanges are collective operations over all ranks of the communicator passed to setup(),
+ * including ranks without any peers.
+ */
+class HaloExchanger
+{
+public:
+    HaloExchanger() = default;
+
+    /*! @brief copies the exchange pattern
+     *
+     * The copy creates its own graph communicator, node communicator and shared window on first use, over the same
+     * parent communicator as @p other.
+     */
+    HaloExchanger(const HaloExchanger& other)
+        : incoming_(other.incoming_)
+        , outgoing_(other.outgoing_)
+        , sendRanks_(other.sendRanks_)
+        , receiveRanks_(other.receiveRanks_)
+        , sendOffsets_(other.sendOffsets_)
+        , receiveOffsets_(other.receiveOffsets_)
+        , nodeSendRanks_(other.nodeSendRanks_)
+        , nodeReceiveRanks_(other.nodeReceiveRanks_)
+        , nodeSendOffsets_(other.nodeSendOffsets_)
+        , nodeReceiveOffsets_(other.nodeReceiveOffsets_)
+        , peerSegmentOffsets_(other.peerSegmentOffsets_)
+        , window_(other.window_)
+        , sendBuffer_(other.sendBuffer_.size())
+        , receiveBuffer_(other.receiveBuffer_.size())
+        , elementSize_(other.elementSize_)
+        , neighbors_(other.neighbors_)
+    {
+    }
+
+    HaloExchanger(HaloExchanger&& other) noexcept { swap(other); }
+
+    HaloExchanger& operator=(HaloExchanger other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
 
-        for (int arrayIndex = 0; arrayIndex < nArrays; ++arrayIndex)
+    /*! @brief set up a new exchange pattern
+     *
+     * @param incomingHalos   per source rank, the array index ranges to receive
+     * @param outgoingHalos   per destination rank, the array index ranges to send
+     * @param comm            communicator in which the ranks of the halo lists are numbered
+     */
+    void setup(const SendList& incomingHalos, const SendList& outgoingHalos, MPI_Comm comm = MPI_COMM_WORLD)
+    {
+        incoming_ = incomingHalos;
+        outgoing_ = outgoingHalos;
+
+        window_.init(comm);
+        setupPeers(outgoing_, false, sendRanks_, sendOffsets_);
+        setupPeers(incoming_, false, receiveRanks_, receiveOffsets_);
+        setupPeers(outgoing_, true, nodeSendRanks_, nodeSendOffsets_);
+        setupPeers(incoming_, true, nodeReceiveRanks_, nodeReceiveOffsets_);
+        neighbors_.setPeers(receiveRanks_, sendRanks_, comm);
+        exchangeSegmentOffsets();
+        resizeBuffers(std::max(elementSize_, sizeof(double)));
+    }
+
+    /*! @brief handle to an exchange in progress, see exchangeAsync
+     *
+     * @tparam Arrays  pointer types of the exchanged arrays
+     *
+     * The exchange is completed by wait() or at the latest by the destructor of the handle.
+     */
+    template<class... Arrays>
+    class Handle
+    {
+    public:
+        Handle(HaloExchanger* exchanger, std::tuple<Arrays...> arrays)
+            : exchanger_(exchanger)
+            , arrays_(arrays)
         {
-            size_t inputOffset = countPerArray * arrayIndex;
-            for (std::size_t rangeIdx = 0; rangeIdx < incomingHalos[receiveRank].nRanges(); ++rangeIdx)
-            {
-                IndexType offset = incomingHalos[receiveRank].rangeStart(rangeIdx);
-                size_t count     = incomingHalos[receiveRank].count(rangeIdx);
+        }
+
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+
+        Handle(Handle&& other) noexcept
+            : exchanger_(other.exchanger_)
+            , arrays_(other.arrays_)
+        {
+            other.exchanger_ = nullptr;
+        }
 
-                std::copy(receiveBuffer.data() + inputOffset, receiveBuffer.data() + inputOffset + count,
-                          data[arrayIndex]+offset);
+        ~Handle() { wait(); }
 
-                inputOffset += count;
+        //! @brief block until all halos have been received into the arrays and all sends have completed
+        void wait()
+        {
+            if (exchanger_)
+            {
+                std::apply([this](auto... arrays) { exchanger_->finish(arrays...); }, arrays_);
+                exchanger_ = nullptr;
             }
         }
-        nMessages--;
+
+    private:
+        HaloExchanger* exchanger_;
+        std::tuple<Arrays...> arrays_;
+    };
+
+    /*! @brief exchange halos of the specified arrays
+     *
+     * @param arrays   pointers to arrays of trivially copyable types, all of them need the size of the local
+     *                 particles plus halos. Arrays wrapped with reducedPrecision are transferred with the
+     *                 precision of the wrapper.
+     */
+    template<class... Arrays>
+    std::enable_if_t<areHaloArrays<Arrays...>> exchange(Arrays... arrays)
+    {
+        exchangeAsync(arrays...).wait();
     }
 
-    if (not sendRequests.empty())
+    /*! @brief start a halo exchange of the specified arrays and return without waiting for incoming halos
+     *
+     * @param arrays   pointers to arrays of trivially copyable types, all of them need the size of the local
+     *                 particles plus halos
+     * @return         a handle whose wait() completes the exchange
+     *
+     * The outgoing halos are copied into the send buffer before returning. Until wait() is called,
+     * the arrays can therefore be read and written anywhere except at the incoming halo indices.
+     * Only one exchange per HaloExchanger can be in progress at a time.
+     */
+    template<class... Arrays>
+    Handle<Arrays...> exchangeAsync(Arrays... arrays)
     {
-        MPI_Status status[sendRequests.size()];
-        MPI_Waitall(int(sendRequests.size()), sendRequests.data(), status);
+        static_assert((std::is_trivially_copyable_v<TransferElement_t<Arrays>> && ...),
+                      "exchanged array elements need to be trivially copyable\n");
+
+        start(arrays...);
+        return Handle<Arrays...>(this, std::make_tuple(arrays...));
     }
 
-    // prevent rank from sending further messages with tag 0 while other ranks
-    // are still listening to the messages sent out here
-    MPI_Barrier(MPI_COMM_WORLD);
-}
+    /*! @brief exchange halos of type-erased arrays, e.g. the fields of a ParticleContainer
+     *
+     * @param arrays     @p numArrays arrays with the size of the local particles plus halos
+     * @param numArrays  number of arrays
+     */
+    void exchange(const ByteArray* arrays, int numArrays)
+    {
+        start(arrays, numArrays);
+        finish(arrays, numArrays);
+    }
+
+private:
+    template<class... Arrays>
+    std::enable_if_t<areHaloArrays<Arrays...>> start(Arrays... arrays)
+    {
+        startExchange(transferElementSize<Arrays...>(),
+                      [arrays...](const SendManifest& manifest, char* buffer)
+                      { packRanges(manifest, buffer, arrays...); });
+    }
+
+    void start(const ByteArray* arrays, int numArrays)
+    {
+        startExchange(packedElementBytes(arrays, numArrays),
+                      [arrays, numArrays](const SendManifest& manifest, char* buffer)
+                      { packRanges(manifest, buffer, arrays, numArrays); });
+    }
+
+    /*! @brief pack the halos for peers on the same node into the shared window, the others into the send buffer
+     *
+     * @param elementSize  packed bytes per particle
+     * @param pack         callable with signature void(const SendManifest&, char* buffer)
+     */
+    template<class F>
+    void startExchange(std::size_t elementSize, F&& pack)
+    {
+        CSTONE_TRACE_RANGE("HaloExchanger::start");
+        if (elementSize > elementSize_ || !window_.allocated())
+        {
+            resizeBuffers(std::max(elementSize, elementSize_));
+        }
+
+        // the peers on this node have finished reading the halos of the previous exchange
+        window_.fence();
+        for (std::size_t i = 0; i < nodeSendRanks_.size(); ++i)
+        {
+            pack(outgoing_[nodeSendRanks_[i]], window_.localSegment() + nodeSendOffsets_[i] * elementSize);
+        }
+        // make the packed halos visible to the peers on this node
+        window_.fence();
+
+        for (std::size_t i = 0; i < sendRanks_.size(); ++i)
+        {
+            pack(outgoing_[sendRanks_[i]], sendBuffer_.data() + sendOffsets_[i] * elementSize);
+        }
+
+        byteCounts(sendOffsets_, elementSize, sendCounts_, sendDispls_);
+        byteCounts(receiveOffsets_, elementSize, receiveCounts_, receiveDispls_);
+
+        MPI_Ineighbor_alltoallv(sendBuffer_.data(), sendCounts_.data(), sendDispls_.data(), MPI_CHAR,
+                                receiveBuffer_.data(), receiveCounts_.data(), receiveDispls_.data(), MPI_CHAR,
+                                neighbors_.comm(), &request_);
+    }
+
+    template<class... Arrays>
+    std::enable_if_t<areHaloArrays<Arrays...>> finish(Arrays... arrays)
+    {
+        finishExchange(transferElementSize<Arrays...>(),
+                       [arrays...](const SendManifest& manifest, const char* buffer)
+                       { unpackRanges(manifest, buffer, arrays...); });
+    }
+
+    void finish(const ByteArray* arrays, int numArrays)
+    {
+        finishExchange(packedElementBytes(arrays, numArrays),
+                       [arrays, numArrays](const SendManifest& manifest, const char* buffer)
+                       { unpackRanges(manifest, buffer, arrays, numArrays); });
+    }
+
+    //! @brief complete the neighborhood collective and unpack the incoming halos, see startExchange
+    template<class F>
+    void finishExchange(std::size_t elementSize, F&& unpack)
+    {
+        CSTONE_TRACE_RANGE("HaloExchanger::finish");
+        MPI_Wait(&request_, MPI_STATUS_IGNORE);
+
+        for (std::size_t i = 0; i < receiveRanks_.size(); ++i)
+        {
+            unpack(incoming_[receiveRanks_[i]], receiveBuffer_.data() + receiveOffsets_[i] * elementSize);
+        }
+
+        for (std::size_t i = 0; i < nodeReceiveRanks_.size(); ++i)
+        {
+            const char* peerSegment = window_.segment(window_.nodeRank(nodeReceiveRanks_[i]));
+            unpack(incoming_[nodeReceiveRanks_[i]], peerSegment + peerSegmentOffsets_[i] * elementSize);
+        }
+    }
+
+    //! @brief convert per-peer particle offsets into byte counts and displacements
+    static void byteCounts(const std::vector<std::size_t>& offsets, std::size_t elementSize,
+                           std::vector<int>& counts, std::vector<int>& displacements)
+    {
+        std::size_t numPeers = offsets.size() - 1;
+        counts.resize(numPeers);
+        displacements.resize(numPeers);
+        for (std::size_t i = 0; i < numPeers; ++i)
+        {
+            counts[i]        = int((offsets[i + 1] - offsets[i]) * elementSize);
+            displacements[i] = int(offsets[i] * elementSize);
+        }
+    }
+
+    /*! @brief extract ranks with non-zero message sizes and compute their offsets in the message buffer
+     *
+     * @param[in]  halos    per rank index ranges
+     * @param[in]  onNode   if true, extract the ranks on the same node, otherwise the ranks on other nodes
+     * @param[out] ranks    the extracted ranks
+     * @param[out] offsets  offsets in particles, length ranks.size() + 1
+     */
+    void setupPeers(const SendList& halos, bool onNode, std::vector<int>& ranks, std::vector<std::size_t>& offsets)
+    {
+        ranks.clear();
+        offsets.assign(1, 0);
+        for (std::size_t rank = 0; rank < halos.size(); ++rank)
+        {
+            if (halos[rank].totalCount() == 0) { continue; }
+            if ((window_.nodeRank(rank) != MPI_UNDEFINED) != onNode) { continue; }
+            ranks.push_back(rank);
+            offsets.push_back(offsets.back() + halos[rank].totalCount());
+        }
+    }
+
+    //! @brief tell each peer on the node where its halos are located in the segment of the calling rank
+    void exchangeSegmentOffsets()
+    {
+        std::vector<uint64_t> sendOffsets(window_.nodeSize(), 0);
+        std::vector<uint64_t> receiveOffsets(window_.nodeSize());
+        for (std::size_t i = 0; i < nodeSendRanks_.size(); ++i)
+        {
+            sendOffsets[window_.nodeRank(nodeSendRanks_[i])] = nodeSendOffsets_[i];
+        }
+
+        MPI_Alltoall(sendOffsets.data(), 1, MPI_UINT64_T, receiveOffsets.data(), 1, MPI_UINT64_T,
+                     window_.nodeComm());
+
+        peerSegmentOffsets_.resize(nodeReceiveRanks_.size());
+        for (std::size_t i = 0; i < nodeReceiveRanks_.size(); ++i)
+        {
+            peerSegmentOffsets_[i] = receiveOffsets[window_.nodeRank(nodeReceiveRanks_[i])];
+        }
+    }
+
+    //! @brief resize the buffers and the shared window segment, collective over the ranks of a node
+    void resizeBuffers(std::size_t elementSize)
+    {
+        elementSize_ = elementSize;
+        sendBuffer_.resize(sendOffsets_.back() * elementSize);
+        receiveBuffer_.resize(receiveOffsets_.back() * elementSize);
+        window_.allocate(nodeSendOffsets_.back() * elementSize);
+    }
+
+    void swap(HaloExchanger& other) noexcept
+    {
+        std::swap(incoming_, other.incoming_);
+        std::swap(outgoing_, other.outgoing_);
+        std::swap(sendRanks_, other.sendRanks_);
+        std::swap(receiveRanks_, other.receiveRanks_);
+        std::swap(sendOffsets_, other.sendOffsets_);
+        std::swap(receiveOffsets_, other.receiveOffsets_);
+        std::swap(nodeSendRanks_, other.nodeSendRanks_);
+        std::swap(nodeReceiveRanks_, other.nodeReceiveRanks_);
+        std::swap(nodeSendOffsets_, other.nodeSendOffsets_);
+        std::swap(nodeReceiveOffsets_, other.nodeReceiveOffsets_);
+        std::swap(peerSegmentOffsets_, other.peerSegmentOffsets_);
+        std::swap(window_, other.window_);
+        std::swap(sendBuffer_, other.sendBuffer_);
+        std::swap(receiveBuffer_, other.receiveBuffer_);
+        std::swap(elementSize_, other.elementSize_);
+        std::swap(neighbors_, other.neighbors_);
+        std::swap(request_, other.request_);
+    }
+
+    SendList incoming_;
+    SendList outgoing_;
+
+    //! @brief ranks on other nodes with non-zero message sizes
+    std::vector<int> sendRanks_;
+    std::vector<int> receiveRanks_;
+    //! @brief message offsets in particles into the buffers, length = number of ranks + 1
+    std::vector<std::size_t> sendOffsets_{0};
+    std::vector<std::size_t> receiveOffsets_{0};
+
+    //! @brief ranks on the same node with non-zero halo counts and their offsets in particles
+    std::vector<int> nodeSendRanks_;
+    std::vector<int> nodeReceiveRanks_;
+    std::vector<std::size_t> nodeSendOffsets_{0};
+    std::vector<std::size_t> nodeReceiveOffsets_{0};
+    //! @brief for each rank in nodeReceiveRanks_, the offset of the halos in its window segment
+    std::vector<std::size_t> peerSegmentOffsets_;
+    //! @brief holds the packed halos for peers on the same node, nodeSendOffsets_.back() * elementSize_ bytes
+    SharedWindow window_;
+
+    //! @brief the buffers fit messages with up to elementSize_ bytes per particle
+    std::vector<char> sendBuffer_;
+    std::vector<char> receiveBuffer_;
+    std::size_t elementSize_{0};
+
+    //! @brief graph communicator with the ranks in receiveRanks_ as sources and sendRanks_ as destinations
+    NeighborCommunicator neighbors_;
+    //! @brief byte counts and displacements per peer for the current exchange
+    std::vector<int> sendCounts_;
+    std::vector<int> sendDispls_;
+    std::vector<int> receiveCounts_;
+    std::vector<int> receiveDispls_;
+
+    MPI_Request request_{MPI_REQUEST_NULL};
+};
 
 } // namespace cstone
 
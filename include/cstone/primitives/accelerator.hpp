@@ -0,0 +1,194 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Data-parallel primitives with implementations selected by the accelerator tag
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * Each primitive takes CpuTag or CudaTag as its first argument. With CpuTag, the arrays are in host memory and
+ * the primitives are multi-threaded with OpenMP. With CudaTag, the arrays are in device memory and the
+ * implementations in primitives_gpu.cu are used, which requires linking with primitives_gpu_obj.
+ * Code that is templated on the accelerator can therefore be written once, e.g. as
+ *
+ *      exclusiveScan(Accelerator{}, counts, offsets, numNodes + 1);
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "cstone/cuda/primitives_gpu.cuh"
+#include "cstone/primitives/gather.hpp"
+#include "cstone/primitives/radix_sort.hpp"
+#include "cstone/primitives/scan.hpp"
+
+namespace cstone
+{
+
+//! @brief selects host implementations, arrays are in host memory
+struct CpuTag {};
+//! @brief selects CUDA implementations, arrays are in device memory
+struct CudaTag {};
+
+/*! @brief sort @p keys and permute @p values in the same way
+ *
+ * Unsigned integer keys such as SFC keys are sorted with the stable radixSortByKey, other key types with a
+ * comparison sort.
+ */
+template<class KeyType, class ValueType>
+void sortByKey(CpuTag, KeyType* keys, ValueType* values, std::size_t numElements)
+{
+    if constexpr (std::is_unsigned_v<KeyType>) { radixSortByKey(keys, values, numElements); }
+    else { sort_by_key(keys, keys + numElements, values, std::less<KeyType>{}); }
+}
+
+template<class KeyType, class ValueType>
+void sortByKey(CudaTag, KeyType* keys, ValueType* values, std::size_t numElements)
+{
+    sortByKeyGpu(keys, values, numElements);
+}
+
+//! @brief exclusive prefix sum of @p in to @p out, in-place if in == out
+template<class T>
+void exclusiveScan(CpuTag, const T* in, T* out, std::size_t numElements)
+{
+    if (in == out) { exclusiveScan(out, numElements); }
+    else
+    {
+#ifdef _OPENMP
+        exclusiveScan(in, out, numElements);
+#else
+        stl::exclusive_scan(in, in + numElements, out, T(0));
+#endif
+    }
+}
+
+template<class T>
+void exclusiveScan(CudaTag, const T* in, T* out, std::size_t numElements)
+{
+    exclusiveScanGpu(in, out, numElements);
+}
+
+//! @brief inclusive prefix sum of @p in to @p out, in-place if in == out
+template<class T>
+void inclusiveScan(CpuTag, const T* in, T* out, std::size_t numElements)
+{
+    std::inclusive_scan(in, in + numElements, out);
+}
+
+template<class T>
+void inclusiveScan(CudaTag, const T* in, T* out, std::size_t numElements)
+{
+    inclusiveScanGpu(in, out, numElements);
+}
+
+//! @brief the smallest and largest element of the non-empty array @p in
+template<class T>
+std::tuple<T, T> minMax(CpuTag, const T* in, std::size_t numElements)
+{
+    T minimum = in[0], maximum = in[0];
+
+    #pragma omp parallel for reduction(min : minimum) reduction(max : maximum) schedule(static)
+    for (std::size_t i = 0; i < numElements; ++i)
+    {
+        minimum = std::min(minimum, in[i]);
+        maximum = std::max(maximum, in[i]);
+    }
+
+    return {minimum, maximum};
+}
+
+template<class T>
+std::tuple<T, T> minMax(CudaTag, const T* in, std::size_t numElements)
+{
+    return minMaxGpu(in, numElements);
+}
+
+//! @brief out[i] = in[map[i]] for i in [0:numElements], @p in and @p out may not overlap
+template<class IndexType, class ValueType>
+void gatherValues(CpuTag, const IndexType* map, std::size_t numElements, const ValueType* in, ValueType* out)
+{
+    #pragma omp parallel for schedule(static)
+    for (std::size_t i = 0; i < numElements; ++i)
+    {
+        out[i] = in[map[i]];
+    }
+}
+
+template<class IndexType, class ValueType>
+void gatherValues(CudaTag, const IndexType* map, std::size_t numElements, const ValueType* in, ValueType* out)
+{
+    gatherGpu(map, numElements, in, out);
+}
+
+//! @brief out[map[i]] = in[i] for i in [0:numElements], @p in and @p out may not overlap
+template<class IndexType, class ValueType>
+void scatterValues(CpuTag, const IndexType* map, std::size_t numElements, const ValueType* in, ValueType* out)
+{
+    #pragma omp parallel for schedule(static)
+    for (std::size_t i = 0; i < numElements; ++i)
+    {
+        out[map[i]] = in[i];
+    }
+}
+
+template<class IndexType, class ValueType>
+void scatterValues(CudaTag, const IndexType* map, std::size_t numElements, const ValueType* in, ValueType* out)
+{
+    scatterGpu(map, numElements, in, out);
+}
+
+/*! @brief sum over the segments of @p values
+ *
+ * @param[in]  values       input values
+ * @param[in]  offsets      segment s covers values[offsets[s]:offsets[s+1]], length @p numSegments + 1,
+ *                          e.g. the particle layout of octree leaves
+ * @param[in]  numSegments  number of segments
+ * @param[out] out          segment sums, length @p numSegments
+ */
+template<class ValueType, class IndexType>
+void segmentedReduce(CpuTag, const ValueType* values, const IndexType* offsets, std::size_t numSegments,
+                     ValueType* out)
+{
+    #pragma omp parallel for schedule(static)
+    for (std::size_t s = 0; s < numSegments; ++s)
+    {
+        out[s] = std::accumulate(values + offsets[s], values + offsets[s + 1], ValueType(0));
+    }
+}
+
+template<class ValueType, class IndexType>
+void segmentedReduce(CudaTag, const ValueType* values, const IndexType* offsets, std::size_t numSegments,
+                     ValueType* out)
+{
+    segmentedReduceGpu(values, offsets, numSegments, out);
+}
+
+} // namespace cstone
@@ -0,0 +1,122 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Type-erased views of arrays for exchanging fields of different types in a single message
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+namespace cstone
+{
+
+//! @brief untyped pointer to an array of trivially copyable elements with an element size known at runtime
+struct ByteArray
+{
+    char* data;
+    std::size_t elementSize;
+
+    //! @brief the array starting from element @p offset
+    [[nodiscard]] ByteArray operator+(std::size_t offset) const { return {data + offset * elementSize, elementSize}; }
+};
+
+//! @brief type-erase a pointer to trivially copyable elements
+template<class T>
+ByteArray byteArray(T* array)
+{
+    static_assert(std::is_trivially_copyable_v<T>, "exchanged array elements need to be trivially copyable\n");
+    return {reinterpret_cast<char*>(array), sizeof(T)};
+}
+
+//! @brief true if all @p Arrays are typed pointers, used to separate typed overloads from those for ByteArray lists
+template<class... Arrays>
+constexpr bool areTypedArrays = (std::is_pointer_v<Arrays> && ...);
+
+//! @brief number of bytes of one element of each array when packed into a single message
+inline std::size_t packedElementBytes(const ByteArray* arrays, int numArrays)
+{
+    std::size_t elementSize = 0;
+    for (int i = 0; i < numArrays; ++i)
+    {
+        elementSize += arrays[i].elementSize;
+    }
+    return elementSize;
+}
+
+namespace detail
+{
+
+//! @brief buffer[i] = source[indices[i]] for elements of ElementSize bytes
+template<std::size_t ElementSize, class IndexType>
+void gatherElements(const IndexType* indices, std::size_t count, const char* source, char* buffer)
+{
+    #pragma omp parallel for schedule(static)
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        std::memcpy(buffer + i * ElementSize, source + indices[i] * ElementSize, ElementSize);
+    }
+}
+
+//! @brief buffer[i] = source[indices[i]] for elements of @p elementSize bytes
+template<class IndexType>
+void gatherElements(const IndexType* indices, std::size_t count, const char* source, char* buffer,
+                    std::size_t elementSize)
+{
+    #pragma omp parallel for schedule(static)
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        std::memcpy(buffer + i * elementSize, source + indices[i] * elementSize, elementSize);
+    }
+}
+
+} // namespace detail
+
+/*! @brief gather the elements of @p array at @p indices into a contiguous byte buffer
+ *
+ * @param[in]  indices  element indices to pack, length @p count
+ * @param[in]  count    number of elements to pack
+ * @param[in]  array    the array to gather from
+ * @param[out] buffer   output, length count * array.elementSize bytes
+ *
+ * The common element sizes are dispatched to copies with a compile-time size.
+ */
+template<class IndexType>
+void gatherBytes(const IndexType* indices, std::size_t count, ByteArray array, char* buffer)
+{
+    switch (array.elementSize)
+    {
+        case 4: detail::gatherElements<4>(indices, count, array.data, buffer); break;
+        case 8: detail::gatherElements<8>(indices, count, array.data, buffer); break;
+        default: detail::gatherElements(indices, count, array.data, buffer, array.elementSize);
+    }
+}
+
+} // namespace cstone
@@ -34,11 +34,15 @@
 
 #include <algorithm>
 #include <cassert>
+#include <functional>
 #include <numeric>
 #include <tuple>
 #include <vector>
 
+#include "cstone/primitives/radix_sort.hpp"
 #include "cstone/sfc/morton.hpp"
+#include "cstone/util/executor.hpp"
+#include "cstone/util/tracing.hpp"
 
 namespace cstone
 {
@@ -62,21 +66,19 @@ void sort_by_key(InoutIterator keyBegin, InoutIterator keyEnd, OutputIterator va
 
     // zip the input integer array together with the index sequence
     std::vector<std::tuple<KeyType, ValueType>> keyIndexPairs(n);
-    #pragma omp parallel for schedule(static)
-    for (std::size_t i = 0; i < n; ++i)
-        keyIndexPairs[i] = std::make_tuple(keyBegin[i], valueBegin[i]);
+    parallelFor(std::size_t(0), n,
+                [&](std::size_t i) { keyIndexPairs[i] = std::make_tuple(keyBegin[i], valueBegin[i]); });
 
     // sort, comparing only the first tuple element
     std::sort(begin(keyIndexPairs), end(keyIndexPairs),
               [compare](const auto& t1, const auto& t2){ return compare(std::get<0>(t1), std::get<0>(t2)); });
 
     // extract the resulting ordering and store back the sorted keys
-    #pragma omp parallel for schedule(static)
-    for (std::size_t i = 0; i < n; ++i)
+    parallelFor(std::size_t(0), n, [&](std::size_t i)
     {
         keyBegin[i]  = std::get<0>(keyIndexPairs[i]);
         valueBegin[i] = std::get<1>(keyIndexPairs[i]);
-    }
+    });
 }
 
 //! @brief calculate the sortKey that sorts the input sequence, default ascending order
@@ -101,16 +103,8 @@ void reorder(const std::vector<I>& ordering, std::vector<ValueType>& array)
     assert(array.size() >= ordering.size());
 
     std::vector<ValueType> tmp(array.size());
-    #pragma omp parallel for schedule(static)
-    for (std::size_t i = 0; i < ordering.size(); ++i)
-    {
-        tmp[i] = array[ordering[i]];
-    }
-    #pragma omp parallel for schedule(static)
-    for (std::size_t i = ordering.size(); i < array.size(); ++i)
-    {
-        tmp[i] = array[i];
-    }
+    parallelFor(std::size_t(0), ordering.size(), [&](std::size_t i) { tmp[i] = array[ordering[i]]; });
+    parallelFor(ordering.size(), array.size(), [&](std::size_t i) { tmp[i] = array[i]; });
     swap(tmp, array);
 }
 
@@ -130,23 +124,9 @@ void reorder(const std::vector<I>& ordering, std::vector<ValueType>& array, int
 
     std::vector<ValueType> tmp(array.size());
 
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < offset; ++i)
-    {
-        tmp[i] = array[i];
-    }
-
-    #pragma omp parallel for schedule(static)
-    for (std::size_t i = 0; i < ordering.size(); ++i)
-    {
-        tmp[i+offset] = array[ordering[i]+offset];
-    }
-
-    #pragma omp parallel for schedule(static)
-    for (size_t i = ordering.size()+offset; i < array.size(); ++i)
-    {
-        tmp[i] = array[i];
-    }
+    parallelFor(0, offset, [&](int i) { tmp[i] = array[i]; });
+    parallelFor(std::size_t(0), ordering.size(), [&](std::size_t i) { tmp[i + offset] = array[ordering[i] + offset]; });
+    parallelFor(ordering.size() + offset, array.size(), [&](std::size_t i) { tmp[i] = array[i]; });
 
     swap(tmp, array);
 }
@@ -163,15 +143,266 @@ template<class LocalIndex, class ValueType>
 void reorderInPlace(const std::vector<LocalIndex>& ordering, ValueType* array)
 {
     std::vector<ValueType> tmp(ordering.size());
-    #pragma omp parallel for schedule(static)
-    for (std::size_t i = 0; i < ordering.size(); ++i)
+    ValueType* tmpData = tmp.data();
+    parallelFor(std::size_t(0), ordering.size(), [&ordering, array, tmpData](std::size_t i)
+                { tmpData[i] = array[ordering[i]]; });
+    parallelFor(std::size_t(0), ordering.size(), [array, tmpData](std::size_t i) { array[i] = tmpData[i]; });
+}
+
+/*! @brief gather multiple arrays with the same ordering in a single blocked pass
+ *
+ * @tparam IndexType          integer type
+ * @tparam ValueType          any trivially copyable type
+ * @param[in]  ordering       gather map, length @p numElements
+ * @param[in]  numElements    number of elements to gather per array
+ * @param[in]  sources        @p numArrays input arrays
+ * @param[out] destinations   @p numArrays output arrays with destinations[a][i] = sources[a][ordering[i]],
+ *                            must not overlap with @p sources
+ * @param[in]  numArrays      number of arrays
+ *
+ * The ordering is processed in blocks that stay in cache while they are applied to all arrays,
+ * such that the ordering is only loaded once from memory. The irregular reads from the sources are prefetched.
+ */
+template<class IndexType, class ValueType>
+void gatherArrays(const IndexType* ordering, std::size_t numElements, const ValueType* const* sources,
+                  ValueType* const* destinations, int numArrays)
+{
+    constexpr std::size_t blockSize        = 2048;
+    constexpr std::size_t prefetchDistance = 16;
+
+    std::size_t numBlocks = (numElements + blockSize - 1) / blockSize;
+
+    parallelFor(std::size_t(0), numBlocks, [=](std::size_t block)
+    {
+        std::size_t first = block * blockSize;
+        std::size_t last  = std::min(first + blockSize, numElements);
+
+        for (int a = 0; a < numArrays; ++a)
+        {
+            const ValueType* source = sources[a];
+            ValueType* destination  = destinations[a];
+
+            for (std::size_t i = first; i < last; ++i)
+            {
+#if defined(__GNUC__) || defined(__clang__)
+                if (i + prefetchDistance < last) { __builtin_prefetch(source + ordering[i + prefetchDistance]); }
+#endif
+                destination[i] = source[ordering[i]];
+            }
+        }
+    });
+}
+
+/*! @brief sort values according to keys, exploiting existing order of nearly sorted keys
+ *
+ * @tparam KeyType          32- or 64-bit unsigned integer
+ * @tparam ValueType        payload type, e.g. particle indices
+ * @param[inout] keys       input keys, length = @p numElements, sorted on return
+ * @param[inout] values     input values, length = @p numElements, permuted in the same way as @p keys
+ * @param[in] numElements   number of keys to sort
+ * @param[-] keyBuffer      temporary storage, length = @p numElements
+ * @param[-] valueBuffer    temporary storage, length = @p numElements
+ * @param[in] maxDisorder   maximum fraction of out-of-order keys, in [0, 0.5], for which the
+ *                          incremental path is used
+ * @return                  true if the incremental path was used, false if all keys were radix sorted
+ *
+ * Keys that break the ascending order are moved out of the sequence, sorted separately and merged
+ * back into the remaining sorted run. If the number of out-of-order keys exceeds
+ * maxDisorder * numElements, this falls back to a full radix sort. The incremental path is O(N),
+ * but the removal of out-of-order keys and the merge run serially.
+ */
+template<class KeyType, class ValueType>
+bool sortNearlySortedByKey(KeyType* keys, ValueType* values, std::size_t numElements,
+                           KeyType* keyBuffer, ValueType* valueBuffer, float maxDisorder)
+{
+    // the radix sort of the out-of-order keys uses the second half of the buffers as temporary storage
+    std::size_t maxOutliers = std::min(std::size_t(maxDisorder * numElements), numElements / 2);
+
+    std::size_t numDescents = parallelReduce(
+        std::size_t(1), numElements, std::size_t(0), [keys](std::size_t i) { return std::size_t(keys[i] < keys[i - 1]); },
+        std::plus<std::size_t>{});
+
+    if (numDescents == 0) { return true; }
+
+    // each descent implies at least one key out of order
+    if (numDescents > maxOutliers)
     {
-        tmp[i] = array[ordering[i]];
+        radixSortByKey(keys, values, numElements, keyBuffer, valueBuffer);
+        return false;
     }
-    #pragma omp parallel for schedule(static)
-    for (std::size_t i = 0; i < ordering.size(); ++i)
+
+    // compact the keys in sorted order into the front of keys, move out-of-order keys to keyBuffer
+    std::size_t numKept     = 0;
+    std::size_t numOutliers = 0;
+    for (std::size_t i = 0; i < numElements; ++i)
     {
-        array[i] = tmp[i];
+        if (numKept > 0 && keys[i] < keys[numKept - 1])
+        {
+            if (numOutliers == maxOutliers)
+            {
+                // too much disorder, fill the gap between the kept and the unprocessed keys and sort everything
+                std::copy(keyBuffer, keyBuffer + numOutliers, keys + numKept);
+                std::copy(valueBuffer, valueBuffer + numOutliers, values + numKept);
+                radixSortByKey(keys, values, numElements, keyBuffer, valueBuffer);
+                return false;
+            }
+
+            if (numKept > 1 && keys[i] >= keys[numKept - 2])
+            {
+                // the last kept key is a spike, replace it with the current one
+                keyBuffer[numOutliers]     = keys[numKept - 1];
+                valueBuffer[numOutliers++] = values[numKept - 1];
+                keys[numKept - 1]          = keys[i];
+                values[numKept - 1]        = values[i];
+            }
+            else
+            {
+                // the current key is a dip
+                keyBuffer[numOutliers]     = keys[i];
+                valueBuffer[numOutliers++] = values[i];
+            }
+        }
+        else
+        {
+            keys[numKept]     = keys[i];
+            values[numKept++] = values[i];
+        }
+    }
+
+    radixSortByKey(keyBuffer, valueBuffer, numOutliers, keyBuffer + numOutliers, valueBuffer + numOutliers);
+
+    // merge from the back, the free space at the end of keys holds exactly numOutliers elements
+    std::size_t out = numElements;
+    while (numOutliers > 0)
+    {
+        --out;
+        if (numKept > 0 && keys[numKept - 1] > keyBuffer[numOutliers - 1])
+        {
+            --numKept;
+            keys[out]   = keys[numKept];
+            values[out] = values[numKept];
+        }
+        else
+        {
+            --numOutliers;
+            keys[out]   = keyBuffer[numOutliers];
+            values[out] = valueBuffer[numOutliers];
+        }
+    }
+
+    return true;
+}
+
+/*! @brief merge two sorted key sequences together with their values
+ *
+ * @param[in]  keysA      first sorted key sequence, length @p numA
+ * @param[in]  valuesA    values of @p keysA
+ * @param[in]  numA
+ * @param[in]  keysB      second sorted key sequence, length @p numB
+ * @param[in]  valuesB    values of @p keysB
+ * @param[in]  numB
+ * @param[out] keysOut    merged keys, length numA + numB, must not overlap with the inputs
+ * @param[out] valuesOut  values of @p keysOut
+ *
+ * Elements of the first sequence precede equal keys of the second. The merge path is split into chunks
+ * of equal length that are merged in parallel, the chunk boundaries are located with binary searches.
+ */
+template<class KeyType, class ValueType>
+void mergeByKey(const KeyType* keysA, const ValueType* valuesA, std::size_t numA, const KeyType* keysB,
+                const ValueType* valuesB, std::size_t numB, KeyType* keysOut, ValueType* valuesOut)
+{
+    constexpr std::size_t chunkSize = 16384;
+
+    // number of elements of A among the first @p diagonal elements of the merged sequence
+    auto splitA = [keysA, keysB, numA, numB](std::size_t diagonal)
+    {
+        std::size_t lo = (diagonal > numB) ? diagonal - numB : 0;
+        std::size_t hi = std::min(diagonal, numA);
+        while (lo < hi)
+        {
+            std::size_t mid = (lo + hi) / 2;
+            if (keysA[mid] <= keysB[diagonal - mid - 1]) { lo = mid + 1; }
+            else { hi = mid; }
+        }
+        return lo;
+    };
+
+    std::size_t numMerged = numA + numB;
+    std::size_t numChunks = (numMerged + chunkSize - 1) / chunkSize;
+
+    parallelFor(std::size_t(0), numChunks, [=](std::size_t chunk)
+    {
+        std::size_t diagStart = chunk * chunkSize;
+        std::size_t diagEnd   = std::min(diagStart + chunkSize, numMerged);
+
+        std::size_t a = splitA(diagStart), aEnd = splitA(diagEnd);
+        std::size_t b = diagStart - a, bEnd = diagEnd - aEnd;
+
+        for (std::size_t out = diagStart; out < diagEnd; ++out)
+        {
+            if (b < bEnd && (a == aEnd || keysB[b] < keysA[a]))
+            {
+                keysOut[out]   = keysB[b];
+                valuesOut[out] = valuesB[b++];
+            }
+            else
+            {
+                keysOut[out]   = keysA[a];
+                valuesOut[out] = valuesA[a++];
+            }
+        }
+    });
+}
+
+/*! @brief sort a key sequence that consists of sorted segments, together with its values
+ *
+ * @param[inout] keys          keys, each segment is sorted
+ * @param[inout] values        values of @p keys
+ * @param[in]    segments      segment boundaries, segment i is [segments[i]:segments[i+1]], length @p numSegments + 1,
+ *                             segments[0] must be zero
+ * @param[in]    numSegments
+ * @param[-]     keyBuffer     temporary storage, length segments[numSegments]
+ * @param[-]     valueBuffer   temporary storage, length segments[numSegments]
+ *
+ * Neighboring segments are merged pairwise until a single segment remains, which is O(N log(numSegments)) instead
+ * of a full sort. Within equal keys, elements of earlier segments come first.
+ */
+template<class KeyType, class ValueType>
+void mergeSortedSegmentsByKey(KeyType* keys, ValueType* values, const std::size_t* segments, std::size_t numSegments,
+                              KeyType* keyBuffer, ValueType* valueBuffer)
+{
+    std::vector<std::size_t> bounds(segments, segments + numSegments + 1);
+
+    KeyType*   keysIn    = keys;
+    ValueType* valuesIn  = values;
+    KeyType*   keysOut   = keyBuffer;
+    ValueType* valuesOut = valueBuffer;
+
+    while (bounds.size() > 2)
+    {
+        std::size_t              numRuns = bounds.size() - 1;
+        std::vector<std::size_t> merged;
+        for (std::size_t run = 0; run < numRuns; run += 2)
+        {
+            std::size_t first = bounds[run], mid = bounds[run + 1];
+            std::size_t last  = (run + 1 < numRuns) ? bounds[run + 2] : mid;
+
+            mergeByKey(keysIn + first, valuesIn + first, mid - first, keysIn + mid, valuesIn + mid, last - mid,
+                       keysOut + first, valuesOut + first);
+            merged.push_back(first);
+        }
+        merged.push_back(bounds.back());
+
+        bounds.swap(merged);
+        std::swap(keysIn, keysOut);
+        std::swap(valuesIn, valuesOut);
+    }
+
+    if (keysIn != keys)
+    {
+        std::size_t numElements = bounds.back();
+        std::copy(keysIn, keysIn + numElements, keys);
+        std::copy(valuesIn, valuesIn + numElements, values);
     }
 }
 
@@ -214,8 +445,10 @@ public:
      *     and the identity permutation as the values
      *
      *  Remarks:
-     *    - reallocates space on the device if necessary to fit N elements of type LocalParticleIndex
-     *      and a second buffer of size max(2N*sizeof(T), N*sizeof(KeyType))
+     *    - reallocates space if necessary to fit N elements of type IndexType and
+     *      sort buffers for N keys and N indices
+     *    - if at most a fraction maxDisorder of the codes is out of order, as is typical between
+     *      consecutive time steps, the sort is O(N), see sortNearlySortedByKey
      */
     void setMapFromCodes(CodeType* codes_first, CodeType* codes_last)
     {
@@ -223,7 +456,20 @@ public:
         ordering_.resize(mapSize_);
         std::iota(begin(ordering_), end(ordering_), 0);
 
-        sort_by_key(codes_first, codes_last, begin(ordering_));
+        keyBuffer_.resize(mapSize_);
+        indexBuffer_.resize(mapSize_);
+        sortNearlySortedByKey(codes_first, ordering_.data(), mapSize_, keyBuffer_.data(), indexBuffer_.data(),
+                              maxDisorder_);
+    }
+
+    /*! @brief set the maximum fraction of out-of-order codes for incremental sorting in setMapFromCodes
+     *
+     * @param maxDisorder  fraction in [0, 0.5], 0 disables the incremental path and always performs a full sort
+     */
+    void setMaxDisorder(float maxDisorder)
+    {
+        assert(0 <= maxDisorder && maxDisorder <= 0.5);
+        maxDisorder_ = maxDisorder;
     }
 
     /*! @brief reorder the array @p values according to the reorder map provided previously
@@ -236,9 +482,76 @@ public:
         reorderInPlace(ordering_, values);
     }
 
+    //! @brief reorder @p numArrays arrays in a single pass over the reorder map, see gatherArrays
+    void operator()(ValueType* const* values, int numArrays)
+    {
+        resizeScratch(numArrays);
+        std::vector<ValueType*> destinations(numArrays);
+        for (int a = 0; a < numArrays; ++a)
+        {
+            scratch_[a].resize(mapSize_);
+            destinations[a] = scratch_[a].data();
+        }
+
+        gatherArrays(ordering_.data(), mapSize_, values, destinations.data(), numArrays);
+
+        for (int a = 0; a < numArrays; ++a)
+        {
+            std::copy(scratch_[a].begin(), scratch_[a].end(), values[a]);
+        }
+    }
+
+    /*! @brief reorder the elements [offset:offset + mapSize] of @p numArrays vectors in a single pass
+     *
+     * @param[inout] arrays     pointers to vectors with at least offset + mapSize elements
+     * @param[in]    numArrays  number of vectors
+     * @param[in]    offset     index of the first element to reorder in each vector
+     *
+     * The elements are gathered into persistent scratch vectors, which are then swapped with the inputs.
+     * Compared to gathering into a temporary and copying back, this halves the memory traffic of the reorder.
+     * Elements outside of the reordered range are copied, their values are preserved.
+     */
+    void operator()(std::vector<ValueType>* const* arrays, int numArrays, std::size_t offset)
+    {
+        CSTONE_TRACE_RANGE("reorder");
+        resizeScratch(numArrays);
+        std::vector<const ValueType*> sources(numArrays);
+        std::vector<ValueType*> destinations(numArrays);
+        for (int a = 0; a < numArrays; ++a)
+        {
+            scratch_[a].resize(arrays[a]->size());
+            sources[a]      = arrays[a]->data() + offset;
+            destinations[a] = scratch_[a].data() + offset;
+        }
+
+        gatherArrays(ordering_.data(), mapSize_, sources.data(), destinations.data(), numArrays);
+
+        for (int a = 0; a < numArrays; ++a)
+        {
+            std::vector<ValueType>& array = *arrays[a];
+            std::copy(array.begin(), array.begin() + offset, scratch_[a].begin());
+            std::copy(array.begin() + offset + mapSize_, array.end(), scratch_[a].begin() + offset + mapSize_);
+            array.swap(scratch_[a]);
+        }
+    }
+
 private:
     std::size_t mapSize_{0};
     std::vector<IndexType> ordering_;
+
+    //! @brief above this fraction of out-of-order codes, setMapFromCodes performs a full sort
+    float maxDisorder_{0.1};
+
+    void resizeScratch(int numArrays)
+    {
+        if (int(scratch_.size()) < numArrays) { scratch_.resize(numArrays); }
+    }
+
+    //! @brief temporary storage for sorting
+    std::vector<CodeType>  keyBuffer_;
+    std::vector<IndexType> indexBuffer_;
+    //! @brief one gather destination per array, swapped with the reordered vectors to keep their capacity
+    std::vector<std::vector<ValueType>> scratch_;
 };
 
 } // namespace cstone
@@ -0,0 +1,136 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Distributed graph communicator for neighborhood collectives between peer ranks
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include <mpi.h>
+
+#include "cstone/primitives/mpi_wrappers.hpp"
+
+namespace cstone
+{
+
+/*! @brief wraps an MPI_Dist_graph_create_adjacent communicator with the peers of the calling rank
+ *
+ * The graph communicator is created on first use of comm() after the peers changed on any rank.
+ * Since the creation is collective over the parent communicator passed to setPeers, setPeers and the operations
+ * using comm() need to be called by all ranks of the parent, including those without any peers.
+ */
+class NeighborCommunicator
+{
+public:
+    NeighborCommunicator() = default;
+
+    //! @brief copies the peers, the copy creates its own graph communicator on first use
+    NeighborCommunicator(const NeighborCommunicator& other)
+        : sources_(other.sources_)
+        , destinations_(other.destinations_)
+        , parent_(other.parent_)
+    {
+    }
+
+    NeighborCommunicator(NeighborCommunicator&& other) noexcept { swap(other); }
+
+    NeighborCommunicator& operator=(NeighborCommunicator other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    //! @brief the graph communicator is not freed after MPI_Finalize, e.g. for domains that are locals of main
+    ~NeighborCommunicator()
+    {
+        if (!mpiFinalized()) { freeComm(); }
+    }
+
+    /*! @brief set the ranks from which this rank receives and to which it sends
+     *
+     * @param sources        ranks that send messages to the calling rank
+     * @param destinations   ranks that receive messages from the calling rank
+     * @param parent         the communicator in which @p sources and @p destinations are numbered
+     *
+     * The graph communicator is only rebuilt if the peers or the parent changed on at least one rank.
+     * The order of the ranks defines the order of the counts and displacements in neighborhood collectives.
+     */
+    void setPeers(const std::vector<int>& sources, const std::vector<int>& destinations,
+                  MPI_Comm parent = MPI_COMM_WORLD)
+    {
+        int changed = sources != sources_ || destinations != destinations_ || parent != parent_;
+        MPI_Allreduce(MPI_IN_PLACE, &changed, 1, MPI_INT, MPI_LOR, parent);
+
+        if (changed)
+        {
+            freeComm();
+            sources_      = sources;
+            destinations_ = destinations;
+            parent_       = parent;
+        }
+    }
+
+    //! @brief return the graph communicator, collective on first call after a change of peers
+    MPI_Comm comm()
+    {
+        if (comm_ == MPI_COMM_NULL)
+        {
+            MPI_Dist_graph_create_adjacent(parent_, int(sources_.size()), sources_.data(), MPI_UNWEIGHTED,
+                                           int(destinations_.size()), destinations_.data(), MPI_UNWEIGHTED,
+                                           MPI_INFO_NULL, 0, &comm_);
+        }
+        return comm_;
+    }
+
+    [[nodiscard]] const std::vector<int>& sources() const { return sources_; }
+    [[nodiscard]] const std::vector<int>& destinations() const { return destinations_; }
+
+private:
+    void freeComm()
+    {
+        if (comm_ != MPI_COMM_NULL) { MPI_Comm_free(&comm_); }
+    }
+
+    void swap(NeighborCommunicator& other) noexcept
+    {
+        std::swap(sources_, other.sources_);
+        std::swap(destinations_, other.destinations_);
+        std::swap(parent_, other.parent_);
+        std::swap(comm_, other.comm_);
+    }
+
+    std::vector<int> sources_;
+    std::vector<int> destinations_;
+    MPI_Comm parent_{MPI_COMM_WORLD};
+    MPI_Comm comm_{MPI_COMM_NULL};
+};
+
+} // namespace cstone
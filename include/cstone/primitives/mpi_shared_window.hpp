@@ -0,0 +1,193 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  MPI-3 shared memory window between the ranks of a compute node
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include <mpi.h>
+
+#include "cstone/primitives/mpi_wrappers.hpp"
+
+namespace cstone
+{
+
+/*! @brief a memory segment per rank, allocated with MPI_Win_allocate_shared and accessible by all ranks of a node
+ *
+ * The node communicator is created from the parent communicator passed to init, MPI_COMM_WORLD by default,
+ * on the first call to init or allocate. Memory of other ranks
+ * on the same node can be accessed directly through segment(). Accesses need to be separated from
+ * modifications by the owner with fence(). All member functions except the accessors are collective over
+ * the ranks of a node.
+ */
+class SharedWindow
+{
+public:
+    SharedWindow() = default;
+
+    //! @brief the copy creates its own node communicator and window on first use
+    SharedWindow(const SharedWindow& other)
+        : parent_(other.parent_)
+    {
+    }
+
+    SharedWindow(SharedWindow&& other) noexcept { swap(other); }
+
+    SharedWindow& operator=(SharedWindow other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    //! @brief the window and the node communicator are not freed after MPI_Finalize
+    ~SharedWindow()
+    {
+        if (mpiFinalized()) { return; }
+        freeWindow();
+        freeNodeComm();
+    }
+
+    /*! @brief create the node communicator if it does not exist yet for @p parent
+     *
+     * @param parent  the ranks of @p parent on the same node share the window, collective over @p parent
+     *
+     * A change of the parent communicator frees the window and the node communicator of the previous parent.
+     */
+    void init(MPI_Comm parent = MPI_COMM_WORLD)
+    {
+        if (nodeComm_ != MPI_COMM_NULL && parent == parent_) { return; }
+
+        freeWindow();
+        freeNodeComm();
+        parent_ = parent;
+
+        int parentRank, parentSize;
+        MPI_Comm_rank(parent_, &parentRank);
+        MPI_Comm_size(parent_, &parentSize);
+        MPI_Comm_split_type(parent_, MPI_COMM_TYPE_SHARED, parentRank, MPI_INFO_NULL, &nodeComm_);
+        MPI_Comm_size(nodeComm_, &nodeSize_);
+        MPI_Comm_rank(nodeComm_, &myNodeRank_);
+
+        std::vector<int> parentRanks(parentSize);
+        for (int i = 0; i < parentSize; ++i)
+        {
+            parentRanks[i] = i;
+        }
+        nodeRanks_.resize(parentSize);
+
+        MPI_Group parentGroup, nodeGroup;
+        MPI_Comm_group(parent_, &parentGroup);
+        MPI_Comm_group(nodeComm_, &nodeGroup);
+        MPI_Group_translate_ranks(parentGroup, parentSize, parentRanks.data(), nodeGroup, nodeRanks_.data());
+        MPI_Group_free(&parentGroup);
+        MPI_Group_free(&nodeGroup);
+    }
+
+    /*! @brief replace the segment of the calling rank by one of @p numBytes bytes
+     *
+     * Different ranks may request different sizes. Previous contents are not preserved.
+     */
+    void allocate(std::size_t numBytes)
+    {
+        init(parent_);
+        freeWindow();
+
+        char* base;
+        MPI_Win_allocate_shared(MPI_Aint(numBytes), 1, MPI_INFO_NULL, nodeComm_, &base, &window_);
+
+        segments_.resize(nodeSize_);
+        for (int i = 0; i < nodeSize_; ++i)
+        {
+            MPI_Aint size;
+            int dispUnit;
+            MPI_Win_shared_query(window_, i, &size, &dispUnit, &segments_[i]);
+        }
+        numBytes_ = numBytes;
+    }
+
+    //! @brief separate accesses to the segments from modifications by their owners
+    void fence() { MPI_Win_fence(0, window_); }
+
+    //! @brief the rank in the node communicator of @p rank of the parent, MPI_UNDEFINED if not on the same node
+    [[nodiscard]] int nodeRank(int rank) const { return nodeRanks_[rank]; }
+
+    //! @brief the segment of the rank with @p nodeRank in the node communicator
+    [[nodiscard]] char* segment(int nodeRank) const { return static_cast<char*>(segments_[nodeRank]); }
+
+    //! @brief the segment of the calling rank
+    [[nodiscard]] char* localSegment() const { return segment(myNodeRank_); }
+
+    //! @brief size of the segment of the calling rank
+    [[nodiscard]] std::size_t size() const { return numBytes_; }
+
+    [[nodiscard]] bool allocated() const { return window_ != MPI_WIN_NULL; }
+
+    [[nodiscard]] MPI_Comm nodeComm() const { return nodeComm_; }
+    [[nodiscard]] int nodeSize() const { return nodeSize_; }
+
+private:
+    void freeWindow()
+    {
+        if (window_ != MPI_WIN_NULL) { MPI_Win_free(&window_); }
+    }
+
+    void freeNodeComm()
+    {
+        if (nodeComm_ != MPI_COMM_NULL) { MPI_Comm_free(&nodeComm_); }
+    }
+
+    void swap(SharedWindow& other) noexcept
+    {
+        std::swap(parent_, other.parent_);
+        std::swap(nodeComm_, other.nodeComm_);
+        std::swap(nodeSize_, other.nodeSize_);
+        std::swap(myNodeRank_, other.myNodeRank_);
+        std::swap(nodeRanks_, other.nodeRanks_);
+        std::swap(window_, other.window_);
+        std::swap(segments_, other.segments_);
+        std::swap(numBytes_, other.numBytes_);
+    }
+
+    MPI_Comm parent_{MPI_COMM_WORLD};
+    MPI_Comm nodeComm_{MPI_COMM_NULL};
+    int nodeSize_{0};
+    int myNodeRank_{0};
+    //! @brief node communicator rank for each rank of the parent communicator
+    std::vector<int> nodeRanks_;
+
+    MPI_Win window_{MPI_WIN_NULL};
+    //! @brief base addresses of the segments of all ranks on the node
+    std::vector<void*> segments_;
+    std::size_t numBytes_{0};
+};
+
+} // namespace cstone
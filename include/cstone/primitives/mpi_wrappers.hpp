@@ -31,6 +31,10 @@
 
 #pragma once
 
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
 #include <mpi.h>
 
 template<class T>
@@ -68,79 +72,227 @@ struct MpiType<unsigned long>
     constexpr operator MPI_Datatype() const noexcept { return MPI_UNSIGNED_LONG; }
 };
 
+template<>
+struct MpiType<long>
+{
+    constexpr operator MPI_Datatype() const noexcept { return MPI_LONG; }
+};
+
+template<>
+struct MpiType<long long>
+{
+    constexpr operator MPI_Datatype() const noexcept { return MPI_LONG_LONG; }
+};
+
+template<>
+struct MpiType<unsigned long long>
+{
+    constexpr operator MPI_Datatype() const noexcept { return MPI_UNSIGNED_LONG_LONG; }
+};
+
 template<class T>
 std::enable_if_t<std::is_same<double, std::decay_t<T>>{}>
-mpiSendAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests)
+mpiSendAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests, MPI_Comm comm = MPI_COMM_WORLD)
 {
     requests.push_back(MPI_Request{});
-    MPI_Isend(data, count, MPI_DOUBLE, rank, tag, MPI_COMM_WORLD, &requests.back());
+    MPI_Isend(data, count, MPI_DOUBLE, rank, tag, comm, &requests.back());
 }
 
 template<class T>
 std::enable_if_t<std::is_same<float, std::decay_t<T>>{}>
-mpiSendAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests)
+mpiSendAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests, MPI_Comm comm = MPI_COMM_WORLD)
 {
     requests.push_back(MPI_Request{});
-    MPI_Isend(data, count, MPI_FLOAT, rank, tag, MPI_COMM_WORLD, &requests.back());
+    MPI_Isend(data, count, MPI_FLOAT, rank, tag, comm, &requests.back());
 }
 
 template<class T>
 std::enable_if_t<std::is_same<int, std::decay_t<T>>{}>
-mpiSendAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests)
+mpiSendAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests, MPI_Comm comm = MPI_COMM_WORLD)
 {
     requests.push_back(MPI_Request{});
-    MPI_Isend(data, count, MPI_INT, rank, tag, MPI_COMM_WORLD, &requests.back());
+    MPI_Isend(data, count, MPI_INT, rank, tag, comm, &requests.back());
 }
 
 template<class T>
 std::enable_if_t<std::is_same<unsigned, std::decay_t<T>>{}>
-mpiSendAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests)
+mpiSendAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests, MPI_Comm comm = MPI_COMM_WORLD)
 {
     requests.push_back(MPI_Request{});
-    MPI_Isend(data, count, MPI_UNSIGNED, rank, tag, MPI_COMM_WORLD, &requests.back());
+    MPI_Isend(data, count, MPI_UNSIGNED, rank, tag, comm, &requests.back());
 }
 
 template<class T>
 std::enable_if_t<std::is_same<unsigned long, std::decay_t<T>>{}>
-mpiSendAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests)
+mpiSendAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests, MPI_Comm comm = MPI_COMM_WORLD)
 {
     requests.push_back(MPI_Request{});
-    MPI_Isend(data, count, MPI_UNSIGNED_LONG, rank, tag, MPI_COMM_WORLD, &requests.back());
+    MPI_Isend(data, count, MPI_UNSIGNED_LONG, rank, tag, comm, &requests.back());
+}
+
+template<class T>
+std::enable_if_t<std::is_same<long, std::decay_t<T>>{}>
+mpiSendAsync(T* data, int count, int rank, int tag, std::vector<MPI_Request>& requests, MPI_Comm comm = MPI_COMM_WORLD)
+{
+    requests.push_back(MPI_Request{});
+    MPI_Isend(data, count, MPI_LONG, rank, tag, comm, &requests.back());
 }
 
 template<class T>
 std::enable_if_t<std::is_same<double, std::decay_t<T>>{}>
-mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status)
+mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status, MPI_Comm comm = MPI_COMM_WORLD)
 {
-    MPI_Recv(data, count, MPI_DOUBLE, rank, tag, MPI_COMM_WORLD, status);
+    MPI_Recv(data, count, MPI_DOUBLE, rank, tag, comm, status);
 }
 
 template<class T>
 std::enable_if_t<std::is_same<float, std::decay_t<T>>{}>
-mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status)
+mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status, MPI_Comm comm = MPI_COMM_WORLD)
 {
-    MPI_Recv(data, count, MPI_FLOAT, rank, tag, MPI_COMM_WORLD, status);
+    MPI_Recv(data, count, MPI_FLOAT, rank, tag, comm, status);
 }
 
 template<class T>
 std::enable_if_t<std::is_same<int, std::decay_t<T>>{}>
-mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status)
+mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status, MPI_Comm comm = MPI_COMM_WORLD)
 {
-    MPI_Recv(data, count, MPI_INT, rank, tag, MPI_COMM_WORLD, status);
+    MPI_Recv(data, count, MPI_INT, rank, tag, comm, status);
 }
 
 template<class T>
 std::enable_if_t<std::is_same<unsigned, std::decay_t<T>>{}>
-mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status)
+mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status, MPI_Comm comm = MPI_COMM_WORLD)
 {
-    MPI_Recv(data, count, MPI_UNSIGNED, rank, tag, MPI_COMM_WORLD, status);
+    MPI_Recv(data, count, MPI_UNSIGNED, rank, tag, comm, status);
 }
 
 template<class T>
 std::enable_if_t<std::is_same<unsigned long, std::decay_t<T>>{}>
-mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status)
+mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status, MPI_Comm comm = MPI_COMM_WORLD)
+{
+    MPI_Recv(data, count, MPI_UNSIGNED_LONG, rank, tag, comm, status);
+}
+
+template<class T>
+std::enable_if_t<std::is_same<long, std::decay_t<T>>{}>
+mpiRecvSync(T* data, int count, int rank, int tag, MPI_Status* status, MPI_Comm comm = MPI_COMM_WORLD)
 {
-    MPI_Recv(data, count, MPI_UNSIGNED_LONG, rank, tag, MPI_COMM_WORLD, status);
+    MPI_Recv(data, count, MPI_LONG, rank, tag, comm, status);
 }
 
+//! @brief number of bytes of one element of each array when packed into a single message
+template<class... Arrays>
+constexpr std::size_t packedElementSize()
+{
+    return (sizeof(std::remove_pointer_t<Arrays>) + ... + 0);
+}
+
+//! @brief kinds of point-to-point exchanges, each kind uses a separate range of MPI tags
+enum class ExchangeKind : int
+{
+    particles,
+    haloKeys,
+    halos,
+    peerCounts,
+    nodeData,
+    numKinds
+};
+
+//! @brief number of consecutive calls of the same exchange kind before tags are reused
+constexpr int mpiTagEpochs = 64;
+
+//! @brief number of distinct tags available to each exchange call
+constexpr int mpiTagsPerCall = 32;
 
+//! @brief a tag outside the ranges handed out by nextTagEpoch, for exchanges with a persistent tag
+constexpr int mpiReservedTag = int(ExchangeKind::numKinds) * mpiTagEpochs * mpiTagsPerCall;
+
+//! @brief releases the tag epochs attached to a communicator when it is freed
+inline int deleteTagEpochs(MPI_Comm, int, void* epochs, void*)
+{
+    delete[] static_cast<int*>(epochs);
+    return MPI_SUCCESS;
+}
+
+//! @brief the attribute key of the tag epochs, duplicates of a communicator do not inherit the attribute
+inline int tagEpochKeyval()
+{
+    static int keyval = []()
+    {
+        int key;
+        MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, deleteTagEpochs, &key, nullptr);
+        return key;
+    }();
+    return keyval;
+}
+
+/*! @brief return the first of mpiTagsPerCall tags reserved for the next exchange of the specified kind on @p comm
+ *
+ * Consecutive exchanges of the same kind use different tags, such that messages of a rank that is already
+ * in the next exchange cannot be received by a peer that is still in the previous one. This replaces a
+ * global barrier at the end of each exchange with synchronization between actual peers only.
+ * All ranks of @p comm need to perform exchanges of a given kind on @p comm in the same order, which is the case
+ * for the collective sync operations of a domain. The epochs are stored as an attribute of @p comm, such that
+ * exchanges on other communicators do not advance them. The largest tag handed out is below 32767,
+ * the minimum MPI_TAG_UB.
+ */
+inline int nextTagEpoch(MPI_Comm comm, ExchangeKind kind)
+{
+    int keyval = tagEpochKeyval();
+
+    int* epochs;
+    int found;
+    MPI_Comm_get_attr(comm, keyval, &epochs, &found);
+    if (!found)
+    {
+        epochs = new int[int(ExchangeKind::numKinds)]{};
+        MPI_Comm_set_attr(comm, keyval, epochs);
+    }
+
+    int& epoch = epochs[int(kind)];
+    int tag    = (int(kind) * mpiTagEpochs + epoch) * mpiTagsPerCall;
+    epoch      = (epoch + 1) % mpiTagEpochs;
+
+    return tag;
+}
+
+//! @brief true if MPI_Finalize was already called, in which case MPI handles can no longer be freed
+inline bool mpiFinalized()
+{
+    int finalized;
+    MPI_Finalized(&finalized);
+    return finalized;
+}
+
+/*! @brief owns a duplicate of a communicator
+ *
+ * Gives a domain a communication context of its own, such that point-to-point messages and tag epochs of two
+ * domains on the same ranks never interfere. Construction and copies duplicate the communicator and are
+ * collective over it. The duplicate is not freed if MPI is already finalized, such that owners can still be
+ * destroyed after MPI_Finalize.
+ */
+class DuplicateComm
+{
+public:
+    explicit DuplicateComm(MPI_Comm comm) { MPI_Comm_dup(comm, &comm_); }
+
+    DuplicateComm(const DuplicateComm& other) : DuplicateComm(other.comm_) {}
+
+    DuplicateComm(DuplicateComm&& other) noexcept { std::swap(comm_, other.comm_); }
+
+    DuplicateComm& operator=(DuplicateComm other) noexcept
+    {
+        std::swap(comm_, other.comm_);
+        return *this;
+    }
+
+    ~DuplicateComm()
+    {
+        if (comm_ != MPI_COMM_NULL && !mpiFinalized()) { MPI_Comm_free(&comm_); }
+    }
+
+    operator MPI_Comm() const { return comm_; }
+
+private:
+    MPI_Comm comm_{MPI_COMM_NULL};
+};
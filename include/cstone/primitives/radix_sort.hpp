@@ -0,0 +1,276 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Multi-threaded LSD radix sort for unsigned integer keys with a value payload
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "cstone/util/executor.hpp"
+
+namespace cstone
+{
+
+namespace detail
+{
+
+constexpr int radixBits  = 8;
+constexpr int numBuckets = 1 << radixBits;
+
+//! @brief number of digit passes over bits that are set in @p varyingBits
+template<class KeyType>
+int numRadixPasses(KeyType varyingBits)
+{
+    int numPasses = 0;
+    for (int shift = 0; shift < int(8 * sizeof(KeyType)); shift += radixBits)
+    {
+        numPasses += ((varyingBits >> shift) & KeyType(numBuckets - 1)) != 0;
+    }
+    return numPasses;
+}
+
+template<class KeyType, class ValueType>
+void copyFromBuffers(KeyType* keys, ValueType* values, std::size_t numElements, const KeyType* keyBuffer,
+                     const ValueType* valueBuffer)
+{
+    parallelFor(std::size_t(0), numElements, [=](std::size_t i)
+    {
+        keys[i]   = keyBuffer[i];
+        values[i] = valueBuffer[i];
+    });
+}
+
+/*! @brief the digit passes of radixSortByKey for an installed Executor
+ *
+ * The histograms and the scatter of each pass run as two parallelFor loops over one chunk per executor thread,
+ * since the tasks of an executor cannot synchronize with barriers.
+ */
+template<class KeyType, class ValueType>
+void radixSortPassesChunked(KeyType* keys, ValueType* values, std::size_t numElements, KeyType* keyBuffer,
+                            ValueType* valueBuffer, KeyType varyingBits)
+{
+    std::size_t numChunks = std::min(numElements, std::size_t(parallelism()));
+    std::size_t chunkSize = (numElements + numChunks - 1) / numChunks;
+    numChunks             = (numElements + chunkSize - 1) / chunkSize;
+
+    std::vector<std::size_t> offsets(numChunks * numBuckets);
+    std::size_t* offsetsData = offsets.data();
+
+    KeyType*   keysIn    = keys;
+    KeyType*   keysOut   = keyBuffer;
+    ValueType* valuesIn  = values;
+    ValueType* valuesOut = valueBuffer;
+
+    for (int shift = 0; shift < int(8 * sizeof(KeyType)); shift += radixBits)
+    {
+        if (((varyingBits >> shift) & KeyType(numBuckets - 1)) == 0) { continue; }
+
+        parallelFor(std::size_t(0), numChunks, [=](std::size_t c)
+        {
+            std::size_t* chunkOffsets = offsetsData + c * numBuckets;
+            std::fill(chunkOffsets, chunkOffsets + numBuckets, 0);
+            std::size_t last = std::min((c + 1) * chunkSize, numElements);
+            for (std::size_t i = c * chunkSize; i < last; ++i)
+            {
+                chunkOffsets[(keysIn[i] >> shift) & KeyType(numBuckets - 1)]++;
+            }
+        });
+
+        // exclusive scan in bucket-major, chunk-minor order keeps the sort stable
+        std::size_t sum = 0;
+        for (int bucket = 0; bucket < numBuckets; ++bucket)
+        {
+            for (std::size_t c = 0; c < numChunks; ++c)
+            {
+                std::size_t count = offsets[c * numBuckets + bucket];
+                offsets[c * numBuckets + bucket] = sum;
+                sum += count;
+            }
+        }
+
+        parallelFor(std::size_t(0), numChunks, [=](std::size_t c)
+        {
+            std::size_t* chunkOffsets = offsetsData + c * numBuckets;
+            std::size_t last = std::min((c + 1) * chunkSize, numElements);
+            for (std::size_t i = c * chunkSize; i < last; ++i)
+            {
+                std::size_t destination = chunkOffsets[(keysIn[i] >> shift) & KeyType(numBuckets - 1)]++;
+                keysOut[destination]    = keysIn[i];
+                valuesOut[destination]  = valuesIn[i];
+            }
+        });
+
+        std::swap(keysIn, keysOut);
+        std::swap(valuesIn, valuesOut);
+    }
+
+    if (keysIn != keys) { copyFromBuffers(keys, values, numElements, keyBuffer, valueBuffer); }
+}
+
+} // namespace detail
+
+/*! @brief sort values according to unsigned integer keys with a stable multi-threaded LSD radix sort
+ *
+ * @tparam KeyType          32- or 64-bit unsigned integer
+ * @tparam ValueType        payload type, e.g. particle indices
+ * @param[inout] keys       input keys, length = @p numElements, sorted on return
+ * @param[inout] values     input values, length = @p numElements, permuted in the same way as @p keys
+ * @param[in] numElements   number of keys to sort
+ * @param[-] keyBuffer      temporary storage, length = @p numElements
+ * @param[-] valueBuffer    temporary storage, length = @p numElements
+ *
+ * Digit passes over bits that are identical for all keys are skipped. SFC keys of particles
+ * that are assigned to a single rank usually share a common prefix, which means that the
+ * number of passes performed is typically smaller than sizeof(KeyType).
+ * Since the sort is stable, values with equal keys retain their relative order.
+ * All passes run in a single OpenMP parallel region, or through parallelFor if an Executor is installed.
+ */
+template<class KeyType, class ValueType>
+void radixSortByKey(KeyType* keys, ValueType* values, std::size_t numElements,
+                    KeyType* keyBuffer, ValueType* valueBuffer)
+{
+    static_assert(std::is_unsigned_v<KeyType>, "radix sort requires unsigned integer keys\n");
+
+    constexpr int radixBits  = detail::radixBits;
+    constexpr int numBuckets = detail::numBuckets;
+    constexpr int numPasses  = (8 * sizeof(KeyType)) / radixBits;
+
+    if (numElements < 2) { return; }
+
+    // determine the bits that are not the same for all keys
+    KeyType firstKey    = keys[0];
+    KeyType varyingBits = parallelReduce(
+        std::size_t(0), numElements, KeyType(0), [keys, firstKey](std::size_t i) { return keys[i] ^ firstKey; },
+        [](KeyType a, KeyType b) { return a | b; });
+    if (varyingBits == 0) { return; }
+
+    if (currentExecutor())
+    {
+        detail::radixSortPassesChunked(keys, values, numElements, keyBuffer, valueBuffer, varyingBits);
+        return;
+    }
+
+    // one histogram per thread, converted to scatter offsets in place
+    std::vector<std::size_t> offsets;
+    int numThreads = 1;
+
+    #pragma omp parallel
+    {
+        int tid = 0;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+#endif
+
+        // the chunks and the scan are sized by the team that actually executes the sort
+        #pragma omp single
+        {
+#ifdef _OPENMP
+            numThreads = omp_get_num_threads();
+#endif
+            offsets.resize(numThreads * numBuckets);
+        }
+
+        std::size_t chunkSize = (numElements + numThreads - 1) / numThreads;
+        std::size_t first     = std::min(tid * chunkSize, numElements);
+        std::size_t last      = std::min(first + chunkSize, numElements);
+
+        std::size_t* threadOffsets = offsets.data() + tid * numBuckets;
+
+        // each thread swaps its own copies of the buffer pointers in the same way
+        KeyType*   threadKeysIn    = keys;
+        KeyType*   threadKeysOut   = keyBuffer;
+        ValueType* threadValuesIn  = values;
+        ValueType* threadValuesOut = valueBuffer;
+
+        for (int pass = 0; pass < numPasses; ++pass)
+        {
+            int shift = pass * radixBits;
+            if (((varyingBits >> shift) & KeyType(numBuckets - 1)) == 0) { continue; }
+
+            std::fill(threadOffsets, threadOffsets + numBuckets, 0);
+            for (std::size_t i = first; i < last; ++i)
+            {
+                threadOffsets[(threadKeysIn[i] >> shift) & KeyType(numBuckets - 1)]++;
+            }
+
+            #pragma omp barrier
+
+            // exclusive scan in bucket-major, thread-minor order keeps the sort stable
+            #pragma omp single
+            {
+                std::size_t sum = 0;
+                for (int bucket = 0; bucket < numBuckets; ++bucket)
+                {
+                    for (int t = 0; t < numThreads; ++t)
+                    {
+                        std::size_t count = offsets[t * numBuckets + bucket];
+                        offsets[t * numBuckets + bucket] = sum;
+                        sum += count;
+                    }
+                }
+            }
+
+            for (std::size_t i = first; i < last; ++i)
+            {
+                std::size_t destination      = threadOffsets[(threadKeysIn[i] >> shift) & KeyType(numBuckets - 1)]++;
+                threadKeysOut[destination]   = threadKeysIn[i];
+                threadValuesOut[destination] = threadValuesIn[i];
+            }
+
+            // the next pass reads the output of all threads
+            #pragma omp barrier
+
+            std::swap(threadKeysIn, threadKeysOut);
+            std::swap(threadValuesIn, threadValuesOut);
+        }
+    }
+
+    int numActivePasses = detail::numRadixPasses(varyingBits);
+    // an odd number of passes leaves the result in the buffers
+    if (numActivePasses % 2) { detail::copyFromBuffers(keys, values, numElements, keyBuffer, valueBuffer); }
+}
+
+//! @brief radix sort with internally allocated temporary storage
+template<class KeyType, class ValueType>
+void radixSortByKey(KeyType* keys, ValueType* values, std::size_t numElements)
+{
+    std::vector<KeyType>   keyBuffer(numElements);
+    std::vector<ValueType> valueBuffer(numElements);
+    radixSortByKey(keys, values, numElements, keyBuffer.data(), valueBuffer.data());
+}
+
+} // namespace cstone
@@ -0,0 +1,165 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Reduced transfer precision for arrays in halo exchanges
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * Wrapping an array as reducedPrecision<Wire>(array) makes halo exchanges convert its elements to Wire when
+ * packing and back to the array element type when unpacking. The owned elements are not modified, only the
+ * halo copies lose precision. Suitable for derived quantities such as densities or pressures, but not for
+ * coordinates or smoothing lengths, which determine the halo search itself.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "cstone/cuda/annotation.hpp"
+
+namespace cstone
+{
+
+/*! @brief 16-bit brain floating point format, the upper half of an IEEE float
+ *
+ * Has the exponent range of float with 8 bits of mantissa precision, i.e. a relative precision of 2^-8.
+ */
+struct BFloat16
+{
+    uint16_t bits;
+
+    BFloat16() = default;
+
+    //! @brief round to nearest, ties to even
+    CUDA_HOST_DEVICE_FUN explicit BFloat16(float value)
+    {
+        uint32_t u;
+        std::memcpy(&u, &value, sizeof(float));
+        // keep NaNs quiet instead of rounding them to infinity
+        if ((u & 0x7fffffffu) > 0x7f800000u) { bits = uint16_t((u >> 16) | 0x40u); }
+        else { bits = uint16_t((u + 0x7fffu + ((u >> 16) & 1u)) >> 16); }
+    }
+
+    CUDA_HOST_DEVICE_FUN operator float() const
+    {
+        uint32_t u = uint32_t(bits) << 16;
+        float ret;
+        std::memcpy(&ret, &u, sizeof(float));
+        return ret;
+    }
+};
+
+/*! @brief an array whose halos are transferred as elements of type Wire
+ *
+ * @tparam Wire  transfer type, e.g. float or BFloat16 for T = double
+ * @tparam T     element type of the array
+ */
+template<class Wire, class T>
+struct ReducedPrecision
+{
+    static_assert(std::is_floating_point_v<T>, "reduced transfer precision is only supported for floating point\n");
+    static_assert(sizeof(Wire) <= sizeof(T), "the transfer type cannot be larger than the element type\n");
+
+    T* data;
+};
+
+//! @brief a container whose halos are transferred as elements of type Wire, see Domain::exchangeHalos
+template<class Wire, class Vector>
+struct ReducedPrecisionField
+{
+    Vector& field;
+
+    [[nodiscard]] std::size_t size() const { return field.size(); }
+    [[nodiscard]] ReducedPrecision<Wire, typename Vector::value_type> data() { return {field.data()}; }
+};
+
+//! @brief transfer the halos of @p array with the precision of Wire
+template<class Wire, class T>
+ReducedPrecision<Wire, T> reducedPrecision(T* array)
+{
+    return {array};
+}
+
+//! @brief transfer the halos of the container @p field with the precision of Wire
+template<class Wire, class Vector>
+std::enable_if_t<!std::is_pointer_v<Vector>, ReducedPrecisionField<Wire, Vector>> reducedPrecision(Vector& field)
+{
+    return {field};
+}
+
+template<class A>
+struct TransferElement
+{
+    using type = std::remove_pointer_t<A>;
+};
+
+template<class Wire, class T>
+struct TransferElement<ReducedPrecision<Wire, T>>
+{
+    using type = Wire;
+};
+
+//! @brief the type of the elements of an exchanged array as they are transferred
+template<class A>
+using TransferElement_t = typename TransferElement<A>::type;
+
+template<class A>
+struct IsReducedPrecision : public std::false_type
+{
+};
+
+template<class Wire, class T>
+struct IsReducedPrecision<ReducedPrecision<Wire, T>> : public std::true_type
+{
+};
+
+//! @brief true if all @p Arrays are typed pointers or pointers wrapped in ReducedPrecision
+template<class... Arrays>
+constexpr bool areHaloArrays = ((std::is_pointer_v<Arrays> || IsReducedPrecision<Arrays>{}) && ...);
+
+//! @brief number of transferred bytes of one element of each array when packed into a single message
+template<class... Arrays>
+constexpr std::size_t transferElementSize()
+{
+    return (sizeof(TransferElement_t<Arrays>) + ... + 0);
+}
+
+//! @brief the array pointer of an exchanged array
+template<class T>
+T* arrayData(T* array)
+{
+    return array;
+}
+
+template<class Wire, class T>
+T* arrayData(ReducedPrecision<Wire, T> array)
+{
+    return array.data;
+}
+
+} // namespace cstone
@@ -27,6 +27,9 @@
  * @brief Parallel prefix sum
  *
  * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * The OpenMP implementations scan in lock-step over blocks with one block per thread and step. If an Executor
+ * is installed, see executor.hpp, a three-pass scan over blocks is used instead, which needs no barriers.
  */
 
 #pragma once
@@ -34,14 +37,70 @@
 #include <algorithm>
 #include <iostream>
 #include <numeric>
+#include <vector>
 
 #include <omp.h>
 
 #include "cstone/primitives/stl.hpp"
+#include "cstone/util/executor.hpp"
 
 namespace cstone
 {
 
+template<class T>
+T exclusiveScanSerialInplace(T* out, size_t num_elements, T init)
+{
+    T a = init;
+    T b = init;
+    for (size_t i = 0; i < num_elements; ++i)
+    {
+        a += out[i];
+        out[i] = b;
+        b = a;
+    }
+    return b;
+}
+
+namespace detail
+{
+
+/*! @brief exclusive scan in three passes over blocks of @p in, for parallel loops dispatched through an Executor
+ *
+ * @p in and @p out may be identical. The block sums are computed in parallel, scanned serially, and then
+ * used as initial values for independent scans of each block.
+ */
+template<class T1, class T2>
+void exclusiveScanBlocked(const T1* in, T2* out, size_t numElements)
+{
+    constexpr size_t blockSize = (2 * 16384) / sizeof(T2);
+    size_t numBlocks           = (numElements + blockSize - 1) / blockSize;
+
+    std::vector<T2> blockSums(numBlocks + 1, 0);
+    T2* sums = blockSums.data();
+
+    parallelFor(size_t(0), numBlocks, [in, sums, numElements](size_t block)
+    {
+        size_t first = block * blockSize;
+        size_t last  = std::min(first + blockSize, numElements);
+        sums[block]  = std::accumulate(in + first, in + last, T2(0));
+    });
+
+    exclusiveScanSerialInplace(sums, numBlocks + 1, T2(0));
+
+    parallelFor(size_t(0), numBlocks, [in, out, sums, numElements](size_t block)
+    {
+        size_t first = block * blockSize;
+        size_t last  = std::min(first + blockSize, numElements);
+        if (static_cast<const void*>(in) == static_cast<const void*>(out))
+        {
+            exclusiveScanSerialInplace(out + first, last - first, sums[block]);
+        }
+        else { stl::exclusive_scan(in + first, in + last, out + first, sums[block]); }
+    });
+}
+
+} // namespace detail
+
 /*! @brief multi-threaded exclusive scan (prefix sum) implementation
  *
  * @tparam T1, T2       integer types
@@ -52,6 +111,13 @@ namespace cstone
 template<class T1, class T2>
 void exclusiveScan(const T1* in, T2* out, size_t numElements)
 {
+    if (currentExecutor())
+    {
+        detail::exclusiveScanBlocked(in, out, numElements);
+        return;
+    }
+
+#ifdef _OPENMP
     constexpr int blockSize = (8192 + 16384) / sizeof(T1);
 
     int numThreads = 1;
@@ -95,20 +161,9 @@ void exclusiveScan(const T1* in, T2* out, size_t numElements)
     // remainder
     T2 stepSum = superBlock[(nSteps+1)%2][numThreads];
     stl::exclusive_scan(in + nSteps*elementsPerStep, in + numElements, out + nSteps*elementsPerStep, stepSum);
-}
-
-template<class T>
-T exclusiveScanSerialInplace(T* out, size_t num_elements, T init)
-{
-    T a = init;
-    T b = init;
-    for (size_t i = 0; i < num_elements; ++i)
-    {
-        a += out[i];
-        out[i] = b;
-        b = a;
-    }
-    return b;
+#else
+    stl::exclusive_scan(in, in + numElements, out, T2(0));
+#endif
 }
 
 #ifdef _OPENMP
@@ -116,6 +171,12 @@ T exclusiveScanSerialInplace(T* out, size_t num_elements, T init)
 template<class T>
 void exclusiveScan(T* out, size_t numElements)
 {
+    if (currentExecutor())
+    {
+        detail::exclusiveScanBlocked(out, out, numElements);
+        return;
+    }
+
     constexpr int blockSize = (2*16384) / sizeof(T);
 
     int numThreads = 1;
@@ -164,7 +225,8 @@ void exclusiveScan(T* out, size_t numElements)
 template<class T>
 void exclusiveScan(T* out, size_t numElements)
 {
-    exclusiveScanSerialInplace(out, numElements, T(0));
+    if (currentExecutor()) { detail::exclusiveScanBlocked(out, out, numElements); }
+    else { exclusiveScanSerialInplace(out, numElements, T(0)); }
 }
 
 #endif
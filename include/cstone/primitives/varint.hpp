@@ -0,0 +1,169 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Variable-length encoding of unsigned integer sequences for compact MPI messages
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * Values are stored in little-endian groups of 7 bits per byte, the high bit of each byte indicates that
+ * another byte follows (LEB128). Sorted SFC key sequences are encoded as differences between consecutive
+ * keys, which are small for the clustered keys of tree leaves, such that most keys take one or two bytes
+ * instead of four or eight.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "cstone/util/gsl-lite.hpp"
+
+namespace cstone
+{
+
+//! @brief upper bound for the number of bytes of a single encoded value of type T
+template<class T>
+constexpr std::size_t maxVarintBytes()
+{
+    return (sizeof(T) * 8 + 6) / 7;
+}
+
+//! @brief write @p value to @p out, returns the position after the last written byte
+inline uint8_t* encodeVarint(uint64_t value, uint8_t* out)
+{
+    while (value >= 0x80)
+    {
+        *out++ = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    *out++ = uint8_t(value);
+    return out;
+}
+
+//! @brief read one value from @p in into @p value, returns the position after the last read byte
+inline const uint8_t* decodeVarint(const uint8_t* in, uint64_t& value)
+{
+    // single byte values are the common case for key differences and particle counts
+    if (*in < 0x80)
+    {
+        value = *in;
+        return in + 1;
+    }
+
+    uint64_t ret = 0;
+    int shift    = 0;
+    uint8_t byte;
+    do
+    {
+        byte = *in++;
+        ret |= uint64_t(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    value = ret;
+    return in;
+}
+
+/*! @brief encode a non-decreasing key sequence as differences between consecutive keys
+ *
+ * @param[in]  keys   sorted SFC keys
+ * @param[out] bytes  resized to the length of the encoded sequence, the capacity is kept across calls
+ */
+template<class KeyType>
+void encodeSortedKeys(gsl::span<const KeyType> keys, std::vector<uint8_t>& bytes)
+{
+    bytes.resize(keys.size() * maxVarintBytes<KeyType>());
+
+    uint8_t* out     = bytes.data();
+    KeyType previous = 0;
+    for (KeyType key : keys)
+    {
+        assert(previous <= key);
+        out      = encodeVarint(key - previous, out);
+        previous = key;
+    }
+    bytes.resize(out - bytes.data());
+}
+
+/*! @brief decode a key sequence encoded with encodeSortedKeys
+ *
+ * @param[in]  bytes  the encoded sequence
+ * @param[out] keys   output for the decoded keys, needs to be big enough for the whole sequence
+ * @return            the number of decoded keys
+ */
+template<class KeyType>
+std::size_t decodeSortedKeys(gsl::span<const uint8_t> bytes, gsl::span<KeyType> keys)
+{
+    const uint8_t* in  = bytes.data();
+    const uint8_t* end = bytes.data() + bytes.size();
+
+    std::size_t numKeys = 0;
+    KeyType previous    = 0;
+    while (in < end)
+    {
+        assert(numKeys < keys.size());
+        uint64_t delta;
+        in              = decodeVarint(in, delta);
+        previous        = previous + KeyType(delta);
+        keys[numKeys++] = previous;
+    }
+    return numKeys;
+}
+
+//! @brief encode unsigned integers without delta step, e.g. particle counts
+template<class T>
+void encodeValues(gsl::span<const T> values, std::vector<uint8_t>& bytes)
+{
+    bytes.resize(values.size() * maxVarintBytes<T>());
+
+    uint8_t* out = bytes.data();
+    for (T value : values)
+    {
+        out = encodeVarint(value, out);
+    }
+    bytes.resize(out - bytes.data());
+}
+
+/*! @brief decode values encoded with encodeValues
+ *
+ * @param[in]  in      start of the encoded sequence
+ * @param[out] values  decoded values, the length of the span determines the number of values read
+ * @return             the position after the last read byte
+ */
+template<class T>
+const uint8_t* decodeValues(const uint8_t* in, gsl::span<T> values)
+{
+    for (T& value : values)
+    {
+        uint64_t v;
+        in    = decodeVarint(in, v);
+        value = T(v);
+    }
+    return in;
+}
+
+} // namespace cstone
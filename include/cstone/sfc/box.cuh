@@ -0,0 +1,87 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Bounding box reductions on the GPU
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <thrust/device_ptr.h>
+#include <thrust/execution_policy.h>
+#include <thrust/extrema.h>
+
+#include "cstone/util/util.hpp"
+#include "box.hpp"
+
+namespace cstone
+{
+
+/*! @brief compute minimum and maximum of a device array
+ *
+ * @tparam T      float or double
+ * @param  first  device pointer to the first element
+ * @param  last   device pointer to the last element, must be different from @p first
+ * @return        the minimum and maximum element, in that order
+ */
+template<class T>
+pair<T> minMaxGpu(const T* first, const T* last)
+{
+    auto minMax = thrust::minmax_element(thrust::device, thrust::device_pointer_cast(first),
+                                         thrust::device_pointer_cast(last));
+
+    // dereferencing the device pointers downloads the elements
+    return {*minMax.first, *minMax.second};
+}
+
+/*! @brief compute the bounding box of local device coordinate arrays
+ *
+ * @tparam T            float or double
+ * @param  x            device x-coordinates, length @p numElements
+ * @param  y            device y-coordinates, length @p numElements
+ * @param  z            device z-coordinates, length @p numElements
+ * @param  numElements  number of coordinates, must be larger than zero
+ * @param  previousBox  previous coordinate bounding box
+ * @return              the local bounding box
+ *
+ * As in makeGlobalBox, limits of periodic dimensions are taken from @p previousBox.
+ */
+template<class T>
+Box<T> makeLocalBoxGpu(const T* x, const T* y, const T* z, size_t numElements, const Box<T>& previousBox)
+{
+    pair<T> xLimits = previousBox.pbcX() ? pair<T>{previousBox.xmin(), previousBox.xmax()}
+                                         : minMaxGpu(x, x + numElements);
+    pair<T> yLimits = previousBox.pbcY() ? pair<T>{previousBox.ymin(), previousBox.ymax()}
+                                         : minMaxGpu(y, y + numElements);
+    pair<T> zLimits = previousBox.pbcZ() ? pair<T>{previousBox.zmin(), previousBox.zmax()}
+                                         : minMaxGpu(z, z + numElements);
+
+    return Box<T>{xLimits[0], xLimits[1], yLimits[0], yLimits[1], zLimits[0], zLimits[1],
+                  previousBox.pbcX(), previousBox.pbcY(), previousBox.pbcZ()};
+}
+
+} // namespace cstone
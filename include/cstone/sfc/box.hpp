@@ -176,6 +176,62 @@ private:
     bool pbc[3];
 };
 
+/*! @brief return a box that contains @p box with the same edge length in all open dimensions
+ *
+ * Open dimensions are extended symmetrically to the longest edge of @p box, such that SFC keys computed
+ * with the returned box describe cubic cells in real space, which keeps MACs and halo boxes of elongated
+ * domains compact. Periodic dimensions keep their limits, the result is therefore only cubic if no periodic
+ * dimension is shorter than the longest edge.
+ */
+template<class T>
+CUDA_HOST_DEVICE_FUN constexpr Box<T> makeCubicBox(const Box<T>& box)
+{
+    T length = box.maxExtent();
+
+    T padX = box.pbcX() ? T(0) : T(0.5) * (length - box.lx());
+    T padY = box.pbcY() ? T(0) : T(0.5) * (length - box.ly());
+    T padZ = box.pbcZ() ? T(0) : T(0.5) * (length - box.lz());
+
+    return Box<T>(box.xmin() - padX, box.xmax() + padX, box.ymin() - padY, box.ymax() + padY, box.zmin() - padZ,
+                  box.zmax() + padZ, box.pbcX(), box.pbcY(), box.pbcZ());
+}
+
+/*! @brief a Box whose periodic boundaries are fixed at compile time
+ *
+ * @tparam T     floating point type
+ * @tparam PbcX  periodicity in x, y and z
+ *
+ * Functions that are templated on the box type see pbcX,Y,Z() as compile-time constants,
+ * such that the branches and the periodic arithmetic for open dimensions are eliminated.
+ */
+template<class T, bool PbcX, bool PbcY, bool PbcZ>
+class StaticPbcBox : public Box<T>
+{
+public:
+    CUDA_HOST_DEVICE_FUN constexpr explicit StaticPbcBox(const Box<T>& box)
+        : Box<T>(box)
+    {
+        assert(box.pbcX() == PbcX && box.pbcY() == PbcY && box.pbcZ() == PbcZ);
+    }
+
+    CUDA_HOST_DEVICE_FUN static constexpr bool pbcX() { return PbcX; } // NOLINT
+    CUDA_HOST_DEVICE_FUN static constexpr bool pbcY() { return PbcY; } // NOLINT
+    CUDA_HOST_DEVICE_FUN static constexpr bool pbcZ() { return PbcZ; } // NOLINT
+};
+
+/*! @brief call @p f with @p box converted to a StaticPbcBox
+ *
+ * Fully open and fully periodic boxes get a dedicated instantiation of @p f, boxes that are periodic in only
+ * some of the dimensions are passed on as Box<T> with runtime periodicity.
+ */
+template<class T, class F>
+CUDA_HOST_DEVICE_FUN decltype(auto) dispatchPbc(const Box<T>& box, F&& f)
+{
+    if (box.pbcX() && box.pbcY() && box.pbcZ()) { return f(StaticPbcBox<T, true, true, true>(box)); }
+    if (!box.pbcX() && !box.pbcY() && !box.pbcZ()) { return f(StaticPbcBox<T, false, false, false>(box)); }
+    return f(box);
+}
+
 /*! @brief stores octree index integer bounds
  */
 class IBox
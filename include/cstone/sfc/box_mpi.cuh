@@ -0,0 +1,73 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Global bounding box computation from device coordinate arrays
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <mpi.h>
+
+#include "cstone/primitives/mpi_wrappers.hpp"
+#include "box.cuh"
+
+namespace cstone
+{
+
+/*! @brief compute global bounding box for local x,y,z device arrays
+ *
+ * @tparam T            float or double
+ * @param  x            device x-coordinates, length @p numElements
+ * @param  y            device y-coordinates, length @p numElements
+ * @param  z            device z-coordinates, length @p numElements
+ * @param  numElements  number of local coordinates, must be larger than zero
+ * @param  previousBox  previous coordinate bounding box, default non-pbc box
+ *                      with limits ignored
+ * @param  comm         communicator of the ranks that hold parts of the coordinates
+ * @return              the new bounding box
+ *
+ * Device equivalent of makeGlobalBox. Only the six local limits are transferred to the host
+ * and reduced across ranks with a single MPI call.
+ */
+template<class T>
+Box<T> makeGlobalBoxGpu(const T* x, const T* y, const T* z, size_t numElements,
+                        const Box<T>& previousBox = Box<T>{0, 1}, MPI_Comm comm = MPI_COMM_WORLD)
+{
+    Box<T> localBox = makeLocalBoxGpu(x, y, z, numElements, previousBox);
+
+    // negated maxima, such that all limits are reduced with MPI_MIN in a single call
+    T limits[6] = {localBox.xmin(), localBox.ymin(), localBox.zmin(),
+                   -localBox.xmax(), -localBox.ymax(), -localBox.zmax()};
+
+    MPI_Allreduce(MPI_IN_PLACE, limits, 6, MpiType<T>{}, MPI_MIN, comm);
+
+    return Box<T>{limits[0], -limits[3], limits[1], -limits[4], limits[2], -limits[5],
+                  previousBox.pbcX(), previousBox.pbcY(), previousBox.pbcZ()};
+}
+
+} // namespace cstone
@@ -35,8 +35,10 @@
 #include <mpi.h>
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cmath>
+#include <stdexcept>
 
 #include "box.hpp"
 #include "cstone/primitives/mpi_wrappers.hpp"
@@ -45,9 +47,9 @@
 namespace cstone
 {
 
-//! @brief compute global minimum of an array range
+//! @brief compute global minimum of an array range over the ranks of @p comm
 template<class Iterator>
-auto globalMin(Iterator start, Iterator end)
+auto globalMin(Iterator start, Iterator end, MPI_Comm comm = MPI_COMM_WORLD)
 {
     assert(end > start);
     using T = std::decay_t<decltype(*start)>;
@@ -61,14 +63,14 @@ auto globalMin(Iterator start, Iterator end)
         minimum = std::min(minimum, value);
     }
 
-    MPI_Allreduce(MPI_IN_PLACE, &minimum, 1, MpiType<T>{}, MPI_MIN, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &minimum, 1, MpiType<T>{}, MPI_MIN, comm);
 
     return minimum;
 }
 
-//! @brief compute global maximum of an array range
+//! @brief compute global maximum of an array range over the ranks of @p comm
 template<class Iterator>
-auto globalMax(Iterator start, Iterator end)
+auto globalMax(Iterator start, Iterator end, MPI_Comm comm = MPI_COMM_WORLD)
 {
     assert(end > start);
     using T = std::decay_t<decltype(*start)>;
@@ -82,11 +84,62 @@ auto globalMax(Iterator start, Iterator end)
         maximum = std::max(maximum, value);
     }
 
-    MPI_Allreduce(MPI_IN_PLACE, &maximum, 1, MpiType<T>{}, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &maximum, 1, MpiType<T>{}, MPI_MAX, comm);
 
     return maximum;
 }
 
+namespace detail
+{
+
+/*! @brief local minima of x,y,z in the first three elements, followed by the negated maxima
+ *
+ * With negated maxima, the global limits of all three dimensions are obtained with a single MPI_MIN reduction.
+ * All six limits are computed in one pass over the coordinates. Empty ranges yield +INFINITY,
+ * i.e. they do not contribute to the global reduction.
+ */
+template<class Iterator>
+auto localBoxLimits(Iterator xB, Iterator xE, Iterator yB, Iterator zB)
+{
+    using T = typename Iterator::value_type;
+
+    T xmin = INFINITY, ymin = INFINITY, zmin = INFINITY;
+    T xmaxNeg = INFINITY, ymaxNeg = INFINITY, zmaxNeg = INFINITY;
+
+    std::size_t nElements = xE - xB;
+    #pragma omp parallel for reduction(min : xmin, ymin, zmin, xmaxNeg, ymaxNeg, zmaxNeg)
+    for (std::size_t i = 0; i < nElements; ++i)
+    {
+        T xi = xB[i], yi = yB[i], zi = zB[i];
+
+        xmin    = std::min(xmin, xi);
+        ymin    = std::min(ymin, yi);
+        zmin    = std::min(zmin, zi);
+        xmaxNeg = std::min(xmaxNeg, -xi);
+        ymaxNeg = std::min(ymaxNeg, -yi);
+        zmaxNeg = std::min(zmaxNeg, -zi);
+    }
+
+    return std::array<T, 6>{xmin, ymin, zmin, xmaxNeg, ymaxNeg, zmaxNeg};
+}
+
+//! @brief box from globally reduced localBoxLimits, periodic dimensions keep the limits of @p previousBox
+template<class T>
+Box<T> boxFromLimits(const std::array<T, 6>& limits, const Box<T>& previousBox)
+{
+    T newXmin = previousBox.pbcX() ? previousBox.xmin() : limits[0];
+    T newYmin = previousBox.pbcY() ? previousBox.ymin() : limits[1];
+    T newZmin = previousBox.pbcZ() ? previousBox.zmin() : limits[2];
+    T newXmax = previousBox.pbcX() ? previousBox.xmax() : -limits[3];
+    T newYmax = previousBox.pbcY() ? previousBox.ymax() : -limits[4];
+    T newZmax = previousBox.pbcZ() ? previousBox.zmax() : -limits[5];
+
+    return Box<T>{newXmin, newXmax, newYmin, newYmax, newZmin, newZmax,
+                  previousBox.pbcX(), previousBox.pbcY(), previousBox.pbcZ()};
+}
+
+} // namespace detail
+
 /*! @brief compute global bounding box for local x,y,z arrays
  *
  * @tparam Iterator      coordinate array iterator, providing random access
@@ -96,10 +149,12 @@ auto globalMax(Iterator start, Iterator end)
  * @param  zB            z coordinate array start
  * @param  previousBox   previous coordinate bounding box, default non-pbc box
  *                       with limits ignored
+ * @param  comm          communicator of the ranks that hold parts of the coordinates
  * @return               the new bounding box
  *
  * For each periodic dimension, limits are fixed and will not be modified.
  * For non-periodic dimensions, limits are determined by global min/max.
+ * The local limits of all dimensions are computed in a single pass and reduced with a single MPI_Allreduce.
  */
 template<class Iterator>
 auto makeGlobalBox(Iterator xB,
@@ -107,20 +162,65 @@ auto makeGlobalBox(Iterator xB,
                    Iterator yB,
                    Iterator zB,
                    const Box<typename Iterator::value_type>& previousBox =
-                       Box<typename Iterator::value_type>{0,1})
+                       Box<typename Iterator::value_type>{0,1},
+                   MPI_Comm comm = MPI_COMM_WORLD)
 {
     using T = typename Iterator::value_type;
 
-    std::size_t nElements = xE - xB;
-    T newXmin = (previousBox.pbcX()) ? previousBox.xmin() : globalMin(xB, xB + nElements);
-    T newYmin = (previousBox.pbcY()) ? previousBox.ymin() : globalMin(yB, yB + nElements);
-    T newZmin = (previousBox.pbcZ()) ? previousBox.zmin() : globalMin(zB, zB + nElements);
-    T newXmax = (previousBox.pbcX()) ? previousBox.xmax() : globalMax(xB, xB + nElements);
-    T newYmax = (previousBox.pbcY()) ? previousBox.ymax() : globalMax(yB, yB + nElements);
-    T newZmax = (previousBox.pbcZ()) ? previousBox.zmax() : globalMax(zB, zB + nElements);
+    if (previousBox.pbcX() && previousBox.pbcY() && previousBox.pbcZ()) { return previousBox; }
 
-    return Box<T>{newXmin, newXmax, newYmin, newYmax, newZmin, newZmax,
-                  previousBox.pbcX(), previousBox.pbcY(), previousBox.pbcZ()};
+    std::array<T, 6> limits = detail::localBoxLimits(xB, xE, yB, zB);
+    MPI_Allreduce(MPI_IN_PLACE, limits.data(), 6, MpiType<T>{}, MPI_MIN, comm);
+
+    return detail::boxFromLimits(limits, previousBox);
+}
+
+/*! @brief non-blocking computation of the global bounding box, see makeGlobalBox
+ *
+ * start() computes the local limits and starts their reduction with MPI_Iallreduce, wait() returns the global box.
+ * In between, work that does not depend on the new box can be performed, e.g. processing particles with the keys
+ * of the previous box. Only one reduction per object can be in progress at any time.
+ */
+template<class T>
+class GlobalBoxReduction
+{
+public:
+    GlobalBoxReduction() = default;
+
+    GlobalBoxReduction(const GlobalBoxReduction&) = delete;
+    GlobalBoxReduction& operator=(const GlobalBoxReduction&) = delete;
+
+    ~GlobalBoxReduction()
+    {
+        if (request_ != MPI_REQUEST_NULL) { MPI_Wait(&request_, MPI_STATUS_IGNORE); }
+    }
+
+    //! @brief compute the local limits and start the global reduction, arguments as for makeGlobalBox
+    template<class Iterator>
+    void start(Iterator xB, Iterator xE, Iterator yB, Iterator zB, const Box<T>& previousBox = Box<T>{0, 1},
+               MPI_Comm comm = MPI_COMM_WORLD)
+    {
+        if (request_ != MPI_REQUEST_NULL)
+        {
+            throw std::runtime_error("GlobalBoxReduction: previous reduction still in progress\n");
+        }
+
+        previousBox_ = previousBox;
+        limits_      = detail::localBoxLimits(xB, xE, yB, zB);
+        MPI_Iallreduce(MPI_IN_PLACE, limits_.data(), 6, MpiType<T>{}, MPI_MIN, comm, &request_);
+    }
+
+    //! @brief complete the reduction and return the new global bounding box
+    Box<T> wait()
+    {
+        MPI_Wait(&request_, MPI_STATUS_IGNORE);
+        return detail::boxFromLimits(limits_, previousBox_);
+    }
+
+private:
+    std::array<T, 6> limits_;
+    Box<T> previousBox_{0, 1};
+    MPI_Request request_{MPI_REQUEST_NULL};
 };
 
 } // namespace cstone
@@ -0,0 +1,195 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  3D Hilbert encoding/decoding in 32- and 64-bit
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * Keys are computed with the transpose-based algorithm of J. Skilling,
+ * "Programming the Hilbert curve", AIP Conference Proceedings 707, 381 (2004).
+ * The transform maps integer coordinates to the so-called transposed Hilbert index,
+ * whose bits are then interleaved exactly like those of a Morton code.
+ *
+ * Like Morton codes, Hilbert keys assign 3 bits to each octree subdivision level,
+ * with the consequence that every octree node is a contiguous range of keys of length
+ * nodeRange<KeyType>(level), starting at a key that is a multiple of that range.
+ * All of the cornerstone octree machinery is therefore independent of the choice
+ * between the two curves. What differs is the mapping of a node key to the
+ * node's position in space. Contrary to Morton order, consecutive Hilbert keys are
+ * always face-neighbors, which produces compact, connected SFC domains.
+ */
+
+#pragma once
+
+#include "morton.hpp"
+
+namespace cstone
+{
+
+/*! @brief compute the Hilbert key for a 3D point in integer coordinates
+ *
+ * @tparam KeyType   32- or 64-bit unsigned integer
+ * @param px,py,pz   input coordinates in [0:2^maxTreeLevel<KeyType>{}]
+ * @return           the Hilbert key
+ */
+template<class KeyType>
+CUDA_HOST_DEVICE_FUN
+inline std::enable_if_t<std::is_unsigned<KeyType>{}, KeyType> iHilbert(unsigned px, unsigned py, unsigned pz)
+{
+    assert(px < (1u << maxTreeLevel<KeyType>{}));
+    assert(py < (1u << maxTreeLevel<KeyType>{}));
+    assert(pz < (1u << maxTreeLevel<KeyType>{}));
+
+    constexpr unsigned highestBit = 1u << (maxTreeLevel<KeyType>{} - 1);
+
+    unsigned X[3] = {px, py, pz};
+
+    // inverse undo excess work
+    for (unsigned Q = highestBit; Q > 1; Q >>= 1)
+    {
+        unsigned P = Q - 1;
+        for (int i = 0; i < 3; ++i)
+        {
+            if (X[i] & Q) { X[0] ^= P; }           // invert
+            else
+            {
+                unsigned t = (X[0] ^ X[i]) & P;   // exchange
+                X[0] ^= t;
+                X[i] ^= t;
+            }
+        }
+    }
+
+    // gray encode
+    X[1] ^= X[0];
+    X[2] ^= X[1];
+
+    unsigned t = 0;
+    for (unsigned Q = highestBit; Q > 1; Q >>= 1)
+    {
+        if (X[2] & Q) { t ^= Q - 1; }
+    }
+
+    X[0] ^= t;
+    X[1] ^= t;
+    X[2] ^= t;
+
+    // the transposed index has the same memory layout as a Morton code
+    return imorton3D<KeyType>(X[0], X[1], X[2]);
+}
+
+/*! @brief decode a Hilbert key into integer x,y,z coordinates
+ *
+ * @tparam KeyType     32- or 64-bit unsigned integer
+ * @param[in]  key     input Hilbert key
+ * @param[out] px      x-coordinate in [0:2^maxTreeLevel<KeyType>{}]
+ * @param[out] py      y-coordinate
+ * @param[out] pz      z-coordinate
+ *
+ * Inverts iHilbert.
+ */
+template<class KeyType>
+CUDA_HOST_DEVICE_FUN
+inline std::enable_if_t<std::is_unsigned<KeyType>{}> idecodeHilbert(KeyType key, unsigned& px, unsigned& py, unsigned& pz)
+{
+    constexpr unsigned maxCoord = 1u << maxTreeLevel<KeyType>{};
+
+    unsigned X[3] = {unsigned(idecodeMortonX(key)), unsigned(idecodeMortonY(key)), unsigned(idecodeMortonZ(key))};
+
+    // gray decode
+    unsigned t = X[2] >> 1;
+    X[2] ^= X[1];
+    X[1] ^= X[0];
+    X[0] ^= t;
+
+    // undo excess work
+    for (unsigned Q = 2; Q != maxCoord; Q <<= 1)
+    {
+        unsigned P = Q - 1;
+        for (int i = 2; i >= 0; --i)
+        {
+            if (X[i] & Q) { X[0] ^= P; }      // invert
+            else
+            {
+                t = (X[0] ^ X[i]) & P;        // exchange
+                X[0] ^= t;
+                X[i] ^= t;
+            }
+        }
+    }
+
+    px = X[0];
+    py = X[1];
+    pz = X[2];
+}
+
+/*! @brief compute the integer box of the octree node that starts at @p key
+ *
+ * @tparam KeyType   32- or 64-bit unsigned integer
+ * @param key        Hilbert key of any point inside the node
+ * @param level      subdivision level of the node
+ * @return           the node's integer coordinate box
+ *
+ * The first key of a Hilbert node does not in general map to the node corner closest
+ * to the origin, so the decoded coordinates are truncated to multiples of the node edge length.
+ */
+template<class KeyType>
+CUDA_HOST_DEVICE_FUN
+inline IBox hilbertIBox(KeyType key, unsigned level)
+{
+    assert(level <= maxTreeLevel<KeyType>{});
+    unsigned cubeLength = 1u << (maxTreeLevel<KeyType>{} - level);
+    unsigned mask       = ~(cubeLength - 1);
+
+    unsigned ix, iy, iz;
+    idecodeHilbert(key, ix, iy, iz);
+
+    int xmin = ix & mask;
+    int ymin = iy & mask;
+    int zmin = iz & mask;
+
+    return IBox(xmin, xmin + cubeLength, ymin, ymin + cubeLength, zmin, zmin + cubeLength);
+}
+
+/*! @brief Calculates a Hilbert key for a 3D point within the specified box
+ *
+ * @tparam KeyType  32- or 64-bit unsigned integer, needs to be specified explicitly
+ * @param[in] x,y,z input coordinates within @p box
+ * @param[in] box   bounding for coordinates
+ * @return          the Hilbert key
+ */
+template<class KeyType, class T>
+CUDA_HOST_DEVICE_FUN
+inline std::enable_if_t<std::is_unsigned<KeyType>{}, KeyType> hilbert3D(T x, T y, T z, Box<T> box)
+{
+    unsigned ix = toNBitInt<KeyType>(normalize(x, box.xmin(), box.xmax()));
+    unsigned iy = toNBitInt<KeyType>(normalize(y, box.ymin(), box.ymax()));
+    unsigned iz = toNBitInt<KeyType>(normalize(z, box.zmin(), box.zmax()));
+
+    return iHilbert<KeyType>(ix, iy, iz);
+}
+
+} // namespace cstone
@@ -31,11 +31,17 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>       // for std::ceil
 #include <cstdint>     // for uint32_t and uint64_t
 #include <type_traits> // for std::enable_if_t
 
+#if defined(__BMI2__) && !defined(__CUDA_ARCH__)
+#include <immintrin.h> // for _pdep_u32/64 and _pext_u32/64
+#endif
+
+#include "cstone/util/executor.hpp"
 #include "box.hpp"
 #include "common.hpp"
 
@@ -49,12 +55,17 @@ namespace detail
 CUDA_HOST_DEVICE_FUN
 inline unsigned expandBits(unsigned v)
 {
+#if defined(__BMI2__) && !defined(__CUDA_ARCH__)
+    // deposit the lower 10 bits into every third bit position (flag: -mbmi2 or -march=haswell)
+    return _pdep_u32(v, 0x09249249u);
+#else
     v &= 0x000003ffu; // discard bit higher 10
     v = (v * 0x00010001u) & 0xFF0000FFu;
     v = (v * 0x00000101u) & 0x0F00F00Fu;
     v = (v * 0x00000011u) & 0xC30C30C3u;
     v = (v * 0x00000005u) & 0x49249249u;
     return v;
+#endif
 }
 
 /*! @brief Compacts a 30-bit integer into 10 bits by selecting only bits divisible by 3
@@ -63,18 +74,25 @@ inline unsigned expandBits(unsigned v)
 CUDA_HOST_DEVICE_FUN
 inline unsigned compactBits(unsigned v)
 {
+#if defined(__BMI2__) && !defined(__CUDA_ARCH__)
+    return _pext_u32(v, 0x09249249u);
+#else
     v &= 0x09249249u;
     v = (v ^ (v >>  2u)) & 0x030c30c3u;
     v = (v ^ (v >>  4u)) & 0x0300f00fu;
     v = (v ^ (v >>  8u)) & 0xff0000ffu;
     v = (v ^ (v >> 16u)) & 0x000003ffu;
     return v;
+#endif
 }
 
 //! @brief Expands a 21-bit integer into 63 bits by inserting 2 zeros after each bit.
 CUDA_HOST_DEVICE_FUN
 inline uint64_t expandBits(uint64_t v)
 {
+#if defined(__BMI2__) && !defined(__CUDA_ARCH__)
+    return _pdep_u64(v, 0x1249249249249249lu);
+#else
     uint64_t x = v & 0x1fffffu; // discard bits higher 21
     x = (x | x << 32u) & 0x001f00000000fffflu;
     x = (x | x << 16u) & 0x001f0000ff0000fflu;
@@ -82,6 +100,7 @@ inline uint64_t expandBits(uint64_t v)
     x = (x | x << 4u)  & 0x10c30c30c30c30c3lu;
     x = (x | x << 2u)  & 0x1249249249249249lu;
     return x;
+#endif
 }
 
 /*! @brief Compacts a 63-bit integer into 21 bits by selecting only bits divisible by 3
@@ -90,6 +109,9 @@ inline uint64_t expandBits(uint64_t v)
 CUDA_HOST_DEVICE_FUN
 inline uint64_t compactBits(uint64_t v)
 {
+#if defined(__BMI2__) && !defined(__CUDA_ARCH__)
+    return _pext_u64(v, 0x1249249249249249lu);
+#else
     v &= 0x1249249249249249lu;
     v = (v ^ (v >>  2u)) & 0x10c30c30c30c30c3lu;
     v = (v ^ (v >>  4u)) & 0x100f00f00f00f00flu;
@@ -97,6 +119,7 @@ inline uint64_t compactBits(uint64_t v)
     v = (v ^ (v >> 16u)) & 0x001f00000000fffflu;
     v = (v ^ (v >> 32u)) & 0x00000000001ffffflu;
     return v;
+#endif
 }
 
 } // namespace detail
@@ -395,6 +418,10 @@ mortonNeighbor(KeyType code, unsigned treeLevel, int dx, int dy, int dz,
 
 
 /*! @brief compute the Morton codes for the input coordinate arrays
+ *
+ * The loop is vectorized over particles. If BMI2 is enabled (-mbmi2 or -march=haswell and later),
+ * bit interleaving uses scalar pdep instructions, otherwise the compiler vectorizes the magic number
+ * expansion of detail::expandBits, e.g. with AVX2, AVX-512 or NEON.
  *
  * @tparam     T          float or double
  * @param[in]  xBegin     input iterators for coordinate arrays
@@ -415,11 +442,19 @@ void computeMortonCodes(InputIterator  xBegin,
     assert(xEnd >= xBegin);
     using CodeType = std::decay_t<decltype(*codesBegin)>;
 
-    #pragma omp parallel for schedule(static)
-    for (std::size_t i = 0; i < std::size_t(xEnd-xBegin); ++i)
+    constexpr std::size_t blockSize = 4096;
+    std::size_t numElements = xEnd - xBegin;
+    std::size_t numBlocks   = (numElements + blockSize - 1) / blockSize;
+
+    parallelFor(std::size_t(0), numBlocks, [=, &box](std::size_t block)
     {
-        codesBegin[i] = morton3D<CodeType>(xBegin[i], yBegin[i], zBegin[i], box);
-    }
+        std::size_t last = std::min((block + 1) * blockSize, numElements);
+        #pragma omp simd
+        for (std::size_t i = block * blockSize; i < last; ++i)
+        {
+            codesBegin[i] = morton3D<CodeType>(xBegin[i], yBegin[i], zBegin[i], box);
+        }
+    });
 }
 
 } // namespace cstone
@@ -0,0 +1,74 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  SFC key computation on the GPU
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include "cstone/util/util.hpp"
+#include "sfc.hpp"
+
+namespace cstone
+{
+
+//! @brief see computeSfcKeysGpu
+template<class SfcKind, class T>
+__global__ void computeSfcKeysKernel(const T* x, const T* y, const T* z, SfcKeyType_t<SfcKind>* keys,
+                                     size_t numKeys, const Box<T> box)
+{
+    size_t tid = blockDim.x * blockIdx.x + threadIdx.x;
+    if (tid < numKeys)
+    {
+        keys[tid] = sfc3D<SfcKind>(x[tid], y[tid], z[tid], box);
+    }
+}
+
+/*! @brief compute the SFC keys for device coordinate arrays
+ *
+ * @tparam     SfcKind  selects the curve and the key type, see sfc.hpp
+ * @tparam     T        float or double
+ * @param[in]  x        device x-coordinates, length @p numKeys
+ * @param[in]  y        device y-coordinates, length @p numKeys
+ * @param[in]  z        device z-coordinates, length @p numKeys
+ * @param[out] keys     device output SFC keys, length @p numKeys
+ * @param[in]  numKeys  number of coordinates
+ * @param[in]  box      coordinate bounding box, passed to the kernel by value
+ */
+template<class SfcKind, class T>
+void computeSfcKeysGpu(const T* x, const T* y, const T* z, SfcKeyType_t<SfcKind>* keys, size_t numKeys,
+                       const Box<T>& box)
+{
+    constexpr int threadsPerBlock = 256;
+    if (numKeys == 0) { return; }
+
+    computeSfcKeysKernel<SfcKind><<<iceil(numKeys, threadsPerBlock), threadsPerBlock>>>
+        (x, y, z, keys, numKeys, box);
+}
+
+} // namespace cstone
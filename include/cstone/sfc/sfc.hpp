@@ -0,0 +1,240 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  SFC key types and curve-agnostic key encoding/decoding
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * Octree nodes, particle keys and all key arithmetic always use plain 32- or 64-bit
+ * unsigned integers. The choice of space-filling curve is expressed through an additional
+ * SfcKind type that is either
+ *      - a plain unsigned integer, which selects the Morton curve (default),
+ *      - MortonKey<KeyType>, or
+ *      - HilbertKey<KeyType>
+ *
+ * and is only needed by the functions that map keys to coordinates and vice versa.
+ * Domain<HilbertKey<uint64_t>, double> for example will use Hilbert order with 64-bit keys.
+ */
+
+#pragma once
+
+#include "hilbert.hpp"
+#include "morton.hpp"
+
+namespace cstone
+{
+
+struct MortonKeyTag
+{
+};
+
+struct HilbertKeyTag
+{
+};
+
+//! @brief selects the Morton curve with keys of type IntegerType
+template<class IntegerType>
+using MortonKey = StrongType<IntegerType, MortonKeyTag>;
+
+//! @brief selects the Hilbert curve with keys of type IntegerType
+template<class IntegerType>
+using HilbertKey = StrongType<IntegerType, HilbertKeyTag>;
+
+//! @brief plain unsigned integers map to the Morton curve
+template<class SfcKind>
+struct SfcKindTraits
+{
+    static_assert(std::is_unsigned<SfcKind>{}, "SFC key type needs to be an unsigned integer\n");
+    using KeyType = SfcKind;
+    using CurveTag = MortonKeyTag;
+};
+
+template<class IntegerType, class Tag>
+struct SfcKindTraits<StrongType<IntegerType, Tag>>
+{
+    static_assert(std::is_unsigned<IntegerType>{}, "SFC key type needs to be an unsigned integer\n");
+    using KeyType = IntegerType;
+    using CurveTag = Tag;
+};
+
+//! @brief the unsigned integer type used to store keys of @p SfcKind
+template<class SfcKind>
+using SfcKeyType_t = typename SfcKindTraits<SfcKind>::KeyType;
+
+template<class SfcKind>
+struct IsHilbert : stl::integral_constant<bool, std::is_same_v<typename SfcKindTraits<SfcKind>::CurveTag, HilbertKeyTag>>
+{
+};
+
+/*! @brief compute the SFC key for a 3D point in integer coordinates
+ *
+ * @tparam SfcKind   selects the curve and the key type, see file description
+ * @param ix,iy,iz   input coordinates in [0:2^maxTreeLevel<KeyType>{}]
+ */
+template<class SfcKind>
+CUDA_HOST_DEVICE_FUN
+inline SfcKeyType_t<SfcKind> iSfcKey(unsigned ix, unsigned iy, unsigned iz)
+{
+    using KeyType = SfcKeyType_t<SfcKind>;
+    if constexpr (IsHilbert<SfcKind>{}) { return iHilbert<KeyType>(ix, iy, iz); }
+    else { return imorton3D<KeyType>(ix, iy, iz); }
+}
+
+//! @brief compute the SFC key for a 3D point within the specified box
+template<class SfcKind, class T>
+CUDA_HOST_DEVICE_FUN
+inline SfcKeyType_t<SfcKind> sfc3D(T x, T y, T z, const Box<T>& box)
+{
+    using KeyType = SfcKeyType_t<SfcKind>;
+    if constexpr (IsHilbert<SfcKind>{}) { return hilbert3D<KeyType>(x, y, z, box); }
+    else { return morton3D<KeyType>(x, y, z, box); }
+}
+
+/*! @brief compute the integer coordinate box of a binary or octree node
+ *
+ * @tparam SfcKind      selects the curve and the key type, see file description
+ * @param prefix        lowest SFC key of the node
+ * @param prefixLength  number of bits in @p prefix that define the node,
+ *                      the corresponding key range is 2^(3*maxTreeLevel<KeyType>{} - prefixLength)
+ * @return              the integer box occupied by the node
+ *
+ * Binary nodes with prefix lengths that are not multiples of 3 cover 2 or 4 consecutive
+ * octants of their parent node. Along the Hilbert curve, these octants are always
+ * face-neighbors and form a box.
+ */
+template<class SfcKind>
+CUDA_HOST_DEVICE_FUN
+inline IBox sfcIBox(SfcKeyType_t<SfcKind> prefix, int prefixLength)
+{
+    using KeyType = SfcKeyType_t<SfcKind>;
+
+    if constexpr (IsHilbert<SfcKind>{})
+    {
+        unsigned level = prefixLength / 3;
+        unsigned remainder = prefixLength % 3;
+        if (remainder == 0) { return hilbertIBox(prefix, level); }
+
+        IBox ret = hilbertIBox(prefix, level + 1);
+        // remaining octants at level + 1 covered by the binary node
+        unsigned numOctants = 8u >> remainder;
+        for (unsigned i = 1; i < numOctants; ++i)
+        {
+            IBox octant = hilbertIBox(KeyType(prefix + i * nodeRange<KeyType>(level + 1)), level + 1);
+            ret = IBox(stl::min(ret.xmin(), octant.xmin()), stl::max(ret.xmax(), octant.xmax()),
+                       stl::min(ret.ymin(), octant.ymin()), stl::max(ret.ymax(), octant.ymax()),
+                       stl::min(ret.zmin(), octant.zmin()), stl::max(ret.zmax(), octant.zmax()));
+        }
+        return ret;
+    }
+    else
+    {
+        pair<int> xrange = idecodeMortonXRange(prefix, prefixLength);
+        pair<int> yrange = idecodeMortonYRange(prefix, prefixLength);
+        pair<int> zrange = idecodeMortonZRange(prefix, prefixLength);
+
+        return IBox(xrange[0], xrange[1], yrange[0], yrange[1], zrange[0], zrange[1]);
+    }
+}
+
+namespace detail
+{
+
+//! @brief shift integer coordinate @p x by @p delta, wrap around if @p pbc, otherwise discard shifts out of range
+template<class KeyType>
+CUDA_HOST_DEVICE_FUN
+inline int shiftCoordinate(int x, int delta, bool pbc)
+{
+    constexpr int pbcRange = 1u << maxTreeLevel<KeyType>{};
+    constexpr int maxCoord = pbcRange - 1;
+
+    int newX = x + delta;
+    if (pbc) { return pbcAdjust<pbcRange>(newX); }
+    return (newX < 0 || newX > maxCoord) ? x : newX;
+}
+
+} // namespace detail
+
+/*! @brief compute the SFC key of the neighbor of an octree node
+ *
+ * @tparam SfcKind  selects the curve and the key type, see file description
+ * @param key       input SFC key
+ * @param level     octree subdivision level, 0-10 for 32-bit, and 0-21 for 64-bit
+ * @param dx,dy,dz  neighbor offsets at @p level
+ * @param pbcX,Y,Z  apply pbc in X,Y,Z direction
+ * @return          neighbor start key, see mortonNeighbor
+ */
+template<class SfcKind>
+CUDA_HOST_DEVICE_FUN
+inline SfcKeyType_t<SfcKind> sfcNeighbor(SfcKeyType_t<SfcKind> key, unsigned level, int dx, int dy, int dz,
+                                         bool pbcX = true, bool pbcY = true, bool pbcZ = true)
+{
+    using KeyType = SfcKeyType_t<SfcKind>;
+
+    if constexpr (IsHilbert<SfcKind>{})
+    {
+        int shiftValue = int(1u << (maxTreeLevel<KeyType>{} - level));
+        IBox node      = hilbertIBox(key, level);
+
+        int x = detail::shiftCoordinate<KeyType>(node.xmin(), dx * shiftValue, pbcX);
+        int y = detail::shiftCoordinate<KeyType>(node.ymin(), dy * shiftValue, pbcY);
+        int z = detail::shiftCoordinate<KeyType>(node.zmin(), dz * shiftValue, pbcZ);
+
+        return enclosingBoxCode(iHilbert<KeyType>(x, y, z), level);
+    }
+    else { return mortonNeighbor(key, level, dx, dy, dz, pbcX, pbcY, pbcZ); }
+}
+
+/*! @brief compute the SFC keys for the input coordinate arrays
+ *
+ * @tparam     SfcKind    selects the curve, see file description
+ * @param[in]  xBegin     input iterators for coordinate arrays
+ * @param[in]  xEnd
+ * @param[in]  yBegin
+ * @param[in]  zBegin
+ * @param[out] keysBegin  output for SFC keys
+ * @param[in]  box        coordinate bounding box
+ */
+template<class SfcKind, class InputIterator, class OutputIterator, class T>
+void computeSfcKeys(InputIterator  xBegin,
+                    InputIterator  xEnd,
+                    InputIterator  yBegin,
+                    InputIterator  zBegin,
+                    OutputIterator keysBegin,
+                    const Box<T>& box)
+{
+    assert(xEnd >= xBegin);
+    static_assert(std::is_same_v<std::decay_t<decltype(*keysBegin)>, SfcKeyType_t<SfcKind>>,
+                  "output key type does not match SfcKind\n");
+
+    if constexpr (IsHilbert<SfcKind>{})
+    {
+        parallelFor(std::size_t(0), std::size_t(xEnd - xBegin), [=, &box](std::size_t i)
+                    { keysBegin[i] = sfc3D<SfcKind>(xBegin[i], yBegin[i], zBegin[i], box); });
+    }
+    else { computeMortonCodes(xBegin, xEnd, yBegin, zBegin, keysBegin, box); }
+}
+
+} // namespace cstone
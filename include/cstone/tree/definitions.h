@@ -25,36 +25,54 @@
 
 #pragma once
 
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
 #include "cstone/cuda/annotation.hpp"
 
 namespace cstone
 {
 
-//! @brief Controls the node index type, has to be signed. Change to 64-bit if more than 2 billion tree nodes are
-//! required.
-using TreeNodeIndex = int;
-
+/*! @brief index types for tree nodes and rank-local particles
+ *
+ * The default 32-bit indices support up to 2^31 tree nodes and 2^32 particles per rank. Defining
+ * CSTONE_64BIT_INDICES (CMake option CSTONE_WITH_64BIT_INDICES) switches both to 64 bits for ranks
+ * that hold more particles, e.g. when several GPUs are merged into one rank.
+ * TreeNodeIndex has to be signed, negative values mark leaf indices in the internal tree.
+ */
+#ifdef CSTONE_64BIT_INDICES
+using TreeNodeIndex      = int64_t;
+using LocalParticleIndex = uint64_t;
+#else
+using TreeNodeIndex      = int;
 using LocalParticleIndex = unsigned;
+#endif
+
+static_assert(std::is_signed_v<TreeNodeIndex>, "TreeNodeIndex has to be signed\n");
+static_assert(std::is_unsigned_v<LocalParticleIndex>, "LocalParticleIndex has to be unsigned\n");
 
 //! @brief checks whether a binary tree index corresponds to a leaf index
 CUDA_HOST_DEVICE_FUN
 constexpr bool isLeafIndex(TreeNodeIndex nodeIndex) { return nodeIndex < 0; }
 
+//! @brief the most negative TreeNodeIndex, -2^31 or -2^63, leaf indices are stored relative to it
+constexpr TreeNodeIndex leafIndexOffset =
+    TreeNodeIndex(~(std::make_unsigned_t<TreeNodeIndex>(-1) >> 1));
+
 //! @brief convert a leaf index to the storage format
 CUDA_HOST_DEVICE_FUN
 constexpr TreeNodeIndex storeLeafIndex(TreeNodeIndex index)
 {
-    // -2^31 or -2^63
-    constexpr auto offset = TreeNodeIndex(-(1ul << (8 * sizeof(TreeNodeIndex) - 1)));
-    return index + offset;
+    return index + leafIndexOffset;
 }
 
 //! @brief restore a leaf index from the storage format
 CUDA_HOST_DEVICE_FUN
 constexpr TreeNodeIndex loadLeafIndex(TreeNodeIndex index)
 {
-    constexpr auto offset = TreeNodeIndex(-(1ul << (8 * sizeof(TreeNodeIndex) - 1)));
-    return index - offset;
+    return index - leafIndexOffset;
 }
 
 /*! @brief returns the number of nodes in a tree
@@ -43,12 +43,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <type_traits>
 #include <vector>
 
 #include "cstone/primitives/mpi_wrappers.hpp"
+#include "cstone/primitives/varint.hpp"
 #include "cstone/tree/octree.hpp"
 #include "cstone/util/gsl-lite.hpp"
 #include "cstone/util/index_ranges.hpp"
+#include "cstone/util/tracing.hpp"
 
 namespace cstone
 {
@@ -78,6 +82,116 @@ void countRequestParticles(gsl::span<const KeyType> leaves, gsl::span<const unsi
     }
 }
 
+/*! @brief persistent buffers for exchangePeerCounts
+ *
+ * Reusing the same buffers for consecutive exchanges avoids memory allocation once the
+ * buffers have grown to the sizes required by the peer node structures.
+ */
+template<class KeyType>
+struct PeerCountBuffers
+{
+    //! @brief the node structures received from each peer rank
+    std::vector<std::vector<KeyType>> queryLeaves;
+    //! @brief answers per peer rank, need to stay alive until the non-blocking sends have completed
+    std::vector<std::vector<unsigned>> answers;
+    //! @brief receives of the node structures, one per peer rank, completed in arbitrary order
+    std::vector<MPI_Request> queryRequests;
+    //! @brief receives of the answers and non-blocking sends of queries and answers
+    std::vector<MPI_Request> requests;
+
+    //! @brief with compression: encoded queries sent to, answers sent to and answers received from each peer rank
+    std::vector<std::vector<uint8_t>> encodedQueries;
+    std::vector<std::vector<uint8_t>> encodedAnswers;
+    std::vector<std::vector<uint8_t>> encodedReceives;
+    //! @brief with compression: the encoded node structure received from a peer rank, processed one at a time
+    std::vector<uint8_t> encodedQuery;
+};
+
+namespace detail
+{
+
+/*! @brief exchangePeerCounts with variable-length encoded node structures and counts
+ *
+ * The node structures are sent as differences between consecutive keys. Since their encoded sizes are not
+ * known in advance, they are received in the order of arrival with MPI_Probe. The receives for the answers are
+ * posted with the maximum encoded size and decoded once all answers have arrived.
+ */
+template<class KeyType>
+void exchangePeerCountsCompressed(gsl::span<const int> peerRanks,
+                                  gsl::span<const IndexPair<TreeNodeIndex>> exchangeIndices,
+                                  gsl::span<const KeyType> localLeaves, gsl::span<unsigned> localCounts,
+                                  PeerCountBuffers<KeyType>& buffers, MPI_Comm comm)
+{
+    int queryTag  = nextTagEpoch(comm, ExchangeKind::peerCounts);
+    int answerTag = queryTag + 1;
+
+    size_t numPeers = peerRanks.size();
+    buffers.queryLeaves.resize(numPeers);
+    buffers.answers.resize(numPeers);
+    buffers.encodedQueries.resize(numPeers);
+    buffers.encodedAnswers.resize(numPeers);
+    buffers.encodedReceives.resize(numPeers);
+    buffers.requests.clear();
+
+    for (size_t rankIndex = 0; rankIndex < numPeers; ++rankIndex)
+    {
+        std::vector<uint8_t>& receive = buffers.encodedReceives[rankIndex];
+        receive.resize(exchangeIndices[rankIndex].count() * maxVarintBytes<unsigned>());
+        buffers.requests.push_back(MPI_Request{});
+        MPI_Irecv(receive.data(), int(receive.size()), MPI_BYTE, peerRanks[rankIndex], answerTag, comm,
+                  &buffers.requests.back());
+    }
+
+    for (size_t rankIndex = 0; rankIndex < numPeers; ++rankIndex)
+    {
+        // +1 to include the upper key boundary for the last node
+        std::vector<uint8_t>& query = buffers.encodedQueries[rankIndex];
+        encodeSortedKeys(localLeaves.subspan(exchangeIndices[rankIndex].start(), exchangeIndices[rankIndex].count() + 1),
+                         query);
+        buffers.requests.push_back(MPI_Request{});
+        MPI_Isend(query.data(), int(query.size()), MPI_BYTE, peerRanks[rankIndex], queryTag, comm,
+                  &buffers.requests.back());
+    }
+
+    for (size_t numMessages = 0; numMessages < numPeers; ++numMessages)
+    {
+        MPI_Status status;
+        MPI_Probe(MPI_ANY_SOURCE, queryTag, comm, &status);
+        int numBytes;
+        MPI_Get_count(&status, MPI_BYTE, &numBytes);
+        size_t rankIndex = std::find(peerRanks.begin(), peerRanks.end(), status.MPI_SOURCE) - peerRanks.begin();
+
+        buffers.encodedQuery.resize(numBytes);
+        MPI_Recv(buffers.encodedQuery.data(), numBytes, MPI_BYTE, status.MPI_SOURCE, queryTag, comm,
+                 MPI_STATUS_IGNORE);
+
+        // a peer cannot request a node structure with a higher resolution than the local tree
+        std::vector<KeyType>& queryLeaves = buffers.queryLeaves[rankIndex];
+        if (queryLeaves.size() < localLeaves.size()) { queryLeaves.resize(localLeaves.size()); }
+        size_t numKeys = decodeSortedKeys<KeyType>(buffers.encodedQuery, queryLeaves);
+
+        std::vector<unsigned>& answer = buffers.answers[rankIndex];
+        answer.resize(numKeys - 1);
+        countRequestParticles<KeyType>(localLeaves, localCounts, {queryLeaves.data(), numKeys}, answer);
+
+        std::vector<uint8_t>& encodedAnswer = buffers.encodedAnswers[rankIndex];
+        encodeValues<unsigned>(answer, encodedAnswer);
+        buffers.requests.push_back(MPI_Request{});
+        MPI_Isend(encodedAnswer.data(), int(encodedAnswer.size()), MPI_BYTE, peerRanks[rankIndex], answerTag,
+                  comm, &buffers.requests.back());
+    }
+
+    MPI_Waitall(int(buffers.requests.size()), buffers.requests.data(), MPI_STATUSES_IGNORE);
+
+    for (size_t rankIndex = 0; rankIndex < numPeers; ++rankIndex)
+    {
+        decodeValues(buffers.encodedReceives[rankIndex].data(),
+                     localCounts.subspan(exchangeIndices[rankIndex].start(), exchangeIndices[rankIndex].count()));
+    }
+}
+
+} // namespace detail
+
 /*! @brief exchange particle counts with specified peer ranks
  *
  * @tparam KeyType                  32- or 64-bit unsigned integer
@@ -88,73 +202,185 @@ void countRequestParticles(gsl::span<const KeyType> leaves, gsl::span<const unsi
  *                                  of the executing rank
  * @param[out] localCounts          particle counts associated with @p localLeaves
  *                                  length(localCounts) = length(localLeaves) - 1
- * @param[-]   queryLeafBuffer      temp buffer for MPI p2p, length = same as @p localLeaves
- * @param[-]   queryCountBuffer     temp buffer for MPI p2p, length = same as @p localCounts
+ * @param[-]   buffers              temporary storage, reused across calls
+ * @param[in]  compress             send node structures and counts variable-length encoded, which reduces the
+ *                                  message sizes at the cost of encoding and decoding, all ranks need to pass
+ *                                  the same value
+ * @param[in]  comm                 communicator in which @p peerRanks are numbered
  *
  * Procedure on each rank:
- *  1. Send out the SFC keys for which it wants to get particle counts to peer ranks
- *  2. receive SFC keys from other peer ranks, count particles and send back the counts as answer
- *  3. receive answer with the counts for the requested keys
+ *  1. Post receives for the answers of all peer ranks, their sizes are given by @p exchangeIndices,
+ *     and for one node structure from each peer rank, whose size is bounded by the length of @p localLeaves
+ *  2. Send out the SFC keys for which it wants to get particle counts to peer ranks
+ *  3. In the order in which the node structures of the peer ranks arrive, count particles and send back
+ *     the counts as answer
+ *  4. Wait for the answers with the counts for the requested keys
+ *
+ * None of the steps blocks on a particular peer rank.
  */
 template<class KeyType>
 void exchangePeerCounts(gsl::span<const int> peerRanks, gsl::span<const IndexPair<TreeNodeIndex>> exchangeIndices,
                         gsl::span<const KeyType> localLeaves, gsl::span<unsigned> localCounts,
-                        gsl::span<KeyType> queryLeafBuffer, gsl::span<unsigned> queryCountBuffer)
+                        PeerCountBuffers<KeyType>& buffers, bool compress = false,
+                        MPI_Comm comm = MPI_COMM_WORLD)
 
 {
-    std::vector<std::vector<unsigned>> sendBuffers;
-    sendBuffers.reserve(peerRanks.size());
+    CSTONE_TRACE_RANGE("exchangePeerCounts");
+    if (compress)
+    {
+        detail::exchangePeerCountsCompressed(peerRanks, exchangeIndices, localLeaves, localCounts, buffers, comm);
+        return;
+    }
+
+    int queryTag  = nextTagEpoch(comm, ExchangeKind::peerCounts);
+    int answerTag = queryTag + 1;
+
+    size_t numPeers = peerRanks.size();
+    buffers.queryLeaves.resize(numPeers);
+    buffers.answers.resize(numPeers);
+    buffers.queryRequests.assign(numPeers, MPI_REQUEST_NULL);
+    buffers.requests.clear();
+
+    for (size_t rankIndex = 0; rankIndex < numPeers; ++rankIndex)
+    {
+        buffers.requests.push_back(MPI_Request{});
+        MPI_Irecv(localCounts.data() + exchangeIndices[rankIndex].start(), exchangeIndices[rankIndex].count(),
+                  MPI_UNSIGNED, peerRanks[rankIndex], answerTag, comm, &buffers.requests.back());
+    }
+
+    // a peer cannot request a node structure with a higher resolution than the local tree
+    for (size_t rankIndex = 0; rankIndex < numPeers; ++rankIndex)
+    {
+        std::vector<KeyType>& query = buffers.queryLeaves[rankIndex];
+        if (query.size() < localLeaves.size()) { query.resize(localLeaves.size()); }
+        MPI_Irecv(query.data(), localLeaves.size(), MpiType<KeyType>{}, peerRanks[rankIndex], queryTag,
+                  comm, &buffers.queryRequests[rankIndex]);
+    }
 
-    std::vector<MPI_Request> sendRequests;
-    for (size_t rankIndex = 0; rankIndex < peerRanks.size(); ++rankIndex)
+    for (size_t rankIndex = 0; rankIndex < numPeers; ++rankIndex)
     {
-        int destinationRank = peerRanks[rankIndex];
         // +1 to include the upper key boundary for the last node
         TreeNodeIndex sendCount = exchangeIndices[rankIndex].count() + 1;
-        mpiSendAsync(localLeaves.data() + exchangeIndices[rankIndex].start(), sendCount, destinationRank, 0, sendRequests);
+        mpiSendAsync(localLeaves.data() + exchangeIndices[rankIndex].start(), sendCount, peerRanks[rankIndex],
+                     queryTag, buffers.requests, comm);
     }
 
-    size_t numMessages = peerRanks.size();
-    while (numMessages > 0)
+    for (size_t numMessages = 0; numMessages < numPeers; ++numMessages)
     {
+        int rankIndex;
         MPI_Status status;
-        // receive SFC key sequence from remote rank, this defines the remote rank's node structure view of the local domain
-        mpiRecvSync(queryLeafBuffer.data(), queryLeafBuffer.size(), MPI_ANY_SOURCE, 0, &status);
-        int receiveRank = status.MPI_SOURCE;
-        TreeNodeIndex numKeys;
+        MPI_Waitany(int(numPeers), buffers.queryRequests.data(), &rankIndex, &status);
+        int numKeys;
         MPI_Get_count(&status, MpiType<KeyType>{}, &numKeys);
 
         // compute particle counts for the received node structure.
         // The number of nodes to count is one less the number of received SFC keys
-        TreeNodeIndex numNodes = numKeys - 1;
-        std::vector<unsigned> countBuffer(numNodes);
-        countRequestParticles<KeyType>(localLeaves, localCounts, queryLeafBuffer.first(numKeys), countBuffer);
+        std::vector<unsigned>& answer = buffers.answers[rankIndex];
+        answer.resize(numKeys - 1);
+        countRequestParticles<KeyType>(localLeaves, localCounts,
+                                       gsl::span<const KeyType>(buffers.queryLeaves[rankIndex].data(), numKeys),
+                                       answer);
 
         // send back answer with the counts for the requested nodes
-        mpiSendAsync(countBuffer.data(), numNodes, receiveRank, 1, sendRequests);
-        sendBuffers.push_back(std::move(countBuffer));
+        buffers.requests.push_back(MPI_Request{});
+        MPI_Isend(answer.data(), answer.size(), MPI_UNSIGNED, peerRanks[rankIndex], answerTag, comm,
+                  &buffers.requests.back());
+    }
+
+    MPI_Waitall(int(buffers.requests.size()), buffers.requests.data(), MPI_STATUSES_IGNORE);
+}
+
+/*! @brief persistent buffers for exchangeNodeData
+ *
+ * Reusing the same buffers for consecutive exchanges avoids memory allocation once the
+ * buffers have grown to the sizes required by the peer node structures.
+ */
+template<class KeyType, class NodeData>
+struct NodeExchangeBuffers
+{
+    //! @brief the node structure received from a peer rank, processed one peer at a time
+    std::vector<KeyType> queryLeaves;
+    //! @brief answers per peer rank, need to stay alive until the non-blocking sends have completed
+    std::vector<std::vector<NodeData>> answers;
+    std::vector<MPI_Request> requests;
+};
 
-        numMessages--;
+/*! @brief exchange arbitrary per-node quantities with specified peer ranks
+ *
+ * @tparam KeyType                  32- or 64-bit unsigned integer
+ * @tparam NodeData                 a trivially copyable per-node payload, e.g. particle counts or multipoles
+ * @tparam F                        callable with signature
+ *                                  void(gsl::span<const KeyType> requestLeaves, gsl::span<NodeData> answer)
+ * @param[in]    peerRanks          list of peer rank IDs
+ * @param[in]    exchangeIndices    contains one range of indices of @p localLeaves to request data
+ *                                  for from each peer rank, length = same as @p peerRanks
+ * @param[in]    localLeaves        cornerstone SFC key sequence of the locally (focused) tree
+ * @param[out]   localData          node data associated with @p localLeaves, the ranges
+ *                                  @p exchangeIndices are overwritten with the answers from the peer ranks,
+ *                                  length = length(localLeaves) - 1
+ * @param[in]    answerFunction     computes the payload for the node structure @p requestLeaves
+ *                                  that a peer rank requested from the executing rank
+ * @param[-]     buffers            temporary storage, reused across calls
+ * @param[in]    comm               communicator in which @p peerRanks are numbered
+ *
+ * Same protocol as exchangePeerCounts, but with a single round trip: receives for the answers are posted
+ * before the node structures are sent, and the answers are sent back without blocking.
+ * The payload is transferred as bytes, no MPI datatype has to be defined for @p NodeData.
+ */
+template<class KeyType, class NodeData, class F>
+void exchangeNodeData(gsl::span<const int> peerRanks, gsl::span<const IndexPair<TreeNodeIndex>> exchangeIndices,
+                      gsl::span<const KeyType> localLeaves, gsl::span<NodeData> localData, F&& answerFunction,
+                      NodeExchangeBuffers<KeyType, NodeData>& buffers, MPI_Comm comm = MPI_COMM_WORLD)
+{
+    CSTONE_TRACE_RANGE("exchangeNodeData");
+    static_assert(std::is_trivially_copyable_v<NodeData>, "node data is sent as bytes\n");
+
+    int queryTag  = nextTagEpoch(comm, ExchangeKind::nodeData);
+    int answerTag = queryTag + 1;
+
+    size_t numPeers = peerRanks.size();
+    buffers.answers.resize(numPeers);
+    buffers.requests.clear();
+
+    for (size_t rankIndex = 0; rankIndex < numPeers; ++rankIndex)
+    {
+        buffers.requests.push_back(MPI_Request{});
+        MPI_Irecv(localData.data() + exchangeIndices[rankIndex].start(),
+                  exchangeIndices[rankIndex].count() * sizeof(NodeData), MPI_BYTE, peerRanks[rankIndex], answerTag,
+                  comm, &buffers.requests.back());
     }
 
-    numMessages = peerRanks.size();
-    while (numMessages > 0)
+    for (size_t rankIndex = 0; rankIndex < numPeers; ++rankIndex)
+    {
+        // +1 to include the upper key boundary for the last node
+        TreeNodeIndex sendCount = exchangeIndices[rankIndex].count() + 1;
+        mpiSendAsync(localLeaves.data() + exchangeIndices[rankIndex].start(), sendCount, peerRanks[rankIndex],
+                     queryTag, buffers.requests, comm);
+    }
+
+    for (size_t numMessages = 0; numMessages < numPeers; ++numMessages)
     {
         MPI_Status status;
-        MPI_Probe(MPI_ANY_SOURCE, 1, MPI_COMM_WORLD, &status);
+        MPI_Probe(MPI_ANY_SOURCE, queryTag, comm, &status);
         int receiveRank = status.MPI_SOURCE;
+        int numKeys;
+        MPI_Get_count(&status, MpiType<KeyType>{}, &numKeys);
 
-        size_t receiveRankIndex    = std::find(peerRanks.begin(), peerRanks.end(), receiveRank) - peerRanks.begin();
-        TreeNodeIndex receiveCount = exchangeIndices[receiveRankIndex].count();
-        mpiRecvSync(localCounts.data() + exchangeIndices[receiveRankIndex].start(), receiveCount, receiveRank, 1, &status);
+        buffers.queryLeaves.resize(numKeys);
+        mpiRecvSync(buffers.queryLeaves.data(), numKeys, receiveRank, queryTag, &status, comm);
 
-        numMessages--;
-    }
+        size_t rankIndex = std::find(peerRanks.begin(), peerRanks.end(), receiveRank) - peerRanks.begin();
+        std::vector<NodeData>& answer = buffers.answers[rankIndex];
+        answer.resize(numKeys - 1);
+        answerFunction(gsl::span<const KeyType>(buffers.queryLeaves.data(), numKeys),
+                       gsl::span<NodeData>(answer.data(), answer.size()));
 
-    MPI_Status status[sendRequests.size()];
-    MPI_Waitall(int(sendRequests.size()), sendRequests.data(), status);
+        buffers.requests.push_back(MPI_Request{});
+        MPI_Isend(answer.data(), answer.size() * sizeof(NodeData), MPI_BYTE, receiveRank, answerTag, comm,
+                  &buffers.requests.back());
+    }
 
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Waitall(int(buffers.requests.size()), buffers.requests.data(), MPI_STATUSES_IGNORE);
 }
 
 } // namespace cstone
@@ -0,0 +1,203 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Level-of-detail summaries of particle fields based on cornerstone trees
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * A level-of-detail (LOD) tree is obtained from a cornerstone tree by replacing all nodes deeper than
+ * a given level with their ancestor at that level. Each LOD node then aggregates the particles it contains
+ * into a particle count, total mass, center of mass, mean smoothing length and one reduced user field.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "cstone/sfc/common.hpp"
+#include "cstone/tree/definitions.h"
+#include "cstone/util/gsl-lite.hpp"
+
+namespace cstone
+{
+
+//! @brief reduction applied to the user field of a LOD summary
+enum class LodReduction
+{
+    sum,
+    min,
+    max
+};
+
+/*! @brief per-node aggregates of a particle field
+ *
+ * All arrays have one element per LOD node, except for @a nodes, which contains the cornerstone keys
+ * of the LOD tree. Empty nodes have a center of mass and mean h of zero. @a field is empty if no
+ * user field was provided.
+ */
+template<class KeyType, class T>
+struct LodSummary
+{
+    std::vector<KeyType>  nodes;
+    std::vector<uint64_t> counts;
+    std::vector<T>        mass;
+    std::vector<T>        x, y, z;
+    std::vector<T>        h;
+    std::vector<T>        field;
+};
+
+/*! @brief replace all nodes of a cornerstone tree deeper than @p maxLevel with their ancestor at @p maxLevel
+ *
+ * @param tree      cornerstone leaves
+ * @param maxLevel  maximum level of the returned nodes
+ * @return          the truncated cornerstone tree, a subset of @p tree
+ */
+template<class KeyType>
+std::vector<KeyType> truncateTree(gsl::span<const KeyType> tree, unsigned maxLevel)
+{
+    std::vector<KeyType> truncated;
+    truncated.reserve(tree.size());
+
+    TreeNodeIndex numNodes = nNodes(tree);
+    for (TreeNodeIndex i = 0; i < numNodes; ++i)
+    {
+        KeyType nodeStart = tree[i];
+        if (treeLevel(tree[i + 1] - tree[i]) > maxLevel) { nodeStart = enclosingBoxCode(nodeStart, maxLevel); }
+        if (truncated.empty() || truncated.back() != nodeStart) { truncated.push_back(nodeStart); }
+    }
+    truncated.push_back(tree.back());
+
+    return truncated;
+}
+
+//! @brief number of partial sums per LOD node: count, mass, mass-weighted x,y,z and h
+constexpr int lodNumSums = 6;
+
+//! @brief neutral element of @p reduction
+inline double lodNeutralElement(LodReduction reduction)
+{
+    switch (reduction)
+    {
+        case LodReduction::min: return std::numeric_limits<double>::max();
+        case LodReduction::max: return std::numeric_limits<double>::lowest();
+        default: return 0.0;
+    }
+}
+
+/*! @brief compute the partial aggregates of a range of SFC-sorted particles for each LOD node
+ *
+ * @param[in]  lodTree    cornerstone keys of the LOD nodes
+ * @param[in]  keys       SFC keys of the particles, sorted in [first:last)
+ * @param[in]  first      first particle to aggregate
+ * @param[in]  last       last particle to aggregate
+ * @param[in]  x,y,z,h    particle coordinates and smoothing lengths
+ * @param[in]  m          particle masses, if nullptr, all particles have unit mass
+ * @param[in]  field      user field to reduce, may be nullptr
+ * @param[in]  reduction  reduction to apply to @p field
+ * @param[out] sums       lodNumSums partial sums per LOD node, for combination with other ranges by summation
+ * @param[out] reduced    reduced @p field per LOD node, not accessed if @p field is nullptr
+ */
+template<class KeyType, class T>
+void lodPartialSums(gsl::span<const KeyType> lodTree, const KeyType* keys, LocalParticleIndex first,
+                    LocalParticleIndex last, const T* x, const T* y, const T* z, const T* h, const T* m,
+                    const T* field, LodReduction reduction, double* sums, double* reduced)
+{
+    TreeNodeIndex numNodes = nNodes(lodTree);
+
+#pragma omp parallel for schedule(static)
+    for (TreeNodeIndex i = 0; i < numNodes; ++i)
+    {
+        LocalParticleIndex nodeStart = std::lower_bound(keys + first, keys + last, lodTree[i]) - keys;
+        LocalParticleIndex nodeEnd   = std::lower_bound(keys + nodeStart, keys + last, lodTree[i + 1]) - keys;
+
+        double nodeSums[lodNumSums] = {double(nodeEnd - nodeStart), 0, 0, 0, 0, 0};
+        double nodeReduced          = lodNeutralElement(reduction);
+        for (LocalParticleIndex j = nodeStart; j < nodeEnd; ++j)
+        {
+            double mass = m ? m[j] : 1.0;
+            nodeSums[1] += mass;
+            nodeSums[2] += mass * x[j];
+            nodeSums[3] += mass * y[j];
+            nodeSums[4] += mass * z[j];
+            nodeSums[5] += h[j];
+
+            if (!field) { continue; }
+            switch (reduction)
+            {
+                case LodReduction::sum: nodeReduced += field[j]; break;
+                case LodReduction::min: nodeReduced = std::min(nodeReduced, double(field[j])); break;
+                case LodReduction::max: nodeReduced = std::max(nodeReduced, double(field[j])); break;
+            }
+        }
+
+        std::copy(nodeSums, nodeSums + lodNumSums, sums + lodNumSums * i);
+        if (field) { reduced[i] = nodeReduced; }
+    }
+}
+
+/*! @brief convert the combined partial sums of all particle ranges into a LOD summary
+ *
+ * @param lodTree    cornerstone keys of the LOD nodes
+ * @param sums       lodNumSums sums per LOD node, as computed by lodPartialSums
+ * @param reduced    reduced user field per LOD node, nullptr if there is none
+ */
+template<class T, class KeyType>
+LodSummary<KeyType, T> finalizeLodSummary(gsl::span<const KeyType> lodTree, const double* sums,
+                                          const double* reduced)
+{
+    TreeNodeIndex numNodes = nNodes(lodTree);
+
+    LodSummary<KeyType, T> summary;
+    summary.nodes.assign(lodTree.begin(), lodTree.end());
+    summary.counts.resize(numNodes);
+    summary.mass.resize(numNodes);
+    summary.x.resize(numNodes);
+    summary.y.resize(numNodes);
+    summary.z.resize(numNodes);
+    summary.h.resize(numNodes);
+    if (reduced) { summary.field.resize(numNodes); }
+
+    for (TreeNodeIndex i = 0; i < numNodes; ++i)
+    {
+        const double* nodeSums = sums + lodNumSums * i;
+        uint64_t count         = nodeSums[0];
+        double   mass          = nodeSums[1];
+
+        summary.counts[i] = count;
+        summary.mass[i]   = mass;
+        summary.x[i]      = mass > 0 ? nodeSums[2] / mass : 0;
+        summary.y[i]      = mass > 0 ? nodeSums[3] / mass : 0;
+        summary.z[i]      = mass > 0 ? nodeSums[4] / mass : 0;
+        summary.h[i]      = count > 0 ? nodeSums[5] / count : 0;
+        if (reduced) { summary.field[i] = count > 0 ? reduced[i] : 0; }
+    }
+
+    return summary;
+}
+
+} // namespace cstone
@@ -0,0 +1,89 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Distributed level-of-detail summaries of particle fields
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <mpi.h>
+
+#include "cstone/primitives/mpi_wrappers.hpp"
+#include "cstone/tree/lod.hpp"
+
+namespace cstone
+{
+
+/*! @brief aggregate the particles of all ranks per node of a LOD tree and gather the result on one rank
+ *
+ * @param globalTree  global cornerstone leaves, identical on all ranks, e.g. Domain::tree()
+ * @param maxLevel    maximum level of the LOD nodes, see truncateTree
+ * @param root        the rank that receives the summary
+ * @param comm        the ranks that hold parts of the particles, @p root is a rank in @p comm
+ *
+ * See lodPartialSums for the remaining parameters. The particles in [first:last) of each rank have to be
+ * sorted in SFC order, as is the case for the assigned particles after a sync. LOD nodes straddling
+ * rank boundaries are combined across ranks. The summary, in SFC order, is only returned on @p root,
+ * the other ranks receive an empty summary.
+ */
+template<class KeyType, class T>
+LodSummary<KeyType, T> computeLodSummary(gsl::span<const KeyType> globalTree, unsigned maxLevel, const KeyType* keys,
+                                         LocalParticleIndex first, LocalParticleIndex last, const T* x, const T* y,
+                                         const T* z, const T* h, const T* m, const T* field = nullptr,
+                                         LodReduction reduction = LodReduction::sum, int root = 0,
+                                         MPI_Comm comm = MPI_COMM_WORLD)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    std::vector<KeyType> lodTree = truncateTree(globalTree, maxLevel);
+    TreeNodeIndex numNodes       = nNodes(lodTree);
+
+    std::vector<double> sums(lodNumSums * numNodes);
+    std::vector<double> reduced(field ? numNodes : 0);
+    lodPartialSums<KeyType>(lodTree, keys, first, last, x, y, z, h, m, field, reduction, sums.data(),
+                            reduced.data());
+
+    auto reduceToRoot = [rank, root, comm](std::vector<double>& values, MPI_Op op)
+    {
+        void* sendBuffer = rank == root ? MPI_IN_PLACE : values.data();
+        MPI_Reduce(sendBuffer, values.data(), values.size(), MPI_DOUBLE, op, root, comm);
+    };
+
+    reduceToRoot(sums, MPI_SUM);
+    if (field)
+    {
+        MPI_Op ops[] = {MPI_SUM, MPI_MIN, MPI_MAX};
+        reduceToRoot(reduced, ops[int(reduction)]);
+    }
+
+    if (rank != root) { return {}; }
+    return finalizeLodSummary<T, KeyType>(lodTree, sums.data(), field ? reduced.data() : nullptr);
+}
+
+} // namespace cstone
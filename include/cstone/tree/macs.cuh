@@ -0,0 +1,224 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  GPU driver for marking octree nodes that fail the MAC paired with the focus
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <thrust/device_vector.h>
+#include <thrust/execution_policy.h>
+#include <thrust/fill.h>
+
+#include "cstone/util/tracing.hpp"
+#include "cstone/util/util.hpp"
+#include "macs.hpp"
+#include "octree_internal.cuh"
+
+namespace cstone
+{
+
+//! @brief number of lanes that traverse the octree for one focus box
+constexpr int macWarpSize = 32;
+//! @brief number of warps per thread block in markMacKernel
+constexpr int macWarpsPerBlock = 4;
+//! @brief capacity of the breadth-first frontier of each warp in shared memory
+constexpr int macFrontierSize = 512;
+
+//! @brief evaluate the min-distance MAC of @p node against @p target and mark @p node if it fails
+template<class KeyType, class SfcKind, class BoxType>
+__device__ bool checkAndMarkMac(const OctreeGpuDataView<KeyType>& tree, TreeNodeIndex node, IBox target,
+                                const BoxType& box, float invThetaSq, KeyType focusStart, KeyType focusEnd,
+                                char* markings)
+{
+    KeyType nodeStart = tree.codeStart(node);
+    KeyType nodeEnd   = tree.codeEnd(node);
+    // nodes fully contained in the focus are not marked and their subtrees are not traversed
+    if (containedIn(nodeStart, nodeEnd, focusStart, focusEnd)) { return false; }
+
+    IBox sourceBox   = makeIBox<KeyType, SfcKind>(nodeStart, nodeEnd);
+    bool violatesMac = !minDistanceMac<KeyType>(target, sourceBox, box, invThetaSq);
+
+    // concurrent warps only ever store the same value, therefore no atomic operations are required
+    if (violatesMac) { markings[node] = 1; }
+
+    return violatesMac;
+}
+
+//! @brief depth-first traversal of the subtrees below @p node by a single thread, used on frontier overflow
+template<class KeyType, class SfcKind, class BoxType>
+__device__ void markMacSubtree(const OctreeGpuDataView<KeyType>& tree, TreeNodeIndex node, IBox target,
+                               const BoxType& box, float invThetaSq, KeyType focusStart, KeyType focusEnd,
+                               char* markings)
+{
+    // each level adds at most 7 siblings to the stack
+    constexpr int stackSize = 8 * maxTreeLevel<KeyType>{};
+    TreeNodeIndex stack[stackSize];
+
+    int stackPos = 0;
+    for (int octant = 0; octant < 8; ++octant)
+    {
+        stack[stackPos++] = tree.child(node, octant);
+    }
+
+    while (stackPos > 0)
+    {
+        TreeNodeIndex idx = stack[--stackPos];
+        if (checkAndMarkMac<KeyType, SfcKind>(tree, idx, target, box, invThetaSq, focusStart, focusEnd, markings) &&
+            !tree.isLeaf(idx))
+        {
+            for (int octant = 0; octant < 8; ++octant)
+            {
+                stack[stackPos++] = tree.child(idx, octant);
+            }
+        }
+    }
+}
+
+/*! @brief mark nodes that fail the MAC with one of the focus boxes, one warp per focus box
+ *
+ * The warp traverses the tree breadth-first. The lanes evaluate the nodes of the current frontier in
+ * parallel and the children of the nodes that fail the MAC form the next frontier, compacted with a warp ballot.
+ * If the children of a batch of 32 nodes do not fit into the next frontier, the lanes of that batch traverse
+ * the subtrees below their nodes depth-first instead.
+ */
+template<class KeyType, class SfcKind, class BoxType>
+__global__ void markMacKernel(OctreeGpuDataView<KeyType> tree, BoxType box, const KeyType* focusCodes,
+                              TreeNodeIndex numFocusBoxes, float invThetaSq, KeyType focusStart, KeyType focusEnd,
+                              char* markings)
+{
+    __shared__ TreeNodeIndex frontiers[macWarpsPerBlock][2][macFrontierSize];
+
+    int lane = threadIdx.x % macWarpSize;
+    int warp = threadIdx.x / macWarpSize;
+
+    TreeNodeIndex focusBox = blockIdx.x * macWarpsPerBlock + warp;
+    if (focusBox >= numFocusBoxes) { return; }
+
+    IBox target = makeIBox<KeyType, SfcKind>(focusCodes[focusBox], focusCodes[focusBox + 1]);
+
+    TreeNodeIndex* current = frontiers[warp][0];
+    TreeNodeIndex* next    = frontiers[warp][1];
+
+    if (lane == 0) { current[0] = 0; }
+    TreeNodeIndex numCurrent = 1;
+    __syncwarp();
+
+    unsigned lowerLanes = (1u << lane) - 1;
+
+    while (numCurrent > 0)
+    {
+        // numNext is identical in all lanes, since it is only incremented by ballot results
+        TreeNodeIndex numNext = 0;
+        for (TreeNodeIndex batch = 0; batch < numCurrent; batch += macWarpSize)
+        {
+            TreeNodeIndex i    = batch + lane;
+            TreeNodeIndex node = 0;
+            bool descend       = false;
+            if (i < numCurrent)
+            {
+                node    = current[i];
+                descend = checkAndMarkMac<KeyType, SfcKind>(tree, node, target, box, invThetaSq, focusStart,
+                                                            focusEnd, markings) && !tree.isLeaf(node);
+            }
+
+            unsigned descendMask = __ballot_sync(0xffffffff, descend);
+            TreeNodeIndex numChildren = 8 * __popc(descendMask);
+
+            if (numNext + numChildren <= macFrontierSize)
+            {
+                if (descend)
+                {
+                    TreeNodeIndex offset = numNext + 8 * __popc(descendMask & lowerLanes);
+                    for (int octant = 0; octant < 8; ++octant)
+                    {
+                        next[offset + octant] = tree.child(node, octant);
+                    }
+                }
+                numNext += numChildren;
+            }
+            else if (descend)
+            {
+                markMacSubtree<KeyType, SfcKind>(tree, node, target, box, invThetaSq, focusStart, focusEnd, markings);
+            }
+        }
+        __syncwarp();
+
+        TreeNodeIndex* tmp = current;
+        current            = next;
+        next               = tmp;
+        numCurrent         = numNext;
+    }
+}
+
+/*! @brief Mark each node in an octree that fails the MAC paired with any node from a given focus SFC range
+ *
+ * @tparam T                float or double
+ * @tparam KeyType          32- or 64-bit unsigned integer
+ * @tparam SfcKind          SFC used to construct @p tree, see sfc.hpp
+ * @param[in]  tree         device view of the octree, e.g. from OctreeGpu::data()
+ * @param[in]  box          global coordinate bounding box
+ * @param[in]  focusStart   lower SFC focus code
+ * @param[in]  focusEnd     upper SFC focus code
+ * @param[in]  invThetaSq   1./theta^2
+ * @param[out] markings     device array of length @p tree.numTreeNodes(), see markMac
+ *
+ * Device version of markMac with the min-distance MAC. Node indices refer to the node layout of @p tree.
+ */
+template<class T, class KeyType, class SfcKind = KeyType>
+void markMacGpu(const OctreeGpuDataView<KeyType>& tree, const Box<T>& box, KeyType focusStart, KeyType focusEnd,
+                float invThetaSq, char* markings)
+{
+    CSTONE_TRACE_RANGE("markMacGpu");
+    thrust::fill(thrust::device, markings, markings + tree.numTreeNodes(), 0);
+
+    TreeNodeIndex numFocusBoxes = spanSfcRange(focusStart, focusEnd);
+    if (numFocusBoxes == 0) { return; }
+
+    std::vector<KeyType> focusCodes(numFocusBoxes + 1);
+    spanSfcRange(focusStart, focusEnd, focusCodes.data());
+    focusCodes.back() = focusEnd;
+    thrust::device_vector<KeyType> d_focusCodes = focusCodes;
+
+    constexpr unsigned numThreads = macWarpSize * macWarpsPerBlock;
+    unsigned numBlocks            = iceil(numFocusBoxes, macWarpsPerBlock);
+
+    auto launch = [&](const auto& pbcBox)
+    {
+        using BoxType = std::decay_t<decltype(pbcBox)>;
+        markMacKernel<KeyType, SfcKind, BoxType><<<numBlocks, numThreads>>>(
+            tree, pbcBox, thrust::raw_pointer_cast(d_focusCodes.data()), numFocusBoxes, invThetaSq, focusStart,
+            focusEnd, markings);
+    };
+
+    dispatchPbc(box, launch);
+}
+
+} // namespace cstone
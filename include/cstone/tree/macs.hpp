@@ -41,11 +41,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "cstone/halos/boxoverlap.hpp"
+#include "cstone/util/executor.hpp"
+#include "cstone/util/tracing.hpp"
 #include "octree_internal.hpp"
 #include "traversal.hpp"
+#include "upsweep.hpp"
 
 namespace cstone
 {
@@ -64,17 +69,18 @@ constexpr int rangeSeparation(int a, int b, int c, int d, bool pbc)
 
 /*! @brief return the smallest distance squared between two points on the surface of the AABBs @p a and @p b
  *
- * @tparam T        float or double
  * @tparam KeyType  32- or 64-bit unsigned integer
+ * @tparam BoxType  Box<T> or StaticPbcBox<T, ...>, with T float or double
  * @param a         a box, specified with integer coordinates in [0:2^21]
  * @param b
  * @param box       floating point coordinate bounding box
  * @return          the square of the smallest distance between a and b
  */
-template<class KeyType, class T>
+template<class KeyType, class BoxType>
 CUDA_HOST_DEVICE_FUN
-T minDistanceSq(IBox a, IBox b, const Box<T>& box)
+auto minDistanceSq(IBox a, IBox b, const BoxType& box)
 {
+    using T = decltype(box.lx());
     constexpr size_t maxCoord = 1u<<maxTreeLevel<KeyType>{};
     constexpr T unitLengthSq  = T(1.) / (maxCoord * maxCoord);
 
@@ -109,10 +115,11 @@ T nodeLength(IBox b, const Box<T>& box)
  * Note: Mac is valid for any point in a w.r.t to box b, therefore only the
  * size of b is relevant.
  */
-template<class KeyType, class T>
+template<class KeyType, class BoxType>
 CUDA_HOST_DEVICE_FUN
-bool minDistanceMac(IBox a, IBox b, const Box<T>& box, float invThetaSq)
+bool minDistanceMac(IBox a, IBox b, const BoxType& box, float invThetaSq)
 {
+    using T = decltype(box.lx());
     T dsq = minDistanceSq<KeyType>(a, b, box);
     // equivalent to "d > l / theta"
     T bLength = nodeLength<KeyType>(b, box);
@@ -120,43 +127,216 @@ bool minDistanceMac(IBox a, IBox b, const Box<T>& box, float invThetaSq)
 }
 
 //! @brief commutative version
-template<class KeyType, class T>
+template<class KeyType, class BoxType>
 CUDA_HOST_DEVICE_FUN
-bool minDistanceMacMutual(IBox a, IBox b, const Box<T>& box, float invThetaSq)
+bool minDistanceMacMutual(IBox a, IBox b, const BoxType& box, float invThetaSq)
 {
+    using T = decltype(box.lx());
     T dsq = minDistanceSq<KeyType>(a, b, box);
     // equivalent to "d > l / theta"
     T boxLength = stl::max(nodeLength<KeyType>(a, box), nodeLength<KeyType>(b, box));
     return dsq > boxLength * boxLength * invThetaSq;
 }
 
-template<class T, class KeyType>
+//! @brief selects the purely geometric minimum distance MAC, see minDistanceMac
+struct MinDistanceMacTag
+{
+};
+
+//! @brief selects the vector MAC based on node expansion centers, see vectorMac
+struct VectorMacTag
+{
+};
+
+/*! @brief expansion center of an octree node
+ *
+ * x,y,z is the mean position of the particles contained in the node and mass the number of particles.
+ * Nodes without particles are assigned their geometric center and zero mass.
+ */
+template<class T>
+struct ExpansionCenter
+{
+    T x, y, z, mass;
+};
+
+//! @brief geometric center of the integer box @p b, with zero mass
+template<class KeyType, class T>
+CUDA_HOST_DEVICE_FUN
+ExpansionCenter<T> geometricCenter(IBox b, const Box<T>& box)
+{
+    constexpr T unitLength = T(1.) / (1u << maxTreeLevel<KeyType>{});
+
+    return {box.xmin() + T(0.5) * (b.xmin() + b.xmax()) * unitLength * box.lx(),
+            box.ymin() + T(0.5) * (b.ymin() + b.ymax()) * unitLength * box.ly(),
+            box.zmin() + T(0.5) * (b.zmin() + b.zmax()) * unitLength * box.lz(), T(0)};
+}
+
+/*! @brief return the smallest distance squared between the point @p c and the AABB @p b
+ *
+ * @tparam KeyType  32- or 64-bit unsigned integer
+ * @param c         a point, the mass is ignored
+ * @param b         a box, specified with integer coordinates in [0:2^21]
+ * @param box       floating point coordinate bounding box
+ * @return          the square of the smallest distance between c and b, taking PBC into account
+ */
+template<class KeyType, class T, class BoxType = Box<T>>
+CUDA_HOST_DEVICE_FUN
+T minDistanceSq(const ExpansionCenter<T>& c, IBox b, const BoxType& box)
+{
+    constexpr T unitLength = T(1.) / (1u << maxTreeLevel<KeyType>{});
+
+    ExpansionCenter<T> bCenter = geometricCenter<KeyType>(b, box);
+
+    auto separation = [](T d, T halfExtent, T length, bool pbc)
+    {
+        if (pbc) { d -= length * std::rint(d / length); }
+        return stl::max(std::abs(d) - halfExtent, T(0));
+    };
+
+    T dx = separation(c.x - bCenter.x, T(0.5) * (b.xmax() - b.xmin()) * unitLength * box.lx(), box.lx(), box.pbcX());
+    T dy = separation(c.y - bCenter.y, T(0.5) * (b.ymax() - b.ymin()) * unitLength * box.ly(), box.ly(), box.pbcY());
+    T dz = separation(c.z - bCenter.z, T(0.5) * (b.zmax() - b.zmin()) * unitLength * box.lz(), box.lz(), box.pbcZ());
+
+    return dx * dx + dy * dy + dz * dz;
+}
+
+/*! @brief evaluate the vector MAC of a source cell with expansion center @p c, non-commutative version
+ *
+ * @param c            expansion center of @p source
+ * @param source       source cell
+ * @param target       target cell
+ * @param box          coordinate bounding box
+ * @param invThetaSq   inverse theta squared
+ * @return             true if MAC fulfilled, false otherwise
+ *
+ * The MAC is fulfilled if the distance between @p c and any point in @p target exceeds l/theta + s,
+ * with l the edge length of @p source and s the distance of @p c from the geometric center of @p source.
+ * Since distances are measured from the expansion center instead of the surface of the source cell,
+ * this is less conservative than minDistanceMac, while the accuracy is still controlled through s for
+ * nodes with off-center particle distributions.
+ */
+template<class KeyType, class T, class BoxType = Box<T>>
+CUDA_HOST_DEVICE_FUN
+bool vectorMac(const ExpansionCenter<T>& c, IBox source, IBox target, const BoxType& box, float invThetaSq)
+{
+    ExpansionCenter<T> geoCenter = geometricCenter<KeyType>(source, box);
+
+    T sx = c.x - geoCenter.x;
+    T sy = c.y - geoCenter.y;
+    T sz = c.z - geoCenter.z;
+
+    T mac = nodeLength<KeyType>(source, box) * std::sqrt(T(invThetaSq)) + std::sqrt(sx * sx + sy * sy + sz * sz);
+    return minDistanceSq<KeyType>(c, target, box) > mac * mac;
+}
+
+//! @brief commutative version, both cells need to pass the MAC as source cells of the other one
+template<class KeyType, class T, class BoxType = Box<T>>
 CUDA_HOST_DEVICE_FUN
-void markMacPerBox(IBox target, const Octree<KeyType>& octree, const Box<T>& box,
-                   float invThetaSq, KeyType focusStart, KeyType focusEnd, char* markings)
+bool vectorMacMutual(const ExpansionCenter<T>& ca, IBox a, const ExpansionCenter<T>& cb, IBox b,
+                     const BoxType& box, float invThetaSq)
 {
-    auto checkAndMarkMac = [target, &octree, &box, invThetaSq, focusStart, focusEnd, markings](TreeNodeIndex idx)
+    return vectorMac<KeyType>(ca, a, b, box, invThetaSq) && vectorMac<KeyType>(cb, b, a, box, invThetaSq);
+}
+
+/*! @brief compute expansion centers for all nodes of an octree from local particle keys
+ *
+ * @tparam T                  float or double
+ * @tparam KeyType            32- or 64-bit unsigned integer
+ * @tparam SfcKind            SFC used to construct @p octree, see sfc.hpp
+ * @param[in]  octree         octree, including internal part
+ * @param[in]  particleKeys   sorted SFC keys of the particles, length = @p numKeys
+ * @param[in]  numKeys        number of particle keys
+ * @param[in]  box            global coordinate bounding box
+ * @param[out] centers        expansion centers, length = octree.numTreeNodes(), indexed like the Octree nodes
+ *
+ * Particle positions are reconstructed from their SFC keys at the maximum tree resolution. Leaf centers are
+ * the mean particle positions, centers of internal nodes are obtained by a mass-weighted upsweep.
+ */
+template<class T, class KeyType, class SfcKind = KeyType>
+void computeExpansionCenters(const Octree<KeyType>& octree, const KeyType* particleKeys, std::size_t numKeys,
+                             const Box<T>& box, ExpansionCenter<T>* centers)
+{
+    constexpr T unitLength = T(1.) / (1u << maxTreeLevel<KeyType>{});
+
+    gsl::span<const KeyType> leaves = octree.treeLeaves();
+    ExpansionCenter<T>* leafCenters = centers + octree.numInternalNodes();
+
+    parallelFor(TreeNodeIndex(0), octree.numLeafNodes(), [&](TreeNodeIndex i)
+    {
+        const KeyType* first = std::lower_bound(particleKeys, particleKeys + numKeys, leaves[i]);
+        const KeyType* last  = std::lower_bound(first, particleKeys + numKeys, leaves[i + 1]);
+
+        if (first == last)
+        {
+            leafCenters[i] = geometricCenter<KeyType>(makeIBox<KeyType, SfcKind>(leaves[i], leaves[i + 1]), box);
+            return;
+        }
+
+        T x = 0, y = 0, z = 0;
+        for (const KeyType* key = first; key != last; ++key)
+        {
+            IBox particleBox = sfcIBox<SfcKind>(*key, 3 * maxTreeLevel<KeyType>{});
+            x += particleBox.xmin();
+            y += particleBox.ymin();
+            z += particleBox.zmin();
+        }
+
+        T numParticles = last - first;
+        leafCenters[i] = {box.xmin() + (x / numParticles + T(0.5)) * unitLength * box.lx(),
+                          box.ymin() + (y / numParticles + T(0.5)) * unitLength * box.ly(),
+                          box.zmin() + (z / numParticles + T(0.5)) * unitLength * box.lz(), numParticles};
+    });
+
+    auto combineCenters = [](auto... c)
     {
-        KeyType nodeStart = octree.codeStart(idx);
-        KeyType nodeEnd   = octree.codeEnd(idx);
+        T mass = (c.mass + ...);
+        // empty children have geometric centers, whose mean is the geometric center of the parent
+        if (mass == T(0)) { return ExpansionCenter<T>{(c.x + ...) / 8, (c.y + ...) / 8, (c.z + ...) / 8, T(0)}; }
+        return ExpansionCenter<T>{((c.x * c.mass) + ...) / mass, ((c.y * c.mass) + ...) / mass,
+                                  ((c.z * c.mass) + ...) / mass, mass};
+    };
+
+    upsweep(octree, leafCenters, centers, combineCenters);
+}
+
+template<class T, class KeyType, class SfcKind = KeyType, class MacTag = MinDistanceMacTag, class BoxType = Box<T>>
+CUDA_HOST_DEVICE_FUN
+void markMacPerBox(IBox target, const Octree<KeyType>& octree, const BoxType& box,
+                   float invThetaSq, KeyType focusStart, KeyType focusEnd, char* markings,
+                   const ExpansionCenter<T>* centers = nullptr)
+{
+    const TraversalOctree<KeyType>& tree = octree.traversalTree();
+
+    auto checkAndMarkMac = [target, &tree, &box, invThetaSq, focusStart, focusEnd, markings, centers](TreeNodeIndex idx)
+    {
+        KeyType nodeStart = tree.codeStart(idx);
+        KeyType nodeEnd   = tree.codeEnd(idx);
         // if the tree node with index idx is fully contained in the focus, we stop traversal
         if (containedIn(nodeStart, nodeEnd, focusStart, focusEnd)) { return false; }
 
-        IBox sourceBox = makeIBox(nodeStart, nodeEnd);
+        IBox sourceBox = makeIBox<KeyType, SfcKind>(nodeStart, nodeEnd);
+
+        bool violatesMac;
+        if constexpr (std::is_same_v<MacTag, VectorMacTag>)
+        {
+            violatesMac = !vectorMac<KeyType>(centers[tree.octreeIndex(idx)], sourceBox, target, box, invThetaSq);
+        }
+        else { violatesMac = !minDistanceMac<KeyType>(target, sourceBox, box, invThetaSq); }
 
-        bool violatesMac = !minDistanceMac<KeyType>(target, sourceBox, box, invThetaSq);
-        if (violatesMac) { markings[idx] = 1; }
+        if (violatesMac) { markings[tree.octreeIndex(idx)] = 1; }
 
         return violatesMac;
     };
 
-    singleTraversal(octree, checkAndMarkMac, [](TreeNodeIndex) {});
+    singleTraversalStackless(tree, checkAndMarkMac, [](TreeNodeIndex) {});
 }
 
 /*! @brief Mark each node in an octree that fails the MAC paired with any node from a given focus SFC range
  *
  * @tparam T                float or double
  * @tparam KeyType          32- or 64-bit unsigned integer
+ * @tparam SfcKind          SFC used to construct @p octree, see sfc.hpp
+ * @tparam MacTag           MinDistanceMacTag or VectorMacTag
  * @param[in]  octree       octree, including internal part
  * @param[in]  box          global coordinate bounding box
  * @param[in]  focusStart   lower SFC focus code
@@ -165,12 +345,17 @@ void markMacPerBox(IBox target, const Octree<KeyType>& octree, const Box<T>& box
  * @param[out] markings     array of length @p octree.numTreeNodes(), each position i
  *                          will be set to 1, if the node of @p octree with index i fails the MAC paired with
  *                          any node contained in the focus range [focusStart:focusEnd]
+ * @param[in]  centers      expansion centers of the @p octree nodes, see computeExpansionCenters,
+ *                          only used and required with VectorMacTag
+ *
+ * The traversal is instantiated with the periodicity of @p box fixed at compile time, see dispatchPbc.
  */
-template<class T, class KeyType>
+template<class T, class KeyType, class SfcKind = KeyType, class MacTag = MinDistanceMacTag>
 void markMac(const Octree<KeyType>& octree, const Box<T>& box, KeyType focusStart, KeyType focusEnd,
-             float invThetaSq, char* markings)
+             float invThetaSq, char* markings, const ExpansionCenter<T>* centers = nullptr)
 
 {
+    CSTONE_TRACE_RANGE("markMac");
     std::fill(markings, markings + octree.numTreeNodes(), 0);
 
     // find the minimum possible number of octree node boxes to cover the entire focus
@@ -179,12 +364,111 @@ void markMac(const Octree<KeyType>& octree, const Box<T>& box, KeyType focusStar
     spanSfcRange(focusStart, focusEnd, focusCodes.data());
     focusCodes.back() = focusEnd;
 
-    #pragma omp parallel for schedule(static)
-    for (TreeNodeIndex i = 0; i < numFocusBoxes; ++i)
+    auto markFocusBoxes = [&](const auto& pbcBox)
     {
-        IBox target = makeIBox(focusCodes[i], focusCodes[i+1]);
-        markMacPerBox(target, octree, box, invThetaSq, focusStart, focusEnd, markings);
-    }
+        parallelFor(TreeNodeIndex(0), numFocusBoxes, [&](TreeNodeIndex i)
+        {
+            IBox target = makeIBox<KeyType, SfcKind>(focusCodes[i], focusCodes[i + 1]);
+            markMacPerBox<T, KeyType, SfcKind, MacTag>(target, octree, pbcBox, invThetaSq, focusStart, focusEnd,
+                                                       markings, centers);
+        });
+    };
+
+    dispatchPbc(box, markFocusBoxes);
 }
 
+/*! @brief MAC marking that reuses the markings of the previous call for unchanged nodes
+ *
+ * @tparam KeyType   32- or 64-bit unsigned integer
+ * @tparam SfcKind   SFC used to construct the octree, see sfc.hpp
+ *
+ * With the min-distance MAC, a node is marked by markMac if and only if it is not contained in the focus
+ * and fails the MAC with at least one of the boxes that span the focus, since the MAC is monotonic under
+ * refinement of the source node. The marking of a node therefore only depends on its geometry, the focus range,
+ * the bounding box and theta. If none of the latter changed since the previous call, nodes that also
+ * existed in the previous tree keep their marking and only the remaining nodes, i.e. the descendants of split
+ * leaves, are evaluated. Otherwise, the markings are recomputed with markMac.
+ */
+template<class KeyType, class SfcKind = KeyType>
+class IncrementalMacMarker
+{
+public:
+    //! @brief arguments identical to markMac with the min-distance MAC
+    template<class T>
+    void markMac(const Octree<KeyType>& octree, const Box<T>& box, KeyType focusStart, KeyType focusEnd,
+                 float invThetaSq, char* markings)
+    {
+        Box<double> currentBox(box.xmin(), box.xmax(), box.ymin(), box.ymax(), box.zmin(), box.zmax(), box.pbcX(),
+                               box.pbcY(), box.pbcZ());
+        const TraversalOctree<KeyType>& tree = octree.traversalTree();
+
+        bool reusable = numCalls_ > 0 && focusStart == focusStart_ && focusEnd == focusEnd_ &&
+                        invThetaSq == invThetaSq_ && currentBox == box_;
+
+        if (reusable)
+        {
+            TreeNodeIndex numFocusBoxes = spanSfcRange(focusStart, focusEnd);
+            std::vector<KeyType> focusCodes(numFocusBoxes + 1);
+            spanSfcRange(focusStart, focusEnd, focusCodes.data());
+            focusCodes.back() = focusEnd;
+
+            parallelFor(TreeNodeIndex(0), tree.numTreeNodes(), [&](TreeNodeIndex i)
+            {
+                KeyType nodeStart = tree.codeStart(i);
+                KeyType nodeEnd   = tree.codeEnd(i);
+
+                TreeNodeIndex previous = previousTree_.locate(nodeStart, nodeEnd);
+                if (previous < previousTree_.numTreeNodes())
+                {
+                    markings[tree.octreeIndex(i)] = previousMarkings_[previous];
+                    return;
+                }
+
+                char violatesMac = 0;
+                if (!containedIn(nodeStart, nodeEnd, focusStart, focusEnd))
+                {
+                    IBox sourceBox = makeIBox<KeyType, SfcKind>(nodeStart, nodeEnd);
+                    for (TreeNodeIndex j = 0; j < numFocusBoxes && !violatesMac; ++j)
+                    {
+                        IBox target = makeIBox<KeyType, SfcKind>(focusCodes[j], focusCodes[j + 1]);
+                        violatesMac = !minDistanceMac<KeyType>(target, sourceBox, box, invThetaSq);
+                    }
+                }
+                markings[tree.octreeIndex(i)] = violatesMac;
+            });
+        }
+        else
+        {
+            cstone::markMac<T, KeyType, SfcKind>(octree, box, focusStart, focusEnd, invThetaSq, markings);
+        }
+
+        // store markings in traversal layout order, such that lookups into the previous tree can be used directly
+        previousTree_ = tree;
+        previousMarkings_.resize(tree.numTreeNodes());
+        parallelFor(TreeNodeIndex(0), tree.numTreeNodes(),
+                    [&](TreeNodeIndex i) { previousMarkings_[i] = markings[tree.octreeIndex(i)]; });
+
+        focusStart_ = focusStart;
+        focusEnd_   = focusEnd;
+        invThetaSq_ = invThetaSq;
+        box_        = currentBox;
+        numCalls_++;
+        if (reusable) { numReused_++; }
+    }
+
+    //! @brief number of calls to markMac that reused the previous markings
+    [[nodiscard]] std::size_t numReused() const { return numReused_; }
+
+private:
+    TraversalOctree<KeyType> previousTree_;
+    std::vector<char>        previousMarkings_;
+
+    KeyType     focusStart_{0};
+    KeyType     focusEnd_{0};
+    float       invThetaSq_{0};
+    Box<double> box_{0, 1};
+    std::size_t numCalls_{0};
+    std::size_t numReused_{0};
+};
+
 } // namespace cstone
\ No newline at end of file
@@ -0,0 +1,104 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  GPU driver for the single-sweep node statistics
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <thrust/device_vector.h>
+
+#include "cstone/util/tracing.hpp"
+#include "cstone/util/util.hpp"
+#include "node_statistics.hpp"
+
+namespace cstone
+{
+
+//! @brief one merge path chunk per thread, see computeNodeStatistics
+template<class KeyType, class T, class Tw>
+__global__ void nodeStatisticsKernel(const KeyType* tree, TreeNodeIndex numNodes, const KeyType* keys,
+                                     std::size_t numKeys, std::size_t chunkSize, std::size_t numChunks,
+                                     NodeStatisticsInput<T, Tw> in, NodeStatisticsOutput<T> out,
+                                     detail::NodePartial<T>* partials)
+{
+    std::size_t chunk = std::size_t(blockDim.x) * blockIdx.x + threadIdx.x;
+    if (chunk >= numChunks) { return; }
+
+    const KeyType* nodeEnds = tree + 1;
+    std::size_t pathLength  = numNodes + numKeys;
+    std::size_t diagStart   = stl::min(chunk * chunkSize, pathLength);
+    std::size_t diagEnd     = stl::min(diagStart + chunkSize, pathLength);
+
+    TreeNodeIndex firstNode = mergePathSplit(nodeEnds, numNodes, keys, numKeys, diagStart);
+    detail::nodeStatisticsChunk(nodeEnds, numNodes, keys, numKeys, firstNode, diagStart, diagEnd, in, out,
+                                partials + 2 * chunk, partials + 2 * chunk + 1);
+}
+
+//! @brief one partial entry per thread, see combineNodePartials
+template<class T>
+__global__ void combineNodePartialsKernel(const detail::NodePartial<T>* partials, int numEntries,
+                                          NodeStatisticsOutput<T> out)
+{
+    int entry = blockDim.x * blockIdx.x + threadIdx.x;
+    if (entry < numEntries) { detail::combineNodePartials(entry, partials, numEntries, out); }
+}
+
+/*! @brief device version of computeNodeStatistics
+ *
+ * @param[in]  tree       node keys in device memory, length @p nNodes + 1
+ * @param[in]  nNodes     number of nodes
+ * @param[in]  keys       sorted particle SFC keys in device memory
+ * @param[in]  numKeys    number of particle keys
+ * @param[in]  in         particle data in device memory, in the order of @p keys
+ * @param[out] out        statistics per node in device memory
+ * @param[in]  chunkSize  length of the merge path section handled by one thread
+ */
+template<class KeyType, class T, class Tw>
+void computeNodeStatisticsGpu(const KeyType* tree, TreeNodeIndex nNodes, const KeyType* keys, std::size_t numKeys,
+                              const NodeStatisticsInput<T, Tw>& in, const NodeStatisticsOutput<T>& out,
+                              unsigned chunkSize = 64)
+{
+    CSTONE_TRACE_RANGE("computeNodeStatisticsGpu");
+    constexpr unsigned numThreads = 256;
+    if (nNodes == 0) { return; }
+
+    std::size_t pathLength = nNodes + numKeys;
+    std::size_t numChunks  = iceil(pathLength, chunkSize);
+
+    thrust::device_vector<detail::NodePartial<T>> partials(2 * numChunks);
+    detail::NodePartial<T>* d_partials = thrust::raw_pointer_cast(partials.data());
+
+    nodeStatisticsKernel<<<iceil(numChunks, numThreads), numThreads>>>(tree, nNodes, keys, numKeys, chunkSize,
+                                                                       numChunks, in, out, d_partials);
+
+    int numEntries = 2 * numChunks;
+    combineNodePartialsKernel<<<iceil(numEntries, numThreads), numThreads>>>(d_partials, numEntries, out);
+}
+
+} // namespace cstone
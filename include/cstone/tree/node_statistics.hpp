@@ -0,0 +1,281 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Particle statistics per octree leaf computed in a single sweep over SFC-sorted particle data
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * computeNodeCounts, computeHaloRadii and computeNodeWeights each locate the particle range of every leaf
+ * with binary searches and then stream through it independently. computeNodeStatistics evaluates all of these
+ * quantities, optionally together with the particle bounding boxes, in one pass over the merge path of leaf keys
+ * and particle keys. All particle inputs are expected in the order of the SFC keys, such that the sweep is
+ * linear in memory as well.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "cstone/primitives/stl.hpp"
+#include "cstone/util/tracing.hpp"
+#include "octree.hpp"
+
+namespace cstone
+{
+
+//! @brief coordinate bounding box of the particles in a node
+template<class T>
+struct NodeBounds
+{
+    T xmin, xmax, ymin, ymax, zmin, zmax;
+};
+
+/*! @brief particle arrays that enter the node statistics, in SFC order
+ *
+ * Quantities whose inputs are null pointers are not computed. x, y and z have to be given together.
+ */
+template<class T, class Tw = T>
+struct NodeStatisticsInput
+{
+    const T*  x{nullptr};
+    const T*  y{nullptr};
+    const T*  z{nullptr};
+    //! @brief smoothing lengths
+    const T*  h{nullptr};
+    const Tw* weights{nullptr};
+};
+
+/*! @brief per-node outputs of computeNodeStatistics, outputs that are null pointers are skipped
+ *
+ * counts:   number of particles
+ * radii:    2 * max(h), the halo search radius, see computeHaloRadii
+ * weights:  sum of the particle weights
+ * bounds:   bounding box of the particle coordinates, all limits are zero for empty nodes
+ */
+template<class T>
+struct NodeStatisticsOutput
+{
+    unsigned*      counts{nullptr};
+    float*         radii{nullptr};
+    double*        weights{nullptr};
+    NodeBounds<T>* bounds{nullptr};
+};
+
+namespace detail
+{
+
+//! @brief statistics of a (partial) particle range of one node
+template<class T>
+struct NodeAccumulator
+{
+    unsigned      count{0};
+    T             hMax{0};
+    double        weight{0};
+    NodeBounds<T> bounds{0, 0, 0, 0, 0, 0};
+
+    template<class Tw>
+    CUDA_HOST_DEVICE_FUN void add(std::size_t i, const NodeStatisticsInput<T, Tw>& in)
+    {
+        if (in.h) { hMax = stl::max(hMax, in.h[i]); }
+        if (in.weights) { weight += in.weights[i]; }
+        if (in.x)
+        {
+            T x = in.x[i], y = in.y[i], z = in.z[i];
+            if (count == 0) { bounds = {x, x, y, y, z, z}; }
+            else
+            {
+                bounds = {stl::min(bounds.xmin, x), stl::max(bounds.xmax, x), stl::min(bounds.ymin, y),
+                          stl::max(bounds.ymax, y), stl::min(bounds.zmin, z), stl::max(bounds.zmax, z)};
+            }
+        }
+        count++;
+    }
+
+    CUDA_HOST_DEVICE_FUN void combine(const NodeAccumulator& rhs)
+    {
+        if (rhs.count == 0) { return; }
+        if (count > 0)
+        {
+            bounds = {stl::min(bounds.xmin, rhs.bounds.xmin), stl::max(bounds.xmax, rhs.bounds.xmax),
+                      stl::min(bounds.ymin, rhs.bounds.ymin), stl::max(bounds.ymax, rhs.bounds.ymax),
+                      stl::min(bounds.zmin, rhs.bounds.zmin), stl::max(bounds.zmax, rhs.bounds.zmax)};
+        }
+        else { bounds = rhs.bounds; }
+        count += rhs.count;
+        hMax = stl::max(hMax, rhs.hMax);
+        weight += rhs.weight;
+    }
+
+    CUDA_HOST_DEVICE_FUN void store(TreeNodeIndex node, const NodeStatisticsOutput<T>& out) const
+    {
+        if (out.counts) { out.counts[node] = count; }
+        // note factor of 2 due to SPH conventions
+        if (out.radii) { out.radii[node] = float(2 * hMax); }
+        if (out.weights) { out.weights[node] = weight; }
+        if (out.bounds) { out.bounds[node] = bounds; }
+    }
+};
+
+//! @brief statistics of a node that is shared between merge path chunks, node is -1 for unused entries
+template<class T>
+struct NodePartial
+{
+    TreeNodeIndex      node;
+    NodeAccumulator<T> acc;
+};
+
+/*! @brief accumulate the statistics of one chunk of the merge path of node end keys and particle keys
+ *
+ * Arguments as countMergePathChunk. Nodes that are completely contained in the chunk are stored in @p out.
+ * The first node of the chunk and the node that is still open at the end of the chunk may be shared with
+ * neighboring chunks, their partial statistics are returned in @p head and @p tail.
+ */
+template<class KeyType, class T, class Tw>
+CUDA_HOST_DEVICE_FUN void nodeStatisticsChunk(const KeyType* nodeEnds, TreeNodeIndex numNodes, const KeyType* keys,
+                                              std::size_t numKeys, TreeNodeIndex firstNode, std::size_t diagStart,
+                                              std::size_t diagEnd, const NodeStatisticsInput<T, Tw>& in,
+                                              const NodeStatisticsOutput<T>& out, NodePartial<T>* head,
+                                              NodePartial<T>* tail)
+{
+    head->node = -1;
+    tail->node = -1;
+
+    TreeNodeIndex a = firstNode;
+    std::size_t   b = diagStart - firstNode;
+    NodeAccumulator<T> acc;
+
+    for (std::size_t diagonal = diagStart; diagonal < diagEnd; ++diagonal)
+    {
+        if (b < numKeys && (a == numNodes || keys[b] < nodeEnds[a]))
+        {
+            acc.add(b, in);
+            b++;
+        }
+        else
+        {
+            if (a == firstNode) { *head = {a, acc}; }
+            else { acc.store(a, out); }
+            acc = NodeAccumulator<T>{};
+            a++;
+        }
+    }
+
+    if (a < numNodes)
+    {
+        if (a == firstNode) { *head = {a, acc}; }
+        else { *tail = {a, acc}; }
+    }
+}
+
+/*! @brief combine and store the partial statistics of shared nodes
+ *
+ * @param entry        index into @p partials, ordered by node index apart from unused entries
+ * @param partials     head and tail entries of all chunks, in chunk order
+ * @param numEntries   length of @p partials
+ * @param out          output statistics
+ *
+ * Each node is stored by the first entry that refers to it, such that all entries can be processed in parallel.
+ */
+template<class T>
+CUDA_HOST_DEVICE_FUN void combineNodePartials(int entry, const NodePartial<T>* partials, int numEntries,
+                                              const NodeStatisticsOutput<T>& out)
+{
+    TreeNodeIndex node = partials[entry].node;
+    if (node < 0) { return; }
+
+    for (int prev = entry - 1; prev >= 0; --prev)
+    {
+        if (partials[prev].node < 0) { continue; }
+        if (partials[prev].node == node) { return; }
+        break;
+    }
+
+    NodeAccumulator<T> acc = partials[entry].acc;
+    for (int next = entry + 1; next < numEntries; ++next)
+    {
+        if (partials[next].node < 0) { continue; }
+        if (partials[next].node != node) { break; }
+        acc.combine(partials[next].acc);
+    }
+    acc.store(node, out);
+}
+
+} // namespace detail
+
+/*! @brief compute particle counts, halo radii, weight sums and bounding boxes of octree nodes in a single sweep
+ *
+ * @tparam KeyType          32- or 64-bit unsigned integer type
+ * @tparam T                float or double
+ * @tparam Tw               float or double
+ * @param[in]  tree         octree nodes given as SFC codes of length @a nNodes+1, only sortedness is required
+ * @param[in]  nNodes       number of nodes in @p tree
+ * @param[in]  keys         sorted particle SFC keys, all keys must be in [tree[0]:tree[nNodes]]
+ * @param[in]  numKeys      number of particle keys
+ * @param[in]  in           particle data in the order of @p keys
+ * @param[out] out          statistics per node of @p tree, length @p nNodes each
+ *
+ * As in computeNodeCountsMerge, the merged sequence of node keys and particle keys is split into chunks of equal
+ * length, one per thread. Each thread streams through its share of both arrays, nodes that span multiple chunks
+ * are combined afterwards.
+ */
+template<class KeyType, class T, class Tw>
+void computeNodeStatistics(const KeyType* tree, TreeNodeIndex nNodes, const KeyType* keys, std::size_t numKeys,
+                           const NodeStatisticsInput<T, Tw>& in, const NodeStatisticsOutput<T>& out)
+{
+    CSTONE_TRACE_RANGE("computeNodeStatistics");
+    const KeyType* nodeEnds = tree + 1;
+    std::size_t pathLength  = nNodes + numKeys;
+
+    int numThreads = 1;
+#ifdef _OPENMP
+    numThreads = omp_get_max_threads();
+#endif
+    std::size_t chunkSize = (pathLength + numThreads - 1) / numThreads;
+
+    std::vector<detail::NodePartial<T>> partials(2 * numThreads);
+
+    #pragma omp parallel for num_threads(numThreads) schedule(static, 1)
+    for (int chunk = 0; chunk < numThreads; ++chunk)
+    {
+        std::size_t diagStart   = std::min(chunk * chunkSize, pathLength);
+        std::size_t diagEnd     = std::min(diagStart + chunkSize, pathLength);
+        TreeNodeIndex firstNode = mergePathSplit(nodeEnds, nNodes, keys, numKeys, diagStart);
+        detail::nodeStatisticsChunk(nodeEnds, nNodes, keys, numKeys, firstNode, diagStart, diagEnd, in, out,
+                                    &partials[2 * chunk], &partials[2 * chunk + 1]);
+    }
+
+    for (int entry = 0; entry < int(partials.size()); ++entry)
+    {
+        detail::combineNodePartials(entry, partials.data(), int(partials.size()), out);
+    }
+}
+
+} // namespace cstone
@@ -46,6 +46,7 @@
 
 #include "cstone/cuda/errorcheck.cuh"
 #include "cstone/util/util.hpp"
+#include "cstone/util/tracing.hpp"
 #include "octree.hpp"
 
 namespace cstone
@@ -63,6 +64,75 @@ __global__ void computeNodeCountsKernel(const KeyType* tree, unsigned* counts, T
     }
 }
 
+//! @brief compute the merge path split of each chunk and zero-initialize the counts of the first node per chunk
+template<class KeyType>
+__global__ void mergePathSplitKernel(const KeyType* nodeEnds, TreeNodeIndex nNodes, const KeyType* codesStart,
+                                     std::size_t numKeys, std::size_t chunkSize, TreeNodeIndex numChunks,
+                                     TreeNodeIndex* chunkNodes, unsigned* counts)
+{
+    TreeNodeIndex chunk = blockDim.x * blockIdx.x + threadIdx.x;
+    if (chunk < numChunks)
+    {
+        std::size_t pathLength = nNodes + numKeys;
+        TreeNodeIndex node     = mergePathSplit(nodeEnds, nNodes, codesStart, numKeys,
+                                                min(chunk * chunkSize, pathLength));
+        chunkNodes[chunk] = node;
+        if (node < nNodes) { counts[node] = 0; }
+    }
+}
+
+//! @brief count the particles in one merge path chunk per thread, see computeNodeCountsMerge
+template<class KeyType>
+__global__ void computeNodeCountsMergeKernel(const KeyType* nodeEnds, TreeNodeIndex nNodes, const KeyType* codesStart,
+                                             std::size_t numKeys, std::size_t chunkSize, TreeNodeIndex numChunks,
+                                             const TreeNodeIndex* chunkNodes, unsigned* counts)
+{
+    TreeNodeIndex chunk = blockDim.x * blockIdx.x + threadIdx.x;
+    if (chunk < numChunks)
+    {
+        std::size_t pathLength = nNodes + numKeys;
+        std::size_t diagStart  = min(chunk * chunkSize, pathLength);
+        std::size_t diagEnd    = min(diagStart + chunkSize, pathLength);
+
+        auto deviceAtomicAdd = [](unsigned* address, unsigned value) { atomicAdd(address, value); };
+        countMergePathChunk(nodeEnds, nNodes, codesStart, numKeys, chunkNodes[chunk], diagStart, diagEnd, counts,
+                            deviceAtomicAdd);
+    }
+}
+
+//! @brief clamp node counts to @p maxCount
+__global__ void clampNodeCountsKernel(unsigned* counts, TreeNodeIndex nNodes, unsigned maxCount)
+{
+    TreeNodeIndex tid = blockDim.x * blockIdx.x + threadIdx.x;
+    if (tid < nNodes) { counts[tid] = min(counts[tid], maxCount); }
+}
+
+/*! @brief count number of particles in each octree node with a merge of node keys and particle keys on the GPU
+ *
+ * Arguments as computeNodeCountsMerge. Each thread handles a chunk of @p chunkSize elements of the merged sequence.
+ * The start node of each chunk is stored in @p chunkNodes, a temporary array that is resized as needed.
+ */
+template<class KeyType>
+void computeNodeCountsMergeGpu(const KeyType* tree, unsigned* counts, TreeNodeIndex nNodes, const KeyType* codesStart,
+                               const KeyType* codesEnd, unsigned maxCount,
+                               thrust::device_vector<TreeNodeIndex>& chunkNodes)
+{
+    constexpr unsigned nThreads     = 256;
+    constexpr std::size_t chunkSize = 64;
+
+    std::size_t numKeys     = codesEnd - codesStart;
+    TreeNodeIndex numChunks = iceil(nNodes + numKeys, chunkSize);
+
+    if (chunkNodes.size() < std::size_t(numChunks)) { chunkNodes.resize(numChunks); }
+    TreeNodeIndex* chunkNodesPtr = thrust::raw_pointer_cast(chunkNodes.data());
+
+    mergePathSplitKernel<<<iceil(numChunks, nThreads), nThreads>>>
+        (tree + 1, nNodes, codesStart, numKeys, chunkSize, numChunks, chunkNodesPtr, counts);
+    computeNodeCountsMergeKernel<<<iceil(numChunks, nThreads), nThreads>>>
+        (tree + 1, nNodes, codesStart, numKeys, chunkSize, numChunks, chunkNodesPtr, counts);
+    clampNodeCountsKernel<<<iceil(nNodes, nThreads), nThreads>>>(counts, nNodes, maxCount);
+}
+
 //! @brief see updateNodeCounts
 template<class KeyType>
 __global__ void updateNodeCountsKernel(const KeyType* tree, unsigned* counts, TreeNodeIndex nNodes, const KeyType* codesStart,
@@ -105,11 +175,14 @@ __global__ void findPopulatedNodes(const KeyType* tree, TreeNodeIndex nNodes, co
  * @param[in]  codesEnd     sorted particle SFC code range end
  * @param[in]  maxCount     maximum particle count per node to store, this is used
  *                          to prevent overflow in MPI_Allreduce
+ * @param[-]   workArray    temporary array for the merge path, will be resized as needed
  */
 template<class KeyType>
 void computeNodeCountsGpu(const KeyType* tree, unsigned* counts, TreeNodeIndex nNodes, const KeyType* codesStart,
-                          const KeyType* codesEnd, unsigned maxCount, bool useCountsAsGuess = false)
+                          const KeyType* codesEnd, unsigned maxCount, bool useCountsAsGuess,
+                          thrust::device_vector<TreeNodeIndex>& workArray)
 {
+    CSTONE_TRACE_RANGE("computeNodeCountsGpu");
     TreeNodeIndex popNodes[2];
 
     findPopulatedNodes<<<1,1>>>(tree, nNodes, codesStart, codesEnd);
@@ -127,11 +200,20 @@ void computeNodeCountsGpu(const KeyType* tree, unsigned* counts, TreeNodeIndex n
     }
     else
     {
-        computeNodeCountsKernel<<<iceil(popNodes[1] - popNodes[0], nThreads), nThreads>>>
-            (tree + popNodes[0], counts + popNodes[0], popNodes[1] - popNodes[0], codesStart, codesEnd, maxCount);
+        computeNodeCountsMergeGpu(tree + popNodes[0], counts + popNodes[0], popNodes[1] - popNodes[0], codesStart,
+                                  codesEnd, maxCount, workArray);
     }
 }
 
+//! @brief computeNodeCountsGpu with an internally allocated temporary array
+template<class KeyType>
+void computeNodeCountsGpu(const KeyType* tree, unsigned* counts, TreeNodeIndex nNodes, const KeyType* codesStart,
+                          const KeyType* codesEnd, unsigned maxCount, bool useCountsAsGuess = false)
+{
+    thrust::device_vector<TreeNodeIndex> workArray;
+    computeNodeCountsGpu(tree, counts, nNodes, codesStart, codesEnd, maxCount, useCountsAsGuess, workArray);
+}
+
 //! @brief this symbol is used to keep track of octree structure changes and detect convergence
 __device__ int rebalanceChangeCounter;
 
@@ -205,6 +287,7 @@ template<class SfcVector>
 bool rebalanceTreeGpu(SfcVector& tree, const unsigned* counts, unsigned bucketSize,
                       SfcVector& tmpTree, thrust::device_vector<TreeNodeIndex>& workArray)
 {
+    CSTONE_TRACE_RANGE("rebalanceTreeGpu");
     using KeyType = typename SfcVector::value_type;
     TreeNodeIndex nOldNodes = nNodes(tree);
 
@@ -254,12 +337,13 @@ bool updateOctreeGpu(const KeyType* codesStart, const KeyType* codesEnd, unsigne
                      thrust::device_vector<KeyType>& tmpTree, thrust::device_vector<TreeNodeIndex>& workArray,
                      unsigned maxCount = std::numeric_limits<unsigned>::max())
 {
+    CSTONE_TRACE_RANGE("updateOctreeGpu");
     bool converged = rebalanceTreeGpu(tree, thrust::raw_pointer_cast(counts.data()), bucketSize, tmpTree, workArray);
     counts.resize(nNodes(tree));
 
     // local node counts
     computeNodeCountsGpu(thrust::raw_pointer_cast(tree.data()), thrust::raw_pointer_cast(counts.data()),
-                         nNodes(tree), codesStart, codesEnd, maxCount, true);
+                         nNodes(tree), codesStart, codesEnd, maxCount, true, workArray);
 
     return converged;
 }
@@ -57,9 +57,15 @@
 #include <vector>
 #include <tuple>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "cstone/sfc/common.hpp"
 #include "cstone/primitives/scan.hpp"
+#include "cstone/util/executor.hpp"
 #include "cstone/util/gsl-lite.hpp"
+#include "cstone/util/tracing.hpp"
 
 #include "definitions.h"
 
@@ -176,6 +182,129 @@ unsigned updateNodeCount(TreeNodeIndex nodeIdx, const KeyType* tree,
     return stl::min(count, maxCount);
 }
 
+/*! @brief find the intersection of the merge path of node end keys and particle keys with a diagonal
+ *
+ * @tparam KeyType         32- or 64-bit unsigned integer type
+ * @param[in] nodeEnds     sorted upper key bounds of the nodes, length = @p numNodes
+ * @param[in] numNodes     number of nodes
+ * @param[in] keys         sorted particle keys, length = @p numKeys
+ * @param[in] numKeys      number of particle keys
+ * @param[in] diagonal     index of the diagonal, range [0:numNodes + numKeys]
+ * @return                 the number of node ends among the first @p diagonal elements of the merged sequence
+ *
+ * In the merged sequence, a particle key precedes a node end key if it is strictly smaller,
+ * such that all keys that precede the end of node i and succeed the end of node i-1 belong to node i.
+ */
+template<class KeyType>
+CUDA_HOST_DEVICE_FUN
+TreeNodeIndex mergePathSplit(const KeyType* nodeEnds, TreeNodeIndex numNodes, const KeyType* keys, std::size_t numKeys,
+                             std::size_t diagonal)
+{
+    TreeNodeIndex lo = (diagonal > numKeys) ? TreeNodeIndex(diagonal - numKeys) : 0;
+    TreeNodeIndex hi = stl::min(TreeNodeIndex(diagonal), numNodes);
+
+    while (lo < hi)
+    {
+        TreeNodeIndex mid = (lo + hi) / 2;
+        if (nodeEnds[mid] <= keys[diagonal - mid - 1]) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return lo;
+}
+
+/*! @brief count the particles in one chunk of the merge path of node end keys and particle keys
+ *
+ * @tparam KeyType          32- or 64-bit unsigned integer type
+ * @tparam AtomicAdd        callable with signature void(unsigned*, unsigned)
+ * @param[in]    nodeEnds   sorted upper key bounds of the nodes, length = @p numNodes
+ * @param[in]    numNodes   number of nodes
+ * @param[in]    keys       sorted particle keys, length = @p numKeys, all keys must be smaller than nodeEnds[numNodes-1]
+ * @param[in]    numKeys    number of particle keys
+ * @param[in]    firstNode  merge path split at @p diagStart, see mergePathSplit
+ * @param[in]    diagStart  first diagonal of the chunk
+ * @param[in]    diagEnd    last diagonal of the chunk
+ * @param[inout] counts     node counts, length = @p numNodes. The first and last node of the chunk may be shared
+ *                          with neighboring chunks, their counts need to be zero-initialized and are accumulated
+ *                          with @p atomicAdd. All other nodes of the chunk are overwritten.
+ * @param[in]    atomicAdd  accumulation function for shared nodes
+ */
+template<class KeyType, class AtomicAdd>
+CUDA_HOST_DEVICE_FUN
+void countMergePathChunk(const KeyType* nodeEnds, TreeNodeIndex numNodes, const KeyType* keys, std::size_t numKeys,
+                         TreeNodeIndex firstNode, std::size_t diagStart, std::size_t diagEnd, unsigned* counts,
+                         AtomicAdd&& atomicAdd)
+{
+    TreeNodeIndex a = firstNode;
+    std::size_t   b = diagStart - firstNode;
+    unsigned count  = 0;
+
+    for (std::size_t diagonal = diagStart; diagonal < diagEnd; ++diagonal)
+    {
+        if (b < numKeys && (a == numNodes || keys[b] < nodeEnds[a]))
+        {
+            count++;
+            b++;
+        }
+        else
+        {
+            if (a == firstNode) { atomicAdd(counts + a, count); }
+            else { counts[a] = count; }
+            count = 0;
+            a++;
+        }
+    }
+
+    if (a < numNodes) { atomicAdd(counts + a, count); }
+}
+
+/*! @brief count number of particles in each octree node with a merge of the node keys and particle keys
+ *
+ * @tparam KeyType            32- or 64-bit unsigned integer type
+ * @param[in]    tree         octree nodes given as SFC codes of length @a nNodes+1
+ * @param[out]   counts       output particle counts per node, length = @a nNodes
+ * @param[in]    nNodes       number of nodes in tree
+ * @param[in]    codesStart   sorted particle SFC code range start
+ * @param[in]    codesEnd     sorted particle SFC code range end, all codes need to be in [tree[0]:tree[nNodes]]
+ * @param[in]    maxCount     maximum particle count per node to store
+ *
+ * The merged sequence of leaf keys and particle keys is split into chunks of equal length, one per thread.
+ * Each thread streams linearly through its share of both arrays, instead of performing two binary searches
+ * per node. Only the chunk boundaries are located with binary searches.
+ */
+template<class KeyType>
+void computeNodeCountsMerge(const KeyType* tree, unsigned* counts, TreeNodeIndex nNodes, const KeyType* codesStart,
+                            const KeyType* codesEnd, unsigned maxCount)
+{
+    const KeyType* nodeEnds = tree + 1;
+    std::size_t numKeys     = codesEnd - codesStart;
+    std::size_t pathLength  = nNodes + numKeys;
+
+    int numThreads        = parallelism();
+    std::size_t chunkSize = (pathLength + numThreads - 1) / numThreads;
+
+    std::vector<TreeNodeIndex> chunkNodes(numThreads);
+    for (int chunk = 0; chunk < numThreads; ++chunk)
+    {
+        chunkNodes[chunk] = mergePathSplit(nodeEnds, nNodes, codesStart, numKeys,
+                                           std::min(chunk * chunkSize, pathLength));
+        if (chunkNodes[chunk] < nNodes) { counts[chunkNodes[chunk]] = 0; }
+    }
+
+    // chunks may run on threads of an application executor, which are not synchronized by OpenMP atomics
+    auto atomicAdd = [](unsigned* address, unsigned value) { __atomic_fetch_add(address, value, __ATOMIC_RELAXED); };
+
+    parallelFor(0, numThreads, [&](int chunk)
+    {
+        std::size_t diagStart = std::min(chunk * chunkSize, pathLength);
+        std::size_t diagEnd   = std::min(diagStart + chunkSize, pathLength);
+        countMergePathChunk(nodeEnds, nNodes, codesStart, numKeys, chunkNodes[chunk], diagStart, diagEnd, counts,
+                            atomicAdd);
+    });
+
+    parallelFor(TreeNodeIndex(0), nNodes,
+                [counts, maxCount](TreeNodeIndex i) { counts[i] = stl::min(counts[i], maxCount); });
+}
+
 /*! @brief count number of particles in each octree node
  *
  * @tparam KeyType            32- or 64-bit unsigned integer type
@@ -192,6 +321,7 @@ template<class KeyType>
 void computeNodeCounts(const KeyType* tree, unsigned* counts, TreeNodeIndex nNodes, const KeyType* codesStart, const KeyType* codesEnd,
                        unsigned maxCount, bool useCountsAsGuess = false)
 {
+    CSTONE_TRACE_RANGE("computeNodeCounts");
     TreeNodeIndex firstNode = 0;
     TreeNodeIndex lastNode  = nNodes;
     if (codesStart != codesEnd)
@@ -200,13 +330,8 @@ void computeNodeCounts(const KeyType* tree, unsigned* counts, TreeNodeIndex nNod
         lastNode  = std::upper_bound(tree, tree + nNodes, *(codesEnd-1)) - tree;
     }
 
-    #pragma omp parallel for schedule(static)
-    for (TreeNodeIndex i = 0; i < firstNode; ++i)
-        counts[i] = 0;
-
-    #pragma omp parallel for schedule(static)
-    for (TreeNodeIndex i = lastNode; i < nNodes; ++i)
-        counts[i] = 0;
+    parallelFor(TreeNodeIndex(0), firstNode, [counts](TreeNodeIndex i) { counts[i] = 0; });
+    parallelFor(lastNode, nNodes, [counts](TreeNodeIndex i) { counts[i] = 0; });
 
     TreeNodeIndex nNonZeroNodes = lastNode - firstNode;
     const KeyType* populatedTree = tree + firstNode;
@@ -214,14 +339,13 @@ void computeNodeCounts(const KeyType* tree, unsigned* counts, TreeNodeIndex nNod
     if (useCountsAsGuess)
     {
         exclusiveScan(counts + firstNode, nNonZeroNodes);
-        #pragma omp parallel for schedule(static)
-        for (TreeNodeIndex i = 0; i < nNonZeroNodes-1; ++i)
+        parallelFor(TreeNodeIndex(0), nNonZeroNodes - 1, [&](TreeNodeIndex i)
         {
             unsigned firstGuess   = counts[i + firstNode];
             unsigned secondGuess  = counts[i + firstNode + 1];
             counts[i + firstNode] = updateNodeCount(i, populatedTree, firstGuess, secondGuess,
                                                     codesStart, codesEnd, maxCount);
-        }
+        });
 
         TreeNodeIndex lastIdx       = nNonZeroNodes-1;
         unsigned lastGuess          = counts[lastIdx + firstNode];
@@ -230,12 +354,37 @@ void computeNodeCounts(const KeyType* tree, unsigned* counts, TreeNodeIndex nNod
     }
     else
     {
-        #pragma omp parallel for schedule(static)
-        for (TreeNodeIndex i = 0; i < nNonZeroNodes; ++i)
+        computeNodeCountsMerge(populatedTree, counts + firstNode, nNonZeroNodes, codesStart, codesEnd, maxCount);
+    }
+}
+
+/*! @brief sum up the weights of the particles in each octree node
+ *
+ * @tparam KeyType             32- or 64-bit unsigned integer type
+ * @tparam WeightType          float or double
+ * @param[in]  tree            octree nodes given as SFC codes of length @a nNodes+1
+ * @param[out] nodeWeights     output weight sum per node, length = @a nNodes
+ * @param[in]  nNodes          number of nodes in tree
+ * @param[in]  codesStart      sorted particle SFC code range start
+ * @param[in]  codesEnd        sorted particle SFC code range end
+ * @param[in]  weights         particle weights in the order of the SFC codes
+ */
+template<class KeyType, class WeightType>
+void computeNodeWeights(const KeyType* tree, double* nodeWeights, TreeNodeIndex nNodes, const KeyType* codesStart,
+                        const KeyType* codesEnd, const WeightType* weights)
+{
+    parallelFor(TreeNodeIndex(0), nNodes, [=](TreeNodeIndex i)
+    {
+        std::size_t firstParticle = std::lower_bound(codesStart, codesEnd, tree[i]) - codesStart;
+        std::size_t lastParticle  = std::lower_bound(codesStart + firstParticle, codesEnd, tree[i + 1]) - codesStart;
+
+        double weightSum = 0;
+        for (std::size_t j = firstParticle; j < lastParticle; ++j)
         {
-            counts[i + firstNode] = calculateNodeCount(populatedTree, i, codesStart, codesEnd, maxCount);
+            weightSum += weights[j];
         }
-    }
+        nodeWeights[i] = weightSum;
+    });
 }
 
 /*! @brief return the sibling index and level of the specified csTree node
@@ -267,7 +416,16 @@ pair<unsigned> siblingAndLevel(const KeyType* csTree, TreeNodeIndex nodeIdx)
     return pair<unsigned>{siblingIdx, level};
 }
 
-//! @brief returns 0 for merging, 1 for no-change, 8 for splitting
+//! @brief maximum number of levels by which a node can be split in a single rebalance step
+constexpr unsigned maxSplitLevels = 3;
+
+/*! @brief returns 0 for merging, 1 for no-change, 8, 64 or 512 for splitting by 1, 2 or 3 levels
+ *
+ * An overfull node is split by one level for each factor of 8 that its count exceeds
+ * the bucket size, up to maxSplitLevels. Assuming a uniform particle distribution inside the node,
+ * this avoids creating children that would be split again in the next step, but does not
+ * create empty leaves that would have to be merged back.
+ */
 template<class KeyType>
 CUDA_HOST_DEVICE_FUN
 int calculateNodeOp(const KeyType* tree, TreeNodeIndex nodeIdx, const unsigned* counts, unsigned bucketSize)
@@ -284,7 +442,17 @@ int calculateNodeOp(const KeyType* tree, TreeNodeIndex nodeIdx, const unsigned*
         if (countMerge) { return 0; } // merge
     }
 
-    if (counts[nodeIdx] > bucketSize && level < maxTreeLevel<KeyType>{}) { return 8; } // split
+    if (counts[nodeIdx] > bucketSize && level < maxTreeLevel<KeyType>{}) // split
+    {
+        unsigned splitLevels = 1;
+        uint64_t threshold   = uint64_t(bucketSize) * 8;
+        while (counts[nodeIdx] > threshold && splitLevels < maxSplitLevels && level + splitLevels < maxTreeLevel<KeyType>{})
+        {
+            splitLevels++;
+            threshold *= 8;
+        }
+        return 1 << (3 * splitLevels);
+    }
 
     return 1; // default: do nothing
 }
@@ -304,28 +472,20 @@ int calculateNodeOp(const KeyType* tree, TreeNodeIndex nodeIdx, const unsigned*
  * For each node i in the tree, in nodeOps[i], stores
  *  - 0 if to be merged
  *  - 1 if unchanged,
- *  - 8 if to be split.
+ *  - 8, 64 or 512 if to be split by 1, 2 or 3 levels, see calculateNodeOp.
  */
 template<class KeyType, class LocalIndex>
 bool rebalanceDecision(const KeyType* tree, const unsigned* counts, TreeNodeIndex nNodes,
                        unsigned bucketSize, LocalIndex* nodeOps)
 {
-    bool converged = true;
-
-    #pragma omp parallel
+    auto decide = [=](TreeNodeIndex i)
     {
-        bool convergedThread = true;
-        #pragma omp for
-        for (TreeNodeIndex i = 0; i < nNodes; ++i)
-        {
-            int decision = calculateNodeOp(tree, i, counts, bucketSize);
-            if (decision != 1) { convergedThread = false; }
+        int decision = calculateNodeOp(tree, i, counts, bucketSize);
+        nodeOps[i]   = decision;
+        return decision == 1;
+    };
 
-            nodeOps[i] = decision;
-        }
-        if (!convergedThread) { converged = false; }
-    }
-    return converged;
+    return parallelReduce(TreeNodeIndex(0), nNodes, true, decide, [](bool a, bool b) { return a && b; });
 }
 
 /*! @brief transform old nodes into new nodes based on opcodes
@@ -340,9 +500,8 @@ template<class KeyType>
 CUDA_HOST_DEVICE_FUN
 void processNode(TreeNodeIndex nodeIndex, const KeyType* oldTree, const TreeNodeIndex* nodeOps, KeyType* newTree)
 {
-    KeyType thisNode     = oldTree[nodeIndex];
-    KeyType range        = oldTree[nodeIndex+1] - thisNode;
-    unsigned level = treeLevel(range);
+    KeyType thisNode = oldTree[nodeIndex];
+    KeyType range    = oldTree[nodeIndex+1] - thisNode;
 
     TreeNodeIndex opCode       = nodeOps[nodeIndex+1] - nodeOps[nodeIndex];
     TreeNodeIndex newNodeIndex = nodeOps[nodeIndex];
@@ -351,11 +510,13 @@ void processNode(TreeNodeIndex nodeIndex, const KeyType* oldTree, const TreeNode
     {
         newTree[newNodeIndex] = thisNode;
     }
-    else if (opCode == 8)
+    else if (opCode > 1)
     {
-        for (int sibling = 0; sibling < 8; ++sibling)
+        // split into 8, 64 or 512 descendants
+        KeyType childRange = range / KeyType(opCode);
+        for (TreeNodeIndex child = 0; child < opCode; ++child)
         {
-            newTree[newNodeIndex + sibling] = thisNode + sibling * nodeRange<KeyType>(level + 1);
+            newTree[newNodeIndex + child] = thisNode + child * childRange;
         }
     }
 }
@@ -371,17 +532,16 @@ void processNode(TreeNodeIndex nodeIndex, const KeyType* oldTree, const TreeNode
 template<class InputVector, class OutputVector>
 void rebalanceTree(const InputVector& tree, OutputVector& newTree, TreeNodeIndex* nodeOps)
 {
+    CSTONE_TRACE_RANGE("rebalanceTree");
     using KeyType = typename InputVector::value_type;
     TreeNodeIndex numNodes = nNodes(tree);
 
     exclusiveScan(nodeOps, numNodes + 1);
     newTree.resize(nodeOps[numNodes] + 1);
 
-    #pragma omp parallel for schedule(static)
-    for (TreeNodeIndex i = 0; i < numNodes; ++i)
-    {
-        processNode(i, tree.data(), nodeOps, newTree.data());
-    }
+    const KeyType* oldNodes = tree.data();
+    KeyType* newNodes       = newTree.data();
+    parallelFor(TreeNodeIndex(0), numNodes, [=](TreeNodeIndex i) { processNode(i, oldNodes, nodeOps, newNodes); });
     *newTree.rbegin() = nodeRange<KeyType>(0);
 }
 
@@ -408,6 +568,7 @@ bool updateOctree(const KeyType* codesStart, const KeyType* codesEnd, unsigned b
                   std::vector<KeyType>& tree, std::vector<unsigned>& counts,
                   unsigned maxCount = std::numeric_limits<unsigned>::max())
 {
+    CSTONE_TRACE_RANGE("updateOctree");
     std::vector<TreeNodeIndex> nodeOps(nNodes(tree) + 1);
     bool converged = rebalanceDecision(tree.data(), counts.data(), nNodes(tree), bucketSize, nodeOps.data());
 
@@ -421,19 +582,6 @@ bool updateOctree(const KeyType* codesStart, const KeyType* codesEnd, unsigned b
     return converged;
 }
 
-//! @brief convenience wrapper for updateOctree
-template<class KeyType>
-std::tuple<std::vector<KeyType>, std::vector<unsigned>>
-computeOctree(const KeyType* codesStart, const KeyType* codesEnd, unsigned bucketSize,
-              unsigned maxCount = std::numeric_limits<unsigned>::max())
-{
-    std::vector<KeyType>  tree{0, nodeRange<KeyType>(0)};
-    std::vector<unsigned> counts{unsigned(codesEnd - codesStart)};
-
-    while (!updateOctree(codesStart, codesEnd, bucketSize, tree, counts, maxCount));
-
-    return std::make_tuple(std::move(tree), std::move(counts));
-}
 
 /*! @brief create a cornerstone octree around a series of given SFC codes
  *
@@ -469,7 +617,7 @@ auto computeSpanningTree(InputIterator firstCode, InputIterator lastCode)
         offsets[i] = spanSfcRange(firstCode[i], firstCode[i+1]);
     }
 
-    exclusiveScanSerialInplace(offsets.data(), offsets.size(), 0);
+    exclusiveScanSerialInplace(offsets.data(), offsets.size(), TreeNodeIndex(0));
 
     std::vector<CodeType> spanningTree(offsets.back() + 1);
     for (TreeNodeIndex i = 0; i < numIntervals; ++i)
@@ -481,6 +629,96 @@ auto computeSpanningTree(InputIterator firstCode, InputIterator lastCode)
     return spanningTree;
 }
 
+/*! @brief determine the node boundaries required to resolve all nodes with more than @p bucketSize keys
+ *
+ * @tparam KeyType           32- or 64-bit unsigned integer for SFC code
+ * @param[in]  codesStart    sorted particle SFC codes start
+ * @param[in]  codesEnd      sorted particle SFC codes end
+ * @param[in]  bucketSize    maximum number of particles per leaf node
+ * @return                   sorted, unique SFC keys, including 0 and nodeRange<KeyType>(0)
+ *
+ * A node contains more than bucketSize particles if and only if it contains two keys that are
+ * bucketSize positions apart in the sorted key sequence. For each such pair, the smallest node
+ * containing both is overfull and the start keys of its 8 children are added to the output.
+ * Nodes at the maximum tree level cannot be split, in that case the node start and end are added.
+ * All other overfull nodes contain at least one of these smallest nodes.
+ */
+template<class KeyType>
+std::vector<KeyType> computeSplitKeys(const KeyType* codesStart, const KeyType* codesEnd, unsigned bucketSize)
+{
+    std::size_t numKeys = codesEnd - codesStart;
+    if (numKeys <= bucketSize) { return {0, nodeRange<KeyType>(0)}; }
+
+    std::size_t numPairs = numKeys - bucketSize;
+
+    // smallest node containing the pair i, i + bucketSize
+    auto smallestNode = [codesStart, bucketSize](std::size_t i)
+    { return smallestCommonBox(codesStart[i], codesStart[i + bucketSize]); };
+
+    // count split keys, consecutive pairs mostly share the same smallest node, store only the first
+    std::vector<std::size_t> offsets(numPairs + 1);
+    parallelFor(std::size_t(0), numPairs, [&](std::size_t i)
+    {
+        pair<KeyType> node = smallestNode(i);
+        offsets[i] = 0;
+        if (i == 0 || !(smallestNode(i - 1) == node))
+        {
+            offsets[i] = (node[1] - node[0] > 1) ? 8 : 2;
+        }
+    });
+    offsets[numPairs] = 0;
+
+    exclusiveScan(offsets.data(), offsets.size());
+
+    std::vector<KeyType> splitKeys(offsets.back() + 2);
+    parallelFor(std::size_t(0), numPairs, [&](std::size_t i)
+    {
+        std::size_t numSplits = offsets[i + 1] - offsets[i];
+        if (numSplits == 0) { return; }
+
+        pair<KeyType> node = smallestNode(i);
+        // children of the node, or the node itself at the maximum tree level
+        KeyType step = (numSplits == 8) ? (node[1] - node[0]) / 8 : KeyType(1);
+        for (std::size_t j = 0; j < numSplits; ++j)
+        {
+            splitKeys[offsets[i] + j] = node[0] + j * step;
+        }
+    });
+    *(splitKeys.rbegin() + 1) = 0;
+    *splitKeys.rbegin()       = nodeRange<KeyType>(0);
+
+    std::sort(begin(splitKeys), end(splitKeys));
+    splitKeys.erase(std::unique(begin(splitKeys), end(splitKeys)), end(splitKeys));
+
+    return splitKeys;
+}
+
+/*! @brief compute the octree for the given keys in a single pass
+ *
+ * @tparam KeyType           32- or 64-bit unsigned integer for SFC code
+ * @param[in]    codesStart  sorted particle SFC codes start
+ * @param[in]    codesEnd    sorted particle SFC codes end
+ * @param[in]    bucketSize  maximum number of particles per node
+ * @param[in]    maxCount    if actual node counts are higher, they will be capped to @p maxCount
+ * @return                   the octree leaf nodes (cornerstone format) and the leaf node particle counts
+ *
+ * The resulting tree is identical to the one obtained by repeatedly calling updateOctree,
+ * starting from the root node until convergence, but only performs one node counting pass.
+ */
+template<class KeyType>
+std::tuple<std::vector<KeyType>, std::vector<unsigned>>
+computeOctree(const KeyType* codesStart, const KeyType* codesEnd, unsigned bucketSize,
+              unsigned maxCount = std::numeric_limits<unsigned>::max())
+{
+    std::vector<KeyType> splitKeys = computeSplitKeys(codesStart, codesEnd, bucketSize);
+    std::vector<KeyType> tree      = computeSpanningTree(begin(splitKeys), end(splitKeys));
+
+    std::vector<unsigned> counts(nNodes(tree));
+    computeNodeCounts(tree.data(), counts.data(), nNodes(tree), codesStart, codesEnd, maxCount);
+
+    return std::make_tuple(std::move(tree), std::move(counts));
+}
+
 /*! @brief Compute the halo radius of each node in the given octree
  *
  * This is the maximum distance beyond the node boundaries that a particle outside the
@@ -510,24 +748,18 @@ template<class Tin, class Tout, class KeyType, class IndexType>
 void computeHaloRadii(const KeyType* tree, TreeNodeIndex nNodes, const KeyType* codesStart, const KeyType* codesEnd,
                       const IndexType* ordering, const Tin* input, Tout* output)
 {
-    int firstNode = 0;
-    int lastNode  = nNodes;
+    TreeNodeIndex firstNode = 0;
+    TreeNodeIndex lastNode  = nNodes;
     if (codesStart != codesEnd)
     {
         firstNode = std::upper_bound(tree, tree + nNodes, *codesStart) - tree - 1;
         lastNode  = std::upper_bound(tree, tree + nNodes, *(codesEnd-1)) - tree;
     }
 
-    #pragma omp parallel for schedule(static)
-    for (TreeNodeIndex i = 0; i < firstNode; ++i)
-        output[i] = 0;
-
-    #pragma omp parallel for schedule(static)
-    for (TreeNodeIndex i = lastNode; i < nNodes; ++i)
-        output[i] = 0;
+    parallelFor(TreeNodeIndex(0), firstNode, [output](TreeNodeIndex i) { output[i] = 0; });
+    parallelFor(lastNode, nNodes, [output](TreeNodeIndex i) { output[i] = 0; });
 
-    #pragma omp parallel for
-    for (TreeNodeIndex i = firstNode; i < lastNode; ++i)
+    parallelFor(firstNode, lastNode, [=](TreeNodeIndex i)
     {
         KeyType nodeStart = tree[i];
         KeyType nodeEnd   = tree[i+1];
@@ -545,7 +777,7 @@ void computeHaloRadii(const KeyType* tree, TreeNodeIndex nNodes, const KeyType*
 
         // note factor of 2 due to SPH conventions
         output[i] = Tout(2 * nodeMax);
-    }
+    });
 }
 
 } // namespace cstone
@@ -41,12 +41,14 @@
 
 #pragma once
 
+#include <stdexcept>
 #include <vector>
 
 #include "cstone/domain/domaindecomp.hpp"
 #include "cstone/halos/boxoverlap.hpp"
 #include "cstone/util/gsl-lite.hpp"
 #include "cstone/util/index_ranges.hpp"
+#include "cstone/util/tracing.hpp"
 
 #include "macs.hpp"
 #include "octree_internal.hpp"
@@ -101,9 +103,9 @@ std::vector<IndexPair<TreeNodeIndex>> findRequestIndices(gsl::span<const int> pe
  * @return the output ranges that cover everything within [first:last]
  *         that the input ranges did not cover
  */
-std::vector<IndexPair<TreeNodeIndex>> invertRanges(TreeNodeIndex first,
-                                                   gsl::span<const IndexPair<TreeNodeIndex>> ranges,
-                                                   TreeNodeIndex last)
+inline std::vector<IndexPair<TreeNodeIndex>> invertRanges(TreeNodeIndex first,
+                                                          gsl::span<const IndexPair<TreeNodeIndex>> ranges,
+                                                          TreeNodeIndex last)
 {
     assert(!ranges.empty() && std::is_sorted(ranges.begin(), ranges.end()));
 
@@ -207,15 +209,16 @@ bool rebalanceDecisionEssential(const KeyType* cstoneTree, TreeNodeIndex numInte
     return converged;
 }
 
+template<class KeyType>
 struct NoPeerExchange
 {
-    template<class KeyType>
-    void operator()(gsl::span<const int>, gsl::span<const IndexPair<TreeNodeIndex>>,
-                    gsl::span<const KeyType>, gsl::span<unsigned>,
-                    gsl::span<KeyType>, gsl::span<unsigned>)
+    void operator()(gsl::span<const int>, gsl::span<const IndexPair<TreeNodeIndex>>, gsl::span<const KeyType>,
+                    gsl::span<unsigned>)
     {
         throw std::runtime_error("FocusTree without MPI communication cannot perform a global update\n");
     }
+
+    void setCompression(bool) {}
 };
 
 namespace focused_octree_detail
@@ -223,33 +226,40 @@ namespace focused_octree_detail
     struct NoCommTag {};
 }
 
-template<class, class = void>
+template<class, class, class = void>
 struct ExchangePeerCounts
 {};
 
-template<class CommunicationType>
-struct ExchangePeerCounts<CommunicationType, std::enable_if_t<std::is_same_v<focused_octree_detail::NoCommTag, CommunicationType>>>
+template<class KeyType, class CommunicationType>
+struct ExchangePeerCounts<KeyType, CommunicationType,
+                          std::enable_if_t<std::is_same_v<focused_octree_detail::NoCommTag, CommunicationType>>>
 {
-    using type = NoPeerExchange;
+    using type = NoPeerExchange<KeyType>;
 };
 
-template<class CommunicationType>
-using ExchangePeerCounts_t = typename ExchangePeerCounts<CommunicationType>::type;
+template<class KeyType, class CommunicationType>
+using ExchangePeerCounts_t = typename ExchangePeerCounts<KeyType, CommunicationType>::type;
 
 
 /*! @brief a fully traversable octree with a local focus
  *
- * @tparam KeyType             32- or 64-bit unsigned integer
+ * @tparam SfcKind             32- or 64-bit unsigned integer to use Morton keys,
+ *                             or MortonKey/HilbertKey<32- or 64-bit unsigned>, see sfc.hpp
  * @tparam CommunicationType   NoCommTag or MpiCommTag to enable updateGlobal
+ * @tparam MacTag              MinDistanceMacTag or VectorMacTag, the MAC that determines the resolution
+ *                             outside the focus. The vector MAC uses expansion centers computed from
+ *                             the local particles, nodes without local particles use their geometric center.
  *
  * This class is not intended for direct use. Instead use the type aliases
  * FocusedOctreeSingleNode or FocusedOctree.
  *
  * The focus area can dynamically change.
  */
-template<class KeyType, class CommunicationType>
+template<class SfcKind, class CommunicationType, class MacTag = MinDistanceMacTag>
 class FocusedOctreeImpl
 {
+    using KeyType = SfcKeyType_t<SfcKind>;
+
 public:
 
     /*! @brief constructor
@@ -282,8 +292,21 @@ public:
     template<class T>
     bool update(const Box<T>& box, gsl::span<const KeyType> particleKeys, KeyType focusStart, KeyType focusEnd)
     {
-        assert(std::is_sorted(particleKeys.begin(), particleKeys.end()));
+        bool converged = updateTree(box, focusStart, focusEnd);
+        updateCounts(box, particleKeys, focusStart, focusEnd);
+        return converged;
+    }
 
+    /*! @brief first part of update: the steps that do not depend on the particles
+     *
+     * Rebalances the tree based on the previous node counts and MAC evaluations and evaluates the
+     * min-distance MAC for the new tree. Can be called while the particle keys are not yet known,
+     * but has to be followed by updateCounts before the tree is used.
+     */
+    template<class T>
+    bool updateTree(const Box<T>& box, KeyType focusStart, KeyType focusEnd)
+    {
+        CSTONE_TRACE_RANGE("FocusedOctree::updateTree");
         gsl::span<const KeyType> leaves = tree_.treeLeaves();
 
         TreeNodeIndex firstFocusNode = findNodeBelow(leaves, focusStart);
@@ -295,20 +318,41 @@ public:
                                                     bucketSize_, nodeOps.data());
         std::vector<KeyType> newLeaves;
         rebalanceTree(leaves, newLeaves, nodeOps.data());
-        tree_.update(std::move(newLeaves));
-
-        // tree update invalidates the view, need to update it
-        leaves = tree_.treeLeaves();
+        tree_.update(std::move(newLeaves), nodeOps.data());
 
         macs_.resize(tree_.numTreeNodes());
-        markMac(tree_, box, focusStart, focusEnd, 1.0/(theta_*theta_), macs_.data());
+        if constexpr (!std::is_same_v<MacTag, VectorMacTag>)
+        {
+            macMarker_.markMac(tree_, box, focusStart, focusEnd, 1.0/(theta_*theta_), macs_.data());
+        }
+
+        return converged;
+    }
+
+    /*! @brief second part of update: compute the local node counts and, for the vector MAC, the MAC evaluations
+     *
+     * @param particleKeys    locally present particle SFC keys, sorted
+     */
+    template<class T>
+    void updateCounts(const Box<T>& box, gsl::span<const KeyType> particleKeys, KeyType focusStart, KeyType focusEnd)
+    {
+        assert(std::is_sorted(particleKeys.begin(), particleKeys.end()));
+
+        gsl::span<const KeyType> leaves = tree_.treeLeaves();
+
+        if constexpr (std::is_same_v<MacTag, VectorMacTag>)
+        {
+            std::vector<ExpansionCenter<T>> centers(tree_.numTreeNodes());
+            computeExpansionCenters<T, KeyType, SfcKind>(tree_, particleKeys.data(), particleKeys.size(), box,
+                                                         centers.data());
+            markMac<T, KeyType, SfcKind, MacTag>(tree_, box, focusStart, focusEnd, 1.0/(theta_*theta_), macs_.data(),
+                                                 centers.data());
+        }
 
         counts_.resize(tree_.numLeafNodes());
         // local node counts
         computeNodeCounts(leaves.data(), counts_.data(), nNodes(leaves), particleKeys.data(), particleKeys.data() + particleKeys.size(),
                           std::numeric_limits<unsigned>::max(), true);
-
-        return converged;
     }
 
     /*! @brief perform a global update of the tree structure
@@ -341,19 +385,37 @@ public:
                       const SpaceCurveAssignment& assignment, gsl::span<const KeyType> globalTreeLeaves,
                       gsl::span<const unsigned> globalCounts)
     {
+        CSTONE_TRACE_RANGE("FocusedOctree::updateGlobal");
+        KeyType focusStart = globalTreeLeaves[assignment.firstNodeIdx(myRank)];
+        KeyType focusEnd   = globalTreeLeaves[assignment.lastNodeIdx(myRank)];
+
+        bool converged = updateTree(box, focusStart, focusEnd);
+        updateGlobalCounts(box, particleKeys, myRank, peerRanks, assignment, globalTreeLeaves, globalCounts);
+
+        return converged;
+    }
+
+    /*! @brief second part of updateGlobal, to be called after updateTree
+     *
+     * Computes the local node counts and the MACs as in updateCounts, then adds the node counts from peer ranks
+     * and the global tree on top. Arguments as in updateGlobal.
+     */
+    template<class T>
+    void updateGlobalCounts(const Box<T>& box, gsl::span<const KeyType> particleKeys, int myRank,
+                            gsl::span<const int> peerRanks, const SpaceCurveAssignment& assignment,
+                            gsl::span<const KeyType> globalTreeLeaves, gsl::span<const unsigned> globalCounts)
+    {
+        CSTONE_TRACE_RANGE("FocusedOctree::updateGlobalCounts");
         KeyType focusStart = globalTreeLeaves[assignment.firstNodeIdx(myRank)];
         KeyType focusEnd   = globalTreeLeaves[assignment.lastNodeIdx(myRank)];
 
         assert(particleKeys.front() >= focusStart && particleKeys.back() < focusEnd);
 
-        bool converged = update(box, particleKeys, focusStart, focusEnd);
+        updateCounts(box, particleKeys, focusStart, focusEnd);
 
         auto requestIndices = findRequestIndices(peerRanks, assignment, globalTreeLeaves, tree_.treeLeaves());
 
-        std::vector<KeyType>  tmpLeaves(tree_.numLeafNodes() + 1);
-        std::vector<unsigned> tmpCounts(tree_.numLeafNodes());
-        ExchangePeerCounts_t<CommunicationType>{}.template operator()<KeyType>
-            (peerRanks, requestIndices, tree_.treeLeaves(), counts_, tmpLeaves, tmpCounts);
+        peerExchange_(peerRanks, requestIndices, tree_.treeLeaves(), counts_);
 
         TreeNodeIndex firstFocusNode = findNodeAbove(treeLeaves(), focusStart);
         TreeNodeIndex lastFocusNode  = findNodeBelow(treeLeaves(), focusEnd);
@@ -373,8 +435,6 @@ public:
             countRequestParticles(globalTreeLeaves, globalCounts, treeLeaves().subspan(ip.start(), ip.count() + 1),
                                   gsl::span<unsigned>(counts_.data() + ip.start(), ip.count()));
         }
-
-        return converged;
     }
 
     //! @brief returns a view of the tree leaves
@@ -383,7 +443,59 @@ public:
     //! @brief returns a view of the leaf particle counts
     [[nodiscard]] gsl::span<const unsigned> leafCounts() const { return counts_; }
 
-    gsl::span<const BinaryNode<KeyType>> binaryTree() const { return tree_.binaryTree(); }
+    //! @brief the focused octree, including the internal part
+    const Octree<KeyType>& octree() const { return tree_; }
+
+    //! @brief change the maximum number of particles per leaf inside the focus, takes effect with the next update
+    void setBucketSize(unsigned bucketSize) { bucketSize_ = bucketSize; }
+
+    //! @brief change the opening angle of the refinement criterion, takes effect with the next update
+    void setTheta(float theta) { theta_ = theta; }
+
+    //! @brief send variable-length encoded node structures and counts in the peer count exchanges of updateCounts
+    void setCompression(bool enable) { peerExchange_.setCompression(enable); }
+
+    //! @brief the functor that exchanges counts with peer ranks in updateCounts, e.g. to set its communicator
+    ExchangePeerCounts_t<KeyType, CommunicationType>& peerExchange() { return peerExchange_; }
+
+    /*! @brief returns the MAC evaluations of the last update in the node order of an octree built from treeLeaves()
+     *
+     * The node order of octree() depends on the sequence of updates that produced it,
+     * the order of a tree that is constructed from the leaves in a single step does not.
+     */
+    [[nodiscard]] std::vector<char> canonicalMacs() const
+    {
+        Octree<KeyType> canonical;
+        canonical.update(std::vector<KeyType>(treeLeaves().begin(), treeLeaves().end()));
+
+        std::vector<char> markings(canonical.numTreeNodes());
+        #pragma omp parallel for schedule(static)
+        for (TreeNodeIndex i = 0; i < canonical.numTreeNodes(); ++i)
+        {
+            markings[i] = macs_[tree_.locate(canonical.codeStart(i), canonical.codeEnd(i))];
+        }
+        return markings;
+    }
+
+    /*! @brief replace the tree with a state returned by treeLeaves(), leafCounts() and canonicalMacs()
+     *
+     * @param leaves   cornerstone leaves
+     * @param counts   particle counts of @p leaves
+     * @param macs     MAC evaluations in the node order of an octree constructed from @p leaves
+     *
+     * The next update proceeds as if it followed the update that produced the provided state.
+     */
+    void restore(std::vector<KeyType>&& leaves, std::vector<unsigned>&& counts, std::vector<char>&& macs)
+    {
+        tree_.update(std::move(leaves));
+        if (counts.size() != std::size_t(tree_.numLeafNodes()) || macs.size() != std::size_t(tree_.numTreeNodes()))
+        {
+            throw std::runtime_error("focused tree state has inconsistent sizes\n");
+        }
+        counts_    = std::move(counts);
+        macs_      = std::move(macs);
+        macMarker_ = IncrementalMacMarker<KeyType, SfcKind>{};
+    }
 
 private:
 
@@ -398,10 +510,14 @@ private:
     std::vector<unsigned> counts_;
     //! @brief mac evaluation result relative to focus area (pass or fail)
     std::vector<char> macs_;
+    //! @brief reuses MAC evaluations of the previous update for nodes that did not change
+    IncrementalMacMarker<KeyType, SfcKind> macMarker_;
+    //! @brief exchanges counts with peer ranks in updateGlobal, keeps its buffers between calls
+    ExchangePeerCounts_t<KeyType, CommunicationType> peerExchange_;
 };
 
 //! @brief Focused octree type for use without MPI (e.g. in unit tests)
-template<class KeyType>
-using FocusedOctreeSingleNode = FocusedOctreeImpl<KeyType, focused_octree_detail::NoCommTag>;
+template<class SfcKind, class MacTag = MinDistanceMacTag>
+using FocusedOctreeSingleNode = FocusedOctreeImpl<SfcKind, focused_octree_detail::NoCommTag, MacTag>;
 
 } // namespace cstone
\ No newline at end of file
@@ -0,0 +1,453 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Device-resident locally essential octree
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * GPU counterpart of FocusedOctree. The tree leaves, the internal tree, the leaf counts and the MAC flags are
+ * kept in device memory and the complete update/updateGlobal cycle runs on the GPU. Only the node structures and
+ * particle counts exchanged with peer ranks are staged through host buffers.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <mpi.h>
+
+#include <thrust/binary_search.h>
+#include <thrust/copy.h>
+#include <thrust/device_vector.h>
+#include <thrust/execution_policy.h>
+#include <thrust/scan.h>
+
+#include "cstone/primitives/mpi_wrappers.hpp"
+#include "cstone/util/tracing.hpp"
+#include "cstone/util/util.hpp"
+#include "macs.cuh"
+#include "octree.cuh"
+#include "octree_focus.hpp"
+#include "octree_internal.cuh"
+
+namespace cstone
+{
+
+//! @brief see rebalanceDecisionEssential, one thread per leaf
+template<class KeyType>
+__global__ void rebalanceDecisionEssentialKernel(const KeyType* cstoneTree, TreeNodeIndex numInternalNodes,
+                                                 TreeNodeIndex numLeafNodes, const TreeNodeIndex* leafParents,
+                                                 const unsigned* leafCounts, const char* macs,
+                                                 TreeNodeIndex firstFocusNode, TreeNodeIndex lastFocusNode,
+                                                 unsigned bucketSize, TreeNodeIndex* nodeOps, int* changeCounter)
+{
+    TreeNodeIndex leafIdx = blockDim.x * blockIdx.x + threadIdx.x;
+    if (leafIdx < numLeafNodes)
+    {
+        int opDecision = mergeCountAndMacOp(leafIdx, cstoneTree, numInternalNodes, leafParents, leafCounts, macs,
+                                            firstFocusNode, lastFocusNode, bucketSize);
+        // concurrent threads only ever store the same value
+        if (opDecision != 1) { *changeCounter = 1; }
+
+        nodeOps[leafIdx] = opDecision;
+    }
+}
+
+/*! @brief see countRequestParticles, one thread per requested node
+ *
+ * @param[in]  leaves         cornerstone leaves of the counted tree, length @p numLeaves + 1
+ * @param[in]  numLeaves      number of leaves
+ * @param[in]  counts         particle counts of @p leaves
+ * @param[in]  requestLeaves  keys of the requested nodes, length @p numRequests + 1
+ * @param[in]  numRequests    number of requested nodes
+ * @param[out] requestCounts  particle counts of the requested nodes
+ */
+template<class KeyType>
+__global__ void countRequestParticlesKernel(const KeyType* leaves, TreeNodeIndex numLeaves, const unsigned* counts,
+                                            const KeyType* requestLeaves, TreeNodeIndex numRequests,
+                                            unsigned* requestCounts)
+{
+    TreeNodeIndex i = blockDim.x * blockIdx.x + threadIdx.x;
+    if (i >= numRequests) { return; }
+
+    TreeNodeIndex startIdx = stl::upper_bound(leaves, leaves + numLeaves + 1, requestLeaves[i]) - leaves - 1;
+    TreeNodeIndex endIdx   = stl::lower_bound(leaves, leaves + numLeaves + 1, requestLeaves[i + 1]) - leaves;
+
+    unsigned count = 0;
+    for (TreeNodeIndex j = startIdx; j < endIdx; ++j)
+    {
+        count += counts[j];
+    }
+    requestCounts[i] = count;
+}
+
+//! @brief device version of countRequestParticles, all arguments in device memory
+template<class KeyType>
+void countRequestParticlesGpu(const KeyType* leaves, TreeNodeIndex numLeaves, const unsigned* counts,
+                              const KeyType* requestLeaves, TreeNodeIndex numRequests, unsigned* requestCounts)
+{
+    constexpr unsigned numThreads = 256;
+    if (numRequests == 0) { return; }
+
+    countRequestParticlesKernel<<<iceil(numRequests, numThreads), numThreads>>>(leaves, numLeaves, counts,
+                                                                                requestLeaves, numRequests,
+                                                                                requestCounts);
+}
+
+/*! @brief exchange particle counts of device-resident focused trees with peer ranks
+ *
+ * Same protocol as exchangePeerCounts. The requested node structures and the answers are copied between device
+ * and host buffers, counting the particles of the node structures received from peers happens on the device.
+ * The buffers are kept between calls.
+ */
+template<class KeyType>
+class MpiPeerExchangeGpu
+{
+public:
+    /*! @brief exchange counts
+     *
+     * @param[in]    peerRanks        list of peer rank IDs
+     * @param[in]    exchangeIndices  one range of leaf indices to request counts for from each peer rank
+     * @param[in]    localLeaves      device cornerstone leaves of the focused tree, length @p numLeaves + 1
+     * @param[in]    numLeaves        number of leaves
+     * @param[inout] localCounts      device leaf counts, the ranges in @p exchangeIndices are overwritten
+     */
+    void operator()(gsl::span<const int> peerRanks, gsl::span<const IndexPair<TreeNodeIndex>> exchangeIndices,
+                    const KeyType* localLeaves, TreeNodeIndex numLeaves, unsigned* localCounts)
+    {
+        CSTONE_TRACE_RANGE("exchangePeerCountsGpu");
+        int queryTag  = nextTagEpoch(comm_, ExchangeKind::peerCounts);
+        int answerTag = queryTag + 1;
+
+        std::size_t numPeers = peerRanks.size();
+        requestLeaves_.resize(numPeers);
+        receivedCounts_.resize(numPeers);
+        queryLeaves_.resize(numPeers);
+        answers_.resize(numPeers);
+        queryRequests_.assign(numPeers, MPI_REQUEST_NULL);
+        requests_.clear();
+
+        for (std::size_t i = 0; i < numPeers; ++i)
+        {
+            receivedCounts_[i].resize(exchangeIndices[i].count());
+            requests_.push_back(MPI_Request{});
+            MPI_Irecv(receivedCounts_[i].data(), exchangeIndices[i].count(), MPI_UNSIGNED, peerRanks[i], answerTag,
+                      comm_, &requests_.back());
+        }
+
+        // a peer cannot request a node structure with a higher resolution than the local tree
+        for (std::size_t i = 0; i < numPeers; ++i)
+        {
+            if (queryLeaves_[i].size() < std::size_t(numLeaves + 1)) { queryLeaves_[i].resize(numLeaves + 1); }
+            MPI_Irecv(queryLeaves_[i].data(), numLeaves + 1, MpiType<KeyType>{}, peerRanks[i], queryTag,
+                      comm_, &queryRequests_[i]);
+        }
+
+        for (std::size_t i = 0; i < numPeers; ++i)
+        {
+            // +1 to include the upper key boundary for the last node
+            TreeNodeIndex sendCount = exchangeIndices[i].count() + 1;
+            requestLeaves_[i].resize(sendCount);
+            thrust::copy(thrust::device_pointer_cast(localLeaves + exchangeIndices[i].start()),
+                         thrust::device_pointer_cast(localLeaves + exchangeIndices[i].start() + sendCount),
+                         requestLeaves_[i].begin());
+            requests_.push_back(MPI_Request{});
+            MPI_Isend(requestLeaves_[i].data(), sendCount, MpiType<KeyType>{}, peerRanks[i], queryTag,
+                      comm_, &requests_.back());
+        }
+
+        for (std::size_t numMessages = 0; numMessages < numPeers; ++numMessages)
+        {
+            int peerIndex;
+            MPI_Status status;
+            MPI_Waitany(int(numPeers), queryRequests_.data(), &peerIndex, &status);
+            int numKeys;
+            MPI_Get_count(&status, MpiType<KeyType>{}, &numKeys);
+
+            d_query_.resize(numKeys);
+            d_answer_.resize(numKeys - 1);
+            thrust::copy(queryLeaves_[peerIndex].begin(), queryLeaves_[peerIndex].begin() + numKeys,
+                         d_query_.begin());
+            countRequestParticlesGpu(localLeaves, numLeaves, localCounts, thrust::raw_pointer_cast(d_query_.data()),
+                                     numKeys - 1, thrust::raw_pointer_cast(d_answer_.data()));
+
+            answers_[peerIndex].resize(numKeys - 1);
+            thrust::copy(d_answer_.begin(), d_answer_.end(), answers_[peerIndex].begin());
+
+            requests_.push_back(MPI_Request{});
+            MPI_Isend(answers_[peerIndex].data(), numKeys - 1, MPI_UNSIGNED, peerRanks[peerIndex], answerTag,
+                      comm_, &requests_.back());
+        }
+
+        MPI_Waitall(int(requests_.size()), requests_.data(), MPI_STATUSES_IGNORE);
+
+        for (std::size_t i = 0; i < numPeers; ++i)
+        {
+            thrust::copy(receivedCounts_[i].begin(), receivedCounts_[i].end(),
+                         thrust::device_pointer_cast(localCounts + exchangeIndices[i].start()));
+        }
+    }
+
+    //! @brief the communicator in which the peer ranks are numbered
+    void setCommunicator(MPI_Comm comm) { comm_ = comm; }
+
+private:
+    MPI_Comm comm_{MPI_COMM_WORLD};
+    //! @brief node structures sent to the peers, need to stay alive until the sends have completed
+    std::vector<std::vector<KeyType>> requestLeaves_;
+    //! @brief answers received from the peers
+    std::vector<std::vector<unsigned>> receivedCounts_;
+    //! @brief node structures received from the peers
+    std::vector<std::vector<KeyType>> queryLeaves_;
+    //! @brief answers sent to the peers
+    std::vector<std::vector<unsigned>> answers_;
+    std::vector<MPI_Request> queryRequests_;
+    std::vector<MPI_Request> requests_;
+
+    thrust::device_vector<KeyType>  d_query_;
+    thrust::device_vector<unsigned> d_answer_;
+};
+
+/*! @brief a fully traversable octree with a local focus in device memory
+ *
+ * @tparam SfcKind  32- or 64-bit unsigned integer to use Morton keys,
+ *                  or MortonKey/HilbertKey<32- or 64-bit unsigned>, see sfc.hpp
+ *
+ * Device counterpart of FocusedOctree with the min-distance MAC. The resulting tree leaves and counts are
+ * identical to those of FocusedOctree for the same inputs. The internal tree is rebuilt on each update with
+ * OctreeGpu, such that its node order may differ from FocusedOctree::octree().
+ */
+template<class SfcKind>
+class FocusedOctreeGpu
+{
+    using KeyType = SfcKeyType_t<SfcKind>;
+
+public:
+    //! @brief see FocusedOctreeImpl
+    FocusedOctreeGpu(unsigned bucketSize, float theta)
+        : bucketSize_(bucketSize)
+        , theta_(theta)
+        , counts_(1, bucketSize + 1)
+        , macs_(1, 1)
+        , changeCounter_(1)
+    {
+        std::vector<KeyType> rootLeaves{0, nodeRange<KeyType>(0)};
+        tree_.update(thrust::device_vector<KeyType>(rootLeaves.begin(), rootLeaves.end()));
+    }
+
+    /*! @brief perform a local update step, see FocusedOctreeImpl::update
+     *
+     * @param particleKeys   locally present particle SFC keys, sorted, device memory
+     */
+    template<class T>
+    bool update(const Box<T>& box, gsl::span<const KeyType> particleKeys, KeyType focusStart, KeyType focusEnd)
+    {
+        bool converged = updateTree(box, focusStart, focusEnd);
+        updateCounts(particleKeys);
+        return converged;
+    }
+
+    //! @brief rebalance the tree based on the previous counts and MACs, then evaluate the MAC for the new tree
+    template<class T>
+    bool updateTree(const Box<T>& box, KeyType focusStart, KeyType focusEnd)
+    {
+        CSTONE_TRACE_RANGE("FocusedOctreeGpu::updateTree");
+        constexpr unsigned numThreads = 256;
+
+        TreeNodeIndex numLeafNodes   = tree_.numLeafNodes();
+        TreeNodeIndex firstFocusNode = findNodeBelowGpu(focusStart);
+        TreeNodeIndex lastFocusNode  = findNodeAboveGpu(focusEnd);
+
+        nodeOps_.resize(numLeafNodes + 1);
+        thrust::fill(changeCounter_.begin(), changeCounter_.end(), 0);
+        rebalanceDecisionEssentialKernel<<<iceil(numLeafNodes, numThreads), numThreads>>>(
+            tree_.treeLeaves(), tree_.numInternalNodes(), numLeafNodes, tree_.leafParents(),
+            thrust::raw_pointer_cast(counts_.data()), thrust::raw_pointer_cast(macs_.data()), firstFocusNode,
+            lastFocusNode, bucketSize_, thrust::raw_pointer_cast(nodeOps_.data()),
+            thrust::raw_pointer_cast(changeCounter_.data()));
+        bool converged = changeCounter_[0] == 0;
+
+        // rebalance the leaves, see rebalanceTree
+        thrust::exclusive_scan(thrust::device, nodeOps_.begin(), nodeOps_.end(), nodeOps_.begin());
+        TreeNodeIndex numNewLeaves = nodeOps_.back();
+        newLeaves_.resize(numNewLeaves + 1);
+
+        TreeNodeIndex numElements = stl::max(numLeafNodes, numNewLeaves);
+        processNodes<<<iceil(numElements + 1, numThreads), numThreads>>>(
+            tree_.treeLeaves(), thrust::raw_pointer_cast(nodeOps_.data()), numLeafNodes, numNewLeaves,
+            thrust::raw_pointer_cast(newLeaves_.data()));
+
+        // swaps the old leaves into newLeaves_, which are reused as buffer in the next update
+        tree_.update(std::move(newLeaves_));
+
+        macs_.resize(tree_.numTreeNodes());
+        markMacGpu<T, KeyType, SfcKind>(tree_.data(), box, focusStart, focusEnd, 1.0f / (theta_ * theta_),
+                                        thrust::raw_pointer_cast(macs_.data()));
+
+        return converged;
+    }
+
+    //! @brief compute the local leaf counts from sorted device @p particleKeys, to be called after updateTree
+    void updateCounts(gsl::span<const KeyType> particleKeys)
+    {
+        counts_.resize(tree_.numLeafNodes());
+        computeNodeCountsGpu(tree_.treeLeaves(), thrust::raw_pointer_cast(counts_.data()), tree_.numLeafNodes(),
+                             particleKeys.data(), particleKeys.data() + particleKeys.size(),
+                             std::numeric_limits<unsigned>::max(), true, nodeOps_);
+    }
+
+    /*! @brief perform a global update of the tree structure, see FocusedOctreeImpl::updateGlobal
+     *
+     * @param[in] box                global coordinate bounding box
+     * @param[in] particleKeys       sorted SFC keys of the local particles, device memory
+     * @param[in] myRank             ID of the executing rank
+     * @param[in] peerRanks          list of peer ranks, see findPeersMac
+     * @param[in] assignment         assignment of the global leaf tree to ranks
+     * @param[in] globalTreeLeaves   global cornerstone leaf tree, host memory
+     * @param[in] globalTreeLeavesGpu  device copy of @p globalTreeLeaves
+     * @param[in] globalCountsGpu    global leaf tree counts, device memory
+     * @return                       true if the tree structure did not change
+     */
+    template<class T>
+    bool updateGlobal(const Box<T>& box, gsl::span<const KeyType> particleKeys, int myRank,
+                      gsl::span<const int> peerRanks, const SpaceCurveAssignment& assignment,
+                      gsl::span<const KeyType> globalTreeLeaves, const KeyType* globalTreeLeavesGpu,
+                      const unsigned* globalCountsGpu)
+    {
+        CSTONE_TRACE_RANGE("FocusedOctreeGpu::updateGlobal");
+        KeyType focusStart = globalTreeLeaves[assignment.firstNodeIdx(myRank)];
+        KeyType focusEnd   = globalTreeLeaves[assignment.lastNodeIdx(myRank)];
+
+        bool converged = updateTree(box, focusStart, focusEnd);
+        updateGlobalCounts(particleKeys, myRank, peerRanks, assignment, globalTreeLeaves, globalTreeLeavesGpu,
+                           globalCountsGpu);
+
+        return converged;
+    }
+
+    //! @brief second part of updateGlobal, to be called after updateTree, arguments as in updateGlobal
+    void updateGlobalCounts(gsl::span<const KeyType> particleKeys, int myRank, gsl::span<const int> peerRanks,
+                            const SpaceCurveAssignment& assignment, gsl::span<const KeyType> globalTreeLeaves,
+                            const KeyType* globalTreeLeavesGpu, const unsigned* globalCountsGpu)
+    {
+        CSTONE_TRACE_RANGE("FocusedOctreeGpu::updateGlobalCounts");
+        KeyType focusStart = globalTreeLeaves[assignment.firstNodeIdx(myRank)];
+        KeyType focusEnd   = globalTreeLeaves[assignment.lastNodeIdx(myRank)];
+
+        updateCounts(particleKeys);
+
+        // only fully contained nodes in the peer SFC ranges are requested, see findRequestIndices
+        std::vector<IndexPair<TreeNodeIndex>> requestIndices;
+        requestIndices.reserve(peerRanks.size() + 1);
+        for (int peer : peerRanks)
+        {
+            TreeNodeIndex firstRequestIdx = findNodeAboveGpu(globalTreeLeaves[assignment.firstNodeIdx(peer)]);
+            TreeNodeIndex lastRequestIdx  = findNodeBelowGpu(globalTreeLeaves[assignment.lastNodeIdx(peer)]);
+            if (lastRequestIdx < firstRequestIdx) { lastRequestIdx = firstRequestIdx; }
+            requestIndices.emplace_back(firstRequestIdx, lastRequestIdx);
+        }
+
+        peerExchange_(peerRanks, requestIndices, tree_.treeLeaves(), tree_.numLeafNodes(),
+                      thrust::raw_pointer_cast(counts_.data()));
+
+        // all leaves that are neither in the focus nor requested from peers get their counts from the global tree
+        requestIndices.emplace_back(findNodeAboveGpu(focusStart), findNodeBelowGpu(focusEnd));
+        std::sort(requestIndices.begin(), requestIndices.end());
+        auto globalCountIndices = invertRanges(0, requestIndices, tree_.numLeafNodes());
+
+        TreeNodeIndex numGlobalLeaves = TreeNodeIndex(globalTreeLeaves.size()) - 1;
+        for (auto ip : globalCountIndices)
+        {
+            countRequestParticlesGpu(globalTreeLeavesGpu, numGlobalLeaves, globalCountsGpu,
+                                     tree_.treeLeaves() + ip.start(), ip.count(),
+                                     thrust::raw_pointer_cast(counts_.data()) + ip.start());
+        }
+    }
+
+    //! @brief the tree leaves, device memory, length numLeafNodes() + 1
+    [[nodiscard]] const KeyType* treeLeaves() const { return tree_.treeLeaves(); }
+
+    [[nodiscard]] TreeNodeIndex numLeafNodes() const { return tree_.numLeafNodes(); }
+
+    //! @brief the leaf particle counts, device memory
+    [[nodiscard]] const unsigned* leafCounts() const { return thrust::raw_pointer_cast(counts_.data()); }
+
+    //! @brief MAC evaluations of the last update in the node order of octree(), device memory
+    [[nodiscard]] const char* macs() const { return thrust::raw_pointer_cast(macs_.data()); }
+
+    //! @brief the focused octree, including the internal part
+    [[nodiscard]] const OctreeGpu<KeyType>& octree() const { return tree_; }
+
+    //! @brief see FocusedOctreeImpl::setBucketSize
+    void setBucketSize(unsigned bucketSize) { bucketSize_ = bucketSize; }
+
+    //! @brief see FocusedOctreeImpl::setTheta
+    void setTheta(float theta) { theta_ = theta; }
+
+    //! @brief the communicator in which the peer ranks passed to updateCounts are numbered
+    void setCommunicator(MPI_Comm comm) { peerExchange_.setCommunicator(comm); }
+
+private:
+    //! @brief see findNodeBelow, the search runs on the device leaves
+    TreeNodeIndex findNodeBelowGpu(KeyType key) const
+    {
+        const KeyType* leaves = tree_.treeLeaves();
+        TreeNodeIndex numKeys = tree_.numLeafNodes() + 1;
+        return thrust::upper_bound(thrust::device, leaves, leaves + numKeys, key) - leaves - 1;
+    }
+
+    //! @brief see findNodeAbove, the search runs on the device leaves
+    TreeNodeIndex findNodeAboveGpu(KeyType key) const
+    {
+        const KeyType* leaves = tree_.treeLeaves();
+        TreeNodeIndex numKeys = tree_.numLeafNodes() + 1;
+        return thrust::lower_bound(thrust::device, leaves, leaves + numKeys, key) - leaves;
+    }
+
+    //! @brief max number of particles per node in focus
+    unsigned bucketSize_;
+    //! @brief opening angle refinement criterion
+    float theta_;
+
+    //! @brief the focused tree
+    OctreeGpu<KeyType> tree_;
+    //! @brief particle counts of the focused tree leaves
+    thrust::device_vector<unsigned> counts_;
+    //! @brief mac evaluation result relative to focus area (pass or fail)
+    thrust::device_vector<char> macs_;
+
+    //! @brief rebalance decisions per leaf, scanned in place, reused as temporary array by updateCounts
+    thrust::device_vector<TreeNodeIndex> nodeOps_;
+    //! @brief the rebalanced leaves, handed over to tree_
+    thrust::device_vector<KeyType> newLeaves_;
+    //! @brief non-zero if any leaf changed in the last rebalance
+    thrust::device_vector<int> changeCounter_;
+
+    MpiPeerExchangeGpu<KeyType> peerExchange_;
+};
+
+} // namespace cstone
@@ -37,15 +37,26 @@
 namespace cstone
 {
 
-struct MpiPeerExchange
+template<class KeyType>
+class MpiPeerExchange
 {
-    template <class KeyType>
+public:
     void operator()(gsl::span<const int> peerRanks, gsl::span<const IndexPair<TreeNodeIndex>> exchangeIndices,
-                    gsl::span<const KeyType> localLeaves, gsl::span<unsigned> localCounts,
-                    gsl::span<KeyType> queryLeafBuffer, gsl::span<unsigned> queryCountBuffer)
+                    gsl::span<const KeyType> localLeaves, gsl::span<unsigned> localCounts)
     {
-        exchangePeerCounts(peerRanks, exchangeIndices, localLeaves, localCounts, queryLeafBuffer, queryCountBuffer);
+        exchangePeerCounts(peerRanks, exchangeIndices, localLeaves, localCounts, buffers_, compress_, comm_);
     }
+
+    //! @brief variable-length encoded messages, see exchangePeerCounts
+    void setCompression(bool enable) { compress_ = enable; }
+
+    //! @brief the communicator in which the peer ranks are numbered
+    void setCommunicator(MPI_Comm comm) { comm_ = comm; }
+
+private:
+    MPI_Comm comm_{MPI_COMM_WORLD};
+    PeerCountBuffers<KeyType> buffers_;
+    bool compress_{false};
 };
 
 namespace focused_octree_detail
@@ -53,13 +64,14 @@ namespace focused_octree_detail
     struct MpiCommTag {};
 }
 
-template <class CommunicationType>
-struct ExchangePeerCounts<CommunicationType, std::enable_if_t<std::is_same_v<focused_octree_detail::MpiCommTag, CommunicationType>>>
+template<class KeyType, class CommunicationType>
+struct ExchangePeerCounts<KeyType, CommunicationType,
+                          std::enable_if_t<std::is_same_v<focused_octree_detail::MpiCommTag, CommunicationType>>>
 {
-    using type = MpiPeerExchange;
+    using type = MpiPeerExchange<KeyType>;
 };
 
-template<class KeyType>
-using FocusedOctree = FocusedOctreeImpl<KeyType, focused_octree_detail::MpiCommTag>;
+template<class SfcKind, class MacTag = MinDistanceMacTag>
+using FocusedOctree = FocusedOctreeImpl<SfcKind, focused_octree_detail::MpiCommTag, MacTag>;
 
 } // namespace cstone
@@ -32,6 +32,21 @@
 
 #pragma once
 
+#include <thrust/binary_search.h>
+#include <thrust/copy.h>
+#include <thrust/device_vector.h>
+#include <thrust/execution_policy.h>
+#include <thrust/fill.h>
+#include <thrust/functional.h>
+#include <thrust/host_vector.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/scan.h>
+#include <thrust/scatter.h>
+#include <thrust/sequence.h>
+#include <thrust/sort.h>
+
+#include "cstone/util/util.hpp"
+#include "btree.cuh"
 #include "octree_internal.hpp"
 
 namespace cstone {
@@ -47,4 +62,350 @@ __global__ void nodeDepthKernel(const OctreeNode<I>* octree, TreeNodeIndex nNode
     }
 }
 
-} // namespace cstone
\ No newline at end of file
+//! @brief flag binary nodes whose prefix length is divisible by 3, see createInternalOctreeCpu
+template<class KeyType>
+__global__ void octreeNodeFlagKernel(const BinaryNode<KeyType>* binaryTree, TreeNodeIndex nBinaryNodes,
+                                     TreeNodeIndex* prefixes)
+{
+    unsigned tid = blockDim.x * blockIdx.x + threadIdx.x;
+    if (tid < nBinaryNodes)
+    {
+        prefixes[tid] = (decodePrefixLength(binaryTree[tid].prefix) % 3 == 0) ? 1 : 0;
+    }
+    if (tid == nBinaryNodes)
+    {
+        prefixes[tid] = 0;
+    }
+}
+
+//! @brief compacted list of binary nodes that correspond to octree nodes, see createInternalOctreeCpu
+template<class Index>
+__global__ void octreeScatterMapKernel(const Index* prefixes, Index nBinaryNodes, Index* scatterMap)
+{
+    unsigned tid = blockDim.x * blockIdx.x + threadIdx.x;
+    if (tid < nBinaryNodes && prefixes[tid + 1] - prefixes[tid] == 1)
+    {
+        scatterMap[prefixes[tid]] = tid;
+    }
+}
+
+//! @brief see constructOctreeNode
+template<class KeyType>
+__global__ void constructOctreeNodesKernel(OctreeNode<KeyType>* internalOctree, const BinaryNode<KeyType>* binaryTree,
+                                           TreeNodeIndex nInternalOctreeNodes, const TreeNodeIndex* scatterMap,
+                                           const TreeNodeIndex* binaryToOctreeIndex, TreeNodeIndex* leafParents)
+{
+    unsigned tid = blockDim.x * blockIdx.x + threadIdx.x;
+    if (tid < nInternalOctreeNodes)
+    {
+        constructOctreeNode(internalOctree, binaryTree, tid, scatterMap, binaryToOctreeIndex, leafParents);
+    }
+}
+
+//! @brief see rewireInternal
+template<class KeyType>
+__global__ void rewireInternalKernel(const OctreeNode<KeyType>* oldNodes, const TreeNodeIndex* rewireMap,
+                                     TreeNodeIndex nInternalNodes, OctreeNode<KeyType>* newNodes)
+{
+    unsigned tid = blockDim.x * blockIdx.x + threadIdx.x;
+    if (tid < nInternalNodes)
+    {
+        rewireInternalElement(tid, oldNodes, rewireMap, newNodes);
+    }
+}
+
+//! @brief see rewireIndices
+template<class Index>
+__global__ void rewireIndicesKernel(const Index* input, const Index* rewireMap, Index nElements, Index* output)
+{
+    unsigned tid = blockDim.x * blockIdx.x + threadIdx.x;
+    if (tid < nElements)
+    {
+        output[tid] = rewireMap[input[tid]];
+    }
+}
+
+/*! @brief translate an internal binary radix tree into an internal octree on the GPU
+ *
+ * @tparam KeyType                   32- or 64-bit unsigned integer
+ * @param[in]  binaryTree      binary tree nodes, device memory
+ * @param[in]  nLeafNodes      number of octree leaf nodes used to construct @p binaryTree
+ * @param[out] internalOctree  output internal octree nodes, length = (@p numLeafNodes-1) / 7, device memory
+ * @param[out] leafParents     node index of the parent node for each leaf, length = @p numLeafNodes, device memory
+ * @param[-]   prefixes        temporary device storage, length = @p numLeafNodes
+ * @param[-]   scatterMap      temporary device storage, length = (@p numLeafNodes-1) / 7
+ */
+template<class KeyType>
+void createInternalOctreeGpu(const BinaryNode<KeyType>* binaryTree, TreeNodeIndex nLeafNodes,
+                             OctreeNode<KeyType>* internalOctree, TreeNodeIndex* leafParents,
+                             TreeNodeIndex* prefixes, TreeNodeIndex* scatterMap)
+{
+    constexpr unsigned nThreads = 256;
+
+    TreeNodeIndex nBinaryNodes         = nLeafNodes - 1;
+    TreeNodeIndex nInternalOctreeNodes = (nLeafNodes - 1) / 7;
+
+    octreeNodeFlagKernel<<<iceil(nBinaryNodes + 1, nThreads), nThreads>>>(binaryTree, nBinaryNodes, prefixes);
+    thrust::exclusive_scan(thrust::device, prefixes, prefixes + nBinaryNodes + 1, prefixes);
+
+    octreeScatterMapKernel<<<iceil(nBinaryNodes, nThreads), nThreads>>>(prefixes, nBinaryNodes, scatterMap);
+
+    if (nInternalOctreeNodes > 0)
+    {
+        constructOctreeNodesKernel<<<iceil(nInternalOctreeNodes, nThreads), nThreads>>>
+            (internalOctree, binaryTree, nInternalOctreeNodes, scatterMap, prefixes, leafParents);
+    }
+}
+
+/*! @brief calculates the tree node ordering for descending max leaf distance on the GPU
+ *
+ * @tparam KeyType                    32- or 64-bit integer
+ * @param[in]  octree           input array of OctreeNode<KeyType>, device memory
+ * @param[in]  nNodes           number of input octree nodes
+ * @param[out] ordering         output ordering, a permutation of [0:nNodes], device memory
+ * @param[out] nNodesPerLevel   number of nodes per value of farthest leaf distance, host memory
+ *                              length is maxTreeLevel<KeyType>{} (10 or 21)
+ * @param[-]   depths           temporary device storage, length = @p nNodes
+ * @param[-]   inverseOrdering  temporary device storage, length = @p nNodes
+ *
+ * See decreasingMaxDepthOrder. Only the maxTreeLevel<KeyType>{} node counts are copied to the host.
+ */
+template<class KeyType>
+void decreasingMaxDepthOrderGpu(const OctreeNode<KeyType>* octree, TreeNodeIndex nNodes, TreeNodeIndex* ordering,
+                                TreeNodeIndex* nNodesPerLevel, TreeNodeIndex* depths, TreeNodeIndex* inverseOrdering)
+{
+    constexpr unsigned nThreads = 256;
+
+    thrust::fill(thrust::device, depths, depths + nNodes, 0);
+    nodeDepthKernel<<<iceil(nNodes, nThreads), nThreads>>>(octree, nNodes, depths);
+
+    thrust::sequence(thrust::device, inverseOrdering, inverseOrdering + nNodes, 0);
+    thrust::sort_by_key(thrust::device, depths, depths + nNodes, inverseOrdering, thrust::greater<TreeNodeIndex>{});
+
+    // invert the gather-ordering to obtain the scatter-ordering
+    thrust::scatter(thrust::device, thrust::counting_iterator<TreeNodeIndex>(0),
+                    thrust::counting_iterator<TreeNodeIndex>(nNodes), inverseOrdering, ordering);
+
+    // count nodes per value of depth
+    thrust::device_vector<TreeNodeIndex> levels(maxTreeLevel<KeyType>{});
+    thrust::device_vector<TreeNodeIndex> lower(maxTreeLevel<KeyType>{});
+    thrust::device_vector<TreeNodeIndex> upper(maxTreeLevel<KeyType>{});
+    thrust::sequence(levels.begin(), levels.end(), 0);
+
+    thrust::lower_bound(thrust::device, depths, depths + nNodes, levels.begin(), levels.end(), lower.begin(),
+                        thrust::greater<TreeNodeIndex>{});
+    thrust::upper_bound(thrust::device, depths, depths + nNodes, levels.begin(), levels.end(), upper.begin(),
+                        thrust::greater<TreeNodeIndex>{});
+
+    thrust::host_vector<TreeNodeIndex> h_lower = lower;
+    thrust::host_vector<TreeNodeIndex> h_upper = upper;
+    for (TreeNodeIndex depth = 1; depth < maxTreeLevel<KeyType>{}; ++depth)
+    {
+        nNodesPerLevel[depth] = h_upper[depth] - h_lower[depth];
+    }
+}
+
+/*! @brief a non-owning view of an OctreeGpu, usable in device code
+ *
+ * Provides the same node accessors as Octree, see there for documentation.
+ */
+template<class KeyType>
+struct OctreeGpuDataView
+{
+    const KeyType*             leaves;
+    const OctreeNode<KeyType>* internalTree;
+    const TreeNodeIndex*       leafParents;
+    TreeNodeIndex              numLeafNodes;
+    TreeNodeIndex              numInternalNodes;
+
+    CUDA_HOST_DEVICE_FUN TreeNodeIndex numTreeNodes() const { return numLeafNodes + numInternalNodes; }
+
+    CUDA_HOST_DEVICE_FUN bool isLeaf(TreeNodeIndex node) const { return node >= numInternalNodes; }
+
+    CUDA_HOST_DEVICE_FUN bool isRoot(TreeNodeIndex node) const { return node == 0; }
+
+    CUDA_HOST_DEVICE_FUN TreeNodeIndex toInternal(TreeNodeIndex node) const { return node + numInternalNodes; }
+
+    CUDA_HOST_DEVICE_FUN TreeNodeIndex toLeaf(TreeNodeIndex node) const { return node - numInternalNodes; }
+
+    CUDA_HOST_DEVICE_FUN bool isLeafChild(TreeNodeIndex node, int octant) const
+    {
+        return isLeafIndex(internalTree[node].child[octant]);
+    }
+
+    CUDA_HOST_DEVICE_FUN TreeNodeIndex child(TreeNodeIndex node, int octant) const
+    {
+        TreeNodeIndex childIndex = internalTree[node].child[octant];
+        if (isLeafIndex(childIndex)) { childIndex = loadLeafIndex(childIndex) + numInternalNodes; }
+        return childIndex;
+    }
+
+    CUDA_HOST_DEVICE_FUN TreeNodeIndex childDirect(TreeNodeIndex node, int octant) const
+    {
+        TreeNodeIndex childIndex = internalTree[node].child[octant];
+        return isLeafIndex(childIndex) ? loadLeafIndex(childIndex) : childIndex;
+    }
+
+    CUDA_HOST_DEVICE_FUN TreeNodeIndex parent(TreeNodeIndex node) const
+    {
+        return (node < numInternalNodes) ? internalTree[node].parent : leafParents[node - numInternalNodes];
+    }
+
+    CUDA_HOST_DEVICE_FUN KeyType codeStart(TreeNodeIndex node) const
+    {
+        return (node < numInternalNodes) ? internalTree[node].prefix : leaves[node - numInternalNodes];
+    }
+
+    CUDA_HOST_DEVICE_FUN KeyType codeEnd(TreeNodeIndex node) const
+    {
+        return (node < numInternalNodes) ? internalTree[node].prefix + nodeRange<KeyType>(internalTree[node].level)
+                                         : leaves[node - numInternalNodes + 1];
+    }
+
+    CUDA_HOST_DEVICE_FUN int level(TreeNodeIndex node) const
+    {
+        return (node < numInternalNodes) ? internalTree[node].level
+                                         : treeLevel(leaves[node - numInternalNodes + 1] - leaves[node - numInternalNodes]);
+    }
+};
+
+/*! @brief device-resident counterpart of Octree
+ *
+ * @tparam KeyType  32- or 64-bit unsigned integer
+ *
+ * All tree data is kept in device memory and the complete update pipeline, including the max-depth ordering,
+ * runs on the GPU. Node accessors for use in kernels are provided by the view returned from data().
+ * Only the node counts per max-depth value are mirrored on the host.
+ */
+template<class KeyType>
+class OctreeGpu
+{
+public:
+    OctreeGpu() : nNodesPerLevel_(maxTreeLevel<KeyType>{}) {}
+
+    /*! @brief sets the leaves to the provided ones and updates the internal part based on them
+     *
+     * @param firstLeaf  first leaf, device memory
+     * @param lastLeaf   last leaf, device memory
+     */
+    void update(const KeyType* firstLeaf, const KeyType* lastLeaf)
+    {
+        assert(lastLeaf > firstLeaf);
+
+        reallocateGeometric(cstoneTree_, lastLeaf - firstLeaf);
+        thrust::copy(thrust::device, firstLeaf, lastLeaf, cstoneTree_.begin());
+
+        updateInternalTree();
+    }
+
+    //! @brief sets the leaves to the provided ones without a copy and updates the internal part
+    void update(thrust::device_vector<KeyType>&& newLeaves)
+    {
+        cstoneTree_.swap(newLeaves);
+        updateInternalTree();
+    }
+
+    //! @brief total number of nodes in the tree
+    [[nodiscard]] TreeNodeIndex numTreeNodes() const { return numLeafNodes() + numInternalNodes(); }
+
+    //! @brief number of nodes with given value of maxDepth, see Octree::numTreeNodes
+    [[nodiscard]] TreeNodeIndex numTreeNodes(int maxDepth) const
+    {
+        assert(maxDepth < maxTreeLevel<KeyType>{});
+        return nNodesPerLevel_[maxDepth];
+    }
+
+    //! @brief number of leaf nodes in the tree
+    [[nodiscard]] TreeNodeIndex numLeafNodes() const { return nNodes(cstoneTree_); }
+
+    //! @brief number of internal nodes in the tree, equal to (numLeafNodes()-1) / 7
+    [[nodiscard]] TreeNodeIndex numInternalNodes() const { return internalTree_.size(); }
+
+    //! @brief a view of the tree with node accessors for use in device code
+    [[nodiscard]] OctreeGpuDataView<KeyType> data() const
+    {
+        return {thrust::raw_pointer_cast(cstoneTree_.data()), thrust::raw_pointer_cast(internalTree_.data()),
+                thrust::raw_pointer_cast(leafParents_.data()), numLeafNodes(), numInternalNodes()};
+    }
+
+    //! @brief cornerstone leaves, device memory
+    [[nodiscard]] const KeyType* treeLeaves() const { return thrust::raw_pointer_cast(cstoneTree_.data()); }
+
+    //! @brief the internal part as binary radix nodes, device memory
+    [[nodiscard]] const BinaryNode<KeyType>* binaryTree() const { return thrust::raw_pointer_cast(binaryTree_.data()); }
+
+    //! @brief parent node index of each leaf, device memory
+    [[nodiscard]] const TreeNodeIndex* leafParents() const { return thrust::raw_pointer_cast(leafParents_.data()); }
+
+private:
+    //! @brief regenerates the internal tree based on (a changed) cstoneTree_, see Octree::updateInternalTree
+    void updateInternalTree()
+    {
+        constexpr unsigned nThreads = 256;
+
+        TreeNodeIndex numLeafNodes     = nNodes(cstoneTree_);
+        TreeNodeIndex numInternalNodes = (numLeafNodes - 1) / 7;
+
+        nNodesPerLevel_[0] = numLeafNodes;
+
+        reallocateGeometric(binaryTree_, numLeafNodes);
+        createBinaryTreeGpu(thrust::raw_pointer_cast(cstoneTree_.data()), numLeafNodes,
+                            thrust::raw_pointer_cast(binaryTree_.data()));
+
+        reallocateGeometric(preTree_, numInternalNodes);
+        reallocateGeometric(preLeafParents_, numLeafNodes);
+        reallocateGeometric(prefixes_, numLeafNodes);
+        reallocateGeometric(ordering_, numInternalNodes);
+        reallocateGeometric(depths_, numInternalNodes);
+
+        // ordering_ is not needed yet and serves as scatter map scratch space
+        createInternalOctreeGpu(thrust::raw_pointer_cast(binaryTree_.data()), numLeafNodes,
+                                thrust::raw_pointer_cast(preTree_.data()), thrust::raw_pointer_cast(preLeafParents_.data()),
+                                thrust::raw_pointer_cast(prefixes_.data()), thrust::raw_pointer_cast(ordering_.data()));
+
+        reallocateGeometric(internalTree_, numInternalNodes);
+        reallocateGeometric(leafParents_, numLeafNodes);
+
+        // internal tree is empty if a single leaf node is also the tree-root
+        if (numInternalNodes == 0)
+        {
+            thrust::fill(leafParents_.begin(), leafParents_.end(), 0);
+            // counts of a previous tree would translate into internal node ranges beyond the empty internal tree
+            std::fill(nNodesPerLevel_.begin() + 1, nNodesPerLevel_.end(), 0);
+            return;
+        }
+
+        // prefixes_ is no longer needed and serves as inverse ordering scratch space
+        decreasingMaxDepthOrderGpu(thrust::raw_pointer_cast(preTree_.data()), numInternalNodes,
+                                   thrust::raw_pointer_cast(ordering_.data()), nNodesPerLevel_.data(),
+                                   thrust::raw_pointer_cast(depths_.data()), thrust::raw_pointer_cast(prefixes_.data()));
+
+        rewireInternalKernel<<<iceil(numInternalNodes, nThreads), nThreads>>>
+            (thrust::raw_pointer_cast(preTree_.data()), thrust::raw_pointer_cast(ordering_.data()), numInternalNodes,
+             thrust::raw_pointer_cast(internalTree_.data()));
+
+        rewireIndicesKernel<<<iceil(numLeafNodes, nThreads), nThreads>>>
+            (thrust::raw_pointer_cast(preLeafParents_.data()), thrust::raw_pointer_cast(ordering_.data()), numLeafNodes,
+             thrust::raw_pointer_cast(leafParents_.data()));
+    }
+
+    //! @brief cornerstone octree, just the leaves
+    thrust::device_vector<KeyType>             cstoneTree_;
+    //! @brief indices into internalTree_ to store the parent index of each leaf
+    thrust::device_vector<TreeNodeIndex>       leafParents_;
+    //! @brief the internal tree
+    thrust::device_vector<OctreeNode<KeyType>> internalTree_;
+    //! @brief the internal part as binary radix nodes, precursor to internalTree_
+    thrust::device_vector<BinaryNode<KeyType>> binaryTree_;
+    //! @brief number of nodes for each value of maxDepth, see Octree
+    std::vector<TreeNodeIndex>                 nNodesPerLevel_;
+
+    //! @brief scratch space for updateInternalTree
+    thrust::device_vector<OctreeNode<KeyType>> preTree_;
+    thrust::device_vector<TreeNodeIndex>       preLeafParents_;
+    thrust::device_vector<TreeNodeIndex>       prefixes_;
+    thrust::device_vector<TreeNodeIndex>       ordering_;
+    thrust::device_vector<TreeNodeIndex>       depths_;
+};
+
+} // namespace cstone
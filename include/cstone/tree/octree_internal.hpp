@@ -39,6 +39,7 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <iterator>
 #include <vector>
@@ -47,6 +48,7 @@
 #include "cstone/primitives/gather.hpp"
 #include "cstone/sfc/morton.hpp"
 #include "cstone/util/gsl-lite.hpp"
+#include "cstone/util/util.hpp"
 
 #include "btree.hpp"
 #include "octree.hpp"
@@ -236,6 +238,29 @@ void decreasingMaxDepthOrder(const OctreeNode<KeyType>* octree,
     }
 }
 
+//! @brief move the node at @p oldIndex to rewireMap[oldIndex] and translate its parent and child indices
+template<class KeyType>
+CUDA_HOST_DEVICE_FUN
+inline void rewireInternalElement(TreeNodeIndex oldIndex, const OctreeNode<KeyType>* oldNodes,
+                                  const TreeNodeIndex* rewireMap, OctreeNode<KeyType>* newNodes)
+{
+    // node at <oldIndex> moves to <newIndex>
+    TreeNodeIndex newIndex = rewireMap[oldIndex];
+
+    OctreeNode<KeyType> newNode = oldNodes[oldIndex];
+    newNode.parent = rewireMap[newNode.parent];
+    for (int octant = 0; octant < 8; ++octant)
+    {
+        if (!isLeafIndex(newNode.child[octant]))
+        {
+            TreeNodeIndex oldChild = newNode.child[octant];
+            newNode.child[octant]  = rewireMap[oldChild];
+        }
+    }
+
+    newNodes[newIndex] = newNode;
+}
+
 /*! @brief reorder internal octree nodes according to a map
  *
  * @tparam KeyType                   32- or 64-bit unsigned integer
@@ -253,21 +278,7 @@ void rewireInternal(const OctreeNode<KeyType>* oldNodes,
     #pragma omp parallel for schedule(static)
     for (TreeNodeIndex oldIndex = 0; oldIndex < nInternalNodes; ++oldIndex)
     {
-        // node at <oldIndex> moves to <newIndex>
-        TreeNodeIndex newIndex = rewireMap[oldIndex];
-
-        OctreeNode<KeyType> newNode = oldNodes[oldIndex];
-        newNode.parent = rewireMap[newNode.parent];
-        for (int octant = 0; octant < 8; ++octant)
-        {
-            if (!isLeafIndex(newNode.child[octant]))
-            {
-                TreeNodeIndex oldChild = newNode.child[octant];
-                newNode.child[octant]  = rewireMap[oldChild];
-            }
-        }
-
-        newNodes[newIndex] = newNode;
+        rewireInternalElement(oldIndex, oldNodes, rewireMap, newNodes);
     }
 }
 
@@ -365,17 +376,18 @@ inline void constructOctreeNode(OctreeNode<KeyType>*       internalOctree,
  * @param[in]  nLeafNodes      number of octree leaf nodes used to construct @p binaryTree
  * @param[out] internalOctree  output internal octree nodes, length = (@p numLeafNodes-1) / 7
  * @param[out] leafParents     node index of the parent node for each leaf, length = @p numLeafNodes
- *
+ * @param[-]   prefixes        temporary storage, length = @p numLeafNodes
+ * @param[-]   scatterMap      temporary storage, length = (@p numLeafNodes-1) / 7
  */
 template<class KeyType>
 void createInternalOctreeCpu(const BinaryNode<KeyType>* binaryTree, TreeNodeIndex nLeafNodes,
-                             OctreeNode<KeyType>* internalOctree, TreeNodeIndex* leafParents)
+                             OctreeNode<KeyType>* internalOctree, TreeNodeIndex* leafParents,
+                             TreeNodeIndex* prefixes, TreeNodeIndex* scatterMap)
 {
     // we ignore the last binary tree node which is a duplicate root node
     TreeNodeIndex nBinaryNodes = nLeafNodes - 1;
 
-    // one extra element to store the total sum of the exclusive scan
-    std::vector<TreeNodeIndex> prefixes(nBinaryNodes + 1);
+    // prefixes has one extra element to store the total sum of the exclusive scan
     #pragma omp parallel for schedule(static)
     for (TreeNodeIndex i = 0; i < nBinaryNodes; ++i)
     {
@@ -383,13 +395,13 @@ void createInternalOctreeCpu(const BinaryNode<KeyType>* binaryTree, TreeNodeInde
         bool divisibleBy3 = prefixLength % 3 == 0;
         prefixes[i] = (divisibleBy3) ? 1 : 0;
     }
+    prefixes[nBinaryNodes] = 0;
 
     // stream compaction: scan and scatter
-    exclusiveScan(prefixes.data(), prefixes.size());
+    exclusiveScan(prefixes, nBinaryNodes + 1);
 
     // nInternalOctreeNodes is also equal to prefixes[nBinaryNodes]
     TreeNodeIndex nInternalOctreeNodes = (nLeafNodes-1)/7;
-    std::vector<TreeNodeIndex> scatterMap(nInternalOctreeNodes);
 
     // compaction step, scatterMap -> compacted list of binary nodes that correspond to octree nodes
     #pragma omp parallel for schedule(static)
@@ -406,10 +418,195 @@ void createInternalOctreeCpu(const BinaryNode<KeyType>* binaryTree, TreeNodeInde
     #pragma omp parallel for schedule(static)
     for (TreeNodeIndex i = 0; i < nInternalOctreeNodes; ++i)
     {
-        constructOctreeNode(internalOctree, binaryTree, i, scatterMap.data(), prefixes.data(), leafParents);
+        constructOctreeNode(internalOctree, binaryTree, i, scatterMap, prefixes, leafParents);
     }
 }
 
+//! @brief overload with internally allocated temporary storage
+template<class KeyType>
+void createInternalOctreeCpu(const BinaryNode<KeyType>* binaryTree, TreeNodeIndex nLeafNodes,
+                             OctreeNode<KeyType>* internalOctree, TreeNodeIndex* leafParents)
+{
+    std::vector<TreeNodeIndex> prefixes(nLeafNodes);
+    std::vector<TreeNodeIndex> scatterMap((nLeafNodes-1)/7);
+    createInternalOctreeCpu(binaryTree, nLeafNodes, internalOctree, leafParents, prefixes.data(), scatterMap.data());
+}
+
+
+/*! @brief non-owning view of a TraversalOctree, usable in device code
+ *
+ * @tparam KeyType  32- or 64-bit unsigned integer
+ *
+ * Accessors are identical to the ones of TraversalOctree.
+ */
+template<class KeyType>
+struct TraversalOctreeView
+{
+    const KeyType*       keys;
+    const uint8_t*       levels;
+    const TreeNodeIndex* firstChild;
+    const TreeNodeIndex* escapeIndex;
+    const TreeNodeIndex* octreeIdx;
+    TreeNodeIndex        numNodes;
+    TreeNodeIndex        numInternalNodes;
+
+    CUDA_HOST_DEVICE_FUN TreeNodeIndex numTreeNodes() const { return numNodes; }
+    CUDA_HOST_DEVICE_FUN bool isLeaf(TreeNodeIndex node) const { return firstChild[node] == 0; }
+    CUDA_HOST_DEVICE_FUN TreeNodeIndex child(TreeNodeIndex node, int octant) const { return firstChild[node] + octant; }
+    CUDA_HOST_DEVICE_FUN TreeNodeIndex escape(TreeNodeIndex node) const { return escapeIndex[node]; }
+    CUDA_HOST_DEVICE_FUN KeyType codeStart(TreeNodeIndex node) const { return keys[node]; }
+    CUDA_HOST_DEVICE_FUN KeyType codeEnd(TreeNodeIndex node) const { return keys[node] + nodeRange<KeyType>(levels[node]); }
+    CUDA_HOST_DEVICE_FUN int level(TreeNodeIndex node) const { return levels[node]; }
+    CUDA_HOST_DEVICE_FUN TreeNodeIndex octreeIndex(TreeNodeIndex node) const { return octreeIdx[node]; }
+    CUDA_HOST_DEVICE_FUN TreeNodeIndex toLeaf(TreeNodeIndex node) const { return octreeIdx[node] - numInternalNodes; }
+};
+
+/*! @brief traversal-optimized representation of an octree with sibling-contiguous node storage
+ *
+ * @tparam KeyType  32- or 64-bit unsigned integer
+ *
+ * Nodes are stored as separate arrays for SFC keys, levels and the index of the first child.
+ * The root has index 0 and the 8 children of the internal node with Octree index i are stored
+ * contiguously at [1 + 8*i : 9 + 8*i]. Child lookups therefore require no leaf index decoding and
+ * visiting all children of a node touches consecutive array elements. A first child index
+ * of 0 marks a leaf, since the root is not the child of any node.
+ *
+ * Node indices differ from the Octree node indices, octreeIndex() provides the translation.
+ *
+ * In addition, each node stores an escape index, which is the next node in depth-first pre-order
+ * that is not a descendant of the node. This is the next sibling for octants 0-6 and otherwise the escape
+ * index of the parent. Escape indices of the last node along the right boundary of the tree equal numTreeNodes().
+ * They allow depth-first traversals without a stack, see singleTraversalStackless.
+ */
+template<class KeyType>
+class TraversalOctree
+{
+public:
+    /*! @brief construct the traversal layout from the internal and leaf nodes of an Octree
+     *
+     * @param[in] internalTree      internal octree nodes, length = @p numInternalNodes
+     * @param[in] numInternalNodes  number of internal nodes
+     * @param[in] leaves            cornerstone leaves, length = @p numLeafNodes + 1
+     * @param[in] numLeafNodes      number of leaf nodes
+     */
+    void update(const OctreeNode<KeyType>* internalTree, TreeNodeIndex numInternalNodes, const KeyType* leaves,
+                TreeNodeIndex numLeafNodes)
+    {
+        TreeNodeIndex numNodes = numInternalNodes + numLeafNodes;
+        numInternalNodes_      = numInternalNodes;
+
+        reallocateGeometric(keys_, numNodes);
+        reallocateGeometric(levels_, numNodes);
+        reallocateGeometric(firstChild_, numNodes);
+        reallocateGeometric(octreeIndex_, numNodes);
+        reallocateGeometric(escape_, numNodes);
+        reallocateGeometric(internalPosition_, numInternalNodes);
+
+        keys_[0]        = 0;
+        levels_[0]      = 0;
+        firstChild_[0]  = (numInternalNodes > 0) ? 1 : 0;
+        octreeIndex_[0] = 0;
+        escape_[0]      = numNodes;
+        if (numInternalNodes > 0) { internalPosition_[0] = 0; }
+
+        #pragma omp parallel for schedule(static)
+        for (TreeNodeIndex i = 0; i < numInternalNodes; ++i)
+        {
+            for (int octant = 0; octant < 8; ++octant)
+            {
+                TreeNodeIndex nodeIdx = 1 + 8 * i + octant;
+                TreeNodeIndex child   = internalTree[i].child[octant];
+                if (isLeafIndex(child))
+                {
+                    TreeNodeIndex leafIdx = loadLeafIndex(child);
+                    keys_[nodeIdx]        = leaves[leafIdx];
+                    levels_[nodeIdx]      = treeLevel(leaves[leafIdx + 1] - leaves[leafIdx]);
+                    firstChild_[nodeIdx]  = 0;
+                    octreeIndex_[nodeIdx] = numInternalNodes + leafIdx;
+                }
+                else
+                {
+                    keys_[nodeIdx]        = internalTree[child].prefix;
+                    levels_[nodeIdx]      = internalTree[child].level;
+                    firstChild_[nodeIdx]  = 1 + 8 * child;
+                    octreeIndex_[nodeIdx] = child;
+                    internalPosition_[child] = nodeIdx;
+                }
+            }
+        }
+
+        // walk up through last octants to the first ancestor that has a next sibling
+        #pragma omp parallel for schedule(static)
+        for (TreeNodeIndex nodeIdx = 1; nodeIdx < numNodes; ++nodeIdx)
+        {
+            TreeNodeIndex node = nodeIdx;
+            while (node != 0 && (node - 1) % 8 == 7)
+            {
+                node = internalPosition_[(node - 1) / 8];
+            }
+            escape_[nodeIdx] = (node == 0) ? numNodes : node + 1;
+        }
+    }
+
+    //! @brief total number of nodes in the tree
+    [[nodiscard]] TreeNodeIndex numTreeNodes() const { return keys_.size(); }
+
+    //! @brief check whether node is a leaf
+    [[nodiscard]] bool isLeaf(TreeNodeIndex node) const { return firstChild_[node] == 0; }
+
+    //! @brief return child node index, @p node must be internal
+    [[nodiscard]] TreeNodeIndex child(TreeNodeIndex node, int octant) const { return firstChild_[node] + octant; }
+
+    //! @brief next node in depth-first pre-order after the subtree of @p node, numTreeNodes() if there is none
+    [[nodiscard]] TreeNodeIndex escape(TreeNodeIndex node) const { return escape_[node]; }
+
+    //! @brief lowest SFC key contained int the geometrical box of @p node
+    [[nodiscard]] KeyType codeStart(TreeNodeIndex node) const { return keys_[node]; }
+
+    //! @brief highest SFC key contained in the geometrical box of @p node
+    [[nodiscard]] KeyType codeEnd(TreeNodeIndex node) const { return keys_[node] + nodeRange<KeyType>(levels_[node]); }
+
+    //! @brief octree subdivision level for @p node
+    [[nodiscard]] int level(TreeNodeIndex node) const { return levels_[node]; }
+
+    //! @brief the index of @p node in the Octree that was used to construct the traversal layout
+    [[nodiscard]] TreeNodeIndex octreeIndex(TreeNodeIndex node) const { return octreeIndex_[node]; }
+
+    //! @brief leaf index of @p node in the cornerstone leaf array, @p node must be a leaf
+    [[nodiscard]] TreeNodeIndex toLeaf(TreeNodeIndex node) const { return octreeIndex_[node] - numInternalNodes_; }
+
+    /*! @brief finds the index of the node with SFC key range [startKey:endKey]
+     *
+     * @return the index of the node, or numTreeNodes() if no such node exists
+     */
+    [[nodiscard]] TreeNodeIndex locate(KeyType startKey, KeyType endKey) const
+    {
+        TreeNodeIndex node = 0;
+        while (codeStart(node) != startKey || codeEnd(node) != endKey)
+        {
+            if (isLeaf(node) || startKey < codeStart(node) || endKey > codeEnd(node)) { return numTreeNodes(); }
+            node = child(node, (startKey - codeStart(node)) / nodeRange<KeyType>(level(node) + 1));
+        }
+        return node;
+    }
+
+    //! @brief non-owning view of the traversal layout, can be passed to device code if the arrays are device-resident
+    [[nodiscard]] TraversalOctreeView<KeyType> data() const
+    {
+        return {keys_.data(), levels_.data(), firstChild_.data(), escape_.data(),
+                octreeIndex_.data(), numTreeNodes(), numInternalNodes_};
+    }
+
+private:
+    TreeNodeIndex              numInternalNodes_{0};
+    std::vector<KeyType>       keys_;
+    std::vector<uint8_t>       levels_;
+    std::vector<TreeNodeIndex> firstChild_;
+    std::vector<TreeNodeIndex> escape_;
+    std::vector<TreeNodeIndex> octreeIndex_;
+    //! @brief traversal layout index of each internal node, only needed during construction
+    std::vector<TreeNodeIndex> internalPosition_;
+};
 
 /*! @brief This class unifies a cornerstone octree with the internal part
  *
@@ -419,6 +616,82 @@ void createInternalOctreeCpu(const BinaryNode<KeyType>* binaryTree, TreeNodeInde
  * All nodes are guaranteed to be stored ordered according to decreasing value of the distance of the farthest leaf.
  * This property is relied upon by the generic upsweep implementation.
  */
+/*! @brief non-owning, read-only view of an Octree
+ *
+ * @tparam KeyType  32- or 64-bit unsigned integer
+ *
+ * Provides the same node accessors as Octree, see there for documentation. Obtained from Octree::data()
+ * or from a memory-mapped tree file, see MappedOctree.
+ */
+template<class KeyType>
+struct OctreeView
+{
+    const KeyType*             leaves;
+    const OctreeNode<KeyType>* internalTree;
+    const TreeNodeIndex*       leafParentsPtr;
+    //! @brief node counts per max depth, length maxTreeLevel<KeyType>{}
+    const TreeNodeIndex*       nodesPerLevel;
+    TreeNodeIndex              numLeaves;
+    TreeNodeIndex              numInternal;
+
+    [[nodiscard]] TreeNodeIndex numTreeNodes() const { return numLeaves + numInternal; }
+    [[nodiscard]] TreeNodeIndex numTreeNodes(int maxDepth) const
+    {
+        assert(maxDepth < maxTreeLevel<KeyType>{});
+        return nodesPerLevel[maxDepth];
+    }
+    [[nodiscard]] TreeNodeIndex numLeafNodes() const { return numLeaves; }
+    [[nodiscard]] TreeNodeIndex numInternalNodes() const { return numInternal; }
+
+    [[nodiscard]] bool isLeaf(TreeNodeIndex node) const { return node >= numInternal; }
+    [[nodiscard]] bool isRoot(TreeNodeIndex node) const { return node == 0; }
+    [[nodiscard]] TreeNodeIndex toInternal(TreeNodeIndex node) const { return node + numInternal; }
+    [[nodiscard]] TreeNodeIndex toLeaf(TreeNodeIndex node) const { return node - numInternal; }
+
+    [[nodiscard]] bool isLeafChild(TreeNodeIndex node, int octant) const
+    {
+        return isLeafIndex(internalTree[node].child[octant]);
+    }
+
+    [[nodiscard]] TreeNodeIndex child(TreeNodeIndex node, int octant) const
+    {
+        TreeNodeIndex childIndex = internalTree[node].child[octant];
+        if (isLeafIndex(childIndex)) { childIndex = loadLeafIndex(childIndex) + numInternal; }
+        return childIndex;
+    }
+
+    [[nodiscard]] TreeNodeIndex childDirect(TreeNodeIndex node, int octant) const
+    {
+        TreeNodeIndex childIndex = internalTree[node].child[octant];
+        return isLeafIndex(childIndex) ? loadLeafIndex(childIndex) : childIndex;
+    }
+
+    [[nodiscard]] TreeNodeIndex parent(TreeNodeIndex node) const
+    {
+        return (node < numInternal) ? internalTree[node].parent : leafParentsPtr[node - numInternal];
+    }
+
+    [[nodiscard]] KeyType codeStart(TreeNodeIndex node) const
+    {
+        return (node < numInternal) ? internalTree[node].prefix : leaves[node - numInternal];
+    }
+
+    [[nodiscard]] KeyType codeEnd(TreeNodeIndex node) const
+    {
+        return (node < numInternal) ? internalTree[node].prefix + nodeRange<KeyType>(internalTree[node].level)
+                                    : leaves[node - numInternal + 1];
+    }
+
+    [[nodiscard]] int level(TreeNodeIndex node) const
+    {
+        return (node < numInternal) ? internalTree[node].level
+                                    : treeLevel(leaves[node - numInternal + 1] - leaves[node - numInternal]);
+    }
+
+    [[nodiscard]] gsl::span<const KeyType> treeLeaves() const { return {leaves, std::size_t(numLeaves + 1)}; }
+    [[nodiscard]] const TreeNodeIndex* leafParents() const { return leafParentsPtr; }
+};
+
 template<class KeyType>
 class Octree {
 public:
@@ -451,6 +724,25 @@ public:
         updateInternalTree();
     }
 
+    /*! @brief replaces the leaves with the output of rebalanceTree and patches the internal part
+     *
+     * @param newLeaves  the rebalanced leaves, output of rebalanceTree applied to treeLeaves()
+     * @param nodeOps    exclusive scan of the rebalance decisions, as left behind by rebalanceTree,
+     *                   length = numLeafNodes() + 1 of the tree before the update
+     *
+     * Instead of reconstructing the internal tree from a new binary radix tree, only the nodes
+     * affected by merges and splits and their ancestors are modified. The remaining work consists
+     * of linear passes to renumber node indices, which is required anyway since leaf indices shift.
+     * The result is equivalent to update(newLeaves), up to the order of nodes with equal max depth.
+     */
+    void update(std::vector<KeyType>&& newLeaves, const TreeNodeIndex* nodeOps)
+    {
+        assert(TreeNodeIndex(newLeaves.size()) == nodeOps[numLeafNodes()] + 1);
+
+        cstoneTree_.swap(newLeaves);
+        if (!patchInternalTree(nodeOps)) { updateInternalTree(); }
+    }
+
     //! @brief total number of nodes in the tree
     [[nodiscard]] inline TreeNodeIndex numTreeNodes() const
     {
@@ -506,6 +798,16 @@ public:
         return node + numInternalNodes();
     }
 
+    /*! @brief convert an octree index of a leaf to the leaf index in the cornerstone leaf array
+     *
+     * @param[in] node    octree leaf node index, range [numInternalNodes():numTreeNodes()]
+     * @return            leaf index, range [0:numLeafNodes()]
+     */
+    [[nodiscard]] inline TreeNodeIndex toLeaf(TreeNodeIndex node) const
+    {
+        return node - numInternalNodes();
+    }
+
     /*! @brief check whether child of node is a leaf
      *
      * @param[in] node    node index, range [0:numInternalNodes()]
@@ -687,6 +989,19 @@ public:
         return leafParents_.data();
     }
 
+    //! @brief a read-only view of the tree, valid until the next update
+    [[nodiscard]] OctreeView<KeyType> data() const
+    {
+        return {cstoneTree_.data(), internalTree_.data(), leafParents_.data(), nNodesPerLevel_.data(),
+                numLeafNodes(), numInternalNodes()};
+    }
+
+    //! @brief the same tree in a layout optimized for traversal, see TraversalOctree
+    [[nodiscard]] const TraversalOctree<KeyType>& traversalTree() const
+    {
+        return traversalTree_;
+    }
+
 private:
 
     /*! @brief find the child that contains the given key
@@ -707,36 +1022,294 @@ private:
         return internalTree_[nodeIdx].child[7];
     }
 
-    //! @brief regenerates the internal tree based on (a changed) cstoneTree_
+    /*! @brief regenerates the internal tree based on (a changed) cstoneTree_
+     *
+     * Temporaries are kept as members and only grow, such that repeated updates with similar
+     * tree sizes do not allocate.
+     */
     void updateInternalTree()
     {
-        nNodesPerLevel_[0] = nNodes(cstoneTree_);
+        TreeNodeIndex numLeafNodes     = nNodes(cstoneTree_);
+        TreeNodeIndex numInternalNodes = (numLeafNodes - 1) / 7;
+
+        nNodesPerLevel_[0] = numLeafNodes;
 
-        binaryTree_.resize(nNodes(cstoneTree_));
-        createBinaryTree(cstoneTree_.data(), nNodes(cstoneTree_), binaryTree_.data());
+        reallocateGeometric(binaryTree_, numLeafNodes);
+        createBinaryTree(cstoneTree_.data(), numLeafNodes, binaryTree_.data());
 
-        std::vector<OctreeNode<KeyType>> preTree((nNodes(cstoneTree_) - 1) / 7);
-        std::vector<TreeNodeIndex> preLeafParents(nNodes(cstoneTree_));
+        reallocateGeometric(preTree_, numInternalNodes);
+        reallocateGeometric(preLeafParents_, numLeafNodes);
+        reallocateGeometric(prefixes_, numLeafNodes);
+        reallocateGeometric(ordering_, numInternalNodes);
 
-        createInternalOctreeCpu(binaryTree_.data(), nNodes(cstoneTree_), preTree.data(), preLeafParents.data());
+        // ordering_ is not needed yet and serves as scatter map scratch space
+        createInternalOctreeCpu(binaryTree_.data(), numLeafNodes, preTree_.data(), preLeafParents_.data(),
+                                prefixes_.data(), ordering_.data());
 
         // re-sort internal nodes to establish a max-depth ordering
-        std::vector<TreeNodeIndex> ordering(preTree.size());
-        // determine ordering
-        decreasingMaxDepthOrder(preTree.data(), preTree.size(), ordering.data(), nNodesPerLevel_.data());
+        decreasingMaxDepthOrder(preTree_.data(), numInternalNodes, ordering_.data(), nNodesPerLevel_.data());
         // apply the ordering to the internal tree;
-        internalTree_.resize(preTree.size());
-        rewireInternal(preTree.data(), ordering.data(), preTree.size(), internalTree_.data());
+        reallocateGeometric(internalTree_, numInternalNodes);
+        rewireInternal(preTree_.data(), ordering_.data(), numInternalNodes, internalTree_.data());
 
         // apply ordering to leaf parents
-        leafParents_.resize(preLeafParents.size());
+        reallocateGeometric(leafParents_, numLeafNodes);
 
         // internal tree is empty if a single leaf node is also the tree-root
         if (!internalTree_.empty())
         {
             leafParents_[0] = 0;
-            rewireIndices(preLeafParents.data(), ordering.data(), preLeafParents.size(), leafParents_.data());
+            rewireIndices(preLeafParents_.data(), ordering_.data(), numLeafNodes, leafParents_.data());
         }
+
+        traversalTree_.update(internalTree_.data(), numInternalNodes, cstoneTree_.data(), numLeafNodes);
+    }
+
+    /*! @brief applies the changes encoded in nodeOps to the internal tree
+     *
+     * @param nodeOps   exclusive scan of the rebalance decisions that turned the previous leaves into cstoneTree_
+     * @return          false if the tree could not be patched and needs a full update
+     *
+     * Merged nodes are removed, split leaves are replaced by complete subtrees and the max-depth
+     * of the ancestors is corrected. Node indices are then reassigned with a counting sort over
+     * max-depth values, which preserves the relative order of the nodes that did not move.
+     */
+    bool patchInternalTree(const TreeNodeIndex* nodeOps)
+    {
+        TreeNodeIndex oldNumLeaves   = leafParents_.size();
+        TreeNodeIndex oldNumInternal = internalTree_.size();
+        TreeNodeIndex newNumLeaves   = nNodes(cstoneTree_);
+
+        // the root is a leaf before or after the update
+        if (oldNumInternal == 0 || newNumLeaves == 1) { return false; }
+
+        auto opCode = [nodeOps](TreeNodeIndex i) { return nodeOps[i + 1] - nodeOps[i]; };
+        // number of levels that a leaf with opcode @p op is split into
+        auto splitLevels = [](TreeNodeIndex op)
+        {
+            int k = 0;
+            for (; op > 1; op /= 8) { ++k; }
+            return k;
+        };
+        // number of internal nodes in a complete subtree with k levels
+        auto subtreeSize = [](int k) { return TreeNodeIndex(((1u << (3 * k)) - 1) / 7); };
+
+        // recover the max-depth of each internal node from the level-ordered node layout
+        reallocateGeometric(depths_, oldNumInternal);
+        {
+            TreeNodeIndex groupStart = 0;
+            for (int depth = maxTreeLevel<KeyType>{} - 1; depth > 0; --depth)
+            {
+                std::fill(depths_.begin() + groupStart, depths_.begin() + groupStart + nNodesPerLevel_[depth], depth);
+                groupStart += nNodesPerLevel_[depth];
+            }
+            if (groupStart != oldNumInternal) { return false; }
+        }
+
+        // internal nodes that are removed because their children are merged get depth 0,
+        // split leaves are replaced by subtrees that are appended after the existing internal nodes
+        splitLeaves_.clear();
+        ancestors_.clear();
+        TreeNodeIndex numStagedNodes = oldNumInternal;
+        for (TreeNodeIndex i = 0; i < oldNumLeaves; ++i)
+        {
+            TreeNodeIndex op = opCode(i);
+            if (op == 0)
+            {
+                TreeNodeIndex parentIdx = leafParents_[i];
+                if (depths_[parentIdx] == 0) { continue; }
+
+                const auto& mergeNode = internalTree_[parentIdx];
+                for (int octant = 0; octant < 8; ++octant)
+                {
+                    if (!isLeafIndex(mergeNode.child[octant])) { return false; }
+                    TreeNodeIndex siblingOp = opCode(loadLeafIndex(mergeNode.child[octant]));
+                    if (siblingOp != (octant == 0 ? 1 : 0)) { return false; }
+                }
+                depths_[parentIdx] = 0;
+                ancestors_.push_back(parentIdx);
+            }
+            else if (op > 1)
+            {
+                splitLeaves_.push_back({i, numStagedNodes});
+                numStagedNodes += subtreeSize(splitLevels(op));
+                ancestors_.push_back(leafParents_[i]);
+            }
+        }
+
+        if (ancestors_.empty()) { return true; } // no change
+
+        reallocateGeometric(depths_, numStagedNodes);
+        for (auto [leafIdx, subtreeStart] : splitLeaves_)
+        {
+            int k = splitLevels(opCode(leafIdx));
+            for (int r = 0; r < k; ++r)
+            {
+                std::fill(depths_.begin() + subtreeStart + subtreeSize(r),
+                          depths_.begin() + subtreeStart + subtreeSize(r + 1), k - r);
+            }
+        }
+
+        // staging index of the subtree that replaces split leaf @p leafIdx
+        auto subtreeRoot = [this](TreeNodeIndex leafIdx)
+        {
+            auto it = std::lower_bound(splitLeaves_.begin(), splitLeaves_.end(), leafIdx,
+                                       [](const auto& split, TreeNodeIndex key) { return split[0] < key; });
+            return (*it)[1];
+        };
+
+        auto childDepth = [this, &opCode, &splitLevels](TreeNodeIndex child)
+        {
+            return isLeafIndex(child) ? splitLevels(opCode(loadLeafIndex(child))) : depths_[child];
+        };
+
+        // correct the max-depth of all ancestors of removed nodes and split leaves
+        for (TreeNodeIndex nodeIdx : ancestors_)
+        {
+            if (depths_[nodeIdx] == 0) { nodeIdx = internalTree_[nodeIdx].parent; }
+            while (true)
+            {
+                int depth = 0;
+                for (int octant = 0; octant < 8; ++octant)
+                {
+                    depth = std::max(depth, childDepth(internalTree_[nodeIdx].child[octant]));
+                }
+                depth += 1;
+
+                if (depth == depths_[nodeIdx]) { break; }
+                depths_[nodeIdx] = depth;
+                if (nodeIdx == 0) { break; }
+                nodeIdx = internalTree_[nodeIdx].parent;
+            }
+        }
+
+        // counting sort by decreasing max-depth, ordering_ maps staging indices to final indices
+        std::array<TreeNodeIndex, maxTreeLevel<KeyType>{} + 1> depthOffsets{0};
+        for (TreeNodeIndex i = 0; i < numStagedNodes; ++i)
+        {
+            depthOffsets[depths_[i]]++;
+        }
+        for (int depth = 1; depth < int(maxTreeLevel<KeyType>{}); ++depth)
+        {
+            nNodesPerLevel_[depth] = depthOffsets[depth];
+        }
+        nNodesPerLevel_[0] = newNumLeaves;
+
+        TreeNodeIndex newNumInternal = 0;
+        for (int depth = maxTreeLevel<KeyType>{}; depth > 0; --depth)
+        {
+            TreeNodeIndex count = depthOffsets[depth];
+            depthOffsets[depth] = newNumInternal;
+            newNumInternal += count;
+        }
+
+        reallocateGeometric(ordering_, numStagedNodes);
+        for (TreeNodeIndex i = 0; i < numStagedNodes; ++i)
+        {
+            if (depths_[i] > 0) { ordering_[i] = depthOffsets[depths_[i]]++; }
+        }
+
+        // new leaf index of the single leaf that replaces the removed internal node @p nodeIdx
+        auto mergedLeaf = [this, nodeOps](TreeNodeIndex nodeIdx)
+        {
+            return nodeOps[loadLeafIndex(internalTree_[nodeIdx].child[0])];
+        };
+
+        // final index of the parent of a node whose old parent was @p parentIdx
+        auto newParent = [this](TreeNodeIndex parentIdx)
+        {
+            if (depths_[parentIdx] == 0) { parentIdx = internalTree_[parentIdx].parent; }
+            return ordering_[parentIdx];
+        };
+
+        reallocateGeometric(preTree_, newNumInternal);
+        reallocateGeometric(preLeafParents_, newNumLeaves);
+
+        #pragma omp parallel for schedule(static)
+        for (TreeNodeIndex i = 0; i < oldNumInternal; ++i)
+        {
+            if (depths_[i] == 0) { continue; }
+
+            const OctreeNode<KeyType>& oldNode = internalTree_[i];
+            OctreeNode<KeyType>& newNode       = preTree_[ordering_[i]];
+
+            newNode.prefix = oldNode.prefix;
+            newNode.level  = oldNode.level;
+            newNode.parent = (i == 0) ? 0 : ordering_[oldNode.parent];
+
+            for (int octant = 0; octant < 8; ++octant)
+            {
+                TreeNodeIndex child = oldNode.child[octant];
+                if (isLeafIndex(child))
+                {
+                    TreeNodeIndex leafIdx = loadLeafIndex(child);
+                    newNode.child[octant] = (opCode(leafIdx) == 1) ? storeLeafIndex(nodeOps[leafIdx])
+                                                                   : ordering_[subtreeRoot(leafIdx)];
+                }
+                else
+                {
+                    newNode.child[octant] = (depths_[child] == 0) ? storeLeafIndex(mergedLeaf(child))
+                                                                  : ordering_[child];
+                }
+            }
+        }
+
+        #pragma omp parallel for schedule(static)
+        for (TreeNodeIndex i = 0; i < oldNumLeaves; ++i)
+        {
+            if (opCode(i) == 1) { preLeafParents_[nodeOps[i]] = newParent(leafParents_[i]); }
+        }
+
+        // construct the complete subtrees of split leaves in breadth-first order
+        #pragma omp parallel for schedule(dynamic)
+        for (std::size_t s = 0; s < splitLeaves_.size(); ++s)
+        {
+            auto [leafIdx, subtreeStart] = splitLeaves_[s];
+            TreeNodeIndex firstLeaf = nodeOps[leafIdx];
+            TreeNodeIndex op        = opCode(leafIdx);
+            int k                   = splitLevels(op);
+            int leafLevel           = treeLevel(cstoneTree_[firstLeaf + op] - cstoneTree_[firstLeaf]);
+
+            for (int r = 0; r < k; ++r)
+            {
+                TreeNodeIndex numLevelNodes = TreeNodeIndex(1) << (3 * r);
+                TreeNodeIndex leavesPerNode = op / numLevelNodes;
+                for (TreeNodeIndex pos = 0; pos < numLevelNodes; ++pos)
+                {
+                    TreeNodeIndex nodeIdx      = ordering_[subtreeStart + subtreeSize(r) + pos];
+                    OctreeNode<KeyType>& node  = preTree_[nodeIdx];
+
+                    node.prefix = cstoneTree_[firstLeaf + pos * leavesPerNode];
+                    node.level  = leafLevel + r;
+                    node.parent = (r == 0) ? newParent(leafParents_[leafIdx])
+                                           : ordering_[subtreeStart + subtreeSize(r - 1) + pos / 8];
+
+                    for (int octant = 0; octant < 8; ++octant)
+                    {
+                        TreeNodeIndex childPos = 8 * pos + octant;
+                        if (r + 1 < k)
+                        {
+                            node.child[octant] = ordering_[subtreeStart + subtreeSize(r + 1) + childPos];
+                        }
+                        else
+                        {
+                            node.child[octant]                 = storeLeafIndex(firstLeaf + childPos);
+                            preLeafParents_[firstLeaf + childPos] = nodeIdx;
+                        }
+                    }
+                }
+            }
+        }
+
+        internalTree_.swap(preTree_);
+        leafParents_.swap(preLeafParents_);
+
+        reallocateGeometric(binaryTree_, newNumLeaves);
+        createBinaryTree(cstoneTree_.data(), newNumLeaves, binaryTree_.data());
+
+        traversalTree_.update(internalTree_.data(), newNumInternal, cstoneTree_.data(), newNumLeaves);
+
+        return true;
     }
 
     //! @brief cornerstone octree, just the leaves
@@ -763,6 +1336,20 @@ private:
      *  etc.
      */
      std::vector<TreeNodeIndex> nNodesPerLevel_;
+
+    //! @brief traversal-optimized copy of the tree
+    TraversalOctree<KeyType> traversalTree_;
+
+    //! @brief scratch space for updateInternalTree
+    std::vector<OctreeNode<KeyType>> preTree_;
+    std::vector<TreeNodeIndex>       preLeafParents_;
+    std::vector<TreeNodeIndex>       prefixes_;
+    std::vector<TreeNodeIndex>       ordering_;
+
+    //! @brief scratch space for patchInternalTree
+    std::vector<int>                          depths_;
+    std::vector<TreeNodeIndex>                ancestors_;
+    std::vector<std::array<TreeNodeIndex, 2>> splitLeaves_;
 };
 
 
@@ -0,0 +1,374 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Memory-mappable binary file format for octrees
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * File layout, all sections start at multiples of octreeFileAlignment:
+ *   - OctreeFileHeader
+ *   - OctreeFileQuantity table with one entry per stored node quantity
+ *   - leaves, numLeafNodes + 1 keys
+ *   - internal nodes, numInternalNodes OctreeNode<KeyType>
+ *   - leaf parents, numLeafNodes TreeNodeIndex
+ *   - node counts per max depth, maxTreeLevel<KeyType>{} TreeNodeIndex
+ *   - node quantities, numTreeNodes elements each, in Octree node order
+ *
+ * All sections are stored in their in-memory representation. A mapped file can therefore be accessed
+ * through an OctreeView without any parsing, provided that the key type, the index type and the byte order
+ * match, which is checked against the header when the file is opened.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cstone/tree/octree_internal.hpp"
+
+namespace cstone
+{
+
+constexpr uint32_t octreeFileVersion   = 1;
+constexpr uint64_t octreeFileAlignment = 64;
+
+struct OctreeFileHeader
+{
+    char magic[8];
+    //! @brief written as 1, reads differently if the byte order of the file does not match
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t keySize;
+    uint32_t indexSize;
+    uint32_t nodeSize;
+    uint32_t numQuantities;
+    uint64_t numLeafNodes;
+    uint64_t numInternalNodes;
+    uint64_t leavesOffset;
+    uint64_t internalOffset;
+    uint64_t leafParentsOffset;
+    uint64_t nodesPerLevelOffset;
+    uint64_t fileSize;
+};
+
+//! @brief table entry describing a per-node quantity stored with the tree
+struct OctreeFileQuantity
+{
+    char     name[48];
+    uint64_t elementSize;
+    uint64_t offset;
+};
+
+//! @brief a named per-node quantity to write along with an octree, see nodeQuantity
+struct NodeQuantity
+{
+    std::string name;
+    const void* data;
+    std::size_t elementSize;
+};
+
+//! @brief describe a quantity with one element of type T per tree node, in Octree node order
+template<class T>
+NodeQuantity nodeQuantity(std::string name, const T* data)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    return {std::move(name), data, sizeof(T)};
+}
+
+constexpr char octreeFileMagic[8] = {'C', 'S', 'T', 'O', 'N', 'E', 'O', 'T'};
+
+namespace detail
+{
+
+inline uint64_t alignFileOffset(uint64_t offset)
+{
+    return (offset + octreeFileAlignment - 1) / octreeFileAlignment * octreeFileAlignment;
+}
+
+} // namespace detail
+
+/*! @brief write an octree and optional per-node quantities to a file that can be opened with MappedOctree
+ *
+ * @param filename    output file, existing content is overwritten
+ * @param octree      the octree, Octree or OctreeView
+ * @param quantities  per-node quantities with octree.numTreeNodes() elements each
+ */
+template<template<class> class TreeType, class KeyType>
+void writeOctree(const std::string& filename, const TreeType<KeyType>& octree,
+                 const std::vector<NodeQuantity>& quantities = {})
+{
+    OctreeView<KeyType> tree = octree.data();
+    uint64_t numLeaves       = tree.numLeafNodes();
+    uint64_t numInternal     = tree.numInternalNodes();
+    uint64_t numNodes        = numLeaves + numInternal;
+
+    OctreeFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, octreeFileMagic, sizeof(header.magic));
+    header.byteOrder        = 1;
+    header.version          = octreeFileVersion;
+    header.keySize          = sizeof(KeyType);
+    header.indexSize        = sizeof(TreeNodeIndex);
+    header.nodeSize         = sizeof(OctreeNode<KeyType>);
+    header.numQuantities    = quantities.size();
+    header.numLeafNodes     = numLeaves;
+    header.numInternalNodes = numInternal;
+
+    uint64_t offset = detail::alignFileOffset(sizeof(OctreeFileHeader) + quantities.size() * sizeof(OctreeFileQuantity));
+    header.leavesOffset        = offset;
+    offset                     = detail::alignFileOffset(offset + (numLeaves + 1) * sizeof(KeyType));
+    header.internalOffset      = offset;
+    offset                     = detail::alignFileOffset(offset + numInternal * sizeof(OctreeNode<KeyType>));
+    header.leafParentsOffset   = offset;
+    offset                     = detail::alignFileOffset(offset + numLeaves * sizeof(TreeNodeIndex));
+    header.nodesPerLevelOffset = offset;
+    offset                     = detail::alignFileOffset(offset + maxTreeLevel<KeyType>{} * sizeof(TreeNodeIndex));
+
+    std::vector<OctreeFileQuantity> table(quantities.size());
+    for (std::size_t i = 0; i < quantities.size(); ++i)
+    {
+        if (quantities[i].name.size() >= sizeof(table[i].name))
+        {
+            throw std::runtime_error("octree quantity name too long: " + quantities[i].name + "\n");
+        }
+        std::memset(table[i].name, 0, sizeof(table[i].name));
+        std::memcpy(table[i].name, quantities[i].name.data(), quantities[i].name.size());
+        table[i].elementSize = quantities[i].elementSize;
+        table[i].offset      = offset;
+        offset               = detail::alignFileOffset(offset + numNodes * quantities[i].elementSize);
+    }
+    header.fileSize = offset;
+
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out) { throw std::runtime_error("could not open " + filename + " for writing\n"); }
+
+    auto writeAt = [&out](uint64_t position, const void* data, uint64_t numBytes)
+    {
+        out.seekp(position);
+        out.write(static_cast<const char*>(data), numBytes);
+    };
+
+    writeAt(0, &header, sizeof(header));
+    writeAt(sizeof(header), table.data(), table.size() * sizeof(OctreeFileQuantity));
+    writeAt(header.leavesOffset, tree.leaves, (numLeaves + 1) * sizeof(KeyType));
+    writeAt(header.internalOffset, tree.internalTree, numInternal * sizeof(OctreeNode<KeyType>));
+    writeAt(header.leafParentsOffset, tree.leafParentsPtr, numLeaves * sizeof(TreeNodeIndex));
+    writeAt(header.nodesPerLevelOffset, tree.nodesPerLevel, maxTreeLevel<KeyType>{} * sizeof(TreeNodeIndex));
+    for (std::size_t i = 0; i < quantities.size(); ++i)
+    {
+        writeAt(table[i].offset, quantities[i].data, numNodes * quantities[i].elementSize);
+    }
+    // pad the last section, such that the file size matches the header
+    out.seekp(header.fileSize - 1);
+    out.put(0);
+
+    if (!out) { throw std::runtime_error("failed to write " + filename + "\n"); }
+}
+
+/*! @brief read-only octree backed by a memory-mapped file written with writeOctree
+ *
+ * @tparam KeyType  32- or 64-bit unsigned integer
+ *
+ * Opening a file only validates the header, tree data is paged in on access. Since the mapping is shared,
+ * multiple processes opening the same file share the page cache.
+ */
+template<class KeyType>
+class MappedOctree
+{
+public:
+    explicit MappedOctree(const std::string& filename)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) { throw std::runtime_error("could not open " + filename + " for reading\n"); }
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || uint64_t(fileStat.st_size) < sizeof(OctreeFileHeader))
+        {
+            close(fd);
+            throw std::runtime_error(filename + " is not an octree file\n");
+        }
+
+        mappedSize_ = fileStat.st_size;
+        void* ptr   = mmap(nullptr, mappedSize_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (ptr == MAP_FAILED) { throw std::runtime_error("could not map " + filename + "\n"); }
+        base_ = static_cast<const char*>(ptr);
+
+        try
+        {
+            validate(filename);
+        }
+        catch (...)
+        {
+            munmap(const_cast<char*>(base_), mappedSize_);
+            throw;
+        }
+    }
+
+    MappedOctree(const MappedOctree&)            = delete;
+    MappedOctree& operator=(const MappedOctree&) = delete;
+
+    MappedOctree(MappedOctree&& other) noexcept
+        : base_(other.base_)
+        , mappedSize_(other.mappedSize_)
+    {
+        other.base_ = nullptr;
+    }
+
+    MappedOctree& operator=(MappedOctree&& other) noexcept
+    {
+        std::swap(base_, other.base_);
+        std::swap(mappedSize_, other.mappedSize_);
+        return *this;
+    }
+
+    ~MappedOctree()
+    {
+        if (base_) { munmap(const_cast<char*>(base_), mappedSize_); }
+    }
+
+    //! @brief a view of the mapped tree, valid for the lifetime of this object
+    [[nodiscard]] OctreeView<KeyType> data() const
+    {
+        const OctreeFileHeader& h = header();
+        return {section<KeyType>(h.leavesOffset), section<OctreeNode<KeyType>>(h.internalOffset),
+                section<TreeNodeIndex>(h.leafParentsOffset), section<TreeNodeIndex>(h.nodesPerLevelOffset),
+                TreeNodeIndex(h.numLeafNodes), TreeNodeIndex(h.numInternalNodes)};
+    }
+
+    //! @brief number of stored per-node quantities
+    [[nodiscard]] int numQuantities() const { return header().numQuantities; }
+
+    //! @brief name of the i-th stored quantity
+    [[nodiscard]] std::string quantityName(int i) const { return quantityTable()[i].name; }
+
+    //! @brief check whether a quantity with the given name is stored
+    [[nodiscard]] bool hasQuantity(const std::string& name) const { return findQuantity(name) != nullptr; }
+
+    /*! @brief access a stored per-node quantity
+     *
+     * @tparam T     element type the quantity was written with
+     * @param  name  name of the quantity
+     * @return       pointer to numTreeNodes() elements in Octree node order
+     */
+    template<class T>
+    [[nodiscard]] const T* quantity(const std::string& name) const
+    {
+        const OctreeFileQuantity* q = findQuantity(name);
+        if (!q) { throw std::runtime_error("octree file has no quantity " + name + "\n"); }
+        if (q->elementSize != sizeof(T))
+        {
+            throw std::runtime_error("element size of octree quantity " + name + " does not match\n");
+        }
+        return section<T>(q->offset);
+    }
+
+private:
+    [[nodiscard]] const OctreeFileHeader& header() const
+    {
+        return *reinterpret_cast<const OctreeFileHeader*>(base_);
+    }
+
+    [[nodiscard]] const OctreeFileQuantity* quantityTable() const
+    {
+        return reinterpret_cast<const OctreeFileQuantity*>(base_ + sizeof(OctreeFileHeader));
+    }
+
+    template<class T>
+    [[nodiscard]] const T* section(uint64_t offset) const
+    {
+        return reinterpret_cast<const T*>(base_ + offset);
+    }
+
+    [[nodiscard]] const OctreeFileQuantity* findQuantity(const std::string& name) const
+    {
+        for (uint32_t i = 0; i < header().numQuantities; ++i)
+        {
+            if (name == quantityTable()[i].name) { return quantityTable() + i; }
+        }
+        return nullptr;
+    }
+
+    void validate(const std::string& filename) const
+    {
+        const OctreeFileHeader& h = header();
+        if (std::memcmp(h.magic, octreeFileMagic, sizeof(h.magic)) != 0)
+        {
+            throw std::runtime_error(filename + " is not an octree file\n");
+        }
+        if (h.byteOrder != 1) { throw std::runtime_error(filename + ": byte order mismatch\n"); }
+        if (h.version != octreeFileVersion)
+        {
+            throw std::runtime_error(filename + ": unsupported octree file version " + std::to_string(h.version) +
+                                     "\n");
+        }
+        if (h.keySize != sizeof(KeyType) || h.indexSize != sizeof(TreeNodeIndex) ||
+            h.nodeSize != sizeof(OctreeNode<KeyType>))
+        {
+            throw std::runtime_error(filename + ": key or index type mismatch\n");
+        }
+        if (h.fileSize != mappedSize_ ||
+            sizeof(OctreeFileHeader) + h.numQuantities * sizeof(OctreeFileQuantity) > mappedSize_)
+        {
+            throw std::runtime_error(filename + " is truncated\n");
+        }
+
+        uint64_t numNodes = h.numLeafNodes + h.numInternalNodes;
+        auto checkSection = [this, &filename](uint64_t offset, uint64_t numBytes)
+        {
+            if (offset % octreeFileAlignment != 0 || offset + numBytes > mappedSize_)
+            {
+                throw std::runtime_error(filename + ": corrupt section offsets\n");
+            }
+        };
+        checkSection(h.leavesOffset, (h.numLeafNodes + 1) * sizeof(KeyType));
+        checkSection(h.internalOffset, h.numInternalNodes * sizeof(OctreeNode<KeyType>));
+        checkSection(h.leafParentsOffset, h.numLeafNodes * sizeof(TreeNodeIndex));
+        checkSection(h.nodesPerLevelOffset, maxTreeLevel<KeyType>{} * sizeof(TreeNodeIndex));
+        for (uint32_t i = 0; i < h.numQuantities; ++i)
+        {
+            const OctreeFileQuantity& q = quantityTable()[i];
+            if (q.name[sizeof(q.name) - 1] != 0) { throw std::runtime_error(filename + ": corrupt quantity table\n"); }
+            checkSection(q.offset, numNodes * q.elementSize);
+        }
+    }
+
+    const char* base_{nullptr};
+    uint64_t    mappedSize_{0};
+};
+
+} // namespace cstone
@@ -34,8 +34,14 @@
 
 #include <mpi.h>
 
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <vector>
+
 #include "cstone/primitives/mpi_wrappers.hpp"
 #include "cstone/tree/octree.hpp"
+#include "cstone/util/tracing.hpp"
 
 namespace cstone
 {
@@ -46,28 +52,340 @@ namespace cstone
  */
 template <class KeyType>
 bool updateOctreeGlobal(const KeyType *codesStart, const KeyType *codesEnd, unsigned bucketSize,
-                        std::vector<KeyType>& tree, std::vector<unsigned>& counts)
+                        std::vector<KeyType>& tree, std::vector<unsigned>& counts, MPI_Comm comm = MPI_COMM_WORLD)
 {
+    CSTONE_TRACE_RANGE("updateOctreeGlobal");
     int nRanks;
-    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+    MPI_Comm_size(comm, &nRanks);
     unsigned maxCount = std::numeric_limits<unsigned>::max() / nRanks;
 
     bool converged = updateOctree(codesStart, codesEnd, bucketSize, tree, counts, maxCount);
-    MPI_Allreduce(MPI_IN_PLACE, counts.data(), counts.size(), MPI_UNSIGNED, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, counts.data(), counts.size(), MPI_UNSIGNED, MPI_SUM, comm);
 
     return converged;
 }
 
+/*! @brief distribute the leaves of @p tree to @p numRanks contiguous slices that do not split sibling groups
+ *
+ * @return   slice offsets, length numRanks + 1, rank i owns the leaves [offsets[i]:offsets[i+1]]
+ *
+ * The slices are approximately equal in size. Since no group of 8 siblings is split, the rank owning a slice
+ * can take the rebalance decision for all of its leaves, see calculateNodeOp. Depends only on the tree and
+ * is therefore identical on all ranks.
+ */
+template<class KeyType>
+std::vector<TreeNodeIndex> countSliceOffsets(const std::vector<KeyType>& tree, int numRanks)
+{
+    TreeNodeIndex numNodes = nNodes(tree);
+
+    std::vector<TreeNodeIndex> offsets(numRanks + 1);
+    for (int i = 0; i < numRanks; ++i)
+    {
+        TreeNodeIndex offset = TreeNodeIndex(int64_t(numNodes) * i / numRanks);
+        if (offset < numNodes) { offset -= siblingAndLevel(tree.data(), offset)[0]; }
+        offsets[i] = std::max(offset, i > 0 ? offsets[i - 1] : 0);
+    }
+    offsets[numRanks] = numNodes;
+
+    return offsets;
+}
+
+/*! @brief sum up local node counts of all ranks, each rank receives the global counts of its slice of the tree
+ *
+ * @param[in]  tree         global octree, identical on all ranks
+ * @param[in]  localCounts  counts of the local particles in each node of @p tree
+ * @return                  global counts of the nodes in the slice of the executing rank, see countSliceOffsets
+ */
+template<class KeyType>
+std::vector<unsigned> reduceScatterCounts(const std::vector<KeyType>& tree, const std::vector<unsigned>& localCounts,
+                                          MPI_Comm comm = MPI_COMM_WORLD)
+{
+    int rank, numRanks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numRanks);
+
+    std::vector<TreeNodeIndex> offsets = countSliceOffsets(tree, numRanks);
+    std::vector<int> sliceSizes(numRanks);
+    // offsets[0] is zero, therefore the first difference is the size of the first slice
+    std::adjacent_difference(offsets.begin() + 1, offsets.end(), sliceSizes.begin());
+
+    std::vector<unsigned> sliceCounts(sliceSizes[rank]);
+    MPI_Reduce_scatter(localCounts.data(), sliceCounts.data(), sliceSizes.data(), MPI_UNSIGNED, MPI_SUM, comm);
+
+    return sliceCounts;
+}
+
+/*! @brief assemble the global counts of all nodes from the slices of all ranks
+ *
+ * @param[in]  tree         global octree, identical on all ranks
+ * @param[in]  sliceCounts  global counts of the slice of the executing rank, see reduceScatterCounts
+ * @param[out] counts       global counts of all nodes of @p tree
+ */
+template<class KeyType>
+void allgatherCounts(const std::vector<KeyType>& tree, const std::vector<unsigned>& sliceCounts,
+                     std::vector<unsigned>& counts, MPI_Comm comm = MPI_COMM_WORLD)
+{
+    int numRanks;
+    MPI_Comm_size(comm, &numRanks);
+
+    std::vector<TreeNodeIndex> offsets = countSliceOffsets(tree, numRanks);
+    std::vector<int> sliceSizes(numRanks);
+    // offsets[0] is zero, therefore the first difference is the size of the first slice
+    std::adjacent_difference(offsets.begin() + 1, offsets.end(), sliceSizes.begin());
+
+    // MPI displacements are int, the global tree has less than 2^31 nodes
+    std::vector<int> displacements(offsets.begin(), offsets.end());
+
+    counts.resize(nNodes(tree));
+    MPI_Allgatherv(sliceCounts.data(), int(sliceCounts.size()), MPI_UNSIGNED, counts.data(), sliceSizes.data(),
+                   displacements.data(), MPI_UNSIGNED, comm);
+}
+
+/*! @brief perform one global octree update with node counts that are distributed over the ranks
+ *
+ * @param[in]    codesStart   local sorted particle SFC codes start
+ * @param[in]    codesEnd     local sorted particle SFC codes end
+ * @param[in]    bucketSize   maximum number of particles per node
+ * @param[inout] tree         the global octree leaf nodes (cornerstone format), identical on all ranks
+ * @param[inout] sliceCounts  global counts of the nodes in the slice of @p tree owned by the executing rank,
+ *                            see countSliceOffsets. On return, the counts of the slice of the updated tree.
+ * @return                    true if the tree was not modified, false otherwise
+ *
+ * Performs the same update as updateOctreeGlobal, but without replicating the counts on all ranks.
+ * Each rank takes the rebalance decision for its own slice and only the nodes that change are gathered
+ * on all ranks. The counts of the new tree are then summed with a reduce-scatter, which moves half the
+ * data of the allreduce in updateOctreeGlobal. The full counts can be assembled with allgatherCounts
+ * once the tree has converged.
+ */
+template<class KeyType>
+bool updateOctreeGlobalScattered(const KeyType* codesStart, const KeyType* codesEnd, unsigned bucketSize,
+                                 std::vector<KeyType>& tree, std::vector<unsigned>& sliceCounts,
+                                 MPI_Comm comm = MPI_COMM_WORLD)
+{
+    int rank, numRanks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numRanks);
+    unsigned maxCount = std::numeric_limits<unsigned>::max() / numRanks;
+
+    std::vector<TreeNodeIndex> offsets = countSliceOffsets(tree, numRanks);
+    TreeNodeIndex firstNode = offsets[rank];
+    TreeNodeIndex sliceSize = offsets[rank + 1] - firstNode;
+    assert(TreeNodeIndex(sliceCounts.size()) == sliceSize);
+
+    // the slice never splits a sibling group, such that counts outside of the slice are not accessed
+    std::vector<unsigned> counts(nNodes(tree));
+    std::copy(sliceCounts.begin(), sliceCounts.end(), counts.begin() + firstNode);
+
+    std::vector<TreeNodeIndex> changes;
+    for (TreeNodeIndex i = firstNode; i < firstNode + sliceSize; ++i)
+    {
+        int op = calculateNodeOp(tree.data(), i, counts.data(), bucketSize);
+        if (op != 1)
+        {
+            changes.push_back(i);
+            changes.push_back(op);
+        }
+    }
+
+    int numChanges = int(changes.size());
+    std::vector<int> changeCounts(numRanks);
+    MPI_Allgather(&numChanges, 1, MPI_INT, changeCounts.data(), 1, MPI_INT, comm);
+
+    std::vector<int> changeDispls(numRanks + 1, 0);
+    std::partial_sum(changeCounts.begin(), changeCounts.end(), changeDispls.begin() + 1);
+
+    std::vector<TreeNodeIndex> allChanges(changeDispls.back());
+    MPI_Allgatherv(changes.data(), numChanges, MpiType<TreeNodeIndex>{}, allChanges.data(), changeCounts.data(),
+                   changeDispls.data(), MpiType<TreeNodeIndex>{}, comm);
+
+    bool converged = allChanges.empty();
+
+    std::vector<TreeNodeIndex> nodeOps(nNodes(tree) + 1, 1);
+    for (std::size_t i = 0; i < allChanges.size(); i += 2)
+    {
+        nodeOps[allChanges[i]] = allChanges[i + 1];
+    }
+
+    std::vector<KeyType> newTree;
+    rebalanceTree(tree, newTree, nodeOps.data());
+    swap(tree, newTree);
+
+    std::vector<unsigned> localCounts(nNodes(tree));
+    computeNodeCounts(tree.data(), localCounts.data(), nNodes(tree), codesStart, codesEnd, maxCount, true);
+    sliceCounts = reduceScatterCounts(tree, localCounts, comm);
+
+    return converged;
+}
+
+/*! @brief sum up the weights of the particles of all ranks in each node of the global octree
+ *
+ * See documentation of computeNodeWeights, the output @p nodeWeights is identical on all ranks
+ */
+template<class KeyType, class WeightType>
+void computeNodeWeightsGlobal(const KeyType* tree, double* nodeWeights, TreeNodeIndex nNodes,
+                              const KeyType* codesStart, const KeyType* codesEnd, const WeightType* weights,
+                              MPI_Comm comm = MPI_COMM_WORLD)
+{
+    computeNodeWeights(tree, nodeWeights, nNodes, codesStart, codesEnd, weights);
+    MPI_Allreduce(MPI_IN_PLACE, nodeWeights, nNodes, MPI_DOUBLE, MPI_SUM, comm);
+}
+
+/*! @brief iterate updateOctreeGlobalScattered until the global tree has converged
+ *
+ * @param[in]    codesStart  local sorted particle SFC codes start
+ * @param[in]    codesEnd    local sorted particle SFC codes end
+ * @param[in]    bucketSize  maximum number of particles per node
+ * @param[inout] tree        a global octree to start from, identical on all ranks, the converged tree on return
+ * @param[out]   counts      the global octree leaf node particle counts of the converged tree
+ *
+ * @return                  the number of iterations until convergence
+ *
+ * The intermediate trees only need distributed counts, the full counts are gathered once at the end.
+ */
+template<class KeyType>
+int convergeOctreeGlobal(const KeyType* codesStart, const KeyType* codesEnd, unsigned bucketSize,
+                          std::vector<KeyType>& tree, std::vector<unsigned>& counts, MPI_Comm comm = MPI_COMM_WORLD)
+{
+    int nRanks;
+    MPI_Comm_size(comm, &nRanks);
+
+    unsigned maxCount = std::numeric_limits<unsigned>::max() / nRanks;
+    counts.resize(nNodes(tree));
+    computeNodeCounts(tree.data(), counts.data(), nNodes(tree), codesStart, codesEnd, maxCount);
+
+    std::vector<unsigned> sliceCounts = reduceScatterCounts(tree, counts, comm);
+    int numIterations = 1;
+    while (!updateOctreeGlobalScattered(codesStart, codesEnd, bucketSize, tree, sliceCounts, comm))
+    {
+        numIterations++;
+    }
+    allgatherCounts(tree, sliceCounts, counts, comm);
+    return numIterations;
+}
+
+/*! @brief compute the global octree from scratch
+ *
+ * @tparam KeyType           32- or 64-bit unsigned integer for SFC code
+ * @param[in]  codesStart    local sorted particle SFC codes start
+ * @param[in]  codesEnd      local sorted particle SFC codes end
+ * @param[in]  bucketSize    maximum number of particles per node
+ * @param[out] tree          the global octree leaf nodes (cornerstone format), identical on all ranks
+ * @param[out] counts        the global octree leaf node particle counts
+ * @param[in]  comm          communicator of the ranks that share the global octree
+ * @return                   the number of tree update iterations, see convergeOctreeGlobal
+ *
+ * Nodes with more than bucketSize local particles also have more than bucketSize particles globally.
+ * The tree spanned by the union of the split keys of all ranks (see computeSplitKeys) is therefore
+ * a refinement of the global tree in which no node needs to be merged, such that only the nodes
+ * that exceed bucketSize due to particles from multiple ranks are left to be split by updateOctreeGlobal.
+ */
+template<class KeyType>
+int computeOctreeGlobal(const KeyType* codesStart, const KeyType* codesEnd, unsigned bucketSize,
+                         std::vector<KeyType>& tree, std::vector<unsigned>& counts, MPI_Comm comm = MPI_COMM_WORLD)
+{
+    CSTONE_TRACE_RANGE("computeOctreeGlobal");
+    int nRanks;
+    MPI_Comm_size(comm, &nRanks);
+
+    std::vector<KeyType> localSplitKeys = computeSplitKeys(codesStart, codesEnd, bucketSize);
+
+    std::vector<int> numSplitKeys(nRanks);
+    int numLocalSplitKeys = localSplitKeys.size();
+    MPI_Allgather(&numLocalSplitKeys, 1, MPI_INT, numSplitKeys.data(), 1, MPI_INT, comm);
+
+    std::vector<int> displacements(nRanks + 1, 0);
+    std::partial_sum(begin(numSplitKeys), end(numSplitKeys), begin(displacements) + 1);
+
+    std::vector<KeyType> splitKeys(displacements.back());
+    MPI_Allgatherv(localSplitKeys.data(), numLocalSplitKeys, MpiType<KeyType>{}, splitKeys.data(),
+                   numSplitKeys.data(), displacements.data(), MpiType<KeyType>{}, comm);
+
+    std::sort(begin(splitKeys), end(splitKeys));
+    splitKeys.erase(std::unique(begin(splitKeys), end(splitKeys)), end(splitKeys));
+
+    tree = computeSpanningTree(begin(splitKeys), end(splitKeys));
+
+    return convergeOctreeGlobal(codesStart, codesEnd, bucketSize, tree, counts, comm);
+}
+
+/*! @brief compute the global octree from scratch, starting from a tree built from a sample of the keys
+ *
+ * @tparam KeyType           32- or 64-bit unsigned integer for SFC code
+ * @param[in]  codesStart    local sorted particle SFC codes start
+ * @param[in]  codesEnd      local sorted particle SFC codes end
+ * @param[in]  bucketSize    maximum number of particles per node
+ * @param[out] tree          the global octree leaf nodes (cornerstone format), identical on all ranks
+ * @param[out] counts        the global octree leaf node particle counts
+ * @param[in]  maxSamples    upper bound for the total number of keys gathered on all ranks
+ * @return                   the number of tree update iterations, see convergeOctreeGlobal
+ *
+ * computeOctreeGlobal gathers the split keys of all ranks, whose number grows with the number of particles.
+ * Here, each rank contributes every stride-th key of its sorted keys, with a stride chosen such that at most
+ * @p maxSamples keys are gathered. Each sample key stands for stride particles, the tree built from the samples
+ * with a bucket size of bucketSize / stride is therefore close to the final tree and only a few iterations of
+ * updateOctreeGlobalScattered are needed to converge. The resulting tree and counts are identical to those
+ * of computeOctreeGlobal. If the total number of particles does not exceed @p maxSamples,
+ * computeOctreeGlobal is called instead.
+ */
+template<class KeyType>
+int computeOctreeGlobalSampled(const KeyType* codesStart, const KeyType* codesEnd, unsigned bucketSize,
+                                std::vector<KeyType>& tree, std::vector<unsigned>& counts,
+                                std::size_t maxSamples = std::size_t(1) << 20, MPI_Comm comm = MPI_COMM_WORLD)
+{
+    CSTONE_TRACE_RANGE("computeOctreeGlobalSampled");
+    int nRanks;
+    MPI_Comm_size(comm, &nRanks);
+
+    std::size_t numLocalKeys = codesEnd - codesStart;
+    uint64_t numKeys         = numLocalKeys;
+    MPI_Allreduce(MPI_IN_PLACE, &numKeys, 1, MPI_UINT64_T, MPI_SUM, comm);
+
+    if (numKeys <= maxSamples)
+    {
+        return computeOctreeGlobal(codesStart, codesEnd, bucketSize, tree, counts, comm);
+    }
+
+    std::size_t stride = (numKeys + maxSamples - 1) / maxSamples;
+
+    // regular sample of the local keys, starting half a stride into the sequence
+    std::vector<KeyType> localSamples;
+    localSamples.reserve(numLocalKeys / stride + 1);
+    for (std::size_t i = stride / 2; i < numLocalKeys; i += stride)
+    {
+        localSamples.push_back(codesStart[i]);
+    }
+
+    std::vector<int> numSamples(nRanks);
+    int numLocalSamples = localSamples.size();
+    MPI_Allgather(&numLocalSamples, 1, MPI_INT, numSamples.data(), 1, MPI_INT, comm);
+
+    std::vector<int> displacements(nRanks + 1, 0);
+    std::partial_sum(begin(numSamples), end(numSamples), begin(displacements) + 1);
+
+    std::vector<KeyType> samples(displacements.back());
+    MPI_Allgatherv(localSamples.data(), numLocalSamples, MpiType<KeyType>{}, samples.data(), numSamples.data(),
+                   displacements.data(), MpiType<KeyType>{}, comm);
+    std::sort(begin(samples), end(samples));
+
+    unsigned sampleBucketSize = std::max(std::size_t(1), bucketSize / stride);
+    std::vector<KeyType> splitKeys =
+        computeSplitKeys(samples.data(), samples.data() + samples.size(), sampleBucketSize);
+    tree = computeSpanningTree(begin(splitKeys), end(splitKeys));
+
+    return convergeOctreeGlobal(codesStart, codesEnd, bucketSize, tree, counts, comm);
+}
+
 /*! @brief Compute the global maximum value of a given input array for each node in the global or local octree
  *
  * See documentation of computeHaloRadii
  */
 template <class Tin, class Tout, class KeyType, class IndexType>
 void computeHaloRadiiGlobal(const KeyType *tree, int nNodes, const KeyType *codesStart, const KeyType *codesEnd,
-                            const IndexType *ordering, const Tin *input, Tout *output)
+                            const IndexType *ordering, const Tin *input, Tout *output, MPI_Comm comm = MPI_COMM_WORLD)
 {
+    CSTONE_TRACE_RANGE("computeHaloRadiiGlobal");
     computeHaloRadii(tree, nNodes, codesStart, codesEnd, ordering, input, output);
-    MPI_Allreduce(MPI_IN_PLACE, output, nNodes, MpiType<Tout>{}, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, output, nNodes, MpiType<Tout>{}, MPI_MAX, comm);
 }
 
 } // namespace cstone
@@ -0,0 +1,154 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Batched spatial queries on the GPU, see range_query.hpp
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * The traversal layout of the host octree is uploaded once per call, each query is then traversed by one thread.
+ */
+
+#pragma once
+
+#include <thrust/device_vector.h>
+#include <thrust/scan.h>
+
+#include "cstone/util/util.hpp"
+#include "range_query.hpp"
+
+namespace cstone
+{
+
+//! @brief particle index ranges of a batch of queries in compressed row format, in device memory
+template<class LocalIndex>
+struct DeviceParticleRangeLists
+{
+    //! @brief the ranges of query i are [rangeStarts[j]:rangeEnds[j]] for j in [offsets[i]:offsets[i+1]]
+    thrust::device_vector<std::size_t> offsets;
+    thrust::device_vector<LocalIndex>  rangeStarts;
+    thrust::device_vector<LocalIndex>  rangeEnds;
+};
+
+//! @brief count the ranges of each query, one thread per query
+template<class KeyType, class SfcKind, class LocalIndex, class T, class Query>
+__global__ void countRangesKernel(TraversalOctreeView<KeyType> tree, const KeyType* leaves, TreeNodeIndex numLeaves,
+                                  const LocalIndex* layout, const T* x, const T* y, const T* z, Box<T> box,
+                                  const Query* queries, std::size_t numQueries, std::size_t* counts)
+{
+    std::size_t i = blockDim.x * blockIdx.x + threadIdx.x;
+    if (i >= numQueries) { return; }
+
+    std::size_t numRanges = 0;
+    rangeQuery<KeyType, SfcKind>(tree, leaves, numLeaves, layout, x, y, z, box, queries[i],
+                                 [&numRanges](LocalIndex, LocalIndex) { numRanges++; });
+    counts[i] = numRanges;
+}
+
+//! @brief store the ranges of each query at the offsets obtained from countRangesKernel
+template<class KeyType, class SfcKind, class LocalIndex, class T, class Query>
+__global__ void fillRangesKernel(TraversalOctreeView<KeyType> tree, const KeyType* leaves, TreeNodeIndex numLeaves,
+                                 const LocalIndex* layout, const T* x, const T* y, const T* z, Box<T> box,
+                                 const Query* queries, std::size_t numQueries, const std::size_t* offsets,
+                                 LocalIndex* rangeStarts, LocalIndex* rangeEnds)
+{
+    std::size_t i = blockDim.x * blockIdx.x + threadIdx.x;
+    if (i >= numQueries) { return; }
+
+    LocalIndex* starts = rangeStarts + offsets[i];
+    LocalIndex* ends   = rangeEnds + offsets[i];
+    rangeQuery<KeyType, SfcKind>(tree, leaves, numLeaves, layout, x, y, z, box, queries[i],
+                                 [&starts, &ends](LocalIndex start, LocalIndex end)
+                                 {
+                                     *starts++ = start;
+                                     *ends++   = end;
+                                 });
+}
+
+/*! @brief find the particles inside each of a batch of query regions on the GPU
+ *
+ * @param[in]  octree      host octree, including internal part
+ * @param[in]  d_layout    device array of leaf particle offsets, length = octree.numLeafNodes() + 1
+ * @param[in]  d_x,d_y,d_z device arrays with particle coordinates, sorted in SFC order
+ * @param[in]  box         global coordinate bounding box
+ * @param[in]  d_queries   device array of QueryBox or QuerySphere regions, length = @p numQueries
+ * @param[in]  numQueries  number of queries
+ * @param[out] result      particle index ranges per query in device memory
+ *
+ * The result is identical to the one of queryParticleRanges.
+ */
+template<class KeyType, class SfcKind = KeyType, class LocalIndex, class T, class Query>
+void queryParticleRangesGpu(const Octree<KeyType>& octree, const LocalIndex* d_layout, const T* d_x, const T* d_y,
+                            const T* d_z, const Box<T>& box, const Query* d_queries, std::size_t numQueries,
+                            DeviceParticleRangeLists<LocalIndex>& result)
+{
+    constexpr unsigned numThreads = 128;
+
+    TraversalOctreeView<KeyType> hostTree = octree.traversalTree().data();
+    TreeNodeIndex numNodes                = hostTree.numNodes;
+    gsl::span<const KeyType> leaves       = octree.treeLeaves();
+
+    thrust::device_vector<KeyType>       d_keys(hostTree.keys, hostTree.keys + numNodes);
+    thrust::device_vector<uint8_t>       d_levels(hostTree.levels, hostTree.levels + numNodes);
+    thrust::device_vector<TreeNodeIndex> d_firstChild(hostTree.firstChild, hostTree.firstChild + numNodes);
+    thrust::device_vector<TreeNodeIndex> d_escape(hostTree.escapeIndex, hostTree.escapeIndex + numNodes);
+    thrust::device_vector<TreeNodeIndex> d_octreeIdx(hostTree.octreeIdx, hostTree.octreeIdx + numNodes);
+    thrust::device_vector<KeyType>       d_leaves(leaves.begin(), leaves.end());
+
+    TraversalOctreeView<KeyType> tree{thrust::raw_pointer_cast(d_keys.data()),
+                                      thrust::raw_pointer_cast(d_levels.data()),
+                                      thrust::raw_pointer_cast(d_firstChild.data()),
+                                      thrust::raw_pointer_cast(d_escape.data()),
+                                      thrust::raw_pointer_cast(d_octreeIdx.data()),
+                                      numNodes,
+                                      hostTree.numInternalNodes};
+    const KeyType* leavesPtr = thrust::raw_pointer_cast(d_leaves.data());
+    TreeNodeIndex numLeaves  = octree.numLeafNodes();
+
+    result.offsets.resize(numQueries + 1);
+    result.offsets[numQueries] = 0;
+    if (numQueries > 0)
+    {
+        countRangesKernel<KeyType, SfcKind><<<iceil(numQueries, numThreads), numThreads>>>(
+            tree, leavesPtr, numLeaves, d_layout, d_x, d_y, d_z, box, d_queries, numQueries,
+            thrust::raw_pointer_cast(result.offsets.data()));
+    }
+    thrust::exclusive_scan(result.offsets.begin(), result.offsets.end(), result.offsets.begin());
+
+    std::size_t numRanges = result.offsets.back();
+    result.rangeStarts.resize(numRanges);
+    result.rangeEnds.resize(numRanges);
+
+    if (numQueries > 0)
+    {
+        fillRangesKernel<KeyType, SfcKind><<<iceil(numQueries, numThreads), numThreads>>>(
+            tree, leavesPtr, numLeaves, d_layout, d_x, d_y, d_z, box, d_queries, numQueries,
+            thrust::raw_pointer_cast(result.offsets.data()), thrust::raw_pointer_cast(result.rangeStarts.data()),
+            thrust::raw_pointer_cast(result.rangeEnds.data()));
+    }
+    cudaDeviceSynchronize();
+}
+
+} // namespace cstone
@@ -0,0 +1,302 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Batched spatial queries that return the particles inside boxes or spheres as index ranges
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * Particles sorted along the SFC of an octree occupy a contiguous index range per tree node, given by the layout,
+ * i.e. the particle offset of each leaf. A query therefore traverses the octree and reports
+ *
+ *  - the index range of any node that is fully contained in the query region, without descending further,
+ *  - the particles inside the query region of each leaf that only partially overlaps it.
+ *
+ * Adjacent ranges are fused, such that the result for each query is a minimal list of ascending, disjoint
+ * index ranges. Results of a batch of queries are stored in compressed row format, with each query
+ * traversed twice, first to count the ranges, then to store them.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "cstone/cuda/annotation.hpp"
+#include "cstone/primitives/stl.hpp"
+#include "cstone/tree/macs.hpp"
+#include "cstone/tree/traversal.hpp"
+
+namespace cstone
+{
+
+//! @brief an axis aligned query box
+template<class T>
+struct QueryBox
+{
+    T xmin, xmax, ymin, ymax, zmin, zmax;
+};
+
+//! @brief a spherical query region
+template<class T>
+struct QuerySphere
+{
+    T x, y, z, radius;
+};
+
+//! @brief the relation of a tree node or particle to a query region
+enum class QueryOverlap : int
+{
+    none,
+    partial,
+    full
+};
+
+namespace detail
+{
+
+//! @brief center and half edge lengths of an octree node in floating point coordinates
+template<class T>
+struct NodeExtent
+{
+    T x, y, z, hx, hy, hz;
+};
+
+template<class KeyType, class T>
+CUDA_HOST_DEVICE_FUN NodeExtent<T> nodeExtent(IBox b, const Box<T>& box)
+{
+    constexpr T unitLength = T(1.) / (1u << maxTreeLevel<KeyType>{});
+
+    ExpansionCenter<T> center = geometricCenter<KeyType>(b, box);
+    return {center.x,
+            center.y,
+            center.z,
+            T(0.5) * (b.xmax() - b.xmin()) * unitLength * box.lx(),
+            T(0.5) * (b.ymax() - b.ymin()) * unitLength * box.ly(),
+            T(0.5) * (b.zmax() - b.zmin()) * unitLength * box.lz()};
+}
+
+//! @brief distance between @p a and the nearest periodic image of @p b along one dimension
+template<class T>
+CUDA_HOST_DEVICE_FUN T pbcAbsDistance(T a, T b, T length, bool pbc)
+{
+    T d = b - a;
+    if (pbc) { d -= length * std::rint(d / length); }
+    return std::abs(d);
+}
+
+} // namespace detail
+
+/*! @brief relation of the node @p n to the query box @p q
+ *
+ * With periodic boundaries, the box is wrapped around, which requires the query edge lengths to be
+ * smaller than half of the corresponding global box lengths.
+ */
+template<class T>
+CUDA_HOST_DEVICE_FUN QueryOverlap queryOverlap(const QueryBox<T>& q, const detail::NodeExtent<T>& n,
+                                               const Box<T>& box)
+{
+    T qhx = T(0.5) * (q.xmax - q.xmin);
+    T qhy = T(0.5) * (q.ymax - q.ymin);
+    T qhz = T(0.5) * (q.zmax - q.zmin);
+
+    T dx = detail::pbcAbsDistance(q.xmin + qhx, n.x, box.lx(), box.pbcX());
+    T dy = detail::pbcAbsDistance(q.ymin + qhy, n.y, box.ly(), box.pbcY());
+    T dz = detail::pbcAbsDistance(q.zmin + qhz, n.z, box.lz(), box.pbcZ());
+
+    if (dx > qhx + n.hx || dy > qhy + n.hy || dz > qhz + n.hz) { return QueryOverlap::none; }
+    if (dx + n.hx <= qhx && dy + n.hy <= qhy && dz + n.hz <= qhz) { return QueryOverlap::full; }
+    return QueryOverlap::partial;
+}
+
+/*! @brief relation of the node @p n to the query sphere @p q
+ *
+ * With periodic boundaries, the distance to the nearest image of the sphere center is used,
+ * which requires the query diameter to be smaller than half of the global box lengths.
+ */
+template<class T>
+CUDA_HOST_DEVICE_FUN QueryOverlap queryOverlap(const QuerySphere<T>& q, const detail::NodeExtent<T>& n,
+                                               const Box<T>& box)
+{
+    T dx = detail::pbcAbsDistance(q.x, n.x, box.lx(), box.pbcX());
+    T dy = detail::pbcAbsDistance(q.y, n.y, box.ly(), box.pbcY());
+    T dz = detail::pbcAbsDistance(q.z, n.z, box.lz(), box.pbcZ());
+
+    T minX = stl::max(dx - n.hx, T(0)), minY = stl::max(dy - n.hy, T(0)), minZ = stl::max(dz - n.hz, T(0));
+    T radiusSq = q.radius * q.radius;
+
+    if (minX * minX + minY * minY + minZ * minZ > radiusSq) { return QueryOverlap::none; }
+
+    T maxX = dx + n.hx, maxY = dy + n.hy, maxZ = dz + n.hz;
+    if (maxX * maxX + maxY * maxY + maxZ * maxZ <= radiusSq) { return QueryOverlap::full; }
+    return QueryOverlap::partial;
+}
+
+//! @brief true if the point @p x, @p y, @p z lies inside the query region @p q
+template<class Query, class T>
+CUDA_HOST_DEVICE_FUN bool queryContains(const Query& q, T x, T y, T z, const Box<T>& box)
+{
+    return queryOverlap(q, detail::NodeExtent<T>{x, y, z, T(0), T(0), T(0)}, box) == QueryOverlap::full;
+}
+
+/*! @brief find the particles of one query region as a list of index ranges
+ *
+ * @tparam KeyType      32- or 64-bit unsigned integer
+ * @tparam SfcKind      SFC used to construct the tree, see sfc.hpp
+ * @param  tree         traversal layout of the octree, see Octree::traversalTree()
+ * @param  leaves       cornerstone leaf keys of the octree, length = @p numLeaves + 1
+ * @param  numLeaves    number of leaves
+ * @param  layout       particle offset of each leaf, length = @p numLeaves + 1
+ * @param  x,y,z        particle coordinates, sorted in SFC order
+ * @param  box          global coordinate bounding box
+ * @param  query        a QueryBox or QuerySphere
+ * @param  emit         called with (start, end) for each index range [start:end] in ascending order
+ *
+ * Ranges that are contiguous are fused before they are passed to @p emit.
+ */
+template<class KeyType, class SfcKind = KeyType, class Tree, class LocalIndex, class T, class Query, class F>
+CUDA_HOST_DEVICE_FUN void rangeQuery(const Tree& tree, const KeyType* leaves, TreeNodeIndex numLeaves,
+                                     const LocalIndex* layout, const T* x, const T* y, const T* z,
+                                     const Box<T>& box, const Query& query, F&& emit)
+{
+    // nodes are visited in SFC order, therefore the ranges are ascending
+    LocalIndex pendingStart = 0, pendingEnd = 0;
+    auto append = [&pendingStart, &pendingEnd, &emit](LocalIndex start, LocalIndex end)
+    {
+        if (start == end) { return; }
+        if (start != pendingEnd)
+        {
+            if (pendingEnd > pendingStart) { emit(pendingStart, pendingEnd); }
+            pendingStart = start;
+        }
+        pendingEnd = end;
+    };
+
+    auto descend = [&tree, leaves, numLeaves, layout, &box, &query, &append](TreeNodeIndex node)
+    {
+        KeyType nodeStart = tree.codeStart(node);
+        KeyType nodeEnd   = tree.codeEnd(node);
+
+        IBox nodeBox = makeIBox<KeyType, SfcKind>(nodeStart, nodeEnd);
+        QueryOverlap overlap = queryOverlap(query, detail::nodeExtent<KeyType>(nodeBox, box), box);
+
+        if (overlap == QueryOverlap::full)
+        {
+            // the leaves of the subtree of node are the ones within its key range
+            TreeNodeIndex firstLeaf = stl::lower_bound(leaves, leaves + numLeaves, nodeStart) - leaves;
+            TreeNodeIndex lastLeaf  = stl::lower_bound(leaves + firstLeaf, leaves + numLeaves + 1, nodeEnd) - leaves;
+            append(layout[firstLeaf], layout[lastLeaf]);
+        }
+        return overlap == QueryOverlap::partial;
+    };
+
+    auto partialLeaf = [layout, x, y, z, &box, &query, &append](TreeNodeIndex leaf)
+    {
+        for (LocalIndex i = layout[leaf]; i < layout[leaf + 1]; ++i)
+        {
+            if (queryContains(query, x[i], y[i], z[i], box)) { append(i, i + 1); }
+        }
+    };
+
+    singleTraversalStackless(tree, descend, partialLeaf);
+    if (pendingEnd > pendingStart) { emit(pendingStart, pendingEnd); }
+}
+
+//! @brief particle index ranges of a batch of queries in compressed row format
+template<class LocalIndex>
+struct ParticleRangeLists
+{
+    //! @brief the ranges of query i are [rangeStarts[j]:rangeEnds[j]] for j in [offsets[i]:offsets[i+1]]
+    std::vector<std::size_t> offsets;
+    std::vector<LocalIndex>  rangeStarts;
+    std::vector<LocalIndex>  rangeEnds;
+
+    //! @brief total number of particles found by query @p i
+    [[nodiscard]] std::size_t count(std::size_t i) const
+    {
+        std::size_t sum = 0;
+        for (std::size_t j = offsets[i]; j < offsets[i + 1]; ++j)
+        {
+            sum += rangeEnds[j] - rangeStarts[j];
+        }
+        return sum;
+    }
+};
+
+/*! @brief find the particles inside each of a batch of query regions
+ *
+ * @tparam KeyType         32- or 64-bit unsigned integer
+ * @tparam SfcKind         SFC used to construct @p octree, see sfc.hpp
+ * @param[in]  octree      octree, including internal part
+ * @param[in]  layout      particle offset of each leaf, length = octree.numLeafNodes() + 1
+ * @param[in]  x,y,z       particle coordinates, sorted in SFC order
+ * @param[in]  box         global coordinate bounding box
+ * @param[in]  queries     QueryBox or QuerySphere regions, length = @p numQueries
+ * @param[in]  numQueries  number of queries
+ * @param[out] result      particle index ranges per query, existing allocations are reused
+ *
+ * In a Domain, the focus tree octree and the layout of the domain arrays, including halos, can be used.
+ */
+template<class KeyType, class SfcKind = KeyType, class LocalIndex, class T, class Query>
+void queryParticleRanges(const Octree<KeyType>& octree, const LocalIndex* layout, const T* x, const T* y,
+                         const T* z, const Box<T>& box, const Query* queries, std::size_t numQueries,
+                         ParticleRangeLists<LocalIndex>& result)
+{
+    TraversalOctreeView<KeyType> tree = octree.traversalTree().data();
+    const KeyType* leaves             = octree.treeLeaves().data();
+    TreeNodeIndex numLeaves           = octree.numLeafNodes();
+
+    result.offsets.resize(numQueries + 1);
+    result.offsets[0] = 0;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (std::size_t i = 0; i < numQueries; ++i)
+    {
+        std::size_t numRanges = 0;
+        rangeQuery<KeyType, SfcKind>(tree, leaves, numLeaves, layout, x, y, z, box, queries[i],
+                                     [&numRanges](LocalIndex, LocalIndex) { numRanges++; });
+        result.offsets[i + 1] = numRanges;
+    }
+
+    std::partial_sum(result.offsets.begin(), result.offsets.end(), result.offsets.begin());
+    result.rangeStarts.resize(result.offsets.back());
+    result.rangeEnds.resize(result.offsets.back());
+
+    #pragma omp parallel for schedule(dynamic)
+    for (std::size_t i = 0; i < numQueries; ++i)
+    {
+        LocalIndex* starts = result.rangeStarts.data() + result.offsets[i];
+        LocalIndex* ends   = result.rangeEnds.data() + result.offsets[i];
+        rangeQuery<KeyType, SfcKind>(tree, leaves, numLeaves, layout, x, y, z, box, queries[i],
+                                     [&starts, &ends](LocalIndex start, LocalIndex end)
+                                     {
+                                         *starts++ = start;
+                                         *ends++   = end;
+                                     });
+    }
+}
+
+} // namespace cstone
@@ -0,0 +1,152 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Compact particle coordinates relative to the corners of their octree leaf cells
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * Within a leaf cell, the position of a particle relative to the lower cell corner is bounded by the cell size.
+ * Such offsets can be stored as float or as 16-bit fixed-point fractions of the cell edge length without losing
+ * significant precision compared to the cell size, which halves or quarters the memory traffic compared to
+ * double precision coordinates. The corners of the cells follow exactly from their SFC keys and the global
+ * bounding box, such that the separation of particles in different cells is recovered as an exact corner
+ * difference plus the difference of the offsets.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+#include "cstone/halos/boxoverlap.hpp"
+#include "cstone/primitives/stl.hpp"
+#include "cstone/tree/definitions.h"
+
+namespace cstone
+{
+
+//! @brief lower corner and edge lengths of a cell in floating point coordinates
+template<class T>
+struct CellFrame
+{
+    T x, y, z;
+    T lx, ly, lz;
+};
+
+//! @brief the frame of the cell with integer coordinates @p ibox
+template<class KeyType, class T>
+CUDA_HOST_DEVICE_FUN CellFrame<T> cellFrame(IBox ibox, const Box<T>& box)
+{
+    constexpr T unitLength = T(1.) / (1u << maxTreeLevel<KeyType>{});
+
+    return {box.xmin() + ibox.xmin() * unitLength * box.lx(),
+            box.ymin() + ibox.ymin() * unitLength * box.ly(),
+            box.zmin() + ibox.zmin() * unitLength * box.lz(),
+            (ibox.xmax() - ibox.xmin()) * unitLength * box.lx(),
+            (ibox.ymax() - ibox.ymin()) * unitLength * box.ly(),
+            (ibox.zmax() - ibox.zmin()) * unitLength * box.lz()};
+}
+
+/*! @brief floating point displacement from the lower corner of cell @p a to the lower corner of cell @p b
+ *
+ * The lengths of the returned frame are the edge lengths of @p b. The displacement is evaluated in integer
+ * coordinates, it is therefore exact up to the final conversion.
+ */
+template<class KeyType, class T>
+CUDA_HOST_DEVICE_FUN CellFrame<T> cellShift(IBox a, IBox b, const Box<T>& box)
+{
+    constexpr T unitLength = T(1.) / (1u << maxTreeLevel<KeyType>{});
+
+    return {(b.xmin() - a.xmin()) * unitLength * box.lx(),
+            (b.ymin() - a.ymin()) * unitLength * box.ly(),
+            (b.zmin() - a.zmin()) * unitLength * box.lz(),
+            (b.xmax() - b.xmin()) * unitLength * box.lx(),
+            (b.ymax() - b.ymin()) * unitLength * box.ly(),
+            (b.zmax() - b.zmin()) * unitLength * box.lz()};
+}
+
+/*! @brief store the offset of a coordinate from the lower cell corner in the compact type @p OffsetType
+ *
+ * @tparam OffsetType   float or uint16_t, in the latter case the offset is stored in units of cellLength / 65535
+ * @param  offset       coordinate minus the lower cell corner, in [0:cellLength]
+ * @param  cellLength   the edge length of the cell
+ */
+template<class OffsetType, class T>
+CUDA_HOST_DEVICE_FUN OffsetType encodeCellOffset(T offset, T cellLength)
+{
+    static_assert(std::is_same_v<OffsetType, float> || std::is_same_v<OffsetType, uint16_t>,
+                  "cell offsets are stored as float or uint16_t\n");
+
+    if constexpr (std::is_same_v<OffsetType, float>) { return float(offset); }
+    else
+    {
+        T fraction = std::rint(offset / cellLength * T(65535));
+        return uint16_t(stl::min(stl::max(fraction, T(0)), T(65535)));
+    }
+}
+
+//! @brief inverse of encodeCellOffset
+template<class T, class OffsetType>
+CUDA_HOST_DEVICE_FUN T decodeCellOffset(OffsetType offset, T cellLength)
+{
+    if constexpr (std::is_same_v<OffsetType, float>) { return T(offset); }
+    else { return T(offset) * (cellLength * T(1. / 65535)); }
+}
+
+/*! @brief compute the compact coordinate mirror of the particles in the leaves of an octree
+ *
+ * @tparam KeyType          32- or 64-bit unsigned integer
+ * @tparam SfcKind          SFC used to construct @p leaves, see sfc.hpp
+ * @tparam OffsetType       float or uint16_t, see encodeCellOffset
+ * @param[in]  leaves       cornerstone leaf keys, length @p numLeaves + 1
+ * @param[in]  numLeaves    number of leaf cells
+ * @param[in]  layout       particle index offset of each leaf, length @p numLeaves + 1
+ * @param[in]  x,y,z        particle coordinates in SFC order
+ * @param[in]  box          coordinate bounding box that was used to compute the SFC keys
+ * @param[out] rx,ry,rz     offsets of the particles from the lower corner of their leaf, indexed like x,y,z
+ *
+ * The mirror has to be recomputed when particles move or when the leaves change.
+ */
+template<class KeyType, class SfcKind = KeyType, class T, class LocalIndex, class OffsetType>
+void computeCellRelativeCoordinates(const KeyType* leaves, TreeNodeIndex numLeaves, const LocalIndex* layout,
+                                    const T* x, const T* y, const T* z, const Box<T>& box, OffsetType* rx,
+                                    OffsetType* ry, OffsetType* rz)
+{
+    #pragma omp parallel for schedule(static)
+    for (TreeNodeIndex leafIdx = 0; leafIdx < numLeaves; ++leafIdx)
+    {
+        CellFrame<T> frame = cellFrame<KeyType>(makeIBox<KeyType, SfcKind>(leaves[leafIdx], leaves[leafIdx + 1]), box);
+        for (LocalIndex i = layout[leafIdx]; i < layout[leafIdx + 1]; ++i)
+        {
+            rx[i] = encodeCellOffset<OffsetType>(x[i] - frame.x, frame.lx);
+            ry[i] = encodeCellOffset<OffsetType>(y[i] - frame.y, frame.ly);
+            rz[i] = encodeCellOffset<OffsetType>(z[i] - frame.z, frame.lz);
+        }
+    }
+}
+
+} // namespace cstone
@@ -37,10 +37,10 @@
 namespace cstone
 {
 
-template<class KeyType>
+template<class KeyType, class SfcKind = KeyType>
 inline bool overlapNode(const Octree<KeyType>& octree, TreeNodeIndex nodeIndex, const IBox& collisionBox)
 {
-    return overlap(octree.codeStart(nodeIndex), 3 * octree.level(nodeIndex), collisionBox);
+    return overlap<KeyType, SfcKind>(octree.codeStart(nodeIndex), 3 * octree.level(nodeIndex), collisionBox);
 }
 
 //constexpr int maxCoord = 1u<<maxTreeLevel<KeyType>{};
@@ -68,8 +68,15 @@ inline bool overlapNode(const Octree<KeyType>& octree, TreeNodeIndex nodeIndex,
 //    return;
 //}
 
-template <class KeyType, class C, class A>
-void singleTraversal(const Octree<KeyType>& octree, C&& continuationCriterion, A&& endpointAction)
+/*! @brief Generic single traversal of a tree
+ *
+ * @tparam Tree                   Octree or TraversalOctree
+ * @param octree                  traversable octree
+ * @param continuationCriterion   callable with signature bool(TreeNodeIndex), descend into the node if true
+ * @param endpointAction          called with the leaf index of each leaf node that passed @p continuationCriterion
+ */
+template <class Tree, class C, class A>
+void singleTraversal(const Tree& octree, C&& continuationCriterion, A&& endpointAction)
 {
     if (!continuationCriterion(0) || octree.isLeaf(0))
     {
@@ -84,7 +91,6 @@ void singleTraversal(const Octree<KeyType>& octree, C&& continuationCriterion, A
     TreeNodeIndex stackPos = 1;
     TreeNodeIndex node     = 0; // start at the root
 
-    TreeNodeIndex internalNodes = octree.numInternalNodes();
     do
     {
         for (int octant = 0; octant < 8; ++octant)
@@ -95,7 +101,7 @@ void singleTraversal(const Octree<KeyType>& octree, C&& continuationCriterion, A
             {
                 if (octree.isLeaf(child))
                 {
-                    endpointAction(child - internalNodes);
+                    endpointAction(octree.toLeaf(child));
                 }
                 else
                 {
@@ -116,7 +122,7 @@ void singleTraversal(const Octree<KeyType>& octree, C&& continuationCriterion, A
  * for FMM, general collision detection for halo discovery and surface detection.
  *
  *
- * @tparam KeyType         32- or 64-bit unsigned integer
+ * @tparam Tree            Octree or TraversalOctree
  * @tparam MAC             traversal continuation criterion
  * @tparam M2L             endpoint action for nodes that passed @p MAC
  * @tparam P2P             endpoint action for leaf nodes that did not pass @p MAC
@@ -132,8 +138,8 @@ void singleTraversal(const Octree<KeyType>& octree, C&& continuationCriterion, A
  * @param p2p              Particle-2-particle, called for each pair of leaf nodes during traversal
  *                         that did not pass @p continuation
  */
-template <class KeyType, class MAC, class M2L, class P2P>
-void dualTraversal(const Octree<KeyType>& octree, TreeNodeIndex a, TreeNodeIndex b,
+template <class Tree, class MAC, class M2L, class P2P>
+void dualTraversal(const Tree& octree, TreeNodeIndex a, TreeNodeIndex b,
                    MAC&& continuation, M2L&& m2l, P2P&& p2p)
 {
     using NodePair = pair<TreeNodeIndex>;
@@ -185,4 +191,123 @@ void dualTraversal(const Octree<KeyType>& octree, TreeNodeIndex a, TreeNodeIndex
     }
 }
 
+/*! @brief Task-parallel dual traversal of a tree with OpenMP tasks
+ *
+ * @param taskDepth   number of refinement steps of the node pair (a, b) for which child pairs
+ *                    are processed as separate tasks, below that, dualTraversal is used
+ *
+ * Other arguments and semantics as dualTraversal. This function generates OpenMP tasks and needs to be
+ * called from inside a parallel region, typically by a single thread. All generated tasks have completed
+ * when the function returns. Node pairs with large subtrees are thus distributed dynamically among the threads
+ * of the team. @p continuation, @p m2l and @p p2p are called concurrently from different threads.
+ */
+template<class Tree, class MAC, class M2L, class P2P>
+void dualTraversalTasks(const Tree& octree, TreeNodeIndex a, TreeNodeIndex b, MAC&& continuation, M2L&& m2l,
+                        P2P&& p2p, int taskDepth = 4)
+{
+    if (taskDepth == 0 || (octree.isLeaf(a) && octree.isLeaf(b)))
+    {
+        dualTraversal(octree, a, b, continuation, m2l, p2p);
+        return;
+    }
+
+    auto interact = [&octree, &continuation, &m2l, &p2p, taskDepth](TreeNodeIndex a, TreeNodeIndex b)
+    {
+        if (continuation(a, b))
+        {
+            if (octree.isLeaf(a) && octree.isLeaf(b)) { p2p(a, b); }
+            else
+            {
+                #pragma omp task default(shared) firstprivate(a, b)
+                dualTraversalTasks(octree, a, b, continuation, m2l, p2p, taskDepth - 1);
+            }
+        }
+        else { m2l(a, b); }
+    };
+
+    if ((octree.level(a) < octree.level(b) && !octree.isLeaf(a)) || octree.isLeaf(b))
+    {
+        for (int octant = 0; octant < 8; ++octant)
+        {
+            interact(octree.child(a, octant), b);
+        }
+    }
+    else
+    {
+        for (int octant = 0; octant < 8; ++octant)
+        {
+            interact(a, octree.child(b, octant));
+        }
+    }
+
+    // child tasks refer to the arguments of this call
+    #pragma omp taskwait
+}
+
+/*! @brief Stackless single traversal of a tree with escape indices
+ *
+ * @tparam Tree                   TraversalOctree or TraversalOctreeView
+ * @param tree                    traversable octree with escape indices
+ * @param continuationCriterion   callable with signature bool(TreeNodeIndex), descend into the node if true
+ * @param endpointAction          called with the leaf index of each leaf node that passed @p continuationCriterion
+ *
+ * Visits the same nodes as singleTraversal in depth-first pre-order. Instead of a stack, the traversal
+ * proceeds to the first child of nodes that pass @p continuationCriterion and to the escape index otherwise.
+ * Memory use is therefore constant and independent of the tree depth, which makes this function suitable
+ * for use in device code with one traversal per thread.
+ */
+template<class Tree, class C, class A>
+CUDA_HOST_DEVICE_FUN void singleTraversalStackless(const Tree& tree, C&& continuationCriterion, A&& endpointAction)
+{
+    TreeNodeIndex numNodes = tree.numTreeNodes();
+    TreeNodeIndex node     = 0;
+
+    while (node != numNodes)
+    {
+        if (continuationCriterion(node))
+        {
+            if (!tree.isLeaf(node))
+            {
+                node = tree.child(node, 0);
+                continue;
+            }
+            endpointAction(tree.toLeaf(node));
+        }
+        node = tree.escape(node);
+    }
+}
+
+/*! @brief Stackless traversal of a tree paired with a single node
+ *
+ * @tparam Tree            TraversalOctree or TraversalOctreeView
+ * @param tree             traversable octree with escape indices
+ * @param target           node index of @p tree that is paired with the nodes encountered during traversal
+ * @param continuation     callable with signature bool(TreeNodeIndex, TreeNodeIndex), descend into the
+ *                         second node if true
+ * @param m2l              called for each pair (target, source) that did not pass @p continuation
+ * @param p2p              called for each pair (target, source) that passed @p continuation with a leaf source
+ *
+ * Only the source side is refined. Compared to dualTraversal, the node pairs are therefore processed with
+ * one traversal per target node, e.g. one per leaf, which is the natural decomposition into independent
+ * tasks on GPUs. For target leaves and a continuation criterion that is monotonic under refinement of either
+ * node, the p2p pairs are identical to the ones of dualTraversal.
+ */
+template<class Tree, class MAC, class M2L, class P2P>
+CUDA_HOST_DEVICE_FUN void dualTraversalStackless(const Tree& tree, TreeNodeIndex target, MAC&& continuation,
+                                                 M2L&& m2l, P2P&& p2p)
+{
+    auto criterion = [target, &tree, &continuation, &m2l, &p2p](TreeNodeIndex source)
+    {
+        if (!continuation(target, source))
+        {
+            m2l(target, source);
+            return false;
+        }
+        if (tree.isLeaf(source)) { p2p(target, source); }
+        return true;
+    };
+
+    singleTraversalStackless(tree, criterion, [](TreeNodeIndex) {});
+}
+
 } // namespace cstone
@@ -0,0 +1,124 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Generic octree upsweep procedure on the GPU
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * See upsweep.hpp for a description of the upsweep operation.
+ */
+
+#pragma once
+
+#include "octree_internal.cuh"
+#include "upsweep.hpp"
+
+namespace cstone
+{
+
+//! @brief compute internal node quantities for nodes [firstNode:lastNode], all of which have the same max depth
+template<class T, class KeyType, class CombinationFunction>
+__global__ void upsweepKernel(OctreeGpuDataView<KeyType> octree, TreeNodeIndex firstNode, TreeNodeIndex lastNode,
+                              const T* leafQuantities, T* internalQuantities, CombinationFunction combinationFunction)
+{
+    TreeNodeIndex nodeIdx = firstNode + blockDim.x * blockIdx.x + threadIdx.x;
+    if (nodeIdx < lastNode)
+    {
+        internalQuantities[nodeIdx] =
+            upsweepNode(octree, nodeIdx, leafQuantities, internalQuantities, combinationFunction);
+    }
+}
+
+/*! @brief performs an upsweep operation on the GPU, calculates quantities for internal nodes, based on given leaf nodes
+ *
+ * @tparam T                         anything that can be copied
+ * @tparam KeyType                   32- or 64-bit unsigned integer
+ * @tparam CombinationFunction       device-callable with signature T(T,T,T,T,T,T,T,T)
+ * @param[in]  octree                the device octree
+ * @param[in]  leafQuantities        input device array of length octree.numLeafNodes()
+ * @param[out] internalQuantities    output device array of length octree.numInternalNodes()
+ * @param[in]  combinationFunction   callable of type @p CombinationFunction
+ *
+ * One kernel is launched per max-depth value, starting with the nodes whose children are all leaves.
+ * Kernels in the same stream execute in order, which guarantees that all children of a node are
+ * processed before the node itself.
+ */
+template<class T, class KeyType, class CombinationFunction>
+void upsweep(const OctreeGpu<KeyType>& octree, const T* leafQuantities, T* internalQuantities,
+             CombinationFunction combinationFunction)
+{
+    constexpr unsigned nThreads = 256;
+
+    TreeNodeIndex internalNodeIndex = octree.numInternalNodes();
+    for (int depth = 1; depth < maxTreeLevel<KeyType>{} && octree.numTreeNodes(depth) > 0; ++depth)
+    {
+        TreeNodeIndex numLevelNodes = octree.numTreeNodes(depth);
+        internalNodeIndex -= numLevelNodes;
+
+        upsweepKernel<<<iceil(numLevelNodes, nThreads), nThreads>>>(octree.data(), internalNodeIndex,
+                                                                     internalNodeIndex + numLevelNodes, leafQuantities,
+                                                                     internalQuantities, combinationFunction);
+    }
+}
+
+//! @brief multi-field version of upsweepKernel, see upsweepFields
+template<class KeyType, class... Fields>
+__global__ void upsweepFieldsKernel(OctreeGpuDataView<KeyType> octree, TreeNodeIndex firstNode,
+                                    TreeNodeIndex lastNode, Fields... fields)
+{
+    TreeNodeIndex nodeIdx = firstNode + blockDim.x * blockIdx.x + threadIdx.x;
+    if (nodeIdx < lastNode) { upsweepNodeFields(octree, nodeIdx, fields...); }
+}
+
+/*! @brief upsweep of several quantities with one kernel per tree level on the GPU
+ *
+ * @param[in] octree   the device octree
+ * @param[in] fields   UpsweepFields with device arrays and device-callable combination functions
+ *
+ * See upsweepFields in upsweep.hpp.
+ */
+template<class KeyType, class... Fields>
+void upsweepFields(const OctreeGpu<KeyType>& octree, const std::tuple<Fields...>& fields)
+{
+    constexpr unsigned nThreads = 256;
+
+    TreeNodeIndex internalNodeIndex = octree.numInternalNodes();
+    for (int depth = 1; depth < maxTreeLevel<KeyType>{} && octree.numTreeNodes(depth) > 0; ++depth)
+    {
+        TreeNodeIndex numLevelNodes = octree.numTreeNodes(depth);
+        internalNodeIndex -= numLevelNodes;
+
+        std::apply(
+            [&](const auto&... field)
+            {
+                upsweepFieldsKernel<<<iceil(numLevelNodes, nThreads), nThreads>>>(
+                    octree.data(), internalNodeIndex, internalNodeIndex + numLevelNodes, field...);
+            },
+            fields);
+    }
+}
+
+} // namespace cstone
@@ -34,30 +34,56 @@
 
 #pragma once
 
+#include <tuple>
+
+#include "cstone/util/executor.hpp"
 #include "octree_internal.hpp"
 
 namespace cstone
 {
 
+/*! @brief combine the quantities of the 8 children of an internal node
+ *
+ * @tparam Tree             Octree, OctreeView or OctreeGpuDataView
+ * @param[in] octree        the octree
+ * @param[in] nodeIdx       internal node index, range [0:octree.numInternalNodes()]
+ * @return                  the result of @p combinationFunction applied to the children's quantities
+ *
+ * See upsweep for the remaining parameters.
+ */
+template<class T, class Tree, class CombinationFunction>
+CUDA_HOST_DEVICE_FUN
+T upsweepNode(const Tree& octree, TreeNodeIndex nodeIdx, const T* leafQuantities, const T* internalQuantities,
+              CombinationFunction combinationFunction)
+{
+    auto childQuantity = [&](int octant)
+    {
+        TreeNodeIndex child = octree.childDirect(nodeIdx, octant);
+        return octree.isLeafChild(nodeIdx, octant) ? leafQuantities[child] : internalQuantities[child];
+    };
+
+    return combinationFunction(childQuantity(0), childQuantity(1), childQuantity(2), childQuantity(3),
+                               childQuantity(4), childQuantity(5), childQuantity(6), childQuantity(7));
+}
+
 /*! @brief performs an upsweep operation, calculates quantities for internal nodes, based on given leaf nodes
  *
  * @tparam T                         anything that can be copied
  * @tparam KeyType                   32- or 64-bit unsigned integer
  * @tparam CombinationFunction       callable with signature T(T,T,T,T,T,T,T,T)
- * @param[in]  octree                the octree
+ * @param[in]  octree                Octree or OctreeView
  * @param[in]  leafQuantities        input array of length octree.numLeafNodes()
  * @param[out] internalQuantities    output array of length octree.numInternalNodes()
  * @param[in]  combinationFunction   callable of type @p CombinationFunction
  */
-template<class T, class KeyType, class CombinationFunction>
-void upsweep(const Octree<KeyType>& octree, const T* leafQuantities, T* internalQuantities, CombinationFunction combinationFunction)
+template<class T, template<class> class TreeType, class KeyType, class CombinationFunction>
+void upsweep(const TreeType<KeyType>& octree, const T* leafQuantities, T* internalQuantities, CombinationFunction combinationFunction)
 {
     int depth = 1;
     TreeNodeIndex internalNodeIndex = octree.numInternalNodes();
 
     internalNodeIndex -= octree.numTreeNodes(depth);
-    #pragma omp parallel for schedule(static)
-    for (TreeNodeIndex i = internalNodeIndex; i < internalNodeIndex + octree.numTreeNodes(depth); ++i)
+    parallelFor(internalNodeIndex, internalNodeIndex + octree.numTreeNodes(depth), [&](TreeNodeIndex i)
     {
         internalQuantities[i] = combinationFunction(leafQuantities[octree.childDirect(i, 0)],
                                                     leafQuantities[octree.childDirect(i, 1)],
@@ -67,30 +93,114 @@ void upsweep(const Octree<KeyType>& octree, const T* leafQuantities, T* internal
                                                     leafQuantities[octree.childDirect(i, 5)],
                                                     leafQuantities[octree.childDirect(i, 6)],
                                                     leafQuantities[octree.childDirect(i, 7)]);
-    }
+    });
 
     depth++;
 
     while (depth < maxTreeLevel<KeyType>{} && octree.numTreeNodes(depth) > 0)
     {
         internalNodeIndex -= octree.numTreeNodes(depth);
-        #pragma omp parallel for schedule(static)
-        for (TreeNodeIndex i = internalNodeIndex; i < internalNodeIndex + octree.numTreeNodes(depth); ++i)
+        parallelFor(internalNodeIndex, internalNodeIndex + octree.numTreeNodes(depth), [&](TreeNodeIndex i)
         {
-            T a = octree.isLeafChild(i, 0) ? leafQuantities[octree.childDirect(i, 0)] : internalQuantities[octree.childDirect(i, 0)];
-            T b = octree.isLeafChild(i, 1) ? leafQuantities[octree.childDirect(i, 1)] : internalQuantities[octree.childDirect(i, 1)];
-            T c = octree.isLeafChild(i, 2) ? leafQuantities[octree.childDirect(i, 2)] : internalQuantities[octree.childDirect(i, 2)];
-            T d = octree.isLeafChild(i, 3) ? leafQuantities[octree.childDirect(i, 3)] : internalQuantities[octree.childDirect(i, 3)];
-            T e = octree.isLeafChild(i, 4) ? leafQuantities[octree.childDirect(i, 4)] : internalQuantities[octree.childDirect(i, 4)];
-            T f = octree.isLeafChild(i, 5) ? leafQuantities[octree.childDirect(i, 5)] : internalQuantities[octree.childDirect(i, 5)];
-            T g = octree.isLeafChild(i, 6) ? leafQuantities[octree.childDirect(i, 6)] : internalQuantities[octree.childDirect(i, 6)];
-            T h = octree.isLeafChild(i, 7) ? leafQuantities[octree.childDirect(i, 7)] : internalQuantities[octree.childDirect(i, 7)];
-
-            internalQuantities[i] = combinationFunction(a, b, c, d, e, f, g, h);
-        }
+            internalQuantities[i] = upsweepNode(octree, i, leafQuantities, internalQuantities, combinationFunction);
+        });
 
         depth++;
     }
 }
 
-} // namespace cstone
\ No newline at end of file
+/*! @brief apply a function to all internal nodes, such that children are processed before their parents
+ *
+ * @tparam KeyType        32- or 64-bit unsigned integer
+ * @tparam NodeFunction   callable with signature void(TreeNodeIndex)
+ * @param[in] octree      Octree or OctreeView
+ * @param[in] nodeFunction called once for each internal node index
+ *
+ * Nodes with the same max depth are processed in parallel. In contrast to upsweep, the node quantities
+ * don't need to be stored in two arrays of a single type, which allows e.g. structure-of-arrays layouts.
+ */
+template<template<class> class TreeType, class KeyType, class NodeFunction>
+void upsweepNodes(const TreeType<KeyType>& octree, NodeFunction&& nodeFunction)
+{
+    TreeNodeIndex internalNodeIndex = octree.numInternalNodes();
+    for (int depth = 1; depth < int(maxTreeLevel<KeyType>{}) && octree.numTreeNodes(depth) > 0; ++depth)
+    {
+        internalNodeIndex -= octree.numTreeNodes(depth);
+        parallelFor(internalNodeIndex, internalNodeIndex + octree.numTreeNodes(depth),
+                    [&nodeFunction](TreeNodeIndex i) { nodeFunction(i); });
+    }
+}
+
+/*! @brief one quantity of a multi-field upsweep, see upsweepFields
+ *
+ * @tparam T                    anything that can be copied
+ * @tparam CombinationFunction  callable with signature T(T,T,T,T,T,T,T,T)
+ */
+template<class T, class CombinationFunction>
+struct UpsweepField
+{
+    //! @brief input array of length octree.numLeafNodes()
+    const T* leafQuantities;
+    //! @brief output array of length octree.numInternalNodes()
+    T* internalQuantities;
+    CombinationFunction combinationFunction;
+
+    //! @brief combine the quantities of the given children of internal node @p nodeIdx
+    CUDA_HOST_DEVICE_FUN void combine(TreeNodeIndex nodeIdx, const TreeNodeIndex* children,
+                                      const bool* isLeafChild) const
+    {
+        auto childQuantity = [&](int octant)
+        { return isLeafChild[octant] ? leafQuantities[children[octant]] : internalQuantities[children[octant]]; };
+
+        internalQuantities[nodeIdx] =
+            combinationFunction(childQuantity(0), childQuantity(1), childQuantity(2), childQuantity(3),
+                                childQuantity(4), childQuantity(5), childQuantity(6), childQuantity(7));
+    }
+};
+
+//! @brief construct an UpsweepField with deduced template arguments
+template<class T, class CombinationFunction>
+UpsweepField<T, CombinationFunction> upsweepField(const T* leafQuantities, T* internalQuantities,
+                                                  CombinationFunction combinationFunction)
+{
+    return {leafQuantities, internalQuantities, combinationFunction};
+}
+
+/*! @brief combine all @p fields of internal node @p nodeIdx, reading the child indices only once
+ *
+ * @tparam Tree     Octree, OctreeView or OctreeGpuDataView
+ * @tparam Fields   UpsweepField types
+ */
+template<class Tree, class... Fields>
+CUDA_HOST_DEVICE_FUN void upsweepNodeFields(const Tree& octree, TreeNodeIndex nodeIdx, const Fields&... fields)
+{
+    TreeNodeIndex children[8];
+    bool isLeafChild[8];
+    for (int octant = 0; octant < 8; ++octant)
+    {
+        children[octant]    = octree.childDirect(nodeIdx, octant);
+        isLeafChild[octant] = octree.isLeafChild(nodeIdx, octant);
+    }
+
+    (fields.combine(nodeIdx, children, isLeafChild), ...);
+}
+
+/*! @brief upsweep of several quantities in a single pass over the tree levels
+ *
+ * @tparam KeyType     32- or 64-bit unsigned integer
+ * @tparam Fields      UpsweepField types, e.g. constructed with upsweepField
+ * @param[in] octree   Octree or OctreeView
+ * @param[in] fields   the quantities with their leaf inputs, internal outputs and combination functions
+ *
+ * Equivalent to calling upsweep once per field, but the child indices of each node are read only once
+ * for all fields and there is one parallel region per tree level instead of one per level and field.
+ */
+template<template<class> class TreeType, class KeyType, class... Fields>
+void upsweepFields(const TreeType<KeyType>& octree, const std::tuple<Fields...>& fields)
+{
+    std::apply([&octree](const auto&... field)
+               { upsweepNodes(octree, [&](TreeNodeIndex i) { upsweepNodeFields(octree, i, field...); }); },
+               fields);
+}
+
+} // namespace cstone
@@ -0,0 +1,337 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Executors that the multi-threaded host loops of the library dispatch through
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * By default, parallelFor is an OpenMP parallel for loop with static scheduling. Applications with their own
+ * task runtime can install an Executor with setExecutor or ScopedExecutor. Loops are then split into chunks
+ * that are handed to Executor::run, such that the library runs on the threads of the application
+ * instead of an additional OpenMP thread team. Besides the default, the following executors are provided:
+ *
+ *  - SerialExecutor: all chunks on the calling thread, e.g. for calls from within a task
+ *  - OmpExecutor: chunks as OpenMP tasks, can be called from within an existing parallel region
+ *  - TbbExecutor: tbb::parallel_for, requires CSTONE_HAVE_TBB (cmake option CSTONE_WITH_TBB)
+ *  - StdParallelExecutor: std::for_each with std::execution::par, requires CSTONE_HAVE_STD_EXECUTION
+ *    (cmake option CSTONE_WITH_STD_EXECUTION)
+ *
+ * A thread pool is connected by deriving from Executor, see there.
+ * The installed executor is process-wide. It applies to the host loops of the tree build and the particle
+ * reordering in Domain::sync: SFC key computation, sorting and gathering (sfc.hpp, radix_sort.hpp, gather.hpp),
+ * octree construction and node counts (octree.hpp), halo discovery (discovery.hpp), MAC marking and upsweeps
+ * (macs.hpp, upsweep.hpp) and exclusiveScan. The other host loops, e.g. in the particle layout, the focus tree,
+ * the neighbor searches and the gravity kernels, are not dispatched through the executor and still use OpenMP.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef CSTONE_HAVE_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#endif
+
+#ifdef CSTONE_HAVE_STD_EXECUTION
+#include <execution>
+#include <numeric>
+#endif
+
+namespace cstone
+{
+
+//! @brief non-owning, type-erased reference to a callable with signature void(std::size_t)
+class TaskRef
+{
+public:
+    template<class F>
+    TaskRef(const F& f)
+        : object_(&f)
+        , call_([](const void* object, std::size_t i) { (*static_cast<const F*>(object))(i); })
+    {
+    }
+
+    void operator()(std::size_t i) const { call_(object_, i); }
+
+private:
+    const void* object_;
+    void (*call_)(const void*, std::size_t);
+};
+
+/*! @brief interface to run independent tasks of a parallel loop
+ *
+ * An implementation for an application thread pool submits task(i) for all i in [0:numTasks] to the pool and
+ * waits for their completion, ideally participating in the execution with the calling thread. Tasks may run
+ * in any order and concurrently, but the executor must not return before all of them have finished.
+ */
+class Executor
+{
+public:
+    virtual ~Executor() = default;
+
+    //! @brief number of threads the tasks are executed on, loops are split into a small multiple of it
+    [[nodiscard]] virtual int concurrency() const = 0;
+
+    //! @brief call @p task with each index in [0:numTasks] and return after all calls have completed
+    virtual void run(std::size_t numTasks, TaskRef task) = 0;
+};
+
+//! @brief runs all tasks on the calling thread
+class SerialExecutor : public Executor
+{
+public:
+    [[nodiscard]] int concurrency() const override { return 1; }
+
+    void run(std::size_t numTasks, TaskRef task) override
+    {
+        for (std::size_t i = 0; i < numTasks; ++i)
+        {
+            task(i);
+        }
+    }
+};
+
+//! @brief runs tasks as OpenMP tasks, in a new parallel region unless called from within one
+class OmpExecutor : public Executor
+{
+public:
+    [[nodiscard]] int concurrency() const override
+    {
+#ifdef _OPENMP
+        return omp_in_parallel() ? omp_get_num_threads() : omp_get_max_threads();
+#else
+        return 1;
+#endif
+    }
+
+    void run(std::size_t numTasks, TaskRef task) override
+    {
+#ifdef _OPENMP
+        if (omp_in_parallel())
+        {
+            #pragma omp taskgroup
+            {
+                for (std::size_t i = 0; i < numTasks; ++i)
+                {
+                    #pragma omp task firstprivate(i) shared(task)
+                    task(i);
+                }
+            }
+            return;
+        }
+#endif
+        #pragma omp parallel for schedule(dynamic)
+        for (std::size_t i = 0; i < numTasks; ++i)
+        {
+            task(i);
+        }
+    }
+};
+
+#ifdef CSTONE_HAVE_TBB
+
+//! @brief runs tasks with tbb::parallel_for in the current task arena
+class TbbExecutor : public Executor
+{
+public:
+    [[nodiscard]] int concurrency() const override { return tbb::this_task_arena::max_concurrency(); }
+
+    void run(std::size_t numTasks, TaskRef task) override
+    {
+        tbb::parallel_for(std::size_t(0), numTasks, [task](std::size_t i) { task(i); });
+    }
+};
+
+#endif
+
+#ifdef CSTONE_HAVE_STD_EXECUTION
+
+//! @brief runs tasks with the parallel std::for_each of the standard library
+class StdParallelExecutor : public Executor
+{
+public:
+    explicit StdParallelExecutor(int concurrency)
+        : concurrency_(concurrency)
+    {
+    }
+
+    [[nodiscard]] int concurrency() const override { return concurrency_; }
+
+    void run(std::size_t numTasks, TaskRef task) override
+    {
+        indices_.resize(numTasks);
+        std::iota(indices_.begin(), indices_.end(), std::size_t(0));
+        std::for_each(std::execution::par, indices_.begin(), indices_.end(), [task](std::size_t i) { task(i); });
+    }
+
+private:
+    int                      concurrency_;
+    std::vector<std::size_t> indices_;
+};
+
+#endif
+
+namespace detail
+{
+
+inline std::atomic<Executor*>& executorSlot()
+{
+    static std::atomic<Executor*> executor{nullptr};
+    return executor;
+}
+
+} // namespace detail
+
+//! @brief the installed executor, nullptr selects the default OpenMP loops
+inline Executor* currentExecutor() { return detail::executorSlot().load(std::memory_order_relaxed); }
+
+/*! @brief install @p executor for all subsequent library calls, nullptr restores the default OpenMP loops
+ *
+ * @return the previously installed executor
+ */
+inline Executor* setExecutor(Executor* executor) { return detail::executorSlot().exchange(executor); }
+
+//! @brief installs an executor for the lifetime of the object, then restores the previous one
+class ScopedExecutor
+{
+public:
+    explicit ScopedExecutor(Executor* executor)
+        : previous_(setExecutor(executor))
+    {
+    }
+
+    ScopedExecutor(const ScopedExecutor&)            = delete;
+    ScopedExecutor& operator=(const ScopedExecutor&) = delete;
+
+    ~ScopedExecutor() { setExecutor(previous_); }
+
+private:
+    Executor* previous_;
+};
+
+//! @brief number of threads parallel loops run on, to size per-thread work decompositions
+inline int parallelism()
+{
+    if (Executor* executor = currentExecutor()) { return std::max(executor->concurrency(), 1); }
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+/*! @brief call @p f(i) for each i in [first:last], in parallel
+ *
+ * Without an installed executor, this is an OpenMP parallel for loop with static scheduling. Otherwise, the range
+ * is split into tasks of consecutive indices, a few per thread of the executor to balance irregular work.
+ */
+template<class IndexType, class F>
+void parallelFor(IndexType first, IndexType last, F&& f)
+{
+    if (first >= last) { return; }
+
+    Executor* executor = currentExecutor();
+    if (executor == nullptr)
+    {
+        #pragma omp parallel for schedule(static)
+        for (IndexType i = first; i < last; ++i)
+        {
+            f(i);
+        }
+        return;
+    }
+
+    constexpr std::size_t tasksPerThread = 4;
+
+    std::size_t numElements = last - first;
+    std::size_t numTasks    = std::min(numElements, std::size_t(std::max(executor->concurrency(), 1)) * tasksPerThread);
+    std::size_t taskSize    = (numElements + numTasks - 1) / numTasks;
+    numTasks                = (numElements + taskSize - 1) / taskSize;
+
+    auto task = [first, last, taskSize, &f](std::size_t t)
+    {
+        IndexType taskFirst = first + IndexType(t * taskSize);
+        IndexType taskLast  = std::min(IndexType(taskFirst + IndexType(taskSize)), last);
+        for (IndexType i = taskFirst; i < taskLast; ++i)
+        {
+            f(i);
+        }
+    };
+    executor->run(numTasks, task);
+}
+
+/*! @brief combine @p f(i) for each i in [first:last] with the associative @p op, in parallel
+ *
+ * @param identity  neutral element of @p op, the result for an empty range
+ *
+ * The range is split into one chunk per thread of parallelism(), each reduced serially in a parallelFor.
+ * The partial results are then combined on the calling thread in chunk order.
+ */
+template<class IndexType, class T, class F, class Op>
+T parallelReduce(IndexType first, IndexType last, T identity, F&& f, Op&& op)
+{
+    if (first >= last) { return identity; }
+
+    std::size_t numElements = last - first;
+    std::size_t numChunks   = std::min(numElements, std::size_t(parallelism()));
+    std::size_t chunkSize   = (numElements + numChunks - 1) / numChunks;
+    numChunks               = (numElements + chunkSize - 1) / chunkSize;
+
+    // not a std::vector, to avoid the packed storage of std::vector<bool>
+    std::unique_ptr<T[]> partials(new T[numChunks]);
+    T* partialsData = partials.get();
+
+    parallelFor(std::size_t(0), numChunks, [first, last, chunkSize, identity, partialsData, &f, &op](std::size_t c)
+    {
+        IndexType chunkFirst = first + IndexType(c * chunkSize);
+        IndexType chunkLast  = std::min(IndexType(chunkFirst + IndexType(chunkSize)), last);
+
+        T partial = identity;
+        for (IndexType i = chunkFirst; i < chunkLast; ++i)
+        {
+            partial = op(partial, f(i));
+        }
+        partialsData[c] = partial;
+    });
+
+    T result = identity;
+    for (std::size_t c = 0; c < numChunks; ++c)
+    {
+        result = op(result, partialsData[c]);
+    }
+    return result;
+}
+
+} // namespace cstone
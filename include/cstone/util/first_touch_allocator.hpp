@@ -0,0 +1,133 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Allocator that distributes the pages of large arrays across NUMA domains by parallel first touch
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * On Linux, a physical page is placed on the NUMA domain of the thread that first writes to it. Arrays that are
+ * value-initialized by std::vector end up entirely on the domain of the master thread, such that multi-socket nodes
+ * access most particle data remotely. FirstTouchAllocator touches freshly allocated storage with the same
+ * schedule(static) partitioning of the element index range that the OpenMP compute loops use, which places each
+ * page close to the thread that later processes the corresponding elements.
+ *
+ * If CSTONE_HUGE_PAGES is defined, allocations of at least one huge page are additionally aligned to 2 MiB
+ * and marked for transparent huge pages to reduce TLB misses.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#if defined(CSTONE_HUGE_PAGES) && defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace cstone
+{
+
+template<class T>
+class FirstTouchAllocator
+{
+public:
+    using value_type = T;
+
+    //! @brief allocations below this size in bytes are not touched in parallel
+    static constexpr std::size_t firstTouchThreshold = 64 * 1024;
+    //! @brief size and alignment of transparent huge pages
+    static constexpr std::size_t hugePageSize = 2 * 1024 * 1024;
+
+    FirstTouchAllocator() noexcept = default;
+
+    template<class U>
+    FirstTouchAllocator(const FirstTouchAllocator<U>&) noexcept
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        std::size_t numBytes = n * sizeof(T);
+        void* ptr;
+        if (useHugePages(numBytes))
+        {
+            ptr = ::operator new(numBytes, std::align_val_t{hugePageSize});
+#if defined(CSTONE_HUGE_PAGES) && defined(__linux__)
+            madvise(ptr, numBytes - numBytes % hugePageSize, MADV_HUGEPAGE);
+#endif
+        }
+        else { ptr = ::operator new(numBytes); }
+
+        if (numBytes >= firstTouchThreshold) { firstTouch(static_cast<char*>(ptr), n); }
+
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, std::size_t n) noexcept
+    {
+        if (useHugePages(n * sizeof(T))) { ::operator delete(ptr, std::align_val_t{hugePageSize}); }
+        else { ::operator delete(ptr); }
+    }
+
+private:
+    static constexpr bool useHugePages([[maybe_unused]] std::size_t numBytes)
+    {
+#if defined(CSTONE_HUGE_PAGES) && defined(__linux__)
+        return numBytes >= hugePageSize;
+#else
+        return false;
+#endif
+    }
+
+    //! @brief write one byte per element with the element-to-thread mapping of the compute loops
+    static void firstTouch(char* bytes, std::size_t n)
+    {
+        #pragma omp parallel for schedule(static)
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            bytes[i * sizeof(T)] = 0;
+        }
+    }
+};
+
+template<class T, class U>
+bool operator==(const FirstTouchAllocator<T>&, const FirstTouchAllocator<U>&) noexcept
+{
+    return true;
+}
+
+template<class T, class U>
+bool operator!=(const FirstTouchAllocator<T>&, const FirstTouchAllocator<U>&) noexcept
+{
+    return false;
+}
+
+//! @brief vector for temporary per-particle or per-node arrays that are processed by multi-threaded loops
+template<class T>
+using FirstTouchVector = std::vector<T, FirstTouchAllocator<T>>;
+
+} // namespace cstone
@@ -0,0 +1,295 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Instrumentation hooks for the phases of Domain::sync
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * Domains report the begin and end of each sync phase, together with communication volumes and iteration
+ * counts, to an optional SyncObserver. Without an observer, the instrumentation reduces to a null pointer
+ * check per phase. SyncTimer is an observer that accumulates wall times and counters per phase,
+ * see reduceSyncCounters for an MPI-aggregated report.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "cstone/util/index_ranges.hpp"
+
+namespace cstone
+{
+
+//! @brief the phases of a domain sync
+enum class SyncPhase : int
+{
+    box,
+    keys,
+    sort,
+    globalTree,
+    assignment,
+    focusTree,
+    haloRadii,
+    haloDiscovery,
+    layout,
+    particleExchange,
+    reorder,
+    haloExchange
+};
+
+constexpr int numSyncPhases = 12;
+
+inline const char* syncPhaseName(SyncPhase phase)
+{
+    constexpr const char* names[numSyncPhases] = {"box",       "keys",          "sort",   "globalTree",
+                                                  "assignment", "focusTree",    "haloRadii", "haloDiscovery",
+                                                  "layout",    "particleExchange", "reorder", "haloExchange"};
+    return names[int(phase)];
+}
+
+//! @brief point-to-point communication volume of the executing rank
+struct PhaseTraffic
+{
+    uint64_t bytesSent{0};
+    uint64_t bytesReceived{0};
+    uint64_t messagesSent{0};
+    uint64_t messagesReceived{0};
+
+    PhaseTraffic& operator+=(const PhaseTraffic& rhs)
+    {
+        bytesSent += rhs.bytesSent;
+        bytesReceived += rhs.bytesReceived;
+        messagesSent += rhs.messagesSent;
+        messagesReceived += rhs.messagesReceived;
+        return *this;
+    }
+};
+
+/*! @brief traffic of an exchange of array elements according to the given send and receive lists
+ *
+ * @param outgoing      per destination rank, the index ranges to send
+ * @param incoming      per source rank, the index ranges to receive
+ * @param thisRank      the executing rank, whose own ranges are not communicated
+ * @param elementBytes  bytes per exchanged array element, summed over all exchanged arrays
+ *
+ * One message per peer with a non-empty range list is assumed.
+ */
+inline PhaseTraffic sendListTraffic(const SendList& outgoing, const SendList& incoming, int thisRank,
+                                    std::size_t elementBytes)
+{
+    PhaseTraffic traffic;
+    for (int rank = 0; rank < int(outgoing.size()); ++rank)
+    {
+        std::size_t count = outgoing[rank].totalCount();
+        if (rank == thisRank || count == 0) { continue; }
+        traffic.bytesSent += count * elementBytes;
+        traffic.messagesSent++;
+    }
+    for (int rank = 0; rank < int(incoming.size()); ++rank)
+    {
+        std::size_t count = incoming[rank].totalCount();
+        if (rank == thisRank || count == 0) { continue; }
+        traffic.bytesReceived += count * elementBytes;
+        traffic.messagesReceived++;
+    }
+    return traffic;
+}
+
+//! @brief number of exchanged elements with each rank, i.e. the total counts of the ranges in @p sendList
+inline std::vector<std::size_t> sendListCounts(const SendList& sendList)
+{
+    std::vector<std::size_t> counts(sendList.size());
+    for (std::size_t rank = 0; rank < sendList.size(); ++rank)
+    {
+        counts[rank] = sendList[rank].totalCount();
+    }
+    return counts;
+}
+
+//! @brief number of ranks other than @p thisRank with a non-empty range list in @p incoming or @p outgoing
+inline int numExchangePeers(const SendList& incoming, const SendList& outgoing, int thisRank)
+{
+    int numPeers = 0;
+    for (int rank = 0; rank < int(incoming.size()); ++rank)
+    {
+        if (rank == thisRank) { continue; }
+        numPeers += incoming[rank].totalCount() > 0 || outgoing[rank].totalCount() > 0;
+    }
+    return numPeers;
+}
+
+//! @brief communication volume of the executing rank with a single peer in one exchange
+struct PeerVolume
+{
+    int      rank;
+    uint64_t elementsSent{0};
+    uint64_t elementsReceived{0};
+    uint64_t bytesSent{0};
+    uint64_t bytesReceived{0};
+    uint64_t messagesSent{0};
+    uint64_t messagesReceived{0};
+};
+
+/*! @brief per-peer volumes of an exchange with the given number of elements sent to and received from each rank
+ *
+ * @param sendCounts     number of elements sent to each rank
+ * @param receiveCounts  number of elements received from each rank, same size as @p sendCounts
+ * @param thisRank       the executing rank, which is excluded from the result
+ * @param elementBytes   bytes per exchanged element, summed over all exchanged arrays
+ * @return               one entry per rank with a non-zero send or receive count, in ascending rank order
+ *
+ * As in sendListTraffic, one message per peer and direction with a non-zero count is assumed.
+ */
+inline std::vector<PeerVolume> peerVolumes(const std::vector<std::size_t>& sendCounts,
+                                           const std::vector<std::size_t>& receiveCounts, int thisRank,
+                                           std::size_t elementBytes)
+{
+    std::vector<PeerVolume> volumes;
+    for (int rank = 0; rank < int(sendCounts.size()); ++rank)
+    {
+        std::size_t numSent = sendCounts[rank], numReceived = receiveCounts[rank];
+        if (rank == thisRank || (numSent == 0 && numReceived == 0)) { continue; }
+
+        volumes.push_back({rank, numSent, numReceived, numSent * elementBytes, numReceived * elementBytes,
+                           uint64_t(numSent > 0), uint64_t(numReceived > 0)});
+    }
+    return volumes;
+}
+
+//! @brief receives instrumentation events from domain syncs, see Domain::setObserver
+class SyncObserver
+{
+public:
+    virtual ~SyncObserver() = default;
+
+    virtual void beginPhase(SyncPhase phase) = 0;
+    virtual void endPhase(SyncPhase phase)   = 0;
+
+    //! @brief point-to-point communication performed in @p phase
+    virtual void recordTraffic(SyncPhase /*phase*/, const PhaseTraffic& /*traffic*/) {}
+
+    //! @brief number of iterations performed in @p phase, e.g. of the global tree convergence
+    virtual void recordIterations(SyncPhase /*phase*/, uint64_t /*iterations*/) {}
+};
+
+/*! @brief reports the phases of a sync to an observer, which may be nullptr
+ *
+ * Begins @p phase on construction, next() ends the current phase and begins another one.
+ * The current phase is ended on destruction or by end(), after which no more events are reported.
+ */
+class PhaseScope
+{
+public:
+    PhaseScope(SyncObserver* observer, SyncPhase phase)
+        : observer_(observer)
+        , phase_(phase)
+    {
+        if (observer_) { observer_->beginPhase(phase_); }
+    }
+
+    PhaseScope(const PhaseScope&)            = delete;
+    PhaseScope& operator=(const PhaseScope&) = delete;
+
+    ~PhaseScope() { end(); }
+
+    void end()
+    {
+        if (observer_) { observer_->endPhase(phase_); }
+        observer_ = nullptr;
+    }
+
+    void next(SyncPhase phase)
+    {
+        if (observer_)
+        {
+            observer_->endPhase(phase_);
+            observer_->beginPhase(phase);
+        }
+        phase_ = phase;
+    }
+
+    void recordTraffic(const PhaseTraffic& traffic)
+    {
+        if (observer_) { observer_->recordTraffic(phase_, traffic); }
+    }
+
+    void recordIterations(uint64_t iterations)
+    {
+        if (observer_) { observer_->recordIterations(phase_, iterations); }
+    }
+
+private:
+    SyncObserver* observer_;
+    SyncPhase     phase_;
+};
+
+//! @brief accumulated measurements of one sync phase
+struct PhaseCounters
+{
+    double       seconds{0};
+    uint64_t     calls{0};
+    uint64_t     iterations{0};
+    PhaseTraffic traffic;
+};
+
+//! @brief observer that accumulates wall times, traffic and iteration counts per phase over all observed syncs
+class SyncTimer : public SyncObserver
+{
+    using Clock = std::chrono::steady_clock;
+
+public:
+    void beginPhase(SyncPhase phase) override { start_[int(phase)] = Clock::now(); }
+
+    void endPhase(SyncPhase phase) override
+    {
+        PhaseCounters& c = counters_[int(phase)];
+        c.seconds += std::chrono::duration<double>(Clock::now() - start_[int(phase)]).count();
+        c.calls++;
+    }
+
+    void recordTraffic(SyncPhase phase, const PhaseTraffic& traffic) override
+    {
+        counters_[int(phase)].traffic += traffic;
+    }
+
+    void recordIterations(SyncPhase phase, uint64_t iterations) override
+    {
+        counters_[int(phase)].iterations += iterations;
+    }
+
+    [[nodiscard]] const PhaseCounters& counters(SyncPhase phase) const { return counters_[int(phase)]; }
+
+    void reset() { counters_ = {}; }
+
+private:
+    std::array<PhaseCounters, numSyncPhases>     counters_{};
+    std::array<Clock::time_point, numSyncPhases> start_{};
+};
+
+} // namespace cstone
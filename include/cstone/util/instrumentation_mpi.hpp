@@ -0,0 +1,217 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief MPI-aggregated reports of sync instrumentation counters
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <vector>
+
+#include <mpi.h>
+
+#include "cstone/util/instrumentation.hpp"
+
+namespace cstone
+{
+
+//! @brief minimum, average and maximum of a quantity across ranks
+struct MinAvgMax
+{
+    double min;
+    double avg;
+    double max;
+};
+
+namespace detail
+{
+
+//! @brief MPI reduction of (min, max, sum) triples of doubles
+inline void minMaxSumOp(void* in, void* inout, int* len, MPI_Datatype*)
+{
+    const double* a = static_cast<const double*>(in);
+    double*       b = static_cast<double*>(inout);
+    for (int i = 0; i < *len; ++i)
+    {
+        b[3 * i]     = std::min(a[3 * i], b[3 * i]);
+        b[3 * i + 1] = std::max(a[3 * i + 1], b[3 * i + 1]);
+        b[3 * i + 2] += a[3 * i + 2];
+    }
+}
+
+} // namespace detail
+
+/*! @brief collectively compute min/avg/max across ranks of each element of @p values with a single allreduce
+ *
+ * @param values  the values of the executing rank, same number of elements on all ranks
+ * @param comm    the ranks to reduce over
+ * @return        statistics per element of @p values, identical on all ranks of @p comm
+ */
+inline std::vector<MinAvgMax> reduceMinAvgMax(const std::vector<double>& values, MPI_Comm comm = MPI_COMM_WORLD)
+{
+    std::vector<double> triples(3 * values.size());
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+        triples[3 * i] = triples[3 * i + 1] = triples[3 * i + 2] = values[i];
+    }
+
+    MPI_Datatype tripleType;
+    MPI_Type_contiguous(3, MPI_DOUBLE, &tripleType);
+    MPI_Type_commit(&tripleType);
+    MPI_Op op;
+    MPI_Op_create(detail::minMaxSumOp, 1, &op);
+
+    MPI_Allreduce(MPI_IN_PLACE, triples.data(), int(values.size()), tripleType, op, comm);
+
+    MPI_Op_free(&op);
+    MPI_Type_free(&tripleType);
+
+    int numRanks;
+    MPI_Comm_size(comm, &numRanks);
+
+    std::vector<MinAvgMax> ret(values.size());
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+        ret[i] = {triples[3 * i], triples[3 * i + 2] / numRanks, triples[3 * i + 1]};
+    }
+    return ret;
+}
+
+//! @brief distribution of particles, halos, halo peers and work across ranks after a sync
+struct DomainBalance
+{
+    //! @brief assigned particles per rank
+    MinAvgMax assigned;
+    //! @brief halo particles per rank
+    MinAvgMax halos;
+    //! @brief ratio of halo to assigned particles per rank
+    MinAvgMax haloRatio;
+    //! @brief number of ranks exchanging halos with each rank
+    MinAvgMax peers;
+    //! @brief sum of the particle weights per rank, zero if no weights were supplied
+    MinAvgMax weights;
+
+    //! @brief maximum over average assigned particles, 1 for perfect balance
+    [[nodiscard]] double imbalance() const { return assigned.avg > 0 ? assigned.max / assigned.avg : 1.0; }
+
+    //! @brief maximum over average weight sum, 1 for perfect balance or if no weights were supplied
+    [[nodiscard]] double weightImbalance() const { return weights.avg > 0 ? weights.max / weights.avg : 1.0; }
+};
+
+/*! @brief collectively compute the balance statistics from the quantities of each rank, see DomainBalance
+ *
+ * Requires a single allreduce of 5 elements.
+ */
+inline DomainBalance reduceDomainBalance(uint64_t numAssigned, uint64_t numHalos, int numPeers, double weightSum,
+                                         MPI_Comm comm = MPI_COMM_WORLD)
+{
+    double haloRatio = numAssigned > 0 ? double(numHalos) / numAssigned : 0.0;
+    std::vector<MinAvgMax> stats =
+        reduceMinAvgMax({double(numAssigned), double(numHalos), haloRatio, double(numPeers), weightSum}, comm);
+    return {stats[0], stats[1], stats[2], stats[3], stats[4]};
+}
+
+//! @brief statistics of the counters of one sync phase across ranks
+struct PhaseReport
+{
+    SyncPhase phase;
+    MinAvgMax seconds;
+    MinAvgMax bytesSent;
+    MinAvgMax bytesReceived;
+    MinAvgMax messagesSent;
+    MinAvgMax messagesReceived;
+    MinAvgMax iterations;
+};
+
+/*! @brief collectively compute min/avg/max of the counters of all sync phases across ranks
+ *
+ * @param timer  the counters of the executing rank
+ * @param comm   the ranks to reduce over
+ * @return       one report per phase, identical on all ranks, phases that were not observed on any rank are omitted
+ */
+inline std::vector<PhaseReport> reduceSyncCounters(const SyncTimer& timer, MPI_Comm comm = MPI_COMM_WORLD)
+{
+    constexpr int numMetrics = 6;
+
+    std::vector<double> minValues(numSyncPhases * numMetrics), calls(numSyncPhases);
+    for (int p = 0; p < numSyncPhases; ++p)
+    {
+        const PhaseCounters& c = timer.counters(SyncPhase(p));
+        double values[numMetrics] = {c.seconds,
+                                     double(c.traffic.bytesSent),
+                                     double(c.traffic.bytesReceived),
+                                     double(c.traffic.messagesSent),
+                                     double(c.traffic.messagesReceived),
+                                     double(c.iterations)};
+        std::copy(values, values + numMetrics, minValues.begin() + p * numMetrics);
+        calls[p] = c.calls;
+    }
+    std::vector<double> maxValues = minValues, sumValues = minValues;
+
+    MPI_Allreduce(MPI_IN_PLACE, minValues.data(), minValues.size(), MPI_DOUBLE, MPI_MIN, comm);
+    MPI_Allreduce(MPI_IN_PLACE, maxValues.data(), maxValues.size(), MPI_DOUBLE, MPI_MAX, comm);
+    MPI_Allreduce(MPI_IN_PLACE, sumValues.data(), sumValues.size(), MPI_DOUBLE, MPI_SUM, comm);
+    MPI_Allreduce(MPI_IN_PLACE, calls.data(), calls.size(), MPI_DOUBLE, MPI_MAX, comm);
+
+    int numRanks;
+    MPI_Comm_size(comm, &numRanks);
+
+    std::vector<PhaseReport> reports;
+    for (int p = 0; p < numSyncPhases; ++p)
+    {
+        if (calls[p] == 0) { continue; }
+
+        std::array<MinAvgMax, numMetrics> stats;
+        for (int m = 0; m < numMetrics; ++m)
+        {
+            int i    = p * numMetrics + m;
+            stats[m] = {minValues[i], sumValues[i] / numRanks, maxValues[i]};
+        }
+        reports.push_back({SyncPhase(p), stats[0], stats[1], stats[2], stats[3], stats[4], stats[5]});
+    }
+    return reports;
+}
+
+//! @brief print the output of reduceSyncCounters as a table, call on a single rank
+inline void printSyncReport(const std::vector<PhaseReport>& reports, FILE* out = stdout)
+{
+    std::fprintf(out, "%-18s %32s %32s %20s %14s\n", "phase", "time [s] min/avg/max", "MB sent min/avg/max",
+                 "messages min/avg/max", "iterations max");
+    for (const auto& r : reports)
+    {
+        std::fprintf(out, "%-18s %10.4f %10.4f %10.4f %10.3f %10.3f %10.3f %6.0f %6.1f %6.0f %14.0f\n",
+                     syncPhaseName(r.phase), r.seconds.min, r.seconds.avg, r.seconds.max, r.bytesSent.min / 1e6,
+                     r.bytesSent.avg / 1e6, r.bytesSent.max / 1e6, r.messagesSent.min, r.messagesSent.avg,
+                     r.messagesSent.max, r.iterations.max);
+    }
+}
+
+} // namespace cstone
@@ -0,0 +1,108 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Monotonic scratch arena for temporaries that live for the duration of one domain sync
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include "cstone/util/first_touch_allocator.hpp"
+#include "cstone/util/gsl-lite.hpp"
+
+namespace cstone
+{
+
+/*! @brief bump allocator for uninitialized arrays of trivial types, released all at once by reset()
+ *
+ * Allocations are served from a single block. Requests that do not fit are served from separate overflow
+ * blocks, such that previously returned spans remain valid until the next reset. reset() merges the
+ * overflow into the main block, after which a repetition of the same allocation sequence does not
+ * allocate any memory from the system.
+ */
+class ScratchArena
+{
+    using Unit = std::max_align_t;
+
+public:
+    /*! @brief return an uninitialized array of @p n elements, valid until the next call to reset()
+     *
+     * @tparam T   a trivial type, no constructors or destructors are invoked
+     */
+    template<class T>
+    gsl::span<T> allocate(std::size_t n)
+    {
+        static_assert(std::is_trivial_v<T>, "scratch arena only supports trivial types\n");
+        static_assert(alignof(T) <= alignof(Unit), "scratch arena does not support over-aligned types\n");
+
+        std::size_t numUnits = (n * sizeof(T) + sizeof(Unit) - 1) / sizeof(Unit);
+
+        Unit* ptr;
+        if (used_ + numUnits <= block_.size())
+        {
+            ptr = block_.data() + used_;
+            used_ += numUnits;
+        }
+        else
+        {
+            overflow_.emplace_back(numUnits);
+            overflowUnits_ += numUnits;
+            ptr = overflow_.back().data();
+        }
+
+        return {reinterpret_cast<T*>(ptr), n};
+    }
+
+    //! @brief invalidate all allocations and grow the main block to the peak size of the previous cycle
+    void reset()
+    {
+        std::size_t required = used_ + overflowUnits_;
+        overflow_.clear();
+        if (required > block_.size())
+        {
+            // some slack to absorb fluctuations of the particle counts between syncs
+            block_ = FirstTouchVector<Unit>(static_cast<std::size_t>(double(required) * 1.05));
+        }
+        used_          = 0;
+        overflowUnits_ = 0;
+    }
+
+    //! @brief number of bytes that can be allocated without system allocation
+    [[nodiscard]] std::size_t capacity() const { return block_.size() * sizeof(Unit); }
+
+private:
+    FirstTouchVector<Unit> block_;
+    std::vector<FirstTouchVector<Unit>> overflow_;
+    std::size_t used_{0};
+    std::size_t overflowUnits_{0};
+};
+
+} // namespace cstone
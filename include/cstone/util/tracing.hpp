@@ -0,0 +1,182 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Scoped trace ranges for profiling timelines
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * CSTONE_TRACE_RANGE(name) marks the remainder of the enclosing scope as a named range. Ranges are only
+ * compiled in if CSTONE_TRACING is defined (cmake option CSTONE_WITH_TRACING), otherwise the macro expands
+ * to nothing. With CSTONE_HAVE_NVTX, ranges are NVTX ranges that show up in Nsight Systems timelines.
+ * Otherwise, they are recorded in memory and can be written with writeChromeTrace in the Chrome trace event
+ * format, which is understood by chrome://tracing and Perfetto.
+ */
+
+#pragma once
+
+#ifdef CSTONE_TRACING
+
+#ifdef CSTONE_HAVE_NVTX
+
+#include <nvtx3/nvToolsExt.h>
+
+#else
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#endif
+
+namespace cstone
+{
+
+#ifdef CSTONE_HAVE_NVTX
+
+class TraceRange
+{
+public:
+    explicit TraceRange(const char* name) { nvtxRangePushA(name); }
+    ~TraceRange() { nvtxRangePop(); }
+
+    TraceRange(const TraceRange&)            = delete;
+    TraceRange& operator=(const TraceRange&) = delete;
+};
+
+#else
+
+//! @brief a completed trace range
+struct TraceEvent
+{
+    const char* name;
+    int         thread;
+    double      startMicroseconds;
+    double      durationMicroseconds;
+};
+
+//! @brief process-wide collection of completed trace ranges
+class TraceRecorder
+{
+    using Clock = std::chrono::steady_clock;
+
+public:
+    static TraceRecorder& instance()
+    {
+        static TraceRecorder recorder;
+        return recorder;
+    }
+
+    //! @brief microseconds since the creation of the recorder
+    double now() const { return std::chrono::duration<double, std::micro>(Clock::now() - epoch_).count(); }
+
+    void record(const char* name, double start, double end)
+    {
+        static std::atomic<int> numThreads{0};
+        thread_local int        thread = numThreads++;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.push_back({name, thread, start, end - start});
+    }
+
+    std::vector<TraceEvent> events() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return events_;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.clear();
+    }
+
+private:
+    TraceRecorder() : epoch_(Clock::now()) {}
+
+    Clock::time_point       epoch_;
+    mutable std::mutex      mutex_;
+    std::vector<TraceEvent> events_;
+};
+
+class TraceRange
+{
+public:
+    explicit TraceRange(const char* name)
+        : name_(name)
+        , start_(TraceRecorder::instance().now())
+    {
+    }
+
+    ~TraceRange() { TraceRecorder::instance().record(name_, start_, TraceRecorder::instance().now()); }
+
+    TraceRange(const TraceRange&)            = delete;
+    TraceRange& operator=(const TraceRange&) = delete;
+
+private:
+    const char* name_;
+    double      start_;
+};
+
+/*! @brief write all ranges recorded so far in the Chrome trace event format
+ *
+ * @param filename  output file
+ * @param processId process id shown in the timeline, e.g. the MPI rank, such that the files of several ranks
+ *                  can be merged into one timeline
+ */
+inline void writeChromeTrace(const std::string& filename, int processId = 0)
+{
+    FILE* out = std::fopen(filename.c_str(), "w");
+    if (!out) { throw std::runtime_error("could not open " + filename + " for writing\n"); }
+
+    std::vector<TraceEvent> events = TraceRecorder::instance().events();
+    std::fprintf(out, "{\"traceEvents\":[\n");
+    for (std::size_t i = 0; i < events.size(); ++i)
+    {
+        std::fprintf(out, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                     events[i].name, processId, events[i].thread, events[i].startMicroseconds,
+                     events[i].durationMicroseconds, i + 1 < events.size() ? "," : "");
+    }
+    std::fprintf(out, "]}\n");
+    std::fclose(out);
+}
+
+#endif
+
+} // namespace cstone
+
+#define CSTONE_TRACE_CONCAT_IMPL(a, b) a##b
+#define CSTONE_TRACE_CONCAT(a, b) CSTONE_TRACE_CONCAT_IMPL(a, b)
+#define CSTONE_TRACE_RANGE(name) ::cstone::TraceRange CSTONE_TRACE_CONCAT(cstoneTraceRange, __LINE__)(name)
+
+#else
+
+#define CSTONE_TRACE_RANGE(name)
+
+#endif
@@ -31,6 +31,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <utility>
 
 #include "cstone/cuda/annotation.hpp"
@@ -138,3 +139,22 @@ CUDA_HOST_DEVICE_FUN constexpr unsigned iceil(size_t dividend, unsigned divisor)
     return (dividend + divisor - 1) / divisor;
 }
 
+/*! @brief resize a vector to @p size, growing its capacity geometrically
+ *
+ * @tparam Vector         std::vector-like container
+ * @param[inout] vector   the container to resize
+ * @param[in] size        the new size of @p vector
+ *
+ * Capacity is never reduced. Used for scratch buffers that are resized repeatedly
+ * with slowly fluctuating sizes, such that steady-state resizes do not allocate.
+ */
+template<class Vector>
+void reallocateGeometric(Vector& vector, std::size_t size)
+{
+    constexpr std::size_t growthRate = 2;
+    if (size > vector.capacity())
+    {
+        vector.reserve(std::max(size, growthRate * vector.capacity()));
+    }
+    vector.resize(size);
+}
@@ -36,14 +36,16 @@
 #include <random>
 #include <vector>
 
-#include "cstone/sfc/morton.hpp"
+#include "cstone/sfc/sfc.hpp"
 #include "cstone/primitives/gather.hpp"
 
 using namespace cstone;
 
-template<class T, class I>
+template<class T, class SfcKind>
 class RandomCoordinates
 {
+    using KeyType = SfcKeyType_t<SfcKind>;
+
 public:
 
     RandomCoordinates(unsigned n, Box<T> box, int seed = 42)
@@ -63,10 +65,9 @@ public:
         std::generate(begin(y_), end(y_), randY);
         std::generate(begin(z_), end(z_), randZ);
 
-        computeMortonCodes(begin(x_), end(x_), begin(y_), begin(z_),
-                                   begin(codes_), box);
+        computeSfcKeys<SfcKind>(begin(x_), end(x_), begin(y_), begin(z_), begin(codes_), box);
 
-        std::vector<I> mortonOrder(n);
+        std::vector<KeyType> mortonOrder(n);
         std::iota(begin(mortonOrder), end(mortonOrder), 0);
         sort_by_key(begin(codes_), end(codes_), begin(mortonOrder));
 
@@ -78,18 +79,20 @@ public:
     const std::vector<T>& x() const { return x_; }
     const std::vector<T>& y() const { return y_; }
     const std::vector<T>& z() const { return z_; }
-    const std::vector<I>& mortonCodes() const { return codes_; }
+    const std::vector<KeyType>& mortonCodes() const { return codes_; }
 
 private:
 
     Box<T> box_;
     std::vector<T> x_, y_, z_;
-    std::vector<I> codes_;
+    std::vector<KeyType> codes_;
 };
 
-template<class T, class I>
+template<class T, class SfcKind>
 class RandomGaussianCoordinates
 {
+    using KeyType = SfcKeyType_t<SfcKind>;
+
 public:
 
     RandomGaussianCoordinates(unsigned n, Box<T> box, int seed = 42)
@@ -110,10 +113,9 @@ public:
         std::generate(begin(y_), end(y_), randY);
         std::generate(begin(z_), end(z_), randZ);
 
-        computeMortonCodes(begin(x_), end(x_), begin(y_), begin(z_),
-                                   begin(codes_), box);
+        computeSfcKeys<SfcKind>(begin(x_), end(x_), begin(y_), begin(z_), begin(codes_), box);
 
-        std::vector<I> mortonOrder(n);
+        std::vector<KeyType> mortonOrder(n);
         std::iota(begin(mortonOrder), end(mortonOrder), 0);
         sort_by_key(begin(codes_), end(codes_), begin(mortonOrder));
 
@@ -125,11 +127,11 @@ public:
     const std::vector<T>& x() const { return x_; }
     const std::vector<T>& y() const { return y_; }
     const std::vector<T>& z() const { return z_; }
-    const std::vector<I>& mortonCodes() const { return codes_; }
+    const std::vector<KeyType>& mortonCodes() const { return codes_; }
 
 private:
 
     Box<T> box_;
     std::vector<T> x_, y_, z_;
-    std::vector<I> codes_;
+    std::vector<KeyType> codes_;
 };
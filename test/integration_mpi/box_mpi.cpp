@@ -126,3 +126,51 @@ TEST(GlobalBox, makeGlobalBox)
     makeGlobalBox<float>(rank, nRanks);
     makeGlobalBox<double>(rank, nRanks);
 }
+
+template<class T>
+void globalBoxReduction(int rank, int nRanks)
+{
+    int nElements = 10;
+    std::vector<T> x(nElements);
+    std::iota(begin(x), end(x), 1);
+
+    std::vector<T> y = x;
+    std::vector<T> z = x;
+
+    for (auto& val : x)
+        val *= (rank + 1);
+
+    for (auto& val : y)
+        val *= -(rank + 2);
+
+    // rank 0 does not contribute any particles
+    int numLocal = (rank == 0) ? 0 : nElements;
+
+    GlobalBoxReduction<T> reduction;
+    reduction.start(begin(x), begin(x) + numLocal, begin(y), begin(z), Box<T>{0, 1, 0, 1, 0, 5, false, false, true});
+    Box<T> box = reduction.wait();
+
+    Box<T> refBox = makeGlobalBox(begin(x), begin(x) + numLocal, begin(y), begin(z),
+                                  Box<T>{0, 1, 0, 1, 0, 5, false, false, true});
+
+    EXPECT_EQ(box, refBox);
+    if (nRanks > 1)
+    {
+        EXPECT_EQ(box.xmin(), 2);
+        EXPECT_EQ(box.xmax(), T(nElements * nRanks));
+        EXPECT_EQ(box.ymin(), -T(nElements * (nRanks + 1)));
+        EXPECT_EQ(box.ymax(), -3);
+    }
+    EXPECT_EQ(box.zmin(), 0);
+    EXPECT_EQ(box.zmax(), 5);
+}
+
+TEST(GlobalBox, globalBoxReduction)
+{
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    globalBoxReduction<float>(rank, nRanks);
+    globalBoxReduction<double>(rank, nRanks);
+}
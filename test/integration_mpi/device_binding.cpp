@@ -0,0 +1,73 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests the assignment of GPUs to the ranks of a node
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include "cstone/cuda/device_binding.hpp"
+
+using namespace cstone;
+
+TEST(DeviceBinding, nodeLocalRank)
+{
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    MPI_Comm nodeComm;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nodeComm);
+    int nodeSize;
+    MPI_Comm_size(nodeComm, &nodeSize);
+
+    // the local ranks of a node are a permutation of [0:nodeSize]
+    int localRank = nodeLocalRank();
+    std::vector<int> localRanks(nodeSize);
+    MPI_Allgather(&localRank, 1, MPI_INT, localRanks.data(), 1, MPI_INT, nodeComm);
+    MPI_Comm_free(&nodeComm);
+
+    std::sort(localRanks.begin(), localRanks.end());
+    std::vector<int> reference(nodeSize);
+    std::iota(reference.begin(), reference.end(), 0);
+    EXPECT_EQ(localRanks, reference);
+}
+
+TEST(DeviceBinding, deviceOfRank)
+{
+    int localRank = nodeLocalRank();
+
+    EXPECT_EQ(deviceOfRank(1), 0);
+    EXPECT_EQ(deviceOfRank(2), localRank % 2);
+    EXPECT_EQ(deviceOfRank(8), localRank % 8);
+    EXPECT_THROW(deviceOfRank(0), std::runtime_error);
+}
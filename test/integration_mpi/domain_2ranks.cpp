@@ -438,3 +438,72 @@ TEST(Domain, multiStepSync)
     multiStepSync<unsigned, float>(rank, nRanks);
     multiStepSync<uint64_t, float>(rank, nRanks);
 }
+
+/*! @brief only one rank removes and creates particles between syncs
+ *
+ * The halo pattern is dropped on rank 0 only, the following syncs must still take the same collective path
+ * on both ranks.
+ */
+template<class I, class T>
+void removeAndCreateOneRank(int rank, int nRanks)
+{
+    int numParticles = 100;
+    std::vector<T> x(numParticles), y(numParticles), z(numParticles), h(numParticles, 0.05);
+    for (int i = 0; i < numParticles; ++i)
+    {
+        x[i] = (i % 10 + 0.5) / 10;
+        y[i] = (i / 10 + 0.5) / 10;
+        z[i] = 0.25 + 0.5 * rank;
+    }
+
+    Domain<I, T> domain(rank, nRanks, 4);
+    std::vector<I> codes;
+    domain.sync(x, y, z, h, codes);
+
+    auto checkHalos = [&domain, &x, &y, &z]()
+    {
+        std::vector<T> xh = x, yh = y, zh = z;
+        domain.exchangeHalos(xh, yh, zh);
+        EXPECT_EQ(xh, x);
+        EXPECT_EQ(yh, y);
+        EXPECT_EQ(zh, z);
+
+        int count = domain.nParticles();
+        MPI_Allreduce(MPI_IN_PLACE, &count, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+        EXPECT_EQ(count, 200);
+    };
+
+    // replace a particle by an identical one on rank 0
+    if (rank == 0)
+    {
+        LocalParticleIndex p = domain.startIndex();
+        T px = x[p], py = y[p], pz = z[p], ph = h[p];
+
+        LocalParticleIndex firstNew = domain.removeAndCreate({p}, 1, x, y, z, h);
+        x[firstNew] = px;
+        y[firstNew] = py;
+        z[firstNew] = pz;
+        h[firstNew] = ph;
+    }
+    EXPECT_FALSE(domain.syncLazy(x, y, z, h, codes));
+    checkHalos();
+    EXPECT_TRUE(domain.syncLazy(x, y, z, h, codes));
+
+    if (rank == 0) { domain.removeAndCreate({}, 0, x, y, z, h); }
+    domain.sync(x, y, z, h, codes);
+    checkHalos();
+    EXPECT_TRUE(domain.syncLazy(x, y, z, h, codes));
+}
+
+TEST(Domain, removeAndCreateOneRank)
+{
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    const int thisExampleRanks = 2;
+    if (nRanks != thisExampleRanks) throw std::runtime_error("this test needs 2 ranks\n");
+
+    removeAndCreateOneRank<unsigned, double>(rank, nRanks);
+    removeAndCreateOneRank<uint64_t, float>(rank, nRanks);
+}
@@ -78,7 +78,7 @@ void focusDomain(int thisRank, int numRanks)
     LocalParticleIndex numParticlesAssigned = assignment.totalCount(thisRank);
 
     reallocate(numParticlesAssigned, x, y, z);
-    exchangeParticles<T>(sendList, Rank(thisRank), numParticlesAssigned, ordering.data(), x.data(), y.data(), z.data());
+    exchangeParticles(sendList, Rank(thisRank), numParticlesAssigned, ordering.data(), x.data(), y.data(), z.data());
 
     reallocate(numParticlesAssigned, particleKeys);
     computeMortonCodes(begin(x), end(x), begin(y), begin(z), begin(particleKeys), box);
@@ -123,8 +123,7 @@ void focusDomain(int thisRank, int numRanks)
                      );
 
     std::vector<int> haloFlags(nNodes(focusTree.treeLeaves()), 0);
-    findHalos<KeyType, float>(focusTree.treeLeaves(),
-                              focusTree.binaryTree(),
+    findHalos<KeyType, float>(focusTree.octree(),
                               haloRadii,
                               box,
                               focusAssignment.firstNodeIdx(thisRank),
@@ -149,7 +148,7 @@ void focusDomain(int thisRank, int numRanks)
     relocate(numParticlesTotal, haloOffset, x, y, z, h);
     relocate(numParticlesTotal, haloOffset, particleKeys);
 
-    haloexchange<T>(haloReceiveList, haloSendList, x.data(), y.data(), z.data(), h.data());
+    haloexchange(haloReceiveList, haloSendList, x.data(), y.data(), z.data(), h.data());
 
     LocalParticleIndex particleStart_ = haloOffset;
     LocalParticleIndex particleEnd_ = particleStart_ + numParticlesAssigned;
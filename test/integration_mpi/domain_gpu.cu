@@ -0,0 +1,94 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests a device domain sync against the host domain with the same particles
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <gtest/gtest.h>
+
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+
+#include "cstone/cuda/device_binding.hpp"
+#include "cstone/domain/domain.hpp"
+#include "cstone/domain/domain_gpu.cuh"
+#include "coord_samples/random.hpp"
+
+using namespace cstone;
+
+TEST(DeviceDomain, matchesHostDomain)
+{
+    using T       = double;
+    using KeyType = unsigned;
+
+    int rank = 0, numRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+    Box<T> box{-1, 1};
+    RandomCoordinates<T, KeyType> coords(1000, box, rank + 1);
+
+    std::vector<T> x = coords.x();
+    std::vector<T> y = coords.y();
+    std::vector<T> z = coords.z();
+    std::vector<T> h(x.size(), 0.05);
+    std::vector<KeyType> keys;
+
+    Domain<KeyType, T> domain(rank, numRanks, 10, box);
+    int numDevices = 0;
+    cudaGetDeviceCount(&numDevices);
+    DeviceDomain<KeyType, T> deviceDomain(rank, numRanks, 10, box, deviceOfRank(numDevices));
+
+    // the device arrays are allocated on the device of the domain
+    thrust::device_vector<T> d_x = x, d_y = y, d_z = z, d_h = h;
+    thrust::device_vector<KeyType> d_keys;
+
+    // the host domain updates the tree only once per sync, sync a few times such that both trees converge
+    for (int i = 0; i < 5; ++i)
+    {
+        domain.sync(x, y, z, h, keys);
+        deviceDomain.sync(d_x, d_y, d_z, d_h, d_keys);
+    }
+
+    EXPECT_EQ(deviceDomain.tree(), domain.tree());
+    EXPECT_EQ(deviceDomain.startIndex(), domain.startIndex());
+    EXPECT_EQ(deviceDomain.endIndex(), domain.endIndex());
+    EXPECT_EQ(deviceDomain.nParticlesWithHalos(), domain.nParticlesWithHalos());
+
+    thrust::host_vector<KeyType> deviceKeys = d_keys;
+    EXPECT_TRUE(std::equal(deviceKeys.begin(), deviceKeys.end(), keys.begin()));
+
+    thrust::host_vector<T> deviceX = d_x;
+    for (LocalParticleIndex i = domain.startIndex(); i < domain.endIndex(); ++i)
+    {
+        // particles with identical keys may be in a different order
+        if (i + 1 < domain.endIndex() && keys[i] == keys[i + 1]) { continue; }
+        if (i > domain.startIndex() && keys[i] == keys[i - 1]) { continue; }
+        EXPECT_EQ(deviceX[i], x[i]);
+    }
+}
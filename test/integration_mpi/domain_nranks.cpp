@@ -40,12 +40,20 @@
  * This tests that the domain halo exchange finds all halos needed for a correct neighbor count.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <string>
+
 #include "gtest/gtest.h"
 
 #include "coord_samples/random.hpp"
+#include "cstone/domain/autotune.hpp"
 #include "cstone/domain/domain.hpp"
 #include "cstone/domain/domain_focus.hpp"
 #include "cstone/findneighbors.hpp"
+#include "cstone/util/instrumentation_mpi.hpp"
 
 using namespace cstone;
 
@@ -80,9 +88,11 @@ void initCoordinates(std::vector<T>& x, std::vector<T>& y, std::vector<T>& z, Bo
     std::generate(begin(z), end(z), randZ);
 }
 
-template<class I, class T, class DomainType>
+template<class SfcKind, class T, class DomainType>
 void randomGaussianDomain(DomainType domain, int rank, int nRanks, bool equalizeH = false)
 {
+    using I = SfcKeyType_t<SfcKind>;
+
     int nParticles = (1000 / nRanks) * nRanks;
     Box<T> box = domain.box();
 
@@ -117,13 +127,13 @@ void randomGaussianDomain(DomainType domain, int rank, int nRanks, bool equalize
     int localCount = domain.endIndex() - domain.startIndex();
     int localCountSum = localCount;
     int extractedCount = x.size();
-    MPI_Allreduce(MPI_IN_PLACE, &localCountSum, 1, MpiType<int>{}, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &localCountSum, 1, MpiType<int>{}, MPI_SUM, domain.comm());
     EXPECT_EQ(localCountSum, nParticles);
 
     // box got updated if not using PBC
     box = domain.box();
     std::vector<I> mortonCodes(x.size());
-    computeMortonCodes(begin(x), end(x), begin(y), begin(z), begin(mortonCodes), box);
+    computeSfcKeys<SfcKind>(begin(x), end(x), begin(y), begin(z), begin(mortonCodes), box);
 
     // check that particles are Morton order sorted and the codes are in sync with the x,y,z arrays
     EXPECT_EQ(mortonCodes, codes);
@@ -135,13 +145,49 @@ void randomGaussianDomain(DomainType domain, int rank, int nRanks, bool equalize
     for (int i = 0; i < localCount; ++i)
     {
         int particleIndex = i + domain.startIndex();
-        findNeighbors(particleIndex, x.data(), y.data(), z.data(), h.data(), box,
-                      mortonCodes.data(), neighbors.data() + i * ngmax, neighborsCount.data() + i,
-                      extractedCount, ngmax);
+        findNeighbors<T, I, SfcKind>(particleIndex, x.data(), y.data(), z.data(), h.data(), box,
+                                     mortonCodes.data(), neighbors.data() + i * ngmax, neighborsCount.data() + i,
+                                     extractedCount, ngmax);
+    }
+
+    // neighbors of interior particles are all assigned to the executing rank
+    for (auto range : domain.interiorRanges())
+    {
+        EXPECT_LE(domain.startIndex(), range.start());
+        EXPECT_LE(range.end(), domain.endIndex());
+        for (LocalParticleIndex i = range.start(); i < range.end(); ++i)
+        {
+            LocalParticleIndex localIdx = i - domain.startIndex();
+            for (int j = 0; j < neighborsCount[localIdx]; ++j)
+            {
+                LocalParticleIndex neighbor = neighbors[localIdx * ngmax + j];
+                EXPECT_TRUE(domain.startIndex() <= neighbor && neighbor < domain.endIndex());
+            }
+        }
+    }
+
+    // asynchronous halo exchange of a property that is only valid for assigned particles before the exchange
+    {
+        std::vector<T> property(x.size(), 0);
+        std::copy(x.begin() + domain.startIndex(), x.begin() + domain.endIndex(),
+                  property.begin() + domain.startIndex());
+
+        auto handle = domain.exchangeHalosAsync(property);
+        for (auto range : domain.interiorRanges())
+        {
+            for (LocalParticleIndex i = range.start(); i < range.end(); ++i) { property[i] *= T(2); }
+        }
+        handle.wait();
+
+        for (auto range : domain.interiorRanges())
+        {
+            for (LocalParticleIndex i = range.start(); i < range.end(); ++i) { property[i] /= T(2); }
+        }
+        EXPECT_EQ(property, x);
     }
 
     int neighborSum = std::accumulate(begin(neighborsCount), end(neighborsCount), 0);
-    MPI_Allreduce(MPI_IN_PLACE, &neighborSum, 1, MpiType<int>{}, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &neighborSum, 1, MpiType<int>{}, MPI_SUM, domain.comm());
     //if (rank == 0)
     //{
     //    std::cout << " neighborSum " << neighborSum << std::endl;
@@ -152,7 +198,7 @@ void randomGaussianDomain(DomainType domain, int rank, int nRanks, bool equalize
     {
         // Note: global coordinates are not yet in Morton order
         std::vector<I> codesGlobal(nParticles);
-        computeMortonCodes(begin(xGlobal), end(xGlobal), begin(yGlobal), begin(zGlobal), begin(codesGlobal), box);
+        computeSfcKeys<SfcKind>(begin(xGlobal), end(xGlobal), begin(yGlobal), begin(zGlobal), begin(codesGlobal), box);
         std::vector<LocalParticleIndex> ordering(nParticles);
         std::iota(begin(ordering), end(ordering), LocalParticleIndex(0));
         sort_by_key(begin(codesGlobal), end(codesGlobal), begin(ordering));
@@ -166,9 +212,9 @@ void randomGaussianDomain(DomainType domain, int rank, int nRanks, bool equalize
         std::vector<int> neighborsCountRef(nParticles);
         for (int i = 0; i < nParticles; ++i)
         {
-            findNeighbors(i, xGlobal.data(), yGlobal.data(), zGlobal.data(), hGlobal.data(), box,
-                          codesGlobal.data(), neighborsRef.data() + i * ngmax, neighborsCountRef.data() + i,
-                          nParticles, ngmax);
+            findNeighbors<T, I, SfcKind>(i, xGlobal.data(), yGlobal.data(), zGlobal.data(), hGlobal.data(), box,
+                                         codesGlobal.data(), neighborsRef.data() + i * ngmax,
+                                         neighborsCountRef.data() + i, nParticles, ngmax);
         }
 
         int neighborSumRef = std::accumulate(begin(neighborsCountRef), end(neighborsCountRef), 0);
@@ -210,6 +256,14 @@ TEST(Domain, randomGaussianNeighborSum)
         Domain<uint64_t, float> domain(rank, nRanks, bucketSize, {-1, 1});
         randomGaussianDomain<uint64_t, float>(domain, rank, nRanks, equalizeH);
     }
+    {
+        Domain<HilbertKey<unsigned>, double> domain(rank, nRanks, bucketSize, {-1, 1});
+        randomGaussianDomain<HilbertKey<unsigned>, double>(domain, rank, nRanks, equalizeH);
+    }
+    {
+        Domain<HilbertKey<uint64_t>, double> domain(rank, nRanks, bucketSize, {-1, 1});
+        randomGaussianDomain<HilbertKey<uint64_t>, double>(domain, rank, nRanks, equalizeH);
+    }
 }
 
 TEST(Domain, randomGaussianNeighborSumPbc)
@@ -239,6 +293,10 @@ TEST(Domain, randomGaussianNeighborSumPbc)
         Domain<uint64_t, float> domain(rank, nRanks, bucketSize, {-1, 1, true});
         randomGaussianDomain<uint64_t, float>(domain, rank, nRanks, equalizeH);
     }
+    {
+        Domain<HilbertKey<uint64_t>, double> domain(rank, nRanks, bucketSize, {-1, 1, true});
+        randomGaussianDomain<HilbertKey<uint64_t>, double>(domain, rank, nRanks, equalizeH);
+    }
 }
 
 TEST(FocusDomain, randomGaussianNeighborSum)
@@ -266,6 +324,19 @@ TEST(FocusDomain, randomGaussianNeighborSum)
         FocusedDomain<uint64_t, float> domain(rank, nRanks, bucketSize, bucketSizeFocus, {-1, 1});
         randomGaussianDomain<uint64_t, float>(domain, rank, nRanks);
     }
+    {
+        FocusedDomain<HilbertKey<unsigned>, double> domain(rank, nRanks, bucketSize, bucketSizeFocus, {-1, 1});
+        randomGaussianDomain<HilbertKey<unsigned>, double>(domain, rank, nRanks);
+    }
+    {
+        FocusedDomain<HilbertKey<uint64_t>, double> domain(rank, nRanks, bucketSize, bucketSizeFocus, {-1, 1});
+        randomGaussianDomain<HilbertKey<uint64_t>, double>(domain, rank, nRanks);
+    }
+    {
+        FocusedDomain<HilbertKey<uint64_t>, double> domain(rank, nRanks, bucketSize, bucketSizeFocus, {-1, 1});
+        domain.setCompressTreeExchanges(true);
+        randomGaussianDomain<HilbertKey<uint64_t>, double>(domain, rank, nRanks);
+    }
 }
 
 TEST(FocusDomain, randomGaussianNeighborSumPbc)
@@ -293,4 +364,958 @@ TEST(FocusDomain, randomGaussianNeighborSumPbc)
         FocusedDomain<uint64_t, float> domain(rank, nRanks, bucketSize, bucketSizeFocus, {-1, 1, true});
         randomGaussianDomain<uint64_t, float>(domain, rank, nRanks);
     }
+    {
+        FocusedDomain<HilbertKey<uint64_t>, double> domain(rank, nRanks, bucketSize, bucketSizeFocus,
+                                                           {-1, 1, true});
+        randomGaussianDomain<HilbertKey<uint64_t>, double>(domain, rank, nRanks);
+    }
+}
+
+/*! @brief repeated syncs with an unchanged tree reuse the halo pattern
+ *
+ * Slightly smaller halo radii within the tolerance keep the layout of the previous sync,
+ * larger radii trigger a new halo discovery that finds at least as many halos.
+ */
+TEST(Domain, haloPatternReuse)
+{
+    using T = double;
+    using KeyType = unsigned;
+
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    int nParticlesPerRank = 1000 / nRanks;
+    Box<T> box{-1, 1};
+
+    std::vector<T> xGlobal(nParticlesPerRank * nRanks), yGlobal(xGlobal.size()), zGlobal(xGlobal.size());
+    initCoordinates(xGlobal, yGlobal, zGlobal, box);
+
+    std::vector<T> x{xGlobal.begin() + rank * nParticlesPerRank, xGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> y{yGlobal.begin() + rank * nParticlesPerRank, yGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> z{zGlobal.begin() + rank * nParticlesPerRank, zGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> h(nParticlesPerRank, 0.1);
+    std::vector<KeyType> codes;
+
+    Domain<KeyType, T> domain(rank, nRanks, 10, box, 0.05);
+    domain.sync(x, y, z, h, codes);
+
+    std::vector<T> xRef = x;
+    std::vector<KeyType> codesRef = codes;
+    LocalParticleIndex numWithHalos = domain.nParticlesWithHalos();
+    LocalParticleIndex startIndex   = domain.startIndex();
+
+    for (auto& hi : h) { hi *= 0.99; }
+    domain.sync(x, y, z, h, codes);
+
+    EXPECT_EQ(domain.nParticlesWithHalos(), numWithHalos);
+    EXPECT_EQ(domain.startIndex(), startIndex);
+    EXPECT_EQ(x, xRef);
+    EXPECT_EQ(codes, codesRef);
+
+    for (auto& hi : h) { hi *= 1.5; }
+    domain.sync(x, y, z, h, codes);
+
+    EXPECT_GE(domain.nParticlesWithHalos(), numWithHalos);
+    std::vector<KeyType> keys(x.size());
+    computeSfcKeys<KeyType>(begin(x), end(x), begin(y), begin(z), begin(keys), domain.box());
+    EXPECT_EQ(keys, codes);
+}
+
+//! @brief halos of fields wrapped in reducedPrecision are the rounded values of the owning rank
+TEST(Domain, reducedPrecisionHalos)
+{
+    using T = double;
+    using KeyType = uint64_t;
+
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    int nParticlesPerRank = 1000 / nRanks;
+    Box<T> box{-1, 1};
+
+    std::vector<T> xGlobal(nParticlesPerRank * nRanks), yGlobal(xGlobal.size()), zGlobal(xGlobal.size());
+    initCoordinates(xGlobal, yGlobal, zGlobal, box);
+
+    std::vector<T> x{xGlobal.begin() + rank * nParticlesPerRank, xGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> y{yGlobal.begin() + rank * nParticlesPerRank, yGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> z{zGlobal.begin() + rank * nParticlesPerRank, zGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> h(nParticlesPerRank, 0.1);
+    std::vector<KeyType> codes;
+
+    FocusedDomain<KeyType, T> domain(rank, nRanks, 10, 10, box);
+    domain.sync(x, y, z, h, codes);
+
+    std::vector<T> rho(x.size(), 0), p(x.size(), 0), xCopy(x.size(), 0);
+    for (LocalParticleIndex i = domain.startIndex(); i < domain.endIndex(); ++i)
+    {
+        rho[i]   = x[i];
+        p[i]     = x[i];
+        xCopy[i] = x[i];
+    }
+
+    domain.exchangeHalos(xCopy, reducedPrecision<float>(rho));
+    domain.exchangeHalosAsync(reducedPrecision<BFloat16>(p)).wait();
+
+    EXPECT_EQ(xCopy, x);
+    for (LocalParticleIndex i = 0; i < x.size(); ++i)
+    {
+        bool owned = domain.startIndex() <= i && i < domain.endIndex();
+        EXPECT_EQ(rho[i], owned ? x[i] : T(float(x[i])));
+        EXPECT_EQ(p[i], owned ? x[i] : T(float(BFloat16(float(x[i])))));
+    }
+}
+
+/*! @brief a lazy sync without particle movement keeps the domain unchanged
+ *
+ * Moving a single particle on one rank out of the bounding box makes all ranks fall back to a full sync.
+ */
+TEST(Domain, lazySync)
+{
+    using T = double;
+    using KeyType = unsigned;
+
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    int nParticlesPerRank = 1000 / nRanks;
+    Box<T> box{-1, 1};
+
+    std::vector<T> xGlobal(nParticlesPerRank * nRanks), yGlobal(xGlobal.size()), zGlobal(xGlobal.size());
+    initCoordinates(xGlobal, yGlobal, zGlobal, box);
+
+    std::vector<T> x{xGlobal.begin() + rank * nParticlesPerRank, xGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> y{yGlobal.begin() + rank * nParticlesPerRank, yGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> z{zGlobal.begin() + rank * nParticlesPerRank, zGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> h(nParticlesPerRank, 0.1);
+    std::vector<KeyType> codes;
+
+    Domain<KeyType, T> domain(rank, nRanks, 10, box);
+    domain.sync(x, y, z, h, codes);
+
+    std::vector<T> xRef = x;
+    std::vector<KeyType> codesRef = codes;
+    LocalParticleIndex numWithHalos = domain.nParticlesWithHalos();
+
+    EXPECT_TRUE(domain.syncLazy(x, y, z, h, codes));
+    EXPECT_EQ(domain.nParticlesWithHalos(), numWithHalos);
+    EXPECT_EQ(x, xRef);
+    EXPECT_EQ(codes, codesRef);
+
+    if (rank == 0) { x[domain.startIndex()] = domain.box().xmax() + 0.5; }
+
+    EXPECT_FALSE(domain.syncLazy(x, y, z, h, codes));
+    std::vector<KeyType> keys(x.size());
+    computeSfcKeys<KeyType>(begin(x), end(x), begin(y), begin(z), begin(keys), domain.box());
+    EXPECT_EQ(keys, codes);
+}
+
+/*! @brief a partial sync of active particles gives the same arrays as a full halo exchange
+ *
+ * Pairs of particles in the same leaf swap their coordinates, which keeps them in their leaves, but changes
+ * the key order within these leaves. Only these pairs are passed as active particles.
+ */
+TEST(Domain, activeSync)
+{
+    using T = double;
+    using KeyType = unsigned;
+
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    int nParticlesPerRank = 1000 / nRanks;
+    Box<T> box{-1, 1};
+
+    std::vector<T> xGlobal(nParticlesPerRank * nRanks), yGlobal(xGlobal.size()), zGlobal(xGlobal.size());
+    initCoordinates(xGlobal, yGlobal, zGlobal, box);
+
+    std::vector<T> x{xGlobal.begin() + rank * nParticlesPerRank, xGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> y{yGlobal.begin() + rank * nParticlesPerRank, yGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> z{zGlobal.begin() + rank * nParticlesPerRank, zGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> h(nParticlesPerRank, 0.1);
+    std::vector<KeyType> codes;
+
+    Domain<KeyType, T> domain(rank, nRanks, 10, box);
+    domain.sync(x, y, z, h, codes);
+
+    std::vector<LocalParticleIndex> active;
+    for (LocalParticleIndex p = domain.startIndex(); p + 1 < domain.endIndex(); p += 10)
+    {
+        const auto& tree = domain.tree();
+        auto leaf        = std::upper_bound(tree.begin(), tree.end(), codes[p]);
+        if (codes[p] == codes[p + 1] || *leaf <= codes[p + 1]) { continue; }
+
+        std::swap(x[p], x[p + 1]);
+        std::swap(y[p], y[p + 1]);
+        std::swap(z[p], z[p + 1]);
+        active.push_back(p);
+        active.push_back(p + 1);
+    }
+
+    std::vector<T> mass(x.size(), T(rank + 1));
+    EXPECT_TRUE(domain.syncActive(active, x, y, z, h, codes, mass));
+
+    EXPECT_TRUE(std::is_sorted(codes.begin() + domain.startIndex(), codes.begin() + domain.endIndex()));
+    std::vector<KeyType> keys(x.size());
+    computeSfcKeys<KeyType>(begin(x), end(x), begin(y), begin(z), begin(keys), domain.box());
+    EXPECT_EQ(keys, codes);
+
+    // halos outside the active leaves did not change, a full exchange does not modify any elements
+    std::vector<T> xFull = x, yFull = y, zFull = z;
+    domain.exchangeHalos(xFull, yFull, zFull);
+    EXPECT_EQ(xFull, x);
+    EXPECT_EQ(yFull, y);
+    EXPECT_EQ(zFull, z);
+
+    std::vector<T> density(x.size(), 0);
+    std::fill(density.begin() + domain.startIndex(), density.begin() + domain.endIndex(), T(rank + 1));
+    domain.exchangeHalos(density);
+    for (LocalParticleIndex p : active)
+    {
+        density[p] += 1;
+    }
+    domain.exchangeHalosActive(active, density);
+
+    std::vector<T> densityFull = density;
+    domain.exchangeHalos(densityFull);
+    EXPECT_EQ(densityFull, density);
+
+    // invalid active indices on a single rank throw on all ranks
+    std::vector<LocalParticleIndex> invalid = active;
+    if (rank == 0) { invalid.push_back(domain.endIndex()); }
+    EXPECT_THROW(domain.exchangeHalosActive(invalid, density), std::runtime_error);
+    EXPECT_THROW(domain.syncActive(invalid, x, y, z, h, codes, mass), std::runtime_error);
+
+    // an active particle that leaves the bounding box triggers a full sync on all ranks
+    if (rank == 0 && !active.empty()) { x[active.front()] = domain.box().xmax() + 0.5; }
+    EXPECT_FALSE(domain.syncActive(active, x, y, z, h, codes, mass));
+}
+
+//! @brief fields of a particle container are exchanged according to their kind
+TEST(Domain, particleContainer)
+{
+    using T = double;
+    using KeyType = unsigned;
+
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    int nParticlesPerRank = 1000 / nRanks;
+    Box<T> box{-1, 1};
+
+    std::vector<T> xGlobal(nParticlesPerRank * nRanks), yGlobal(xGlobal.size()), zGlobal(xGlobal.size());
+    initCoordinates(xGlobal, yGlobal, zGlobal, box);
+
+    std::vector<T> x{xGlobal.begin() + rank * nParticlesPerRank, xGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> y{yGlobal.begin() + rank * nParticlesPerRank, yGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> z{zGlobal.begin() + rank * nParticlesPerRank, zGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> h(nParticlesPerRank, 0.1);
+    std::vector<KeyType> codes;
+
+    std::vector<T> idRef(nParticlesPerRank);
+    std::iota(idRef.begin(), idRef.end(), T(rank * nParticlesPerRank));
+
+    ParticleContainer particles;
+    auto id      = particles.registerField<uint64_t>("id", FieldKind::migrate);
+    auto xCopy   = particles.registerField<float>("xCopy", FieldKind::halo);
+    auto scratch = particles.registerField<int>("scratch", FieldKind::transient);
+    auto tracer  = particles.registerField<uint64_t>("tracer", FieldKind::deferred);
+    particles.resize(nParticlesPerRank);
+    std::iota(particles.field(id).begin(), particles.field(id).end(), uint64_t(rank * nParticlesPerRank));
+    std::iota(particles.field(tracer).begin(), particles.field(tracer).end(), uint64_t(rank * nParticlesPerRank));
+
+    Domain<KeyType, T> domain(rank, nRanks, 10, box);
+    for (int step = 0; step < 2; ++step)
+    {
+        std::transform(x.begin(), x.end(), particles.field(xCopy).begin(), [](T xi) { return float(xi); });
+        domain.sync(x, y, z, h, codes, idRef, particles);
+
+        EXPECT_EQ(particles.size(), x.size());
+        EXPECT_EQ(particles.field(scratch).size(), x.size());
+        for (LocalParticleIndex i = domain.startIndex(); i < domain.endIndex(); ++i)
+        {
+            EXPECT_EQ(T(particles.field(id)[i]), idRef[i]);
+        }
+        for (std::size_t i = 0; i < x.size(); ++i)
+        {
+            EXPECT_EQ(particles.field(xCopy)[i], float(x[i]));
+        }
+    }
+
+    // the deferred field is only accessed after both syncs, its reorder maps were composed and applied on exchange
+    for (LocalParticleIndex i = domain.startIndex(); i < domain.endIndex(); ++i)
+    {
+        EXPECT_EQ(T(particles.field(tracer)[i]), idRef[i]);
+    }
+
+    int numAssigned = domain.nParticles();
+    MPI_Allreduce(MPI_IN_PLACE, &numAssigned, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    EXPECT_EQ(numAssigned, nParticlesPerRank * nRanks);
+}
+
+//! @brief a decomposition by particle weights balances the weights instead of the particle counts
+TEST(Domain, weightedDecomposition)
+{
+    using T = double;
+    using KeyType = unsigned;
+
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    int nParticlesPerRank = 1000;
+    int nParticles        = nParticlesPerRank * nRanks;
+    Box<T> box{-1, 1};
+
+    std::vector<T> xGlobal(nParticles), yGlobal(nParticles), zGlobal(nParticles);
+    initCoordinates(xGlobal, yGlobal, zGlobal, box);
+
+    std::vector<T> x{xGlobal.begin() + rank * nParticlesPerRank, xGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> y{yGlobal.begin() + rank * nParticlesPerRank, yGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> z{zGlobal.begin() + rank * nParticlesPerRank, zGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> h(nParticlesPerRank, 0.05);
+    std::vector<KeyType> codes;
+
+    // particles in the x > 0 half are ten times as expensive
+    auto particleWeight = [](T xi) { return xi > 0 ? 10.0f : 1.0f; };
+
+    Domain<KeyType, T> domain(rank, nRanks, 10, box);
+    for (int step = 0; step < 2; ++step)
+    {
+        std::vector<float> weights(x.size());
+        std::transform(x.begin(), x.end(), weights.begin(), particleWeight);
+        domain.syncWeighted(weights, 4.0, x, y, z, h, codes);
+    }
+
+    int localCount = domain.nParticles();
+    int totalCount = localCount;
+    MPI_Allreduce(MPI_IN_PLACE, &totalCount, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    EXPECT_EQ(totalCount, nParticles);
+    EXPECT_LE(localCount, 4 * nParticlesPerRank);
+
+    double localWeight = 0;
+    for (LocalParticleIndex i = domain.startIndex(); i < domain.endIndex(); ++i)
+    {
+        localWeight += particleWeight(x[i]);
+    }
+    double maxWeight = localWeight, totalWeight = localWeight;
+    MPI_Allreduce(MPI_IN_PLACE, &maxWeight, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &totalWeight, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    EXPECT_LT(maxWeight, 1.2 * totalWeight / nRanks);
+}
+
+/*! @brief a sync after restoring a saved state gives the same result as continuing with the original domain
+ *
+ * @p restarted is constructed with the same arguments as @p original, but has not performed any sync yet
+ */
+template<class KeyType, class T, class DomainType>
+void checkpointRestart(DomainType& original, DomainType& restarted, int rank, int nRanks)
+{
+    int nParticlesPerRank = 1000 / nRanks;
+    Box<T> box{-1, 1};
+
+    std::vector<T> xGlobal(nParticlesPerRank * nRanks), yGlobal(xGlobal.size()), zGlobal(xGlobal.size());
+    initCoordinates(xGlobal, yGlobal, zGlobal, box);
+
+    std::vector<T> x{xGlobal.begin() + rank * nParticlesPerRank, xGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> y{yGlobal.begin() + rank * nParticlesPerRank, yGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> z{zGlobal.begin() + rank * nParticlesPerRank, zGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> h(nParticlesPerRank, 0.1);
+    std::vector<KeyType> codes;
+
+    original.sync(x, y, z, h, codes);
+
+    std::string filename = "domain_state_" + std::to_string(nRanks) + ".bin";
+    original.saveState(filename);
+
+    std::vector<T> xRestart = x, yRestart = y, zRestart = z, hRestart = h;
+    std::vector<KeyType> codesRestart;
+    restarted.loadState(filename);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (rank == 0) { std::remove(filename.c_str()); }
+
+    EXPECT_EQ(restarted.startIndex(), original.startIndex());
+    EXPECT_EQ(restarted.endIndex(), original.endIndex());
+    EXPECT_EQ(restarted.nParticlesWithHalos(), original.nParticlesWithHalos());
+
+    // move the particles in the same way in both runs
+    auto move = [](std::vector<T>& coords)
+    {
+        for (std::size_t i = 0; i < coords.size(); ++i)
+        {
+            coords[i] += T(0.01) * std::sin(T(i));
+        }
+    };
+    move(x);
+    move(xRestart);
+
+    original.sync(x, y, z, h, codes);
+    restarted.sync(xRestart, yRestart, zRestart, hRestart, codesRestart);
+
+    EXPECT_EQ(restarted.startIndex(), original.startIndex());
+    EXPECT_EQ(restarted.endIndex(), original.endIndex());
+    EXPECT_TRUE(std::equal(restarted.tree().begin(), restarted.tree().end(), original.tree().begin(),
+                           original.tree().end()));
+    EXPECT_EQ(xRestart, x);
+    EXPECT_EQ(hRestart, h);
+    EXPECT_EQ(codesRestart, codes);
+}
+
+TEST(Domain, checkpointRestart)
+{
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    Domain<unsigned, double> original(rank, nRanks, 10, {-1, 1});
+    Domain<unsigned, double> restarted(rank, nRanks, 10, {-1, 1});
+    checkpointRestart<unsigned, double>(original, restarted, rank, nRanks);
+}
+
+TEST(FocusDomain, checkpointRestart)
+{
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    FocusedDomain<uint64_t, double> original(rank, nRanks, 50, 10, {-1, 1});
+    FocusedDomain<uint64_t, double> restarted(rank, nRanks, 50, 10, {-1, 1});
+    checkpointRestart<uint64_t, double>(original, restarted, rank, nRanks);
+
+    EXPECT_TRUE(std::equal(restarted.focusedTree().begin(), restarted.focusedTree().end(),
+                           original.focusedTree().begin(), original.focusedTree().end()));
+}
+
+TEST(Domain, snapshotRestart)
+{
+    using KeyType = unsigned;
+    using T       = double;
+
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    int nParticlesPerRank = 1000 / nRanks;
+    Box<T> box{-1, 1};
+
+    std::vector<T> xGlobal(nParticlesPerRank * nRanks), yGlobal(xGlobal.size()), zGlobal(xGlobal.size());
+    initCoordinates(xGlobal, yGlobal, zGlobal, box);
+
+    std::vector<T> x{xGlobal.begin() + rank * nParticlesPerRank, xGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> y{yGlobal.begin() + rank * nParticlesPerRank, yGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> z{zGlobal.begin() + rank * nParticlesPerRank, zGlobal.begin() + (rank + 1) * nParticlesPerRank};
+    std::vector<T> h(nParticlesPerRank, 0.1);
+    std::vector<T> m(nParticlesPerRank);
+    std::iota(m.begin(), m.end(), T(rank * nParticlesPerRank));
+    std::vector<KeyType> codes;
+
+    Domain<KeyType, T> original(rank, nRanks, 10, box);
+    original.sync(x, y, z, h, codes, m);
+
+    std::string filename = "domain_snapshot_" + std::to_string(nRanks) + ".bin";
+    original.writeSnapshot(filename, x, y, z, h, m);
+
+    Domain<KeyType, T> restarted(rank, nRanks, 10, box);
+    std::vector<T> xr, yr, zr, hr, mr;
+    std::vector<KeyType> codesRestart;
+    restarted.readSnapshot(filename, xr, yr, zr, hr, mr);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (rank == 0) { std::remove(filename.c_str()); }
+
+    EXPECT_EQ(restarted.box(), original.box());
+    EXPECT_EQ(restarted.tree(), original.tree());
+
+    // with a single compute node, the snapshot is read with the same assignment as the one of the sync
+    EXPECT_EQ(xr.size(), original.nParticles());
+    EXPECT_TRUE(std::equal(xr.begin(), xr.end(), x.begin() + original.startIndex()));
+    EXPECT_TRUE(std::equal(mr.begin(), mr.end(), m.begin() + original.startIndex()));
+
+    original.sync(x, y, z, h, codes, m);
+    restarted.sync(xr, yr, zr, hr, codesRestart, mr);
+
+    EXPECT_EQ(restarted.startIndex(), original.startIndex());
+    EXPECT_EQ(restarted.endIndex(), original.endIndex());
+    EXPECT_EQ(xr, x);
+    EXPECT_EQ(codesRestart, codes);
+    // halos of particle properties are not exchanged by sync
+    EXPECT_TRUE(std::equal(mr.begin() + restarted.startIndex(), mr.begin() + restarted.endIndex(),
+                           m.begin() + original.startIndex()));
+}
+
+TEST(Domain, lodSummary)
+{
+    using KeyType = unsigned;
+    using T       = double;
+
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    int nParticlesPerRank = 1000;
+    Box<T> box{-1, 1};
+
+    std::vector<T> x(nParticlesPerRank), y(nParticlesPerRank), z(nParticlesPerRank);
+    initCoordinates(x, y, z, box);
+    std::vector<T> h(nParticlesPerRank, 0.1);
+    std::vector<T> m(nParticlesPerRank, 2.0);
+    std::vector<T> id(nParticlesPerRank);
+    std::iota(id.begin(), id.end(), T(rank * nParticlesPerRank));
+    std::vector<KeyType> codes;
+
+    Domain<KeyType, T> domain(rank, nRanks, 10, box);
+    domain.sync(x, y, z, h, codes, m, id);
+
+    T localSum[4] = {0, 0, 0, 0};
+    for (LocalParticleIndex i = domain.startIndex(); i < domain.endIndex(); ++i)
+    {
+        localSum[0] += x[i];
+        localSum[1] += y[i];
+        localSum[2] += z[i];
+        localSum[3] = std::max(localSum[3], id[i]);
+    }
+    MPI_Allreduce(MPI_IN_PLACE, localSum, 3, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, localSum + 3, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+    auto root = domain.lodSummary(0, codes, x, y, z, h, m, &id, LodReduction::max);
+    auto lod  = domain.lodSummary(2, codes, x, y, z, h, m, &id, LodReduction::max);
+
+    if (rank != 0)
+    {
+        EXPECT_TRUE(root.counts.empty());
+        return;
+    }
+
+    uint64_t numGlobal = uint64_t(nParticlesPerRank) * nRanks;
+    ASSERT_EQ(root.counts.size(), 1);
+    EXPECT_EQ(root.counts[0], numGlobal);
+    EXPECT_NEAR(root.mass[0], 2.0 * numGlobal, 1e-8);
+    EXPECT_NEAR(root.x[0], localSum[0] / numGlobal, 1e-10);
+    EXPECT_NEAR(root.y[0], localSum[1] / numGlobal, 1e-10);
+    EXPECT_NEAR(root.z[0], localSum[2] / numGlobal, 1e-10);
+    EXPECT_NEAR(root.h[0], 0.1, 1e-12);
+    EXPECT_EQ(root.field[0], localSum[3]);
+
+    EXPECT_EQ(lod.nodes, truncateTree<KeyType>(domain.tree(), 2));
+    EXPECT_EQ(std::accumulate(lod.counts.begin(), lod.counts.end(), uint64_t(0)), numGlobal);
+}
+
+TEST(Domain, syncInstrumentation)
+{
+    using KeyType = uint64_t;
+    using T       = double;
+
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    int nParticlesPerRank = 1000;
+    Box<T> box{-1, 1};
+
+    std::vector<T> x(nParticlesPerRank), y(nParticlesPerRank), z(nParticlesPerRank);
+    initCoordinates(x, y, z, box);
+    std::vector<T> h(nParticlesPerRank, 0.1);
+    std::vector<KeyType> codes;
+
+    SyncTimer timer;
+    Domain<KeyType, T> domain(rank, nRanks, 10, box);
+    domain.setObserver(&timer);
+    domain.sync(x, y, z, h, codes);
+    domain.sync(x, y, z, h, codes);
+
+    for (SyncPhase phase : {SyncPhase::box, SyncPhase::globalTree, SyncPhase::particleExchange,
+                            SyncPhase::haloExchange})
+    {
+        EXPECT_GE(timer.counters(phase).calls, 2);
+    }
+    EXPECT_GE(timer.counters(SyncPhase::globalTree).iterations, 2);
+
+    // every particle sent is received somewhere
+    const PhaseTraffic& traffic = timer.counters(SyncPhase::particleExchange).traffic;
+    uint64_t volumes[4] = {traffic.bytesSent, traffic.bytesReceived, traffic.messagesSent, traffic.messagesReceived};
+    MPI_Allreduce(MPI_IN_PLACE, volumes, 4, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    EXPECT_EQ(volumes[0], volumes[1]);
+    EXPECT_EQ(volumes[2], volumes[3]);
+    if (nRanks > 1) { EXPECT_GT(volumes[0], 0); }
+
+    std::vector<PhaseReport> reports = reduceSyncCounters(timer);
+    ASSERT_FALSE(reports.empty());
+    for (const auto& r : reports)
+    {
+        EXPECT_LE(r.seconds.min, r.seconds.avg);
+        EXPECT_LE(r.seconds.avg, r.seconds.max * (1 + 1e-12));
+    }
+    if (rank == 0) { printSyncReport(reports); }
+}
+
+TEST(Domain, balanceMetrics)
+{
+    using KeyType = uint64_t;
+    using T       = double;
+
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    int nParticlesPerRank = 1000;
+    Box<T> box{-1, 1};
+
+    std::vector<T> x(nParticlesPerRank), y(nParticlesPerRank), z(nParticlesPerRank);
+    initCoordinates(x, y, z, box);
+    std::vector<T> h(nParticlesPerRank, 0.1);
+    std::vector<KeyType> codes;
+
+    Domain<KeyType, T> domain(rank, nRanks, 10, box);
+    domain.sync(x, y, z, h, codes);
+
+    std::vector<float> weights(domain.nParticlesWithHalos(), 2.0f);
+    DomainBalance balance = domain.balance(weights);
+
+    EXPECT_NEAR(balance.assigned.avg, nParticlesPerRank, 1e-10);
+    EXPECT_LE(balance.assigned.min, balance.assigned.avg);
+    EXPECT_GE(balance.assigned.max, balance.assigned.avg);
+    EXPECT_GE(balance.imbalance(), 1.0);
+    EXPECT_NEAR(balance.weights.avg, 2 * balance.assigned.avg, 1e-10);
+    EXPECT_NEAR(balance.weightImbalance(), balance.imbalance(), 1e-10);
+    EXPECT_LE(balance.peers.max, nRanks - 1);
+    EXPECT_LE(balance.haloRatio.min, domain.haloRatio());
+    EXPECT_GE(balance.haloRatio.max, domain.haloRatio());
+
+    // all halos are received from peers
+    uint64_t numHalosReceived = 0;
+    for (const PeerVolume& v : domain.haloExchangeVolume())
+    {
+        numHalosReceived += v.elementsReceived;
+        EXPECT_EQ(v.bytesReceived, v.elementsReceived * 4 * sizeof(T));
+    }
+    EXPECT_EQ(numHalosReceived, domain.nParticlesWithHalos() - domain.nParticles());
+    EXPECT_EQ(domain.numPeers(), int(domain.haloExchangeVolume().size()));
+
+    // the particles sent from rank a to rank b are those received by b from a
+    std::vector<uint64_t> sent(nRanks * nRanks, 0), received(nRanks * nRanks, 0);
+    for (const PeerVolume& v : domain.particleExchangeVolume())
+    {
+        EXPECT_NE(v.rank, rank);
+        sent[rank * nRanks + v.rank]     = v.elementsSent;
+        received[v.rank * nRanks + rank] = v.elementsReceived;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, sent.data(), nRanks * nRanks, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, received.data(), nRanks * nRanks, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    EXPECT_EQ(sent, received);
+}
+
+//! @brief synthetic application cost with a minimum at @p optimum, dominating the measured sync times
+static double syntheticCost(unsigned bucketSize, unsigned optimum)
+{
+    return 0.05 * std::abs(std::log2(double(bucketSize) / optimum));
+}
+
+TEST(Domain, autotune)
+{
+    using KeyType = uint64_t;
+    using T       = double;
+
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    int nParticlesPerRank = 1000;
+    Box<T> box{-1, 1};
+
+    std::vector<T> x(nParticlesPerRank), y(nParticlesPerRank), z(nParticlesPerRank);
+    initCoordinates(x, y, z, box);
+    std::vector<T> h(nParticlesPerRank, 0.1);
+    std::vector<KeyType> codes;
+
+    {
+        Domain<KeyType, T> domain(rank, nRanks, 8, box);
+
+        TuningSettings settings{{4, 4, 0}, {128, 128, 0}, 1, 1};
+        Autotuner tuner(domain, settings);
+
+        for (int step = 0; step < 20 && !tuner.locked(); ++step)
+        {
+            domain.sync(x, y, z, h, codes);
+            tuner.step(syntheticCost(domain.bucketSize(), 32));
+        }
+
+        EXPECT_TRUE(tuner.locked());
+        EXPECT_EQ(domain.bucketSize(), 32);
+        // initial setting, two improvements and the rejected bucket size of 64
+        ASSERT_EQ(tuner.trials().size(), 4);
+        EXPECT_EQ(tuner.trials().back().parameters.bucketSize, 64);
+    }
+    {
+        FocusedDomain<KeyType, T> domain(rank, nRanks, 64, 32, box);
+
+        // only the focus bucket size is tuned, towards smaller values
+        TuningSettings settings{{64, 4, 1.0f}, {64, 64, 1.0f}, 1, 1};
+        Autotuner tuner(domain, settings);
+
+        for (int step = 0; step < 20 && !tuner.locked(); ++step)
+        {
+            domain.sync(x, y, z, h, codes);
+            tuner.step(syntheticCost(domain.bucketSizeFocus(), 8));
+        }
+
+        EXPECT_TRUE(tuner.locked());
+        EXPECT_EQ(domain.bucketSize(), 64);
+        EXPECT_EQ(domain.bucketSizeFocus(), 8);
+        EXPECT_EQ(domain.theta(), 1.0f);
+        // 32 (initial), 64 (rejected), 16, 8, 4 (rejected)
+        EXPECT_EQ(tuner.trials().size(), 5);
+
+        // the locked parameters remain in place
+        domain.sync(x, y, z, h, codes);
+        tuner.step(1.0);
+        EXPECT_EQ(domain.bucketSizeFocus(), 8);
+    }
+}
+
+//! @brief two independent domains decomposed concurrently on disjoint halves of MPI_COMM_WORLD
+TEST(Domain, subCommunicator)
+{
+    int worldRank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+
+    MPI_Comm subComm;
+    MPI_Comm_split(MPI_COMM_WORLD, worldRank % 2, worldRank, &subComm);
+
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(subComm, &rank);
+    MPI_Comm_size(subComm, &nRanks);
+
+    int bucketSize      = 50;
+    int bucketSizeFocus = 10;
+
+    {
+        Domain<HilbertKey<uint64_t>, double> domain(rank, nRanks, bucketSize, {-1, 1}, 0, -1, subComm);
+        int comparison;
+        MPI_Comm_compare(domain.comm(), subComm, &comparison);
+        EXPECT_EQ(comparison, MPI_CONGRUENT);
+        randomGaussianDomain<HilbertKey<uint64_t>, double>(domain, rank, nRanks);
+    }
+    {
+        FocusedDomain<HilbertKey<uint64_t>, double> domain(rank, nRanks, bucketSize, bucketSizeFocus, {-1, 1}, -1,
+                                                           subComm);
+        int comparison;
+        MPI_Comm_compare(domain.comm(), subComm, &comparison);
+        EXPECT_EQ(comparison, MPI_CONGRUENT);
+        randomGaussianDomain<HilbertKey<uint64_t>, double>(domain, rank, nRanks);
+    }
+
+    MPI_Comm_free(&subComm);
+}
+
+/*! @brief a domain on a sub-communicator that is synced more often than a domain on MPI_COMM_WORLD
+ *
+ * Only the ranks with even world rank sync the domain of their sub-communicator. The exchanges of the world
+ * domain must still use matching tags on all ranks.
+ */
+TEST(Domain, unevenSubCommunicatorSyncs)
+{
+    using KeyType = HilbertKey<uint64_t>;
+    using T       = double;
+
+    int worldRank = 0, worldSize = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+
+    MPI_Comm subComm;
+    MPI_Comm_split(MPI_COMM_WORLD, worldRank % 2, worldRank, &subComm);
+
+    int subRank = 0, subSize = 0;
+    MPI_Comm_rank(subComm, &subRank);
+    MPI_Comm_size(subComm, &subSize);
+
+    Box<T> box{-1, 1};
+    int numParticles = 500;
+
+    {
+        Domain<KeyType, T> subDomain(subRank, subSize, 32, box, 0, -1, subComm);
+        Domain<KeyType, T> worldDomain(worldRank, worldSize, 32, box);
+
+        std::vector<T> xs(numParticles), ys(numParticles), zs(numParticles), hs(numParticles, 0.05);
+        std::vector<T> xw(numParticles), yw(numParticles), zw(numParticles), hw(numParticles, 0.05);
+        initCoordinates(xs, ys, zs, box);
+        initCoordinates(xw, yw, zw, box);
+        std::vector<SfcKeyType_t<KeyType>> codesSub, codesWorld;
+
+        for (int step = 0; step < 3; ++step)
+        {
+            if (worldRank % 2 == 0) { subDomain.sync(xs, ys, zs, hs, codesSub); }
+            worldDomain.sync(xw, yw, zw, hw, codesWorld);
+        }
+
+        int globalCount = worldDomain.nParticles();
+        MPI_Allreduce(MPI_IN_PLACE, &globalCount, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+        EXPECT_EQ(globalCount, worldSize * numParticles);
+    }
+
+    MPI_Comm_free(&subComm);
+}
+
+/*! @brief snapshots, checkpoints and LOD summaries of domains on disjoint halves of MPI_COMM_WORLD
+ *
+ * The two groups perform different numbers of syncs, such that any collective operation that is not restricted
+ * to the communicator of the domain deadlocks.
+ */
+TEST(Domain, subCommunicatorIO)
+{
+    using KeyType = unsigned;
+    using T       = double;
+
+    int worldRank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    int color = worldRank % 2;
+
+    MPI_Comm subComm;
+    MPI_Comm_split(MPI_COMM_WORLD, color, worldRank, &subComm);
+
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(subComm, &rank);
+    MPI_Comm_size(subComm, &nRanks);
+
+    int nParticlesPerRank = 500;
+    Box<T> box{-1, 1};
+
+    std::vector<T> x(nParticlesPerRank), y(nParticlesPerRank), z(nParticlesPerRank), h(nParticlesPerRank, 0.1);
+    initCoordinates(x, y, z, box);
+    std::vector<T> m(nParticlesPerRank, 1.0);
+    std::vector<KeyType> codes;
+
+    Domain<KeyType, T> domain(rank, nRanks, 10, box, 0, -1, subComm);
+    for (int step = 0; step < 1 + color; ++step)
+    {
+        domain.sync(x, y, z, h, codes, m);
+    }
+
+    std::string suffix = std::to_string(color) + "_" + std::to_string(nRanks) + ".bin";
+
+    std::string snapshotFile = "domain_sub_snapshot_" + suffix;
+    domain.writeSnapshot(snapshotFile, x, y, z, h, m);
+
+    Domain<KeyType, T> fromSnapshot(rank, nRanks, 10, box, 0, -1, subComm);
+    std::vector<T> xr, yr, zr, hr, mr;
+    fromSnapshot.readSnapshot(snapshotFile, xr, yr, zr, hr, mr);
+
+    std::string stateFile = "domain_sub_state_" + suffix;
+    domain.saveState(stateFile);
+    Domain<KeyType, T> fromState(rank, nRanks, 10, box, 0, -1, subComm);
+    fromState.loadState(stateFile);
+
+    auto summary = domain.lodSummary(0, codes, x, y, z, h, m);
+
+    MPI_Barrier(subComm);
+    if (rank == 0)
+    {
+        std::remove(snapshotFile.c_str());
+        std::remove(stateFile.c_str());
+    }
+
+    EXPECT_EQ(fromSnapshot.tree(), domain.tree());
+    EXPECT_EQ(fromState.tree(), domain.tree());
+    EXPECT_EQ(fromState.startIndex(), domain.startIndex());
+    EXPECT_EQ(fromState.endIndex(), domain.endIndex());
+
+    int numRead = xr.size();
+    MPI_Allreduce(MPI_IN_PLACE, &numRead, 1, MPI_INT, MPI_SUM, subComm);
+    EXPECT_EQ(numRead, nParticlesPerRank * nRanks);
+
+    if (rank == 0)
+    {
+        ASSERT_EQ(summary.counts.size(), 1);
+        EXPECT_EQ(summary.counts[0], uint64_t(nParticlesPerRank) * nRanks);
+    }
+    else { EXPECT_TRUE(summary.counts.empty()); }
+
+    // the domains continue independently after the restart
+    fromState.sync(x, y, z, h, codes, m);
+
+    MPI_Comm_free(&subComm);
+}
+
+/*! @brief remove and create particles between syncs
+ *
+ * Each particle carries its id as a property. After removing the particles with even ids on each rank and creating
+ * new ones, the next sync must distribute exactly the remaining and the created particles.
+ */
+template<class DomainType>
+void removeAndCreateParticles(DomainType domain, int rank, int nRanks)
+{
+    using KeyType = typename std::decay_t<decltype(domain.tree())>::value_type;
+    using T       = double;
+
+    int numParticles = 1000;
+    std::vector<T> x(numParticles), y(numParticles), z(numParticles), h(numParticles, 0.05), id(numParticles);
+    Box<T> box{-1, 1};
+    initCoordinates(x, y, z, box);
+    for (int i = 0; i < numParticles; ++i)
+    {
+        id[i] = rank * numParticles + i;
+    }
+
+    std::vector<KeyType> codes;
+    domain.sync(x, y, z, h, codes, id);
+
+    std::vector<LocalParticleIndex> removeIndices;
+    for (LocalParticleIndex i = domain.startIndex(); i < domain.endIndex(); ++i)
+    {
+        if (int(id[i]) % 2 == 0) { removeIndices.push_back(i); }
+    }
+
+    int numNew = 10 + rank;
+    LocalParticleIndex firstNew = domain.removeAndCreate(removeIndices, numNew, x, y, z, h, id);
+    EXPECT_EQ(domain.endIndex(), firstNew + numNew);
+
+    for (int i = 0; i < numNew; ++i)
+    {
+        LocalParticleIndex p = firstNew + i;
+        x[p] = 0.01 * i;
+        y[p] = -0.01 * i;
+        z[p] = 0.5;
+        h[p] = 0.05;
+        // odd ids that are not used by the initial particles
+        id[p] = nRanks * numParticles + 2 * (rank * 100 + i) + 1;
+    }
+
+    domain.sync(x, y, z, h, codes, id);
+
+    EXPECT_TRUE(std::is_sorted(codes.begin() + domain.startIndex(), codes.begin() + domain.endIndex()));
+
+    int localCount = domain.nParticles();
+    int globalCount = localCount;
+    MPI_Allreduce(MPI_IN_PLACE, &globalCount, 1, MPI_INT, MPI_SUM, domain.comm());
+    int refCount = nRanks * numParticles / 2 + nRanks * 10 + nRanks * (nRanks - 1) / 2;
+    EXPECT_EQ(globalCount, refCount);
+
+    // all ids are odd and unique
+    std::vector<int> localIds(id.begin() + domain.startIndex(), id.begin() + domain.endIndex());
+    EXPECT_TRUE(std::all_of(localIds.begin(), localIds.end(), [](int i) { return i % 2 == 1; }));
+
+    std::vector<int> counts(nRanks), displs(nRanks + 1, 0);
+    MPI_Allgather(&localCount, 1, MPI_INT, counts.data(), 1, MPI_INT, domain.comm());
+    std::partial_sum(counts.begin(), counts.end(), displs.begin() + 1);
+    std::vector<int> allIds(displs.back());
+    MPI_Allgatherv(localIds.data(), localCount, MPI_INT, allIds.data(), counts.data(), displs.data(), MPI_INT,
+                   domain.comm());
+    std::sort(allIds.begin(), allIds.end());
+    EXPECT_EQ(std::adjacent_find(allIds.begin(), allIds.end()), allIds.end());
+}
+
+TEST(Domain, removeAndCreate)
+{
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    removeAndCreateParticles(Domain<HilbertKey<uint64_t>, double>(rank, nRanks, 32, {-1, 1}), rank, nRanks);
+    removeAndCreateParticles(FocusedDomain<HilbertKey<uint64_t>, double>(rank, nRanks, 32, 8, {-1, 1}), rank,
+                             nRanks);
 }
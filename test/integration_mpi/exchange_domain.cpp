@@ -29,6 +29,8 @@
  * @author Sebastian Keller <sebastian.f.keller@gmail.com>
  */
 
+#include <array>
+#include <numeric>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -90,7 +92,7 @@ void exchangeAllToAll(int thisRank, int nRanks)
     int nParticlesThisRank = segmentSize * nRanks;
 
     reallocate(nParticlesThisRank, x, y);
-    exchangeParticles<T>(sendList, Rank(thisRank), nParticlesThisRank, ordering.data(), x.data(), y.data());
+    exchangeParticles(sendList, Rank(thisRank), nParticlesThisRank, ordering.data(), x.data(), y.data());
 
     std::vector<T> refX(nParticlesThisRank);
     for (int rank = 0; rank < nRanks; ++rank)
@@ -147,7 +149,7 @@ void exchangeCyclicNeighbors(int thisRank, int nRanks)
     sendList[nextRank].addRange(gridSize - nex, gridSize);
 
     reallocate(gridSize, x, y);
-    exchangeParticles<T>(sendList, Rank(thisRank), gridSize, ordering.data(), x.data(), y.data());
+    exchangeParticles(sendList, Rank(thisRank), gridSize, ordering.data(), x.data(), y.data());
 
     int incomingRank = (thisRank - 1 + nRanks) % nRanks;
     std::vector<T> refX(gridSize, thisRank);
@@ -222,8 +224,8 @@ void exchangeCyclicNeighborsOffsets(int thisRank, int nRanks)
     sendList[nextRank].addRange(assignedSize - nex, assignedSize);
 
     reallocate(finalSize, x, y);
-    exchangeParticles<T>(sendList, Rank(thisRank), assignedSize, inputOffset, outputOffset, ordering.data(), x.data(),
-                         y.data());
+    exchangeParticles(sendList, Rank(thisRank), assignedSize, inputOffset, outputOffset, ordering.data(), x.data(),
+                      y.data());
 
     // the reference covers only the assigned range of 64
     std::vector<T> refX(assignedSize, thisRank);
@@ -244,6 +246,33 @@ void exchangeCyclicNeighborsOffsets(int thisRank, int nRanks)
     }
 }
 
+//! @brief the kept particles and each received message form one contiguous output segment
+TEST(GlobalDomain, exchangeSegments)
+{
+    int thisRank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &thisRank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+    if (nRanks < 2) { return; }
+
+    int gridSize = 64;
+    int nex      = 10;
+    std::vector<double> x(gridSize, thisRank);
+    std::vector<int> ordering(gridSize);
+    std::iota(begin(ordering), end(ordering), 0);
+
+    SendList sendList(nRanks);
+    sendList[thisRank].addRange(0, gridSize - nex);
+    sendList[(thisRank + 1) % nRanks].addRange(gridSize - nex, gridSize);
+
+    std::array<ByteArray, 1> arrays{byteArray(x.data())};
+    ParticleExchange<int> exchange;
+    exchange.start(sendList, thisRank, gridSize, 0, 0, ordering.data(), arrays.data(), 1);
+    exchange.finish();
+
+    std::vector<std::size_t> refSegments{0, std::size_t(gridSize - nex), std::size_t(gridSize)};
+    EXPECT_EQ(exchange.segments(), refSegments);
+}
+
 TEST(GlobalDomain, exchangeCyclicNeighborsOffsets)
 {
     int rank = 0, nRanks = 0;
@@ -254,3 +283,80 @@ TEST(GlobalDomain, exchangeCyclicNeighborsOffsets)
     exchangeCyclicNeighborsOffsets<float>(rank, nRanks);
     exchangeCyclicNeighborsOffsets<int>(rank, nRanks);
 }
+
+/*! @brief arrays of different types are exchanged in the same message
+ *
+ * Each rank sends the last nex elements to the next rank, as in exchangeCyclicNeighborsOffsets
+ */
+TEST(GlobalDomain, exchangeMixedTypes)
+{
+    int thisRank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &thisRank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    int assignedSize = 64;
+    int nex          = 10;
+    int nextRank     = (thisRank + 1) % nRanks;
+
+    std::vector<double> x(assignedSize, thisRank + 0.5);
+    std::vector<float> h(assignedSize, -thisRank);
+    std::vector<uint64_t> keys(assignedSize, (uint64_t(1) << 40) + thisRank);
+    std::vector<int> flags(assignedSize, 2 * thisRank);
+
+    std::vector<int> ordering(assignedSize);
+    std::iota(begin(ordering), end(ordering), 0);
+
+    SendList sendList(nRanks);
+    sendList[thisRank].addRange(0, assignedSize - nex);
+    sendList[nextRank].addRange(assignedSize - nex, assignedSize);
+
+    exchangeParticles(sendList, Rank(thisRank), assignedSize, ordering.data(), x.data(), h.data(), keys.data(),
+                      flags.data());
+
+    int incomingRank = (thisRank - 1 + nRanks) % nRanks;
+    for (int i = 0; i < assignedSize; ++i)
+    {
+        int sourceRank = (i < assignedSize - nex) ? thisRank : incomingRank;
+        EXPECT_EQ(x[i], sourceRank + 0.5);
+        EXPECT_EQ(h[i], float(-sourceRank));
+        EXPECT_EQ(keys[i], (uint64_t(1) << 40) + sourceRank);
+        EXPECT_EQ(flags[i], 2 * sourceRank);
+    }
+}
+
+//! @brief round trip through packArrays and unpackArrays with arrays that span several unpack chunks
+TEST(GlobalDomain, packUnpackChunks)
+{
+    int count = 20000;
+
+    std::vector<double> x(count);
+    std::vector<float> h(count);
+    std::vector<char> flags(count);
+    for (int i = 0; i < count; ++i)
+    {
+        x[i]     = i + 0.5;
+        h[i]     = -i;
+        flags[i] = char(i % 127);
+    }
+
+    // reverse order
+    std::vector<int> indices(count);
+    std::iota(indices.rbegin(), indices.rend(), 0);
+
+    std::array<ByteArray, 3> arrays{byteArray(x.data()), byteArray(h.data()), byteArray(flags.data())};
+    std::vector<char> buffer(count * packedElementBytes(arrays.data(), 3));
+    packArrays(indices.data(), count, buffer.data(), arrays.data(), 3);
+
+    std::vector<double> xOut(count);
+    std::vector<float> hOut(count);
+    std::vector<char> flagsOut(count);
+    std::array<ByteArray, 3> outArrays{byteArray(xOut.data()), byteArray(hOut.data()), byteArray(flagsOut.data())};
+    unpackArrays(buffer.data(), count, outArrays.data(), 3);
+
+    for (int i = 0; i < count; ++i)
+    {
+        EXPECT_EQ(xOut[i], x[count - 1 - i]);
+        EXPECT_EQ(hOut[i], h[count - 1 - i]);
+        EXPECT_EQ(flagsOut[i], flags[count - 1 - i]);
+    }
+}
@@ -62,10 +62,8 @@ void exchangeFocus(int myRank)
         peerFocusIndices.emplace_back(0, 32);
     }
 
-    std::vector<I> tmpLeaves(32 + 1);
-    std::vector<unsigned> tmpCounts(32);
-
-    exchangePeerCounts<I>(peers, peerFocusIndices, treeLeaves, counts, tmpLeaves, tmpCounts);
+    PeerCountBuffers<I> buffers;
+    exchangePeerCounts<I>(peers, peerFocusIndices, treeLeaves, counts, buffers);
 
     std::vector<unsigned> reference(nNodes(treeLeaves), myRank + 1);
     if (myRank == 0) { std::fill(begin(reference) + 32, end(reference), 2); }
@@ -75,6 +73,19 @@ void exchangeFocus(int myRank)
     }
 
     EXPECT_EQ(counts, reference);
+
+    // a second exchange with different counts reuses the buffers of the first one
+    std::fill(begin(counts), end(counts), myRank + 3);
+    exchangePeerCounts<I>(peers, peerFocusIndices, treeLeaves, counts, buffers);
+
+    std::fill(begin(reference), end(reference), myRank + 3);
+    if (myRank == 0) { std::fill(begin(reference) + 32, end(reference), 4); }
+    else
+    {
+        std::fill(begin(reference), begin(reference) + 32, 3);
+    }
+
+    EXPECT_EQ(counts, reference);
 }
 
 TEST(PeerExchange, simpleTest)
@@ -102,7 +113,7 @@ TEST(PeerExchange, simpleTest)
  * from the regular grid that rank 1 has in this half.
  */
 template<class I>
-void exchangeFocusIrregular(int myRank)
+void exchangeFocusIrregular(int myRank, bool compress)
 {
     std::vector<I> treeLeaves;
     std::vector<int> peers;
@@ -153,12 +164,9 @@ void exchangeFocusIrregular(int myRank)
 
     std::vector<unsigned> counts(nNodes(treeLeaves), 1);
 
-    // 256 is the maximum possible size, the actual size of the incoming message is only 18
-    TreeNodeIndex numNodesInFocus = 256;
-    std::vector<I> tmpLeaves(numNodesInFocus + 1);
-    std::vector<unsigned> tmpCounts(numNodesInFocus);
-
-    exchangePeerCounts<I>(peers, peerFocusIndices, treeLeaves, counts, tmpLeaves, tmpCounts);
+    // the incoming message has 18 keys, the receive is posted with the size of treeLeaves as upper bound
+    PeerCountBuffers<I> buffers;
+    exchangePeerCounts<I>(peers, peerFocusIndices, treeLeaves, counts, buffers, compress);
 
     std::vector<unsigned> reference(nNodes(treeLeaves), 1);
     TreeNodeIndex peerStartIdx, peerEndIdx;
@@ -195,6 +203,75 @@ TEST(PeerExchange, irregularTree)
 
     if (nRanks != thisExampleRanks) throw std::runtime_error("this test needs 2 ranks\n");
 
-    exchangeFocusIrregular<unsigned>(rank);
-    exchangeFocusIrregular<uint64_t>(rank);
+    exchangeFocusIrregular<unsigned>(rank, false);
+    exchangeFocusIrregular<uint64_t>(rank, false);
+    exchangeFocusIrregular<unsigned>(rank, true);
+    exchangeFocusIrregular<uint64_t>(rank, true);
+}
+
+template<class I>
+struct TestNodeData
+{
+    I key;
+    int rank;
+    double value;
+};
+
+/*! @brief exchange of a custom node payload with 2 ranks
+ *
+ * Same setup as exchangeFocus, but the answer contains the start key of each requested node,
+ * the answering rank and the particle count as a floating point value.
+ */
+template<class I>
+void exchangeNodePayload(int myRank)
+{
+    std::vector<I> treeLeaves = makeUniformNLevelTree<I>(64, 1);
+    std::vector<unsigned> counts(nNodes(treeLeaves), myRank + 1);
+
+    std::vector<int> peers{1 - myRank};
+    std::vector<IndexPair<TreeNodeIndex>> peerFocusIndices;
+    if (myRank == 0) { peerFocusIndices.emplace_back(32, 64); }
+    else { peerFocusIndices.emplace_back(0, 32); }
+
+    auto answerFunction = [&treeLeaves, &counts, myRank](gsl::span<const I> requestLeaves,
+                                                         gsl::span<TestNodeData<I>> answer)
+    {
+        std::vector<unsigned> requestCounts(answer.size());
+        countRequestParticles<I>(treeLeaves, counts, requestLeaves, requestCounts);
+        for (size_t i = 0; i < answer.size(); ++i)
+        {
+            answer[i] = TestNodeData<I>{requestLeaves[i], myRank, double(requestCounts[i])};
+        }
+    };
+
+    NodeExchangeBuffers<I, TestNodeData<I>> buffers;
+    std::vector<TestNodeData<I>> nodeData(nNodes(treeLeaves), TestNodeData<I>{0, myRank, 0.0});
+
+    // the second exchange reuses the buffers of the first one
+    for (int exchange = 0; exchange < 2; ++exchange)
+    {
+        exchangeNodeData<I>(peers, peerFocusIndices, treeLeaves, gsl::span<TestNodeData<I>>(nodeData), answerFunction,
+                            buffers);
+
+        for (TreeNodeIndex i = peerFocusIndices[0].start(); i < peerFocusIndices[0].end(); ++i)
+        {
+            EXPECT_EQ(nodeData[i].key, treeLeaves[i]);
+            EXPECT_EQ(nodeData[i].rank, 1 - myRank);
+            EXPECT_EQ(nodeData[i].value, double(2 - myRank));
+        }
+    }
+}
+
+TEST(PeerExchange, nodeData)
+{
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    constexpr int thisExampleRanks = 2;
+
+    if (nRanks != thisExampleRanks) throw std::runtime_error("this test needs 2 ranks\n");
+
+    exchangeNodePayload<unsigned>(rank);
+    exchangeNodePayload<uint64_t>(rank);
 }
@@ -98,7 +98,7 @@ void simpleTest(int thisRank)
         EXPECT_EQ(yOrig, y);
     }
 
-    haloexchange<T>(incomingHalos, outgoingHalos, x.data(), y.data());
+    haloexchange(incomingHalos, outgoingHalos, x.data(), y.data());
 
     std::vector<T> xRef{20, 21, 22, 23, 24, 25, 26, 27, 28, 29};
     std::vector<T> yRef{30, 31, 32, 33, 34, 35, 36, 37, 38, 39};
@@ -117,4 +117,305 @@ TEST(HaloExchange, simpleTest)
     if (nRanks != thisExampleRanks) throw std::runtime_error("this test needs 2 ranks\n");
 
     simpleTest<double>(rank);
-}
\ No newline at end of file
+}
+//! @brief repeated exchanges with different numbers of arrays through the same HaloExchanger
+template<class T>
+void persistentExchange(int thisRank)
+{
+    int nRanks = 2;
+    int localCount  = (thisRank == 0) ? 3 : 7;
+    int localOffset = (thisRank == 0) ? 0 : 3;
+
+    SendList incomingHalos(nRanks);
+    SendList outgoingHalos(nRanks);
+    if (thisRank == 0)
+    {
+        incomingHalos[1].addRange(3, 6);
+        incomingHalos[1].addRange(6, 10);
+        outgoingHalos[1].addRange(0, 1);
+        outgoingHalos[1].addRange(1, 3);
+    }
+    if (thisRank == 1)
+    {
+        incomingHalos[0].addRange(0, 1);
+        incomingHalos[0].addRange(1, 3);
+        outgoingHalos[0].addRange(3, 6);
+        outgoingHalos[0].addRange(6, 10);
+    }
+
+    HaloExchanger exchanger;
+    exchanger.setup(incomingHalos, outgoingHalos);
+
+    for (int iteration = 0; iteration < 3; ++iteration)
+    {
+        std::vector<T> x(10, 0), y(10, 0), z(10, 0);
+        for (int i = localOffset; i < localOffset + localCount; ++i)
+        {
+            x[i] = i + 20 + iteration;
+            y[i] = i + 30 + iteration;
+            z[i] = i + 40 + iteration;
+        }
+
+        exchanger.exchange(x.data(), y.data(), z.data());
+        exchanger.exchange(x.data());
+
+        for (int i = 0; i < 10; ++i)
+        {
+            EXPECT_EQ(x[i], i + 20 + iteration);
+            EXPECT_EQ(y[i], i + 30 + iteration);
+            EXPECT_EQ(z[i], i + 40 + iteration);
+        }
+    }
+}
+
+TEST(HaloExchange, persistentExchanger)
+{
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    constexpr int thisExampleRanks = 2;
+
+    if (nRanks != thisExampleRanks) throw std::runtime_error("this test needs 2 ranks\n");
+
+    persistentExchange<double>(rank);
+    persistentExchange<float>(rank);
+}
+
+//! @brief a copy of an exchanger set up on a communicator with reversed rank order exchanges on that communicator
+TEST(HaloExchange, copiedExchanger)
+{
+    int worldRank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    constexpr int thisExampleRanks = 2;
+
+    if (nRanks != thisExampleRanks) throw std::runtime_error("this test needs 2 ranks\n");
+
+    MPI_Comm reversed;
+    MPI_Comm_split(MPI_COMM_WORLD, 0, nRanks - worldRank, &reversed);
+    int thisRank;
+    MPI_Comm_rank(reversed, &thisRank);
+
+    int localCount  = (thisRank == 0) ? 3 : 7;
+    int localOffset = (thisRank == 0) ? 0 : 3;
+
+    SendList incomingHalos(nRanks);
+    SendList outgoingHalos(nRanks);
+    if (thisRank == 0)
+    {
+        incomingHalos[1].addRange(3, 10);
+        outgoingHalos[1].addRange(0, 3);
+    }
+    if (thisRank == 1)
+    {
+        incomingHalos[0].addRange(0, 3);
+        outgoingHalos[0].addRange(3, 10);
+    }
+
+    {
+        HaloExchanger exchanger;
+        exchanger.setup(incomingHalos, outgoingHalos, reversed);
+        HaloExchanger copy(exchanger);
+
+        std::vector<double> x(10, 0);
+        for (int i = localOffset; i < localOffset + localCount; ++i)
+        {
+            x[i] = i + 20;
+        }
+
+        copy.exchange(x.data());
+
+        for (int i = 0; i < 10; ++i)
+        {
+            EXPECT_EQ(x[i], i + 20);
+        }
+    }
+
+    MPI_Comm_free(&reversed);
+}
+
+//! @brief arrays of different element types are exchanged in a single round
+TEST(HaloExchange, mixedTypes)
+{
+    int thisRank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &thisRank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    constexpr int thisExampleRanks = 2;
+
+    if (nRanks != thisExampleRanks) throw std::runtime_error("this test needs 2 ranks\n");
+
+    int localCount  = (thisRank == 0) ? 3 : 7;
+    int localOffset = (thisRank == 0) ? 0 : 3;
+
+    SendList incomingHalos(nRanks);
+    SendList outgoingHalos(nRanks);
+    if (thisRank == 0)
+    {
+        incomingHalos[1].addRange(3, 6);
+        incomingHalos[1].addRange(6, 10);
+        outgoingHalos[1].addRange(0, 1);
+        outgoingHalos[1].addRange(1, 3);
+    }
+    if (thisRank == 1)
+    {
+        incomingHalos[0].addRange(0, 1);
+        incomingHalos[0].addRange(1, 3);
+        outgoingHalos[0].addRange(3, 6);
+        outgoingHalos[0].addRange(6, 10);
+    }
+
+    HaloExchanger exchanger;
+    exchanger.setup(incomingHalos, outgoingHalos);
+
+    for (int iteration = 0; iteration < 2; ++iteration)
+    {
+        std::vector<double> x(10, 0);
+        std::vector<float> rho(10, 0);
+        std::vector<int> flags(10, 0);
+        std::vector<uint64_t> keys(10, 0);
+        for (int i = localOffset; i < localOffset + localCount; ++i)
+        {
+            x[i]     = i + 0.5;
+            rho[i]   = i + 0.25f;
+            flags[i] = -i;
+            keys[i]  = (uint64_t(1) << 40) + i;
+        }
+
+        if (iteration == 0)
+        {
+            haloexchange(incomingHalos, outgoingHalos, x.data(), rho.data(), flags.data(), keys.data());
+        }
+        else { exchanger.exchange(x.data(), rho.data(), flags.data(), keys.data()); }
+
+        for (int i = 0; i < 10; ++i)
+        {
+            EXPECT_EQ(x[i], i + 0.5);
+            EXPECT_EQ(rho[i], i + 0.25f);
+            EXPECT_EQ(flags[i], -i);
+            EXPECT_EQ(keys[i], (uint64_t(1) << 40) + i);
+        }
+    }
+}
+
+//! @brief halos of arrays wrapped in reducedPrecision are rounded to the transfer type, owned elements are unchanged
+TEST(HaloExchange, reducedPrecision)
+{
+    int thisRank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &thisRank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    constexpr int thisExampleRanks = 2;
+
+    if (nRanks != thisExampleRanks) throw std::runtime_error("this test needs 2 ranks\n");
+
+    int localCount  = (thisRank == 0) ? 3 : 7;
+    int localOffset = (thisRank == 0) ? 0 : 3;
+
+    SendList incomingHalos(nRanks);
+    SendList outgoingHalos(nRanks);
+    if (thisRank == 0)
+    {
+        incomingHalos[1].addRange(3, 6);
+        incomingHalos[1].addRange(6, 10);
+        outgoingHalos[1].addRange(0, 1);
+        outgoingHalos[1].addRange(1, 3);
+    }
+    if (thisRank == 1)
+    {
+        incomingHalos[0].addRange(0, 1);
+        incomingHalos[0].addRange(1, 3);
+        outgoingHalos[0].addRange(3, 6);
+        outgoingHalos[0].addRange(6, 10);
+    }
+
+    HaloExchanger exchanger;
+    exchanger.setup(incomingHalos, outgoingHalos);
+
+    auto value = [](int i) { return 1000.0 + i / 3.0; };
+
+    for (int iteration = 0; iteration < 2; ++iteration)
+    {
+        std::vector<double> x(10, 0), rho(10, 0), p(10, 0);
+        std::vector<int> flags(10, 0);
+        for (int i = localOffset; i < localOffset + localCount; ++i)
+        {
+            x[i]     = value(i);
+            rho[i]   = value(i);
+            p[i]     = value(i);
+            flags[i] = -i;
+        }
+
+        if (iteration == 0)
+        {
+            haloexchange(incomingHalos, outgoingHalos, x.data(), reducedPrecision<float>(rho.data()),
+                         reducedPrecision<BFloat16>(p.data()), flags.data());
+        }
+        else
+        {
+            exchanger.exchange(x.data(), reducedPrecision<float>(rho.data()), reducedPrecision<BFloat16>(p.data()),
+                               flags.data());
+        }
+
+        for (int i = 0; i < 10; ++i)
+        {
+            bool owned = localOffset <= i && i < localOffset + localCount;
+            EXPECT_EQ(x[i], value(i));
+            EXPECT_EQ(rho[i], owned ? value(i) : double(float(value(i))));
+            EXPECT_EQ(p[i], owned ? value(i) : double(float(BFloat16(float(value(i))))));
+            EXPECT_EQ(flags[i], -i);
+        }
+    }
+}
+
+//! @brief the graph communicator connects the peers and is only rebuilt if the peers change
+TEST(HaloExchange, neighborCommunicator)
+{
+    int thisRank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &thisRank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    int nextRank     = (thisRank + 1) % nRanks;
+    int previousRank = (thisRank - 1 + nRanks) % nRanks;
+
+    NeighborCommunicator neighbors;
+    neighbors.setPeers({previousRank}, {nextRank});
+    MPI_Comm comm = neighbors.comm();
+
+    int received = -1;
+    MPI_Neighbor_alltoall(&thisRank, 1, MPI_INT, &received, 1, MPI_INT, comm);
+    EXPECT_EQ(received, previousRank);
+
+    neighbors.setPeers({previousRank}, {nextRank});
+    EXPECT_EQ(neighbors.comm(), comm);
+}
+
+//! @brief each rank writes its rank into its segment and reads the segments of all other ranks on the node
+TEST(HaloExchange, sharedWindow)
+{
+    SharedWindow window;
+    window.allocate(sizeof(int));
+
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    EXPECT_NE(window.nodeRank(rank), MPI_UNDEFINED);
+
+    window.fence();
+    std::memcpy(window.localSegment(), &rank, sizeof(int));
+    window.fence();
+
+    int worldSize = 0;
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    for (int peer = 0; peer < worldSize; ++peer)
+    {
+        int peerNodeRank = window.nodeRank(peer);
+        if (peerNodeRank == MPI_UNDEFINED) { continue; }
+
+        int value;
+        std::memcpy(&value, window.segment(peerNodeRank), sizeof(int));
+        EXPECT_EQ(value, peer);
+    }
+    window.fence();
+}
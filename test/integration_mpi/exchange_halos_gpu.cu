@@ -0,0 +1,169 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Halo exchange test for device arrays
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <gtest/gtest.h>
+
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+
+#include "cstone/cuda/device_halo_exchange.cuh"
+
+using namespace cstone;
+
+template<class T>
+void deviceExchange(int thisRank)
+{
+    int nRanks = 2;
+
+    int localCount  = (thisRank == 0) ? 3 : 7;
+    int localOffset = (thisRank == 0) ? 0 : 3;
+
+    SendList incomingHalos(nRanks);
+    SendList outgoingHalos(nRanks);
+
+    if (thisRank == 0)
+    {
+        incomingHalos[1].addRange(3, 6);
+        incomingHalos[1].addRange(6, 10);
+        outgoingHalos[1].addRange(0, 1);
+        outgoingHalos[1].addRange(1, 3);
+    }
+    if (thisRank == 1)
+    {
+        incomingHalos[0].addRange(0, 1);
+        incomingHalos[0].addRange(1, 3);
+        outgoingHalos[0].addRange(3, 6);
+        outgoingHalos[0].addRange(6, 10);
+    }
+
+    thrust::host_vector<T> x(10, 0);
+    thrust::host_vector<T> y(10, 0);
+    for (int i = 0; i < localCount; ++i)
+    {
+        x[localOffset + i] = localOffset + i + 20;
+        y[localOffset + i] = localOffset + i + 30;
+    }
+
+    thrust::device_vector<T> d_x = x;
+    thrust::device_vector<T> d_y = y;
+
+    DeviceHaloExchanger<T> exchanger;
+    exchanger.setup(incomingHalos, outgoingHalos);
+
+    // repeated exchanges reuse the same device buffers
+    for (int iteration = 0; iteration < 2; ++iteration)
+    {
+        exchanger.exchange(thrust::raw_pointer_cast(d_x.data()), thrust::raw_pointer_cast(d_y.data()));
+    }
+
+    thrust::host_vector<T> xProbe = d_x;
+    thrust::host_vector<T> yProbe = d_y;
+
+    std::vector<T> xRef{20, 21, 22, 23, 24, 25, 26, 27, 28, 29};
+    std::vector<T> yRef{30, 31, 32, 33, 34, 35, 36, 37, 38, 39};
+    EXPECT_EQ(xRef, std::vector<T>(xProbe.begin(), xProbe.end()));
+    EXPECT_EQ(yRef, std::vector<T>(yProbe.begin(), yProbe.end()));
+}
+
+/*! @brief same exchange as deviceExchange with x at full precision, y as float and z as BFloat16
+ *
+ * The values are chosen such that rounding to float and BFloat16 changes them.
+ */
+void deviceExchangeReduced(int thisRank)
+{
+    int nRanks = 2;
+
+    int localCount  = (thisRank == 0) ? 3 : 7;
+    int localOffset = (thisRank == 0) ? 0 : 3;
+
+    SendList incomingHalos(nRanks);
+    SendList outgoingHalos(nRanks);
+
+    if (thisRank == 0)
+    {
+        incomingHalos[1].addRange(3, 6);
+        incomingHalos[1].addRange(6, 10);
+        outgoingHalos[1].addRange(0, 1);
+        outgoingHalos[1].addRange(1, 3);
+    }
+    if (thisRank == 1)
+    {
+        incomingHalos[0].addRange(0, 1);
+        incomingHalos[0].addRange(1, 3);
+        outgoingHalos[0].addRange(3, 6);
+        outgoingHalos[0].addRange(6, 10);
+    }
+
+    auto value = [](int i) { return 1000.0 + i / 3.0; };
+
+    thrust::host_vector<double> x(10, 0);
+    for (int i = 0; i < localCount; ++i)
+    {
+        x[localOffset + i] = value(localOffset + i);
+    }
+
+    thrust::device_vector<double> d_x = x;
+    thrust::device_vector<double> d_y = x;
+    thrust::device_vector<double> d_z = x;
+
+    DeviceHaloExchanger<double> exchanger;
+    exchanger.setup(incomingHalos, outgoingHalos);
+    exchanger.exchange(thrust::raw_pointer_cast(d_x.data()),
+                       reducedPrecision<float>(thrust::raw_pointer_cast(d_y.data())),
+                       reducedPrecision<BFloat16>(thrust::raw_pointer_cast(d_z.data())));
+
+    thrust::host_vector<double> xProbe = d_x;
+    thrust::host_vector<double> yProbe = d_y;
+    thrust::host_vector<double> zProbe = d_z;
+
+    for (int i = 0; i < 10; ++i)
+    {
+        bool owned = localOffset <= i && i < localOffset + localCount;
+        EXPECT_EQ(xProbe[i], value(i));
+        EXPECT_EQ(yProbe[i], owned ? value(i) : double(float(value(i))));
+        EXPECT_EQ(zProbe[i], owned ? value(i) : double(float(BFloat16(float(value(i))))));
+    }
+}
+
+TEST(HaloExchange, deviceArrays)
+{
+    int rank = 0, nRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nRanks);
+
+    constexpr int thisExampleRanks = 2;
+
+    if (nRanks != thisExampleRanks) throw std::runtime_error("this test needs 2 ranks\n");
+
+    deviceExchange<float>(rank);
+    deviceExchange<double>(rank);
+    deviceExchangeReduced(rank);
+}
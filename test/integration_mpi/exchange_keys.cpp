@@ -65,7 +65,7 @@ using namespace cstone;
  *  ==> rank i will send particles with index in [4:6] to rank i+1
  */
 template<class KeyType>
-void exchangeKeys(int myRank, int numRanks)
+void exchangeKeys(int myRank, int numRanks, bool compress)
 {
     std::vector<unsigned> counts{2,2,1,1,1,1,2,2};
     std::vector<int> haloFlags{0,1,0,0,0,0,1,0};
@@ -96,7 +96,7 @@ void exchangeKeys(int myRank, int numRanks)
         reference[myRank + 1].addRange(4, 6);
     }
 
-    SendList probe = exchangeRequestKeys<KeyType>(treeLeaves, haloFlags, layout, assignment, peers);
+    SendList probe = exchangeRequestKeys<KeyType>(treeLeaves, haloFlags, layout, assignment, peers, compress);
 
     EXPECT_EQ(probe, reference);
 }
@@ -107,5 +107,69 @@ TEST(ExchangeKeys, fixedTreeSizePerRank)
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
 
-    exchangeKeys<unsigned>(rank, numRanks);
+    exchangeKeys<unsigned>(rank, numRanks, false);
+    exchangeKeys<unsigned>(rank, numRanks, true);
+    exchangeKeys<uint64_t>(rank, numRanks, true);
+}
+
+/*! @brief repeated exchanges with the same setup as exchangeKeys
+ *
+ * The second exchange with unchanged halo flags does not communicate. Afterwards, rank 0 stops requesting
+ * halos from rank 1, which makes all ranks communicate again.
+ */
+template<class KeyType>
+void exchangeKeysCached(int myRank, int numRanks, bool compress)
+{
+    std::vector<unsigned> counts{2,2,1,1,1,1,2,2};
+    std::vector<int> haloFlags{0,1,0,0,0,0,1,0};
+
+    KeyType o = myRank * 4;
+    std::vector<KeyType> treeLeaves{o, o+2, o+4, o+5, o+6, o+7, o+8, o+10, o+12};
+
+    std::vector<LocalParticleIndex> layout = computeNodeLayout(counts, haloFlags, 2, 6);
+
+    SpaceCurveAssignment assignment(numRanks);
+    LocalParticleIndex   numParticlesPerAssignment = 4;
+    std::vector<int>     peers;
+
+    if (myRank > 0)
+    {
+        assignment.addRange(Rank(myRank - 1), 0, 2, numParticlesPerAssignment);
+        peers.push_back(myRank - 1);
+    }
+    assignment.addRange(Rank(myRank), 2, 6, numParticlesPerAssignment);
+    if (myRank < numRanks - 1)
+    {
+        assignment.addRange(Rank(myRank + 1), 6, 8, numParticlesPerAssignment);
+        peers.push_back(myRank + 1);
+    }
+
+    SendList reference = exchangeRequestKeys<KeyType>(treeLeaves, haloFlags, layout, assignment, peers);
+
+    RequestKeyExchange<KeyType> requestKeys;
+    requestKeys.setCompression(compress);
+    EXPECT_EQ(requestKeys.exchange(treeLeaves, haloFlags, layout, assignment, peers), reference);
+    EXPECT_TRUE(requestKeys.exchanged());
+
+    EXPECT_EQ(requestKeys.exchange(treeLeaves, haloFlags, layout, assignment, peers), reference);
+    EXPECT_FALSE(requestKeys.exchanged());
+
+    if (myRank == 0) { haloFlags[6] = 0; }
+    layout    = computeNodeLayout(counts, haloFlags, 2, 6);
+    reference = exchangeRequestKeys<KeyType>(treeLeaves, haloFlags, layout, assignment, peers);
+
+    EXPECT_EQ(requestKeys.exchange(treeLeaves, haloFlags, layout, assignment, peers), reference);
+    EXPECT_EQ(requestKeys.exchanged(), numRanks > 1);
+}
+
+TEST(ExchangeKeys, cachedRequests)
+{
+    int rank = 0, numRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+    exchangeKeysCached<unsigned>(rank, numRanks, false);
+    exchangeKeysCached<uint64_t>(rank, numRanks, false);
+    exchangeKeysCached<unsigned>(rank, numRanks, true);
+    exchangeKeysCached<uint64_t>(rank, numRanks, true);
 }
@@ -128,7 +128,7 @@ void globalRandomGaussian(int thisRank, int numRanks)
     int nParticlesAssigned = assignment.totalCount(thisRank);
 
     reallocate(nParticlesAssigned, x, y, z);
-    exchangeParticles<T>(sendList, Rank(thisRank), nParticlesAssigned, ordering.data(), x.data(), y.data(), z.data());
+    exchangeParticles(sendList, Rank(thisRank), nParticlesAssigned, ordering.data(), x.data(), y.data(), z.data());
 
     reallocate(nParticlesAssigned, particleKeys);
     computeMortonCodes(begin(x), end(x), begin(y), begin(z), begin(particleKeys), box);
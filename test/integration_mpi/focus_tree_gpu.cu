@@ -0,0 +1,134 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Test the device-resident focused octree against the host version with distributed particles
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <mpi.h>
+#include <gtest/gtest.h>
+
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+
+#include "cstone/domain/domaindecomp_mpi.hpp"
+#include "cstone/domain/peers.hpp"
+#include "cstone/tree/octree_focus_gpu.cuh"
+#include "cstone/tree/octree_focus_mpi.hpp"
+#include "cstone/tree/octree_mpi.hpp"
+
+#include "coord_samples/random.hpp"
+
+using namespace cstone;
+
+/*! @brief the device focused tree has to converge to the same leaves and counts as the host version
+ *
+ * Each rank generates a different set of random gaussian particles, which are then distributed according to
+ * a global tree, as in Domain::sync.
+ */
+template<class KeyType, class T>
+void focusTreeGpuMatchesCpu(int thisRank, int numRanks)
+{
+    std::size_t numParticles = 1000;
+    unsigned bucketSize      = 64;
+    unsigned bucketSizeLocal = 16;
+    float theta              = 1.0;
+
+    Box<T> box{-1, 1};
+    RandomGaussianCoordinates<T, KeyType> coords(numParticles, box, thisRank + 1);
+    std::vector<T> x = coords.x(), y = coords.y(), z = coords.z();
+    std::vector<KeyType> particleKeys = coords.mortonCodes();
+
+    std::vector<KeyType> tree = makeRootNodeTree<KeyType>();
+    std::vector<unsigned> counts{unsigned(numParticles) * numRanks};
+    while (!updateOctreeGlobal(particleKeys.data(), particleKeys.data() + numParticles, bucketSize, tree, counts))
+        ;
+
+    std::vector<int> ordering(numParticles);
+    std::iota(begin(ordering), end(ordering), 0);
+
+    auto assignment = singleRangeSfcSplit(counts, numRanks);
+    auto sendList   = createSendList<KeyType>(assignment, tree, particleKeys);
+
+    int numAssigned = assignment.totalCount(thisRank);
+    reallocate(numAssigned, x, y, z);
+    exchangeParticles(sendList, Rank(thisRank), numAssigned, ordering.data(), x.data(), y.data(), z.data());
+
+    reallocate(numAssigned, particleKeys);
+    computeMortonCodes(begin(x), end(x), begin(y), begin(z), begin(particleKeys), box);
+    std::sort(particleKeys.begin(), particleKeys.end());
+
+    Octree<KeyType> domainTree;
+    domainTree.update(begin(tree), end(tree));
+    auto peers = findPeersMac(thisRank, assignment, domainTree, box, theta);
+
+    FocusedOctree<KeyType> focusTree(bucketSizeLocal, theta);
+    int converged = 0;
+    while (converged != numRanks)
+    {
+        converged = focusTree.updateGlobal(box, particleKeys, thisRank, peers, assignment, tree, counts);
+        MPI_Allreduce(MPI_IN_PLACE, &converged, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    }
+
+    thrust::device_vector<KeyType> d_keys = particleKeys;
+    thrust::device_vector<KeyType> d_tree = tree;
+    thrust::device_vector<unsigned> d_counts = counts;
+    gsl::span<const KeyType> d_keySpan(thrust::raw_pointer_cast(d_keys.data()), d_keys.size());
+
+    FocusedOctreeGpu<KeyType> focusTreeGpu(bucketSizeLocal, theta);
+    converged = 0;
+    while (converged != numRanks)
+    {
+        converged = focusTreeGpu.updateGlobal(box, d_keySpan, thisRank, peers, assignment, tree,
+                                              thrust::raw_pointer_cast(d_tree.data()),
+                                              thrust::raw_pointer_cast(d_counts.data()));
+        MPI_Allreduce(MPI_IN_PLACE, &converged, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    }
+
+    TreeNodeIndex numLeaves = focusTreeGpu.numLeafNodes();
+    std::vector<KeyType> gpuLeaves(numLeaves + 1);
+    std::vector<unsigned> gpuCounts(numLeaves);
+    thrust::copy(thrust::device_pointer_cast(focusTreeGpu.treeLeaves()),
+                 thrust::device_pointer_cast(focusTreeGpu.treeLeaves() + numLeaves + 1), gpuLeaves.begin());
+    thrust::copy(thrust::device_pointer_cast(focusTreeGpu.leafCounts()),
+                 thrust::device_pointer_cast(focusTreeGpu.leafCounts() + numLeaves), gpuCounts.begin());
+
+    std::vector<KeyType> cpuLeaves(focusTree.treeLeaves().begin(), focusTree.treeLeaves().end());
+    std::vector<unsigned> cpuCounts(focusTree.leafCounts().begin(), focusTree.leafCounts().end());
+    EXPECT_EQ(gpuLeaves, cpuLeaves);
+    EXPECT_EQ(gpuCounts, cpuCounts);
+}
+
+TEST(FocusedOctreeGpu, matchesCpu)
+{
+    int rank = 0, numRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+    focusTreeGpuMatchesCpu<unsigned, double>(rank, numRanks);
+    focusTreeGpuMatchesCpu<uint64_t, float>(rank, numRanks);
+}
@@ -36,6 +36,7 @@
 
 #include "cstone/tree/octree_mpi.hpp"
 #include "cstone/tree/octree_util.hpp"
+#include "coord_samples/random.hpp"
 
 using namespace cstone;
 
@@ -76,6 +77,128 @@ TEST(GlobalTree, basicRegularTree32)
     buildTree<uint64_t>(rank);
 }
 
+/*! @brief the global single pass build matches the iterative build
+ *
+ * Each rank has a Gaussian particle distribution with a different seed, such that
+ * most nodes contain particles from several ranks.
+ */
+template<class KeyType>
+void computeGlobalDirect(int rank)
+{
+    Box<double> box{-1, 1};
+    unsigned bucketSize = 16;
+
+    RandomGaussianCoordinates<double, KeyType> coords(10000, box, rank + 1);
+    const std::vector<KeyType>& codes = coords.mortonCodes();
+
+    std::vector<KeyType> refTree = makeRootNodeTree<KeyType>();
+    std::vector<unsigned> refCounts{unsigned(codes.size())};
+    MPI_Allreduce(MPI_IN_PLACE, refCounts.data(), 1, MPI_UNSIGNED, MPI_SUM, MPI_COMM_WORLD);
+    while (!updateOctreeGlobal(codes.data(), codes.data() + codes.size(), bucketSize, refTree, refCounts))
+        ;
+
+    std::vector<KeyType> tree;
+    std::vector<unsigned> counts;
+    computeOctreeGlobal(codes.data(), codes.data() + codes.size(), bucketSize, tree, counts);
+
+    EXPECT_EQ(tree, refTree);
+    EXPECT_EQ(counts, refCounts);
+}
+
+TEST(GlobalTree, computeGlobalDirect)
+{
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    computeGlobalDirect<unsigned>(rank);
+    computeGlobalDirect<uint64_t>(rank);
+}
+
+//! @brief the build starting from a sampled tree converges to the same tree as the build from all split keys
+template<class KeyType>
+void computeGlobalSampled(int rank)
+{
+    Box<double> box{-1, 1};
+    unsigned bucketSize = 16;
+
+    RandomGaussianCoordinates<double, KeyType> coords(10000, box, rank + 1);
+    const std::vector<KeyType>& codes = coords.mortonCodes();
+
+    std::vector<KeyType> refTree;
+    std::vector<unsigned> refCounts;
+    computeOctreeGlobal(codes.data(), codes.data() + codes.size(), bucketSize, refTree, refCounts);
+
+    for (std::size_t maxSamples : {100, 1000, 100000})
+    {
+        std::vector<KeyType> tree;
+        std::vector<unsigned> counts;
+        computeOctreeGlobalSampled(codes.data(), codes.data() + codes.size(), bucketSize, tree, counts, maxSamples);
+
+        EXPECT_EQ(tree, refTree);
+        EXPECT_EQ(counts, refCounts);
+    }
+}
+
+TEST(GlobalTree, computeGlobalSampled)
+{
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    computeGlobalSampled<unsigned>(rank);
+    computeGlobalSampled<uint64_t>(rank);
+}
+
+/*! @brief the tree update with distributed counts reproduces the update with replicated counts
+ *
+ * After each step, the slice counts of each rank match the corresponding section of the replicated counts.
+ */
+template<class KeyType>
+void scatteredUpdate(int rank)
+{
+    int numRanks;
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+    Box<double> box{-1, 1};
+    unsigned bucketSize = 16;
+
+    RandomGaussianCoordinates<double, KeyType> coords(10000, box, rank + 1);
+    const std::vector<KeyType>& codes = coords.mortonCodes();
+
+    std::vector<KeyType> refTree = makeRootNodeTree<KeyType>();
+    std::vector<unsigned> refCounts{unsigned(codes.size())};
+    MPI_Allreduce(MPI_IN_PLACE, refCounts.data(), 1, MPI_UNSIGNED, MPI_SUM, MPI_COMM_WORLD);
+
+    std::vector<KeyType> tree = refTree;
+    std::vector<unsigned> sliceCounts = reduceScatterCounts(tree, std::vector<unsigned>{unsigned(codes.size())});
+
+    bool refConverged = false;
+    while (!refConverged)
+    {
+        refConverged   = updateOctreeGlobal(codes.data(), codes.data() + codes.size(), bucketSize, refTree, refCounts);
+        bool converged = updateOctreeGlobalScattered(codes.data(), codes.data() + codes.size(), bucketSize, tree,
+                                                     sliceCounts);
+        EXPECT_EQ(converged, refConverged);
+        ASSERT_EQ(tree, refTree);
+
+        std::vector<TreeNodeIndex> offsets = countSliceOffsets(tree, numRanks);
+        std::vector<unsigned> refSlice(refCounts.begin() + offsets[rank], refCounts.begin() + offsets[rank + 1]);
+        EXPECT_EQ(sliceCounts, refSlice);
+    }
+
+    std::vector<unsigned> counts;
+    allgatherCounts(tree, sliceCounts, counts);
+    EXPECT_EQ(counts, refCounts);
+}
+
+TEST(GlobalTree, scatteredUpdate)
+{
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    scatteredUpdate<unsigned>(rank);
+    scatteredUpdate<uint64_t>(rank);
+}
+
 template<class CodeType>
 void computeNodeMax(int rank)
 {
@@ -29,6 +29,9 @@
  * @author Sebastian Keller <sebastian.f.keller@gmail.com>
  */
 
+#include <algorithm>
+#include <numeric>
+
 #include <mpi.h>
 #include <gtest/gtest.h>
 
@@ -100,7 +103,7 @@ void globalRandomGaussian(int thisRank, int nRanks)
     int nParticlesAssigned = assignment.totalCount(thisRank);
 
     reallocate(nParticlesAssigned, x, y, z);
-    exchangeParticles<T>(sendList, Rank(thisRank), nParticlesAssigned, ordering.data(), x.data(), y.data(), z.data());
+    exchangeParticles(sendList, Rank(thisRank), nParticlesAssigned, ordering.data(), x.data(), y.data(), z.data());
 
     /// post-exchange test:
     /// if the global tree build and assignment is repeated, no particles are exchanged anymore
@@ -152,4 +155,35 @@ TEST(GlobalTreeDomain, randomGaussian)
     globalRandomGaussian<uint64_t, double>(rank, nRanks);
     globalRandomGaussian<unsigned, float>(rank, nRanks);
     globalRandomGaussian<uint64_t, float>(rank, nRanks);
-}
\ No newline at end of file
+}
+//! @brief all ranks appear in exactly one node group and the groups agree on all ranks
+TEST(GlobalTreeDomain, nodeRankGroups)
+{
+    int rank = 0, numRanks = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+    auto groups = computeNodeRankGroups();
+
+    std::vector<int> allRanks;
+    for (const auto& group : groups)
+    {
+        EXPECT_TRUE(std::is_sorted(group.begin(), group.end()));
+        allRanks.insert(allRanks.end(), group.begin(), group.end());
+    }
+    std::sort(allRanks.begin(), allRanks.end());
+
+    std::vector<int> refRanks(numRanks);
+    std::iota(refRanks.begin(), refRanks.end(), 0);
+    EXPECT_EQ(allRanks, refRanks);
+
+    // the flattened groups are identical on all ranks
+    std::vector<int> flatGroups;
+    for (const auto& group : groups)
+    {
+        flatGroups.insert(flatGroups.end(), group.begin(), group.end());
+    }
+    std::vector<int> rootGroups = flatGroups;
+    MPI_Bcast(rootGroups.data(), numRanks, MPI_INT, 0, MPI_COMM_WORLD);
+    EXPECT_EQ(flatGroups, rootGroups);
+}
@@ -0,0 +1,304 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Timing, JSON output and baseline comparison for the benchmark drivers
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * Results are written as a JSON document with one result object per line:
+ *
+ *   {
+ *     "suite": "microbench",
+ *     "threads": 8,
+ *     "results": [
+ *       {"kernel": "computeNodeCounts", "distribution": "gaussian", "n": 1000000, ..., "median": 1.2e-03},
+ *       ...
+ *     ]
+ *   }
+ *
+ * readResults only understands this line-oriented layout, which is sufficient to compare against a baseline
+ * written by an earlier run of the same driver.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace bench
+{
+
+//! @brief the timings of one kernel for one parameter combination
+struct Result
+{
+    //! @brief parameters that identify the measurement, e.g. kernel, distribution, n, bucketSize, keyBits
+    std::vector<std::pair<std::string, std::string>> params;
+    int repetitions{0};
+    double min{0};
+    double median{0};
+    double mean{0};
+
+    //! @brief concatenation of all parameters, used to match results of different runs
+    std::string id() const
+    {
+        std::string ret;
+        for (const auto& [key, value] : params)
+        {
+            ret += key + "=" + value + " ";
+        }
+        return ret;
+    }
+};
+
+inline int numThreads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+/*! @brief time @p kernel @p repetitions times, calling @p setup untimed before each repetition
+ *
+ * One additional untimed warm-up call of setup and kernel is performed first.
+ */
+template<class Setup, class Kernel>
+Result timeKernel(int repetitions, Setup&& setup, Kernel&& kernel)
+{
+    setup();
+    kernel();
+
+    std::vector<double> times(repetitions);
+    for (int r = 0; r < repetitions; ++r)
+    {
+        setup();
+        auto tp0 = std::chrono::high_resolution_clock::now();
+        kernel();
+        auto tp1 = std::chrono::high_resolution_clock::now();
+        times[r] = std::chrono::duration<double>(tp1 - tp0).count();
+    }
+
+    std::sort(times.begin(), times.end());
+
+    Result result;
+    result.repetitions = repetitions;
+    result.min         = times.front();
+    result.median      = times[repetitions / 2];
+    result.mean        = std::accumulate(times.begin(), times.end(), 0.0) / repetitions;
+    return result;
+}
+
+//! @brief time @p kernel without setup
+template<class Kernel>
+Result timeKernel(int repetitions, Kernel&& kernel)
+{
+    return timeKernel(repetitions, []() {}, std::forward<Kernel>(kernel));
+}
+
+//! @brief true if @p value is written without quotes in the JSON output
+inline bool isNumeric(const std::string& value)
+{
+    if (value.empty()) { return false; }
+    char* end;
+    std::strtod(value.c_str(), &end);
+    return *end == '\0';
+}
+
+inline std::string formatDouble(double value)
+{
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.6e", value);
+    return buffer;
+}
+
+//! @brief serialize @p result as a single-line JSON object
+inline std::string toJson(const Result& result)
+{
+    std::string ret = "{";
+    for (const auto& [key, value] : result.params)
+    {
+        ret += "\"" + key + "\": " + (isNumeric(value) ? value : "\"" + value + "\"") + ", ";
+    }
+    ret += "\"repetitions\": " + std::to_string(result.repetitions) + ", ";
+    ret += "\"min\": " + formatDouble(result.min) + ", ";
+    ret += "\"median\": " + formatDouble(result.median) + ", ";
+    ret += "\"mean\": " + formatDouble(result.mean) + "}";
+    return ret;
+}
+
+//! @brief write all results of a suite as a JSON document to @p os
+inline void writeResults(std::ostream& os, const std::string& suite, const std::vector<Result>& results)
+{
+    os << "{\n";
+    os << "  \"suite\": \"" << suite << "\",\n";
+    os << "  \"threads\": " << numThreads() << ",\n";
+    os << "  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        os << "    " << toJson(results[i]) << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n";
+    os << "}\n";
+}
+
+//! @brief extract the value of @p key from a single-line JSON object written by toJson
+inline std::string jsonValue(const std::string& line, const std::string& key)
+{
+    std::string pattern = "\"" + key + "\": ";
+    auto pos            = line.find(pattern);
+    if (pos == std::string::npos) { return {}; }
+    pos += pattern.size();
+
+    if (line[pos] == '"')
+    {
+        auto end = line.find('"', pos + 1);
+        return line.substr(pos + 1, end - pos - 1);
+    }
+    auto end = line.find_first_of(",}", pos);
+    return line.substr(pos, end - pos);
+}
+
+/*! @brief read the results of a file written by writeResults
+ *
+ * @param filename    JSON file
+ * @param paramKeys   names of the parameters to restore, in the order used when writing
+ */
+inline std::vector<Result> readResults(const std::string& filename, const std::vector<std::string>& paramKeys)
+{
+    std::ifstream in(filename);
+    if (!in) { throw std::runtime_error("could not open baseline " + filename + "\n"); }
+
+    std::vector<Result> results;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.find("\"median\": ") == std::string::npos) { continue; }
+
+        Result result;
+        for (const auto& key : paramKeys)
+        {
+            result.params.emplace_back(key, jsonValue(line, key));
+        }
+        result.repetitions = std::stoi(jsonValue(line, "repetitions"));
+        result.min         = std::stod(jsonValue(line, "min"));
+        result.median      = std::stod(jsonValue(line, "median"));
+        result.mean        = std::stod(jsonValue(line, "mean"));
+        results.push_back(result);
+    }
+    return results;
+}
+
+/*! @brief compare median timings of @p current against @p baseline
+ *
+ * @param current    results of this run
+ * @param baseline   results of a reference run
+ * @param tolerance  relative slowdown above which a result counts as regression, e.g. 0.1 for 10%
+ * @param os         a line is printed for each result present in both sets
+ * @return           number of regressions
+ */
+inline int compareResults(const std::vector<Result>& current, const std::vector<Result>& baseline, double tolerance,
+                          std::ostream& os)
+{
+    std::map<std::string, double> reference;
+    for (const auto& result : baseline)
+    {
+        reference[result.id()] = result.median;
+    }
+
+    int numRegressions = 0;
+    for (const auto& result : current)
+    {
+        auto it = reference.find(result.id());
+        if (it == reference.end()) { continue; }
+
+        double ratio     = result.median / it->second;
+        bool  regression = ratio > 1.0 + tolerance;
+        numRegressions += regression;
+
+        os << (regression ? "REGRESSION " : "ok         ") << result.id() << " ratio " << ratio << std::endl;
+    }
+    return numRegressions;
+}
+
+//! @brief split a comma separated list
+inline std::vector<std::string> splitList(const std::string& list)
+{
+    std::vector<std::string> ret;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        if (!item.empty()) { ret.push_back(item); }
+    }
+    return ret;
+}
+
+/*! @brief minimal command line parser for options of the form --name value
+ *
+ * Options that are not given on the command line return @p defaultValue.
+ */
+class CommandLine
+{
+public:
+    CommandLine(int argc, char** argv)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg.rfind("--", 0) != 0) { throw std::runtime_error("unexpected argument " + arg + "\n"); }
+            if (i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0) { options_[arg.substr(2)] = argv[++i]; }
+            else { options_[arg.substr(2)] = ""; }
+        }
+    }
+
+    bool has(const std::string& name) const { return options_.count(name); }
+
+    std::string get(const std::string& name, const std::string& defaultValue) const
+    {
+        auto it = options_.find(name);
+        return it == options_.end() ? defaultValue : it->second;
+    }
+
+private:
+    std::map<std::string, std::string> options_;
+};
+
+} // namespace bench
@@ -0,0 +1,311 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Microbenchmarks of the single-node building blocks with parameter sweeps and JSON output
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * Usage:
+ *   microbench [--n 100000,1000000] [--bucket 16,64] [--dist uniform,gaussian,plummer] [--keys 32,64]
+ *              [--reps 5] [--out results.json] [--baseline reference.json] [--tolerance 0.1]
+ *
+ * Each kernel is timed for all combinations of the listed parameters. With --baseline, the median timings
+ * are compared against a previous output file and the exit code is non-zero if any kernel got slower
+ * by more than the tolerance.
+ */
+
+#include <array>
+#include <iostream>
+#include <numeric>
+#include <random>
+
+#include "cstone/findneighbors.hpp"
+#include "cstone/halos/discovery.hpp"
+#include "cstone/primitives/gather.hpp"
+#include "cstone/tree/macs.hpp"
+#include "cstone/tree/octree.hpp"
+#include "cstone/tree/octree_internal.hpp"
+#include "cstone/tree/upsweep.hpp"
+
+#include "coord_samples/plummer.hpp"
+#include "coord_samples/random.hpp"
+
+#include "benchmark.hpp"
+
+using namespace cstone;
+
+using Coordinates = std::array<std::vector<double>, 3>;
+
+//! @brief unsorted coordinates of distribution @p dist, reproducible for a given @p n
+Coordinates makeCoordinates(const std::string& dist, std::size_t n)
+{
+    Box<double> box{-1, 1};
+    Coordinates coords;
+
+    if (dist == "uniform")
+    {
+        RandomCoordinates<double, uint64_t> c(n, box);
+        coords = {c.x(), c.y(), c.z()};
+    }
+    else if (dist == "gaussian")
+    {
+        RandomGaussianCoordinates<double, uint64_t> c(n, box);
+        coords = {c.x(), c.y(), c.z()};
+    }
+    else if (dist == "plummer") { return plummer<double>(n); }
+    else { throw std::runtime_error("unknown distribution " + dist + "\n"); }
+
+    // the samples are returned in SFC order, shuffle them to obtain the input of a first sort
+    std::vector<std::size_t> permutation(n);
+    std::iota(permutation.begin(), permutation.end(), 0);
+    std::shuffle(permutation.begin(), permutation.end(), std::mt19937(42));
+    for (auto& c : coords)
+    {
+        reorder(permutation, c);
+    }
+    return coords;
+}
+
+Box<double> boundingBox(const Coordinates& c)
+{
+    auto [xmin, xmax] = std::minmax_element(c[0].begin(), c[0].end());
+    auto [ymin, ymax] = std::minmax_element(c[1].begin(), c[1].end());
+    auto [zmin, zmax] = std::minmax_element(c[2].begin(), c[2].end());
+    return {*xmin, *xmax, *ymin, *ymax, *zmin, *zmax};
+}
+
+template<class KeyType>
+void benchmarkKernels(const Coordinates& coords, const std::string& dist, unsigned bucketSize, int reps,
+                      std::vector<bench::Result>& results)
+{
+    std::size_t n   = coords[0].size();
+    Box<double> box = boundingBox(coords);
+
+    auto record = [&](const std::string& kernel, bench::Result result)
+    {
+        result.params = {{"kernel", kernel},
+                         {"distribution", dist},
+                         {"n", std::to_string(n)},
+                         {"bucketSize", std::to_string(bucketSize)},
+                         {"keyBits", std::to_string(8 * sizeof(KeyType))}};
+        std::cout << result.id() << " median " << result.median << " s" << std::endl;
+        results.push_back(std::move(result));
+    };
+
+    const double* x = coords[0].data();
+    const double* y = coords[1].data();
+    const double* z = coords[2].data();
+
+    std::vector<KeyType> unsortedKeys(n);
+    record("computeMortonCodes",
+           bench::timeKernel(reps, [&]() { computeMortonCodes(x, x + n, y, z, unsortedKeys.begin(), box); }));
+
+    {
+        std::vector<KeyType> hilbertKeys(n);
+        record("computeHilbertKeys", bench::timeKernel(reps, [&]() {
+                   computeSfcKeys<HilbertKey<KeyType>>(x, x + n, y, z, hilbertKeys.begin(), box);
+               }));
+    }
+
+    std::vector<KeyType> keys(n);
+    std::vector<unsigned> ordering(n);
+    record("sort_by_key", bench::timeKernel(
+                              reps,
+                              [&]()
+                              {
+                                  std::copy(unsortedKeys.begin(), unsortedKeys.end(), keys.begin());
+                                  std::iota(ordering.begin(), ordering.end(), 0);
+                              },
+                              [&]() { sort_by_key(keys.begin(), keys.end(), ordering.begin()); }));
+
+    // coordinates in SFC order for all subsequent kernels
+    Coordinates sorted = coords;
+    CpuGather<double, KeyType, unsigned> gather;
+    gather.setReorderMap(ordering.data(), ordering.data() + n);
+    {
+        std::array<double*, 3> arrays{sorted[0].data(), sorted[1].data(), sorted[2].data()};
+        gather(arrays.data(), 3);
+    }
+
+    {
+        std::vector<double> buffer(n);
+        record("gather", bench::timeKernel(
+                             reps, [&]() { std::copy(x, x + n, buffer.begin()); },
+                             [&]() { gather(buffer.data()); }));
+
+        Coordinates buffers = coords;
+        std::array<double*, 3> arrays{buffers[0].data(), buffers[1].data(), buffers[2].data()};
+        record("gatherArrays3", bench::timeKernel(reps, [&]() { buffers = coords; }, [&]() { gather(arrays.data(), 3); }));
+    }
+
+    const KeyType* keysStart = keys.data();
+    const KeyType* keysEnd   = keys.data() + n;
+
+    std::vector<KeyType> tree;
+    std::vector<unsigned> counts;
+    record("computeOctree", bench::timeKernel(reps, [&]() {
+               std::tie(tree, counts) = computeOctree(keysStart, keysEnd, bucketSize);
+           }));
+
+    TreeNodeIndex numLeaves = nNodes(tree);
+
+    record("computeNodeCounts", bench::timeKernel(reps, [&]() {
+               computeNodeCounts(tree.data(), counts.data(), numLeaves, keysStart, keysEnd,
+                                 std::numeric_limits<unsigned>::max(), true);
+           }));
+
+    {
+        std::vector<TreeNodeIndex> nodeOps(numLeaves + 1);
+        std::vector<KeyType> newTree;
+        record("rebalanceTree",
+               bench::timeKernel(
+                   reps, [&]() { rebalanceDecision(tree.data(), counts.data(), numLeaves, bucketSize, nodeOps.data()); },
+                   [&]() { rebalanceTree(tree, newTree, nodeOps.data()); }));
+
+        std::vector<KeyType> treeCopy;
+        std::vector<unsigned> countsCopy;
+        record("updateOctree", bench::timeKernel(
+                                   reps,
+                                   [&]()
+                                   {
+                                       treeCopy   = tree;
+                                       countsCopy = counts;
+                                   },
+                                   [&]() { updateOctree(keysStart, keysEnd, bucketSize, treeCopy, countsCopy); }));
+    }
+
+    Octree<KeyType> octree;
+    record("Octree::update", bench::timeKernel(reps, [&]() { octree.update(tree.begin(), tree.end()); }));
+
+    {
+        std::vector<unsigned> internalCounts(octree.numInternalNodes());
+        record("upsweep", bench::timeKernel(reps, [&]() {
+                   upsweep(octree, counts.data(), internalCounts.data(),
+                           [](auto a, auto b, auto c, auto d, auto e, auto f, auto g, auto h)
+                           { return a + b + c + d + e + f + g + h; });
+               }));
+    }
+
+    // the node range of a rank in the middle of an 8-rank decomposition serves as focus and halo domain
+    TreeNodeIndex firstNode = numLeaves * 3 / 8;
+    TreeNodeIndex lastNode  = numLeaves / 2;
+
+    {
+        float theta = 0.5;
+        std::vector<char> markings(octree.numTreeNodes());
+        record("markMac", bench::timeKernel(reps, [&]() {
+                   markMac(octree, box, tree[firstNode], tree[lastNode], 1.0f / (theta * theta), markings.data());
+               }));
+    }
+
+    // smoothing length for about 100 neighbors at the average density of the bounding box
+    double volume = (box.xmax() - box.xmin()) * (box.ymax() - box.ymin()) * (box.zmax() - box.zmin());
+    double h      = 0.5 * std::cbrt(100.0 * volume / (4.0 / 3.0 * M_PI * n));
+    std::vector<double> hs(n, h);
+
+    {
+        std::vector<float> haloRadii(numLeaves, 2 * h);
+        std::vector<int> collisionFlags(numLeaves);
+        record("findHalos", bench::timeKernel(
+                                reps, [&]() { std::fill(collisionFlags.begin(), collisionFlags.end(), 0); },
+                                [&]() {
+                                    findHalos<KeyType, float, double>(octree, haloRadii, box, firstNode, lastNode,
+                                                                      collisionFlags.data());
+                                }));
+    }
+
+    {
+        int ngmax = 150;
+        record("findNeighbors", bench::timeKernel(reps, [&]() {
+                   #pragma omp parallel
+                   {
+                       std::vector<int> neighbors(ngmax);
+                       int numNeighbors;
+                       #pragma omp for schedule(static)
+                       for (std::size_t i = 0; i < n; ++i)
+                       {
+                           findNeighbors(int(i), sorted[0].data(), sorted[1].data(), sorted[2].data(), hs.data(), box,
+                                         keysStart, neighbors.data(), &numNeighbors, int(n), ngmax);
+                       }
+                   }
+               }));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench::CommandLine cmd(argc, argv);
+
+    auto sizes         = bench::splitList(cmd.get("n", "1000000"));
+    auto bucketSizes   = bench::splitList(cmd.get("bucket", "64"));
+    auto distributions = bench::splitList(cmd.get("dist", "uniform,gaussian,plummer"));
+    auto keyWidths     = bench::splitList(cmd.get("keys", "64"));
+    int  reps          = std::stoi(cmd.get("reps", "5"));
+
+    std::vector<bench::Result> results;
+    for (const auto& dist : distributions)
+    {
+        for (const auto& n : sizes)
+        {
+            Coordinates coords = makeCoordinates(dist, std::stoul(n));
+            for (const auto& bucketSize : bucketSizes)
+            {
+                for (const auto& keyBits : keyWidths)
+                {
+                    if (keyBits == "32")
+                    {
+                        benchmarkKernels<uint32_t>(coords, dist, std::stoul(bucketSize), reps, results);
+                    }
+                    else if (keyBits == "64")
+                    {
+                        benchmarkKernels<uint64_t>(coords, dist, std::stoul(bucketSize), reps, results);
+                    }
+                    else { throw std::runtime_error("key width must be 32 or 64\n"); }
+                }
+            }
+        }
+    }
+
+    if (cmd.has("out"))
+    {
+        std::ofstream out(cmd.get("out", ""));
+        bench::writeResults(out, "microbench", results);
+    }
+
+    if (cmd.has("baseline"))
+    {
+        auto baseline = bench::readResults(cmd.get("baseline", ""), {"kernel", "distribution", "n", "bucketSize", "keyBits"});
+        int numRegressions =
+            bench::compareResults(results, baseline, std::stod(cmd.get("tolerance", "0.1")), std::cout);
+        if (numRegressions > 0)
+        {
+            std::cout << numRegressions << " regression(s) detected" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
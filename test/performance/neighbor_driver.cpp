@@ -32,11 +32,13 @@
 #include <chrono>
 #include <iostream>
 #include <iterator>
+#include <numeric>
 
 #include <cuda_runtime.h>
 
 #include "../coord_samples/random.hpp"
 #include "cstone/findneighbors.hpp"
+#include "cstone/findneighbors_cells.hpp"
 
 #include "cstone/cuda/findneighbors.cuh"
 
@@ -125,6 +127,28 @@ int main()
     else
         std::cout << "Neighbor counts: FAIL\n";
 
+    auto [tree, counts] = computeOctree(codes, codes + n, 64);
+    Octree<CodeType> octree;
+    octree.update(tree.begin(), tree.end());
+    std::vector<LocalParticleIndex> layout(counts.size() + 1, 0);
+    std::partial_sum(counts.begin(), counts.end(), layout.begin() + 1);
+
+    std::vector<int> neighborsCells(ngmax * n);
+    std::vector<int> neighborsCountCells(n);
+
+    t0 = std::chrono::high_resolution_clock::now();
+    cstone::findNeighborsCells(octree, layout.data(), 0, octree.numLeafNodes(), x, y, z, h.data(), box,
+                               neighborsCells.data(), neighborsCountCells.data(), ngmax);
+    t1 = std::chrono::high_resolution_clock::now();
+    double cellTime = std::chrono::duration<double>(t1 - t0).count();
+
+    std::cout << "CPU time cell-based " << cellTime << " s" << std::endl;
+    bool cellsEqual = std::equal(begin(neighborsCountCells), end(neighborsCountCells), begin(neighborsCountCPU));
+    if (cellsEqual)
+        std::cout << "Cell-based neighbor counts: PASS\n";
+    else
+        std::cout << "Cell-based neighbor counts: FAIL\n";
+
     cudaFree(d_x);
     cudaFree(d_y);
     cudaFree(d_z);
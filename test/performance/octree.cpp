@@ -93,12 +93,12 @@ void halo_discovery(Box<double> box, const std::vector<KeyType>& tree, const std
     }
 
     {
-        std::vector<BinaryNode<KeyType>> binaryTree(nNodes(tree));
-        createBinaryTree(tree.data(), nNodes(tree), binaryTree.data());
+        Octree<KeyType> octree;
+        octree.update(tree.begin(), tree.end());
         std::vector<int> collisionFlags(nNodes(tree), 0);
 
         auto tp0 = std::chrono::high_resolution_clock::now();
-        findHalos<KeyType, float>(tree, binaryTree, haloRadii, box, 0, upperNode, collisionFlags.data());
+        findHalos<KeyType, float>(octree, haloRadii, box, 0, upperNode, collisionFlags.data());
         auto tp1 = std::chrono::high_resolution_clock::now();
 
         double t2 = std::chrono::duration<double>(tp1 - tp0).count();
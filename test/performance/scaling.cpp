@@ -0,0 +1,361 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Strong and weak scaling driver for Domain::sync and FocusedDomain::sync
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ *
+ * Usage:
+ *   mpirun -n <ranks> scaling [--domain global|focus] [--mode strong|weak] [--dist uniform|plummer|clustered]
+ *                             [--n 1000000] [--steps 20] [--warmup 2] [--bucket 64] [--bucketFocus 16]
+ *                             [--ng 100] [--drift 0.02] [--table scaling.txt]
+ *
+ * With --mode strong, --n is the global number of particles, with --mode weak the number per rank.
+ * Each rank generates its share of the particles independently, the domain distributes them in the first sync.
+ * Between syncs, all particles are rotated around the z-axis and displaced by a random jitter, such that
+ * particles migrate between ranks in every step, as they would in a simulation.
+ *
+ * The phase timings of the timed steps are printed as min/avg/max over the ranks. With --table, one line per run
+ * is appended to the given file and the file is printed as scaling table, with the speedup and parallel efficiency
+ * relative to the run with the fewest ranks among the runs with identical domain, mode, distribution and n.
+ */
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+
+#include <mpi.h>
+
+#include "cstone/domain/domain.hpp"
+#include "cstone/domain/domain_focus.hpp"
+#include "cstone/util/instrumentation_mpi.hpp"
+
+#include "benchmark.hpp"
+
+using namespace cstone;
+
+using Real    = double;
+using KeyType = uint64_t;
+
+//! @brief the particles of one rank with their smoothing lengths
+struct Workload
+{
+    std::vector<Real> x, y, z, h;
+};
+
+/*! @brief generate @p n particles of distribution @p dist in the box [-1,1]^3
+ *
+ * The smoothing lengths are set from the analytic number density of the distribution, such that each particle has
+ * about @p ng neighbors within 2h. Ranks generate different particles by using their rank as seed, while the
+ * cluster centers are identical on all ranks.
+ */
+Workload makeWorkload(const std::string& dist, std::size_t n, uint64_t numGlobal, int rank, double ng)
+{
+    std::mt19937 gen(1234 + rank);
+    std::uniform_real_distribution<Real> uniform(-1, 1);
+    std::uniform_real_distribution<Real> unit(0, 1);
+    std::normal_distribution<Real> normal(0, 1);
+
+    Workload w;
+    w.x.resize(n);
+    w.y.resize(n);
+    w.z.resize(n);
+    w.h.resize(n);
+
+    auto smoothingLength = [ng](double numberDensity)
+    { return std::min(0.5 * std::cbrt(3.0 * ng / (4.0 * M_PI * numberDensity)), 0.25); };
+
+    if (dist == "uniform")
+    {
+        double h = smoothingLength(numGlobal / 8.0);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            w.x[i] = uniform(gen);
+            w.y[i] = uniform(gen);
+            w.z[i] = uniform(gen);
+            w.h[i] = h;
+        }
+    }
+    else if (dist == "plummer")
+    {
+        // Plummer sphere with scale radius a, truncated at the box boundary
+        double a = 0.1;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            double r;
+            do
+            {
+                r = a / std::sqrt(std::pow(unit(gen), -2.0 / 3.0) - 1.0);
+            } while (r > 1.0);
+
+            double cosTheta = 2 * unit(gen) - 1;
+            double sinTheta = std::sqrt(1 - cosTheta * cosTheta);
+            double phi      = 2 * M_PI * unit(gen);
+            w.x[i]          = r * sinTheta * std::cos(phi);
+            w.y[i]          = r * sinTheta * std::sin(phi);
+            w.z[i]          = r * cosTheta;
+
+            double density = numGlobal * 3.0 / (4.0 * M_PI * a * a * a) * std::pow(1 + r * r / (a * a), -2.5);
+            w.h[i]         = smoothingLength(density);
+        }
+    }
+    else if (dist == "clustered")
+    {
+        // gaussian clusters with identical centers on all ranks
+        int    numClusters = 16;
+        double sigma       = 0.05;
+        std::mt19937 centerGen(42);
+        std::uniform_real_distribution<Real> centerDist(-0.7, 0.7);
+        std::vector<std::array<Real, 3>> centers(numClusters);
+        for (auto& c : centers)
+        {
+            c = {centerDist(centerGen), centerDist(centerGen), centerDist(centerGen)};
+        }
+
+        double clusterNorm = double(numGlobal) / numClusters / std::pow(2 * M_PI * sigma * sigma, 1.5);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const auto& c = centers[gen() % numClusters];
+            double dx = sigma * normal(gen), dy = sigma * normal(gen), dz = sigma * normal(gen);
+            w.x[i]    = c[0] + dx;
+            w.y[i]    = c[1] + dy;
+            w.z[i]    = c[2] + dz;
+
+            double density = clusterNorm * std::exp(-(dx * dx + dy * dy + dz * dz) / (2 * sigma * sigma));
+            w.h[i]         = smoothingLength(density);
+        }
+    }
+    else { throw std::runtime_error("unknown distribution " + dist + "\n"); }
+
+    return w;
+}
+
+/*! @brief advance the particles [first:last) by one step of the synthetic drift
+ *
+ * Rotation by @p angle around the z-axis through the origin preserves the shape of the distribution and thus the
+ * validity of the smoothing lengths, the jitter of amplitude @p jitter perturbs the SFC order locally.
+ */
+void drift(Workload& w, std::size_t first, std::size_t last, double angle, double jitter, std::mt19937& gen)
+{
+    std::uniform_real_distribution<Real> disp(-jitter, jitter);
+    double c = std::cos(angle), s = std::sin(angle);
+    for (std::size_t i = first; i < last; ++i)
+    {
+        Real x = w.x[i], y = w.y[i];
+        w.x[i] = std::max(Real(-1), std::min(Real(1), c * x - s * y + disp(gen)));
+        w.y[i] = std::max(Real(-1), std::min(Real(1), s * x + c * y + disp(gen)));
+        w.z[i] = std::max(Real(-1), std::min(Real(1), w.z[i] + disp(gen)));
+    }
+}
+
+//! @brief run the sync loop with @p domain, return the sync wall time of each timed step on the executing rank
+template<class DomainType>
+std::vector<double> runSteps(DomainType& domain, Workload& w, int numSteps, int numWarmup, double driftAngle,
+                             SyncTimer& timer, int rank)
+{
+    std::mt19937 gen(rank);
+    std::vector<KeyType> keys(w.x.size());
+    std::vector<double> stepTimes;
+
+    for (int step = 0; step < numWarmup + numSteps; ++step)
+    {
+        if (step == numWarmup) { domain.setObserver(&timer); }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        auto tp0 = std::chrono::high_resolution_clock::now();
+        domain.sync(w.x, w.y, w.z, w.h, keys);
+        auto tp1 = std::chrono::high_resolution_clock::now();
+
+        if (step >= numWarmup) { stepTimes.push_back(std::chrono::duration<double>(tp1 - tp0).count()); }
+
+        // jitter relative to the smoothing length scale of the box
+        drift(w, domain.startIndex(), domain.endIndex(), driftAngle, 0.1 * driftAngle, gen);
+    }
+    domain.setObserver(nullptr);
+    return stepTimes;
+}
+
+//! @brief one line of the scaling table file
+struct TableRow
+{
+    std::string domain, mode, dist;
+    uint64_t n;
+    int ranks;
+    double secondsPerStep;
+    std::vector<std::pair<std::string, double>> phases;
+
+    std::string group() const { return domain + " " + mode + " " + dist + " " + std::to_string(n); }
+};
+
+std::string formatRow(const TableRow& row)
+{
+    std::ostringstream os;
+    os << row.domain << " " << row.mode << " " << row.dist << " " << row.n << " " << row.ranks << " "
+       << row.secondsPerStep;
+    for (const auto& [name, seconds] : row.phases)
+    {
+        os << " " << name << "=" << seconds;
+    }
+    return os.str();
+}
+
+TableRow parseRow(const std::string& line)
+{
+    std::istringstream is(line);
+    TableRow row;
+    is >> row.domain >> row.mode >> row.dist >> row.n >> row.ranks >> row.secondsPerStep;
+    std::string phase;
+    while (is >> phase)
+    {
+        auto eq = phase.find('=');
+        row.phases.emplace_back(phase.substr(0, eq), std::stod(phase.substr(eq + 1)));
+    }
+    return row;
+}
+
+/*! @brief print the rows of @p filename grouped by domain, mode, distribution and n, with speedup and efficiency
+ *
+ * Strong scaling: speedup = T_ref / T, efficiency = speedup * ranks_ref / ranks
+ * Weak scaling:   efficiency = T_ref / T
+ */
+void printScalingTable(const std::string& filename)
+{
+    std::ifstream in(filename);
+    std::map<std::string, std::vector<TableRow>> groups;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] == '#') { continue; }
+        TableRow row = parseRow(line);
+        groups[row.group()].push_back(row);
+    }
+
+    for (auto& [group, rows] : groups)
+    {
+        std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.ranks < b.ranks; });
+        const TableRow& ref = rows.front();
+        bool strong         = ref.mode == "strong";
+
+        std::printf("\n%s\n", group.c_str());
+        std::printf("%8s %14s %10s %10s", "ranks", "s/step", "speedup", "efficiency");
+        for (const auto& phase : ref.phases)
+        {
+            std::printf(" %16s", phase.first.c_str());
+        }
+        std::printf("\n");
+
+        for (const auto& row : rows)
+        {
+            double speedup    = ref.secondsPerStep / row.secondsPerStep;
+            double efficiency = strong ? speedup * ref.ranks / row.ranks : speedup;
+            std::printf("%8d %14.5f %10.2f %10.2f", row.ranks, row.secondsPerStep, speedup, efficiency);
+            for (const auto& phase : row.phases)
+            {
+                std::printf(" %16.5f", phase.second);
+            }
+            std::printf("\n");
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    MPI_Init(&argc, &argv);
+
+    int rank, numRanks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+    bench::CommandLine cmd(argc, argv);
+    std::string domainType  = cmd.get("domain", "global");
+    std::string mode        = cmd.get("mode", "strong");
+    std::string dist        = cmd.get("dist", "uniform");
+    uint64_t    n           = std::stoull(cmd.get("n", "1000000"));
+    int         numSteps    = std::stoi(cmd.get("steps", "20"));
+    int         numWarmup   = std::stoi(cmd.get("warmup", "2"));
+    unsigned    bucketSize  = std::stoul(cmd.get("bucket", "64"));
+    unsigned    bucketFocus = std::stoul(cmd.get("bucketFocus", "16"));
+    double      ng          = std::stod(cmd.get("ng", "100"));
+    double      driftAngle  = std::stod(cmd.get("drift", "0.02"));
+
+    if (mode != "strong" && mode != "weak") { throw std::runtime_error("mode must be strong or weak\n"); }
+
+    uint64_t numGlobal = mode == "strong" ? n : n * numRanks;
+    uint64_t numLocal  = numGlobal / numRanks + (uint64_t(rank) < numGlobal % numRanks);
+
+    Workload w = makeWorkload(dist, numLocal, numGlobal, rank, ng);
+
+    SyncTimer timer;
+    std::vector<double> stepTimes;
+    Box<Real> box{-1, 1};
+    if (domainType == "global")
+    {
+        Domain<KeyType, Real> domain(rank, numRanks, bucketSize, box);
+        stepTimes = runSteps(domain, w, numSteps, numWarmup, driftAngle, timer, rank);
+    }
+    else if (domainType == "focus")
+    {
+        FocusedDomain<KeyType, Real> domain(rank, numRanks, bucketSize, bucketFocus, box);
+        stepTimes = runSteps(domain, w, numSteps, numWarmup, driftAngle, timer, rank);
+    }
+    else { throw std::runtime_error("domain must be global or focus\n"); }
+
+    // a step takes as long as the slowest rank
+    MPI_Allreduce(MPI_IN_PLACE, stepTimes.data(), stepTimes.size(), MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    double secondsPerStep = std::accumulate(stepTimes.begin(), stepTimes.end(), 0.0) / numSteps;
+
+    std::vector<PhaseReport> reports = reduceSyncCounters(timer);
+
+    if (rank == 0)
+    {
+        std::printf("%s domain, %s scaling, %s distribution, %d ranks, %lu particles, %d steps\n", domainType.c_str(),
+                    mode.c_str(), dist.c_str(), numRanks, numGlobal, numSteps);
+        printSyncReport(reports);
+        std::printf("seconds per sync (max over ranks): %.5f\n", secondsPerStep);
+
+        if (cmd.has("table"))
+        {
+            TableRow row{domainType, mode, dist, n, numRanks, secondsPerStep, {}};
+            for (const auto& r : reports)
+            {
+                row.phases.emplace_back(syncPhaseName(r.phase), r.seconds.max / numSteps);
+            }
+
+            std::string filename = cmd.get("table", "");
+            {
+                std::ofstream out(filename, std::ios::app);
+                out << formatRow(row) << std::endl;
+            }
+            printScalingTable(filename);
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
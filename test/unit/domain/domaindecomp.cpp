@@ -30,6 +30,7 @@
  */
 
 #include <algorithm>
+#include <limits>
 #include <numeric>
 
 #include "gtest/gtest.h"
@@ -94,6 +95,75 @@ TEST(DomainDecomposition, singleRangeSfcSplit)
     }
 }
 
+TEST(DomainDecomposition, weightedSfcSplit)
+{
+    std::size_t noLimit = std::numeric_limits<std::size_t>::max();
+    {
+        // equal weights per particle reproduce the count-based split
+        int nSplits = 2;
+        std::vector<unsigned> counts{5, 5, 5, 5, 5, 6};
+        std::vector<double> weights{5, 5, 5, 5, 5, 6};
+
+        EXPECT_EQ(weightedSfcSplit(counts, weights, nSplits, noLimit), singleRangeSfcSplit(counts, nSplits));
+    }
+    {
+        // the first two leaves are ten times as expensive per particle
+        int nSplits = 2;
+        std::vector<unsigned> counts{5, 5, 5, 5, 5, 5};
+        std::vector<double> weights{50, 50, 5, 5, 5, 5};
+
+        SpaceCurveAssignment ref(nSplits);
+        ref.addRange(Rank(0), 0, 1, 5);
+        ref.addRange(Rank(1), 1, 6, 25);
+        EXPECT_EQ(ref, weightedSfcSplit(counts, weights, nSplits, noLimit));
+    }
+    {
+        // the leaves with low weights are spread over more splits if the particle count is limited
+        int nSplits = 3;
+        std::vector<unsigned> counts{5, 5, 5, 5, 5, 5};
+        std::vector<double> weights{1, 1, 1, 1, 1, 30};
+
+        SpaceCurveAssignment ref(nSplits);
+        ref.addRange(Rank(0), 0, 3, 15);
+        ref.addRange(Rank(1), 3, 5, 10);
+        ref.addRange(Rank(2), 5, 6, 5);
+        EXPECT_EQ(ref, weightedSfcSplit(counts, weights, nSplits, 15));
+    }
+}
+
+TEST(DomainDecomposition, hierarchicalSfcSplit)
+{
+    {
+        // a single group with the ranks in ascending order is a flat split
+        std::vector<unsigned> counts{4, 3, 4, 3, 4, 3, 4, 3, 4, 3};
+        std::vector<std::vector<int>> groups{{0, 1, 2, 3, 4, 5, 6}};
+        EXPECT_EQ(hierarchicalSfcSplit(counts, groups), singleRangeSfcSplit(counts, 7));
+    }
+    {
+        // the ranks of each group are not consecutive, the SFC segments of the groups are
+        std::vector<unsigned> counts{5, 5, 5, 5, 5, 5, 5, 5};
+        std::vector<std::vector<int>> groups{{0, 2}, {1, 3}};
+
+        SpaceCurveAssignment ref(4);
+        ref.addRange(Rank(0), 0, 2, 10);
+        ref.addRange(Rank(2), 2, 4, 10);
+        ref.addRange(Rank(1), 4, 6, 10);
+        ref.addRange(Rank(3), 6, 8, 10);
+        EXPECT_EQ(ref, hierarchicalSfcSplit(counts, groups));
+    }
+    {
+        // groups receive a share of the particles proportional to their number of ranks
+        std::vector<unsigned> counts{5, 5, 5, 5, 5, 5};
+        std::vector<std::vector<int>> groups{{1}, {0, 2}};
+
+        SpaceCurveAssignment ref(3);
+        ref.addRange(Rank(1), 0, 2, 10);
+        ref.addRange(Rank(0), 2, 4, 10);
+        ref.addRange(Rank(2), 4, 6, 10);
+        EXPECT_EQ(ref, hierarchicalSfcSplit(counts, groups));
+    }
+}
+
 //! @brief test that the SfcLookupKey can lookup the rank for a given code
 TEST(DomainDecomposition, AssignmentFindRank)
 {
@@ -111,6 +181,30 @@ TEST(DomainDecomposition, AssignmentFindRank)
     EXPECT_EQ(3, assignment.findRank(4));
 }
 
+//! @brief ranks that are not assigned in SFC order, with ranges added out of order and an empty range
+TEST(DomainDecomposition, AssignmentFindRankPermuted)
+{
+    int nRanks = 4;
+    SpaceCurveAssignment assignment(nRanks);
+    assignment.addRange(Rank(2), 1, 3, 0);
+    assignment.addRange(Rank(0), 3, 4, 0);
+    assignment.addRange(Rank(3), 0, 1, 0);
+    assignment.addRange(Rank(1), 4, 4, 0);
+
+    EXPECT_EQ(3, assignment.findRank(0));
+    EXPECT_EQ(2, assignment.findRank(1));
+    EXPECT_EQ(2, assignment.findRank(2));
+    EXPECT_EQ(0, assignment.findRank(3));
+
+    EXPECT_EQ(assignment.firstNodeIdx(2), 1);
+    EXPECT_EQ(assignment.lastNodeIdx(2), 3);
+    EXPECT_EQ(assignment.firstNodeIdx(1), assignment.lastNodeIdx(1));
+
+    // re-assigning a rank replaces its previous range
+    assignment.addRange(Rank(0), 3, 5, 0);
+    EXPECT_EQ(0, assignment.findRank(4));
+}
+
 /*! @brief test SendList creation from a SFC assignment
  *
  * This test creates an array with SFC keys and an
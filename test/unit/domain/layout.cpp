@@ -29,6 +29,9 @@
  * @author Sebastian Keller <sebastian.f.keller@gmail.com>
  */
 
+#include <numeric>
+#include <random>
+
 #include "gtest/gtest.h"
 
 #include "cstone/domain/layout.hpp"
@@ -63,6 +66,75 @@ TEST(Layout, sendRecvNodeList)
     EXPECT_EQ(outgoingHalos, refOutgoingHalos);
 }
 
+//! @brief unordered halo pairs with duplicates and permuted rank order along the SFC
+TEST(Layout, sendRecvNodeListRandom)
+{
+    int numRanks = 4;
+    SpaceCurveAssignment assignment(numRanks);
+    assignment.addRange(Rank(2), 0, 100, 0);
+    assignment.addRange(Rank(0), 100, 300, 0);
+    assignment.addRange(Rank(3), 300, 350, 0);
+    assignment.addRange(Rank(1), 350, 500, 0);
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<TreeNodeIndex> internalDist(100, 299);
+    std::uniform_int_distribution<TreeNodeIndex> remoteDist(0, 299);
+
+    std::vector<pair<TreeNodeIndex>> haloPairs;
+    for (int i = 0; i < 5000; ++i)
+    {
+        TreeNodeIndex remote = remoteDist(gen);
+        if (remote >= 100) { remote += 200; }
+        haloPairs.emplace_back(internalDist(gen), remote);
+    }
+
+    std::vector<std::vector<TreeNodeIndex>> refIncoming(numRanks), refOutgoing(numRanks);
+    for (auto& p : haloPairs)
+    {
+        int remoteRank = assignment.findRank(p[1]);
+        refIncoming[remoteRank].push_back(p[1]);
+        refOutgoing[remoteRank].push_back(p[0]);
+    }
+    for (int rank = 0; rank < numRanks; ++rank)
+    {
+        for (auto* v : {&refIncoming[rank], &refOutgoing[rank]})
+        {
+            std::sort(v->begin(), v->end());
+            v->erase(std::unique(v->begin(), v->end()), v->end());
+        }
+    }
+
+    std::vector<std::vector<TreeNodeIndex>> incoming, outgoing;
+    computeSendRecvNodeList(assignment, haloPairs, incoming, outgoing);
+
+    EXPECT_EQ(incoming, refIncoming);
+    EXPECT_EQ(outgoing, refOutgoing);
+    EXPECT_TRUE(incoming[0].empty());
+}
+
+TEST(Layout, flaggedIndices)
+{
+    std::vector<int> flags{0, 1, 1, 0, 0, 1, 0, 1};
+
+    EXPECT_EQ(flaggedIndices(flags.data(), flags.size()), (std::vector<TreeNodeIndex>{1, 2, 5, 7}));
+    EXPECT_EQ(flaggedIndices(flags.data(), flags.size(), 10), (std::vector<TreeNodeIndex>{11, 12, 15, 17}));
+    EXPECT_TRUE(flaggedIndices(flags.data(), 1).empty());
+}
+
+TEST(Layout, groupNodesByRank)
+{
+    SpaceCurveAssignment assignment(3);
+    assignment.addRange(Rank(1), 0, 4, 0);
+    assignment.addRange(Rank(2), 4, 6, 0);
+    assignment.addRange(Rank(0), 6, 10, 0);
+
+    std::vector<TreeNodeIndex> nodes{1, 3, 6, 7, 9};
+    auto grouped = groupNodesByRank(nodes, assignment);
+
+    std::vector<std::vector<TreeNodeIndex>> ref{{6, 7, 9}, {1, 3}, {}};
+    EXPECT_EQ(grouped, ref);
+}
+
 TEST(Layout, flattenNodeList)
 {
     std::vector<std::vector<TreeNodeIndex>> grouped{{0, 1, 2}, {3, 4, 5}, {6}, {}};
@@ -91,11 +163,11 @@ TEST(Layout, computeLayoutOffsets)
     std::vector<TreeNodeIndex> presentNodes, offsets;
     computeLayoutOffsets(localNodes[0], localNodes[1], halos, nodeCounts, presentNodes, offsets);
 
-    std::vector<int> refPresentNodes{1, 3, 4, 5, 6, 7, 8, 9, 14, 15, 16, 21, 30};
-    // counts                        2,3,5,1,1,1,1,1,1, 1, 6, 1, 9
+    std::vector<TreeNodeIndex> refPresentNodes{1, 3, 4, 5, 6, 7, 8, 9, 14, 15, 16, 21, 30};
+    // counts                                  2,3,5,1,1,1,1,1,1, 1, 6, 1, 9
     EXPECT_EQ(presentNodes, refPresentNodes);
 
-    std::vector<int> refOffsets{0, 2, 5, 10, 11, 12, 13, 14, 15, 16, 17, 23, 24, 33};
+    std::vector<TreeNodeIndex> refOffsets{0, 2, 5, 10, 11, 12, 13, 14, 15, 16, 17, 23, 24, 33};
     EXPECT_EQ(offsets, refOffsets);
 }
 
@@ -145,3 +217,25 @@ TEST(Layout, computeHaloReceiveList)
 
     EXPECT_EQ(receiveList, reference);
 }
+
+TEST(Layout, removalMoves)
+{
+    // range [10:20], remove 11, 13, 18 and 19
+    std::vector<int> removeIndices{19, 13, 11, 18};
+    std::vector<int> destinations, sources;
+    removalMoves(removeIndices, 10, 20, destinations, sources);
+
+    EXPECT_EQ(destinations, (std::vector<int>{11, 13}));
+    EXPECT_EQ(sources, (std::vector<int>{16, 17}));
+
+    std::vector<int> values(20);
+    std::iota(values.begin(), values.end(), 0);
+    moveElements(destinations, sources, values);
+
+    std::vector<int> remaining(values.begin() + 10, values.begin() + 16);
+    std::sort(remaining.begin(), remaining.end());
+    EXPECT_EQ(remaining, (std::vector<int>{10, 12, 14, 15, 16, 17}));
+
+    EXPECT_THROW(removalMoves(std::vector<int>{9}, 10, 20, destinations, sources), std::runtime_error);
+    EXPECT_THROW(removalMoves(std::vector<int>{12, 12}, 10, 20, destinations, sources), std::runtime_error);
+}
@@ -0,0 +1,158 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for the particle container with a registry of typed fields
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <numeric>
+#include <tuple>
+
+#include "gtest/gtest.h"
+
+#include "cstone/domain/particle_container.hpp"
+
+using namespace cstone;
+
+TEST(ParticleContainer, registerAndResize)
+{
+    ParticleContainer particles;
+    auto mass = particles.registerField<double>("m", FieldKind::migrate);
+    particles.resize(10);
+
+    // fields registered later get the current size of the container
+    auto flags = particles.registerField<int>("flags", FieldKind::transient);
+    EXPECT_EQ(particles.field(mass).size(), 10);
+    EXPECT_EQ(particles.field(flags).size(), 10);
+    EXPECT_EQ(particles.numFields(), 2);
+    EXPECT_EQ(particles.findField("flags"), 1);
+    EXPECT_EQ(particles.findField("u"), -1);
+    EXPECT_EQ(particles.fieldKind(0), FieldKind::migrate);
+
+    EXPECT_THROW(particles.registerField<float>("m", FieldKind::halo), std::runtime_error);
+
+    particles.field(mass).resize(11);
+    EXPECT_THROW(std::ignore = particles.size(), std::runtime_error);
+}
+
+//! @brief capacity is shared by all fields, reallocation happens only when the capacity is exceeded
+TEST(ParticleContainer, capacity)
+{
+    ParticleContainer particles;
+    auto mass = particles.registerField<double>("m", FieldKind::migrate);
+    auto rho  = particles.registerField<float>("rho", FieldKind::halo);
+
+    particles.reserve(100);
+    particles.resize(50);
+    const double* massData = particles.field(mass).data();
+    particles.resize(100);
+
+    EXPECT_EQ(particles.capacity(), 100);
+    EXPECT_EQ(particles.field(mass).data(), massData);
+    EXPECT_GE(particles.field(rho).capacity(), 100);
+}
+
+TEST(ParticleContainer, byteArrays)
+{
+    ParticleContainer particles;
+    particles.registerField<double>("m", FieldKind::migrate);
+    particles.registerField<float>("rho", FieldKind::halo);
+    particles.registerField<char>("tmp", FieldKind::transient);
+    particles.resize(4);
+
+    std::vector<ByteArray> arrays;
+    particles.appendByteArrays(arrays, false);
+    ASSERT_EQ(arrays.size(), 2);
+    EXPECT_EQ(arrays[0].elementSize, sizeof(double));
+    EXPECT_EQ(arrays[1].elementSize, sizeof(float));
+    EXPECT_EQ(packedElementBytes(arrays.data(), 2), sizeof(double) + sizeof(float));
+
+    arrays.clear();
+    particles.appendByteArrays(arrays, true);
+    ASSERT_EQ(arrays.size(), 1);
+    EXPECT_EQ(arrays[0].elementSize, sizeof(float));
+}
+
+//! @brief only persistent fields are reordered, elements outside the reordered range are preserved
+TEST(ParticleContainer, reorder)
+{
+    ParticleContainer particles;
+    auto id      = particles.registerField<uint64_t>("id", FieldKind::migrate);
+    auto scratch = particles.registerField<int>("tmp", FieldKind::transient);
+    particles.resize(6);
+
+    std::iota(particles.field(id).begin(), particles.field(id).end(), 10);
+    std::iota(particles.field(scratch).begin(), particles.field(scratch).end(), 0);
+
+    std::vector<LocalParticleIndex> ordering{3, 0, 2, 1};
+    particles.reorder(ordering.data(), ordering.size(), 1);
+
+    std::vector<uint64_t> idRef{10, 14, 11, 13, 12, 15};
+    std::vector<int> scratchRef{0, 1, 2, 3, 4, 5};
+    EXPECT_EQ(particles.field(id), idRef);
+    EXPECT_EQ(particles.field(scratch), scratchRef);
+}
+
+//! @brief reorder maps of deferred fields are composed and only applied on access
+TEST(ParticleContainer, deferredReorder)
+{
+    ParticleContainer particles;
+    auto id       = particles.registerField<uint64_t>("id", FieldKind::migrate);
+    auto tracer   = particles.registerField<double>("tracer", FieldKind::deferred);
+    auto tracer2  = particles.registerField<float>("tracer2", FieldKind::deferred);
+    particles.resize(6);
+
+    std::iota(particles.field(id).begin(), particles.field(id).end(), 10);
+    std::iota(particles.field(tracer).begin(), particles.field(tracer).end(), 10);
+    std::iota(particles.field(tracer2).begin(), particles.field(tracer2).end(), 10);
+
+    std::vector<LocalParticleIndex> ordering{3, 0, 2, 1};
+    particles.reorder(ordering.data(), ordering.size(), 1);
+    std::vector<LocalParticleIndex> ordering2{1, 3, 0, 2};
+    particles.reorder(ordering2.data(), ordering2.size(), 1);
+
+    // the pending map of both deferred fields is the composition of the two orderings
+    std::vector<const LocalParticleIndex*> pending;
+    particles.appendPendingOrderings(pending, 1);
+    ASSERT_EQ(pending.size(), 3);
+    EXPECT_EQ(pending[0], nullptr);
+    ASSERT_NE(pending[1], nullptr);
+    EXPECT_EQ(pending[1], pending[2]);
+    std::vector<LocalParticleIndex> composed{pending[1], pending[1] + 4};
+    EXPECT_EQ(composed, (std::vector<LocalParticleIndex>{0, 1, 3, 2}));
+
+    std::vector<uint64_t> idRef{10, 11, 12, 14, 13, 15};
+    EXPECT_EQ(particles.field(id), idRef);
+    EXPECT_EQ(particles.field(tracer), std::vector<double>(idRef.begin(), idRef.end()));
+
+    // accessing one field does not apply the map to the other
+    pending.clear();
+    particles.appendPendingOrderings(pending, 1);
+    EXPECT_EQ(pending[1], nullptr);
+    EXPECT_NE(pending[2], nullptr);
+    EXPECT_EQ(particles.field(tracer2), std::vector<float>(idRef.begin(), idRef.end()));
+}
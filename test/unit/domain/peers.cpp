@@ -78,7 +78,7 @@ TEST(Peers, findMacGrid64PBC)
 }
 
 //! @brief reference peer search, all-all leaf comparison
-template<class T, class KeyType>
+template<class T, class KeyType, class SfcKind = KeyType>
 std::vector<int> findPeersAll2All(int myRank, const SpaceCurveAssignment& assignment, gsl::span<const KeyType> tree,
                                   const Box<T>& box, float theta)
 {
@@ -88,7 +88,7 @@ std::vector<int> findPeersAll2All(int myRank, const SpaceCurveAssignment& assign
 
     std::vector<IBox> boxes(nNodes(tree));
     for (TreeNodeIndex i = 0; i < nNodes(tree); ++i)
-        boxes[i] = makeIBox(tree[i], tree[i + 1]);
+        boxes[i] = makeIBox<KeyType, SfcKind>(tree[i], tree[i + 1]);
 
     std::vector<int> peers(assignment.numRanks());
     for (TreeNodeIndex i = firstIdx; i < lastIdx; ++i)
@@ -102,16 +102,17 @@ std::vector<int> findPeersAll2All(int myRank, const SpaceCurveAssignment& assign
     return ret;
 }
 
-template<class KeyType>
-void findPeers()
+template<class SfcKind>
+std::vector<int> findPeers()
 {
+    using KeyType  = SfcKeyType_t<SfcKind>;
     using CodeType = KeyType;
     Box<double> box{-1, 1};
     int nParticles = 100000;
     int bucketSize = 64;
     int numRanks = 50;
 
-    RandomGaussianCoordinates<double, CodeType> randomBox(nParticles, box);
+    RandomGaussianCoordinates<double, SfcKind> randomBox(nParticles, box);
     std::vector<CodeType> codes = randomBox.mortonCodes();
 
     Octree<KeyType> octree;
@@ -121,16 +122,17 @@ void findPeers()
     SpaceCurveAssignment assignment = singleRangeSfcSplit(counts, numRanks);
 
     int probeRank = numRanks / 2;
-    std::vector<int> peersDtt = findPeersMac(probeRank, assignment, octree, box, 0.5);
-    std::vector<int> peersStt = findPeersMacStt(probeRank, assignment, octree, box, 0.5);
-    std::vector<int> peersA2A = findPeersAll2All(probeRank, assignment, octree.treeLeaves(), box, 0.5);
+    std::vector<int> peersDtt = findPeersMac<double, KeyType, SfcKind>(probeRank, assignment, octree, box, 0.5);
+    std::vector<int> peersStt = findPeersMacStt<double, KeyType, SfcKind>(probeRank, assignment, octree, box, 0.5);
+    std::vector<int> peersA2A =
+        findPeersAll2All<double, KeyType, SfcKind>(probeRank, assignment, octree.treeLeaves(), box, 0.5);
     EXPECT_EQ(peersDtt, peersStt);
     EXPECT_EQ(peersDtt, peersA2A);
 
     // check for mutuality
     for (int peerRank : peersDtt)
     {
-        std::vector<int> peersOfPeerDtt = findPeersMac(peerRank, assignment, octree, box, 0.5);
+        std::vector<int> peersOfPeerDtt = findPeersMac<double, KeyType, SfcKind>(peerRank, assignment, octree, box, 0.5);
         // std::vector<int> peersOfPeerStt = findPeersMacStt(peerRank, assignment, octree, box, 0.5);
         // std::vector<int> peersA2A = findPeersAll2All(rank, assignment, octree.treeLeaves(), box, 0.5);
         // EXPECT_EQ(peersDtt, peersStt);
@@ -139,6 +141,8 @@ void findPeers()
         // the peers of the peers of the probeRank have to have probeRank as peer
         EXPECT_TRUE(std::find(begin(peersOfPeerDtt), end(peersOfPeerDtt), probeRank) != end(peersOfPeerDtt));
     }
+
+    return peersDtt;
 }
 
 TEST(Peers, find)
@@ -146,3 +150,110 @@ TEST(Peers, find)
     findPeers<unsigned>();
     findPeers<uint64_t>();
 }
+
+TEST(Peers, findHilbert)
+{
+    auto peersHilbert = findPeers<HilbertKey<uint64_t>>();
+    auto peersMorton  = findPeers<uint64_t>();
+
+    // Hilbert domains are connected and have fewer neighbors
+    EXPECT_LE(peersHilbert.size(), peersMorton.size());
+
+    findPeers<HilbertKey<unsigned>>();
+}
+
+//! @brief the vector MAC finds a mutual subset of the min-distance MAC peers
+template<class KeyType>
+void findPeersVectorMac()
+{
+    Box<double> box{-1, 1};
+    int nParticles = 100000;
+    int bucketSize = 64;
+    int numRanks = 50;
+
+    RandomGaussianCoordinates<double, KeyType> randomBox(nParticles, box);
+    std::vector<KeyType> codes = randomBox.mortonCodes();
+
+    Octree<KeyType> octree;
+    auto [tree, counts] = computeOctree(codes.data(), codes.data() + nParticles, bucketSize);
+    octree.update(tree.begin(), tree.end());
+
+    SpaceCurveAssignment assignment = singleRangeSfcSplit(counts, numRanks);
+
+    std::vector<ExpansionCenter<double>> centers(octree.numTreeNodes());
+    for (TreeNodeIndex i = 0; i < octree.numTreeNodes(); ++i)
+    {
+        IBox nodeBox = makeIBox<KeyType, KeyType>(octree.codeStart(i), octree.codeEnd(i));
+        centers[i]   = geometricCenter<KeyType>(nodeBox, box);
+    }
+
+    int probeRank = numRanks / 2;
+    std::vector<int> peers = findPeersMac<double, KeyType>(probeRank, assignment, octree, box, 0.5);
+    std::vector<int> vectorPeers =
+        findPeersMac<double, KeyType, KeyType, VectorMacTag>(probeRank, assignment, octree, box, 0.5, centers.data());
+
+    EXPECT_FALSE(vectorPeers.empty());
+    EXPECT_LE(vectorPeers.size(), peers.size());
+    EXPECT_TRUE(std::includes(begin(peers), end(peers), begin(vectorPeers), end(vectorPeers)));
+
+    for (int peerRank : vectorPeers)
+    {
+        std::vector<int> peersOfPeer =
+            findPeersMac<double, KeyType, KeyType, VectorMacTag>(peerRank, assignment, octree, box, 0.5, centers.data());
+        EXPECT_TRUE(std::find(begin(peersOfPeer), end(peersOfPeer), probeRank) != end(peersOfPeer));
+    }
+
+    EXPECT_THROW((findPeersMac<double, KeyType, KeyType, VectorMacTag>(probeRank, assignment, octree, box, 0.5)),
+                 std::runtime_error);
+}
+
+TEST(Peers, findVectorMac)
+{
+    findPeersVectorMac<unsigned>();
+    findPeersVectorMac<uint64_t>();
+}
+
+//! @brief the peer cache only traverses the tree if the leaves, the assignment ranges or the box changed
+TEST(Peers, cache)
+{
+    using KeyType = uint64_t;
+    Box<double> box{-1, 1};
+    int nParticles = 100000;
+    int bucketSize = 64;
+    int numRanks   = 50;
+    int probeRank  = numRanks / 2;
+
+    RandomGaussianCoordinates<double, KeyType> randomBox(nParticles, box);
+    std::vector<KeyType> codes = randomBox.mortonCodes();
+
+    auto [tree, counts] = computeOctree(codes.data(), codes.data() + nParticles, bucketSize);
+    Octree<KeyType> octree;
+    octree.update(tree.begin(), tree.end());
+
+    SpaceCurveAssignment assignment = singleRangeSfcSplit(counts, numRanks);
+    std::vector<int> reference = findPeersMac<double, KeyType>(probeRank, assignment, octree, box, 0.5);
+
+    PeerCache<double, KeyType> cache;
+    EXPECT_EQ(cache.peers(probeRank, assignment, tree, box, 0.5), reference);
+    EXPECT_FALSE(cache.reused());
+
+    // different counts with identical node ranges
+    SpaceCurveAssignment recounted(numRanks);
+    for (int rank = 0; rank < numRanks; ++rank)
+    {
+        recounted.addRange(Rank(rank), assignment.firstNodeIdx(rank), assignment.lastNodeIdx(rank),
+                           assignment.totalCount(rank) + 1);
+    }
+    EXPECT_EQ(cache.peers(probeRank, recounted, tree, box, 0.5), reference);
+    EXPECT_TRUE(cache.reused());
+
+    Box<double> largerBox{-2, 2};
+    std::vector<int> largerBoxReference = findPeersMac<double, KeyType>(probeRank, assignment, octree, largerBox, 0.5);
+    EXPECT_EQ(cache.peers(probeRank, assignment, tree, largerBox, 0.5), largerBoxReference);
+    EXPECT_FALSE(cache.reused());
+
+    std::vector<int> otherRankReference =
+        findPeersMac<double, KeyType>(probeRank + 1, assignment, octree, largerBox, 0.5);
+    EXPECT_EQ(cache.peers(probeRank + 1, assignment, tree, largerBox, 0.5), otherRankReference);
+    EXPECT_FALSE(cache.reused());
+}
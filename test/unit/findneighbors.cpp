@@ -30,11 +30,17 @@
  */
 
 #include <iostream>
+#include <numeric>
+#include <tuple>
 #include <vector>
 
 #include "gtest/gtest.h"
 
 #include "cstone/findneighbors.hpp"
+#include "cstone/findneighbors_cells.hpp"
+#include "cstone/findneighbors_csr.hpp"
+#include "cstone/findneighbors_knn.hpp"
+#include "cstone/findneighbors_verlet.hpp"
 
 #include "coord_samples/random.hpp"
 
@@ -265,7 +271,7 @@ TEST(FindNeighbors, findNeighborBoxesCornerPbc)
     findNeighborBoxesCornerPbc<uint64_t>();
 }
 
-template<class Coordinates, class T>
+template<class SfcKind, class Coordinates, class T>
 void neighborCheck(const Coordinates& coords, T radius, const Box<T>& box)
 {
     int n = coords.x().size();
@@ -281,14 +287,75 @@ void neighborCheck(const Coordinates& coords, T radius, const Box<T>& box)
     std::vector<int> neighborsProbe(n * ngmax), neighborsCountProbe(n);
     for (int i = 0; i < n; ++i)
     {
-        findNeighbors(i, coords.x().data(), coords.y().data(), coords.z().data(), h.data(), box,
-                      coords.mortonCodes().data(), neighborsProbe.data() + i * ngmax, neighborsCountProbe.data() + i, n,
-                      ngmax);
+        findNeighbors<T, SfcKeyType_t<SfcKind>, SfcKind>(i, coords.x().data(), coords.y().data(), coords.z().data(),
+                                                         h.data(), box, coords.mortonCodes().data(),
+                                                         neighborsProbe.data() + i * ngmax,
+                                                         neighborsCountProbe.data() + i, n, ngmax);
     }
     sortNeighbors(neighborsProbe.data(), neighborsCountProbe.data(), n, ngmax);
 
     EXPECT_EQ(neighborsRef, neighborsProbe);
     EXPECT_EQ(neighborsCountRef, neighborsCountProbe);
+
+    using KeyType = SfcKeyType_t<SfcKind>;
+    const KeyType* codes = coords.mortonCodes().data();
+    auto [tree, counts]  = computeOctree(codes, codes + n, 16);
+    Octree<KeyType> octree;
+    octree.update(tree.begin(), tree.end());
+
+    std::vector<LocalParticleIndex> layout(counts.size() + 1, 0);
+    std::partial_sum(counts.begin(), counts.end(), layout.begin() + 1);
+
+    std::vector<int> neighborsCells(n * ngmax), neighborsCountCells(n);
+    findNeighborsCells<T, KeyType, SfcKind>(octree, layout.data(), 0, octree.numLeafNodes(), coords.x().data(),
+                                            coords.y().data(), coords.z().data(), h.data(), box,
+                                            neighborsCells.data(), neighborsCountCells.data(), ngmax);
+    sortNeighbors(neighborsCells.data(), neighborsCountCells.data(), n, ngmax);
+
+    EXPECT_EQ(neighborsRef, neighborsCells);
+    EXPECT_EQ(neighborsCountRef, neighborsCountCells);
+
+    std::vector<std::size_t> offsets, deltaOffsets;
+    std::vector<int> neighborsCsr;
+    std::vector<int16_t> deltas;
+    findNeighborsCsr<T, KeyType, SfcKind>(0, n, coords.x().data(), coords.y().data(), coords.z().data(), h.data(),
+                                          box, codes, n, offsets, neighborsCsr);
+    findNeighborsCsrDelta<T, KeyType, SfcKind>(0, n, coords.x().data(), coords.y().data(), coords.z().data(),
+                                               h.data(), box, codes, n, deltaOffsets, deltas);
+
+    EXPECT_EQ(offsets.back(), neighborsCsr.size());
+    for (int i = 0; i < n; ++i)
+    {
+        std::vector<int> probe(neighborsCsr.begin() + offsets[i], neighborsCsr.begin() + offsets[i + 1]);
+        std::vector<int> decoded;
+        forEachNeighborDelta(i, deltas.data() + deltaOffsets[i], deltas.data() + deltaOffsets[i + 1],
+                             [&decoded](int j) { decoded.push_back(j); });
+        std::sort(probe.begin(), probe.end());
+        std::sort(decoded.begin(), decoded.end());
+
+        std::vector<int> ref(neighborsRef.begin() + i * ngmax, neighborsRef.begin() + i * ngmax + neighborsCountRef[i]);
+        EXPECT_EQ(probe, ref);
+        EXPECT_EQ(decoded, ref);
+    }
+}
+
+//! @brief neighbor indices that are too far from the particle index for a 16-bit delta are stored in full
+TEST(FindNeighbors, neighborDeltaEncoding)
+{
+    int i = 100000;
+    std::vector<int> neighbors{i - 1, i + 32767, i - 32767, i - 32768, i + 32768, 0, 1 << 30};
+
+    std::vector<int16_t> deltas;
+    for (int j : neighbors)
+    {
+        deltas.resize(deltas.size() + neighborDeltaSize(i, j));
+        encodeNeighborDelta(i, j, deltas.data() + deltas.size() - neighborDeltaSize(i, j));
+    }
+    EXPECT_EQ(deltas.size(), 3 + 4 * 3);
+
+    std::vector<int> decoded;
+    forEachNeighborDelta(i, deltas.data(), deltas.data() + deltas.size(), [&decoded](int j) { decoded.push_back(j); });
+    EXPECT_EQ(decoded, neighbors);
 }
 
 class FindNeighborsRandom : public testing::TestWithParam<std::tuple<double, int, std::array<double, 6>, bool>>
@@ -305,7 +372,7 @@ public:
 
         CoordinateKind<double, KeyType> coords(nParticles, box);
 
-        neighborCheck(coords, radius, box);
+        neighborCheck<KeyType>(coords, radius, box);
     }
 };
 
@@ -317,6 +384,10 @@ TEST_P(FindNeighborsRandom, 32bitGaussian) { check<uint32_t, RandomGaussianCoord
 
 TEST_P(FindNeighborsRandom, 64bitGaussian) { check<uint64_t, RandomGaussianCoordinates>(); }
 
+TEST_P(FindNeighborsRandom, 32bitHilbertUniform) { check<HilbertKey<uint32_t>, RandomCoordinates>(); }
+
+TEST_P(FindNeighborsRandom, 64bitHilbertGaussian) { check<HilbertKey<uint64_t>, RandomGaussianCoordinates>(); }
+
 std::array<double, 2> radii{0.124, 0.0624};
 std::array<int, 1> nParticles{2500};
 std::array<std::array<double, 6>, 2> boxes{{{0., 1., 0., 1., 0., 1.}, {-1.2, 0.23, -0.213, 3.213, -5.1, 1.23}}};
@@ -329,3 +400,276 @@ INSTANTIATE_TEST_SUITE_P(RandomNeighbors, FindNeighborsRandom,
 INSTANTIATE_TEST_SUITE_P(RandomNeighborsLargeRadius, FindNeighborsRandom,
                          testing::Combine(testing::Values(3.0), testing::Values(500), testing::ValuesIn(boxes),
                                           testing::ValuesIn(pbcUsage)));
+
+//! @brief half lists keep pairs within [firstId:lastId] once and all pairs with particles outside the range
+TEST(FindNeighbors, halfNeighborList)
+{
+    using T       = double;
+    using KeyType = uint64_t;
+
+    int n = 2000;
+    Box<T> box{0, 1, true};
+    RandomGaussianCoordinates<T, KeyType> coords(n, box);
+    std::vector<T> h(n, 0.04);
+    const KeyType* codes = coords.mortonCodes().data();
+
+    int firstId = 500, lastId = 1500;
+    std::vector<std::size_t> offsets, halfOffsets;
+    std::vector<int> neighbors, halfNeighbors;
+    findNeighborsCsr(firstId, lastId, coords.x().data(), coords.y().data(), coords.z().data(), h.data(), box, codes, n,
+                     offsets, neighbors);
+    findNeighborsCsr(firstId, lastId, coords.x().data(), coords.y().data(), coords.z().data(), h.data(), box, codes, n,
+                     halfOffsets, halfNeighbors, true);
+
+    std::size_t numLocalPairs = 0, numHalfLocalPairs = 0;
+    for (int i = firstId; i < lastId; ++i)
+    {
+        std::vector<int> ref;
+        for (std::size_t k = offsets[i - firstId]; k < offsets[i - firstId + 1]; ++k)
+        {
+            int j      = neighbors[k];
+            bool local = firstId <= j && j < lastId;
+            numLocalPairs += local;
+            if (!local || j > i) { ref.push_back(j); }
+        }
+
+        std::vector<int> probe(halfNeighbors.begin() + halfOffsets[i - firstId],
+                               halfNeighbors.begin() + halfOffsets[i - firstId + 1]);
+        for (int j : probe)
+        {
+            numHalfLocalPairs += firstId <= j && j < lastId;
+        }
+        std::sort(ref.begin(), ref.end());
+        std::sort(probe.begin(), probe.end());
+        EXPECT_EQ(probe, ref);
+    }
+    EXPECT_EQ(2 * numHalfLocalPairs, numLocalPairs);
+}
+
+//! @brief smoothing lengths are iterated to the target count and the returned lists match a search with the final h
+TEST(FindNeighbors, targetNeighborCount)
+{
+    using T       = double;
+    using KeyType = uint64_t;
+
+    int n = 3000;
+    Box<T> box{0, 1, false};
+    RandomGaussianCoordinates<T, KeyType> coords(n, box);
+    std::vector<T> h(n, 0.01);
+    const KeyType* codes = coords.mortonCodes().data();
+
+    int firstId = 0, lastId = n, targetCount = 50, tolerance = 5;
+    std::vector<std::size_t> offsets, offsetsRef;
+    std::vector<int> neighbors, neighborsRef;
+    int numUnconverged = findNeighborsTargetCount(firstId, lastId, coords.x().data(), coords.y().data(),
+                                                  coords.z().data(), h.data(), box, codes, n, targetCount, tolerance,
+                                                  20, offsets, neighbors);
+    EXPECT_EQ(numUnconverged, 0);
+
+    findNeighborsCsr(firstId, lastId, coords.x().data(), coords.y().data(), coords.z().data(), h.data(), box, codes, n,
+                     offsetsRef, neighborsRef);
+    EXPECT_EQ(offsets, offsetsRef);
+
+    for (int i = firstId; i < lastId; ++i)
+    {
+        int count = offsets[i + 1] - offsets[i];
+        EXPECT_LE(std::abs(count - targetCount), tolerance);
+
+        std::sort(neighbors.begin() + offsets[i], neighbors.begin() + offsets[i + 1]);
+        std::sort(neighborsRef.begin() + offsetsRef[i], neighborsRef.begin() + offsetsRef[i + 1]);
+    }
+    EXPECT_EQ(neighbors, neighborsRef);
+
+    // a single iteration cannot reach the target from a much too small h
+    std::vector<T> hSmall(n, 0.001);
+    numUnconverged = findNeighborsTargetCount(firstId, lastId, coords.x().data(), coords.y().data(), coords.z().data(),
+                                              hSmall.data(), box, codes, n, targetCount, tolerance, 1, offsets,
+                                              neighbors);
+    EXPECT_GT(numUnconverged, 0);
+}
+
+//! @brief a Verlet list is reused for small displacements and remains exact after a reordering of particles
+TEST(FindNeighbors, verletList)
+{
+    using T       = double;
+    using KeyType = uint64_t;
+
+    int n = 1000;
+    Box<T> box{0, 1, true};
+    RandomCoordinates<T, KeyType> coords(n, box);
+
+    std::vector<T> x = coords.x(), y = coords.y(), z = coords.z();
+    std::vector<T> h(n, 0.05);
+    const KeyType* codes = coords.mortonCodes().data();
+
+    int firstId = 100, lastId = 900;
+    T skin      = 0.02;
+    VerletList<T, KeyType> verlet(skin);
+    EXPECT_TRUE(verlet.update(firstId, lastId, x.data(), y.data(), z.data(), h.data(), box, codes, n));
+
+    auto checkNeighbors = [&]()
+    {
+        int ngmax = n;
+        std::vector<int> neighborsRef(n * ngmax), neighborsCountRef(n);
+        all2allNeighbors(x.data(), y.data(), z.data(), h.data(), n, neighborsRef.data(), neighborsCountRef.data(),
+                         ngmax, box);
+        for (int i = firstId; i < lastId; ++i)
+        {
+            std::vector<int> probe;
+            verlet.forEachNeighbor(i, x.data(), y.data(), z.data(), h.data(), box,
+                                   [&probe](int j) { probe.push_back(j); });
+            std::sort(probe.begin(), probe.end());
+
+            std::vector<int> ref(neighborsRef.begin() + i * ngmax,
+                                 neighborsRef.begin() + i * ngmax + neighborsCountRef[i]);
+            std::sort(ref.begin(), ref.end());
+            EXPECT_EQ(probe, ref);
+        }
+    };
+
+    // displacements and h growth within the skin do not trigger a rebuild
+    for (int i = 0; i < n; ++i)
+    {
+        x[i] += (i % 2 ? 1 : -1) * 0.004;
+        z[i] += (i % 3 ? 1 : -1) * 0.003;
+        h[i] += 0.002;
+    }
+    EXPECT_FALSE(verlet.update(firstId, lastId, x.data(), y.data(), z.data(), h.data(), box, codes, n));
+    checkNeighbors();
+
+    // permute the particles in [200:600]
+    std::vector<LocalParticleIndex> ordering(400);
+    std::iota(ordering.rbegin(), ordering.rend(), 0);
+    std::swap(ordering[10], ordering[300]);
+    for (auto* array : {&x, &y, &z, &h})
+    {
+        std::vector<T> tmp(array->begin() + 200, array->begin() + 600);
+        for (std::size_t i = 0; i < ordering.size(); ++i)
+        {
+            (*array)[200 + i] = tmp[ordering[i]];
+        }
+    }
+    verlet.reorder(ordering.data(), ordering.size(), 200);
+    EXPECT_FALSE(verlet.needsRebuild(firstId, lastId, x.data(), y.data(), z.data(), h.data(), box, n));
+    checkNeighbors();
+
+    x[500] += 0.01;
+    EXPECT_TRUE(verlet.needsRebuild(firstId, lastId, x.data(), y.data(), z.data(), h.data(), box, n));
+    EXPECT_TRUE(verlet.needsRebuild(firstId + 1, lastId, x.data(), y.data(), z.data(), h.data(), box, n));
+
+    verlet.invalidate();
+    x[500] -= 0.01;
+    EXPECT_TRUE(verlet.needsRebuild(firstId, lastId, x.data(), y.data(), z.data(), h.data(), box, n));
+}
+
+//! @brief kNN queries match a brute force search, including queries across periodic boundaries
+template<class KeyType>
+void kNearestNeighbors(int n, int k, bool pbc)
+{
+    using T = double;
+
+    Box<T> box{-1, 1, pbc};
+    RandomGaussianCoordinates<T, KeyType> coords(n, box);
+    const KeyType* codes = coords.mortonCodes().data();
+
+    auto [tree, counts] = computeOctree(codes, codes + n, 16);
+    Octree<KeyType> octree;
+    octree.update(tree.begin(), tree.end());
+
+    std::vector<LocalParticleIndex> layout(counts.size() + 1, 0);
+    std::partial_sum(counts.begin(), counts.end(), layout.begin() + 1);
+
+    RandomCoordinates<T, KeyType> queries(100, box, 7);
+    std::size_t numQueries = queries.x().size();
+
+    std::vector<int> neighbors(numQueries * k);
+    std::vector<T> distancesSq(numQueries * k);
+    findKNearestNeighbors(octree, layout.data(), coords.x().data(), coords.y().data(), coords.z().data(), box,
+                          queries.x().data(), queries.y().data(), queries.z().data(), numQueries, k,
+                          neighbors.data(), distancesSq.data());
+
+    for (std::size_t q = 0; q < numQueries; ++q)
+    {
+        std::vector<std::tuple<T, int>> ref(n);
+        for (int j = 0; j < n; ++j)
+        {
+            ref[j] = {distanceSqPbc(queries.x()[q], queries.y()[q], queries.z()[q], coords.x()[j], coords.y()[j],
+                                    coords.z()[j], box),
+                      j};
+        }
+        std::sort(ref.begin(), ref.end());
+
+        for (int i = 0; i < k; ++i)
+        {
+            if (i < n)
+            {
+                EXPECT_EQ(neighbors[q * k + i], std::get<1>(ref[i]));
+                EXPECT_EQ(distancesSq[q * k + i], std::get<0>(ref[i]));
+            }
+            else { EXPECT_EQ(neighbors[q * k + i], -1); }
+        }
+    }
+}
+
+TEST(FindNeighbors, kNearestNeighbors)
+{
+    kNearestNeighbors<uint64_t>(2000, 32, false);
+    kNearestNeighbors<uint64_t>(2000, 32, true);
+    kNearestNeighbors<uint32_t>(2000, 1, true);
+    kNearestNeighbors<uint32_t>(20, 25, false);
+}
+
+//! @brief neighbors found with the compact coordinate mirror agree with the exact search up to the offset precision
+template<class OffsetType>
+void cellRelativeNeighbors(bool pbc, double tolerance)
+{
+    using T       = double;
+    using KeyType = uint64_t;
+
+    int n = 3000, ngmax = 300;
+    Box<T> box{0, 1, pbc};
+    RandomGaussianCoordinates<T, KeyType> coords(n, box);
+    std::vector<T> h(n, 0.03);
+    const T* x = coords.x().data();
+    const T* y = coords.y().data();
+    const T* z = coords.z().data();
+    const KeyType* codes = coords.mortonCodes().data();
+
+    auto [tree, counts] = computeOctree(codes, codes + n, 16);
+    Octree<KeyType> octree;
+    octree.update(tree.begin(), tree.end());
+
+    std::vector<LocalParticleIndex> layout(counts.size() + 1, 0);
+    std::partial_sum(counts.begin(), counts.end(), layout.begin() + 1);
+
+    std::vector<OffsetType> rx(n), ry(n), rz(n);
+    computeCellRelativeCoordinates(tree.data(), octree.numLeafNodes(), layout.data(), x, y, z, box, rx.data(),
+                                   ry.data(), rz.data());
+
+    std::vector<int> neighbors(n * ngmax), neighborsCount(n);
+    findNeighborsCellsRelative(octree, layout.data(), 0, octree.numLeafNodes(), rx.data(), ry.data(), rz.data(),
+                               h.data(), box, neighbors.data(), neighborsCount.data(), ngmax);
+
+    for (int i = 0; i < n; ++i)
+    {
+        std::vector<int> found(neighbors.begin() + i * ngmax, neighbors.begin() + i * ngmax + neighborsCount[i]);
+        std::sort(found.begin(), found.end());
+
+        T radius = 2 * h[i];
+        for (int j = 0; j < n; ++j)
+        {
+            if (j == i) { continue; }
+            T d = std::sqrt(distanceSqPbc(x[i], y[i], z[i], x[j], y[j], z[j], box));
+            bool isFound = std::binary_search(found.begin(), found.end(), j);
+            if (d < radius - tolerance) { EXPECT_TRUE(isFound); }
+            if (d > radius + tolerance) { EXPECT_FALSE(isFound); }
+        }
+    }
+}
+
+TEST(FindNeighbors, cellRelativeCoordinates)
+{
+    cellRelativeNeighbors<float>(false, 1e-7);
+    cellRelativeNeighbors<float>(true, 1e-7);
+    cellRelativeNeighbors<uint16_t>(true, 2e-5);
+}
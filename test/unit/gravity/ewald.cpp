@@ -0,0 +1,248 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for the Ewald corrections of fully periodic gravity
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <array>
+#include <numeric>
+
+#include "gtest/gtest.h"
+
+#include "cstone/gravity/ewald.hpp"
+#include "cstone/tree/octree.hpp"
+
+#include "coord_samples/random.hpp"
+
+namespace cstone
+{
+
+//! @brief the self-interaction of a particle in a cubic box is the Madelung constant of the simple cubic lattice
+TEST(Ewald, madelung)
+{
+    using T = double;
+    Box<T> box(0, 2, true);
+
+    EwaldValue<T> e = ewaldCorrection(T(0), T(0), T(0), box);
+    EXPECT_NEAR(e.phi, 2.837297479 / box.lx(), 1e-9);
+    EXPECT_NEAR(e.ax, 0.0, 1e-12);
+    EXPECT_NEAR(e.ay, 0.0, 1e-12);
+    EXPECT_NEAR(e.az, 0.0, 1e-12);
+}
+
+TEST(Ewald, splittingIndependent)
+{
+    double lx = 1.0, ly = 1.5, lz = 0.8;
+
+    std::vector<std::array<double, 3>> points{{0.1, 0.2, 0.3}, {-0.45, 0.7, 0.01}, {0.5, -0.75, 0.4}};
+    for (auto [x, y, z] : points)
+    {
+        auto a = detail::ewaldCorrection(x, y, z, lx, ly, lz, 2.0 / lz);
+        auto b = detail::ewaldCorrection(x, y, z, lx, ly, lz, 3.5 / lz);
+        EXPECT_NEAR(a.phi, b.phi, 1e-12);
+        EXPECT_NEAR(a.ax, b.ax, 1e-12);
+        EXPECT_NEAR(a.ay, b.ay, 1e-12);
+        EXPECT_NEAR(a.az, b.az, 1e-12);
+    }
+}
+
+//! @brief the periodic force vanishes half a box length from the source, the correction cancels the Newtonian one
+TEST(Ewald, symmetry)
+{
+    using T = double;
+    Box<T> box(0, 1.0, 0, 1.5, 0, 0.8, true, true, true);
+
+    EwaldValue<T> e = ewaldCorrection(box.lx() / 2, T(0), T(0), box);
+    EXPECT_NEAR(e.ax, 4.0 / (box.lx() * box.lx()), 1e-10);
+    EXPECT_NEAR(e.ay, 0.0, 1e-12);
+    EXPECT_NEAR(e.az, 0.0, 1e-12);
+
+    // acceleration is the negative gradient of the potential
+    T x = 0.2, y = -0.3, z = 0.15, h = 1e-5;
+    e   = ewaldCorrection(x, y, z, box);
+    T dphiX = ewaldCorrection(x + h, y, z, box).phi - ewaldCorrection(x - h, y, z, box).phi;
+    T dphiY = ewaldCorrection(x, y + h, z, box).phi - ewaldCorrection(x, y - h, z, box).phi;
+    T dphiZ = ewaldCorrection(x, y, z + h, box).phi - ewaldCorrection(x, y, z - h, box).phi;
+    EXPECT_NEAR(e.ax, -dphiX / (2 * h), 1e-7);
+    EXPECT_NEAR(e.ay, -dphiY / (2 * h), 1e-7);
+    EXPECT_NEAR(e.az, -dphiZ / (2 * h), 1e-7);
+
+    // correction of the image of a periodic displacement
+    EwaldValue<T> image = ewaldCorrection(x - box.lx(), y, z, box);
+    EXPECT_NEAR(image.ax - e.ax, (x - box.lx()) / std::pow(std::hypot(x - box.lx(), y, z), 3) -
+                                     x / std::pow(std::hypot(x, y, z), 3), 1e-10);
+}
+
+TEST(Ewald, table)
+{
+    using T = double;
+    Box<T> box(0, 1.0, 0, 1.5, 0, 0.8, true, true, true);
+
+    EXPECT_THROW(EwaldTable<T>(Box<T>(0, 1, 0, 1, 0, 1, true, true, false)), std::runtime_error);
+
+    EwaldTable<T> table(box);
+    EwaldTableView<T> view = table.view();
+
+    // scale of the correction half a box length away from the source
+    T scale = 4.0 / (box.minExtent() * box.minExtent());
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<T> dis(-1.5, 1.5);
+    for (int i = 0; i < 100; ++i)
+    {
+        T x = dis(gen), y = dis(gen), z = dis(gen);
+
+        T xi = x - box.lx() * std::rint(x / box.lx());
+        T yi = y - box.ly() * std::rint(y / box.ly());
+        T zi = z - box.lz() * std::rint(z / box.lz());
+
+        EwaldValue<T> ref = ewaldCorrection(xi, yi, zi, box);
+        EwaldValue<T> e   = view.correction(x, y, z);
+        EXPECT_NEAR(e.phi, ref.phi, 1e-3 * scale * box.minExtent());
+        EXPECT_NEAR(e.ax, ref.ax, 1e-3 * scale);
+        EXPECT_NEAR(e.ay, ref.ay, 1e-3 * scale);
+        EXPECT_NEAR(e.az, ref.az, 1e-3 * scale);
+    }
+}
+
+TEST(Ewald, cutLevel)
+{
+    EXPECT_EQ(ewaldCutLevel(Box<double>(0, 1, true), 0.25f), 2);
+    EXPECT_EQ(ewaldCutLevel(Box<double>(0, 1, true), 0.2f), 3);
+    EXPECT_EQ(ewaldCutLevel(Box<double>(0, 2, 0, 1, 0, 1, true, true, true), 0.25f), 3);
+}
+
+TEST(Ewald, straddlesImageBoundary)
+{
+    using KeyType   = uint64_t;
+    constexpr int R = 1 << maxTreeLevel<KeyType>{};
+    constexpr int l = R / 8;
+
+    IBox target(0, l);
+    EXPECT_FALSE(straddlesImageBoundary<KeyType>(target, target));
+    EXPECT_FALSE(straddlesImageBoundary<KeyType>(target, IBox(2 * l, 3 * l)));
+    EXPECT_FALSE(straddlesImageBoundary<KeyType>(target, IBox(7 * l, R)));
+    EXPECT_TRUE(straddlesImageBoundary<KeyType>(target, IBox(4 * l, 5 * l)));
+    EXPECT_TRUE(straddlesImageBoundary<KeyType>(target, IBox(0, l, 0, l, 3 * l, 5 * l)));
+}
+
+//! @brief Barnes-Hut with Ewald corrections compared to the direct sum over the nearest images plus exact corrections
+template<class KeyType>
+void periodicDirectSum()
+{
+    using T         = double;
+    constexpr int P = 2;
+
+    Box<T> box(0, 1, true);
+    int numParticles = 500;
+    RandomGaussianCoordinates<T, KeyType> coords(numParticles, box);
+
+    auto [leaves, counts] = computeOctree(coords.mortonCodes().data(),
+                                          coords.mortonCodes().data() + numParticles, 8);
+    Octree<KeyType> octree;
+    octree.update(leaves.begin(), leaves.end());
+
+    std::vector<LocalParticleIndex> layout(octree.numLeafNodes() + 1, 0);
+    std::inclusive_scan(counts.begin(), counts.end(), layout.begin() + 1);
+
+    const T* x = coords.x().data();
+    const T* y = coords.y().data();
+    const T* z = coords.z().data();
+    std::vector<T> m(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+    {
+        m[i] = (1.0 + i % 3) / numParticles;
+    }
+
+    Multipoles<T, P> multipoles;
+    computeMultipoles(octree, layout.data(), x, y, z, m.data(), box, multipoles);
+
+    T G = 1.0;
+    // the reference uses the same table, such that only the tree approximations are measured
+    EwaldTable<T> ewald(box, 16);
+    EwaldTableView<T> view = ewald.view();
+
+    std::vector<T> axRef(numParticles, 0), ayRef(numParticles, 0), azRef(numParticles, 0), phiRef(numParticles, 0);
+    #pragma omp parallel for
+    for (int i = 0; i < numParticles; ++i)
+    {
+        particle2ParticlePeriodic(x[i], y[i], z[i], x, y, z, m.data(), 0, numParticles, box.lx(), box.ly(), box.lz(),
+                                  T(0), axRef[i], ayRef[i], azRef[i], phiRef[i]);
+        for (int j = 0; j < numParticles; ++j)
+        {
+            EwaldValue<T> e = view.correction(x[i] - x[j], y[i] - y[j], z[i] - z[j]);
+            axRef[i] += m[j] * e.ax;
+            ayRef[i] += m[j] * e.ay;
+            azRef[i] += m[j] * e.az;
+            phiRef[i] += m[j] * e.phi;
+        }
+    }
+
+    std::vector<T> ax(numParticles), ay(numParticles), az(numParticles), phi(numParticles);
+    computeGravityPeriodic(octree, layout.data(), x, y, z, m.data(), multipoles.view(), box, 0.5, G, T(0), ewald,
+                           ax.data(), ay.data(), az.data(), phi.data());
+
+    T aRms = 0, phiRms = 0;
+    for (int i = 0; i < numParticles; ++i)
+    {
+        aRms += axRef[i] * axRef[i] + ayRef[i] * ayRef[i] + azRef[i] * azRef[i];
+        phiRms += phiRef[i] * phiRef[i];
+    }
+    aRms   = std::sqrt(aRms / numParticles);
+    phiRms = std::sqrt(phiRms / numParticles);
+
+    std::vector<T> errors(numParticles);
+    T px = 0, py = 0, pz = 0;
+    for (int i = 0; i < numParticles; ++i)
+    {
+        T dx = ax[i] - axRef[i];
+        T dy = ay[i] - ayRef[i];
+        T dz = az[i] - azRef[i];
+        errors[i] = std::sqrt(dx * dx + dy * dy + dz * dz) / aRms;
+        EXPECT_NEAR(phi[i], phiRef[i], 1e-2 * phiRms);
+
+        px += m[i] * ax[i];
+        py += m[i] * ay[i];
+        pz += m[i] * az[i];
+    }
+
+    std::sort(errors.begin(), errors.end());
+    EXPECT_LT(errors[numParticles / 2], 2e-3);
+    EXPECT_LT(errors.back(), 5e-3);
+
+    // the net force on the periodic system vanishes up to the approximation errors
+    EXPECT_LT(std::sqrt(px * px + py * py + pz * pz), 1e-3 * aRms);
+}
+
+TEST(Ewald, directSum)
+{
+    periodicDirectSum<unsigned>();
+    periodicDirectSum<uint64_t>();
+}
+
+} // namespace cstone
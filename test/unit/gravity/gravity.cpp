@@ -0,0 +1,219 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for the Barnes-Hut gravity interaction lists and kernels
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <numeric>
+
+#include "gtest/gtest.h"
+
+#include "cstone/gravity/gravity.hpp"
+#include "cstone/tree/octree.hpp"
+
+#include "coord_samples/random.hpp"
+
+namespace cstone
+{
+
+//! @brief the quadrupole expansion of a distant cluster has to match the direct sum up to third order terms
+TEST(Gravity, multipole2Particle)
+{
+    using T         = double;
+    constexpr int P = 2;
+
+    std::vector<T> x{0.0, 0.1, -0.1, 0.05}, y{0.0, 0.05, 0.1, -0.1}, z{0.1, -0.05, 0.0, 0.0}, m{1.0, 2.0, 1.5, 0.5};
+
+    Multipoles<T, P> multipoles;
+    multipoles.resize(1);
+    particle2Multipole(multipoles.view(), 0, x.data(), y.data(), z.data(), m.data(), 0, 4,
+                       ExpansionCenter<T>{0, 0, 0, 0});
+
+    T tx = 3.0, ty = -2.0, tz = 1.5;
+
+    T axRef = 0, ayRef = 0, azRef = 0, phiRef = 0;
+    particle2Particle(tx, ty, tz, x.data(), y.data(), z.data(), m.data(), 0, 4, T(0), axRef, ayRef, azRef, phiRef);
+
+    T axMono = 0, ayMono = 0, azMono = 0, phiMono = 0;
+    // the monopole is the first term, such that the moments can be viewed as an expansion of order zero
+    MultipoleView<T, P> view = multipoles.view();
+    MultipoleView<T, 0> monopole{view.x, view.y, view.z, view.moments, view.numNodes};
+    multipole2Particle(tx, ty, tz, monopole, 0, axMono, ayMono, azMono, phiMono);
+
+    T ax = 0, ay = 0, az = 0, phi = 0;
+    multipole2Particle(tx, ty, tz, multipoles.view(), 0, ax, ay, az, phi);
+
+    // the quadrupole terms have to reduce the monopole error substantially
+    EXPECT_LT(std::abs(phi - phiRef), 0.1 * std::abs(phiMono - phiRef));
+    EXPECT_LT(std::abs(ax - axRef), 0.1 * std::abs(axMono - axRef));
+    EXPECT_NEAR(phi, phiRef, 5e-5 * std::abs(phiRef));
+    EXPECT_NEAR(ax, axRef, 1e-4 * std::abs(axRef));
+    EXPECT_NEAR(ay, ayRef, 1e-4 * std::abs(ayRef));
+    EXPECT_NEAR(az, azRef, 1e-4 * std::abs(azRef));
+}
+
+//! @brief Barnes-Hut accelerations compared to direct summation
+template<class KeyType>
+void gravityDirectSum()
+{
+    using T         = double;
+    constexpr int P = 2;
+
+    Box<T> box(-1, 1);
+    int numParticles = 2000;
+    RandomGaussianCoordinates<T, KeyType> coords(numParticles, box);
+
+    auto [leaves, counts] = computeOctree(coords.mortonCodes().data(),
+                                          coords.mortonCodes().data() + numParticles, 16);
+    Octree<KeyType> octree;
+    octree.update(leaves.begin(), leaves.end());
+
+    std::vector<LocalParticleIndex> layout(octree.numLeafNodes() + 1, 0);
+    std::inclusive_scan(counts.begin(), counts.end(), layout.begin() + 1);
+
+    const T* x = coords.x().data();
+    const T* y = coords.y().data();
+    const T* z = coords.z().data();
+    std::vector<T> m(numParticles, 1.0 / numParticles);
+
+    Multipoles<T, P> multipoles;
+    computeMultipoles(octree, layout.data(), x, y, z, m.data(), box, multipoles);
+
+    T G   = 2.0;
+    T eps = 0.0;
+    std::vector<T> axRef(numParticles, 0), ayRef(numParticles, 0), azRef(numParticles, 0), phiRef(numParticles, 0);
+    for (int i = 0; i < numParticles; ++i)
+    {
+        particle2Particle(x[i], y[i], z[i], x, y, z, m.data(), 0, numParticles, eps, axRef[i], ayRef[i], azRef[i],
+                          phiRef[i]);
+    }
+
+    std::vector<T> ax(numParticles), ay(numParticles), az(numParticles), phi(numParticles);
+
+    // with a vanishing opening angle, all interactions are P2P
+    computeGravity(octree, layout.data(), x, y, z, m.data(), multipoles.view(), box, 1e-4, G, eps, ax.data(),
+                   ay.data(), az.data(), phi.data(), 7);
+    for (int i = 0; i < numParticles; ++i)
+    {
+        EXPECT_NEAR(ax[i], G * axRef[i], 1e-10 * std::abs(G * axRef[i]));
+        EXPECT_NEAR(phi[i], G * phiRef[i], 1e-10 * std::abs(G * phiRef[i]));
+    }
+
+    computeGravity(octree, layout.data(), x, y, z, m.data(), multipoles.view(), box, 0.5, G, eps, ax.data(),
+                   ay.data(), az.data(), phi.data());
+
+    std::vector<T> errors(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+    {
+        T dx = ax[i] - G * axRef[i];
+        T dy = ay[i] - G * ayRef[i];
+        T dz = az[i] - G * azRef[i];
+        T aRef = G * std::sqrt(axRef[i] * axRef[i] + ayRef[i] * ayRef[i] + azRef[i] * azRef[i]);
+        errors[i] = std::sqrt(dx * dx + dy * dy + dz * dz) / aRef;
+        EXPECT_NEAR(phi[i], G * phiRef[i], 1e-2 * std::abs(G * phiRef[i]));
+    }
+
+    std::sort(errors.begin(), errors.end());
+    EXPECT_LT(errors[numParticles / 2], 1e-3);
+    EXPECT_LT(errors.back(), 5e-2);
+}
+
+TEST(Gravity, directSum)
+{
+    gravityDirectSum<unsigned>();
+    gravityDirectSum<uint64_t>();
+}
+
+//! @brief P2P interactions with sources from the compact coordinate mirror agree with the full-precision evaluation
+template<class OffsetType>
+void relativeInteractionLists(double tolerance)
+{
+    using T         = double;
+    using KeyType   = uint64_t;
+    constexpr int P = 2;
+
+    Box<T> box(-1, 1);
+    int numParticles = 2000;
+    RandomGaussianCoordinates<T, KeyType> coords(numParticles, box);
+
+    auto [leaves, counts] = computeOctree(coords.mortonCodes().data(),
+                                          coords.mortonCodes().data() + numParticles, 16);
+    Octree<KeyType> octree;
+    octree.update(leaves.begin(), leaves.end());
+
+    std::vector<LocalParticleIndex> layout(octree.numLeafNodes() + 1, 0);
+    std::inclusive_scan(counts.begin(), counts.end(), layout.begin() + 1);
+
+    const T* x = coords.x().data();
+    const T* y = coords.y().data();
+    const T* z = coords.z().data();
+    std::vector<T> m(numParticles, 1.0 / numParticles);
+
+    std::vector<OffsetType> rx(numParticles), ry(numParticles), rz(numParticles);
+    computeCellRelativeCoordinates(leaves.data(), octree.numLeafNodes(), layout.data(), x, y, z, box, rx.data(),
+                                   ry.data(), rz.data());
+
+    Multipoles<T, P> multipoles;
+    computeMultipoles(octree, layout.data(), x, y, z, m.data(), box, multipoles);
+
+    GravityInteractionLists lists;
+    buildInteractionLists<T, P, KeyType, KeyType>(octree, multipoles.view(), box, 4.0f, 0, octree.numLeafNodes(),
+                                                  lists);
+
+    T G = 1.0, eps2 = 1e-6;
+    std::vector<T> axRef(numParticles), ayRef(numParticles), azRef(numParticles), phiRef(numParticles);
+    evaluateInteractionLists(lists, layout.data(), x, y, z, m.data(), multipoles.view(), G, eps2, axRef.data(),
+                             ayRef.data(), azRef.data(), phiRef.data());
+
+    std::vector<T> ax(numParticles), ay(numParticles), az(numParticles), phi(numParticles);
+    evaluateInteractionListsRelative(lists, leaves.data(), layout.data(), box, x, y, z, rx.data(), ry.data(),
+                                     rz.data(), m.data(), multipoles.view(), G, eps2, ax.data(), ay.data(), az.data(),
+                                     phi.data());
+
+    std::vector<T> errors(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+    {
+        T dx = ax[i] - axRef[i];
+        T dy = ay[i] - ayRef[i];
+        T dz = az[i] - azRef[i];
+        errors[i] = std::sqrt((dx * dx + dy * dy + dz * dz) /
+                              (axRef[i] * axRef[i] + ayRef[i] * ayRef[i] + azRef[i] * azRef[i]));
+        EXPECT_NEAR(phi[i], phiRef[i], tolerance * std::abs(phiRef[i]));
+    }
+
+    std::sort(errors.begin(), errors.end());
+    EXPECT_LT(errors[numParticles / 2], tolerance);
+}
+
+TEST(Gravity, relativeCoordinates)
+{
+    relativeInteractionLists<float>(1e-6);
+    relativeInteractionLists<uint16_t>(1e-3);
+}
+
+} // namespace cstone
@@ -0,0 +1,156 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for multipole moments of octree nodes
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <numeric>
+
+#include "gtest/gtest.h"
+
+#include "cstone/gravity/multipole.hpp"
+#include "cstone/tree/octree.hpp"
+#include "cstone/tree/octree_util.hpp"
+
+#include "coord_samples/random.hpp"
+
+namespace cstone
+{
+
+TEST(Multipole, termIndices)
+{
+    constexpr int P = 4;
+    std::vector<int> visited(multipoleNumTerms(P), 0);
+
+    for (int i = 0; i <= P; ++i)
+        for (int j = 0; j <= P - i; ++j)
+            for (int k = 0; k <= P - i - j; ++k)
+            {
+                visited[multipoleIndex(i, j, k)]++;
+            }
+
+    EXPECT_EQ(visited, std::vector<int>(multipoleNumTerms(P), 1));
+    EXPECT_EQ(multipoleIndex(0, 0, 0), 0);
+    EXPECT_EQ(multipoleIndex(1, 0, 0), 1);
+    EXPECT_EQ(multipoleIndex(0, 0, 1), 3);
+    EXPECT_EQ(multipoleNumTerms(2), 10);
+}
+
+//! @brief moments of a few particles about their center of mass
+TEST(Multipole, particle2Multipole)
+{
+    using T      = double;
+    constexpr int P = 2;
+
+    std::vector<T> x{0.0, 1.0, 0.5}, y{0.0, 0.0, 1.0}, z{0.0, 2.0, 0.0}, m{1.0, 2.0, 1.0};
+
+    Multipoles<T, P> multipoles;
+    multipoles.resize(1);
+    particle2Multipole(multipoles.view(), 0, x.data(), y.data(), z.data(), m.data(), 0, 3,
+                       ExpansionCenter<T>{0, 0, 0, 0});
+
+    T cx = 2.5 / 4, cy = 1.0 / 4, cz = 4.0 / 4;
+    EXPECT_DOUBLE_EQ(multipoles.centerX(0), cx);
+    EXPECT_DOUBLE_EQ(multipoles.centerY(0), cy);
+    EXPECT_DOUBLE_EQ(multipoles.centerZ(0), cz);
+
+    EXPECT_DOUBLE_EQ(multipoles.moment(0, 0, 0, 0), 4.0);
+    EXPECT_NEAR(multipoles.moment(0, 1, 0, 0), 0.0, 1e-14);
+    EXPECT_NEAR(multipoles.moment(0, 0, 1, 0), 0.0, 1e-14);
+    EXPECT_NEAR(multipoles.moment(0, 0, 0, 1), 0.0, 1e-14);
+
+    T mxz = 0, myy = 0;
+    for (int p = 0; p < 3; ++p)
+    {
+        mxz += m[p] * (x[p] - cx) * (z[p] - cz);
+        myy += m[p] * (y[p] - cy) * (y[p] - cy);
+    }
+    EXPECT_DOUBLE_EQ(multipoles.moment(0, 1, 0, 1), mxz);
+    EXPECT_DOUBLE_EQ(multipoles.moment(0, 0, 2, 0), myy);
+}
+
+//! @brief M2M shifted moments of each node have to match a direct P2M over all particles contained in the node
+template<class KeyType>
+void computeMultipolesUpsweep()
+{
+    using T         = double;
+    constexpr int P = 3;
+
+    Box<T> box(-1, 1);
+    int numParticles = 5000;
+    RandomGaussianCoordinates<T, KeyType> coords(numParticles, box);
+
+    auto [leaves, counts] = computeOctree(coords.mortonCodes().data(),
+                                          coords.mortonCodes().data() + numParticles, 64);
+    Octree<KeyType> octree;
+    octree.update(leaves.begin(), leaves.end());
+
+    std::vector<LocalParticleIndex> layout(octree.numLeafNodes() + 1, 0);
+    std::inclusive_scan(counts.begin(), counts.end(), layout.begin() + 1);
+
+    std::vector<T> m(numParticles);
+    for (int i = 0; i < numParticles; ++i) { m[i] = 1.0 + (i % 3); }
+
+    Multipoles<T, P> multipoles;
+    computeMultipoles(octree, layout.data(), coords.x().data(), coords.y().data(), coords.z().data(), m.data(), box,
+                      multipoles);
+
+    const KeyType* keys = coords.mortonCodes().data();
+    for (TreeNodeIndex node = 0; node < octree.numTreeNodes(); node += 7)
+    {
+        LocalParticleIndex first = std::lower_bound(keys, keys + numParticles, octree.codeStart(node)) - keys;
+        LocalParticleIndex last  = std::lower_bound(keys, keys + numParticles, octree.codeEnd(node)) - keys;
+
+        Multipoles<T, P> reference;
+        reference.resize(1);
+        particle2Multipole(reference.view(), 0, coords.x().data(), coords.y().data(), coords.z().data(), m.data(),
+                           first, last, ExpansionCenter<T>{0, 0, 0, 0});
+
+        T mass = reference.moment(0, 0, 0, 0);
+        EXPECT_NEAR(multipoles.moment(node, 0, 0, 0), mass, 1e-10);
+        if (mass == 0) { continue; }
+
+        EXPECT_NEAR(multipoles.centerX(node), reference.centerX(0), 1e-12);
+        EXPECT_NEAR(multipoles.centerY(node), reference.centerY(0), 1e-12);
+        EXPECT_NEAR(multipoles.centerZ(node), reference.centerZ(0), 1e-12);
+        for (int i = 0; i <= P; ++i)
+            for (int j = 0; j <= P - i; ++j)
+                for (int k = 0; k <= P - i - j; ++k)
+                {
+                    EXPECT_NEAR(multipoles.moment(node, i, j, k), reference.moment(0, i, j, k), 1e-10 * mass);
+                }
+    }
+}
+
+TEST(Multipole, computeMultipoles)
+{
+    computeMultipolesUpsweep<unsigned>();
+    computeMultipolesUpsweep<uint64_t>();
+}
+
+} // namespace cstone
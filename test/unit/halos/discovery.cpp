@@ -61,7 +61,7 @@ void findHalos()
     // size of one node is 0.25^3
     std::vector<double> interactionRadii(nNodes(tree), 0.1);
 
-    std::vector<pair<int>> refPairs0;
+    std::vector<pair<TreeNodeIndex>> refPairs0;
     for (std::size_t i = 0; i < nNodes(tree) / 2u; ++i)
         for (std::size_t j = nNodes(tree) / 2u; j < nNodes(tree); ++j)
         {
@@ -74,7 +74,7 @@ void findHalos()
     EXPECT_EQ(refPairs0.size(), 100);
 
     {
-        std::vector<pair<int>> testPairs0;
+        std::vector<pair<TreeNodeIndex>> testPairs0;
         findHalos<KeyType, double>(tree, interactionRadii, box, 0, 32, testPairs0);
         std::sort(begin(testPairs0), end(testPairs0));
 
@@ -88,7 +88,7 @@ void findHalos()
     std::sort(begin(refPairs1), end(refPairs1));
 
     {
-        std::vector<pair<int>> testPairs1;
+        std::vector<pair<TreeNodeIndex>> testPairs1;
         findHalos<KeyType, double>(tree, interactionRadii, box, 32, 64, testPairs1);
         std::sort(begin(testPairs1), end(testPairs1));
         EXPECT_EQ(testPairs1.size(), 100);
@@ -210,12 +210,12 @@ void findHalosFlags()
     // size of one node is 0.25^3
     std::vector<double> interactionRadii(nNodes(tree), 0.1);
 
-    std::vector<BinaryNode<KeyType>> binaryTree(nNodes(tree));
-    createBinaryTree(tree.data(), nNodes(tree), binaryTree.data());
+    Octree<KeyType> octree;
+    octree.update(tree.begin(), tree.end());
 
     {
         std::vector<int> collisionFlags(nNodes(tree), 0);
-        findHalos<KeyType, double>(tree, binaryTree, interactionRadii, box, 0, 32, collisionFlags.data());
+        findHalos<KeyType, double>(octree, interactionRadii, box, 0, 32, collisionFlags.data());
 
         std::vector<int> reference{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
                                    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 1, 1,
@@ -224,7 +224,7 @@ void findHalosFlags()
     }
     {
         std::vector<int> collisionFlags(nNodes(tree), 0);
-        findHalos<KeyType, double>(tree, binaryTree, interactionRadii, box, 32, 64, collisionFlags.data());
+        findHalos<KeyType, double>(octree, interactionRadii, box, 32, 64, collisionFlags.data());
 
         std::vector<int> reference{0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0, 1, 1,
                                    1, 1, 0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -281,3 +281,50 @@ TEST(Layout, extractMarkedElements)
         EXPECT_EQ(reqKeys, reference);
     }
 }
+
+/*! @brief halo search radii that exceed the capacity of a fixed collision list
+ *
+ * The halo pairs need to match a brute force overlap check of all node pairs.
+ */
+template<class KeyType>
+void findHalosLargeRadii()
+{
+    // 4096 nodes, 16 along each dimension
+    std::vector<KeyType> tree = makeUniformNLevelTree<KeyType>(4096, 1);
+
+    Box<double> box(0, 1);
+    std::vector<double> interactionRadii(nNodes(tree), 0.3);
+
+    TreeNodeIndex firstNode = 1024, lastNode = 2048;
+
+    std::vector<pair<TreeNodeIndex>> haloPairs;
+    findHalos<KeyType, double>(tree, interactionRadii, box, firstNode, lastNode, haloPairs);
+    std::sort(begin(haloPairs), end(haloPairs));
+
+    std::vector<pair<TreeNodeIndex>> reference;
+    for (TreeNodeIndex i = firstNode; i < lastNode; ++i)
+    {
+        IBox haloBox = makeHaloBox<double, double, KeyType>(tree[i], tree[i + 1], interactionRadii[i], box);
+        for (TreeNodeIndex j = 0; j < TreeNodeIndex(nNodes(tree)); ++j)
+        {
+            if (j >= firstNode && j < lastNode) { continue; }
+            IBox remoteBox = makeHaloBox<double, double, KeyType>(tree[j], tree[j + 1], interactionRadii[j], box);
+            if (overlap<KeyType>(tree[j], tree[j + 1], haloBox) && overlap<KeyType>(tree[i], tree[i + 1], remoteBox))
+            {
+                reference.emplace_back(i, j);
+            }
+        }
+    }
+
+    // the local node with the most collisions exceeds the former fixed collision list capacity of 512
+    std::vector<int> numCollisions(nNodes(tree), 0);
+    for (auto p : reference) { numCollisions[p[0]]++; }
+    EXPECT_GT(*std::max_element(begin(numCollisions), end(numCollisions)), 512);
+    EXPECT_EQ(haloPairs, reference);
+}
+
+TEST(HaloDiscovery, findHalosLargeRadii)
+{
+    findHalosLargeRadii<unsigned>();
+    findHalosLargeRadii<uint64_t>();
+}
@@ -0,0 +1,124 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for the CPU implementations of the accelerator primitives
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "cstone/primitives/accelerator.hpp"
+
+using namespace cstone;
+
+TEST(AcceleratorPrimitives, sortByKey)
+{
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> distribution(-1000, 1000);
+
+    std::size_t n = 10000;
+    std::vector<int> signedKeys(n);
+    std::generate(signedKeys.begin(), signedKeys.end(), [&]() { return distribution(gen); });
+    std::vector<uint64_t> keys(signedKeys.begin(), signedKeys.end());
+
+    // signed keys use a comparison sort
+    std::vector<int> signedRef = signedKeys;
+    std::vector<unsigned> signedValues(n);
+    std::iota(signedValues.begin(), signedValues.end(), 0);
+    sortByKey(CpuTag{}, signedKeys.data(), signedValues.data(), n);
+    std::sort(signedRef.begin(), signedRef.end());
+    EXPECT_EQ(signedKeys, signedRef);
+
+    // unsigned keys use the radix sort
+    std::vector<uint64_t> original = keys;
+    std::vector<int> values(n);
+    std::iota(values.begin(), values.end(), 0);
+    sortByKey(CpuTag{}, keys.data(), values.data(), n);
+
+    EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        EXPECT_EQ(keys[i], original[values[i]]);
+    }
+}
+
+TEST(AcceleratorPrimitives, scans)
+{
+    std::size_t n = 100000;
+    std::vector<uint64_t> in(n);
+    std::iota(in.begin(), in.end(), 1);
+
+    std::vector<uint64_t> ref(n), probe(n);
+    std::exclusive_scan(in.begin(), in.end(), ref.begin(), uint64_t(0));
+    exclusiveScan(CpuTag{}, in.data(), probe.data(), n);
+    EXPECT_EQ(probe, ref);
+
+    probe = in;
+    exclusiveScan(CpuTag{}, probe.data(), probe.data(), n);
+    EXPECT_EQ(probe, ref);
+
+    std::inclusive_scan(in.begin(), in.end(), ref.begin());
+    inclusiveScan(CpuTag{}, in.data(), probe.data(), n);
+    EXPECT_EQ(probe, ref);
+}
+
+TEST(AcceleratorPrimitives, minMax)
+{
+    std::vector<double> in{3.0, -1.5, 8.0, 2.0, 7.5};
+    auto [minimum, maximum] = minMax(CpuTag{}, in.data(), in.size());
+    EXPECT_EQ(minimum, -1.5);
+    EXPECT_EQ(maximum, 8.0);
+}
+
+TEST(AcceleratorPrimitives, gatherScatter)
+{
+    std::vector<unsigned> map{3, 0, 4, 1, 2};
+    std::vector<double> in{10, 11, 12, 13, 14};
+
+    std::vector<double> gathered(map.size());
+    gatherValues(CpuTag{}, map.data(), map.size(), in.data(), gathered.data());
+    EXPECT_EQ(gathered, (std::vector<double>{13, 10, 14, 11, 12}));
+
+    std::vector<double> scattered(map.size());
+    scatterValues(CpuTag{}, map.data(), map.size(), gathered.data(), scattered.data());
+    EXPECT_EQ(scattered, in);
+}
+
+TEST(AcceleratorPrimitives, segmentedReduce)
+{
+    std::vector<double> values{1, 2, 3, 4, 5, 6};
+    std::vector<unsigned> offsets{0, 2, 2, 5, 6};
+
+    std::vector<double> sums(offsets.size() - 1);
+    segmentedReduce(CpuTag{}, values.data(), offsets.data(), sums.size(), sums.data());
+    EXPECT_EQ(sums, (std::vector<double>{3, 0, 12, 6}));
+}
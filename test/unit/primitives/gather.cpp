@@ -29,6 +29,10 @@
  * @author Sebastian Keller <sebastian.f.keller@gmail.com>
  */
 
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <random>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -96,4 +100,178 @@ TEST(GatherCpu, CpuGather)
     CpuGatherTest<float, uint64_t, uint64_t>();
     CpuGatherTest<double, unsigned, uint64_t>();
     CpuGatherTest<double, uint64_t, uint64_t>();
-}
\ No newline at end of file
+}
+
+TEST(GatherCpu, gatherArrays)
+{
+    std::size_t numElements = 5000;
+    std::vector<unsigned> ordering(numElements);
+    std::iota(begin(ordering), end(ordering), 0);
+    std::shuffle(begin(ordering), end(ordering), std::mt19937(42));
+
+    std::vector<double> a(numElements), b(numElements);
+    std::iota(begin(a), end(a), 0);
+    std::iota(begin(b), end(b), numElements);
+
+    std::vector<double> aOut(numElements), bOut(numElements);
+    const double* sources[2] = {a.data(), b.data()};
+    double* destinations[2]  = {aOut.data(), bOut.data()};
+    gatherArrays(ordering.data(), numElements, sources, destinations, 2);
+
+    for (std::size_t i = 0; i < numElements; ++i)
+    {
+        EXPECT_EQ(aOut[i], a[ordering[i]]);
+        EXPECT_EQ(bOut[i], b[ordering[i]]);
+    }
+}
+
+//! @brief reorder a subrange of multiple vectors and check that the elements outside the range are preserved
+TEST(GatherCpu, CpuGatherMultipleVectors)
+{
+    std::vector<unsigned> codes{0, 50, 1, 6, 20, 2};
+    std::size_t offset = 2;
+
+    std::vector<double> x{-1, -2, 0, 1, 2, 3, 4, 5, -3};
+    std::vector<double> y{-4, -5, 6, 7, 8, 9, 10, 11, -6};
+
+    CpuGather<double, unsigned, unsigned> cpuGather;
+    cpuGather.setMapFromCodes(codes.data(), codes.data() + codes.size());
+
+    for (int iteration = 0; iteration < 2; ++iteration)
+    {
+        std::array<std::vector<double>*, 2> arrays{&x, &y};
+        cpuGather(arrays.data(), 2, offset);
+    }
+
+    // applying the ordering {0,2,5,3,4,1} twice yields {0,5,1,3,4,2}
+    std::vector<double> xRef{-1, -2, 0, 5, 1, 3, 4, 2, -3};
+    std::vector<double> yRef{-4, -5, 6, 11, 7, 9, 10, 8, -6};
+    EXPECT_EQ(x, xRef);
+    EXPECT_EQ(y, yRef);
+}
+/*! @brief sort keys with @p numDisplaced randomly displaced elements and check the result
+ *
+ * @return  true if the incremental path was used
+ */
+template<class KeyType>
+bool nearlySorted(std::size_t numElements, std::size_t numDisplaced, float maxDisorder)
+{
+    std::mt19937 gen(42);
+    std::vector<KeyType> keys(numElements);
+    std::iota(begin(keys), end(keys), 0);
+    std::for_each(begin(keys), end(keys), [](KeyType& k) { k *= 3; });
+
+    std::uniform_int_distribution<std::size_t> pick(0, numElements - 1);
+    for (std::size_t i = 0; i < numDisplaced; ++i)
+    {
+        // alternating spikes and dips
+        keys[pick(gen)] = (i % 2) ? keys.back() + i : i;
+    }
+
+    std::vector<KeyType> refKeys = keys;
+    std::sort(begin(refKeys), end(refKeys));
+
+    std::vector<KeyType> inputKeys = keys;
+    std::vector<unsigned> ordering(numElements);
+    std::iota(begin(ordering), end(ordering), 0);
+
+    std::vector<KeyType> keyBuffer(numElements);
+    std::vector<unsigned> valueBuffer(numElements);
+    bool incremental = sortNearlySortedByKey(keys.data(), ordering.data(), numElements, keyBuffer.data(),
+                                             valueBuffer.data(), maxDisorder);
+
+    EXPECT_EQ(keys, refKeys);
+    for (std::size_t i = 0; i < numElements; ++i)
+    {
+        EXPECT_EQ(keys[i], inputKeys[ordering[i]]);
+    }
+    std::sort(begin(ordering), end(ordering));
+    for (std::size_t i = 0; i < numElements; ++i)
+    {
+        EXPECT_EQ(ordering[i], i);
+    }
+
+    return incremental;
+}
+
+TEST(GatherCpu, sortNearlySorted)
+{
+    EXPECT_TRUE(nearlySorted<unsigned>(1000, 0, 0.1));
+    EXPECT_TRUE(nearlySorted<unsigned>(1000, 1, 0.1));
+    EXPECT_TRUE(nearlySorted<unsigned>(10000, 50, 0.1));
+    EXPECT_TRUE(nearlySorted<uint64_t>(10000, 50, 0.1));
+
+    // disorder above threshold falls back to a full sort
+    EXPECT_FALSE(nearlySorted<unsigned>(1000, 200, 0.05));
+    EXPECT_FALSE(nearlySorted<uint64_t>(1000, 10, 0));
+}
+
+TEST(GatherCpu, sortNearlySortedOverflow)
+{
+    // a single descent, but all keys after the block of large keys are out of order
+    std::vector<unsigned> keys{0, 1, 100, 101, 102, 2, 3, 4, 5, 6, 7, 8};
+    std::vector<unsigned> ordering{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+    std::vector<unsigned> keyBuffer(keys.size()), valueBuffer(keys.size());
+    bool incremental = sortNearlySortedByKey(keys.data(), ordering.data(), keys.size(), keyBuffer.data(),
+                                             valueBuffer.data(), 0.25);
+
+    std::vector<unsigned> refKeys{0, 1, 2, 3, 4, 5, 6, 7, 8, 100, 101, 102};
+    std::vector<unsigned> refOrdering{0, 1, 5, 6, 7, 8, 9, 10, 11, 2, 3, 4};
+    EXPECT_FALSE(incremental);
+    EXPECT_EQ(keys, refKeys);
+    EXPECT_EQ(ordering, refOrdering);
+}
+
+TEST(GatherCpu, mergeByKey)
+{
+    // more elements than one merge chunk
+    std::size_t numA = 50000, numB = 30000;
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<unsigned> dist(0, 100000);
+
+    std::vector<unsigned> keysA(numA), keysB(numB);
+    std::generate(begin(keysA), end(keysA), [&]() { return dist(gen); });
+    std::generate(begin(keysB), end(keysB), [&]() { return dist(gen); });
+    std::sort(begin(keysA), end(keysA));
+    std::sort(begin(keysB), end(keysB));
+
+    std::vector<int> valuesA(numA, 0), valuesB(numB, 1);
+
+    std::vector<unsigned> keys(numA + numB);
+    std::vector<int> values(numA + numB);
+    mergeByKey(keysA.data(), valuesA.data(), numA, keysB.data(), valuesB.data(), numB, keys.data(), values.data());
+
+    std::vector<unsigned> refKeys;
+    std::merge(begin(keysA), end(keysA), begin(keysB), end(keysB), std::back_inserter(refKeys));
+    EXPECT_EQ(keys, refKeys);
+
+    // elements of the first sequence precede equal keys of the second
+    for (std::size_t i = 1; i < keys.size(); ++i)
+    {
+        if (keys[i] == keys[i - 1]) { EXPECT_LE(values[i - 1], values[i]); }
+    }
+}
+
+TEST(GatherCpu, mergeSortedSegments)
+{
+    std::vector<unsigned> keys{2, 5, 9, 1, 3, 0, 4, 8, 10, 6, 7, 7, 11};
+    std::vector<std::size_t> segments{0, 3, 5, 5, 9, 13};
+    std::vector<unsigned> ordering(keys.size());
+    std::iota(begin(ordering), end(ordering), 0);
+
+    std::vector<unsigned> inputKeys = keys;
+    std::vector<unsigned> keyBuffer(keys.size()), valueBuffer(keys.size());
+    mergeSortedSegmentsByKey(keys.data(), ordering.data(), segments.data(), segments.size() - 1, keyBuffer.data(),
+                             valueBuffer.data());
+
+    std::vector<unsigned> refKeys = inputKeys;
+    std::sort(begin(refKeys), end(refKeys));
+    EXPECT_EQ(keys, refKeys);
+    for (std::size_t i = 0; i < keys.size(); ++i)
+    {
+        EXPECT_EQ(keys[i], inputKeys[ordering[i]]);
+    }
+    EXPECT_EQ(ordering[7], 10);
+    EXPECT_EQ(ordering[8], 11);
+}
@@ -0,0 +1,104 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for the CPU radix sort
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "cstone/primitives/radix_sort.hpp"
+
+using namespace cstone;
+
+/*! @brief compare radix sort against std::stable_sort
+ *
+ * @param keyMask  random keys are and-ed with mask, zero bits in the mask result in skipped passes
+ * @param keyBase  common prefix added to all keys
+ */
+template<class KeyType, class ValueType>
+void radixSortRandom(std::size_t numElements, KeyType keyMask, KeyType keyBase)
+{
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<KeyType> distribution(0, std::numeric_limits<KeyType>::max());
+
+    std::vector<KeyType> keys(numElements);
+    std::generate(begin(keys), end(keys), [&]() { return keyBase + (distribution(gen) & keyMask); });
+
+    std::vector<ValueType> ordering(numElements);
+    std::iota(begin(ordering), end(ordering), 0);
+
+    std::vector<ValueType> refOrdering = ordering;
+    std::stable_sort(begin(refOrdering), end(refOrdering), [&keys](ValueType a, ValueType b) { return keys[a] < keys[b]; });
+
+    std::vector<KeyType> refKeys(numElements);
+    for (std::size_t i = 0; i < numElements; ++i)
+    {
+        refKeys[i] = keys[refOrdering[i]];
+    }
+
+    radixSortByKey(keys.data(), ordering.data(), numElements);
+
+    EXPECT_EQ(keys, refKeys);
+    EXPECT_EQ(ordering, refOrdering);
+}
+
+TEST(RadixSort, random32)
+{
+    radixSortRandom<unsigned, unsigned>(100000, ~0u, 0);
+    radixSortRandom<unsigned, uint64_t>(10000, ~0u, 0);
+}
+
+TEST(RadixSort, random64)
+{
+    radixSortRandom<uint64_t, unsigned>(100000, ~uint64_t(0), 0);
+    radixSortRandom<uint64_t, int>(10000, ~uint64_t(0), 0);
+}
+
+TEST(RadixSort, commonPrefix)
+{
+    // keys of a single rank with a shared prefix, 3 of the 8 passes are performed
+    radixSortRandom<uint64_t, unsigned>(100000, 0xffffff, uint64_t(0x4a3) << 40);
+    // one pass, result needs to be copied back from the buffer
+    radixSortRandom<unsigned, unsigned>(1000, 0x0000ff00, 0x80000000);
+    // many duplicates, checks stability
+    radixSortRandom<unsigned, unsigned>(1000, 0x7, 0);
+}
+
+TEST(RadixSort, degenerate)
+{
+    radixSortRandom<unsigned, unsigned>(0, ~0u, 0);
+    radixSortRandom<unsigned, unsigned>(1, ~0u, 0);
+    // all keys identical, no passes
+    radixSortRandom<uint64_t, unsigned>(100, 0, 12345);
+}
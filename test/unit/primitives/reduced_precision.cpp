@@ -0,0 +1,76 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests of the reduced precision transfer types
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "cstone/primitives/reduced_precision.hpp"
+
+using namespace cstone;
+
+TEST(ReducedPrecision, bfloat16)
+{
+    // exactly representable values
+    for (float v : {0.0f, 1.0f, -2.0f, 0.5f, 384.0f, -std::numeric_limits<float>::infinity()})
+    {
+        EXPECT_EQ(float(BFloat16(v)), v);
+    }
+
+    // 1 + 2^-8 is half way between 1 and 1 + 2^-7, ties round to the even mantissa 1
+    EXPECT_EQ(float(BFloat16(1.0f + 1.0f / 256)), 1.0f);
+    // 1 + 3 * 2^-8 is half way between 1 + 2^-7 and 1 + 2^-6, ties round to the even mantissa 1 + 2^-6
+    EXPECT_EQ(float(BFloat16(1.0f + 3.0f / 256)), 1.0f + 1.0f / 64);
+    EXPECT_EQ(float(BFloat16(1.0f + 1.1f / 256)), 1.0f + 1.0f / 128);
+
+    for (float v : {3.14159f, 1e-20f, -6.02e23f})
+    {
+        EXPECT_NEAR(float(BFloat16(v)), v, std::abs(v) / 256);
+    }
+
+    EXPECT_TRUE(std::isnan(float(BFloat16(std::numeric_limits<float>::quiet_NaN()))));
+}
+
+TEST(ReducedPrecision, traits)
+{
+    std::vector<double> rho(4);
+
+    auto wrapped = reducedPrecision<BFloat16>(rho.data());
+    EXPECT_EQ(arrayData(wrapped), rho.data());
+    EXPECT_EQ(reducedPrecision<float>(rho).data().data, rho.data());
+    EXPECT_EQ(reducedPrecision<float>(rho).size(), rho.size());
+
+    static_assert(transferElementSize<double*, ReducedPrecision<float, double>, decltype(wrapped), int*>() == 18);
+    static_assert(areHaloArrays<double*, decltype(wrapped)>);
+    static_assert(!areHaloArrays<double*, std::vector<double>>);
+}
@@ -0,0 +1,111 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests of the variable-length integer codec
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "cstone/primitives/varint.hpp"
+#include "cstone/tree/octree_util.hpp"
+
+using namespace cstone;
+
+TEST(Varint, singleValues)
+{
+    std::vector<uint64_t> values{0, 1, 127, 128, 16383, 16384, (1ul << 32) - 1, std::numeric_limits<uint64_t>::max()};
+    std::vector<std::size_t> numBytes{1, 1, 1, 2, 2, 3, 5, 10};
+
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+        uint8_t buffer[maxVarintBytes<uint64_t>()];
+        uint8_t* end = encodeVarint(values[i], buffer);
+        EXPECT_EQ(std::size_t(end - buffer), numBytes[i]);
+
+        uint64_t probe;
+        EXPECT_EQ(decodeVarint(buffer, probe), end);
+        EXPECT_EQ(probe, values[i]);
+    }
+}
+
+template<class KeyType>
+void sortedKeysRoundTrip()
+{
+    std::vector<KeyType> keys = makeUniformNLevelTree<KeyType>(4096, 1);
+
+    std::vector<uint8_t> bytes;
+    encodeSortedKeys<KeyType>(keys, bytes);
+    // apart from the first and last key, all differences are those of level-4 nodes, which take at most 3 bytes
+    EXPECT_LT(bytes.size(), keys.size() * sizeof(KeyType));
+
+    std::vector<KeyType> probe(keys.size());
+    EXPECT_EQ(decodeSortedKeys<KeyType>(bytes, probe), keys.size());
+    EXPECT_EQ(probe, keys);
+
+    // repeated keys, maximum key
+    keys = {0, 0, 5, nodeRange<KeyType>(0) - 1, nodeRange<KeyType>(0)};
+    encodeSortedKeys<KeyType>(keys, bytes);
+    probe.resize(keys.size());
+    EXPECT_EQ(decodeSortedKeys<KeyType>(bytes, probe), keys.size());
+    EXPECT_EQ(probe, keys);
+
+    encodeSortedKeys<KeyType>(gsl::span<const KeyType>{}, bytes);
+    EXPECT_TRUE(bytes.empty());
+    EXPECT_EQ(decodeSortedKeys<KeyType>(bytes, probe), 0);
+}
+
+TEST(Varint, sortedKeys)
+{
+    sortedKeysRoundTrip<unsigned>();
+    sortedKeysRoundTrip<uint64_t>();
+}
+
+TEST(Varint, values)
+{
+    std::mt19937 gen(42);
+    std::geometric_distribution<unsigned> smallCounts(0.05);
+
+    std::vector<unsigned> values(1000);
+    for (auto& v : values)
+    {
+        v = smallCounts(gen);
+    }
+    values.push_back(std::numeric_limits<unsigned>::max());
+
+    std::vector<uint8_t> bytes;
+    encodeValues<unsigned>(values, bytes);
+    EXPECT_LT(bytes.size(), values.size() * 2);
+
+    std::vector<unsigned> probe(values.size());
+    EXPECT_EQ(decodeValues<unsigned>(bytes.data(), probe), bytes.data() + bytes.size());
+    EXPECT_EQ(probe, values);
+}
@@ -29,6 +29,8 @@
  * @author Sebastian Keller <sebastian.f.keller@gmail.com>
  */
 
+#include <tuple>
+
 #include "gtest/gtest.h"
 #include "cstone/sfc/box.hpp"
 
@@ -57,4 +59,40 @@ TEST(SfcBox, pbcDistance)
     EXPECT_EQ(pbcDistance<1024>(512), 512);
     EXPECT_EQ(pbcDistance<1024>(513), -511);
     EXPECT_EQ(pbcDistance<1024>(1024), 0);
-}
\ No newline at end of file
+}
+TEST(SfcBox, dispatchPbc)
+{
+    auto periodicity = [](const auto& box)
+    {
+        constexpr bool isStatic = !std::is_same_v<std::decay_t<decltype(box)>, Box<double>>;
+        return std::make_tuple(isStatic, box.pbcX(), box.pbcY(), box.pbcZ());
+    };
+
+    EXPECT_EQ(dispatchPbc(Box<double>(0, 1), periodicity), std::make_tuple(true, false, false, false));
+    EXPECT_EQ(dispatchPbc(Box<double>(0, 1, true), periodicity), std::make_tuple(true, true, true, true));
+    EXPECT_EQ(dispatchPbc(Box<double>(0, 1, 0, 1, 0, 1, true, false, true), periodicity),
+              std::make_tuple(false, true, false, true));
+
+    StaticPbcBox<double, true, true, true> staticBox(Box<double>(0, 2, true));
+    static_assert(staticBox.pbcX() && staticBox.pbcY() && staticBox.pbcZ());
+    EXPECT_EQ(staticBox.lx(), 2.0);
+}
+
+TEST(SfcBox, makeCubicBox)
+{
+    {
+        Box<double> box(0, 16, 0, 1, -1, 1);
+        Box<double> cubic = makeCubicBox(box);
+        EXPECT_EQ(cubic, Box<double>(0, 16, -7.5, 8.5, -8, 8));
+    }
+    {
+        // periodic dimensions keep their limits
+        Box<double> box(0, 16, 0, 1, 0, 1, false, true, false);
+        Box<double> cubic = makeCubicBox(box);
+        EXPECT_EQ(cubic, Box<double>(0, 16, 0, 1, -7.5, 8.5, false, true, false));
+    }
+    {
+        Box<double> box(-1, 1, true);
+        EXPECT_EQ(makeCubicBox(box), box);
+    }
+}
@@ -0,0 +1,199 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Test Hilbert key implementation
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "cstone/halos/boxoverlap.hpp"
+#include "cstone/sfc/sfc.hpp"
+
+using namespace cstone;
+
+template<class KeyType>
+void hilbertRoundTrip()
+{
+    constexpr unsigned maxCoord = 1u << maxTreeLevel<KeyType>{};
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<unsigned> distribution(0, maxCoord - 1);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        unsigned ix = distribution(gen);
+        unsigned iy = distribution(gen);
+        unsigned iz = distribution(gen);
+
+        KeyType key = iHilbert<KeyType>(ix, iy, iz);
+        EXPECT_LT(key, nodeRange<KeyType>(0));
+
+        unsigned px, py, pz;
+        idecodeHilbert(key, px, py, pz);
+        EXPECT_EQ(ix, px);
+        EXPECT_EQ(iy, py);
+        EXPECT_EQ(iz, pz);
+    }
+}
+
+TEST(HilbertCode, roundTrip)
+{
+    hilbertRoundTrip<unsigned>();
+    hilbertRoundTrip<uint64_t>();
+}
+
+TEST(HilbertCode, origin)
+{
+    EXPECT_EQ(iHilbert<unsigned>(0, 0, 0), 0);
+    EXPECT_EQ(iHilbert<uint64_t>(0, 0, 0), 0);
+}
+
+/*! @brief consecutive octree nodes along the Hilbert curve are face neighbors
+ *
+ * Also checks that each node at a given level is a contiguous key range
+ */
+template<class KeyType>
+void hilbertNodeAdjacency()
+{
+    for (unsigned level = 1; level <= 4; ++level)
+    {
+        int edgeLength   = 1u << (maxTreeLevel<KeyType>{} - level);
+        KeyType numNodes = KeyType(1) << (3 * level);
+
+        IBox previous = hilbertIBox(KeyType(0), level);
+        EXPECT_EQ(previous, IBox(0, edgeLength));
+
+        for (KeyType i = 1; i < numNodes; ++i)
+        {
+            KeyType nodeStart = i * nodeRange<KeyType>(level);
+            IBox node         = hilbertIBox(nodeStart, level);
+
+            int distance = std::abs(node.xmin() - previous.xmin()) + std::abs(node.ymin() - previous.ymin()) +
+                           std::abs(node.zmin() - previous.zmin());
+            EXPECT_EQ(distance, edgeLength);
+
+            // the last key of the node lies in the same node
+            EXPECT_EQ(node, hilbertIBox(KeyType(nodeStart + nodeRange<KeyType>(level) - 1), level));
+
+            previous = node;
+        }
+    }
+}
+
+TEST(HilbertCode, nodeAdjacency)
+{
+    hilbertNodeAdjacency<unsigned>();
+    hilbertNodeAdjacency<uint64_t>();
+}
+
+//! @brief binary nodes with prefix lengths that are not multiples of 3 are boxes covering 2 or 4 octants
+template<class KeyType>
+void hilbertBinaryNodeBox()
+{
+    using SfcKind = HilbertKey<KeyType>;
+
+    unsigned level = 2;
+    for (int remainder = 1; remainder < 3; ++remainder)
+    {
+        int prefixLength = 3 * level + remainder;
+        KeyType range    = KeyType(1) << (3 * maxTreeLevel<KeyType>{} - prefixLength);
+
+        for (KeyType prefix = 0; prefix < nodeRange<KeyType>(0); prefix += range)
+        {
+            IBox box = sfcIBox<SfcKind>(prefix, prefixLength);
+
+            int volume = (box.xmax() - box.xmin()) * (box.ymax() - box.ymin()) * (box.zmax() - box.zmin());
+            int octantLength = 1u << (maxTreeLevel<KeyType>{} - level - 1);
+            EXPECT_EQ(volume, (8 >> remainder) * octantLength * octantLength * octantLength);
+
+            // containment is resolved conservatively at octree node granularity
+            KeyType parent = enclosingBoxCode(prefix, level);
+            EXPECT_TRUE((containedIn<KeyType, SfcKind>(parent, parent + nodeRange<KeyType>(level), box)));
+        }
+    }
+}
+
+TEST(HilbertCode, binaryNodeBox)
+{
+    hilbertBinaryNodeBox<unsigned>();
+    hilbertBinaryNodeBox<uint64_t>();
+}
+
+template<class KeyType>
+void hilbertNeighbor()
+{
+    using SfcKind = HilbertKey<KeyType>;
+
+    unsigned level = 3;
+    int edgeLength = 1u << (maxTreeLevel<KeyType>{} - level);
+
+    KeyType key = iHilbert<KeyType>(2 * edgeLength, 5 * edgeLength, 7 * edgeLength);
+    KeyType nodeStart = enclosingBoxCode(key, level);
+
+    // step in x
+    EXPECT_EQ(hilbertIBox(sfcNeighbor<SfcKind>(nodeStart, level, 1, 0, 0), level),
+              IBox(3 * edgeLength, 4 * edgeLength, 5 * edgeLength, 6 * edgeLength, 7 * edgeLength, 8 * edgeLength));
+
+    // step in z across the upper boundary with PBC
+    EXPECT_EQ(hilbertIBox(sfcNeighbor<SfcKind>(nodeStart, level, 0, -1, 1), level),
+              IBox(2 * edgeLength, 3 * edgeLength, 4 * edgeLength, 5 * edgeLength, 0, edgeLength));
+
+    // without PBC, the z-step is discarded
+    EXPECT_EQ(hilbertIBox(sfcNeighbor<SfcKind>(nodeStart, level, 0, 0, 1, false, false, false), level),
+              hilbertIBox(nodeStart, level));
+
+    // Morton and Hilbert neighbors agree in space
+    KeyType mortonStart = imorton3D<KeyType>(2 * edgeLength, 5 * edgeLength, 7 * edgeLength);
+    EXPECT_EQ(sfcIBox<KeyType>(sfcNeighbor<KeyType>(mortonStart, level, -1, 1, 0), 3 * level),
+              hilbertIBox(sfcNeighbor<SfcKind>(nodeStart, level, -1, 1, 0), level));
+}
+
+TEST(HilbertCode, neighbor)
+{
+    hilbertNeighbor<unsigned>();
+    hilbertNeighbor<uint64_t>();
+}
+
+TEST(HilbertCode, containedIn)
+{
+    using KeyType = uint64_t;
+    using SfcKind = HilbertKey<KeyType>;
+
+    unsigned level = 2;
+    for (KeyType i = 0; i < 64; ++i)
+    {
+        KeyType nodeStart = i * nodeRange<KeyType>(level);
+        KeyType nodeEnd   = nodeStart + nodeRange<KeyType>(level);
+        IBox node         = makeIBox<KeyType, SfcKind>(nodeStart, nodeEnd);
+
+        EXPECT_TRUE((containedIn<KeyType, SfcKind>(nodeStart, nodeEnd, node)));
+        EXPECT_FALSE((containedIn<KeyType, SfcKind>(nodeStart + 1, nodeEnd, node)));
+    }
+}
@@ -387,3 +387,38 @@ TEST(MortonCode, mortonCodesSequence)
 
     EXPECT_EQ(probe, reference);
 }
+
+//! @brief vectorized batch computation matches the scalar version, including the loop remainder
+template<class KeyType, class T>
+void mortonCodesBatch()
+{
+    Box<T> box(-1, 2, 0, 1, -3, -2);
+    std::size_t n = 1021;
+
+    std::vector<T> x(n), y(n), z(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        x[i] = box.xmin() + (box.xmax() - box.xmin()) * T(i) / (n - 1);
+        y[i] = box.ymin() + (box.ymax() - box.ymin()) * T((i * 37) % n) / (n - 1);
+        z[i] = box.zmin() + (box.zmax() - box.zmin()) * T((i * 101) % n) / (n - 1);
+    }
+
+    std::vector<KeyType> reference(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        reference[i] = morton3D<KeyType>(x[i], y[i], z[i], box);
+    }
+
+    std::vector<KeyType> probe(n);
+    computeMortonCodes(x.data(), x.data() + n, y.data(), z.data(), probe.data(), box);
+
+    EXPECT_EQ(probe, reference);
+}
+
+TEST(MortonCode, mortonCodesBatch)
+{
+    mortonCodesBatch<unsigned, float>();
+    mortonCodesBatch<unsigned, double>();
+    mortonCodesBatch<uint64_t, float>();
+    mortonCodesBatch<uint64_t, double>();
+}
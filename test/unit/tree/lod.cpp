@@ -0,0 +1,94 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Level-of-detail summary tests
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include "gtest/gtest.h"
+
+#include "cstone/tree/lod.hpp"
+#include "cstone/tree/octree_util.hpp"
+
+using namespace cstone;
+
+template<class KeyType>
+void truncateTreeTest()
+{
+    std::vector<KeyType> tree = OctreeMaker<KeyType>{}.divide().divide(0).divide(0, 2).divide(7).makeTree();
+
+    EXPECT_EQ(truncateTree<KeyType>(tree, 3), tree);
+    EXPECT_EQ(truncateTree<KeyType>(tree, 2), (OctreeMaker<KeyType>{}.divide().divide(0).divide(7).makeTree()));
+    EXPECT_EQ(truncateTree<KeyType>(tree, 1), OctreeMaker<KeyType>{}.divide().makeTree());
+    EXPECT_EQ(truncateTree<KeyType>(tree, 0), makeRootNodeTree<KeyType>());
+}
+
+TEST(Lod, truncateTree)
+{
+    truncateTreeTest<unsigned>();
+    truncateTreeTest<uint64_t>();
+}
+
+template<class KeyType>
+void lodSummaryTest()
+{
+    using T = double;
+
+    std::vector<KeyType> lodTree = OctreeMaker<KeyType>{}.divide().makeTree();
+
+    // two particles in octant 0, one in octant 3, none elsewhere, one particle outside [first:last)
+    KeyType r = nodeRange<KeyType>(1);
+    std::vector<KeyType> keys{0, 1, 3 * r + 5, 7 * r};
+    std::vector<T> x{0.1, 0.3, 0.6, 0.9}, y{0.1, 0.1, 0.6, 0.9}, z{0.2, 0.2, 0.2, 0.9};
+    std::vector<T> h{1, 2, 3, 4}, m{1, 3, 2, 1}, field{5, -1, 7, 8};
+
+    std::vector<double> sums(lodNumSums * nNodes(lodTree)), reduced(nNodes(lodTree));
+    lodPartialSums<KeyType>(lodTree, keys.data(), 0, 3, x.data(), y.data(), z.data(), h.data(), m.data(),
+                            field.data(), LodReduction::min, sums.data(), reduced.data());
+
+    auto summary = finalizeLodSummary<T, KeyType>(lodTree, sums.data(), reduced.data());
+
+    EXPECT_EQ(summary.nodes, lodTree);
+    EXPECT_EQ(summary.counts, (std::vector<uint64_t>{2, 0, 0, 1, 0, 0, 0, 0}));
+    EXPECT_DOUBLE_EQ(summary.mass[0], 4);
+    EXPECT_DOUBLE_EQ(summary.x[0], 0.25);
+    EXPECT_DOUBLE_EQ(summary.y[0], 0.1);
+    EXPECT_DOUBLE_EQ(summary.z[0], 0.2);
+    EXPECT_DOUBLE_EQ(summary.h[0], 1.5);
+    EXPECT_DOUBLE_EQ(summary.field[0], -1);
+    EXPECT_DOUBLE_EQ(summary.x[3], 0.6);
+    EXPECT_DOUBLE_EQ(summary.field[3], 7);
+    EXPECT_EQ(summary.mass[1], 0);
+    EXPECT_EQ(summary.h[7], 0);
+    EXPECT_EQ(summary.field[7], 0);
+}
+
+TEST(Lod, partialSums)
+{
+    lodSummaryTest<unsigned>();
+    lodSummaryTest<uint64_t>();
+}
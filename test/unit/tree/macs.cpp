@@ -32,8 +32,11 @@
 #include "gtest/gtest.h"
 
 #include "cstone/tree/macs.hpp"
+#include "cstone/tree/octree_focus.hpp"
 #include "cstone/tree/octree_util.hpp"
 
+#include "coord_samples/random.hpp"
+
 namespace cstone
 {
 
@@ -144,6 +147,9 @@ TEST(Macs, minDistanceSqPbc)
 
         EXPECT_DOUBLE_EQ(probe1, reference);
         EXPECT_DOUBLE_EQ(probe2, reference);
+
+        StaticPbcBox<T, true, true, true> staticBox(box);
+        EXPECT_DOUBLE_EQ(minDistanceSq<KeyType>(a, b, staticBox), reference);
     }
 }
 
@@ -170,6 +176,89 @@ TEST(Macs, minDistanceMac)
     EXPECT_FALSE(probe2);
 }
 
+TEST(Macs, minDistanceSqPoint)
+{
+    using KeyType = unsigned;
+    constexpr double unitLength = 1.0 / (1u << maxTreeLevel<KeyType>{});
+
+    IBox target(0, 1, 512, 513, 512, 513);
+    ExpansionCenter<double> c{0.999, 0.5, 0.5, 1.0};
+
+    {
+        Box<double> box(0, 1);
+        double reference = (0.999 - unitLength) * (0.999 - unitLength);
+        EXPECT_NEAR(minDistanceSq<KeyType>(c, target, box), reference, 1e-12);
+    }
+    {
+        Box<double> box(0, 1, true);
+        EXPECT_NEAR(minDistanceSq<KeyType>(c, target, box), 1e-6, 1e-12);
+    }
+}
+
+TEST(Macs, vectorMac)
+{
+    using KeyType = unsigned;
+    constexpr double unitLength = 1.0 / (1u << maxTreeLevel<KeyType>{});
+
+    IBox target(0, 1);
+    IBox source(6, 8);
+    Box<double> box(0, 1);
+
+    ExpansionCenter<double> geoCenter = geometricCenter<KeyType>(source, box);
+    EXPECT_DOUBLE_EQ(geoCenter.x, 7 * unitLength);
+
+    // distance from the center is sqrt(108) = 10.39, the minimum box distance is sqrt(75) = 8.66
+    EXPECT_TRUE(vectorMac<KeyType>(geoCenter, source, target, box, 20.0));
+    EXPECT_FALSE(minDistanceMac<KeyType>(target, source, box, 20.0));
+    EXPECT_FALSE(vectorMac<KeyType>(geoCenter, source, target, box, 27.5));
+
+    // an off-center expansion center closer to the target makes the MAC more restrictive
+    ExpansionCenter<double> offCenter{6.1 * unitLength, 6.1 * unitLength, 6.1 * unitLength, 1.0};
+    EXPECT_TRUE(vectorMac<KeyType>(offCenter, source, target, box, 13.0));
+    EXPECT_FALSE(vectorMac<KeyType>(offCenter, source, target, box, 13.5));
+}
+
+template<class KeyType>
+void expansionCenters()
+{
+    constexpr double unitLength = 1.0 / (1u << maxTreeLevel<KeyType>{});
+    Box<double> box(0, 1);
+
+    Octree<KeyType> octree;
+    octree.update(OctreeMaker<KeyType>{}.divide().divide(0).makeTree());
+
+    // two particles in the first leaf, one in the last
+    std::vector<KeyType> keys{imorton3D<KeyType>(0, 0, 0), imorton3D<KeyType>(2, 4, 6),
+                              imorton3D<KeyType>((1u << maxTreeLevel<KeyType>{}) - 1, 0, 0)};
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<ExpansionCenter<double>> centers(octree.numTreeNodes());
+    computeExpansionCenters(octree, keys.data(), keys.size(), box, centers.data());
+
+    ExpansionCenter<double> firstLeaf = centers[octree.toInternal(0)];
+    EXPECT_DOUBLE_EQ(firstLeaf.x, 1.5 * unitLength);
+    EXPECT_DOUBLE_EQ(firstLeaf.y, 2.5 * unitLength);
+    EXPECT_DOUBLE_EQ(firstLeaf.z, 3.5 * unitLength);
+    EXPECT_EQ(firstLeaf.mass, 2.0);
+
+    // empty leaves are at their geometric center
+    TreeNodeIndex emptyLeaf = octree.toInternal(1);
+    IBox emptyBox = makeIBox(octree.codeStart(emptyLeaf), octree.codeEnd(emptyLeaf));
+    EXPECT_DOUBLE_EQ(centers[emptyLeaf].x, geometricCenter<KeyType>(emptyBox, box).x);
+    EXPECT_EQ(centers[emptyLeaf].mass, 0.0);
+
+    ExpansionCenter<double> root = centers[0];
+    EXPECT_EQ(root.mass, 3.0);
+    EXPECT_NEAR(root.x, (2 * 1.5 * unitLength + (1.0 - 0.5 * unitLength)) / 3, 1e-12);
+    EXPECT_NEAR(root.y, (2 * 2.5 * unitLength + 0.5 * unitLength) / 3, 1e-12);
+}
+
+TEST(Macs, expansionCenters)
+{
+    expansionCenters<unsigned>();
+    expansionCenters<uint64_t>();
+}
+
 template<class KeyType>
 void markMac()
 {
@@ -198,4 +287,58 @@ TEST(Macs, markMac)
     markMac<uint64_t>();
 }
 
+//! @brief incremental MAC markings have to match full markMac evaluations along a focus tree convergence
+template<class KeyType>
+void incrementalMarkMac()
+{
+    Box<double> box(-1, 1);
+    int nParticles = 20000;
+    float theta = 0.5;
+    float invThetaSq = 1.0f / (theta * theta);
+
+    RandomCoordinates<double, KeyType> randomBox(nParticles, box);
+    std::vector<KeyType> codes = randomBox.mortonCodes();
+
+    FocusedOctreeSingleNode<KeyType> focusTree(16, theta);
+    IncrementalMacMarker<KeyType> marker;
+    Octree<KeyType> octree;
+
+    auto checkMarkings = [&](KeyType focusStart, KeyType focusEnd)
+    {
+        octree.update(focusTree.treeLeaves().begin(), focusTree.treeLeaves().end());
+
+        std::vector<char> reference(octree.numTreeNodes()), probe(octree.numTreeNodes());
+        markMac(octree, box, focusStart, focusEnd, invThetaSq, reference.data());
+        marker.markMac(octree, box, focusStart, focusEnd, invThetaSq, probe.data());
+        EXPECT_EQ(probe, reference);
+    };
+
+    KeyType focusStart = 0;
+    KeyType focusEnd   = pad(KeyType(1), 3);
+    for (int step = 0; step < 20; ++step)
+    {
+        bool converged = focusTree.update(box, codes, focusStart, focusEnd);
+        checkMarkings(focusStart, focusEnd);
+        if (converged) { break; }
+    }
+    EXPECT_GT(marker.numReused(), 0);
+
+    // the focus moves, markings are recomputed
+    std::size_t numReused = marker.numReused();
+    focusEnd = pad(KeyType(2), 3);
+    focusTree.update(box, codes, focusStart, focusEnd);
+    checkMarkings(focusStart, focusEnd);
+    EXPECT_EQ(marker.numReused(), numReused);
+
+    focusTree.update(box, codes, focusStart, focusEnd);
+    checkMarkings(focusStart, focusEnd);
+    EXPECT_EQ(marker.numReused(), numReused + 1);
+}
+
+TEST(Macs, incrementalMarkMac)
+{
+    incrementalMarkMac<unsigned>();
+    incrementalMarkMac<uint64_t>();
+}
+
 } // namespace cstone
\ No newline at end of file
@@ -0,0 +1,151 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Test the single-sweep node statistics
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <numeric>
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "cstone/tree/node_statistics.hpp"
+#include "cstone/tree/octree_util.hpp"
+
+#include "coord_samples/random.hpp"
+
+using namespace cstone;
+
+/*! @brief compare the fused statistics of particles [first:last] against the separate per-quantity functions
+ *
+ * Particles outside of [first:last] leave some of the nodes empty.
+ */
+template<class KeyType, class T>
+void checkNodeStatistics(const std::vector<KeyType>& tree, const RandomGaussianCoordinates<T, KeyType>& coords,
+                         std::size_t first, std::size_t last)
+{
+    TreeNodeIndex numNodes = nNodes(tree);
+    const KeyType* keys  = coords.mortonCodes().data() + first;
+    std::size_t numKeys  = last - first;
+
+    std::vector<T> h(numKeys), weights(numKeys);
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<T> dist(0.01, 0.1);
+    std::generate(h.begin(), h.end(), [&]() { return dist(gen); });
+    std::generate(weights.begin(), weights.end(), [&]() { return dist(gen); });
+
+    NodeStatisticsInput<T> in{coords.x().data() + first, coords.y().data() + first, coords.z().data() + first,
+                              h.data(), weights.data()};
+
+    std::vector<unsigned> counts(numNodes);
+    std::vector<float> radii(numNodes);
+    std::vector<double> nodeWeights(numNodes);
+    std::vector<NodeBounds<T>> bounds(numNodes);
+    computeNodeStatistics(tree.data(), numNodes, keys, numKeys, in,
+                          NodeStatisticsOutput<T>{counts.data(), radii.data(), nodeWeights.data(), bounds.data()});
+
+    std::vector<unsigned> refCounts(numNodes);
+    computeNodeCounts(tree.data(), refCounts.data(), numNodes, keys, keys + numKeys,
+                      std::numeric_limits<unsigned>::max());
+    EXPECT_EQ(counts, refCounts);
+
+    std::vector<LocalParticleIndex> ordering(numKeys);
+    std::iota(ordering.begin(), ordering.end(), 0);
+    std::vector<float> refRadii(numNodes);
+    computeHaloRadii(tree.data(), numNodes, keys, keys + numKeys, ordering.data(), h.data(), refRadii.data());
+    EXPECT_EQ(radii, refRadii);
+
+    std::vector<double> refWeights(numNodes);
+    computeNodeWeights(tree.data(), refWeights.data(), numNodes, keys, keys + numKeys, weights.data());
+    for (TreeNodeIndex i = 0; i < numNodes; ++i)
+    {
+        EXPECT_NEAR(nodeWeights[i], refWeights[i], 1e-10 * refWeights[i]);
+    }
+
+    std::size_t particle = 0;
+    for (TreeNodeIndex i = 0; i < numNodes; ++i)
+    {
+        NodeBounds<T> ref{0, 0, 0, 0, 0, 0};
+        for (unsigned j = 0; j < refCounts[i]; ++j, ++particle)
+        {
+            T x = in.x[particle], y = in.y[particle], z = in.z[particle];
+            if (j == 0) { ref = {x, x, y, y, z, z}; }
+            ref = {std::min(ref.xmin, x), std::max(ref.xmax, x), std::min(ref.ymin, y),
+                   std::max(ref.ymax, y), std::min(ref.zmin, z), std::max(ref.zmax, z)};
+        }
+        EXPECT_EQ(bounds[i].xmin, ref.xmin);
+        EXPECT_EQ(bounds[i].xmax, ref.xmax);
+        EXPECT_EQ(bounds[i].ymin, ref.ymin);
+        EXPECT_EQ(bounds[i].ymax, ref.ymax);
+        EXPECT_EQ(bounds[i].zmin, ref.zmin);
+        EXPECT_EQ(bounds[i].zmax, ref.zmax);
+    }
+}
+
+template<class KeyType>
+void nodeStatistics()
+{
+    using T = double;
+    RandomGaussianCoordinates<T, KeyType> coords(20000, Box<T>(-1, 1));
+    const auto& keys = coords.mortonCodes();
+
+    auto [tree, counts] = computeOctree(keys.data(), keys.data() + keys.size(), 16);
+    checkNodeStatistics(tree, coords, 0, keys.size());
+    checkNodeStatistics(tree, coords, 5000, 12000);
+
+    // nodes with many particles span multiple merge path chunks when run with several threads
+    std::vector<KeyType> coarseTree = OctreeMaker<KeyType>{}.divide().makeTree();
+    checkNodeStatistics(coarseTree, coords, 0, keys.size());
+    checkNodeStatistics(coarseTree, coords, 100, 101);
+    checkNodeStatistics(coarseTree, coords, 100, 100);
+}
+
+TEST(NodeStatistics, matchesSeparateSweeps)
+{
+    nodeStatistics<unsigned>();
+    nodeStatistics<uint64_t>();
+}
+
+//! @brief quantities without inputs or outputs are skipped
+TEST(NodeStatistics, countsOnly)
+{
+    using KeyType = unsigned;
+    std::vector<KeyType> tree = OctreeMaker<KeyType>{}.divide().divide(0).makeTree();
+    std::vector<KeyType> keys{0, 1, nodeRange<KeyType>(2), nodeRange<KeyType>(1), nodeRange<KeyType>(1) + 1};
+
+    std::vector<unsigned> counts(nNodes(tree), 42);
+    NodeStatisticsOutput<double> out;
+    out.counts = counts.data();
+    computeNodeStatistics(tree.data(), nNodes(tree), keys.data(), keys.size(), NodeStatisticsInput<double>{}, out);
+
+    std::vector<unsigned> reference(nNodes(tree), 0);
+    reference[0] = 2;
+    reference[1] = 1;
+    reference[8] = 2;
+    EXPECT_EQ(counts, reference);
+}
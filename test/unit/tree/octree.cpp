@@ -29,6 +29,8 @@
  * @author Sebastian Keller <sebastian.f.keller@gmail.com>
  */
 
+#include <random>
+
 #include "gtest/gtest.h"
 
 #include "cstone/tree/octree.hpp"
@@ -163,6 +165,70 @@ TEST(CornerstoneOctree, countTreeNodes32) { checkCountTreeNodes<unsigned>(); }
 
 TEST(CornerstoneOctree, countTreeNodes64) { checkCountTreeNodes<uint64_t>(); }
 
+/*! @brief merge path counting split into an arbitrary number of chunks has to match per-node binary searches
+ *
+ * Chunks are processed serially here, such that the combination of node counts shared between chunks
+ * is tested independently of the number of OpenMP threads.
+ */
+template<class KeyType>
+void computeNodeCountsMergeChunks()
+{
+    std::vector<KeyType> tree = OctreeMaker<KeyType>{}.divide().divide(0).divide(0, 3).divide(7).makeTree();
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<KeyType> distribution(0, nodeRange<KeyType>(0) - 1);
+    std::vector<KeyType> keys(1000);
+    for (auto& key : keys) { key = distribution(gen); }
+    // a cluster of identical keys that spans several chunks
+    keys.insert(keys.end(), 300, tree[5]);
+    std::sort(begin(keys), end(keys));
+
+    TreeNodeIndex numNodes = nNodes(tree);
+    std::vector<unsigned> reference(numNodes);
+    for (TreeNodeIndex i = 0; i < numNodes; ++i)
+    {
+        reference[i] = calculateNodeCount(tree.data(), i, keys.data(), keys.data() + keys.size(),
+                                          std::numeric_limits<unsigned>::max());
+    }
+
+    auto serialAdd = [](unsigned* address, unsigned value) { *address += value; };
+
+    std::size_t pathLength = numNodes + keys.size();
+    for (std::size_t numChunks : {1, 2, 7, 64, 1000})
+    {
+        std::size_t chunkSize = (pathLength + numChunks - 1) / numChunks;
+        std::vector<TreeNodeIndex> chunkNodes(numChunks);
+        std::vector<unsigned> counts(numNodes, 0xFFFF);
+        for (std::size_t c = 0; c < numChunks; ++c)
+        {
+            chunkNodes[c] = mergePathSplit(tree.data() + 1, numNodes, keys.data(), keys.size(),
+                                           std::min(c * chunkSize, pathLength));
+            if (chunkNodes[c] < numNodes) { counts[chunkNodes[c]] = 0; }
+        }
+        for (std::size_t c = 0; c < numChunks; ++c)
+        {
+            std::size_t diagStart = std::min(c * chunkSize, pathLength);
+            std::size_t diagEnd   = std::min(diagStart + chunkSize, pathLength);
+            countMergePathChunk(tree.data() + 1, numNodes, keys.data(), keys.size(), chunkNodes[c], diagStart,
+                                diagEnd, counts.data(), serialAdd);
+        }
+        EXPECT_EQ(counts, reference);
+    }
+
+    unsigned maxCount = 50;
+    std::vector<unsigned> cappedCounts(nNodes(tree));
+    computeNodeCountsMerge(tree.data(), cappedCounts.data(), nNodes(tree), keys.data(), keys.data() + keys.size(),
+                           maxCount);
+    for (auto& c : reference) { c = std::min(c, maxCount); }
+    EXPECT_EQ(cappedCounts, reference);
+}
+
+TEST(CornerstoneOctree, computeNodeCountsMergeChunks)
+{
+    computeNodeCountsMergeChunks<unsigned>();
+    computeNodeCountsMergeChunks<uint64_t>();
+}
+
 template<class KeyType>
 void computeNodeCountsSTree()
 {
@@ -189,6 +255,28 @@ TEST(CornerstoneOctree, computeNodeCounts_spanningTree)
     computeNodeCountsSTree<uint64_t>();
 }
 
+template<class KeyType>
+void computeNodeWeightsTest()
+{
+    std::vector<KeyType> tree = OctreeMaker<KeyType>{}.divide().makeTree();
+
+    std::vector<KeyType> codes{tree[0], tree[0] + 1, tree[2], tree[8] - 1};
+    std::vector<float> weights{1, 2, 3, 4};
+
+    std::vector<double> nodeWeights(nNodes(tree));
+    computeNodeWeights(tree.data(), nodeWeights.data(), nNodes(tree), codes.data(), codes.data() + codes.size(),
+                       weights.data());
+
+    std::vector<double> reference{3, 0, 3, 0, 0, 0, 0, 4};
+    EXPECT_EQ(nodeWeights, reference);
+}
+
+TEST(CornerstoneOctree, computeNodeWeights)
+{
+    computeNodeWeightsTest<unsigned>();
+    computeNodeWeightsTest<uint64_t>();
+}
+
 template<class CodeType, class LocalIndex>
 void rebalanceDecision()
 {
@@ -233,6 +321,73 @@ TEST(CornerstoneOctree, rebalanceDecisionSingleRoot)
     rebalanceDecisionSingleRoot<uint64_t, unsigned>();
 }
 
+//! @brief nodes with counts far above the bucket size are split by multiple levels
+template<class KeyType>
+void rebalanceMultiLevel()
+{
+    std::vector<KeyType> tree = OctreeMaker<KeyType>{}.divide().makeTree();
+
+    unsigned bucketSize = 4;
+    std::vector<unsigned> counts{5, 32, 33, 256, 257, 100000, 0, 0};
+
+    std::vector<TreeNodeIndex> nodeOps(tree.size());
+    bool converged = rebalanceDecision(tree.data(), counts.data(), nNodes(tree), bucketSize, nodeOps.data());
+
+    std::vector<TreeNodeIndex> reference{8, 8, 64, 64, 512, 512, 1, 1, 0};
+    EXPECT_EQ(nodeOps, reference);
+    EXPECT_FALSE(converged);
+
+    std::vector<KeyType> newTree;
+    rebalanceTree(tree, newTree, nodeOps.data());
+
+    OctreeMaker<KeyType> refMaker;
+    refMaker.divide().divide(0).divide(1).divide(2).divide(3).divide(4).divide(5);
+    for (int i = 0; i < 8; ++i)
+    {
+        refMaker.divide(2, i).divide(3, i).divide(4, i).divide(5, i);
+        for (int j = 0; j < 8; ++j)
+        {
+            refMaker.divide(4, i, j).divide(5, i, j);
+        }
+    }
+    EXPECT_EQ(newTree, refMaker.makeTree());
+    EXPECT_TRUE(checkOctreeInvariants(newTree.data(), nNodes(newTree)));
+}
+
+TEST(CornerstoneOctree, rebalanceMultiLevel)
+{
+    rebalanceMultiLevel<unsigned>();
+    rebalanceMultiLevel<uint64_t>();
+}
+
+/*! @brief splits by multiple levels are limited by the maximum tree level
+ *
+ * The first node is one level above the maximum tree level and can only be split once.
+ */
+template<class KeyType>
+void rebalanceMultiLevelMaxDepth()
+{
+    OctreeMaker<KeyType> octreeMaker;
+    for (unsigned level = 0; level < maxTreeLevel<KeyType>{} - 1; ++level)
+        octreeMaker.divide({}, level);
+
+    std::vector<KeyType> tree = octreeMaker.makeTree();
+
+    std::vector<unsigned> counts(nNodes(tree), 1);
+    counts[0] = 1000;
+
+    std::vector<TreeNodeIndex> nodeOps(tree.size());
+    rebalanceDecision(tree.data(), counts.data(), nNodes(tree), 1, nodeOps.data());
+
+    EXPECT_EQ(nodeOps[0], 8);
+}
+
+TEST(CornerstoneOctree, rebalanceMultiLevelMaxDepth)
+{
+    rebalanceMultiLevelMaxDepth<unsigned>();
+    rebalanceMultiLevelMaxDepth<uint64_t>();
+}
+
 /*! @brief test behavior of a maximum-depth tree under rebalancing
  *
  *  Node 0 is at the lowest octree level (10 or 21) and its particle
@@ -409,6 +564,53 @@ TEST(CornerstoneOctree, computeSpanningTree)
     computeSpanningTree<uint64_t>();
 }
 
+//! @brief the single pass octree construction yields the same tree as the iterative one
+template<class KeyType, template<class...> class CoordinateType>
+void computeOctreeDirect(unsigned bucketSize)
+{
+    Box<double> box{-1, 1};
+    int nParticles = 20000;
+
+    CoordinateType<double, KeyType> randomBox(nParticles, box);
+    const std::vector<KeyType>& codes = randomBox.mortonCodes();
+
+    std::vector<KeyType> refTree{0, nodeRange<KeyType>(0)};
+    std::vector<unsigned> refCounts{unsigned(nParticles)};
+    while (!updateOctree(codes.data(), codes.data() + nParticles, bucketSize, refTree, refCounts));
+
+    auto [tree, counts] = computeOctree(codes.data(), codes.data() + nParticles, bucketSize);
+
+    EXPECT_EQ(tree, refTree);
+    EXPECT_EQ(counts, refCounts);
+}
+
+TEST(CornerstoneOctree, computeOctreeDirect)
+{
+    for (unsigned bucketSize : {1, 8, 64, 1024, 20000, 30000})
+    {
+        computeOctreeDirect<unsigned, RandomCoordinates>(bucketSize);
+        computeOctreeDirect<unsigned, RandomGaussianCoordinates>(bucketSize);
+        computeOctreeDirect<uint64_t, RandomGaussianCoordinates>(bucketSize);
+    }
+}
+
+TEST(CornerstoneOctree, computeOctreeDuplicateKeys)
+{
+    using KeyType = unsigned;
+
+    // more keys in a single maximum level node than bucketSize
+    std::vector<KeyType> codes{0, 5, 5, 5, 5, 8, 100, nodeRange<KeyType>(0) - 1};
+    auto [tree, counts] = computeOctree(codes.data(), codes.data() + codes.size(), 2);
+
+    std::vector<KeyType> refTree{0, nodeRange<KeyType>(0)};
+    std::vector<unsigned> refCounts{unsigned(codes.size())};
+    while (!updateOctree(codes.data(), codes.data() + codes.size(), 2, refTree, refCounts));
+
+    EXPECT_TRUE(checkOctreeInvariants(tree.data(), nNodes(tree)));
+    EXPECT_EQ(tree, refTree);
+    EXPECT_EQ(counts, refCounts);
+}
+
 TEST(CornerstoneOctree, computeHaloRadii)
 {
     using CodeType = unsigned;
@@ -141,8 +141,8 @@ TEST(OctreeEssential, rebalanceDecision)
     rebalanceDecision<uint64_t>();
 }
 
-template<class KeyType>
-TreeNodeIndex numNodesInRange(const FocusedOctreeSingleNode<KeyType>& tree, KeyType a, KeyType b)
+template<class KeyType, class MacTag>
+TreeNodeIndex numNodesInRange(const FocusedOctreeSingleNode<KeyType, MacTag>& tree, KeyType a, KeyType b)
 {
     auto csFocus = tree.treeLeaves();
 
@@ -198,4 +198,82 @@ TEST(OctreeEssential, compute)
     computeEssentialTree<uint64_t>();
 }
 
-} // namespace cstone
\ No newline at end of file
+//! @brief the vector MAC resolves the focus area identically and needs fewer nodes outside of it
+template<class KeyType>
+void computeEssentialTreeVectorMac()
+{
+    Box<double> box{-1, 1};
+    int nParticles = 100000;
+    unsigned bucketSize = 16;
+    float theta = 0.6;
+
+    RandomCoordinates<double, KeyType> randomBox(nParticles, box);
+    std::vector<KeyType> codes = randomBox.mortonCodes();
+
+    auto [csTree, csCounts] = computeOctree(codes.data(), codes.data() + nParticles, bucketSize);
+
+    FocusedOctreeSingleNode<KeyType> minDistanceTree(bucketSize, theta);
+    FocusedOctreeSingleNode<KeyType, VectorMacTag> vectorTree(bucketSize, theta);
+
+    KeyType focusStart = 0;
+    KeyType focusEnd   = pad(KeyType(1), 3);
+    while (!minDistanceTree.update(box, codes, focusStart, focusEnd)) {}
+    while (!vectorTree.update(box, codes, focusStart, focusEnd)) {}
+
+    TreeNodeIndex lastFocusNode =
+        std::lower_bound(vectorTree.treeLeaves().begin(), vectorTree.treeLeaves().end(), focusEnd) -
+        vectorTree.treeLeaves().begin();
+    EXPECT_TRUE(std::equal(begin(csTree), begin(csTree) + lastFocusNode, vectorTree.treeLeaves().begin()));
+
+    TreeNodeIndex minDistanceOutside = numNodesInRange(minDistanceTree, focusEnd, nodeRange<KeyType>(0));
+    TreeNodeIndex vectorOutside      = numNodesInRange(vectorTree, focusEnd, nodeRange<KeyType>(0));
+    EXPECT_GT(vectorOutside, 0);
+    EXPECT_LT(vectorOutside, minDistanceOutside);
+}
+
+TEST(OctreeEssential, computeVectorMac)
+{
+    computeEssentialTreeVectorMac<unsigned>();
+    computeEssentialTreeVectorMac<uint64_t>();
+}
+
+//! @brief updateTree followed by updateCounts is equivalent to update
+template<class KeyType, class MacTag>
+void splitUpdate()
+{
+    Box<double> box{-1, 1};
+    int nParticles = 20000;
+    unsigned bucketSize = 16;
+    float theta = 0.8;
+
+    RandomCoordinates<double, KeyType> randomBox(nParticles, box);
+    std::vector<KeyType> codes = randomBox.mortonCodes();
+
+    FocusedOctreeSingleNode<KeyType, MacTag> reference(bucketSize, theta);
+    FocusedOctreeSingleNode<KeyType, MacTag> split(bucketSize, theta);
+
+    KeyType focusStart = pad(KeyType(2), 3);
+    KeyType focusEnd   = pad(KeyType(3), 3);
+    bool converged = false;
+    while (!converged)
+    {
+        converged = reference.update(box, codes, focusStart, focusEnd);
+
+        EXPECT_EQ(split.updateTree(box, focusStart, focusEnd), converged);
+        split.updateCounts(box, codes, focusStart, focusEnd);
+
+        EXPECT_TRUE(std::equal(reference.treeLeaves().begin(), reference.treeLeaves().end(),
+                               split.treeLeaves().begin(), split.treeLeaves().end()));
+        EXPECT_TRUE(std::equal(reference.leafCounts().begin(), reference.leafCounts().end(),
+                               split.leafCounts().begin(), split.leafCounts().end()));
+    }
+}
+
+TEST(OctreeEssential, splitUpdate)
+{
+    splitUpdate<unsigned, MinDistanceMacTag>();
+    splitUpdate<uint64_t, MinDistanceMacTag>();
+    splitUpdate<uint64_t, VectorMacTag>();
+}
+
+} // namespace cstone
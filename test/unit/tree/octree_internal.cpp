@@ -33,6 +33,8 @@
  * format. It is only used to test the octree implementation.
  */
 
+#include <random>
+
 #include "gtest/gtest.h"
 
 #include "cstone/tree/octree_internal.hpp"
@@ -635,3 +637,175 @@ TEST(InternalOctree, locate)
     locateTest<unsigned>();
     locateTest<uint64_t>();
 }
+
+//! @brief repeated updates of the same Octree object with changing sizes must match a freshly constructed Octree
+template<class KeyType>
+void reuseWorkspace()
+{
+    std::vector<KeyType> large = OctreeMaker<KeyType>{}.divide().divide(0).divide(0, 2).divide(3).makeTree();
+    std::vector<KeyType> small = OctreeMaker<KeyType>{}.divide().divide(5).makeTree();
+
+    Octree<KeyType> reusedTree;
+    for (const auto& leaves : {large, small, large, small})
+    {
+        reusedTree.update(begin(leaves), end(leaves));
+
+        Octree<KeyType> freshTree;
+        freshTree.update(begin(leaves), end(leaves));
+
+        ASSERT_EQ(reusedTree.numTreeNodes(), freshTree.numTreeNodes());
+        for (TreeNodeIndex i = 0; i < freshTree.numTreeNodes(); ++i)
+        {
+            EXPECT_EQ(reusedTree.codeStart(i), freshTree.codeStart(i));
+            EXPECT_EQ(reusedTree.codeEnd(i), freshTree.codeEnd(i));
+            EXPECT_EQ(reusedTree.parent(i), freshTree.parent(i));
+        }
+        checkConnectivity(reusedTree);
+    }
+}
+
+TEST(InternalOctree, reuseWorkspace)
+{
+    reuseWorkspace<unsigned>();
+    reuseWorkspace<uint64_t>();
+}
+
+//! @brief maximum distance to a leaf of node @p nodeIdx
+template<class KeyType>
+int maxDepth(const Octree<KeyType>& tree, TreeNodeIndex nodeIdx)
+{
+    if (tree.isLeaf(nodeIdx)) { return 0; }
+
+    int depth = 0;
+    for (int octant = 0; octant < 8; ++octant)
+    {
+        depth = std::max(depth, maxDepth(tree, tree.child(nodeIdx, octant)));
+    }
+    return depth + 1;
+}
+
+/*! @brief an Octree patched with rebalance node ops has to match an Octree built from scratch
+ *
+ * Nodes with the same max depth may appear in a different order, therefore nodes are matched by their SFC key range.
+ */
+template<class KeyType>
+void patchFromNodeOps()
+{
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<KeyType> uniform(0, nodeRange<KeyType>(0) - 1);
+    std::uniform_int_distribution<KeyType> clustered(0, nodeRange<KeyType>(2) - 1);
+
+    std::vector<KeyType> uniformKeys(20000), clusteredKeys(20000);
+    for (auto& key : uniformKeys) { key = uniform(gen); }
+    for (auto& key : clusteredKeys) { key = clustered(gen); }
+    std::sort(begin(uniformKeys), end(uniformKeys));
+    std::sort(begin(clusteredKeys), end(clusteredKeys));
+
+    unsigned bucketSize = 16;
+    auto [leaves, leafCounts] = computeOctree(uniformKeys.data(), uniformKeys.data() + uniformKeys.size(), bucketSize);
+
+    Octree<KeyType> patchedTree;
+    patchedTree.update(std::vector<KeyType>(leaves));
+
+    // alternate between distributions to produce both merges and splits
+    for (int step = 0; step < 6; ++step)
+    {
+        const auto& keys = (step % 2 == 0) ? clusteredKeys : uniformKeys;
+        std::vector<KeyType> currentLeaves(patchedTree.treeLeaves().begin(), patchedTree.treeLeaves().end());
+
+        std::vector<unsigned> counts(nNodes(currentLeaves));
+        computeNodeCounts(currentLeaves.data(), counts.data(), nNodes(currentLeaves), keys.data(),
+                          keys.data() + keys.size(), std::numeric_limits<unsigned>::max());
+
+        std::vector<TreeNodeIndex> nodeOps(currentLeaves.size());
+        rebalanceDecision(currentLeaves.data(), counts.data(), nNodes(currentLeaves), bucketSize, nodeOps.data());
+
+        std::vector<KeyType> newLeaves;
+        rebalanceTree(currentLeaves, newLeaves, nodeOps.data());
+
+        Octree<KeyType> freshTree;
+        freshTree.update(begin(newLeaves), end(newLeaves));
+        patchedTree.update(std::move(newLeaves), nodeOps.data());
+
+        ASSERT_EQ(patchedTree.numLeafNodes(), freshTree.numLeafNodes());
+        ASSERT_EQ(patchedTree.numInternalNodes(), freshTree.numInternalNodes());
+        for (int depth = 0; depth < int(maxTreeLevel<KeyType>{}); ++depth)
+        {
+            EXPECT_EQ(patchedTree.numTreeNodes(depth), freshTree.numTreeNodes(depth));
+        }
+
+        for (TreeNodeIndex i = 0; i < freshTree.numTreeNodes(); ++i)
+        {
+            TreeNodeIndex j = patchedTree.locate(freshTree.codeStart(i), freshTree.codeEnd(i));
+            ASSERT_LT(j, patchedTree.numTreeNodes());
+            EXPECT_EQ(patchedTree.isLeaf(j), freshTree.isLeaf(i));
+            EXPECT_EQ(patchedTree.codeStart(patchedTree.parent(j)), freshTree.codeStart(freshTree.parent(i)));
+        }
+
+        // internal nodes are sorted by decreasing max depth
+        for (TreeNodeIndex i = 1; i < patchedTree.numInternalNodes(); ++i)
+        {
+            EXPECT_GE(maxDepth(patchedTree, i - 1), maxDepth(patchedTree, i));
+        }
+        TreeNodeIndex groupStart = 0;
+        for (int depth = maxTreeLevel<KeyType>{} - 1; depth > 0; --depth)
+        {
+            for (TreeNodeIndex i = groupStart; i < groupStart + patchedTree.numTreeNodes(depth); ++i)
+            {
+                EXPECT_EQ(maxDepth(patchedTree, i), depth);
+            }
+            groupStart += patchedTree.numTreeNodes(depth);
+        }
+
+        checkConnectivity(patchedTree);
+    }
+}
+
+TEST(InternalOctree, patchFromNodeOps)
+{
+    patchFromNodeOps<unsigned>();
+    patchFromNodeOps<uint64_t>();
+}
+
+//! @brief each node of the traversal layout has to match the Octree node it refers to
+template<class KeyType>
+void traversalLayout()
+{
+    Octree<KeyType> octree;
+    octree.update(OctreeMaker<KeyType>{}.divide().divide(0).divide(0, 2).divide(3).divide(3, 7).makeTree());
+
+    const TraversalOctree<KeyType>& tree = octree.traversalTree();
+    ASSERT_EQ(tree.numTreeNodes(), octree.numTreeNodes());
+
+    std::vector<TreeNodeIndex> visited(octree.numTreeNodes(), 0);
+    for (TreeNodeIndex i = 0; i < tree.numTreeNodes(); ++i)
+    {
+        TreeNodeIndex j = tree.octreeIndex(i);
+        visited[j]++;
+
+        EXPECT_EQ(tree.codeStart(i), octree.codeStart(j));
+        EXPECT_EQ(tree.codeEnd(i), octree.codeEnd(j));
+        EXPECT_EQ(tree.level(i), octree.level(j));
+        EXPECT_EQ(tree.isLeaf(i), octree.isLeaf(j));
+        EXPECT_EQ(tree.locate(tree.codeStart(i), tree.codeEnd(i)), i);
+
+        if (tree.isLeaf(i)) { EXPECT_EQ(tree.toLeaf(i), octree.toLeaf(j)); }
+        else
+        {
+            for (int octant = 0; octant < 8; ++octant)
+            {
+                EXPECT_EQ(tree.octreeIndex(tree.child(i, octant)), octree.child(j, octant));
+            }
+        }
+    }
+
+    // the traversal layout is a permutation of the octree nodes
+    EXPECT_EQ(visited, std::vector<TreeNodeIndex>(octree.numTreeNodes(), 1));
+    EXPECT_EQ(tree.locate(0, 2), tree.numTreeNodes());
+}
+
+TEST(InternalOctree, traversalLayout)
+{
+    traversalLayout<unsigned>();
+    traversalLayout<uint64_t>();
+}
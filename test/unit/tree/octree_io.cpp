@@ -0,0 +1,128 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Tests for the memory-mapped octree file format
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <cstdio>
+
+#include "gtest/gtest.h"
+
+#include "cstone/tree/octree_io.hpp"
+#include "cstone/tree/octree_util.hpp"
+#include "cstone/tree/upsweep.hpp"
+
+using namespace cstone;
+
+template<class KeyType>
+void writeAndMapOctree()
+{
+    std::vector<KeyType> leaves = OctreeMaker<KeyType>{}.divide().divide(0).divide(0, 2).divide(3).makeTree();
+
+    Octree<KeyType> octree;
+    octree.update(leaves.begin(), leaves.end());
+
+    std::vector<unsigned> counts(octree.numTreeNodes(), 1);
+    auto sumFunction = [](auto a, auto b, auto c, auto d, auto e, auto f, auto g, auto h)
+    { return a + b + c + d + e + f + g + h; };
+    upsweep(octree, counts.data() + octree.numInternalNodes(), counts.data(), sumFunction);
+
+    std::vector<double> levels(octree.numTreeNodes());
+    for (TreeNodeIndex i = 0; i < octree.numTreeNodes(); ++i)
+    {
+        levels[i] = octree.level(i);
+    }
+
+    std::string filename = "octree_io_" + std::to_string(sizeof(KeyType)) + ".bin";
+    writeOctree(filename, octree, {nodeQuantity("counts", counts.data()), nodeQuantity("levels", levels.data())});
+
+    {
+        MappedOctree<KeyType> mapped(filename);
+        OctreeView<KeyType> view = mapped.data();
+
+        ASSERT_EQ(view.numLeafNodes(), octree.numLeafNodes());
+        ASSERT_EQ(view.numInternalNodes(), octree.numInternalNodes());
+        for (int depth = 0; depth < int(maxTreeLevel<KeyType>{}); ++depth)
+        {
+            EXPECT_EQ(view.numTreeNodes(depth), octree.numTreeNodes(depth));
+        }
+        for (TreeNodeIndex i = 0; i < octree.numTreeNodes(); ++i)
+        {
+            EXPECT_EQ(view.codeStart(i), octree.codeStart(i));
+            EXPECT_EQ(view.codeEnd(i), octree.codeEnd(i));
+            EXPECT_EQ(view.level(i), octree.level(i));
+            EXPECT_EQ(view.parent(i), octree.parent(i));
+            EXPECT_EQ(view.isLeaf(i), octree.isLeaf(i));
+        }
+        for (TreeNodeIndex i = 0; i < octree.numInternalNodes(); ++i)
+        {
+            for (int octant = 0; octant < 8; ++octant)
+            {
+                EXPECT_EQ(view.child(i, octant), octree.child(i, octant));
+            }
+        }
+
+        EXPECT_EQ(mapped.numQuantities(), 2);
+        EXPECT_EQ(mapped.quantityName(1), "levels");
+        EXPECT_FALSE(mapped.hasQuantity("mass"));
+        EXPECT_THROW(static_cast<void>(mapped.template quantity<float>("levels")), std::runtime_error);
+
+        const unsigned* mappedCounts = mapped.template quantity<unsigned>("counts");
+        EXPECT_EQ(std::vector<unsigned>(mappedCounts, mappedCounts + view.numTreeNodes()), counts);
+        EXPECT_EQ(mappedCounts[0], octree.numLeafNodes());
+
+        // the mapped tree can be used in place of an Octree
+        std::vector<unsigned> recounts(view.numTreeNodes(), 1);
+        upsweep(view, recounts.data() + view.numInternalNodes(), recounts.data(), sumFunction);
+        EXPECT_EQ(recounts, counts);
+    }
+
+    using OtherKeyType = std::conditional_t<sizeof(KeyType) == 4, uint64_t, unsigned>;
+    EXPECT_THROW(MappedOctree<OtherKeyType>{filename}, std::runtime_error);
+
+    std::remove(filename.c_str());
+}
+
+TEST(OctreeIo, writeAndMap)
+{
+    writeAndMapOctree<unsigned>();
+    writeAndMapOctree<uint64_t>();
+}
+
+TEST(OctreeIo, rejectInvalidFile)
+{
+    std::string filename = "octree_io_invalid.bin";
+    {
+        std::ofstream out(filename, std::ios::binary);
+        std::vector<char> garbage(256, 'x');
+        out.write(garbage.data(), garbage.size());
+    }
+    EXPECT_THROW(MappedOctree<unsigned>{filename}, std::runtime_error);
+    EXPECT_THROW(MappedOctree<unsigned>{"nonexistent_octree_file.bin"}, std::runtime_error);
+    std::remove(filename.c_str());
+}
@@ -0,0 +1,192 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for the batched box and sphere queries
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <numeric>
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "cstone/tree/octree.hpp"
+#include "cstone/tree/range_query.hpp"
+
+#include "coord_samples/random.hpp"
+
+namespace cstone
+{
+
+TEST(RangeQuery, queryOverlap)
+{
+    using T = double;
+    Box<T> box(0, 1);
+    // a node with center (0.25, 0.25, 0.25) and edge length 0.5
+    detail::NodeExtent<T> node{0.25, 0.25, 0.25, 0.25, 0.25, 0.25};
+
+    EXPECT_EQ(queryOverlap(QueryBox<T>{0, 0.6, 0, 0.6, 0, 0.6}, node, box), QueryOverlap::full);
+    EXPECT_EQ(queryOverlap(QueryBox<T>{0.4, 0.6, 0.4, 0.6, 0.4, 0.6}, node, box), QueryOverlap::partial);
+    EXPECT_EQ(queryOverlap(QueryBox<T>{0.6, 0.8, 0, 0.6, 0, 0.6}, node, box), QueryOverlap::none);
+
+    EXPECT_EQ(queryOverlap(QuerySphere<T>{0.25, 0.25, 0.25, 0.44}, node, box), QueryOverlap::full);
+    EXPECT_EQ(queryOverlap(QuerySphere<T>{0.25, 0.25, 0.25, 0.42}, node, box), QueryOverlap::partial);
+    EXPECT_EQ(queryOverlap(QuerySphere<T>{0.8, 0.8, 0.8, 0.5}, node, box), QueryOverlap::none);
+    EXPECT_EQ(queryOverlap(QuerySphere<T>{0.8, 0.8, 0.8, 0.6}, node, box), QueryOverlap::partial);
+
+    // with PBC, the sphere around (0.9, 0.1, 0.1) touches the node through the x-boundary
+    Box<T> pbcBox(0, 1, true);
+    EXPECT_EQ(queryOverlap(QuerySphere<T>{0.9, 0.1, 0.1, 0.15}, node, box), QueryOverlap::none);
+    EXPECT_EQ(queryOverlap(QuerySphere<T>{0.9, 0.1, 0.1, 0.15}, node, pbcBox), QueryOverlap::partial);
+    EXPECT_EQ(queryOverlap(QueryBox<T>{0.95, 1.05, 0, 0.1, 0, 0.1}, node, pbcBox), QueryOverlap::partial);
+
+    EXPECT_TRUE(queryContains(QueryBox<T>{0.95, 1.05, 0, 0.1, 0, 0.1}, T(0.01), T(0.05), T(0.05), pbcBox));
+    EXPECT_FALSE(queryContains(QueryBox<T>{0.95, 1.05, 0, 0.1, 0, 0.1}, T(0.01), T(0.05), T(0.05), box));
+}
+
+//! @brief query results need to match a brute force search over all particles
+template<class SfcKind, class Query>
+void rangeQueryBruteForce(const Box<double>& box, const std::vector<Query>& queries)
+{
+    using T       = double;
+    using KeyType = SfcKeyType_t<SfcKind>;
+
+    int numParticles = 5000;
+    RandomCoordinates<T, SfcKind> coords(numParticles, box);
+
+    auto [leaves, counts] =
+        computeOctree(coords.mortonCodes().data(), coords.mortonCodes().data() + numParticles, 8);
+    Octree<KeyType> octree;
+    octree.update(leaves.begin(), leaves.end());
+
+    std::vector<LocalParticleIndex> layout(octree.numLeafNodes() + 1, 0);
+    std::inclusive_scan(counts.begin(), counts.end(), layout.begin() + 1);
+
+    const T* x = coords.x().data();
+    const T* y = coords.y().data();
+    const T* z = coords.z().data();
+
+    ParticleRangeLists<LocalParticleIndex> result;
+    queryParticleRanges<KeyType, SfcKind>(octree, layout.data(), x, y, z, box, queries.data(), queries.size(),
+                                          result);
+    ASSERT_EQ(result.offsets.size(), queries.size() + 1);
+
+    std::size_t numFound = 0;
+    for (std::size_t i = 0; i < queries.size(); ++i)
+    {
+        std::vector<LocalParticleIndex> probe, reference;
+        for (std::size_t j = result.offsets[i]; j < result.offsets[i + 1]; ++j)
+        {
+            // ranges need to be non-empty, ascending and separated by at least one particle
+            EXPECT_LT(result.rangeStarts[j], result.rangeEnds[j]);
+            if (j > result.offsets[i]) { EXPECT_GT(result.rangeStarts[j], result.rangeEnds[j - 1]); }
+            for (LocalParticleIndex p = result.rangeStarts[j]; p < result.rangeEnds[j]; ++p)
+            {
+                probe.push_back(p);
+            }
+        }
+        for (LocalParticleIndex p = 0; p < LocalParticleIndex(numParticles); ++p)
+        {
+            if (queryContains(queries[i], x[p], y[p], z[p], box)) { reference.push_back(p); }
+        }
+        EXPECT_EQ(probe, reference);
+        EXPECT_EQ(result.count(i), reference.size());
+        numFound += reference.size();
+    }
+    EXPECT_GT(numFound, 0);
+}
+
+template<class SfcKind>
+void rangeQueries(bool pbc)
+{
+    using T = double;
+    Box<T> box(-1, 1, pbc);
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<T> center(-1, 1);
+    std::uniform_real_distribution<T> extent(0.01, 0.4);
+
+    std::vector<QueryBox<T>> boxes;
+    std::vector<QuerySphere<T>> spheres;
+    for (int i = 0; i < 50; ++i)
+    {
+        T cx = center(gen), cy = center(gen), cz = center(gen);
+        T hx = extent(gen), hy = extent(gen), hz = extent(gen);
+        boxes.push_back({cx - hx, cx + hx, cy - hy, cy + hy, cz - hz, cz + hz});
+        spheres.push_back({cx, cy, cz, extent(gen)});
+    }
+
+    rangeQueryBruteForce<SfcKind>(box, boxes);
+    rangeQueryBruteForce<SfcKind>(box, spheres);
+}
+
+TEST(RangeQuery, bruteForce)
+{
+    rangeQueries<MortonKey<unsigned>>(false);
+    rangeQueries<MortonKey<uint64_t>>(true);
+    rangeQueries<HilbertKey<unsigned>>(true);
+    rangeQueries<HilbertKey<uint64_t>>(false);
+}
+
+//! @brief a query that contains the whole box is pruned at the root to a single range
+TEST(RangeQuery, fullyContained)
+{
+    using KeyType = uint64_t;
+    using T       = double;
+
+    Box<T> box(0, 1);
+    int numParticles = 1000;
+    RandomCoordinates<T, KeyType> coords(numParticles, box);
+
+    auto [leaves, counts] =
+        computeOctree(coords.mortonCodes().data(), coords.mortonCodes().data() + numParticles, 4);
+    Octree<KeyType> octree;
+    octree.update(leaves.begin(), leaves.end());
+
+    std::vector<LocalParticleIndex> layout(octree.numLeafNodes() + 1, 0);
+    std::inclusive_scan(counts.begin(), counts.end(), layout.begin() + 1);
+
+    std::vector<QueryBox<T>> queries{{-0.5, 1.5, -0.5, 1.5, -0.5, 1.5}, {0, 0.5, 0, 0.5, 0, 0.5}, {2, 3, 2, 3, 2, 3}};
+
+    ParticleRangeLists<LocalParticleIndex> result;
+    queryParticleRanges(octree, layout.data(), coords.x().data(), coords.y().data(), coords.z().data(), box,
+                        queries.data(), queries.size(), result);
+
+    EXPECT_EQ(result.offsets, (std::vector<std::size_t>{0, 1, 2, 2}));
+    EXPECT_EQ(result.rangeStarts[0], 0);
+    EXPECT_EQ(result.rangeEnds[0], numParticles);
+
+    // the first octant is a subtree of the root and occupies a single range at the start of the SFC
+    KeyType octantEnd = nodeRange<KeyType>(1);
+    LocalParticleIndex octantCount =
+        std::lower_bound(coords.mortonCodes().begin(), coords.mortonCodes().end(), octantEnd) -
+        coords.mortonCodes().begin();
+    EXPECT_EQ(result.rangeStarts[1], 0);
+    EXPECT_EQ(result.rangeEnds[1], octantCount);
+}
+
+} // namespace cstone
@@ -29,6 +29,8 @@
  * @author Sebastian Keller <sebastian.f.keller@gmail.com>
  */
 
+#include <numeric>
+
 #include "gtest/gtest.h"
 
 #include "cstone/tree/octree_internal.hpp"
@@ -104,6 +106,81 @@ TEST(Traversal, dualTraversalAllPairs)
     dualTraversalAllPairs<uint64_t>();
 }
 
+//! @brief task-parallel dual traversal finds the same leaf pairs as the serial version
+template<class KeyType>
+void dualTraversalTasksAllPairs()
+{
+    Octree<KeyType> fullTree;
+    fullTree.update(OctreeMaker<KeyType>{}.divide().divide(0).divide(0, 7).divide(3).divide(3, 1).makeTree());
+    const TraversalOctree<KeyType>& tree = fullTree.traversalTree();
+
+    auto allPairs = [](TreeNodeIndex, TreeNodeIndex) { return true; };
+    auto m2l      = [](TreeNodeIndex, TreeNodeIndex) {};
+
+    std::vector<pair<TreeNodeIndex>> pairs, taskPairs;
+    auto p2p = [&pairs, &tree](TreeNodeIndex a, TreeNodeIndex b) { pairs.emplace_back(tree.toLeaf(a), tree.toLeaf(b)); };
+    auto taskP2p = [&taskPairs, &tree](TreeNodeIndex a, TreeNodeIndex b)
+    {
+        #pragma omp critical
+        taskPairs.emplace_back(tree.toLeaf(a), tree.toLeaf(b));
+    };
+
+    dualTraversal(tree, 0, 0, allPairs, m2l, p2p);
+
+    for (int taskDepth : {0, 1, 4})
+    {
+        taskPairs.clear();
+        #pragma omp parallel
+        {
+            #pragma omp single
+            dualTraversalTasks(tree, 0, 0, allPairs, m2l, taskP2p, taskDepth);
+        }
+
+        std::sort(begin(pairs), end(pairs));
+        std::sort(begin(taskPairs), end(taskPairs));
+        EXPECT_EQ(taskPairs.size(), fullTree.numLeafNodes() * fullTree.numLeafNodes());
+        EXPECT_EQ(taskPairs, pairs);
+    }
+}
+
+TEST(Traversal, dualTraversalTasksAllPairs)
+{
+    dualTraversalTasksAllPairs<unsigned>();
+    dualTraversalTasksAllPairs<uint64_t>();
+}
+
+//! @brief the traversal layout yields the same leaf pairs as the Octree
+template<class KeyType>
+void dualTraversalLayoutAllPairs()
+{
+    Octree<KeyType> fullTree;
+    fullTree.update(OctreeMaker<KeyType>{}.divide().divide(0).divide(0, 7).makeTree());
+    const TraversalOctree<KeyType>& tree = fullTree.traversalTree();
+
+    auto allPairs = [](TreeNodeIndex, TreeNodeIndex) { return true; };
+    auto m2l      = [](TreeNodeIndex, TreeNodeIndex) {};
+
+    std::vector<pair<TreeNodeIndex>> pairs, layoutPairs;
+    auto p2p = [&pairs, &fullTree](TreeNodeIndex a, TreeNodeIndex b)
+    { pairs.emplace_back(fullTree.toLeaf(a), fullTree.toLeaf(b)); };
+    auto layoutP2p = [&layoutPairs, &tree](TreeNodeIndex a, TreeNodeIndex b)
+    { layoutPairs.emplace_back(tree.toLeaf(a), tree.toLeaf(b)); };
+
+    dualTraversal(fullTree, 0, 0, allPairs, m2l, p2p);
+    dualTraversal(tree, 0, 0, allPairs, m2l, layoutP2p);
+
+    std::sort(begin(pairs), end(pairs));
+    std::sort(begin(layoutPairs), end(layoutPairs));
+    EXPECT_EQ(layoutPairs.size(), 484);
+    EXPECT_EQ(layoutPairs, pairs);
+}
+
+TEST(Traversal, dualTraversalLayoutAllPairs)
+{
+    dualTraversalLayoutAllPairs<unsigned>();
+    dualTraversalLayoutAllPairs<uint64_t>();
+}
+
 /*! @brief dual traversal with A, B across a focus range and touching each other
  *
  * This finds all pairs of leaves (a,b) that touch each other and with
@@ -161,4 +238,91 @@ TEST(Traversal, dualTraversalNeighbors)
     dualTraversalNeighbors<uint64_t>();
 }
 
-} // namespace cstone
\ No newline at end of file
+//! @brief a stackless traversal that descends everywhere visits all leaves in SFC order
+template<class KeyType>
+void stacklessTraversalAllLeaves()
+{
+    Octree<KeyType> octree;
+    octree.update(OctreeMaker<KeyType>{}.divide().divide(0).divide(0, 7).divide(7).divide(7, 7).makeTree());
+    const TraversalOctree<KeyType>& tree = octree.traversalTree();
+
+    std::vector<TreeNodeIndex> leaves, viewLeaves;
+    singleTraversalStackless(tree, [](TreeNodeIndex) { return true; },
+                             [&leaves](TreeNodeIndex idx) { leaves.push_back(idx); });
+    singleTraversalStackless(tree.data(), [](TreeNodeIndex) { return true; },
+                             [&viewLeaves](TreeNodeIndex idx) { viewLeaves.push_back(idx); });
+
+    std::vector<TreeNodeIndex> reference(octree.numLeafNodes());
+    std::iota(begin(reference), end(reference), 0);
+    EXPECT_EQ(leaves, reference);
+    EXPECT_EQ(viewLeaves, reference);
+
+    std::vector<TreeNodeIndex> none;
+    singleTraversalStackless(tree, [](TreeNodeIndex) { return false; },
+                             [&none](TreeNodeIndex idx) { none.push_back(idx); });
+    EXPECT_TRUE(none.empty());
+}
+
+TEST(Traversal, stacklessTraversalAllLeaves)
+{
+    stacklessTraversalAllLeaves<unsigned>();
+    stacklessTraversalAllLeaves<uint64_t>();
+}
+
+//! @brief one stackless traversal per target leaf finds the same touching cross-focus pairs as dualTraversal
+template<class KeyType>
+void dualTraversalStacklessNeighbors()
+{
+    Octree<KeyType> octree;
+    octree.update(OctreeMaker<KeyType>{}.divide().divide(0).divide(0, 7).divide(1).divide(6).divide(6, 0).makeTree());
+    const TraversalOctree<KeyType>& tree = octree.traversalTree();
+
+    Box<float> box(0, 1);
+    TreeNodeIndex focusLeafEnd = 12;
+    KeyType focusStart = octree.treeLeaves()[0];
+    KeyType focusEnd   = octree.treeLeaves()[focusLeafEnd];
+
+    auto touchingCrossFocus = [focusStart, focusEnd, &box](KeyType aStart, KeyType aEnd, KeyType bStart, KeyType bEnd)
+    {
+        bool aFocusOverlap = overlapTwoRanges(focusStart, focusEnd, aStart, aEnd);
+        bool bInFocus      = containedIn(bStart, bEnd, focusStart, focusEnd);
+        if (!aFocusOverlap || bInFocus) { return false; }
+
+        return minDistanceSq<KeyType>(makeIBox(aStart, aEnd), makeIBox(bStart, bEnd), box) == 0.0;
+    };
+
+    auto octreeCriterion = [&octree, &touchingCrossFocus](TreeNodeIndex a, TreeNodeIndex b)
+    { return touchingCrossFocus(octree.codeStart(a), octree.codeEnd(a), octree.codeStart(b), octree.codeEnd(b)); };
+    auto layoutCriterion = [&tree, &touchingCrossFocus](TreeNodeIndex a, TreeNodeIndex b)
+    { return touchingCrossFocus(tree.codeStart(a), tree.codeEnd(a), tree.codeStart(b), tree.codeEnd(b)); };
+
+    auto m2l = [](TreeNodeIndex, TreeNodeIndex) {};
+
+    std::vector<pair<TreeNodeIndex>> pairs, stacklessPairs;
+    auto p2p = [&pairs, &octree](TreeNodeIndex a, TreeNodeIndex b)
+    { pairs.emplace_back(octree.toLeaf(a), octree.toLeaf(b)); };
+    auto stacklessP2p = [&stacklessPairs, &tree](TreeNodeIndex a, TreeNodeIndex b)
+    { stacklessPairs.emplace_back(tree.toLeaf(a), tree.toLeaf(b)); };
+
+    dualTraversal(octree, 0, 0, octreeCriterion, m2l, p2p);
+
+    for (TreeNodeIndex i = 0; i < focusLeafEnd; ++i)
+    {
+        KeyType leafStart = octree.treeLeaves()[i];
+        KeyType leafEnd   = octree.treeLeaves()[i + 1];
+        dualTraversalStackless(tree, tree.locate(leafStart, leafEnd), layoutCriterion, m2l, stacklessP2p);
+    }
+
+    std::sort(begin(pairs), end(pairs));
+    std::sort(begin(stacklessPairs), end(stacklessPairs));
+    EXPECT_FALSE(pairs.empty());
+    EXPECT_EQ(stacklessPairs, pairs);
+}
+
+TEST(Traversal, dualTraversalStacklessNeighbors)
+{
+    dualTraversalStacklessNeighbors<unsigned>();
+    dualTraversalStacklessNeighbors<uint64_t>();
+}
+
+} // namespace cstone
@@ -30,6 +30,9 @@
  *
  */
 
+#include <algorithm>
+#include <numeric>
+
 #include "gtest/gtest.h"
 
 #include "cstone/tree/upsweep.hpp"
@@ -146,3 +149,55 @@ TEST(Upsweep, sumIrregularL3)
     upsweepSumIrregularL3<unsigned>();
     upsweepSumIrregularL3<uint64_t>();
 }
+
+//! @brief a multi-field upsweep has to produce the same results as one upsweep per field
+template<class KeyType>
+void upsweepFieldsMatchesUpsweep()
+{
+    std::vector<KeyType> leaves =
+        OctreeMaker<KeyType>{}.divide().divide(0).divide(0, 2).divide(3).divide(3, 7).makeTree();
+
+    Octree<KeyType> octree;
+    octree.update(leaves.data(), leaves.data() + leaves.size());
+
+    TreeNodeIndex numLeaves   = octree.numLeafNodes();
+    TreeNodeIndex numInternal = octree.numInternalNodes();
+
+    std::vector<unsigned> leafCounts(numLeaves);
+    std::vector<float> leafH(numLeaves);
+    std::vector<double> leafMass(numLeaves);
+    for (TreeNodeIndex i = 0; i < numLeaves; ++i)
+    {
+        leafCounts[i] = i % 5;
+        leafH[i]      = 0.1f * (i % 7);
+        leafMass[i]   = 1.5 * i;
+    }
+
+    auto sumFunction = [](auto a, auto b, auto c, auto d, auto e, auto f, auto g, auto h)
+    { return a + b + c + d + e + f + g + h; };
+    auto maxFunction = [](auto a, auto b, auto c, auto d, auto e, auto f, auto g, auto h)
+    { return std::max({a, b, c, d, e, f, g, h}); };
+
+    std::vector<unsigned> refCounts(numInternal), counts(numInternal);
+    std::vector<float> refH(numInternal), h(numInternal);
+    std::vector<double> refMass(numInternal), mass(numInternal);
+
+    upsweep(octree, leafCounts.data(), refCounts.data(), sumFunction);
+    upsweep(octree, leafH.data(), refH.data(), maxFunction);
+    upsweep(octree, leafMass.data(), refMass.data(), sumFunction);
+
+    upsweepFields(octree, std::make_tuple(upsweepField(leafCounts.data(), counts.data(), sumFunction),
+                                          upsweepField(leafH.data(), h.data(), maxFunction),
+                                          upsweepField(leafMass.data(), mass.data(), sumFunction)));
+
+    EXPECT_EQ(counts, refCounts);
+    EXPECT_EQ(h, refH);
+    EXPECT_EQ(mass, refMass);
+    EXPECT_EQ(counts[0], std::accumulate(leafCounts.begin(), leafCounts.end(), 0u));
+}
+
+TEST(Upsweep, fieldsMatchSingleUpsweeps)
+{
+    upsweepFieldsMatchesUpsweep<unsigned>();
+    upsweepFieldsMatchesUpsweep<uint64_t>();
+}
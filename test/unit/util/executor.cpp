@@ -0,0 +1,231 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for the dispatch of parallel loops through executors
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <numeric>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "cstone/primitives/radix_sort.hpp"
+#include "cstone/primitives/scan.hpp"
+#include "cstone/sfc/sfc.hpp"
+#include "cstone/tree/octree.hpp"
+#include "cstone/util/executor.hpp"
+
+#include "coord_samples/random.hpp"
+
+namespace cstone
+{
+
+//! @brief minimal thread pool stand-in, each run distributes the tasks over a fixed number of std::threads
+class ThreadExecutor : public Executor
+{
+public:
+    explicit ThreadExecutor(int numThreads)
+        : numThreads_(numThreads)
+    {
+    }
+
+    int concurrency() const override { return numThreads_; }
+
+    void run(std::size_t numTasks, TaskRef task) override
+    {
+        numRuns++;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < numThreads_; ++t)
+        {
+            threads.emplace_back([t, numTasks, task, this]()
+            {
+                for (std::size_t i = t; i < numTasks; i += numThreads_)
+                {
+                    task(i);
+                }
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    int numRuns{0};
+
+private:
+    int numThreads_;
+};
+
+TEST(Executor, scopedExecutor)
+{
+    EXPECT_EQ(currentExecutor(), nullptr);
+
+    SerialExecutor serial;
+    ThreadExecutor threads(3);
+    {
+        ScopedExecutor outer(&serial);
+        EXPECT_EQ(currentExecutor(), &serial);
+        EXPECT_EQ(parallelism(), 1);
+        {
+            ScopedExecutor inner(&threads);
+            EXPECT_EQ(currentExecutor(), &threads);
+            EXPECT_EQ(parallelism(), 3);
+        }
+        EXPECT_EQ(currentExecutor(), &serial);
+    }
+    EXPECT_EQ(currentExecutor(), nullptr);
+}
+
+//! @brief each index of the loop range needs to be visited exactly once, with any executor
+TEST(Executor, parallelFor)
+{
+    SerialExecutor serial;
+    OmpExecutor omp;
+    ThreadExecutor threads(4);
+
+    for (Executor* executor : std::vector<Executor*>{nullptr, &serial, &omp, &threads})
+    {
+        ScopedExecutor scope(executor);
+        for (int numElements : {0, 1, 7, 1000})
+        {
+            std::vector<int> visits(numElements + 10, 0);
+            parallelFor(10, numElements + 10, [&visits](int i) { visits[i]++; });
+
+            EXPECT_EQ(std::accumulate(visits.begin(), visits.begin() + 10, 0), 0);
+            EXPECT_EQ(std::count(visits.begin() + 10, visits.end(), 1), numElements);
+        }
+    }
+    EXPECT_GT(threads.numRuns, 0);
+}
+
+TEST(Executor, parallelReduce)
+{
+    SerialExecutor serial;
+    ThreadExecutor threads(4);
+
+    for (Executor* executor : std::vector<Executor*>{nullptr, &serial, &threads})
+    {
+        ScopedExecutor scope(executor);
+        for (int numElements : {0, 1, 7, 1000})
+        {
+            long sum = parallelReduce(0, numElements, 0L, [](int i) { return long(i); }, std::plus<long>{});
+            EXPECT_EQ(sum, long(numElements) * (numElements - 1) / 2);
+
+            bool allBelow = parallelReduce(
+                0, numElements, true, [numElements](int i) { return i < numElements - 1; },
+                [](bool a, bool b) { return a && b; });
+            EXPECT_EQ(allBelow, numElements == 0);
+        }
+    }
+}
+
+TEST(Executor, exclusiveScan)
+{
+    std::vector<unsigned> input(100000);
+    std::iota(input.begin(), input.end(), 0);
+
+    std::vector<uint64_t> reference(input.size());
+    std::exclusive_scan(input.begin(), input.end(), reference.begin(), uint64_t(0));
+
+    ThreadExecutor threads(4);
+    ScopedExecutor scope(&threads);
+
+    std::vector<uint64_t> probe(input.size());
+    exclusiveScan(input.data(), probe.data(), input.size());
+    EXPECT_EQ(probe, reference);
+
+    std::vector<uint64_t> inplace(input.begin(), input.end());
+    exclusiveScan(inplace.data(), inplace.size());
+    EXPECT_EQ(inplace, reference);
+    EXPECT_EQ(threads.numRuns, 4);
+}
+
+//! @brief SFC keys and octree node counts with a custom executor need to match the default OpenMP results
+template<class SfcKind>
+void executorTreeBuild()
+{
+    using KeyType = SfcKeyType_t<SfcKind>;
+
+    Box<double> box(-1, 1);
+    int numParticles = 20000;
+    RandomGaussianCoordinates<double, SfcKind> coords(numParticles, box);
+    const auto& x = coords.x();
+
+    std::vector<KeyType> keys(numParticles), probeKeys(numParticles);
+    computeSfcKeys<SfcKind>(x.begin(), x.end(), coords.y().begin(), coords.z().begin(), keys.begin(), box);
+
+    const KeyType* sortedKeys = coords.mortonCodes().data();
+    auto [tree, counts]       = computeOctree(sortedKeys, sortedKeys + numParticles, 16);
+    std::vector<unsigned> probeCounts(counts.size());
+
+    std::vector<KeyType> updatedTree{0, nodeRange<KeyType>(0)};
+    std::vector<unsigned> updatedCounts{unsigned(numParticles)};
+    while (!updateOctree(sortedKeys, sortedKeys + numParticles, 16, updatedTree, updatedCounts)) {}
+
+    std::vector<KeyType> sortedProbeKeys(numParticles);
+    std::vector<LocalParticleIndex> ordering(numParticles);
+
+    ThreadExecutor threads(3);
+    {
+        ScopedExecutor scope(&threads);
+        computeSfcKeys<SfcKind>(x.begin(), x.end(), coords.y().begin(), coords.z().begin(), probeKeys.begin(), box);
+        computeNodeCounts(tree.data(), probeCounts.data(), nNodes(tree), sortedKeys, sortedKeys + numParticles,
+                          std::numeric_limits<unsigned>::max());
+
+        sortedProbeKeys = probeKeys;
+        std::iota(ordering.begin(), ordering.end(), 0);
+        radixSortByKey(sortedProbeKeys.data(), ordering.data(), numParticles);
+
+        std::vector<KeyType> probeTree{0, nodeRange<KeyType>(0)};
+        std::vector<unsigned> probeTreeCounts{unsigned(numParticles)};
+        while (!updateOctree(sortedKeys, sortedKeys + numParticles, 16, probeTree, probeTreeCounts)) {}
+        EXPECT_EQ(probeTree, updatedTree);
+        EXPECT_EQ(probeTreeCounts, updatedCounts);
+    }
+
+    EXPECT_EQ(probeKeys, keys);
+    EXPECT_EQ(probeCounts, counts);
+    EXPECT_EQ(updatedTree, tree);
+
+    EXPECT_TRUE(std::is_sorted(sortedProbeKeys.begin(), sortedProbeKeys.end()));
+    for (int i = 0; i < numParticles; ++i)
+    {
+        EXPECT_EQ(sortedProbeKeys[i], keys[ordering[i]]);
+        if (i > 0 && sortedProbeKeys[i] == sortedProbeKeys[i - 1]) { EXPECT_LT(ordering[i - 1], ordering[i]); }
+    }
+    EXPECT_GE(threads.numRuns, 2);
+}
+
+TEST(Executor, treeBuild)
+{
+    executorTreeBuild<MortonKey<uint64_t>>();
+    executorTreeBuild<HilbertKey<unsigned>>();
+}
+
+} // namespace cstone
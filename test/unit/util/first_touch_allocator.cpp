@@ -0,0 +1,81 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for the NUMA first-touch allocator
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "cstone/util/first_touch_allocator.hpp"
+
+using namespace cstone;
+
+//! @brief first touch must not change the value-initialization semantics of std::vector
+TEST(FirstTouchAllocator, valueInit)
+{
+    for (std::size_t n : {std::size_t(0), std::size_t(10), std::size_t(1000000)})
+    {
+        FirstTouchVector<double> v(n);
+        EXPECT_EQ(v.size(), n);
+        EXPECT_TRUE(std::all_of(v.begin(), v.end(), [](double x) { return x == 0.0; }));
+
+        FirstTouchVector<int> w(n, 7);
+        EXPECT_TRUE(std::all_of(w.begin(), w.end(), [](int x) { return x == 7; }));
+    }
+}
+
+//! @brief growing beyond the capacity preserves existing elements and value-initializes the new ones
+TEST(FirstTouchAllocator, grow)
+{
+    FirstTouchVector<unsigned> v(100);
+    std::iota(v.begin(), v.end(), 0u);
+
+    v.resize(1000000);
+
+    EXPECT_EQ(v.size(), 1000000);
+    EXPECT_GE(v.capacity(), 1000000);
+
+    std::vector<unsigned> reference(100);
+    std::iota(reference.begin(), reference.end(), 0u);
+    EXPECT_TRUE(std::equal(reference.begin(), reference.end(), v.begin()));
+    EXPECT_TRUE(std::all_of(v.begin() + 100, v.end(), [](unsigned x) { return x == 0; }));
+}
+
+TEST(FirstTouchAllocator, rebind)
+{
+    FirstTouchAllocator<double> a;
+    FirstTouchAllocator<char> b(a);
+    EXPECT_TRUE(a == b);
+
+    using Rebound = std::allocator_traits<FirstTouchAllocator<double>>::rebind_alloc<int>;
+    static_assert(std::is_same_v<Rebound, FirstTouchAllocator<int>>);
+}
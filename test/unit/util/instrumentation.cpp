@@ -0,0 +1,139 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for the sync instrumentation hooks
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "cstone/util/instrumentation.hpp"
+
+using namespace cstone;
+
+//! @brief records the sequence of phase events
+class RecordingObserver : public SyncObserver
+{
+public:
+    void beginPhase(SyncPhase phase) override { events.push_back(int(phase) + 1); }
+    void endPhase(SyncPhase phase) override { events.push_back(-int(phase) - 1); }
+
+    std::vector<int> events;
+};
+
+TEST(Instrumentation, phaseScope)
+{
+    RecordingObserver observer;
+    {
+        PhaseScope phase(&observer, SyncPhase::box);
+        phase.next(SyncPhase::keys);
+        phase.next(SyncPhase::box);
+    }
+    std::vector<int> reference{1, -1, 2, -2, 1, -1};
+    EXPECT_EQ(observer.events, reference);
+
+    observer.events.clear();
+    {
+        PhaseScope phase(&observer, SyncPhase::sort);
+        phase.end();
+        phase.next(SyncPhase::keys);
+    }
+    EXPECT_EQ(observer.events, (std::vector<int>{3, -3}));
+
+    // without observer, nothing happens
+    PhaseScope phase(nullptr, SyncPhase::box);
+    phase.next(SyncPhase::keys);
+    phase.recordIterations(1);
+}
+
+TEST(Instrumentation, syncTimer)
+{
+    SyncTimer timer;
+    {
+        PhaseScope phase(&timer, SyncPhase::globalTree);
+        phase.recordIterations(3);
+        phase.next(SyncPhase::particleExchange);
+        phase.recordTraffic({100, 50, 2, 1});
+        phase.next(SyncPhase::globalTree);
+        phase.recordIterations(1);
+    }
+
+    EXPECT_EQ(timer.counters(SyncPhase::globalTree).calls, 2);
+    EXPECT_EQ(timer.counters(SyncPhase::globalTree).iterations, 4);
+    EXPECT_GE(timer.counters(SyncPhase::globalTree).seconds, 0.0);
+    EXPECT_EQ(timer.counters(SyncPhase::particleExchange).traffic.bytesSent, 100);
+    EXPECT_EQ(timer.counters(SyncPhase::particleExchange).traffic.messagesReceived, 1);
+    EXPECT_EQ(timer.counters(SyncPhase::box).calls, 0);
+
+    timer.reset();
+    EXPECT_EQ(timer.counters(SyncPhase::globalTree).calls, 0);
+}
+
+TEST(Instrumentation, sendListTraffic)
+{
+    SendList outgoing(3), incoming(3);
+    outgoing[0].addRange(0, 10);
+    outgoing[1].addRange(10, 15);
+    outgoing[2].addRange(15, 18);
+    outgoing[2].addRange(20, 22);
+    incoming[1].addRange(30, 37);
+
+    PhaseTraffic traffic = sendListTraffic(outgoing, incoming, 1, 8);
+    EXPECT_EQ(traffic.bytesSent, (10 + 5) * 8);
+    EXPECT_EQ(traffic.messagesSent, 2);
+    // the ranges of the executing rank are not communicated
+    EXPECT_EQ(traffic.bytesReceived, 0);
+    EXPECT_EQ(traffic.messagesReceived, 0);
+}
+
+TEST(Instrumentation, peerVolumes)
+{
+    SendList outgoing(4), incoming(4);
+    outgoing[0].addRange(0, 10);
+    outgoing[1].addRange(10, 15);
+    incoming[1].addRange(30, 37);
+    incoming[3].addRange(40, 44);
+
+    EXPECT_EQ(numExchangePeers(incoming, outgoing, 1), 2);
+
+    std::vector<PeerVolume> volumes = peerVolumes(sendListCounts(outgoing), sendListCounts(incoming), 1, 8);
+    ASSERT_EQ(volumes.size(), 2);
+
+    EXPECT_EQ(volumes[0].rank, 0);
+    EXPECT_EQ(volumes[0].elementsSent, 10);
+    EXPECT_EQ(volumes[0].bytesSent, 80);
+    EXPECT_EQ(volumes[0].messagesSent, 1);
+    EXPECT_EQ(volumes[0].messagesReceived, 0);
+
+    EXPECT_EQ(volumes[1].rank, 3);
+    EXPECT_EQ(volumes[1].elementsReceived, 4);
+    EXPECT_EQ(volumes[1].bytesReceived, 32);
+    EXPECT_EQ(volumes[1].messagesSent, 0);
+    EXPECT_EQ(volumes[1].messagesReceived, 1);
+}
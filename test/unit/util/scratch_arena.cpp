@@ -0,0 +1,85 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for the monotonic scratch arena
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <algorithm>
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+#include "cstone/util/scratch_arena.hpp"
+
+using namespace cstone;
+
+//! @brief spans of one cycle must not overlap, including those served from overflow blocks
+TEST(ScratchArena, disjointAllocations)
+{
+    ScratchArena arena;
+
+    auto a = arena.allocate<int>(1000);
+    auto b = arena.allocate<double>(3);
+    auto c = arena.allocate<uint64_t>(500);
+
+    std::fill(a.begin(), a.end(), 1);
+    std::fill(b.begin(), b.end(), 2.0);
+    std::fill(c.begin(), c.end(), 3);
+
+    EXPECT_TRUE(std::all_of(a.begin(), a.end(), [](int x) { return x == 1; }));
+    EXPECT_TRUE(std::all_of(b.begin(), b.end(), [](double x) { return x == 2.0; }));
+    EXPECT_TRUE(std::all_of(c.begin(), c.end(), [](uint64_t x) { return x == 3; }));
+
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(b.data()) % alignof(double), 0);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(c.data()) % alignof(uint64_t), 0);
+}
+
+//! @brief after a reset, the same allocation sequence is served from the main block without growth
+TEST(ScratchArena, steadyState)
+{
+    ScratchArena arena;
+    EXPECT_EQ(arena.capacity(), 0);
+
+    auto allocationCycle = [&arena]()
+    {
+        arena.reset();
+        auto a = arena.allocate<float>(10000);
+        auto b = arena.allocate<int>(333);
+        return std::make_pair(a.data(), reinterpret_cast<void*>(b.data()));
+    };
+
+    allocationCycle();
+    auto [a1, b1] = allocationCycle();
+    std::size_t capacity = arena.capacity();
+    EXPECT_GE(capacity, 10000 * sizeof(float) + 333 * sizeof(int));
+
+    auto [a2, b2] = allocationCycle();
+    EXPECT_EQ(a1, a2);
+    EXPECT_EQ(b1, b2);
+    EXPECT_EQ(arena.capacity(), capacity);
+}
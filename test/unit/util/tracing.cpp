@@ -0,0 +1,96 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief Tests for the Chrome trace backend of the trace ranges
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "cstone/tree/octree.hpp"
+#include "cstone/util/tracing.hpp"
+
+using namespace cstone;
+
+#ifndef CSTONE_HAVE_NVTX
+
+TEST(Tracing, nestedRanges)
+{
+    TraceRecorder::instance().clear();
+    {
+        CSTONE_TRACE_RANGE("outer");
+        {
+            CSTONE_TRACE_RANGE("inner");
+        }
+    }
+
+    std::vector<TraceEvent> events = TraceRecorder::instance().events();
+    ASSERT_EQ(events.size(), 2);
+    // ranges are recorded when they end
+    EXPECT_EQ(std::string(events[0].name), "inner");
+    EXPECT_EQ(std::string(events[1].name), "outer");
+    EXPECT_LE(events[1].startMicroseconds, events[0].startMicroseconds);
+    EXPECT_GE(events[1].startMicroseconds + events[1].durationMicroseconds,
+              events[0].startMicroseconds + events[0].durationMicroseconds);
+}
+
+TEST(Tracing, libraryRanges)
+{
+    TraceRecorder::instance().clear();
+
+    std::vector<unsigned> keys{1, 2, 3, 1000, 2000, 3000};
+    std::vector<unsigned> tree{0, nodeRange<unsigned>(0)}, counts{unsigned(keys.size())};
+    updateOctree(keys.data(), keys.data() + keys.size(), 1, tree, counts);
+
+    std::vector<TraceEvent> events = TraceRecorder::instance().events();
+    auto hasRange = [&events](const std::string& name)
+    {
+        return std::any_of(events.begin(), events.end(), [&name](const auto& e) { return name == e.name; });
+    };
+    EXPECT_TRUE(hasRange("updateOctree"));
+    EXPECT_TRUE(hasRange("computeNodeCounts"));
+    EXPECT_TRUE(hasRange("rebalanceTree"));
+
+    std::string filename = "tracing_test.json";
+    writeChromeTrace(filename, 3);
+
+    std::ifstream in(filename);
+    std::stringstream content;
+    content << in.rdbuf();
+    EXPECT_EQ(content.str().rfind("{\"traceEvents\":[", 0), 0);
+    EXPECT_NE(content.str().find("\"name\":\"updateOctree\",\"ph\":\"X\",\"pid\":3"), std::string::npos);
+    std::remove(filename.c_str());
+}
+
+#endif
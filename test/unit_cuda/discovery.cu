@@ -0,0 +1,98 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief GPU halo discovery tests
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+
+#include "gtest/gtest.h"
+
+#include "cstone/halos/discovery.cuh"
+#include "cstone/halos/discovery.hpp"
+#include "cstone/tree/btree.cuh"
+#include "cstone/tree/octree_util.hpp"
+
+#include "coord_samples/random.hpp"
+
+using namespace cstone;
+
+//! @brief the halo flags from the GPU need to match the CPU version
+template<class KeyType>
+void findHalosFlagsGpu()
+{
+    Box<double> box(0, 1, 0, 1, 0, 1, true, false, true);
+    int numParticles = 20000;
+    RandomGaussianCoordinates<double, KeyType> coords(numParticles, box);
+
+    auto [tree, counts] = computeOctree(coords.mortonCodes().data(), coords.mortonCodes().data() + numParticles, 16);
+    std::vector<float> interactionRadii(nNodes(tree));
+    for (size_t i = 0; i < interactionRadii.size(); ++i) { interactionRadii[i] = 0.01 + 0.02 * (i % 5); }
+
+    TreeNodeIndex firstNode = nNodes(tree) / 3;
+    TreeNodeIndex lastNode  = 2 * nNodes(tree) / 3;
+
+    Octree<KeyType> octree;
+    octree.update(tree.begin(), tree.end());
+    std::vector<int> reference(nNodes(tree), 0);
+    findHalos<KeyType, float>(octree, interactionRadii, box, firstNode, lastNode, reference.data());
+
+    thrust::device_vector<KeyType> d_tree = tree;
+    thrust::device_vector<BinaryNode<KeyType>> d_binaryTree(nNodes(tree));
+    createBinaryTreeGpu(thrust::raw_pointer_cast(d_tree.data()), nNodes(tree),
+                        thrust::raw_pointer_cast(d_binaryTree.data()));
+
+    thrust::device_vector<float> d_radii = interactionRadii;
+    thrust::device_vector<int> d_flags(nNodes(tree), 0);
+
+    findHalosGpu(thrust::raw_pointer_cast(d_tree.data()), thrust::raw_pointer_cast(d_binaryTree.data()),
+                 thrust::raw_pointer_cast(d_radii.data()), box, firstNode, lastNode,
+                 thrust::raw_pointer_cast(d_flags.data()));
+
+    thrust::host_vector<int> h_flags = d_flags;
+    std::vector<int> flags(h_flags.begin(), h_flags.end());
+    EXPECT_EQ(flags, reference);
+}
+
+TEST(HaloDiscoveryGpu, findHalosFlags)
+{
+    findHalosFlagsGpu<unsigned>();
+    findHalosFlagsGpu<uint64_t>();
+}
+
+TEST(HaloDiscoveryGpu, flaggedIndices)
+{
+    std::vector<int> flags{0, 1, 1, 0, 0, 1, 0, 1, 1};
+    thrust::device_vector<int> d_flags = flags;
+
+    std::vector<TreeNodeIndex> indices = flaggedIndicesGpu(thrust::raw_pointer_cast(d_flags.data()), flags.size());
+
+    std::vector<TreeNodeIndex> reference{1, 2, 5, 7, 8};
+    EXPECT_EQ(indices, reference);
+}
@@ -35,6 +35,8 @@
 #include <random>
 #include <vector>
 
+#include <cuda_runtime.h>
+
 #include "gtest/gtest.h"
 
 #include "cstone/primitives/gather.hpp"
@@ -157,3 +159,74 @@ TEST(DeviceGather, reallocate)
     reorderCheck<double, unsigned, uint64_t>(nElements, true);
     reorderCheck<double, uint64_t, uint64_t>(nElements, true);
 }
+
+//! @brief reorder several host arrays in one pipelined call and device arrays on a user stream
+template<class T, class I, class IndexType>
+void multiArrayCheck(int nElements, int numArrays)
+{
+    std::vector<I> origKeys = makeRandomPermutation<I>(nElements);
+
+    std::vector<std::vector<T>> arrays(numArrays, std::vector<T>(nElements));
+    for (int a = 0; a < numArrays; ++a)
+    {
+        std::iota(begin(arrays[a]), end(arrays[a]), a * nElements);
+    }
+    std::vector<std::vector<T>> refArrays = arrays;
+
+    std::vector<I> hostKeys = origKeys;
+    std::vector<IndexType> hostOrder(nElements);
+    std::iota(begin(hostOrder), end(hostOrder), 0u);
+    cstone::sort_by_key(begin(hostKeys), end(hostKeys), begin(hostOrder));
+    for (auto& refArray : refArrays)
+    {
+        cstone::reorder(hostOrder, refArray);
+    }
+
+    cstone::DeviceGather<T, I, IndexType> devGather;
+
+    std::vector<I> keys = origKeys;
+    devGather.setMapFromCodes(keys.data(), keys.data() + keys.size());
+
+    std::vector<T*> arrayPointers(numArrays);
+    for (int a = 0; a < numArrays; ++a)
+    {
+        arrayPointers[a] = arrays[a].data();
+    }
+    devGather(arrayPointers.data(), numArrays);
+    EXPECT_EQ(arrays, refArrays);
+
+    // same reorder with keys and values in device memory
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+
+    I* d_keys;
+    T* d_values;
+    cudaMalloc((void**)&d_keys, nElements * sizeof(I));
+    cudaMalloc((void**)&d_values, nElements * sizeof(T));
+    cudaMemcpy(d_keys, origKeys.data(), nElements * sizeof(I), cudaMemcpyHostToDevice);
+
+    std::vector<T> values(nElements);
+    std::iota(begin(values), end(values), 0);
+    cudaMemcpy(d_values, values.data(), nElements * sizeof(T), cudaMemcpyHostToDevice);
+
+    devGather.setMapFromCodesDevice(d_keys, d_keys + nElements, stream);
+    devGather.reorderDevice(d_values, stream);
+    cudaStreamSynchronize(stream);
+
+    std::vector<I> deviceKeys(nElements);
+    cudaMemcpy(deviceKeys.data(), d_keys, nElements * sizeof(I), cudaMemcpyDeviceToHost);
+    cudaMemcpy(values.data(), d_values, nElements * sizeof(T), cudaMemcpyDeviceToHost);
+    EXPECT_EQ(deviceKeys, hostKeys);
+    EXPECT_EQ(values, refArrays[0]);
+
+    cudaFree(d_keys);
+    cudaFree(d_values);
+    cudaStreamDestroy(stream);
+}
+
+TEST(DeviceGather, multipleArrays)
+{
+    multiArrayCheck<double, unsigned, unsigned>(10000, 1);
+    multiArrayCheck<double, unsigned, unsigned>(10000, 14);
+    multiArrayCheck<float, uint64_t, unsigned>(10000, 5);
+}
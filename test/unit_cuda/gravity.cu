@@ -0,0 +1,105 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  GPU gravity tests
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <numeric>
+
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+
+#include "gtest/gtest.h"
+
+#include "cstone/gravity/gravity.cuh"
+#include "cstone/tree/octree.hpp"
+
+#include "coord_samples/random.hpp"
+
+using namespace cstone;
+
+//! @brief the GPU evaluation of the interaction lists needs to match the CPU version
+template<class KeyType>
+void gravityGpu()
+{
+    using T         = double;
+    constexpr int P = 2;
+    constexpr int numTerms = multipoleNumTerms(P);
+
+    Box<T> box(-1, 1);
+    int numParticles = 10000;
+    RandomGaussianCoordinates<T, KeyType> coords(numParticles, box);
+    std::vector<T> m(numParticles, 1.0 / numParticles);
+
+    auto [leaves, counts] =
+        computeOctree(coords.mortonCodes().data(), coords.mortonCodes().data() + numParticles, 32);
+    std::vector<LocalParticleIndex> layout(nNodes(leaves) + 1, 0);
+    std::inclusive_scan(counts.begin(), counts.end(), layout.begin() + 1);
+
+    Octree<KeyType> octree;
+    octree.update(leaves.begin(), leaves.end());
+    Multipoles<T, P> multipoles;
+    computeMultipoles(octree, layout.data(), coords.x().data(), coords.y().data(), coords.z().data(), m.data(), box,
+                      multipoles);
+
+    std::vector<T> ax(numParticles), ay(numParticles), az(numParticles), phi(numParticles);
+    computeGravity(octree, layout.data(), coords.x().data(), coords.y().data(), coords.z().data(), m.data(),
+                   multipoles.view(), box, 0.6, T(1), T(0.01), ax.data(), ay.data(), az.data(), phi.data());
+
+    TreeNodeIndex numNodes = octree.numTreeNodes();
+    MultipoleView<T, P> view = multipoles.view();
+    thrust::device_vector<T> d_cx(view.x, view.x + numNodes), d_cy(view.y, view.y + numNodes),
+        d_cz(view.z, view.z + numNodes), d_moments(view.moments, view.moments + numNodes * numTerms);
+    MultipoleView<T, P> d_view{thrust::raw_pointer_cast(d_cx.data()), thrust::raw_pointer_cast(d_cy.data()),
+                               thrust::raw_pointer_cast(d_cz.data()), thrust::raw_pointer_cast(d_moments.data()),
+                               numNodes};
+
+    thrust::device_vector<LocalParticleIndex> d_layout = layout;
+    thrust::device_vector<T> d_x = coords.x(), d_y = coords.y(), d_z = coords.z(), d_m = m;
+    thrust::device_vector<T> d_ax(numParticles), d_ay(numParticles), d_az(numParticles), d_phi(numParticles);
+
+    computeGravityGpu<T, P, KeyType>(octree, view, thrust::raw_pointer_cast(d_layout.data()),
+                                     thrust::raw_pointer_cast(d_x.data()), thrust::raw_pointer_cast(d_y.data()),
+                                     thrust::raw_pointer_cast(d_z.data()), thrust::raw_pointer_cast(d_m.data()),
+                                     d_view, box, 0.6, T(1), T(0.01), thrust::raw_pointer_cast(d_ax.data()),
+                                     thrust::raw_pointer_cast(d_ay.data()), thrust::raw_pointer_cast(d_az.data()),
+                                     thrust::raw_pointer_cast(d_phi.data()), 100);
+
+    thrust::host_vector<T> h_ax = d_ax, h_phi = d_phi;
+    for (int i = 0; i < numParticles; ++i)
+    {
+        EXPECT_NEAR(h_ax[i], ax[i], 1e-10 * std::abs(ax[i]));
+        EXPECT_NEAR(h_phi[i], phi[i], 1e-10 * std::abs(phi[i]));
+    }
+}
+
+TEST(GravityGpu, computeGravity)
+{
+    gravityGpu<unsigned>();
+    gravityGpu<uint64_t>();
+}
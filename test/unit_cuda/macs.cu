@@ -0,0 +1,126 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  GPU MAC marking tests
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+
+#include "gtest/gtest.h"
+
+#include "cstone/tree/macs.cuh"
+#include "cstone/tree/octree_util.hpp"
+
+using namespace cstone;
+
+//! @brief extract the node key ranges through the device view
+template<class KeyType>
+__global__ void extractNodeRanges(OctreeGpuDataView<KeyType> tree, KeyType* starts, KeyType* ends)
+{
+    unsigned tid = blockDim.x * blockIdx.x + threadIdx.x;
+    if (tid < tree.numTreeNodes())
+    {
+        starts[tid] = tree.codeStart(tid);
+        ends[tid]   = tree.codeEnd(tid);
+    }
+}
+
+//! @brief GPU markings have to match the CPU markings of the node with the same key range
+template<class KeyType>
+void markMacGpuMatchesCpu(const std::vector<KeyType>& leaves, const Box<double>& box, KeyType focusStart,
+                          KeyType focusEnd, float theta)
+{
+    float invThetaSq = 1.0f / (theta * theta);
+
+    Octree<KeyType> cpuTree;
+    cpuTree.update(begin(leaves), end(leaves));
+    std::vector<char> cpuMarkings(cpuTree.numTreeNodes());
+    markMac(cpuTree, box, focusStart, focusEnd, invThetaSq, cpuMarkings.data());
+
+    thrust::device_vector<KeyType> d_leaves = leaves;
+    OctreeGpu<KeyType> gpuTree;
+    gpuTree.update(thrust::raw_pointer_cast(d_leaves.data()), thrust::raw_pointer_cast(d_leaves.data()) + d_leaves.size());
+
+    TreeNodeIndex numNodes = gpuTree.numTreeNodes();
+    thrust::device_vector<char> d_markings(numNodes);
+    markMacGpu(gpuTree.data(), box, focusStart, focusEnd, invThetaSq, thrust::raw_pointer_cast(d_markings.data()));
+
+    thrust::device_vector<KeyType> starts(numNodes), ends(numNodes);
+    constexpr int nThreads = 256;
+    extractNodeRanges<<<iceil(numNodes, nThreads), nThreads>>>(gpuTree.data(), thrust::raw_pointer_cast(starts.data()),
+                                                               thrust::raw_pointer_cast(ends.data()));
+
+    thrust::host_vector<char>    h_markings = d_markings;
+    thrust::host_vector<KeyType> h_starts = starts, h_ends = ends;
+
+    int numMarked = 0;
+    for (TreeNodeIndex i = 0; i < numNodes; ++i)
+    {
+        TreeNodeIndex cpuIdx = cpuTree.locate(h_starts[i], h_ends[i]);
+        ASSERT_LT(cpuIdx, cpuTree.numTreeNodes());
+        EXPECT_EQ(h_markings[i], cpuMarkings[cpuIdx]);
+        numMarked += h_markings[i];
+    }
+    EXPECT_GT(numMarked, 0);
+}
+
+template<class KeyType>
+void markMacGpuSmallTree()
+{
+    std::vector<KeyType> tree = OctreeMaker<KeyType>{}.divide().divide(0).divide(7).makeTree();
+    markMacGpuMatchesCpu<KeyType>(tree, Box<double>(0, 1), tree[0], tree[2], 0.58);
+}
+
+TEST(MacsGpu, markMac)
+{
+    markMacGpuSmallTree<unsigned>();
+    markMacGpuSmallTree<uint64_t>();
+}
+
+/*! @brief a uniform level-5 tree with a small theta
+ *
+ * The frontiers exceed the shared memory capacity, such that the depth-first fallback is exercised as well.
+ */
+template<class KeyType>
+void markMacGpuOverflow()
+{
+    std::vector<KeyType> tree = makeUniformNLevelTree<KeyType>(32 * 32 * 32, 1);
+
+    KeyType focusStart = nodeRange<KeyType>(1);
+    KeyType focusEnd   = 3 * nodeRange<KeyType>(1) + nodeRange<KeyType>(3);
+
+    markMacGpuMatchesCpu<KeyType>(tree, Box<double>(0, 1), focusStart, focusEnd, 0.3);
+    markMacGpuMatchesCpu<KeyType>(tree, Box<double>(0, 1, true), focusStart, focusEnd, 0.3);
+}
+
+TEST(MacsGpu, markMacFrontierOverflow)
+{
+    markMacGpuOverflow<unsigned>();
+    markMacGpuOverflow<uint64_t>();
+}
@@ -0,0 +1,113 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  GPU multipole tests
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <numeric>
+
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+
+#include "gtest/gtest.h"
+
+#include "cstone/gravity/multipole.cuh"
+#include "cstone/tree/octree.hpp"
+
+#include "coord_samples/random.hpp"
+
+using namespace cstone;
+
+//! @brief the GPU multipoles need to match the CPU version for each node
+template<class KeyType>
+void multipolesGpu()
+{
+    using T         = double;
+    constexpr int P = 2;
+    constexpr int numTerms = multipoleNumTerms(P);
+
+    Box<T> box(-1, 1);
+    int numParticles = 10000;
+    RandomGaussianCoordinates<T, KeyType> coords(numParticles, box);
+    std::vector<T> m(numParticles, 1.0);
+
+    auto [leaves, counts] =
+        computeOctree(coords.mortonCodes().data(), coords.mortonCodes().data() + numParticles, 64);
+    std::vector<LocalParticleIndex> layout(nNodes(leaves) + 1, 0);
+    std::inclusive_scan(counts.begin(), counts.end(), layout.begin() + 1);
+
+    Octree<KeyType> cpuTree;
+    cpuTree.update(leaves.begin(), leaves.end());
+    Multipoles<T, P> cpuMultipoles;
+    computeMultipoles(cpuTree, layout.data(), coords.x().data(), coords.y().data(), coords.z().data(), m.data(), box,
+                      cpuMultipoles);
+
+    thrust::device_vector<KeyType> d_leaves = leaves;
+    OctreeGpu<KeyType> gpuTree;
+    gpuTree.update(thrust::raw_pointer_cast(d_leaves.data()),
+                   thrust::raw_pointer_cast(d_leaves.data()) + d_leaves.size());
+
+    thrust::device_vector<LocalParticleIndex> d_layout = layout;
+    thrust::device_vector<T> d_x = coords.x(), d_y = coords.y(), d_z = coords.z(), d_m = m;
+
+    TreeNodeIndex numNodes = gpuTree.numTreeNodes();
+    thrust::device_vector<T> d_cx(numNodes), d_cy(numNodes), d_cz(numNodes), d_moments(numNodes * numTerms);
+    MultipoleView<T, P> d_view{thrust::raw_pointer_cast(d_cx.data()), thrust::raw_pointer_cast(d_cy.data()),
+                               thrust::raw_pointer_cast(d_cz.data()), thrust::raw_pointer_cast(d_moments.data()),
+                               numNodes};
+
+    computeMultipolesGpu<T, P, KeyType>(gpuTree, thrust::raw_pointer_cast(d_layout.data()),
+                                        thrust::raw_pointer_cast(d_x.data()), thrust::raw_pointer_cast(d_y.data()),
+                                        thrust::raw_pointer_cast(d_z.data()), thrust::raw_pointer_cast(d_m.data()), box,
+                                        d_view);
+
+    thrust::host_vector<T> h_cx = d_cx, h_moments = d_moments;
+    thrust::host_vector<OctreeNode<KeyType>> h_internal(gpuTree.numInternalNodes());
+    thrust::copy(gpuTree.data().internalTree, gpuTree.data().internalTree + gpuTree.numInternalNodes(),
+                 h_internal.begin());
+
+    // internal nodes with equal max depth may be ordered differently, compare via the node keys
+    for (TreeNodeIndex i = 0; i < gpuTree.numInternalNodes(); ++i)
+    {
+        KeyType start          = h_internal[i].prefix;
+        KeyType end            = start + nodeRange<KeyType>(h_internal[i].level);
+        TreeNodeIndex cpuIndex = cpuTree.locate(start, end);
+
+        EXPECT_NEAR(h_cx[i], cpuMultipoles.centerX(cpuIndex), 1e-12);
+        for (int t = 0; t < numTerms; ++t)
+        {
+            EXPECT_NEAR(h_moments[t * numNodes + i], cpuMultipoles.view().moment(cpuIndex, t), 1e-9);
+        }
+    }
+}
+
+TEST(MultipoleGpu, computeMultipoles)
+{
+    multipolesGpu<unsigned>();
+    multipolesGpu<uint64_t>();
+}
@@ -84,4 +84,59 @@ TEST(InternalOctreeGpu, nodeDepthsThreading)
 {
     nodeDepthThreading<unsigned>();
     nodeDepthThreading<uint64_t>();
-}
\ No newline at end of file
+}
+//! @brief extract node key ranges and parent keys through the device view
+template<class KeyType>
+__global__ void extractNodes(OctreeGpuDataView<KeyType> tree, KeyType* starts, KeyType* ends, KeyType* parentStarts)
+{
+    unsigned tid = blockDim.x * blockIdx.x + threadIdx.x;
+    if (tid < tree.numTreeNodes())
+    {
+        starts[tid]       = tree.codeStart(tid);
+        ends[tid]         = tree.codeEnd(tid);
+        parentStarts[tid] = tree.codeStart(tree.parent(tid));
+    }
+}
+
+//! @brief the tree built on the device has to match the CPU tree up to the order of nodes with equal max depth
+template<class KeyType>
+void octreeGpuMatchesCpu()
+{
+    std::vector<KeyType> leaves = OctreeMaker<KeyType>{}.divide().divide(0).divide(0, 2).divide(3).divide(3, 7).makeTree();
+
+    Octree<KeyType> cpuTree;
+    cpuTree.update(begin(leaves), end(leaves));
+
+    thrust::device_vector<KeyType> d_leaves = leaves;
+    OctreeGpu<KeyType> gpuTree;
+    gpuTree.update(thrust::raw_pointer_cast(d_leaves.data()), thrust::raw_pointer_cast(d_leaves.data()) + d_leaves.size());
+
+    ASSERT_EQ(gpuTree.numTreeNodes(), cpuTree.numTreeNodes());
+    for (int depth = 0; depth < maxTreeLevel<KeyType>{}; ++depth)
+    {
+        EXPECT_EQ(gpuTree.numTreeNodes(depth), cpuTree.numTreeNodes(depth));
+    }
+
+    TreeNodeIndex numNodes = gpuTree.numTreeNodes();
+    thrust::device_vector<KeyType> starts(numNodes), ends(numNodes), parentStarts(numNodes);
+
+    constexpr int nThreads = 256;
+    extractNodes<<<iceil(numNodes, nThreads), nThreads>>>(gpuTree.data(), thrust::raw_pointer_cast(starts.data()),
+                                                          thrust::raw_pointer_cast(ends.data()),
+                                                          thrust::raw_pointer_cast(parentStarts.data()));
+
+    thrust::host_vector<KeyType> h_starts = starts, h_ends = ends, h_parentStarts = parentStarts;
+    for (TreeNodeIndex i = 0; i < numNodes; ++i)
+    {
+        TreeNodeIndex cpuIdx = cpuTree.locate(h_starts[i], h_ends[i]);
+        ASSERT_LT(cpuIdx, cpuTree.numTreeNodes());
+        EXPECT_EQ(cpuTree.isLeaf(cpuIdx), i >= gpuTree.numInternalNodes());
+        EXPECT_EQ(cpuTree.codeStart(cpuTree.parent(cpuIdx)), h_parentStarts[i]);
+    }
+}
+
+TEST(InternalOctreeGpu, octreeGpuMatchesCpu)
+{
+    octreeGpuMatchesCpu<unsigned>();
+    octreeGpuMatchesCpu<uint64_t>();
+}
@@ -0,0 +1,100 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  Tests the GPU implementations of the accelerator primitives against the CPU ones
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+
+#include "gtest/gtest.h"
+
+#include "cstone/primitives/accelerator.hpp"
+
+using namespace cstone;
+
+template<class T>
+T* rawPtr(thrust::device_vector<T>& v)
+{
+    return thrust::raw_pointer_cast(v.data());
+}
+
+TEST(AcceleratorPrimitivesGpu, matchCpu)
+{
+    std::size_t n = 100000;
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<unsigned> distribution(0, 1000000);
+
+    std::vector<unsigned> keys(n);
+    std::generate(keys.begin(), keys.end(), [&]() { return distribution(gen); });
+    std::vector<unsigned> values(n);
+    std::iota(values.begin(), values.end(), 0);
+
+    thrust::device_vector<unsigned> d_keys = keys, d_values = values;
+    sortByKey(CpuTag{}, keys.data(), values.data(), n);
+    sortByKey(CudaTag{}, rawPtr(d_keys), rawPtr(d_values), n);
+    EXPECT_EQ(keys, std::vector<unsigned>(thrust::host_vector<unsigned>(d_keys).begin(),
+                                          thrust::host_vector<unsigned>(d_keys).end()));
+
+    std::vector<uint64_t> in(n, 3), out(n);
+    thrust::device_vector<uint64_t> d_in = in, d_out(n);
+    exclusiveScan(CpuTag{}, in.data(), out.data(), n);
+    exclusiveScan(CudaTag{}, rawPtr(d_in), rawPtr(d_out), n);
+    EXPECT_EQ(uint64_t(d_out[n - 1]), out[n - 1]);
+
+    inclusiveScan(CpuTag{}, in.data(), out.data(), n);
+    inclusiveScan(CudaTag{}, rawPtr(d_in), rawPtr(d_out), n);
+    EXPECT_EQ(uint64_t(d_out[n - 1]), out[n - 1]);
+
+    auto [minimum, maximum] = minMax(CudaTag{}, rawPtr(d_keys), n);
+    EXPECT_EQ(minimum, keys.front());
+    EXPECT_EQ(maximum, keys.back());
+
+    std::vector<double> x(n);
+    std::iota(x.begin(), x.end(), 0.5);
+    thrust::device_vector<double> d_x = x, d_gathered(n), d_scattered(n);
+    gatherValues(CudaTag{}, rawPtr(d_values), n, rawPtr(d_x), rawPtr(d_gathered));
+    scatterValues(CudaTag{}, rawPtr(d_values), n, rawPtr(d_gathered), rawPtr(d_scattered));
+    EXPECT_EQ(double(d_gathered[0]), x[values[0]]);
+    EXPECT_EQ(double(d_scattered[n - 1]), x[n - 1]);
+
+    std::vector<unsigned> offsets{0, 10, 10, 1000, unsigned(n)};
+    thrust::device_vector<unsigned> d_offsets = offsets;
+    std::vector<double> sums(offsets.size() - 1);
+    thrust::device_vector<double> d_sums(sums.size());
+    segmentedReduce(CpuTag{}, x.data(), offsets.data(), sums.size(), sums.data());
+    segmentedReduce(CudaTag{}, rawPtr(d_x), rawPtr(d_offsets), sums.size(), rawPtr(d_sums));
+    for (std::size_t s = 0; s < sums.size(); ++s)
+    {
+        EXPECT_NEAR(double(d_sums[s]), sums[s], 1e-10 * std::abs(sums[s]));
+    }
+}
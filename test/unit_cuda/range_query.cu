@@ -0,0 +1,99 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief GPU box and sphere query tests
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <numeric>
+
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+
+#include "gtest/gtest.h"
+
+#include "cstone/tree/octree.hpp"
+#include "cstone/tree/range_query.cuh"
+
+#include "coord_samples/random.hpp"
+
+using namespace cstone;
+
+//! @brief the GPU queries need to find the same ranges as the CPU version
+template<class SfcKind>
+void rangeQueryGpu()
+{
+    using T       = double;
+    using KeyType = SfcKeyType_t<SfcKind>;
+
+    Box<T> box(-1, 1, true);
+    int numParticles = 10000;
+    RandomGaussianCoordinates<T, SfcKind> coords(numParticles, box);
+
+    auto [leaves, counts] =
+        computeOctree(coords.mortonCodes().data(), coords.mortonCodes().data() + numParticles, 16);
+    std::vector<LocalParticleIndex> layout(nNodes(leaves) + 1, 0);
+    std::inclusive_scan(counts.begin(), counts.end(), layout.begin() + 1);
+
+    Octree<KeyType> octree;
+    octree.update(leaves.begin(), leaves.end());
+
+    std::vector<QuerySphere<T>> queries;
+    for (int i = 0; i < 100; ++i)
+    {
+        T c = -0.9 + 0.018 * i;
+        queries.push_back({c, -c, 0.5 * c, 0.05 + 0.003 * i});
+    }
+
+    ParticleRangeLists<LocalParticleIndex> reference;
+    queryParticleRanges<KeyType, SfcKind>(octree, layout.data(), coords.x().data(), coords.y().data(),
+                                          coords.z().data(), box, queries.data(), queries.size(), reference);
+
+    thrust::device_vector<LocalParticleIndex> d_layout = layout;
+    thrust::device_vector<T> d_x = coords.x(), d_y = coords.y(), d_z = coords.z();
+    thrust::device_vector<QuerySphere<T>> d_queries = queries;
+
+    DeviceParticleRangeLists<LocalParticleIndex> result;
+    queryParticleRangesGpu<KeyType, SfcKind>(
+        octree, thrust::raw_pointer_cast(d_layout.data()), thrust::raw_pointer_cast(d_x.data()),
+        thrust::raw_pointer_cast(d_y.data()), thrust::raw_pointer_cast(d_z.data()), box,
+        thrust::raw_pointer_cast(d_queries.data()), queries.size(), result);
+
+    thrust::host_vector<std::size_t> offsets             = result.offsets;
+    thrust::host_vector<LocalParticleIndex> rangeStarts = result.rangeStarts;
+    thrust::host_vector<LocalParticleIndex> rangeEnds   = result.rangeEnds;
+
+    EXPECT_EQ(std::vector<std::size_t>(offsets.begin(), offsets.end()), reference.offsets);
+    EXPECT_EQ(std::vector<LocalParticleIndex>(rangeStarts.begin(), rangeStarts.end()), reference.rangeStarts);
+    EXPECT_EQ(std::vector<LocalParticleIndex>(rangeEnds.begin(), rangeEnds.end()), reference.rangeEnds);
+}
+
+TEST(RangeQueryGpu, matchesCpu)
+{
+    rangeQueryGpu<MortonKey<unsigned>>();
+    rangeQueryGpu<HilbertKey<uint64_t>>();
+}
@@ -0,0 +1,108 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  SFC key and bounding box computation on the GPU
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+
+#include "gtest/gtest.h"
+
+#include "cstone/sfc/box.cuh"
+#include "cstone/sfc/sfc.cuh"
+#include "coord_samples/random.hpp"
+
+using namespace cstone;
+
+template<class SfcKind, class T>
+void sfcKeysGpu()
+{
+    using KeyType = SfcKeyType_t<SfcKind>;
+
+    Box<T> box(-1, 1, 0, 2, -3, 1);
+    RandomCoordinates<T, SfcKind> coords(10000, box);
+
+    thrust::device_vector<T> x = coords.x();
+    thrust::device_vector<T> y = coords.y();
+    thrust::device_vector<T> z = coords.z();
+    thrust::device_vector<KeyType> d_keys(x.size());
+
+    computeSfcKeysGpu<SfcKind>(thrust::raw_pointer_cast(x.data()), thrust::raw_pointer_cast(y.data()),
+                               thrust::raw_pointer_cast(z.data()), thrust::raw_pointer_cast(d_keys.data()),
+                               x.size(), box);
+
+    thrust::host_vector<KeyType> h_keys = d_keys;
+    std::vector<KeyType> keys(h_keys.begin(), h_keys.end());
+
+    EXPECT_EQ(keys, coords.mortonCodes());
+}
+
+TEST(SfcGpu, computeKeys)
+{
+    sfcKeysGpu<unsigned, float>();
+    sfcKeysGpu<uint64_t, double>();
+    sfcKeysGpu<HilbertKey<unsigned>, float>();
+    sfcKeysGpu<HilbertKey<uint64_t>, double>();
+}
+
+template<class T>
+void localBoxGpu()
+{
+    Box<T> refBox(-1, 1, 0, 2, -3, 1);
+    RandomCoordinates<T, unsigned> coords(10000, refBox);
+
+    thrust::device_vector<T> x = coords.x();
+    thrust::device_vector<T> y = coords.y();
+    thrust::device_vector<T> z = coords.z();
+
+    const T* d_x = thrust::raw_pointer_cast(x.data());
+    const T* d_y = thrust::raw_pointer_cast(y.data());
+    const T* d_z = thrust::raw_pointer_cast(z.data());
+
+    pair<T> xLimits = minMaxGpu(d_x, d_x + x.size());
+    EXPECT_EQ(xLimits[0], *std::min_element(coords.x().begin(), coords.x().end()));
+    EXPECT_EQ(xLimits[1], *std::max_element(coords.x().begin(), coords.x().end()));
+
+    Box<T> box = makeLocalBoxGpu(d_x, d_y, d_z, x.size(), Box<T>{0, 1});
+    EXPECT_EQ(box.zmin(), *std::min_element(coords.z().begin(), coords.z().end()));
+    EXPECT_EQ(box.zmax(), *std::max_element(coords.z().begin(), coords.z().end()));
+
+    // limits of periodic dimensions are not modified
+    Box<T> pbcBox = makeLocalBoxGpu(d_x, d_y, d_z, x.size(), Box<T>{-5, 5, 0, 1, 0, 1, true, false, false});
+    EXPECT_EQ(pbcBox.xmin(), T(-5));
+    EXPECT_EQ(pbcBox.xmax(), T(5));
+    EXPECT_EQ(pbcBox.ymin(), *std::min_element(coords.y().begin(), coords.y().end()));
+    EXPECT_TRUE(pbcBox.pbcX());
+}
+
+TEST(SfcGpu, localBox)
+{
+    localBoxGpu<float>();
+    localBoxGpu<double>();
+}
@@ -0,0 +1,157 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 CSCS, ETH Zurich
+ *               2021 University of Basel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*! @file
+ * @brief  GPU octree upsweep tests
+ *
+ * @author Sebastian Keller <sebastian.f.keller@gmail.com>
+ */
+
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+
+#include "gtest/gtest.h"
+
+#include "cstone/tree/upsweep.cuh"
+#include "cstone/tree/octree_util.hpp"
+
+using namespace cstone;
+
+struct SumCombination
+{
+    template<class T>
+    __host__ __device__ T operator()(T a, T b, T c, T d, T e, T f, T g, T h) const
+    {
+        return a + b + c + d + e + f + g + h;
+    }
+};
+
+//! @brief the GPU upsweep needs to produce the same result as the CPU version for each node
+template<class KeyType>
+void upsweepSumGpu()
+{
+    std::vector<KeyType> leaves = OctreeMaker<KeyType>{}.divide().divide(0).divide(0, 2).divide(3).divide(3, 7).makeTree();
+
+    Octree<KeyType> cpuTree;
+    cpuTree.update(begin(leaves), end(leaves));
+
+    std::vector<unsigned> cpuCounts(cpuTree.numTreeNodes(), 0);
+    for (TreeNodeIndex i = 0; i < cpuTree.numLeafNodes(); ++i)
+    {
+        cpuCounts[cpuTree.numInternalNodes() + i] = i;
+    }
+    upsweep(cpuTree, cpuCounts.data() + cpuTree.numInternalNodes(), cpuCounts.data(), SumCombination{});
+
+    thrust::device_vector<KeyType> d_leaves = leaves;
+    OctreeGpu<KeyType> gpuTree;
+    gpuTree.update(thrust::raw_pointer_cast(d_leaves.data()), thrust::raw_pointer_cast(d_leaves.data()) + d_leaves.size());
+
+    thrust::host_vector<unsigned> h_counts(gpuTree.numTreeNodes(), 0);
+    for (TreeNodeIndex i = 0; i < gpuTree.numLeafNodes(); ++i)
+    {
+        h_counts[gpuTree.numInternalNodes() + i] = i;
+    }
+    thrust::device_vector<unsigned> d_counts = h_counts;
+    unsigned* countsPtr = thrust::raw_pointer_cast(d_counts.data());
+    upsweep(gpuTree, countsPtr + gpuTree.numInternalNodes(), countsPtr, SumCombination{});
+
+    h_counts = d_counts;
+
+    // internal nodes with equal max depth may be ordered differently, compare via the node keys
+    thrust::host_vector<OctreeNode<KeyType>> h_internal(gpuTree.numInternalNodes());
+    thrust::copy(gpuTree.data().internalTree, gpuTree.data().internalTree + gpuTree.numInternalNodes(), h_internal.begin());
+    for (TreeNodeIndex i = 0; i < gpuTree.numInternalNodes(); ++i)
+    {
+        KeyType start = h_internal[i].prefix;
+        KeyType end   = start + nodeRange<KeyType>(h_internal[i].level);
+        EXPECT_EQ(h_counts[i], cpuCounts[cpuTree.locate(start, end)]);
+    }
+    EXPECT_EQ(h_counts[0], cpuCounts[0]);
+}
+
+TEST(UpsweepGpu, sum)
+{
+    upsweepSumGpu<unsigned>();
+    upsweepSumGpu<uint64_t>();
+}
+
+struct MaxCombination
+{
+    template<class T>
+    __host__ __device__ T operator()(T a, T b, T c, T d, T e, T f, T g, T h) const
+    {
+        return max(max(max(a, b), max(c, d)), max(max(e, f), max(g, h)));
+    }
+};
+
+//! @brief the multi-field GPU upsweep needs to match one GPU upsweep per field
+template<class KeyType>
+void upsweepFieldsGpu()
+{
+    std::vector<KeyType> leaves = OctreeMaker<KeyType>{}.divide().divide(0).divide(0, 2).divide(3).divide(3, 7).makeTree();
+
+    thrust::device_vector<KeyType> d_leaves = leaves;
+    OctreeGpu<KeyType> gpuTree;
+    gpuTree.update(thrust::raw_pointer_cast(d_leaves.data()), thrust::raw_pointer_cast(d_leaves.data()) + d_leaves.size());
+
+    TreeNodeIndex numLeaves   = gpuTree.numLeafNodes();
+    TreeNodeIndex numInternal = gpuTree.numInternalNodes();
+
+    thrust::host_vector<unsigned> h_leafCounts(numLeaves);
+    thrust::host_vector<float> h_leafH(numLeaves);
+    for (TreeNodeIndex i = 0; i < numLeaves; ++i)
+    {
+        h_leafCounts[i] = i % 5;
+        h_leafH[i]      = 0.1f * (i % 7);
+    }
+    thrust::device_vector<unsigned> leafCounts = h_leafCounts;
+    thrust::device_vector<float> leafH         = h_leafH;
+
+    thrust::device_vector<unsigned> refCounts(numInternal), counts(numInternal);
+    thrust::device_vector<float> refH(numInternal), h(numInternal);
+
+    upsweep(gpuTree, thrust::raw_pointer_cast(leafCounts.data()), thrust::raw_pointer_cast(refCounts.data()),
+            SumCombination{});
+    upsweep(gpuTree, thrust::raw_pointer_cast(leafH.data()), thrust::raw_pointer_cast(refH.data()), MaxCombination{});
+
+    upsweepFields(gpuTree, std::make_tuple(upsweepField(thrust::raw_pointer_cast(leafCounts.data()),
+                                                        thrust::raw_pointer_cast(counts.data()), SumCombination{}),
+                                           upsweepField(thrust::raw_pointer_cast(leafH.data()),
+                                                        thrust::raw_pointer_cast(h.data()), MaxCombination{})));
+
+    thrust::host_vector<unsigned> h_refCounts = refCounts, h_counts = counts;
+    thrust::host_vector<float> h_refH = refH, h_h = h;
+    for (TreeNodeIndex i = 0; i < numInternal; ++i)
+    {
+        EXPECT_EQ(h_counts[i], h_refCounts[i]);
+        EXPECT_EQ(h_h[i], h_refH[i]);
+    }
+}
+
+TEST(UpsweepGpu, fields)
+{
+    upsweepFieldsGpu<unsigned>();
+    upsweepFieldsGpu<uint64_t>();
+}